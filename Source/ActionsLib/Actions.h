@@ -32,6 +32,10 @@ template <typename ElemType>
 void DoCrossValidate(const ConfigParameters& config);
 template <typename ElemType>
 void DoWriteOutput(const ConfigParameters& config);
+template <typename ElemType>
+void DoBenchmarkTraversal(const ConfigParameters& config);
+template <typename ElemType>
+void DoCompareQuantizedModel(const ConfigParameters& config);
 
 // misc (OtherActions.cp)
 template <typename ElemType>
@@ -39,6 +43,8 @@ void DoCreateLabelMap(const ConfigParameters& config);
 template <typename ElemType>
 void DoParameterSVD(const ConfigParameters& config);
 template <typename ElemType>
+void DoConvertModel(const ConfigParameters& config);
+template <typename ElemType>
 void DoWriteWordAndClassInfo(const ConfigParameters& config);
 template <typename ElemType>
 void DoTopologyPlot(const ConfigParameters& config);
@@ -18,6 +18,7 @@
 #include "SimpleEvaluator.h"
 #include "SimpleOutputWriter.h"
 #include "BestGpu.h"
+#include "TimerUtility.h"
 #include "ScriptableObjects.h"
 #include "BrainScriptEvaluator.h"
 
@@ -38,6 +39,28 @@ using namespace std;
 using namespace Microsoft::MSR;
 using namespace Microsoft::MSR::CNTK;
 
+// foldBatchNormalization: fold the BatchNormalization nodes into the weights of the Times or Convolution nodes they follow
+template <typename ElemType>
+static void FoldBatchNormalizationIfRequested(const ConfigParameters& config, const ComputationNetworkPtr& net)
+{
+    if (!config(L"foldBatchNormalization", false))
+        return;
+    net->SetBatchNormlizationNodesBelowEvalMode(true);
+    size_t numFolded = net->FoldBatchNormalizationNodes<ElemType>();
+    fprintf(stderr, "Folded %d BatchNormalization nodes.\n", (int) numFolded);
+    if (numFolded > 0)
+        net->CompileNetwork();
+}
+
+// quantizeWeights: evaluate the Times and Convolution nodes with 8- or 16-bit integer weights (CPU only)
+template <typename ElemType>
+static void QuantizeWeightsIfRequested(const ConfigParameters& config, const ComputationNetworkPtr& net)
+{
+    size_t numBits = config(L"quantizeWeights", (size_t) 0);
+    if (numBits != 0)
+        net->QuantizeWeights<ElemType>(numBits);
+}
+
 // ===========================================================================
 // DoEvalBase() - implements CNTK "eval" command
 // ===========================================================================
@@ -65,7 +88,10 @@ static void DoEvalBase(const ConfigParameters& config, IDataReader<ElemType>& re
         evalNodeNamesVector.push_back(evalNodeNames[i]);
     }
 
-    auto net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelPath);
+    bool memoryMapModel = config(L"memoryMapModel", false);
+    auto net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelPath, memoryMapModel ? (FileOptions)(fileOptionsBinary | fileOptionsMemoryMapped) : fileOptionsBinary);
+    FoldBatchNormalizationIfRequested<ElemType>(config, net);
+    QuantizeWeightsIfRequested<ElemType>(config, net);
 
     SimpleEvaluator<ElemType> eval(net, numMBsToShowResult, traceLevel);
     eval.Evaluate(&reader, evalNodeNamesVector, mbSize[0], epochSize);
@@ -226,7 +252,10 @@ void DoWriteOutput(const ConfigParameters& config)
         outputNodeNamesVector.push_back(outputNodeNames[i]);
     }
 
-    auto net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelPath);
+    bool memoryMapModel = config(L"memoryMapModel", false);
+    auto net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelPath, memoryMapModel ? (FileOptions)(fileOptionsBinary | fileOptionsMemoryMapped) : fileOptionsBinary);
+    FoldBatchNormalizationIfRequested<ElemType>(config, net);
+    QuantizeWeightsIfRequested<ElemType>(config, net);
 
     SimpleOutputWriter<ElemType> writer(net, 1);
 
@@ -247,3 +276,238 @@ void DoWriteOutput(const ConfigParameters& config)
 
 template void DoWriteOutput<float>(const ConfigParameters& config);
 template void DoWriteOutput<double>(const ConfigParameters& config);
+
+// ===========================================================================
+// DoCompareQuantizedModel() - implements CNTK "compareQuantizedModel" command
+// Evaluates a model once as is and once with quantized weights on the same data,
+// and reports how much the outputs and the evaluation criteria differ.
+// ===========================================================================
+
+template <typename ElemType>
+void DoCompareQuantizedModel(const ConfigParameters& config)
+{
+    ConfigParameters readerConfig(config(L"reader"));
+    readerConfig.Insert("traceLevel", config(L"traceLevel", "0"));
+    readerConfig.Insert("randomize", "None");
+
+    DEVICEID_TYPE deviceId = DeviceFromConfig(config);
+    if (deviceId != CPUDEVICE)
+        InvalidArgument("compareQuantizedModel: Quantized weights are only supported on the CPU (deviceId=-1).");
+    wstring modelPath = config(L"modelPath");
+    size_t mbSize = config(L"minibatchSize", "256");
+    size_t epochSize = config(L"epochSize", "0");
+    if (epochSize == 0)
+        epochSize = requestDataSize;
+    size_t numBits = config(L"quantizeWeights", "8");
+
+    DataReader<ElemType> reader(readerConfig);
+    auto net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelPath);
+    auto quantizedNet = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelPath);
+    FoldBatchNormalizationIfRequested<ElemType>(config, net); // (both or neither, so that only the effect of quantization is measured)
+    FoldBatchNormalizationIfRequested<ElemType>(config, quantizedNet);
+    if (quantizedNet->template QuantizeWeights<ElemType>(numBits) == 0)
+        InvalidArgument("compareQuantizedModel: The model has no weights that can be quantized.");
+
+    // the outputs to compare, and the criteria (which need labels from the reader)
+    ConfigArray outputNodeNames = config(L"outputNodeNames", "");
+    vector<ComputationNodeBasePtr> outputNodes;
+    for (size_t i = 0; i < outputNodeNames.size(); ++i)
+        outputNodes.push_back(net->GetNodeFromName(outputNodeNames[i]));
+    if (outputNodes.empty())
+        outputNodes = net->OutputNodes();
+    vector<ComputationNodeBasePtr> evalNodes = net->EvaluationNodes();
+    for (const auto& node : net->FinalCriterionNodes())
+    {
+        if (find(evalNodes.begin(), evalNodes.end(), node) == evalNodes.end())
+            evalNodes.push_back(node);
+    }
+    if (outputNodes.empty() && evalNodes.empty())
+        InvalidArgument("compareQuantizedModel: There are no output or evaluation nodes to compare.");
+    auto nodesIn = [](const ComputationNetworkPtr& toNet, const vector<ComputationNodeBasePtr>& nodes)
+    {
+        vector<ComputationNodeBasePtr> result;
+        for (const auto& node : nodes)
+            result.push_back(toNet->GetNodeFromName(node->NodeName()));
+        return result;
+    };
+    vector<ComputationNodeBasePtr> quantizedOutputNodes = nodesIn(quantizedNet, outputNodes);
+    vector<ComputationNodeBasePtr> quantizedEvalNodes = nodesIn(quantizedNet, evalNodes);
+    vector<ComputationNodeBasePtr> roots = outputNodes, quantizedRoots = quantizedOutputNodes;
+    roots.insert(roots.end(), evalNodes.begin(), evalNodes.end());
+    quantizedRoots.insert(quantizedRoots.end(), quantizedEvalNodes.begin(), quantizedEvalNodes.end());
+
+    net->AllocateAllMatrices(evalNodes, outputNodes, nullptr);
+    quantizedNet->AllocateAllMatrices(quantizedEvalNodes, quantizedOutputNodes, nullptr);
+
+    // the reader fills the inputs of the float network, which are then copied into those of the quantized one
+    vector<ComputationNodeBasePtr> inputNodes = net->FeatureNodes();
+    inputNodes.insert(inputNodes.end(), net->LabelNodes().begin(), net->LabelNodes().end());
+    vector<ComputationNodeBasePtr> quantizedInputNodes = nodesIn(quantizedNet, inputNodes);
+    std::map<std::wstring, Matrix<ElemType>*> inputMatrices;
+    for (const auto& node : inputNodes)
+        inputMatrices[node->NodeName()] = &node->As<ComputationNode<ElemType>>()->Value();
+
+    struct OutputStatistics
+    {
+        double maxAbsError = 0, sumSquaredError = 0, sumSquaredValue = 0;
+        size_t numColumns = 0, numArgMaxMatches = 0;
+    };
+    vector<OutputStatistics> outputStatistics(outputNodes.size());
+    vector<double> evalResults(evalNodes.size(), 0), quantizedEvalResults(evalNodes.size(), 0);
+    size_t numSamples = 0, numSamplesWithLabel = 0;
+
+    reader.StartMinibatchLoop(mbSize, 0, epochSize);
+    net->StartEvaluateMinibatchLoop(roots);
+    quantizedNet->StartEvaluateMinibatchLoop(quantizedRoots);
+    size_t actualMBSize;
+    while (DataReaderHelpers::GetMinibatchIntoNetwork(reader, net, nullptr, false, false, inputMatrices, actualMBSize))
+    {
+        quantizedNet->GetMBLayoutPtr()->CopyFrom(net->GetMBLayoutPtr());
+        for (size_t i = 0; i < inputNodes.size(); i++)
+        {
+            quantizedInputNodes[i]->As<ComputationNode<ElemType>>()->Value().SetValue(inputNodes[i]->As<ComputationNode<ElemType>>()->Value());
+            quantizedInputNodes[i]->NotifyFunctionValuesMBSizeModified();
+        }
+        ComputationNetwork::BumpEvalTimeStamp(inputNodes);
+        ComputationNetwork::BumpEvalTimeStamp(quantizedInputNodes);
+
+        for (size_t i = 0; i < roots.size(); i++)
+        {
+            net->ForwardProp(roots[i]);
+            quantizedNet->ForwardProp(quantizedRoots[i]);
+        }
+
+        for (size_t i = 0; i < outputNodes.size(); i++)
+        {
+            const auto& value = outputNodes[i]->As<ComputationNode<ElemType>>()->Value();
+            const auto& quantizedValue = quantizedOutputNodes[i]->As<ComputationNode<ElemType>>()->Value();
+            unique_ptr<ElemType[]> a(value.CopyToArray()), b(quantizedValue.CopyToArray());
+            size_t rows = value.GetNumRows();
+            auto pMBLayout = outputNodes[i]->GetMBLayout();
+            size_t S = pMBLayout ? pMBLayout->GetNumParallelSequences() : 1;
+            auto& statistics = outputStatistics[i];
+            for (size_t j = 0; j < value.GetNumCols(); j++)
+            {
+                if (pMBLayout && pMBLayout->IsGap(FrameRange(pMBLayout, j / S).Sequence(j % S)))
+                    continue;
+                size_t argMax = 0, quantizedArgMax = 0;
+                for (size_t k = 0; k < rows; k++)
+                {
+                    double x = a[j * rows + k], y = b[j * rows + k];
+                    statistics.maxAbsError = max(statistics.maxAbsError, fabs(x - y));
+                    statistics.sumSquaredError += (x - y) * (x - y);
+                    statistics.sumSquaredValue += x * x;
+                    if (a[j * rows + k] > a[j * rows + argMax])
+                        argMax = k;
+                    if (b[j * rows + k] > b[j * rows + quantizedArgMax])
+                        quantizedArgMax = k;
+                }
+                statistics.numColumns++;
+                statistics.numArgMaxMatches += argMax == quantizedArgMax;
+            }
+        }
+        for (size_t i = 0; i < evalNodes.size(); i++)
+        {
+            evalResults[i] += (double) evalNodes[i]->Get00Element();
+            quantizedEvalResults[i] += (double) quantizedEvalNodes[i]->Get00Element();
+        }
+        numSamples += actualMBSize;
+        numSamplesWithLabel += net->GetNumSamplesWithLabel(actualMBSize);
+
+        reader.DataEnd(endDataSentence);
+    }
+
+    fprintf(stderr, "compareQuantizedModel: %d samples, %d-bit weights.\n", (int) numSamples, (int) numBits);
+    for (size_t i = 0; i < outputNodes.size(); i++)
+    {
+        const auto& statistics = outputStatistics[i];
+        fprintf(stderr, "\t%ls: max abs error = %.6g, rms error / rms value = %.6g, argmax agreement = %.4f%%\n", outputNodes[i]->NodeName().c_str(),
+                statistics.maxAbsError, statistics.sumSquaredValue > 0 ? sqrt(statistics.sumSquaredError / statistics.sumSquaredValue) : 0.0,
+                statistics.numColumns > 0 ? 100.0 * statistics.numArgMaxMatches / statistics.numColumns : 100.0);
+    }
+    for (size_t i = 0; i < evalNodes.size(); i++)
+    {
+        fprintf(stderr, "\t%ls: %.8g (float weights) vs. %.8g (quantized weights)\n", evalNodes[i]->NodeName().c_str(),
+                evalResults[i] / max(numSamplesWithLabel, (size_t) 1), quantizedEvalResults[i] / max(numSamplesWithLabel, (size_t) 1));
+    }
+}
+
+template void DoCompareQuantizedModel<float>(const ConfigParameters& config);
+template void DoCompareQuantizedModel<double>(const ConfigParameters& config);
+
+// ===========================================================================
+// DoBenchmarkTraversal() - implements CNTK "benchmarkTraversal" command
+// Times forward and backward propagation of one minibatch, once walking the
+// nodes one by one and once running independent nodes concurrently.
+// ===========================================================================
+
+template <typename ElemType>
+void DoBenchmarkTraversal(const ConfigParameters& config)
+{
+    ConfigParameters readerConfig(config(L"reader"));
+    readerConfig.Insert("traceLevel", config(L"traceLevel", "0"));
+
+    DEVICEID_TYPE deviceId = DeviceFromConfig(config);
+    wstring modelPath = config(L"modelPath");
+    size_t mbSize = config(L"minibatchSize", "256");
+    size_t numIterations = config(L"numIterations", "20");
+    size_t numThreads = config(L"parallelTraversalThreads", "4");
+    if (numThreads == 0 || numIterations == 0)
+        InvalidArgument("benchmarkTraversal: parallelTraversalThreads and numIterations must be positive.");
+
+    DataReader<ElemType> reader(readerConfig);
+    auto net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelPath);
+    if (net->FinalCriterionNodes().empty())
+        InvalidArgument("benchmarkTraversal: The network has no training criterion.");
+    auto criterionNode = net->FinalCriterionNodes()[0];
+
+    // the dependency graphs are determined while allocating, so the switch must be on at that point
+    size_t savedThreads = g_parallelTraversalThreads;
+    g_parallelTraversalThreads = numThreads;
+    net->AllocateAllMatrices({}, {}, criterionNode);
+
+    auto& featureNodes = net->FeatureNodes();
+    auto& labelNodes = net->LabelNodes();
+    std::map<std::wstring, Matrix<ElemType>*> inputMatrices;
+    for (size_t i = 0; i < featureNodes.size(); i++)
+        inputMatrices[featureNodes[i]->NodeName()] = &dynamic_pointer_cast<ComputationNode<ElemType>>(featureNodes[i])->Value();
+    for (size_t i = 0; i < labelNodes.size(); i++)
+        inputMatrices[labelNodes[i]->NodeName()] = &dynamic_pointer_cast<ComputationNode<ElemType>>(labelNodes[i])->Value();
+
+    reader.StartMinibatchLoop(mbSize, 0, requestDataSize);
+    net->StartEvaluateMinibatchLoop(criterionNode);
+    size_t actualMBSize = 0;
+    if (!DataReaderHelpers::GetMinibatchIntoNetwork(reader, net, criterionNode, false, false, inputMatrices, actualMBSize))
+        InvalidArgument("benchmarkTraversal: The reader returned no data.");
+
+    // returns the average time per forward/backward pass, and the criterion value
+    auto timeTraversal = [&](size_t threads, double& criterion) -> double
+    {
+        g_parallelTraversalThreads = threads;
+        Timer timer;
+        for (size_t iter = 0; iter <= numIterations; iter++) // first iteration is warm-up
+        {
+            if (iter == 1)
+                timer.Start();
+            ComputationNetwork::BumpEvalTimeStamp(featureNodes);
+            ComputationNetwork::BumpEvalTimeStamp(labelNodes);
+            net->ForwardProp(criterionNode);
+            net->Backprop(criterionNode);
+        }
+        timer.Stop();
+        criterion = criterionNode->Get00Element();
+        return timer.ElapsedSeconds() / numIterations;
+    };
+
+    double serialCriterion, parallelCriterion;
+    double serialTime = timeTraversal(0, serialCriterion);
+    double parallelTime = timeTraversal(numThreads, parallelCriterion);
+    g_parallelTraversalThreads = savedThreads;
+
+    fprintf(stderr, "benchmarkTraversal: %d samples, %d iterations: serial %.3f ms (criterion %.8g), %d threads %.3f ms (criterion %.8g), speed-up %.2fx\n",
+            (int) actualMBSize, (int) numIterations,
+            serialTime * 1000, serialCriterion, (int) numThreads, parallelTime * 1000, parallelCriterion, serialTime / parallelTime);
+}
+
+template void DoBenchmarkTraversal<float>(const ConfigParameters& config);
+template void DoBenchmarkTraversal<double>(const ConfigParameters& config);
@@ -208,6 +208,29 @@ void DoParameterSVD(const ConfigParameters& config)
 template void DoParameterSVD<float>(const ConfigParameters& config);
 template void DoParameterSVD<double>(const ConfigParameters& config);
 
+// ===========================================================================
+// DoConvertModel() - implements CNTK "convertModel" command
+// Loads a model saved in any supported format version and saves it in the current one,
+// which stores parameters as page-aligned tensors for bulk reading or memory mapping (memoryMapModel=true).
+// ===========================================================================
+
+template <typename ElemType>
+void DoConvertModel(const ConfigParameters& config)
+{
+    wstring modelPath = config(L"modelPath");
+    wstring outputModelPath = config(L"outputModelPath");
+    if (modelPath == outputModelPath)
+        InvalidArgument("convertModel: outputModelPath must be different from modelPath.");
+
+    ComputationNetwork net(CPUDEVICE);
+    net.Load<ElemType>(modelPath);
+    net.Save(outputModelPath);
+    fprintf(stderr, "Converted model %ls to %ls (model version %d).\n", modelPath.c_str(), outputModelPath.c_str(), (int) CURRENT_CNTK_MODEL_VERSION);
+}
+
+template void DoConvertModel<float>(const ConfigParameters& config);
+template void DoConvertModel<double>(const ConfigParameters& config);
+
 // ===========================================================================
 // DoWriteWordAndClassInfo() - implements CNTK "writeWordAndClass" command
 // ===========================================================================
@@ -67,6 +67,9 @@ wstring computationNodes = // TODO: use actual TypeName() here? would first need
     L"ClassificationError = ErrorPrediction \n"
     L"Delay = PastValue \n" // TODO: should it allow negative offsets and an if test here?
     L"BatchNormalization(input, scale, bias, runMean, runInvStdDev, eval, spatial, expAvgFactor, tag='') = new ComputationNode [ operation = 'BatchNormalization' ; inputs = (input : scale : bias : runMean : runInvStdDev) /*plus the function args*/ ]\n"
+    L"LSTM(input, W, R, b, peepholes, defaultHiddenActivation = 0.1, tag='') = new ComputationNode [ operation = 'LSTM' ; inputs = (input : W : R : b : peepholes) /*plus the function args*/ ]\n"
+    L"LSTMP(input, W, R, b, peepholes, projection, defaultHiddenActivation = 0.1, tag='') = new ComputationNode [ operation = 'LSTM' ; inputs = (input : W : R : b : peepholes : projection) /*plus the function args*/ ]\n"
+    L"GRU(input, W, R, b, defaultHiddenActivation = 0.1, tag='') = new ComputationNode [ operation = 'GRU' ; inputs = (input : W : R : b) /*plus the function args*/ ]\n"
 // standard nodes. We use macros to define these strings.
 #define UnaryStandardNode(Op, a) L## #Op L"(" L## #a L", tag='') = new ComputationNode [ operation = '" L## #Op L"' ; inputs = " L## #a L" /*plus the function args*/ ]\n"
 #define BinaryStandardNode(Op, a, b) L## #Op L"(" L## #a L", " L## #b L", tag='') = new ComputationNode [ operation = '" L## #Op L"' ; inputs = (" L## #a L" : " L## #b L") /*plus the function args*/ ]\n"
@@ -19,6 +19,7 @@
 #include "SynchronousExecutionEngine.h"
 #include "ModelEditLanguage.h"
 #include "CPUMatrix.h" // used for SetNumThreads()
+#include "CPUMemAllocator.h"
 #include "CommonMatrix.h"
 #include "SGD.h"
 #include "MPIWrapper.h"
@@ -61,6 +62,12 @@ Microsoft::MSR::CNTK::MPIWrapper* g_mpi = nullptr;
 // sharing is ready to be enabled by default
 bool g_shareNodeValueMatrices = false;
 
+// number of threads for running independent nodes of a network concurrently (CPU only); 0 = one node at a time
+size_t g_parallelTraversalThreads = 0;
+
+// compute trees of elementwise nodes in a single pass (CPU only)
+bool g_fuseElementwiseNodes = false;
+
 using namespace std;
 using namespace Microsoft::MSR;
 using namespace Microsoft::MSR::CNTK;
@@ -145,6 +152,20 @@ static void DisableLegacyUsage(const ConfigParameters& TopLevelConfig, const Con
     }
 }
 
+// set up the allocator for CPU matrix buffers from the top-level config
+template <class ConfigRecordType>
+static void ConfigureCPUMemAllocator(const ConfigRecordType& config)
+{
+    CPUMemAllocatorOptions options;
+    options.cache = config(L"cpuMemCache", options.cache);
+    options.maxCachedBytes = (size_t) config(L"cpuMemCacheLimitMB", (size_t) (options.maxCachedBytes >> 20)) << 20;
+    options.alignment = config(L"cpuMemAlignment", options.alignment);
+    options.hugePages = config(L"cpuMemHugePages", options.hugePages);
+    options.firstTouch = config(L"cpuMemFirstTouch", options.firstTouch);
+    options.traceStatistics = config(L"cpuMemStats", options.traceStatistics);
+    CPUMemAllocator::Instance().SetOptions(options);
+}
+
 // process the command
 template <typename ElemType>
 void DoCommands(const ConfigParameters& config)
@@ -159,6 +180,8 @@ void DoCommands(const ConfigParameters& config)
         std::cerr << "Using " << numCPUThreads << " CPU threads" << endl;
     }
 
+    ConfigureCPUMemAllocator(config);
+
     bool progressTracing = config(L"progressTracing", false);
 
     // temporary hack to prevent users from failling for a small breaking change related to the "truncated" flag (will be redone bigger and better some day)
@@ -265,6 +288,18 @@ void DoCommands(const ConfigParameters& config)
             {
                 DoParameterSVD<ElemType>(commandParams);
             }
+            else if (action[j] == "convertModel")
+            {
+                DoConvertModel<ElemType>(commandParams);
+            }
+            else if (action[j] == "benchmarkTraversal")
+            {
+                DoBenchmarkTraversal<ElemType>(commandParams);
+            }
+            else if (action[j] == "compareQuantizedModel")
+            {
+                DoCompareQuantizedModel<ElemType>(commandParams);
+            }
             else
             {
                 RuntimeError("unknown action: %s  in command set: %s", action[j].c_str(), command[i].c_str());
@@ -430,6 +465,8 @@ int wmainWithBS(int argc, wchar_t* argv[]) // called from wmain which is a wrapp
         g_mpi = new MPIWrapper();
 
     g_shareNodeValueMatrices = config(L"shareNodeValueMatrices", false);
+    g_parallelTraversalThreads = config(L"parallelTraversalThreads", (size_t) 0);
+    g_fuseElementwiseNodes = config(L"fuseElementwiseNodes", false);
 
     TracingGPUMemoryAllocator::SetTraceLevel(config(L"traceGPUMemoryAllocations", 0));
 
@@ -457,6 +494,8 @@ int wmainWithBS(int argc, wchar_t* argv[]) // called from wmain which is a wrapp
     if (numCPUThreads > 0)
         fprintf(stderr, "Using %d CPU threads.\n", numCPUThreads);
 
+    ConfigureCPUMemAllocator(config);
+
     bool progressTracing = config(L"progressTracing", false);
     size_t fullTotalMaxEpochs = 1; // BUGBUG: BS does not allow me to read out the max epochs parameters, as that would instantiate and thus execute the objects
     // set up progress tracing for compute cluster management
@@ -519,6 +558,8 @@ int wmainOldCNTKConfig(int argc, wchar_t* argv[]) // called from wmain which is
     }
 
     g_shareNodeValueMatrices = config(L"shareNodeValueMatrices", false);
+    g_parallelTraversalThreads = config(L"parallelTraversalThreads", (size_t) 0);
+    g_fuseElementwiseNodes = config(L"fuseElementwiseNodes", false);
 
     TracingGPUMemoryAllocator::SetTraceLevel(config(L"traceGPUMemoryAllocations", 0));
 
@@ -176,6 +176,7 @@ bool CheckFunction(std::string& p_nodeType, bool* allowUndeterminedVariable)
 #ifdef COMING_SOON
     else if (EqualInsensitive(nodeType, OperationNameOf(GMMLogLikelihoodNode), L"GMMLL")) ret = true;
 #endif
+    else if (EqualInsensitive(nodeType, OperationNameOf(GRUNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(HardmaxNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(InputValue), L"Input")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(InvStdDevNode))) ret = true;
@@ -185,6 +186,7 @@ bool CheckFunction(std::string& p_nodeType, bool* allowUndeterminedVariable)
     else if (EqualInsensitive(nodeType, OperationNameOf(LogSoftmaxNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(LogisticNode), L"Logistic")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(LookupTableNode))) ret = true;
+    else if (EqualInsensitive(nodeType, OperationNameOf(LSTMNode))) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(MatrixL1RegNode), L"L1Reg")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(MatrixL2RegNode), L"L2Reg")) ret = true;
     else if (EqualInsensitive(nodeType, OperationNameOf(MaxPoolingNode))) ret = true;
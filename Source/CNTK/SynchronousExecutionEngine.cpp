@@ -406,6 +406,28 @@ void SynchronousNodeEvaluator<ElemType>::Evaluate(NDLNode<ElemType>* node, const
             nodePtr = builder.BatchNormalization(nullptr, nullptr, nullptr, nullptr, nullptr, eval, spatial, expAvgFactor, imageLayoutKind, name);
         }
     }
+    else if (cnNodeType == OperationNameOf(LSTMNode) ||
+             cnNodeType == OperationNameOf(GRUNode))
+    {
+        bool isLSTM = cnNodeType == OperationNameOf(LSTMNode);
+        if (isLSTM && parameter.size() != 5 && parameter.size() != 6)
+            RuntimeError("%ls should have 5 or 6 fixed parameters[inputValueNodeName, W, R, b, peepholes, [projection]] and one optional parameter [defaultHiddenActivity=0.1].", cnNodeType.c_str());
+        if (!isLSTM && parameter.size() != 4)
+            RuntimeError("%ls should have 4 fixed parameters[inputValueNodeName, W, R, b] and one optional parameter [defaultHiddenActivity=0.1].", cnNodeType.c_str());
+
+        // all fixed parameters are inputs
+        nodeParamCount = parameter.size();
+        nodeParamStart = 0;
+
+        if (pass == ndlPassInitial)
+        {
+            float defaultHiddenActivity = node->GetOptionalParameter("defaultHiddenActivity", "0.1");
+            if (isLSTM)
+                nodePtr = builder.LSTM(nullptr, nullptr, nullptr, nullptr, nullptr, nullptr /*projection is attached below*/, defaultHiddenActivity, name);
+            else
+                nodePtr = builder.GRU(nullptr, nullptr, nullptr, nullptr, defaultHiddenActivity, name);
+        }
+    }
     else
     {
 
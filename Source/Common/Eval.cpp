@@ -136,6 +136,13 @@ void Eval<ElemType>::ResetState()
     m_eval->ResetState();
 }
 
+// CreateContext - create a context for evaluating the model on one thread
+template <class ElemType>
+IEvaluateContext<ElemType>* Eval<ElemType>::CreateContext(const std::vector<std::wstring>& inputNodeNames, const std::vector<std::wstring>& outputNodeNames)
+{
+    return m_eval->CreateContext(inputNodeNames, outputNodeNames);
+}
+
 //The explicit instantiation
 template class Eval<double>;
 template class Eval<float>;
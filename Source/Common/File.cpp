@@ -20,6 +20,9 @@
 #endif
 #ifdef __unix__
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 
 namespace Microsoft { namespace MSR { namespace CNTK {
@@ -118,6 +121,9 @@ void File::Init(const wchar_t* filename, int fileOptions)
                     m_file = fopenOrDie(filename, options.c_str());
                     m_seekable = true;
                 });
+    // memory-map it as well if requested
+    if ((fileOptions & fileOptionsMemoryMapped) && reading && !writing && m_seekable && !IsTextBased())
+        m_mappedView = make_shared<MappedFileView>(m_filename);
 }
 
 // skip to given delimiter character
@@ -705,6 +711,30 @@ bool File::TryGetMarker(FileMarker marker, const std::string& section)
     return false;
 }
 
+// PadToAlignment - write zero bytes up to the next multiple of 'alignment' (binary files only)
+void File::PadToAlignment(size_t alignment)
+{
+    if (IsTextBased())
+        return;
+    uint64_t pos = GetPosition();
+    size_t padding = (size_t) ((alignment - pos % alignment) % alignment);
+    if (padding > 0)
+    {
+        std::vector<char> zeroes(padding, 0);
+        fwriteOrDie(zeroes.data(), 1, padding, m_file);
+    }
+}
+
+// SkipToAlignment - skip padding written by PadToAlignment()
+void File::SkipToAlignment(size_t alignment)
+{
+    if (IsTextBased())
+        return;
+    uint64_t pos = GetPosition();
+    if (pos % alignment != 0)
+        SetPosition(pos + alignment - pos % alignment);
+}
+
 // GetPosition - Get position in a file
 uint64_t File::GetPosition()
 {
@@ -721,4 +751,68 @@ void File::SetPosition(uint64_t pos)
         RuntimeError("File: attempted to SetPosition() on non-seekable stream");
     fsetpos(m_file, pos);
 }
+
+// -----------------------------------------------------------------------
+// MappedFileView
+// -----------------------------------------------------------------------
+
+MappedFileView::MappedFileView(const std::wstring& filename)
+    : m_data(nullptr), m_size(0)
+{
+#ifdef _WIN32
+    m_mappingHandle = NULL;
+    m_fileHandle = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_fileHandle == INVALID_HANDLE_VALUE)
+        RuntimeError("MappedFileView: failed to open '%ls' (error %d)", filename.c_str(), (int) GetLastError());
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_fileHandle, &size))
+        RuntimeError("MappedFileView: failed to get the size of '%ls' (error %d)", filename.c_str(), (int) GetLastError());
+    m_size = (size_t) size.QuadPart;
+    if (m_size > 0)
+    {
+        m_mappingHandle = CreateFileMappingW(m_fileHandle, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+        if (m_mappingHandle == NULL)
+            RuntimeError("MappedFileView: failed to map '%ls' (error %d)", filename.c_str(), (int) GetLastError());
+        m_data = (char*) MapViewOfFile(m_mappingHandle, FILE_MAP_COPY, 0, 0, 0);
+        if (m_data == nullptr)
+            RuntimeError("MappedFileView: failed to map '%ls' (error %d)", filename.c_str(), (int) GetLastError());
+    }
+#else
+    int fd = open(msra::strfun::utf8(filename).c_str(), O_RDONLY);
+    if (fd < 0)
+        RuntimeError("MappedFileView: failed to open '%ls': %s", filename.c_str(), strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        RuntimeError("MappedFileView: failed to get the size of '%ls': %s", filename.c_str(), strerror(errno));
+    }
+    m_size = (size_t) st.st_size;
+    if (m_size > 0)
+    {
+        void* data = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            RuntimeError("MappedFileView: failed to map '%ls': %s", filename.c_str(), strerror(errno));
+        }
+        m_data = (char*) data;
+    }
+    close(fd); // (the mapping keeps its own reference to the file)
+#endif
+}
+
+MappedFileView::~MappedFileView()
+{
+#ifdef _WIN32
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mappingHandle)
+        CloseHandle(m_mappingHandle);
+    CloseHandle(m_fileHandle);
+#else
+    if (m_data)
+        munmap(m_data, m_size);
+#endif
+}
 } } }
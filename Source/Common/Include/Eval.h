@@ -36,6 +36,27 @@ enum NodeGroup
     nodeSpecified
 };
 
+// IEvaluateContext - a context for evaluating a model on one thread, created by IEvaluateModel::CreateContext()
+// Contexts share the parameters of the model they were created from, but each has its own activation buffers,
+// so different contexts may evaluate concurrently. A single context must not be used by two threads at once.
+// The model must not be reloaded or destroyed while contexts exist.
+template <class ElemType>
+class IEvaluateContext
+{
+public:
+    virtual void Destroy() = 0;
+
+    // Evaluate - evaluate the output nodes of this context for numSamples independent samples (or one sequence of numSamples frames)
+    // inputs - [i] column-major data for input node [i] as passed to CreateContext(), GetNodeDimensions() x numSamples elements
+    // outputs - [i] preallocated buffer for output node [i], GetNodeDimensions() x numSamples elements
+    virtual void Evaluate(const ElemType* const inputs[], ElemType* const outputs[], size_t numSamples) = 0;
+
+    // EvaluateSequences - evaluate several independent sequences in one minibatch (as parallel sequences)
+    // inputs, outputs - like Evaluate(), with the data of all sequences concatenated
+    // sequenceLengths - [s] number of samples of sequence s; single samples are sequences of length 1
+    virtual void EvaluateSequences(const ElemType* const inputs[], ElemType* const outputs[], const std::vector<size_t>& sequenceLengths) = 0;
+};
+
 // IEvaluateModel - interface used by decoders and other components that need just evaluator functionality in DLL form
 template <class ElemType>
 class IEvaluateModel // Evaluate Model Interface
@@ -49,6 +70,7 @@ public:
     virtual void StartEvaluateMinibatchLoop(const std::wstring& outputNodeName) = 0;
     virtual void Evaluate(std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs) = 0;
     virtual void ResetState() = 0;
+    virtual IEvaluateContext<ElemType>* CreateContext(const std::vector<std::wstring>& inputNodeNames, const std::vector<std::wstring>& outputNodeNames) = 0;
 };
 
 // GetEval - get a evaluator type from the DLL
@@ -102,5 +124,11 @@ public:
     virtual void Evaluate(std::map<std::wstring, std::vector<ElemType>*>& inputs, std::map<std::wstring, std::vector<ElemType>*>& outputs);
     virtual void Init(const std::string& config);
     virtual void ResetState();
+
+    // CreateContext - create a context for evaluating the model on one thread, see IEvaluateContext
+    // inputNodeNames - input nodes whose data is passed to IEvaluateContext::Evaluate(), in this order
+    // outputNodeNames - nodes to evaluate, in the order of the output buffers passed to IEvaluateContext::Evaluate()
+    // The context must be released with its Destroy() method.
+    virtual IEvaluateContext<ElemType>* CreateContext(const std::vector<std::wstring>& inputNodeNames, const std::vector<std::wstring>& outputNodeNames);
 };
 } } }
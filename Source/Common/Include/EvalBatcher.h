@@ -0,0 +1,334 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include "Eval.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+struct EvalBatcherOptions
+{
+    size_t maxBatchSamples = 64;   // a batch is evaluated as soon as the queued requests have this many samples...
+    size_t maxWaitMilliseconds = 2; // ...or the oldest queued request has waited this long
+    size_t numWorkers = 1;          // number of evaluation threads, each with its own IEvaluateContext
+};
+
+// -----------------------------------------------------------------------
+// EvalBatcher -- dynamic batching of concurrent evaluation requests
+//
+// Evaluate() may be called from any number of threads. Each call is one sequence (a single sample
+// is a sequence of length 1). Queued requests are packed into one minibatch, with each request
+// becoming a parallel sequence of the MBLayout, evaluated by one of the worker threads, and the
+// outputs are split back per request. This trades a bounded wait for much better throughput, since
+// one network evaluation of N columns is far cheaper than N evaluations of one column.
+// A request larger than maxBatchSamples is evaluated on its own.
+//
+// Latencies are kept in a fixed histogram with logarithmic bins, so the statistics take constant
+// memory however long the batcher serves; percentiles are accurate to the bin width (about 4%).
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class EvalBatcher
+{
+public:
+    EvalBatcher(IEvaluateModel<ElemType>& model, const std::vector<std::wstring>& inputNodeNames, const std::vector<std::wstring>& outputNodeNames,
+                const EvalBatcherOptions& options = EvalBatcherOptions())
+        : m_options(options), m_numQueuedSamples(0), m_shutdown(false), m_latencyHistogram(numLatencyBins, 0)
+    {
+        if (m_options.maxBatchSamples == 0)
+            m_options.maxBatchSamples = 1;
+        if (m_options.numWorkers == 0)
+            m_options.numWorkers = 1;
+
+        std::map<std::wstring, size_t> dimensions;
+        for (const auto& name : inputNodeNames)
+            dimensions[name] = 0;
+        for (const auto& name : outputNodeNames)
+            dimensions[name] = 0;
+        model.GetNodeDimensions(dimensions, nodeSpecified);
+        for (const auto& name : inputNodeNames)
+            m_inputDims.push_back(dimensions[name]);
+        for (const auto& name : outputNodeNames)
+            m_outputDims.push_back(dimensions[name]);
+
+        try
+        {
+            for (size_t i = 0; i < m_options.numWorkers; i++)
+                m_contexts.push_back(model.CreateContext(inputNodeNames, outputNodeNames));
+        }
+        catch (...)
+        {
+            for (auto context : m_contexts)
+                context->Destroy();
+            throw;
+        }
+        for (size_t i = 0; i < m_contexts.size(); i++)
+            m_threads.push_back(std::thread([this, i]()
+                                            {
+                                                WorkerLoop(*m_contexts[i]);
+                                            }));
+    }
+
+    // requests still queued are completed before the workers exit
+    ~EvalBatcher()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_shutdown = true;
+        }
+        m_wakeUp.notify_all();
+        for (auto& thread : m_threads)
+            thread.join();
+        for (auto context : m_contexts)
+            context->Destroy();
+    }
+
+    // Evaluate - evaluate one sequence of numSamples samples; blocks until the result is available
+    // inputs, outputs - like IEvaluateContext::Evaluate(); the buffers must stay valid until this returns
+    void Evaluate(const ElemType* const inputs[], ElemType* const outputs[], size_t numSamples)
+    {
+        if (numSamples == 0)
+            return;
+
+        Request request;
+        request.inputs.assign(inputs, inputs + m_inputDims.size());
+        request.outputs.assign(outputs, outputs + m_outputDims.size());
+        request.numSamples = numSamples;
+        request.arrivalTime = Clock::now();
+        auto done = request.done.get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.push_back(&request);
+            m_numQueuedSamples += numSamples;
+        }
+        m_wakeUp.notify_one();
+        done.get(); // rethrows the evaluation error, if any
+    }
+
+    // print latency percentiles (from arrival to completion) and the histogram of batch sizes (in requests)
+    void PrintStatistics(FILE* f) const
+    {
+        std::vector<size_t> latencyHistogram;
+        double maxLatency;
+        std::map<size_t, size_t> batchSizes;
+        size_t numBatchedSamples;
+        {
+            std::lock_guard<std::mutex> lock(m_statisticsMutex);
+            latencyHistogram = m_latencyHistogram;
+            maxLatency = m_maxLatency;
+            batchSizes = m_batchSizes;
+            numBatchedSamples = m_numBatchedSamples;
+        }
+        size_t numRequests = 0;
+        for (auto count : latencyHistogram)
+            numRequests += count;
+        if (numRequests == 0)
+        {
+            fprintf(f, "EvalBatcher: No requests.\n");
+            return;
+        }
+
+        // upper end of the bin that holds the request of rank p * numRequests
+        auto percentile = [&](double p)
+        {
+            size_t rank = std::min(numRequests - 1, (size_t)(p * numRequests));
+            size_t bin = 0;
+            for (size_t numBelow = latencyHistogram[0]; numBelow <= rank; numBelow += latencyHistogram[bin])
+                bin++;
+            return std::min(maxLatency, LatencyBinStart(bin + 1));
+        };
+        size_t numBatches = 0;
+        for (const auto& entry : batchSizes)
+            numBatches += entry.second;
+        fprintf(f, "EvalBatcher: %d requests in %d batches (%.1f requests, %.1f samples per batch); latency p50 = %.3f ms, p90 = %.3f ms, p99 = %.3f ms, max = %.3f ms\n",
+                (int) numRequests, (int) numBatches, (double) numRequests / numBatches, (double) numBatchedSamples / numBatches,
+                percentile(0.5), percentile(0.9), percentile(0.99), maxLatency);
+        fprintf(f, "EvalBatcher: Batch sizes (requests per batch):\n");
+        for (const auto& entry : batchSizes)
+            fprintf(f, "\t%5d: %8d (%.1f%%)\n", (int) entry.first, (int) entry.second, 100.0 * entry.second / numBatches);
+    }
+
+    void ResetStatistics()
+    {
+        std::lock_guard<std::mutex> lock(m_statisticsMutex);
+        std::fill(m_latencyHistogram.begin(), m_latencyHistogram.end(), 0);
+        m_maxLatency = 0;
+        m_batchSizes.clear();
+        m_numBatchedSamples = 0;
+    }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    // latency bins: bin 0 is below 1 microsecond, bin k >= 1 starts at 1 microsecond * 2^((k - 1) / 16); the last one is open-ended (above 15 minutes)
+    static const size_t numLatencyBinsPerOctave = 16;
+    static const size_t numLatencyBins = 30 * numLatencyBinsPerOctave + 1;
+
+    static double LatencyBinStart(size_t bin) // in ms
+    {
+        if (bin == 0)
+            return 0;
+        return 1e-3 * std::pow(2.0, (double) (bin - 1) / numLatencyBinsPerOctave);
+    }
+
+    static size_t LatencyBin(double latency) // latency in ms
+    {
+        if (latency < 1e-3)
+            return 0;
+        return std::min(numLatencyBins - 1, 1 + (size_t) (std::log2(latency * 1e3) * numLatencyBinsPerOctave));
+    }
+
+    struct Request
+    {
+        std::vector<const ElemType*> inputs;
+        std::vector<ElemType*> outputs;
+        size_t numSamples;
+        Clock::time_point arrivalTime;
+        std::promise<void> done;
+    };
+
+    void WorkerLoop(IEvaluateContext<ElemType>& context)
+    {
+        std::vector<Request*> batch;
+        std::vector<size_t> sequenceLengths;
+        std::vector<std::vector<ElemType>> inputs(m_inputDims.size()), outputs(m_outputDims.size());
+        std::vector<const ElemType*> inputPtrs(m_inputDims.size());
+        std::vector<ElemType*> outputPtrs(m_outputDims.size());
+
+        for (;;)
+        {
+            // wait until a batch is full or the oldest request is due
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                for (;;)
+                {
+                    if (m_queue.empty())
+                    {
+                        if (m_shutdown)
+                            return;
+                        m_wakeUp.wait(lock);
+                        continue;
+                    }
+                    auto deadline = m_queue.front()->arrivalTime + std::chrono::milliseconds(m_options.maxWaitMilliseconds);
+                    if (m_shutdown || m_numQueuedSamples >= m_options.maxBatchSamples || Clock::now() >= deadline)
+                        break;
+                    m_wakeUp.wait_until(lock, deadline);
+                }
+
+                batch.clear();
+                size_t numSamples = 0;
+                while (!m_queue.empty() && (batch.empty() || numSamples + m_queue.front()->numSamples <= m_options.maxBatchSamples))
+                {
+                    batch.push_back(m_queue.front());
+                    numSamples += m_queue.front()->numSamples;
+                    m_queue.pop_front();
+                }
+                m_numQueuedSamples -= numSamples;
+                if (!m_queue.empty()) // let another worker take care of the rest
+                    m_wakeUp.notify_one();
+            }
+
+            size_t numDone = 0; // batch[0..numDone) have their result
+            try
+            {
+                if (batch.size() == 1)
+                    context.Evaluate(batch[0]->inputs.data(), batch[0]->outputs.data(), batch[0]->numSamples);
+                else
+                {
+                    // pack the requests back to back, evaluate, and split the outputs
+                    sequenceLengths.clear();
+                    size_t numSamples = 0;
+                    for (auto request : batch)
+                    {
+                        sequenceLengths.push_back(request->numSamples);
+                        numSamples += request->numSamples;
+                    }
+                    for (size_t i = 0; i < m_inputDims.size(); i++)
+                    {
+                        inputs[i].clear();
+                        for (auto request : batch)
+                            inputs[i].insert(inputs[i].end(), request->inputs[i], request->inputs[i] + m_inputDims[i] * request->numSamples);
+                        inputPtrs[i] = inputs[i].data();
+                    }
+                    for (size_t i = 0; i < m_outputDims.size(); i++)
+                    {
+                        outputs[i].resize(m_outputDims[i] * numSamples);
+                        outputPtrs[i] = outputs[i].data();
+                    }
+
+                    context.EvaluateSequences(inputPtrs.data(), outputPtrs.data(), sequenceLengths);
+
+                    for (size_t i = 0; i < m_outputDims.size(); i++)
+                    {
+                        const ElemType* output = outputs[i].data();
+                        for (auto request : batch)
+                        {
+                            size_t size = m_outputDims[i] * request->numSamples;
+                            memcpy(request->outputs[i], output, size * sizeof(ElemType));
+                            output += size;
+                        }
+                    }
+                }
+                RecordBatch(batch);
+                // once its promise is fulfilled, a request may be gone, as its Evaluate() call returns
+                for (; numDone < batch.size(); numDone++)
+                    batch[numDone]->done.set_value();
+            }
+            catch (...)
+            {
+                for (; numDone < batch.size(); numDone++)
+                    batch[numDone]->done.set_exception(std::current_exception());
+            }
+        }
+    }
+
+    void RecordBatch(const std::vector<Request*>& batch)
+    {
+        auto now = Clock::now();
+        std::lock_guard<std::mutex> lock(m_statisticsMutex);
+        for (auto request : batch)
+        {
+            double latency = std::chrono::duration<double, std::milli>(now - request->arrivalTime).count();
+            m_latencyHistogram[LatencyBin(latency)]++;
+            m_maxLatency = std::max(m_maxLatency, latency);
+            m_numBatchedSamples += request->numSamples;
+        }
+        m_batchSizes[batch.size()]++;
+    }
+
+    EvalBatcherOptions m_options;
+    std::vector<size_t> m_inputDims;
+    std::vector<size_t> m_outputDims;
+    std::vector<IEvaluateContext<ElemType>*> m_contexts; // [worker]
+    std::vector<std::thread> m_threads;
+
+    std::deque<Request*> m_queue; // requests live on the stack of their waiting Evaluate() call
+    size_t m_numQueuedSamples;
+    bool m_shutdown;
+    std::mutex m_mutex;
+    std::condition_variable m_wakeUp;
+
+    mutable std::mutex m_statisticsMutex;
+    std::vector<size_t> m_latencyHistogram; // [LatencyBin()] -> number of requests
+    double m_maxLatency = 0;                // in ms
+    std::map<size_t, size_t> m_batchSizes; // [requests per batch] -> number of batches
+    size_t m_numBatchedSamples = 0;
+};
+} } }
@@ -19,6 +19,7 @@
 #include "fileutil.h" // for f{ge,pu}t{,Text}()
 #include <fstream>    // for LoadMatrixFromTextFile() --TODO: change to using this File class
 #include <sstream>
+#include <memory>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -35,6 +36,7 @@ enum FileOptions
     fileOptionsRead = 8,                                                        // open in read mode
     fileOptionsWrite = 16,                                                      // open in write mode
     fileOptionsSequential = 32,                                                 // optimize for sequential reads (allocates big buffer)
+    fileOptionsMemoryMapped = 64,                                               // (reading binary files) also map the file into memory, see GetMappedView()
     fileOptionsReadWrite = fileOptionsRead | fileOptionsWrite,                  // read/write mode
 };
 
@@ -92,6 +94,39 @@ static void attempt(const FUNCTION& body)
     // msra::util::attempt<FUNCTION> (retries, body);
 }
 
+// -----------------------------------------------------------------------
+// MappedFileView -- an entire file mapped into memory for reading
+// The pages are mapped copy-on-write: modifying the memory never writes back to the file,
+// so it can serve as storage for model parameters that get updated later.
+// -----------------------------------------------------------------------
+
+class MappedFileView
+{
+public:
+    MappedFileView(const std::wstring& filename);
+    ~MappedFileView();
+
+    char* Data() const
+    {
+        return m_data;
+    }
+    size_t Size() const
+    {
+        return m_size;
+    }
+
+private:
+    MappedFileView(const MappedFileView&) = delete;
+    void operator=(const MappedFileView&) = delete;
+
+    char* m_data;
+    size_t m_size;
+#ifdef _WIN32
+    HANDLE m_fileHandle;
+    HANDLE m_mappingHandle;
+#endif
+};
+
 class File
 {
 private:
@@ -100,6 +135,7 @@ private:
     bool m_pcloseNeeded; // was opened with popen(), use pclose() when destructing
     bool m_seekable;     // this stream is seekable
     int m_options;       // FileOptions ored togther
+    std::shared_ptr<MappedFileView> m_mappedView; // if fileOptionsMemoryMapped
     void Init(const wchar_t* filename, int fileOptions);
 
 public:
@@ -215,6 +251,44 @@ public:
 
     bool IsMarker(FileMarker marker, bool skip = true);
 
+    // put/get arrays of basic types
+    // In binary files, the array is transferred with a single fwrite()/fread(); the bytes are the same as
+    // those of writing the elements one by one, so this can also read arrays written element-wise.
+    template <typename T>
+    void WriteArray(const T* data, size_t count)
+    {
+        if (IsTextBased())
+        {
+            for (size_t i = 0; i < count; i++)
+                *this << data[i];
+        }
+        else if (count > 0)
+            fwriteOrDie(data, sizeof(T), count, m_file);
+    }
+    template <typename T>
+    void ReadArray(T* data, size_t count)
+    {
+        if (IsTextBased())
+        {
+            for (size_t i = 0; i < count; i++)
+                *this >> data[i];
+        }
+        else if (count > 0)
+            freadOrDie(data, sizeof(T), count, m_file);
+    }
+
+    // pad a binary file with zeroes, or skip over such padding, so that the next data starts at a multiple of 'alignment'
+    // Used to page-align bulk data inside a file for memory mapping. No-op for text files.
+    void PadToAlignment(size_t alignment);
+    void SkipToAlignment(size_t alignment);
+
+    // the memory-mapped view of this file if opened with fileOptionsMemoryMapped, otherwise null
+    // Data at file offset GetPosition() is at GetMappedView()->Data() + GetPosition().
+    const std::shared_ptr<MappedFileView>& GetMappedView() const
+    {
+        return m_mappedView;
+    }
+
     // get a vector of types
     template <typename T>
     File& operator>>(std::vector<T>& val)
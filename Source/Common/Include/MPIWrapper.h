@@ -49,6 +49,14 @@ static int operator||(int rc, const MpiFail &what)
     RuntimeError("%s", what.c_str());
 }
 
+// algorithms for MPIWrapper::AllReduce() of a large buffer
+enum class AllReduceAlgorithm : int
+{
+    MPI,              // MPI_Allreduce() of the MPI implementation
+    Ring,             // reduce-scatter and allgather around a ring of the nodes; each node sends 2 (N-1)/N of the buffer, independent of N
+    RecursiveHalving, // recursive halving and doubling (Rabenseifner); 2 log2(N) steps, each node sends 2 (N-1)/N of the buffer; N must be a power of two, else Ring is used
+};
+
 class MPIWrapper
 {
     int m_myRank;
@@ -295,6 +303,24 @@ public:
         }
     }
 
+    // for raw pointer, with a built-in algorithm
+    // 'scratch' is a caller-provided buffer for the received data, so that it can be reused across calls.
+    template <class ElemType>
+    void AllReduce(ElemType *pData, size_t nData, AllReduceAlgorithm algorithm, std::vector<ElemType> &scratch)
+    {
+        if ((NumNodesInUse() <= 1) || (Communicator() == MPI_COMM_NULL))
+            return;
+
+        const size_t numNodes = NumNodesInUse();
+        const bool isPowerOfTwo = (numNodes & (numNodes - 1)) == 0;
+        if (algorithm == AllReduceAlgorithm::MPI || nData < numNodes) // (tiny buffers are not worth splitting)
+            AllReduce(pData, nData);
+        else if (algorithm == AllReduceAlgorithm::RecursiveHalving && isPowerOfTwo)
+            RecursiveHalvingAllReduce(pData, nData, scratch);
+        else
+            RingAllReduce(pData, nData, scratch);
+    }
+
     template <class ElemType>
     void Bcast(ElemType *pData, size_t nData, size_t srcRank)
     {
@@ -309,6 +335,104 @@ public:
     {
         MPI_Barrier(m_currentComm) || MpiFail("waitall: MPI_Barrier");
     }
+
+private:
+    // -----------------------------------------------------------------------
+    // built-in allreduce algorithms
+    // Both split the buffer into pieces that are summed up by exchanging them between pairs
+    // of nodes (reduce-scatter), and then distribute the sums (allgather). Each node ends up
+    // with bit-identical results, since every piece is summed in the same order on one node.
+    // -----------------------------------------------------------------------
+
+    static const int allReduceTag = 0x5252; // ('RR')
+
+    // exchange data with two nodes: send (pSend, nSend) to node 'dest', and receive (pRecv, nRecv) from node 'source'
+    template <class ElemType>
+    void SendRecv(const ElemType *pSend, size_t nSend, size_t dest, ElemType *pRecv, size_t nRecv, size_t source) const
+    {
+        MPI_Sendrecv(const_cast<ElemType *>(pSend), (int) nSend, GetDataType(pRecv), (int) dest, allReduceTag,
+                     pRecv, (int) nRecv, GetDataType(pRecv), (int) source, allReduceTag, Communicator(), MPI_STATUS_IGNORE) || MpiFail("allreduce: MPI_Sendrecv");
+    }
+
+    // The buffer is split into N chunks. In step s of the reduce-scatter, each node passes one chunk
+    // on to its right neighbor, which adds it to its own; after N-1 steps node r holds the sum of
+    // chunk (r+1) mod N. The allgather then passes the sums around the ring in the same way.
+    template <class ElemType>
+    void RingAllReduce(ElemType *pData, size_t nData, std::vector<ElemType> &scratch) const
+    {
+        const size_t numNodes = NumNodesInUse();
+        const size_t rank = CurrentNodeRank();
+        const size_t right = (rank + 1) % numNodes;
+        const size_t left = (rank + numNodes - 1) % numNodes;
+        auto chunkBegin = [&](size_t chunk)
+        {
+            return nData * chunk / numNodes;
+        };
+        auto chunkSize = [&](size_t chunk)
+        {
+            return chunkBegin(chunk + 1) - chunkBegin(chunk);
+        };
+
+        scratch.resize(chunkSize(numNodes - 1)); // (the last chunk is the largest)
+        for (size_t s = 0; s + 1 < numNodes; s++)
+        {
+            const size_t sendChunk = (rank + numNodes - s) % numNodes;
+            const size_t recvChunk = (rank + numNodes - s - 1) % numNodes;
+            SendRecv(pData + chunkBegin(sendChunk), chunkSize(sendChunk), right, scratch.data(), chunkSize(recvChunk), left);
+            ElemType *p = pData + chunkBegin(recvChunk);
+            for (size_t i = 0; i < chunkSize(recvChunk); i++)
+                p[i] += scratch[i];
+        }
+        for (size_t s = 0; s + 1 < numNodes; s++)
+        {
+            const size_t sendChunk = (rank + numNodes - s + 1) % numNodes;
+            const size_t recvChunk = (rank + numNodes - s) % numNodes;
+            SendRecv(pData + chunkBegin(sendChunk), chunkSize(sendChunk), right, pData + chunkBegin(recvChunk), chunkSize(recvChunk), left);
+        }
+    }
+
+    // In each step of the reduce-scatter, the nodes pair up (at distance N/2, N/4, ..., 1), and each
+    // keeps summing one half of its current range while sending the other half to its partner. After
+    // log2(N) steps every node holds the sum of 1/N of the buffer. The allgather reverses the steps.
+    template <class ElemType>
+    void RecursiveHalvingAllReduce(ElemType *pData, size_t nData, std::vector<ElemType> &scratch) const
+    {
+        const size_t numNodes = NumNodesInUse();
+        const size_t rank = CurrentNodeRank();
+        std::vector<std::pair<size_t, size_t>> ranges; // range [begin, end) before each step
+        size_t begin = 0;
+        size_t end = nData;
+
+        scratch.resize((nData + 1) / 2);
+        for (size_t distance = numNodes / 2; distance > 0; distance /= 2)
+        {
+            const size_t partner = rank ^ distance;
+            const size_t mid = begin + (end - begin) / 2;
+            ranges.push_back(std::make_pair(begin, end));
+            const bool keepLower = (rank & distance) == 0;
+            const size_t keepBegin = keepLower ? begin : mid;
+            const size_t keepEnd = keepLower ? mid : end;
+            const size_t sendBegin = keepLower ? mid : begin;
+            const size_t sendEnd = keepLower ? end : mid;
+            SendRecv(pData + sendBegin, sendEnd - sendBegin, partner, scratch.data(), keepEnd - keepBegin, partner);
+            for (size_t i = keepBegin; i < keepEnd; i++)
+                pData[i] += scratch[i - keepBegin];
+            begin = keepBegin;
+            end = keepEnd;
+        }
+        for (size_t distance = 1; distance < numNodes; distance *= 2)
+        {
+            const size_t partner = rank ^ distance;
+            const size_t parentBegin = ranges.back().first;
+            const size_t parentEnd = ranges.back().second;
+            ranges.pop_back();
+            const size_t recvBegin = (begin == parentBegin) ? end : parentBegin;
+            const size_t recvEnd = (begin == parentBegin) ? parentEnd : begin;
+            SendRecv(pData + begin, end - begin, partner, pData + recvBegin, recvEnd - recvBegin, partner);
+            begin = parentBegin;
+            end = parentEnd;
+        }
+    }
 };
 }
 }
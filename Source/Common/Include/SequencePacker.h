@@ -0,0 +1,212 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// SequencePacker.h -- packing variable-length sequences into the parallel sequences of minibatches
+//
+
+#pragma once
+
+#include "Basics.h"
+#include "Sequences.h"
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <random>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// SequencePacker -- packs whole sequences into the parallel sequences (streams) of minibatches
+//
+// A minibatch of whole sequences is as long as its longest sequence; the rest of each stream is
+// a gap, which is masked, but still costs compute in every GEMM and recurrent step. Filling the
+// streams in arrival order wastes a lot of that, as one long sequence makes the whole minibatch long.
+//
+// The packer takes a window of sequences (the next sequences in the reader's randomized order),
+// buckets them by length, and packs them first-fit-decreasing: a minibatch is started with the longest
+// sequence left, which determines its number of time steps, and the remaining sequences, longest first,
+// are placed into the first stream that still has room for them behind the sequences placed there.
+// The minibatches of the window are then handed out in random order.
+//
+// Every sequence of the window is placed exactly once, and sequences are only reordered within the
+// window; sequences of the same length keep their relative order. So beyond the window, the
+// randomization of the reader is preserved, and one sweep still visits every sequence once.
+//
+// The packer also keeps the padding statistics (the fraction of frames of the minibatches handed out
+// that are valid), which readers report per epoch.
+// -----------------------------------------------------------------------
+
+class SequencePacker
+{
+public:
+    struct Placement
+    {
+        size_t sequence; // index of the sequence in the window passed to Pack()
+        size_t s;        // parallel sequence (stream)
+        size_t tBegin;   // time steps [tBegin, tEnd) of the stream
+        size_t tEnd;
+    };
+
+    struct Minibatch
+    {
+        size_t numTimeSteps;
+        std::vector<Placement> sequences;
+        std::vector<size_t> numValidFrames; // [s] the stream is a gap from here on
+
+        size_t GetNumValidFrames() const
+        {
+            size_t numFrames = 0;
+            for (auto n : numValidFrames)
+                numFrames += n;
+            return numFrames;
+        }
+    };
+
+    explicit SequencePacker(size_t numParallelSequences = 1)
+    {
+        Reset(numParallelSequences);
+    }
+
+    // forget the packed minibatches not handed out yet, and reset the statistics, e.g. at the start of an epoch
+    void Reset(size_t numParallelSequences)
+    {
+        if (numParallelSequences == 0)
+            LogicError("SequencePacker: numParallelSequences must be at least 1.");
+        m_numParallelSequences = numParallelSequences;
+        m_minibatches.clear();
+        ResetStatistics();
+    }
+
+    // Pack a window of sequences, given their lengths in frames, into minibatches, which are returned by
+    // NextMinibatch() in an order randomized with 'randomSeed'. Sequences of length 0 are dropped.
+    void Pack(const std::vector<size_t>& lengths, size_t randomSeed)
+    {
+        std::vector<size_t> remaining;
+        for (size_t i = 0; i < lengths.size(); i++)
+            if (lengths[i] > 0)
+                remaining.push_back(i);
+        std::stable_sort(remaining.begin(), remaining.end(), [&lengths](size_t a, size_t b)
+                         {
+                             return lengths[a] > lengths[b];
+                         });
+
+        std::vector<Minibatch> minibatches;
+        std::vector<size_t> notPlaced;
+        while (!remaining.empty())
+        {
+            Minibatch mb;
+            mb.numTimeSteps = lengths[remaining.front()];
+            mb.numValidFrames.assign(m_numParallelSequences, 0);
+            size_t maxRoom = mb.numTimeSteps;
+            notPlaced.clear();
+            for (auto i : remaining)
+            {
+                size_t len = lengths[i];
+                if (len > maxRoom) // (no stream has room for it)
+                {
+                    notPlaced.push_back(i);
+                    continue;
+                }
+                maxRoom = 0;
+                bool placed = false;
+                for (size_t s = 0; s < m_numParallelSequences; s++)
+                {
+                    size_t& filled = mb.numValidFrames[s];
+                    if (!placed && filled + len <= mb.numTimeSteps)
+                    {
+                        mb.sequences.push_back(Placement{i, s, filled, filled + len});
+                        filled += len;
+                        placed = true;
+                    }
+                    maxRoom = std::max(maxRoom, mb.numTimeSteps - filled);
+                }
+                assert(placed);
+            }
+            minibatches.push_back(std::move(mb));
+            remaining.swap(notPlaced);
+        }
+
+        // Fisher-Yates with our own draws, so that the order is the same on all platforms
+        std::mt19937_64 rng(randomSeed);
+        for (size_t i = minibatches.size(); i > 1; i--)
+            std::swap(minibatches[i - 1], minibatches[rng() % i]);
+        for (auto& mb : minibatches)
+            m_minibatches.push_back(std::move(mb));
+    }
+
+    bool HasMinibatches() const
+    {
+        return !m_minibatches.empty();
+    }
+
+    // Hand out the next packed minibatch, and count it in the statistics.
+    Minibatch NextMinibatch()
+    {
+        if (m_minibatches.empty())
+            LogicError("SequencePacker: NextMinibatch() called with no packed minibatches left.");
+        Minibatch mb = std::move(m_minibatches.front());
+        m_minibatches.pop_front();
+        CountMinibatch(mb.sequences.size(), mb.GetNumValidFrames(), mb.numTimeSteps);
+        return mb;
+    }
+
+    // Set up an MBLayout for a minibatch: its sequences, and gaps behind them.
+    void GetLayout(const Minibatch& mb, MBLayout& layout) const
+    {
+        layout.Init(m_numParallelSequences, mb.numTimeSteps);
+        for (const auto& placement : mb.sequences)
+            layout.AddSequence(NEW_SEQUENCE_ID, placement.s, placement.tBegin, placement.tEnd);
+        for (size_t s = 0; s < m_numParallelSequences; s++)
+            if (mb.numValidFrames[s] < mb.numTimeSteps)
+                layout.AddGap(s, mb.numValidFrames[s], mb.numTimeSteps);
+    }
+
+    // Count a minibatch that was not packed by us, so that the statistics can be compared.
+    void CountMinibatch(size_t numSequences, size_t numValidFrames, size_t numTimeSteps)
+    {
+        m_numMinibatches++;
+        m_numSequences += numSequences;
+        m_numValidFrames += numValidFrames;
+        m_numFrames += numTimeSteps * m_numParallelSequences;
+    }
+
+    // statistics since the last call of ResetStatistics()
+    size_t GetNumMinibatches() const
+    {
+        return m_numMinibatches;
+    }
+    size_t GetNumSequences() const
+    {
+        return m_numSequences;
+    }
+    size_t GetNumValidFrames() const
+    {
+        return m_numValidFrames;
+    }
+    size_t GetNumFrames() const // incl. the gaps
+    {
+        return m_numFrames;
+    }
+    double GetPaddingEfficiency() const // fraction of the frames that are valid
+    {
+        return m_numFrames > 0 ? (double) m_numValidFrames / m_numFrames : 1;
+    }
+    void ResetStatistics()
+    {
+        m_numMinibatches = 0;
+        m_numSequences = 0;
+        m_numValidFrames = 0;
+        m_numFrames = 0;
+    }
+
+private:
+    size_t m_numParallelSequences;
+    std::deque<Minibatch> m_minibatches; // packed, in the order they are handed out
+
+    size_t m_numMinibatches;
+    size_t m_numSequences;
+    size_t m_numValidFrames;
+    size_t m_numFrames;
+};
+} } }
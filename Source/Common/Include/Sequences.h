@@ -11,6 +11,7 @@
 #include "Matrix.h"
 #include <vector>
 #include <memory> // for shared_ptr
+#include <mutex>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -399,6 +400,24 @@ private:
     // and 0 indicates invalid (aka MinibatchPackingFlags::NoInput)
     mutable Matrix<char> m_columnsValidityMask;
 
+    // Guards the lazy creation of m_columnsValidityMask, since nodes that share this layout may run concurrently
+    // (see PARTraversalFlowControlNode). It is not copied with the content of the layout.
+    struct MaskMutex
+    {
+        MaskMutex()
+        {
+        }
+        MaskMutex(const MaskMutex&)
+        {
+        }
+        MaskMutex& operator=(const MaskMutex&)
+        {
+            return *this;
+        }
+        std::mutex m_mutex;
+    };
+    mutable MaskMutex m_columnsValidityMaskMutex;
+
     // A boolean flag indicating whether the MBLayout can be further modified
     // When it's value is false, no set operations are allowed on the MBLayout.
     // Meant to guard in lazy creation of m_columnsValidityMask.
@@ -671,6 +690,7 @@ inline const Matrix<char> &MBLayout::GetColumnsValidityMask(DEVICEID_TYPE device
 {
     CheckIsValid();
     // lazily compute the validity mask
+    std::lock_guard<std::mutex> lock(m_columnsValidityMaskMutex.m_mutex);
     if (m_columnsValidityMask.IsEmpty())
     {
         assert(HasGaps()); // must only be called if there are gaps
@@ -0,0 +1,198 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// ThreadPool -- simple work-stealing thread pool
+//
+// Each worker owns a task deque. Tasks submitted from a worker go to the front of
+// its own deque and are run LIFO (good cache locality for dependency chains, as the
+// successor of a task tends to read what the task just wrote). Tasks submitted from
+// outside are distributed round-robin. An idle worker steals from the back of the
+// other workers' deques. Idle workers sleep on a condition variable until a task
+// is submitted. Used by the concurrent network evaluation and the parallel UCI parser.
+// -----------------------------------------------------------------------
+
+class ThreadPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    // 'threadInit' is run once on each worker thread before it picks up any task (e.g. to set per-thread OpenMP settings)
+    explicit ThreadPool(size_t numThreads, const Task& threadInit = Task())
+        : m_numPending(0), m_nextQueue(0), m_shutdown(false)
+    {
+        if (numThreads == 0)
+            numThreads = 1;
+        for (size_t i = 0; i < numThreads; i++)
+            m_queues.push_back(std::unique_ptr<WorkQueue>(new WorkQueue()));
+        for (size_t i = 0; i < numThreads; i++)
+            m_threads.push_back(std::thread([this, i, threadInit]()
+                                            {
+                                                if (threadInit)
+                                                    threadInit();
+                                                WorkerLoop(i);
+                                            }));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_shutdown = true;
+        }
+        m_wakeUp.notify_all();
+        for (auto& thread : m_threads)
+            thread.join();
+    }
+
+    size_t GetNumThreads() const
+    {
+        return m_threads.size();
+    }
+
+    // queue a task for execution; tasks must not throw (catch and forward errors yourself)
+    void Submit(Task&& task)
+    {
+        WorkQueue* queue;
+        bool fromWorker = (CurrentPool() == this);
+        if (fromWorker)
+            queue = m_queues[CurrentWorkerIndex()].get();
+        else
+            queue = m_queues[m_nextQueue++ % m_queues.size()].get();
+        {
+            std::lock_guard<std::mutex> lock(queue->m_mutex);
+            if (fromWorker)
+                queue->m_tasks.push_front(std::move(task));
+            else
+                queue->m_tasks.push_back(std::move(task));
+        }
+        {
+            // take the lock so that a worker that just found nothing to do cannot miss this notification
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            m_numPending++;
+        }
+        m_wakeUp.notify_one();
+    }
+
+    // run 'body(i)' for i in [begin, end) on the pool and wait for all of them
+    // Must not be called from a worker of the same pool.
+    void ParallelFor(size_t begin, size_t end, const std::function<void(size_t)>& body)
+    {
+        if (begin >= end)
+            return;
+        std::mutex doneMutex;
+        std::condition_variable done;
+        size_t numRemaining = end - begin;
+        for (size_t i = begin; i < end; i++)
+        {
+            Submit([&, i]()
+                   {
+                       body(i);
+                       std::lock_guard<std::mutex> lock(doneMutex);
+                       if (--numRemaining == 0)
+                           done.notify_all();
+                   });
+        }
+        std::unique_lock<std::mutex> lock(doneMutex);
+        done.wait(lock, [&]()
+                  {
+                      return numRemaining == 0;
+                  });
+    }
+
+public:
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+private:
+    struct WorkQueue
+    {
+        std::mutex m_mutex;
+        std::deque<Task> m_tasks;
+    };
+
+    static ThreadPool*& CurrentPool()
+    {
+        static thread_local ThreadPool* pool = nullptr;
+        return pool;
+    }
+    static size_t& CurrentWorkerIndex()
+    {
+        static thread_local size_t index = 0;
+        return index;
+    }
+
+    // pop from own queue (front), else steal from another queue (back)
+    bool TryGetTask(size_t workerIndex, Task& task)
+    {
+        for (size_t k = 0; k < m_queues.size(); k++)
+        {
+            WorkQueue& queue = *m_queues[(workerIndex + k) % m_queues.size()];
+            std::lock_guard<std::mutex> lock(queue.m_mutex);
+            if (queue.m_tasks.empty())
+                continue;
+            if (k == 0)
+            {
+                task = std::move(queue.m_tasks.front());
+                queue.m_tasks.pop_front();
+            }
+            else
+            {
+                task = std::move(queue.m_tasks.back());
+                queue.m_tasks.pop_back();
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void WorkerLoop(size_t workerIndex)
+    {
+        CurrentPool() = this;
+        CurrentWorkerIndex() = workerIndex;
+        for (;;)
+        {
+            Task task;
+            if (TryGetTask(workerIndex, task))
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_sleepMutex);
+                    m_numPending--;
+                }
+                task();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_sleepMutex);
+            m_wakeUp.wait(lock, [this]()
+                          {
+                              return m_shutdown || m_numPending > 0;
+                          });
+            if (m_shutdown && m_numPending == 0)
+                return;
+        }
+    }
+
+    std::vector<std::unique_ptr<WorkQueue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wakeUp;
+    size_t m_numPending; // tasks submitted but not yet picked up (guarded by m_sleepMutex)
+    std::atomic<size_t> m_nextQueue;
+    bool m_shutdown;
+};
+} } }
@@ -574,6 +574,11 @@ private:
             }
             alignoffsets[L.edges.size()] = (unsigned int) alignbufsize; // (TODO: remove if not actually needed)
         }
+        // allocate the buffer up front, so that operator[] can be called concurrently for different edges
+        void allocate()
+        {
+            allalignments.resize(alignoffsets.back());
+        }
         // edgealignments[j][t] is the senone at frame offset t in edge j
         array_ref<unsigned short> operator[](size_t j)
         {
@@ -11,6 +11,7 @@
 #include "Config.h"
 
 #include "ComputationNode.h"
+#include "NodeProfiler.h"
 #include "ScriptableObjects.h"
 
 #include <map>
@@ -26,9 +27,65 @@
 #include <regex>
 #include <chrono>
 #include <unordered_map>
+#include <set>
+#include <functional>
+
+// number of threads for executing independent nodes concurrently (CPU only); 0 means to walk the nodes one by one
+extern size_t g_parallelTraversalThreads;
+// compute trees of elementwise nodes in one pass over memory (CPU only), see FusedElementwiseGroup
+extern bool g_fuseElementwiseNodes;
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// ===========================================================================
+// FusedElementwiseGroup -- a tree of elementwise nodes that is computed in one pass
+//
+// Formed by ComputationNetwork::FormFusedElementwiseGroups(). Every member except the
+// root feeds exactly one other member and nothing else, so nobody outside the group
+// looks at its value or gradient. The group is executed as a unit at the position of
+// its root: ForwardProp() reads the external inputs once and writes only the root's
+// value, and Backprop() recomputes the intermediate values on the fly and writes only
+// the gradients of the external inputs.
+// If the matrices do not permit fused execution (e.g. not on the CPU), the members are
+// simply run one by one, which is always correct since the memory plan treats the
+// group as a unit as well.
+// ===========================================================================
+
+class FusedElementwiseGroup
+{
+public:
+    FusedElementwiseGroup(const std::vector<ComputationNodeBasePtr>& members /*in evaluation order, root last*/);
+
+    const ComputationNodeBasePtr& GetRoot() const { return m_members.back(); }
+    const std::vector<ComputationNodeBasePtr>& GetMembers() const { return m_members; }
+    const std::vector<ComputationNodeBasePtr>& GetInputs() const { return m_inputs; } // external inputs of all members
+
+    bool IsOutputOlderThanInputs() const;
+    void BumpEvalTimeStamp();
+    void ForwardProp(const FrameRange& fr);
+    void Backprop(const FrameRange& fr, bool childrenInThisLoop, bool childrenInOuterLoop);
+
+    // always run the members one by one, e.g. because somebody wants to look at an intermediate value after all
+    void DisableFusedExecution() { m_fusedExecutionDisabled = true; }
+    // whether the last ForwardProp() ran the fused kernels
+    bool LastForwardWasFused() const { return m_lastForwardWasFused; }
+
+private:
+    template <class ElemType>
+    bool CanRunFused() const;
+    template <class ElemType>
+    void ForwardPropFused(const FrameRange& fr);
+    template <class ElemType>
+    void BackpropFused(const FrameRange& fr, bool childrenInThisLoop, bool childrenInOuterLoop);
+
+    std::vector<ComputationNodeBasePtr> m_members;
+    std::vector<ComputationNodeBasePtr> m_inputs; // program registers [0, m_inputs.size())
+    FusedElementwiseProgram m_program;            // step k computes m_members[k]
+    bool m_isFloat;
+    bool m_lastForwardWasFused;                   // Backprop() must follow, since the other way needs the intermediate values
+    bool m_fusedExecutionDisabled;
+};
+
 // ===========================================================================
 // ComputationNetwork -- computation graph and operations
 // ===========================================================================
@@ -44,8 +101,10 @@ public:
 
     ComputationNetwork()
         : m_randomSeedOffset(0),
+          m_traceLevel(0),
+          m_pMBLayout(make_shared<MBLayout>()),
           m_isCompiled(false),
-          m_pMBLayout(make_shared<MBLayout>())
+          m_fusedElementwiseGroupsFormed(false)
     {
     }
     ComputationNetwork(DEVICEID_TYPE deviceId)
@@ -130,6 +189,21 @@ public:
     // main entry point for backprop
     void Backprop(const ComputationNodeBasePtr rootNode);
 
+    // If set, Backprop() calls this for each top-level node once its gradient is complete, i.e. all its consumers
+    // have back-propagated into it. Used to start aggregating a parameter's gradient while backprop continues.
+    // With parallelTraversalThreads > 0 it is called from the worker threads.
+    typedef std::function<void(const ComputationNodeBasePtr&)> GradientReadyCallback;
+    void SetGradientReadyCallback(const GradientReadyCallback& callback)
+    {
+        m_gradientReadyCallback = callback;
+    }
+
+    // If set, ForwardProp() and Backprop() report the time spent in each top-level node to this profiler (nullptr to disable).
+    void SetNodeProfiler(const std::shared_ptr<NodeProfiler>& nodeProfiler)
+    {
+        m_nodeProfiler = nodeProfiler;
+    }
+
     template <class NODESET> // version that takes multiple nodes
     void ForwardProp(const NODESET& nodes)
     {
@@ -188,6 +262,7 @@ public:
 private:
     void ReleaseMatricesAfterEvalForChildren(ComputationNodeBasePtr n, std::unordered_map<ComputationNodeBasePtr, int>& parentCount);
     void AllocateGradientMatricesForInputs(ComputationNodeBasePtr parentNode);
+    void FormFusedElementwiseGroups(const std::vector<ComputationNodeBasePtr>& protectedNodes);
 
 public:
     // -----------------------------------------------------------------------
@@ -330,6 +405,7 @@ public:
     ComputationNodeBasePtr CopyNode(const ComputationNetwork& fromNet, const std::wstring fromName, std::wstring toName, const CopyNodeFlags flags);
     void CopySubTree(const ComputationNetwork& fromNet, const std::wstring fromName, std::wstring toNamePrefix, const CopyNodeFlags flags);
     void CopyInputs(const std::wstring fromName, std::wstring toName);
+    void CopyNetworkSharingParameters(const ComputationNetwork& fromNet);
     void RenameNode(const std::wstring& nodeNameOrig, const std::wstring& nodeNameNew);
     void RenameNode(ComputationNodeBasePtr node, const std::wstring& newNodeName);
     void DeleteNode(const std::wstring& nodeName);
@@ -340,6 +416,10 @@ public:
     void RemoveFeatureNode(ComputationNodeBasePtr featureNode);
     void SetLearnableNodesBelowNeedGradient(const bool needGradient, const ComputationNodeBasePtr& rootNode = nullptr);
     void SetBatchNormlizationNodesBelowEvalMode(const bool evalMode, const ComputationNodeBasePtr& rootNode = nullptr);
+    template <class ElemType>
+    size_t FoldBatchNormalizationNodes();
+    template <class ElemType>
+    size_t QuantizeWeights(size_t numBits);
 
     // -----------------------------------------------------------------------
     // node access
@@ -852,6 +932,41 @@ protected:
         // There is currently no other constructor for inner nested PAR-traversed sub-networks, but there will be.
         PARTraversalFlowControlNode(const std::vector<shared_ptr<SEQTraversalFlowControlNode>>& recurrentInfo, const std::list<ComputationNodeBasePtr>& allNodes);
         // Base::m_nestedNodes contains all top-level nodes, in evaluation order
+
+        // determine which nested nodes may run concurrently (see g_parallelTraversalThreads)
+        // Must be called after the matrix pool has been populated, since nodes that share a pooled matrix must not overlap.
+        void BuildExecutionGraphs(const MatrixPool& matrixPool);
+
+    private:
+        // dependency graph over indices into m_nestedNodes, for executing them on a thread pool
+        struct ExecutionGraph
+        {
+            std::vector<std::set<size_t>> m_successors; // [i] -> nodes that may only start after node i has completed
+            std::vector<size_t> m_numPredecessors;      // [i] -> number of nodes that must complete before node i may start
+
+            void Reset(size_t numNodes)
+            {
+                m_successors.assign(numNodes, std::set<size_t>());
+                m_numPredecessors.assign(numNodes, 0);
+            }
+            void AddEdge(size_t from, size_t to)
+            {
+                if (from != to && m_successors[from].insert(to).second)
+                    m_numPredecessors[to]++;
+            }
+            bool IsEmpty() const
+            {
+                return m_numPredecessors.empty();
+            }
+        };
+        static void ExecuteGraph(size_t numThreads, const ExecutionGraph& graph, const std::function<void(size_t)>& runNode);
+
+        ExecutionGraph m_forwardGraph;  // edges go from lower to higher index
+        ExecutionGraph m_backwardGraph; // edges go from higher to lower index
+
+    public:
+        GradientReadyCallback m_gradientReadyCallback; // set by ComputationNetwork::Backprop()
+        std::shared_ptr<NodeProfiler> m_nodeProfiler;  // set by ComputationNetwork::ForwardProp() and Backprop()
     };
 
 public:
@@ -868,9 +983,26 @@ public:
         m_randomSeedOffset = value;
     }
 
+    // > 0 prints diagnostics while compiling the network, e.g. the memory plan
+    int GetTraceLevel() const
+    {
+        return m_traceLevel;
+    }
+    void SetTraceLevel(int traceLevel)
+    {
+        m_traceLevel = traceLevel;
+    }
+
+    // the pool that AllocateAllMatrices() gets the shared matrices from
+    const MatrixPool& GetMatrixPool() const
+    {
+        return m_matrixPool;
+    }
+
 protected:
     DEVICEID_TYPE m_deviceId; // TODO: is this shared by all nodes?
     unsigned long m_randomSeedOffset;
+    int m_traceLevel;
 
     // main node holder
     std::map<const std::wstring, ComputationNodeBasePtr, nocase_compare> m_nameToNodeMap; // [name] -> node; this is the main container that holds this networks' nodes
@@ -906,6 +1038,9 @@ private:
 
     // cache for evaluation ordering:
     bool m_isCompiled; // CompileNetwork has been called
+    bool m_fusedElementwiseGroupsFormed; // FormFusedElementwiseGroups() has been called
+    GradientReadyCallback m_gradientReadyCallback;
+    std::shared_ptr<NodeProfiler> m_nodeProfiler;
 
     // cached network iterations
     std::map<const ComputationNodeBasePtr, std::list<ComputationNodeBasePtr>> m_evalOrders; // [out node] flat depth-first traversal starting from out node
@@ -408,4 +408,299 @@ static int DetermineLoopDirection(const std::vector<ComputationNodeBasePtr>& nes
     return steppingDirection;
 }
 
+
+// -----------------------------------------------------------------------
+// elementwise fusion
+// -----------------------------------------------------------------------
+
+// can 'input' be read elementwise by 'node'? That is the case if the sample shapes agree, and 'input'
+// either has the same MB layout or none (a single column that is broadcast, e.g. a bias).
+static bool IsFusableOperand(const ComputationNodeBasePtr& node, const ComputationNodeBasePtr& input)
+{
+    const auto& shape = node->GetSampleLayout();
+    const auto& inputShape = input->GetSampleLayout();
+    for (size_t k = 0; k < max(shape.GetRank(), inputShape.GetRank()); k++)
+    {
+        if (shape.GetDimPadded(k) != inputShape.GetDimPadded(k))
+            return false;
+    }
+    return !input->HasMBLayout() || input->GetMBLayout() == node->GetMBLayout();
+}
+
+// can 'node' be part of a FusedElementwiseGroup?
+static bool IsFusableNode(const ComputationNodeBasePtr& node)
+{
+    ElementWiseOperator op;
+    if (!node->GetFusableElementwiseOp(op) || node->GetDeviceId() != CPUDEVICE || !node->HasMBLayout())
+        return false;
+    if (node->GetNumInputs() != (FusedElementwiseProgram::IsFusableBinaryOp(op) ? 2 : 1))
+        return false;
+    for (const auto& input : node->GetInputs())
+    {
+        if (!IsFusableOperand(node, input))
+            return false;
+    }
+    return true;
+}
+
+// FormFusedElementwiseGroups() -- find trees of elementwise nodes that can be computed in one pass
+// A fusable node is absorbed into its consumer if that is its only consumer, is fusable as well, and
+// is in the same loop (or also outside of any loop). Absorbed nodes must not be looked at from
+// outside, so 'protectedNodes' and the nodes of all node groups (criteria, outputs, etc.) are never absorbed.
+// This sets ComputationNode::m_fusedElementwiseGroup; ComputationNetwork::AllocateAllMatrices() and the
+// traversal nodes then treat each group as a unit.
+void ComputationNetwork::FormFusedElementwiseGroups(const std::vector<ComputationNodeBasePtr>& protectedNodes)
+{
+    const list<ComputationNodeBasePtr>& allNodes = GetEvalOrder(nullptr);
+    for (auto& node : allNodes)
+        node->m_fusedElementwiseGroup = nullptr;
+
+    unordered_set<ComputationNodeBasePtr> isProtected(protectedNodes.begin(), protectedNodes.end());
+    for (auto* group : GetAllNodeGroups())
+        isProtected.insert(group->begin(), group->end());
+
+    unordered_map<ComputationNodeBasePtr, size_t> numConsumers;
+    unordered_map<ComputationNodeBasePtr, ComputationNodeBasePtr> consumerOf;
+    for (auto& node : allNodes)
+    {
+        for (const auto& input : node->GetInputs())
+        {
+            numConsumers[input]++; // note: a node that uses the same input twice counts twice
+            consumerOf[input] = node;
+        }
+    }
+
+    // determine for each node the node it gets absorbed into, if any
+    unordered_map<ComputationNodeBasePtr, ComputationNodeBasePtr> absorbedInto;
+    for (auto& node : allNodes)
+    {
+        if (isProtected.find(node) != isProtected.end() || numConsumers[node] != 1 || !IsFusableNode(node))
+            continue;
+        const auto& consumer = consumerOf[node];
+        if (!IsFusableNode(consumer) || !IsFusableOperand(consumer, node) || consumer->GetMBLayout() != node->GetMBLayout())
+            continue;
+        if (node->IsPartOfLoop() != consumer->IsPartOfLoop() ||
+            (node->IsPartOfLoop() && FindInRecurrentLoops(m_allSEQNodes, node) != FindInRecurrentLoops(m_allSEQNodes, consumer)))
+            continue;
+        absorbedInto[node] = consumer;
+    }
+
+    // form a group for each node that absorbs others but is not absorbed itself
+    size_t numGroups = 0;
+    size_t numFusedNodes = 0;
+    for (auto& node : allNodes)
+    {
+        if (absorbedInto.find(node) != absorbedInto.end() || !IsFusableNode(node))
+            continue;
+        vector<ComputationNodeBasePtr> members;
+        function<void(const ComputationNodeBasePtr&)> collectMembers = [&](const ComputationNodeBasePtr& member)
+        {
+            for (const auto& input : member->GetInputs())
+            {
+                auto iter = absorbedInto.find(input);
+                if (iter != absorbedInto.end() && iter->second == member)
+                    collectMembers(input);
+            }
+            members.push_back(member); // after its inputs, i.e. in a valid evaluation order
+        };
+        collectMembers(node);
+        if (members.size() < 2)
+            continue;
+
+        auto group = make_shared<FusedElementwiseGroup>(members);
+        for (auto& member : members)
+            member->m_fusedElementwiseGroup = group;
+        numGroups++;
+        numFusedNodes += members.size();
+    }
+    if (m_traceLevel > 0)
+        fprintf(stderr, "\nFormFusedElementwiseGroups: %d elementwise nodes were fused into %d groups.\n", (int) numFusedNodes, (int) numGroups);
+
+    m_fusedElementwiseGroupsFormed = true;
+}
+
+// -----------------------------------------------------------------------
+// FusedElementwiseGroup methods
+// -----------------------------------------------------------------------
+
+FusedElementwiseGroup::FusedElementwiseGroup(const std::vector<ComputationNodeBasePtr>& members)
+    : m_members(members), m_isFloat(dynamic_pointer_cast<ComputationNode<float>>(members.back()) != nullptr), m_lastForwardWasFused(false), m_fusedExecutionDisabled(false)
+{
+    // the external inputs come first since they occupy the first registers
+    for (const auto& member : m_members)
+    {
+        for (const auto& input : member->GetInputs())
+        {
+            if (find(m_members.begin(), m_members.end(), input) == m_members.end() &&
+                find(m_inputs.begin(), m_inputs.end(), input) == m_inputs.end())
+                m_inputs.push_back(input);
+        }
+    }
+
+    // one step per member
+    m_program.m_numInputs = m_inputs.size();
+    for (size_t k = 0; k < m_members.size(); k++)
+    {
+        const auto& member = m_members[k];
+        FusedElementwiseStep step;
+        if (!member->GetFusableElementwiseOp(step.m_op))
+            LogicError("FusedElementwiseGroup: %ls %ls operation cannot be fused.", member->NodeName().c_str(), member->OperationName().c_str());
+        for (size_t i = 0; i < 2; i++)
+        {
+            const auto& input = member->GetInputs()[min(i, member->GetNumInputs() - 1)]; // unary ops just read their input twice
+            auto memberIter = find(m_members.begin(), m_members.begin() + k, input);
+            if (memberIter != m_members.begin() + k)
+                step.m_args[i] = m_inputs.size() + (memberIter - m_members.begin());
+            else
+                step.m_args[i] = find(m_inputs.begin(), m_inputs.end(), input) - m_inputs.begin();
+        }
+        m_program.m_steps.push_back(step);
+    }
+}
+
+bool FusedElementwiseGroup::IsOutputOlderThanInputs() const
+{
+    for (const auto& member : m_members)
+    {
+        if (member->IsOutputOlderThanInputs())
+            return true;
+    }
+    return false;
+}
+
+void FusedElementwiseGroup::BumpEvalTimeStamp()
+{
+    for (auto& member : m_members)
+        member->BumpEvalTimeStamp();
+}
+
+void FusedElementwiseGroup::ForwardProp(const FrameRange& fr)
+{
+    m_lastForwardWasFused = !m_fusedExecutionDisabled && (m_isFloat ? CanRunFused<float>() : CanRunFused<double>());
+    if (!m_lastForwardWasFused)
+    {
+        for (auto& member : m_members)
+            member->ForwardProp(fr);
+    }
+    else if (m_isFloat)
+        ForwardPropFused<float>(fr);
+    else
+        ForwardPropFused<double>(fr);
+}
+
+void FusedElementwiseGroup::Backprop(const FrameRange& fr, bool childrenInThisLoop, bool childrenInOuterLoop)
+{
+    if (!m_lastForwardWasFused)
+    {
+        for (auto iter = m_members.rbegin(); iter != m_members.rend(); iter++)
+            (*iter)->Backprop(fr, childrenInThisLoop, childrenInOuterLoop);
+    }
+    else if (m_isFloat)
+        BackpropFused<float>(fr, childrenInThisLoop, childrenInOuterLoop);
+    else
+        BackpropFused<double>(fr, childrenInThisLoop, childrenInOuterLoop);
+}
+
+// the fused kernels only exist for dense CPU matrices
+template <class ElemType>
+bool FusedElementwiseGroup::CanRunFused() const
+{
+    auto root = dynamic_pointer_cast<ComputationNode<ElemType>>(GetRoot());
+    if (!Matrix<ElemType>::IsFusedElementwiseSupported(root->Value()))
+        return false;
+    for (const auto& inputBase : m_inputs)
+    {
+        auto input = dynamic_pointer_cast<ComputationNode<ElemType>>(inputBase);
+        if (!input || !Matrix<ElemType>::IsFusedElementwiseSupported(input->Value()) ||
+            input->Value().GetNumRows() != root->Value().GetNumRows() ||
+            input->Value().GetNumCols() != (input->HasMBLayout() ? root->Value().GetNumCols() : 1))
+            return false;
+    }
+    return true;
+}
+
+template <class ElemType>
+void FusedElementwiseGroup::ForwardPropFused(const FrameRange& fr)
+{
+    auto root = static_pointer_cast<ComputationNode<ElemType>>(GetRoot());
+    vector<Matrix<ElemType>> inputSlices;
+    inputSlices.reserve(m_inputs.size()); // (we hand out pointers into this)
+    vector<const Matrix<ElemType>*> inputs;
+    for (const auto& inputBase : m_inputs)
+    {
+        auto input = static_pointer_cast<ComputationNode<ElemType>>(inputBase);
+        if (input->HasMBLayout())
+        {
+            inputSlices.push_back(input->ValueFor(fr));
+            inputs.push_back(&inputSlices.back());
+        }
+        else
+            inputs.push_back(&input->Value()); // broadcast
+    }
+    auto result = root->ValueFor(fr);
+    Matrix<ElemType>::FusedElementwiseForward(m_program, inputs, result);
+}
+
+// Only the gradients of the inputs selected by 'childrenInThisLoop' and 'childrenInOuterLoop' are
+// computed, with the same meaning as in ComputationNode::Backprop(). This matters inside a loop,
+// where the gradients of inputs outside the loop are computed afterwards for all frames at once.
+template <class ElemType>
+void FusedElementwiseGroup::BackpropFused(const FrameRange& fr, bool childrenInThisLoop, bool childrenInOuterLoop)
+{
+    auto root = static_pointer_cast<ComputationNode<ElemType>>(GetRoot());
+    vector<Matrix<ElemType>> slices;
+    slices.reserve(2 * m_inputs.size()); // (we hand out pointers into this)
+    vector<const Matrix<ElemType>*> inputs;
+    vector<Matrix<ElemType>*> inputGradients;
+    bool anyGradient = false;
+    bool reducesInTime = false;
+    for (const auto& inputBase : m_inputs)
+    {
+        auto input = static_pointer_cast<ComputationNode<ElemType>>(inputBase);
+        if (input->HasMBLayout())
+        {
+            slices.push_back(input->ValueFor(fr));
+            inputs.push_back(&slices.back());
+        }
+        else
+            inputs.push_back(&input->Value());
+
+        inputGradients.push_back(nullptr);
+        if (!input->NeedGradient() ||
+            !((childrenInThisLoop && input->IsPartOfLoop() == root->IsPartOfLoop()) ||
+              (childrenInOuterLoop && input->IsPartOfLoop() != root->IsPartOfLoop())))
+            continue;
+        input->LazyZeroGradient(); // set gradient to 0 if this is the first time
+        if (!Matrix<ElemType>::IsFusedElementwiseSupported(input->Gradient()))
+            LogicError("FusedElementwiseGroup: Gradient of %ls %ls operation is not a dense CPU matrix.", input->NodeName().c_str(), input->OperationName().c_str());
+        if (input->HasMBLayout())
+        {
+            slices.push_back(input->GradientFor(fr));
+            inputGradients.back() = &slices.back();
+        }
+        else
+        {
+            inputGradients.back() = &input->Gradient(); // summed over all frames
+            reducesInTime = true;
+        }
+        anyGradient = true;
+    }
+    if (!anyGradient)
+        return;
+
+    // like the unfused nodes, zero out the gaps before summing over frames, also in the values that get multiplied with the gradient
+    if (reducesInTime && root->GetMBLayout()->HasGaps(fr))
+    {
+        root->MaskMissingGradientColumnsToZero(fr);
+        for (const auto& input : m_inputs)
+        {
+            if (input->HasMBLayout())
+                input->MaskMissingValueColumnsToZero(fr);
+        }
+    }
+
+    auto resultGradient = root->GradientFor(fr);
+    Matrix<ElemType>::FusedElementwiseBackward(m_program, inputs, resultGradient, inputGradients);
+}
+
 } } }
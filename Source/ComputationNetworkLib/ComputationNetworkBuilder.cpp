@@ -51,6 +51,7 @@ static shared_ptr<ComputationNode<ElemType>> CreateStandardNode(const std::wstri
     else if (nodeType == OperationNameOf(ErrorPredictionNode))                  return New<ErrorPredictionNode<ElemType>>(forward<_Types>(_Args)...);
     else if (nodeType == OperationNameOf(ExpNode))                              return New<ExpNode<ElemType>>(forward<_Types>(_Args)...);
     else if (nodeType == OperationNameOf(FutureValueNode))                      return New<FutureValueNode<ElemType>>(forward<_Types>(_Args)...);
+    else if (nodeType == OperationNameOf(GRUNode))                              return New<GRUNode<ElemType>>(forward<_Types>(_Args)...);
 #ifdef COMING_SOON
     else if (nodeType == OperationNameOf(GMMLogLikelihoodNode))                 return New<GMMLogLikelihoodNode<ElemType>>(forward<_Types>(_Args)...);
 #endif
@@ -60,6 +61,7 @@ static shared_ptr<ComputationNode<ElemType>> CreateStandardNode(const std::wstri
     else if (nodeType == OperationNameOf(LogNode))                              return New<LogNode<ElemType>>(forward<_Types>(_Args)...);
     else if (nodeType == OperationNameOf(LogSoftmaxNode))                       return New<LogSoftmaxNode<ElemType>>(forward<_Types>(_Args)...);
     else if (nodeType == OperationNameOf(LookupTableNode))                      return New<LookupTableNode<ElemType>>(forward<_Types>(_Args)...);
+    else if (nodeType == OperationNameOf(LSTMNode))                             return New<LSTMNode<ElemType>>(forward<_Types>(_Args)...);
     else if (nodeType == OperationNameOf(MatrixL1RegNode))                      return New<MatrixL1RegNode<ElemType>>(forward<_Types>(_Args)...);
     else if (nodeType == OperationNameOf(MatrixL2RegNode))                      return New<MatrixL2RegNode<ElemType>>(forward<_Types>(_Args)...);
     else if (nodeType == OperationNameOf(MeanNode))                             return New<MeanNode<ElemType>>(forward<_Types>(_Args)...);
@@ -609,6 +611,24 @@ shared_ptr<ComputationNode<ElemType>> ComputationNetworkBuilder<ElemType>::Batch
                                            input, scale, bias, runMean, runInvStdDev);
 }
 
+template <class ElemType>
+shared_ptr<ComputationNode<ElemType>> ComputationNetworkBuilder<ElemType>::LSTM(const ComputationNodePtr input, const ComputationNodePtr W, const ComputationNodePtr R, const ComputationNodePtr b,
+                                                                                const ComputationNodePtr peepholes, const ComputationNodePtr projection, const float initHiddenActivity, const std::wstring nodeName)
+{
+    auto node = New<LSTMNode<ElemType>>(net.GetDeviceId(), nodeName, (ElemType) initHiddenActivity);
+    if (projection)
+        return net.AddNodeToNetAndAttachInputs(node, input, W, R, b, peepholes, projection);
+    else
+        return net.AddNodeToNetAndAttachInputs(node, input, W, R, b, peepholes);
+}
+
+template <class ElemType>
+shared_ptr<ComputationNode<ElemType>> ComputationNetworkBuilder<ElemType>::GRU(const ComputationNodePtr input, const ComputationNodePtr W, const ComputationNodePtr R, const ComputationNodePtr b,
+                                                                               const float initHiddenActivity, const std::wstring nodeName)
+{
+    return net.AddNodeToNetAndAttachInputs(New<GRUNode<ElemType>>(net.GetDeviceId(), nodeName, (ElemType) initHiddenActivity), input, W, R, b);
+}
+
 template class ComputationNetworkBuilder<float>;
 template class ComputationNetworkBuilder<double>;
 
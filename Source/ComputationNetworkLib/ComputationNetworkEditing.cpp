@@ -9,10 +9,13 @@
 #include "ComputationNode.h"
 #include "ComputationNetwork.h"
 #include "InputAndParamNodes.h"
+#include "LinearAlgebraNodes.h"
+#include "ConvolutionalNodes.h"
 #include "TrainingNodes.h"
 #include <string>
 #include <vector>
 #include <list>
+#include <map>
 
 using namespace std;
 
@@ -94,6 +97,49 @@ void ComputationNetwork::CopySubTree(const ComputationNetwork& fromNet,
     }
 }
 
+// turn this network into a copy of 'fromNet' whose LearnableParameter nodes share their values with those of 'fromNet'
+// Used to evaluate one model on multiple threads: each copy has its own node state and activation buffers,
+// while the parameters exist once. They must not be modified as long as copies exist.
+void ComputationNetwork::CopyNetworkSharingParameters(const ComputationNetwork& fromNet)
+{
+    ClearNetwork();
+    InvalidateCompiledNetwork();
+    m_deviceId = fromNet.m_deviceId;
+    m_randomSeedOffset = fromNet.m_randomSeedOffset;
+
+    for (const auto& iter : fromNet.m_nameToNodeMap)
+    {
+        const ComputationNodeBasePtr& fromNode = iter.second;
+        int flags = CopyNodeFlags::copyNodeValue;
+        if (fromNode->OperationName() == OperationNameOf(LearnableParameter))
+            flags |= CopyNodeFlags::copyNodeValueShared;
+        AddNodeToNet(fromNode->Duplicate(fromNode->NodeName(), (CopyNodeFlags) flags));
+    }
+
+    // connect the copies like the originals
+    for (const auto& iter : fromNet.m_nameToNodeMap)
+    {
+        const auto& fromInputs = iter.second->GetInputs();
+        if (fromInputs.empty())
+            continue;
+        vector<ComputationNodeBasePtr> inputs;
+        for (const auto& fromInput : fromInputs)
+            inputs.push_back(GetNodeFromName(fromInput->NodeName()));
+        GetNodeFromName(iter.first)->AttachInputs(inputs);
+    }
+
+    auto groups = GetAllNodeGroups();
+    auto fromGroups = const_cast<ComputationNetwork&>(fromNet).GetAllNodeGroups();
+    for (size_t i = 0; i < groups.size(); i++)
+    {
+        groups[i]->clear();
+        for (const auto& fromNode : *fromGroups[i])
+            groups[i]->push_back(GetNodeFromName(fromNode->NodeName()));
+    }
+
+    CompileNetwork();
+}
+
 // you can only copy inputs from nodes in the same network
 void ComputationNetwork::CopyInputs(const std::wstring fromName, std::wstring toName)
 {
@@ -360,4 +406,197 @@ void ComputationNetwork::SetBatchNormlizationNodesBelowEvalMode(const bool evalM
         }
     }
 }
+
+// W = diag(a) * W, where W holds one filter per output channel
+// The rows of a Times matrix and of an HWC convolution kernel are the output channels. A CHW (cuDNN) convolution kernel
+// is stored as [K x C x kH x kW] instead, i.e. each output channel is a contiguous block, which is a column of the reshaped view.
+template <class ElemType>
+static void ScaleOutputChannels(Matrix<ElemType>& weights, const Matrix<ElemType>& a, bool isChwConvolution)
+{
+    size_t numChannels = a.GetNumElements();
+    if (isChwConvolution)
+        weights.Reshaped(weights.GetNumElements() / numChannels, numChannels).RowElementMultiplyWith(a.Reshaped(1, numChannels));
+    else
+        weights.ColumnElementMultiplyWith(a);
+}
+
+// fold BatchNormalization nodes in inference mode into the Times or Convolution node that feeds them
+// BN(W * x + b) = a .* (W * x + b) + (bias - a .* runMean), with a = scale .* runInvStdDev per output row (Times) or feature map (Convolution).
+//  - The filters of W for each output channel are scaled by a (see ScaleOutputChannels() for the CHW convolution layout).
+//  - If the BN input is Plus(Times/Convolution, b), b absorbs the rest and the BN node is removed from the network.
+//  - Otherwise, the BN node stays, with scale 1, runMean 0, and runInvStdDev 1, i.e. it only adds the folded bias.
+// Only BN nodes whose inputs and parameters are not shared with any other node are folded.
+// Returns the number of folded nodes. Call CompileNetwork() afterwards if this returned non-zero.
+template <class ElemType>
+size_t ComputationNetwork::FoldBatchNormalizationNodes()
+{
+    map<ComputationNodeBasePtr, size_t> numConsumers;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        for (const auto& input : iter.second->GetInputs())
+            numConsumers[input]++;
+    }
+    auto isUnsharedParameter = [&](const ComputationNodeBasePtr& node)
+    {
+        return node->OperationName() == OperationNameOf(LearnableParameter) && numConsumers[node] == 1;
+    };
+    auto isInNodeGroup = [&](const ComputationNodeBasePtr& node)
+    {
+        for (auto group : GetAllNodeGroups())
+        {
+            if (find(group->begin(), group->end(), node) != group->end())
+                return true;
+        }
+        return false;
+    };
+
+    vector<ComputationNodeBasePtr> bnNodes;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        auto bn = dynamic_pointer_cast<BatchNormalizationNode<ElemType>>(iter.second);
+        if (bn && bn->IsEvalMode())
+            bnNodes.push_back(iter.second);
+    }
+
+    size_t numFolded = 0;
+    for (const auto& bn : bnNodes)
+    {
+        bool isSpatial = bn->template As<BatchNormalizationNode<ElemType>>()->IsSpatial();
+
+        // match the pattern
+        ComputationNodeBasePtr linear = bn->Input(0);
+        ComputationNodeBasePtr biasNode;
+        if (linear->OperationName() == OperationNameOf(PlusNode) && numConsumers[linear] == 1 && isUnsharedParameter(linear->Input(1)))
+        {
+            biasNode = linear->Input(1);
+            linear = linear->Input(0);
+        }
+        bool isConvolution = linear->OperationName() == OperationNameOf(ConvolutionNode);
+        bool isTimes = linear->OperationName() == OperationNameOf(TimesNode);
+        if (!(isConvolution && isSpatial) && !(isTimes && !isSpatial))
+            continue;
+        if (numConsumers[linear] != 1 || !isUnsharedParameter(linear->Input(0)))
+            continue;
+        bool parametersUnshared = true;
+        for (size_t i = 1; i < bn->GetNumInputs(); i++)
+            parametersUnshared &= isUnsharedParameter(bn->Input(i));
+        if (!parametersUnshared)
+            continue;
+
+        auto& weights = linear->Input(0)->template As<ComputationNode<ElemType>>()->Value();
+        auto& scale = bn->Input(1)->template As<ComputationNode<ElemType>>()->Value();
+        auto& bias = bn->Input(2)->template As<ComputationNode<ElemType>>()->Value();
+        auto& runMean = bn->Input(3)->template As<ComputationNode<ElemType>>()->Value();
+        auto& runInvStdDev = bn->Input(4)->template As<ComputationNode<ElemType>>()->Value();
+        size_t numChannels = scale.GetNumElements();
+        if (weights.GetNumRows() != numChannels || (biasNode && biasNode->template As<ComputationNode<ElemType>>()->Value().GetNumElements() != numChannels))
+            continue;
+
+        // a = scale .* runInvStdDev; W = diag(a) * W
+        Matrix<ElemType> a(weights.GetDeviceId());
+        a.AssignElementProductOf(scale.Reshaped(numChannels, 1), runInvStdDev.Reshaped(numChannels, 1));
+        ScaleOutputChannels(weights, a, isConvolution && linear->template As<ConvolutionNode<ElemType>>()->GetImageLayoutKind() == ImageLayoutKind::CHW);
+
+        // foldedBias = bias - a .* runMean
+        Matrix<ElemType> foldedBias(weights.GetDeviceId());
+        foldedBias.AssignElementProductOf(a, runMean.Reshaped(numChannels, 1));
+        foldedBias *= -1;
+        foldedBias += bias.Reshaped(numChannels, 1);
+
+        if (biasNode) // b = a .* b (+ foldedBias, if the BN node goes away)
+        {
+            Matrix<ElemType> b = biasNode->template As<ComputationNode<ElemType>>()->Value().Reshaped(numChannels, 1);
+            b.ElementMultiplyWith(a);
+            if (!isInNodeGroup(bn))
+            {
+                b += foldedBias;
+                // bypass and delete the BN node and its parameters
+                for (const auto& iter : m_nameToNodeMap)
+                {
+                    for (size_t i = 0; i < iter.second->GetNumInputs(); i++)
+                    {
+                        if (iter.second->Input(i) == bn)
+                            iter.second->SetInput(i, bn->Input(0));
+                    }
+                }
+                fprintf(stderr, "FoldBatchNormalizationNodes: Folded %ls into %ls and %ls.\n", bn->NodeName().c_str(), linear->Input(0)->NodeName().c_str(), biasNode->NodeName().c_str());
+                vector<wstring> namesToDelete{bn->NodeName()};
+                for (size_t i = 1; i < bn->GetNumInputs(); i++)
+                    namesToDelete.push_back(bn->Input(i)->NodeName());
+                for (const auto& name : namesToDelete)
+                    DeleteNode(name);
+                numFolded++;
+                continue;
+            }
+        }
+        scale.SetValue(1);
+        runMean.SetValue(0);
+        runInvStdDev.SetValue(1);
+        bias.Reshaped(numChannels, 1).SetValue(foldedBias);
+        fprintf(stderr, "FoldBatchNormalizationNodes: Folded the scale of %ls into %ls.\n", bn->NodeName().c_str(), linear->Input(0)->NodeName().c_str());
+        numFolded++;
+    }
+    if (numFolded > 0)
+        InvalidateCompiledNetwork();
+    return numFolded;
+}
+
+template size_t ComputationNetwork::FoldBatchNormalizationNodes<float>();
+template size_t ComputationNetwork::FoldBatchNormalizationNodes<double>();
+
+// quantize the weights of the Times, TransposeTimes, and Convolution nodes to numBits (8 or 16) integers for inference on the CPU, see QuantizedGemm.h
+// Only weights that are a LearnableParameter are quantized, once per parameter and layout, so that nodes sharing a parameter share
+// its quantized weights. A parameter whose consumers all use the quantized weights is no longer read, and its value is released;
+// such a network can be evaluated, but no longer trained or saved.
+// The network must have been compiled, since validation creates the convolution engines. Returns the number of quantized nodes.
+template <class ElemType>
+size_t ComputationNetwork::QuantizeWeights(size_t numBits)
+{
+    VerifyIsCompiled("QuantizeWeights");
+    if (m_deviceId != CPUDEVICE)
+        InvalidArgument("QuantizeWeights: Quantized weights are only supported on the CPU.");
+
+    map<ComputationNodeBasePtr, size_t> numConsumers, numQuantizedConsumers;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        for (const auto& input : iter.second->GetInputs())
+            numConsumers[input]++;
+    }
+
+    IQuantizableNode::QuantizedWeightsCache quantizedWeightsCache;
+    size_t numQuantized = 0, quantizedBytes = 0;
+    for (const auto& iter : m_nameToNodeMap)
+    {
+        const ComputationNodeBasePtr& node = iter.second;
+        auto quantizableNode = dynamic_pointer_cast<IQuantizableNode>(node);
+        if (!quantizableNode || node->Input(0)->OperationName() != OperationNameOf(LearnableParameter))
+            continue;
+        size_t numCached = quantizedWeightsCache.size();
+        if (!quantizableNode->QuantizeWeights(numBits, quantizedWeightsCache))
+        {
+            fprintf(stderr, "QuantizeWeights: %ls %ls operation cannot use quantized weights, skipped.\n", node->NodeName().c_str(), node->OperationName().c_str());
+            continue;
+        }
+        numQuantizedConsumers[node->Input(0)]++;
+        if (quantizedWeightsCache.size() > numCached) // (not shared with a node quantized before)
+            quantizedBytes += quantizableNode->GetQuantizedWeightsSizeInBytes();
+        numQuantized++;
+    }
+
+    size_t releasedBytes = 0;
+    for (const auto& iter : numQuantizedConsumers)
+    {
+        if (iter.second != numConsumers[iter.first])
+            continue;
+        auto parameter = iter.first->template As<LearnableParameter<ElemType>>();
+        releasedBytes += parameter->Value().GetNumElements() * sizeof(ElemType);
+        parameter->ReleaseValue();
+    }
+    fprintf(stderr, "QuantizeWeights: Quantized the weights of %d nodes to %d bits (%.1f MB); released %.1f MB of parameters.\n",
+            (int) numQuantized, (int) numBits, quantizedBytes / 1048576.0, releasedBytes / 1048576.0);
+    return numQuantized;
+}
+
+template size_t ComputationNetwork::QuantizeWeights<float>(size_t numBits);
+template size_t ComputationNetwork::QuantizeWeights<double>(size_t numBits);
 } } }
@@ -10,12 +10,19 @@
 #include "ComputationNetwork.h"
 #include "RecurrentNodes.h"
 #include "InputAndParamNodes.h"
+#include "ThreadPool.h"
 #include <string>
 #include <vector>
 #include <list>
 #include <set>
 #include <algorithm>
 #include <map>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace std;
 
@@ -40,7 +47,9 @@ void ComputationNetwork::ForwardProp(const ComputationNodeBasePtr rootNode)
     VerifyIsCompiled("ForwardProp");
 
     // traverse all nodes in the pre-determined evaluation order
-    GetNestedNetwork(rootNode)->ForwardProp(FrameRange(nullptr));
+    auto nestedNetwork = dynamic_pointer_cast<PARTraversalFlowControlNode>(GetNestedNetwork(rootNode));
+    nestedNetwork->m_nodeProfiler = m_nodeProfiler;
+    nestedNetwork->ForwardProp(FrameRange(nullptr));
 }
 
 // set the gradient matrix of a node to an 1x1 matrix containing 1.0
@@ -74,7 +83,10 @@ void ComputationNetwork::Backprop(const ComputationNodeBasePtr rootNode) // trai
         LogicError("Backprop: Training criterion is neither ComputationNode<float> nor ComputationNode<double>.");
 
     // backpropagate through the network
-    GetNestedNetwork(rootNode)->Backprop(FrameRange(nullptr), true, true);
+    auto nestedNetwork = dynamic_pointer_cast<PARTraversalFlowControlNode>(GetNestedNetwork(rootNode));
+    nestedNetwork->m_gradientReadyCallback = m_gradientReadyCallback;
+    nestedNetwork->m_nodeProfiler = m_nodeProfiler;
+    nestedNetwork->Backprop(FrameRange(nullptr), true, true);
 }
 
 void ComputationNetwork::FormNestedNetwork(const ComputationNodeBasePtr& rootNode)
@@ -127,8 +139,32 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
 }
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::ForwardProp(const FrameRange& fr) /*override*/
 {
-    for (auto& node : m_nestedNodes)
+    NodeProfiler* profiler = m_nodeProfiler.get();
+    auto forwardProp = [&](const ComputationNodeBasePtr& node)
     {
+        NodeProfiler::Clock::time_point start;
+        if (profiler)
+            start = NodeProfiler::Clock::now();
+
+        // the members of a fused group are all computed at the position of the group's root
+        const auto& fusedGroup = node->GetFusedElementwiseGroup();
+        if (fusedGroup)
+        {
+            if (fusedGroup->GetRoot() == node && fusedGroup->IsOutputOlderThanInputs())
+            {
+                for (auto& member : fusedGroup->GetMembers())
+                    member->BeginForwardProp();
+                fusedGroup->ForwardProp(fr.WithLayout(node->GetMBLayout()));
+                for (auto& member : fusedGroup->GetMembers())
+                    member->EndForwardProp();
+
+                fusedGroup->BumpEvalTimeStamp();
+                if (profiler)
+                    profiler->RecordForwardProp(node, start);
+            }
+            return;
+        }
+
         if (node->IsOutputOlderThanInputs())
         {
             auto recInfo = dynamic_pointer_cast<SEQTraversalFlowControlNode>(node);
@@ -140,21 +176,275 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
             node->EndForwardProp();
 
             node->BumpEvalTimeStamp();
+            if (profiler)
+                profiler->RecordForwardProp(node, start);
         }
+    };
+
+    size_t numThreads = g_parallelTraversalThreads; // (read once, since an evaluator of another network may change it meanwhile)
+    if (numThreads > 0 && !m_forwardGraph.IsEmpty())
+    {
+        ExecuteGraph(numThreads, m_forwardGraph, [&](size_t i)
+                     {
+                         forwardProp(m_nestedNodes[i]);
+                     });
+        return;
     }
+
+    for (auto& node : m_nestedNodes)
+        forwardProp(node);
 }
 
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::Backprop(const FrameRange& fr, bool childrenInThisLoop, bool childrenInOuterLoop) /*override*/
 {
     childrenInThisLoop, childrenInOuterLoop; // TODO: think through what these mean when coming from PAR mode
-    // process nodes in pre-determined order
-    for (auto pnode = m_nestedNodes.rbegin(); pnode != m_nestedNodes.rend(); pnode++) // iterate backwards over evaluation order
+    NodeProfiler* profiler = m_nodeProfiler.get();
+    auto backprop = [&](const ComputationNodeBasePtr& node)
     {
-        auto& node = *pnode;
+        NodeProfiler::Clock::time_point start;
+        if (profiler)
+            start = NodeProfiler::Clock::now();
+
+        const auto& fusedGroup = node->GetFusedElementwiseGroup();
+        if (fusedGroup)
+        {
+            if (fusedGroup->GetRoot() == node)
+            {
+                for (auto& member : fusedGroup->GetMembers())
+                    member->BeginBackprop();
+                fusedGroup->Backprop(fr.WithLayout(node->GetMBLayout()), true /*childrenInThisLoop*/, true /*childrenInOuterLoop*/);
+                for (auto& member : fusedGroup->GetMembers())
+                    member->EndBackprop();
+                if (profiler)
+                    profiler->RecordBackprop(node, start);
+            }
+            return;
+        }
 
         node->BeginBackprop();
         node->Backprop(fr.WithLayout(node->GetMBLayout()), true /*childrenInThisLoop*/, true /*childrenInOuterLoop*/);
         node->EndBackprop();
+        if (profiler)
+            profiler->RecordBackprop(node, start);
+
+        // all consumers of this node come after it in evaluation order, so they have back-propagated into it by now
+        if (m_gradientReadyCallback)
+            m_gradientReadyCallback(node);
+    };
+
+    size_t numThreads = g_parallelTraversalThreads;
+    if (numThreads > 0 && !m_backwardGraph.IsEmpty())
+    {
+        ExecuteGraph(numThreads, m_backwardGraph, [&](size_t i)
+                     {
+                         backprop(m_nestedNodes[i]);
+                     });
+        return;
+    }
+
+    // process nodes in pre-determined order
+    for (auto pnode = m_nestedNodes.rbegin(); pnode != m_nestedNodes.rend(); pnode++) // iterate backwards over evaluation order
+        backprop(*pnode);
+}
+
+// -----------------------------------------------------------------------
+// concurrent execution of PARTraversalFlowControlNode
+//
+// With g_parallelTraversalThreads > 0, the nested nodes are run on a work-stealing
+// thread pool as soon as all nodes they depend on have completed, so that independent
+// branches (e.g. the towers of a DSSM) overlap. The dependencies are:
+//  - forward: data flow (input -> consumer)
+//  - backward: reverse data flow (a node's gradient is complete once all its consumers
+//    have back-propagated), and consumers of the same input are serialized since they
+//    all accumulate into that input's gradient
+//  - both: nodes that get the same pooled matrix from the MatrixPool are ordered as in
+//    the serial simulation done by AllocateAllMatrices(), i.e. all users of one sharer
+//    of a buffer complete before the next sharer starts
+// All edges follow the serial order, so the serial walk is one valid schedule.
+// This is only enabled for CPU networks.
+// -----------------------------------------------------------------------
+
+// the pool is shared by all networks; it is (re-)created on first use with a given number of threads
+// Callers hold on to the returned pointer while they run, so that replacing the pool, e.g. when the evaluator
+// of another network sets a different g_parallelTraversalThreads, does not destroy it underneath them.
+static shared_ptr<ThreadPool> GetTraversalThreadPool(size_t numThreads)
+{
+    static shared_ptr<ThreadPool> threadPool;
+    static mutex threadPoolMutex;
+    lock_guard<mutex> lock(threadPoolMutex);
+    if (!threadPool || threadPool->GetNumThreads() != numThreads)
+    {
+        // split the OpenMP threads used inside the kernels among our workers, to not oversubscribe the cores
+        int ompThreadsPerWorker = 1;
+#ifdef _OPENMP
+        ompThreadsPerWorker = max(1, omp_get_max_threads() / (int) numThreads);
+#endif
+        threadPool = make_shared<ThreadPool>(numThreads, [ompThreadsPerWorker]()
+                                             {
+#ifdef _OPENMP
+                                                 omp_set_num_threads(ompThreadsPerWorker);
+#else
+                                                 ompThreadsPerWorker;
+#endif
+                                             });
+    }
+    return threadPool;
+}
+
+/*static*/ void ComputationNetwork::PARTraversalFlowControlNode::ExecuteGraph(size_t numThreads, const ExecutionGraph& graph, const std::function<void(size_t)>& runNode)
+{
+    shared_ptr<ThreadPool> threadPool = GetTraversalThreadPool(numThreads);
+
+    const size_t numNodes = graph.m_numPredecessors.size();
+    unique_ptr<atomic<size_t>[]> numPending(new atomic<size_t>[numNodes]);
+    for (size_t i = 0; i < numNodes; i++)
+        numPending[i] = graph.m_numPredecessors[i];
+
+    mutex doneMutex;
+    condition_variable allDone;
+    size_t numDone = 0;
+    exception_ptr firstError;
+    atomic<bool> failed(false);
+
+    // run a node, then release its successors; after an error we only drain the graph
+    function<void(size_t)> schedule = [&](size_t i)
+    {
+        threadPool->Submit([&, i]()
+                          {
+                              if (!failed)
+                              {
+                                  try
+                                  {
+                                      runNode(i);
+                                  }
+                                  catch (...)
+                                  {
+                                      lock_guard<mutex> lock(doneMutex);
+                                      if (!firstError)
+                                          firstError = current_exception();
+                                      failed = true;
+                                  }
+                              }
+                              for (size_t successor : graph.m_successors[i])
+                              {
+                                  if (--numPending[successor] == 0)
+                                      schedule(successor);
+                              }
+                              lock_guard<mutex> lock(doneMutex);
+                              if (++numDone == numNodes)
+                                  allDone.notify_all();
+                          });
+    };
+
+    for (size_t i = 0; i < numNodes; i++)
+    {
+        if (graph.m_numPredecessors[i] == 0)
+            schedule(i);
+    }
+
+    unique_lock<mutex> lock(doneMutex);
+    allDone.wait(lock, [&]()
+                 {
+                     return numDone == numNodes;
+                 });
+    if (firstError)
+        rethrow_exception(firstError);
+}
+
+void ComputationNetwork::PARTraversalFlowControlNode::BuildExecutionGraphs(const MatrixPool& matrixPool)
+{
+    m_forwardGraph.Reset(0);
+    m_backwardGraph.Reset(0);
+
+    // map every node to the index of the nested node that executes it (a SEQ loop executes all its members)
+    map<wstring, size_t> nestedIndex;
+    vector<vector<ComputationNodeBasePtr>> members(m_nestedNodes.size());
+    for (size_t i = 0; i < m_nestedNodes.size(); i++)
+    {
+        auto recInfo = dynamic_pointer_cast<SEQTraversalFlowControlNode>(m_nestedNodes[i]);
+        if (recInfo)
+            members[i] = recInfo->m_nestedNodes;
+        else
+            members[i].push_back(m_nestedNodes[i]);
+        for (const auto& node : members[i])
+        {
+            if (node->GetDeviceId() != CPUDEVICE) // GPU kernels are asynchronous already, nothing to gain
+                return;
+            nestedIndex[node->NodeName()] = i;
+        }
+    }
+
+    // data flow
+    vector<set<size_t>> consumers(m_nestedNodes.size());
+    for (size_t i = 0; i < m_nestedNodes.size(); i++)
+    {
+        for (const auto& node : members[i])
+        {
+            // the root of a fused group reads the inputs of all its members
+            auto inputs = node->GetInputs();
+            const auto& fusedGroup = node->GetFusedElementwiseGroup();
+            if (fusedGroup && fusedGroup->GetRoot() == node)
+                inputs.insert(inputs.end(), fusedGroup->GetInputs().begin(), fusedGroup->GetInputs().end());
+            for (const auto& input : inputs)
+            {
+                auto iter = nestedIndex.find(input->NodeName());
+                if (iter != nestedIndex.end() && iter->second != i)
+                    consumers[iter->second].insert(i);
+            }
+        }
+    }
+
+    m_forwardGraph.Reset(m_nestedNodes.size());
+    m_backwardGraph.Reset(m_nestedNodes.size());
+    for (size_t i = 0; i < m_nestedNodes.size(); i++)
+    {
+        for (size_t consumer : consumers[i])
+        {
+            m_forwardGraph.AddEdge(i, consumer);
+            m_backwardGraph.AddEdge(consumer, i);
+        }
+        // consumers accumulate into our gradient one at a time, in the serial order
+        bool needsGradient = false;
+        for (const auto& node : members[i])
+            needsGradient |= node->NeedGradient();
+        for (auto iter = consumers[i].rbegin(); needsGradient && iter != consumers[i].rend(); iter++)
+        {
+            auto next = iter;
+            if (++next != consumers[i].rend())
+                m_backwardGraph.AddEdge(*iter, *next);
+        }
+    }
+
+    // matrix sharing
+    for (const auto& sharers : matrixPool.GetBufferSharers())
+    {
+        vector<size_t> sharerIndices; // sharers within this network, in the order they got the buffer
+        for (const auto& name : sharers)
+        {
+            auto iter = nestedIndex.find(name);
+            if (iter != nestedIndex.end() && (sharerIndices.empty() || sharerIndices.back() != iter->second))
+                sharerIndices.push_back(iter->second);
+        }
+        for (size_t k = 1; k < sharerIndices.size(); k++)
+        {
+            // everything that touches the previous sharer's matrix (the sharer itself and its consumers) must be done before the next sharer touches it
+            size_t prev = sharerIndices[k - 1];
+            size_t next = sharerIndices[k];
+            set<size_t> prevUsers = consumers[prev];
+            prevUsers.insert(prev);
+            set<size_t> nextUsers = consumers[next];
+            nextUsers.insert(next);
+            for (size_t u : prevUsers)
+            {
+                if (u < next)
+                    m_forwardGraph.AddEdge(u, next);
+                for (size_t v : nextUsers)
+                {
+                    if (u > v)
+                        m_backwardGraph.AddEdge(u, v);
+                }
+            }
+        }
     }
 }
 /*virtual*/ void ComputationNetwork::PARTraversalFlowControlNode::RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) /*override*/
@@ -215,8 +505,17 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
     {
         for (auto& node : m_nestedNodes)
         {
-            node->ForwardProp(t);
-            node->BumpEvalTimeStamp();
+            const auto& fusedGroup = node->GetFusedElementwiseGroup();
+            if (!fusedGroup)
+            {
+                node->ForwardProp(t);
+                node->BumpEvalTimeStamp();
+            }
+            else if (fusedGroup->GetRoot() == node) // members of a fused group are computed together with its root
+            {
+                fusedGroup->ForwardProp(t);
+                fusedGroup->BumpEvalTimeStamp();
+            }
         }
     }
 }
@@ -246,7 +545,11 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
         for (auto nodeIter2 = recurrentNodes.rbegin(); nodeIter2 != recurrentNodes.rend(); ++nodeIter2)
         {
             auto& node2 = *nodeIter2;
-            node2->Backprop(t, true /*childrenInThisLoop*/, false /*childrenInOuterLoop*/);
+            const auto& fusedGroup = node2->GetFusedElementwiseGroup();
+            if (!fusedGroup)
+                node2->Backprop(t, true /*childrenInThisLoop*/, false /*childrenInOuterLoop*/);
+            else if (fusedGroup->GetRoot() == node2)
+                fusedGroup->Backprop(t, true /*childrenInThisLoop*/, false /*childrenInOuterLoop*/);
             // The above flags tell Backprop() to skip back-propagation from inside a node into
             // a node that is outside the loop, which is done later in EndBackprop() in PAR mode.
         }
@@ -261,7 +564,11 @@ ComputationNetwork::PARTraversalFlowControlNode::PARTraversalFlowControlNode(con
     for (auto nodeIter2 = m_nestedNodes.rbegin(); nodeIter2 != m_nestedNodes.rend(); ++nodeIter2)
     {
         auto& node2 = *nodeIter2;
-        node2->Backprop(FrameRange(m_nestedNodes[0]->GetMBLayout()), false /*childrenInThisLoop*/, true /*childrenInOuterLoop*/);
+        const auto& fusedGroup = node2->GetFusedElementwiseGroup();
+        if (!fusedGroup)
+            node2->Backprop(FrameRange(m_nestedNodes[0]->GetMBLayout()), false /*childrenInThisLoop*/, true /*childrenInOuterLoop*/);
+        else if (fusedGroup->GetRoot() == node2)
+            fusedGroup->Backprop(FrameRange(m_nestedNodes[0]->GetMBLayout()), false /*childrenInThisLoop*/, true /*childrenInOuterLoop*/);
     }
 
     // tell all nodes we are done for this iteraTion
@@ -370,6 +677,9 @@ void ComputationNetwork::PrintComputationTree(const ComputationNodeBasePtr& root
 void ComputationNetwork::InvalidateCompiledNetwork()
 {
     m_isCompiled = false;
+    for (auto& nodeIter : m_nameToNodeMap)
+        nodeIter.second->m_fusedElementwiseGroup = nullptr;
+    m_fusedElementwiseGroupsFormed = false;
     m_allSEQNodes.clear();
     m_evalOrders.clear();
     m_nestedNetworks.clear();
@@ -707,6 +1017,10 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
 
     VerifyIsCompiled("AllocateAllMatrices");
 
+    // forget the buffers of deleted nodes, and remember where we start, so that the memory plan below only lists what this call added
+    m_matrixPool.StartAllocationPass();
+    size_t planStartStep = m_matrixPool.GetCurrentStep();
+
     // Due to special topology, if a node is solely induced by parameters, its function value should not be shared
     MarkValueNonSharableNodes();
 
@@ -719,6 +1033,16 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
     if (trainRootNode != nullptr)
         forwardPropRoots.push_back(trainRootNode);
 
+    // find groups of elementwise nodes to compute in one pass; all nodes we get asked for must keep their values
+    if (g_fuseElementwiseNodes && !m_fusedElementwiseGroupsFormed)
+        FormFusedElementwiseGroups(forwardPropRoots);
+    for (auto& node : forwardPropRoots)
+    {
+        const auto& fusedGroup = node->GetFusedElementwiseGroup();
+        if (fusedGroup && fusedGroup->GetRoot() != node) // (groups were formed by an earlier call)
+            fusedGroup->DisableFusedExecution();
+    }
+
     // For each node determine parents and whether the output of the
     // node is needed during back propagation
     std::unordered_map<ComputationNodeBasePtr, bool> outputValueNeededDuringBackProp;
@@ -748,6 +1072,23 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
         }
     }
 
+    // the backprop of a fused group recomputes its intermediate values from its inputs
+    if (performingBackPropagation)
+    {
+        for (auto& rootNode : forwardPropRoots)
+        {
+            for (auto& currentNode : GetEvalOrder(rootNode))
+            {
+                const auto& fusedGroup = currentNode->GetFusedElementwiseGroup();
+                if (fusedGroup && fusedGroup->GetRoot() == currentNode && currentNode->NeedGradient())
+                {
+                    for (const auto& input : fusedGroup->GetInputs())
+                        outputValueNeededDuringBackProp[input] = true;
+                }
+            }
+        }
+    }
+
     std::unordered_map<ComputationNodeBasePtr, int> parentCount;
     for (auto& keyValue : parentsMap)
     {
@@ -788,13 +1129,22 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
                 }
             }
         }
-        else
+        else if (!nodeIter->GetFusedElementwiseGroup())
         {
             nodeIter->RequestMatricesBeforeForwardProp(m_matrixPool);
             // we only release matrices for the children since the root node's informatioin will be used and should not be shared
             // with others
             ReleaseMatricesAfterEvalForChildren(nodeIter, parentCount);
         }
+        else if (nodeIter->GetFusedElementwiseGroup()->GetRoot() == nodeIter)
+        {
+            // a fused group is computed as a unit at the position of its root, so all its inputs must live until then
+            const auto& members = nodeIter->GetFusedElementwiseGroup()->GetMembers();
+            for (auto& member : members)
+                member->RequestMatricesBeforeForwardProp(m_matrixPool);
+            for (auto& member : members)
+                ReleaseMatricesAfterEvalForChildren(member, parentCount);
+        }
     }
 
     if (trainRootNode != nullptr)
@@ -824,7 +1174,7 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
                     recInfo->ReleaseMatricesAfterBackprop(m_matrixPool);
                 }
             }
-            else
+            else if (!n->GetFusedElementwiseGroup())
             {
                 // PAR mode: we can allocate and immediately deallocate one by one
                 n->AllocateGradientMatricesForInputs(m_matrixPool);
@@ -832,8 +1182,30 @@ void ComputationNetwork::AllocateAllMatrices(const std::vector<ComputationNodeBa
                 if ((n != trainRootNode) && n->NeedGradient())
                     n->ReleaseMatricesAfterBackprop(m_matrixPool);
             }
+            else if (n->GetFusedElementwiseGroup()->GetRoot() == n)
+            {
+                // a fused group back-propagates as a unit at the position of its root
+                const auto& members = n->GetFusedElementwiseGroup()->GetMembers();
+                for (auto member = members.rbegin(); member != members.rend(); member++)
+                    (*member)->AllocateGradientMatricesForInputs(m_matrixPool);
+                for (auto member = members.rbegin(); member != members.rend(); member++)
+                {
+                    if ((*member != trainRootNode) && (*member)->NeedGradient())
+                        (*member)->ReleaseMatricesAfterBackprop(m_matrixPool);
+                }
+            }
         }
     }
+
+    if (m_traceLevel > 0)
+        m_matrixPool.PrintMemoryPlan(stderr, planStartStep, m_traceLevel > 1 /*printLeases*/);
+
+    // now that we know who shares what, determine which nodes may run concurrently
+    if (g_parallelTraversalThreads > 0)
+    {
+        for (auto& nestedNetwork : m_nestedNetworks)
+            dynamic_pointer_cast<PARTraversalFlowControlNode>(nestedNetwork.second)->BuildExecutionGraphs(m_matrixPool);
+    }
 }
 
 void ComputationNetwork::ReleaseMatricesAfterEvalForChildren(ComputationNodeBasePtr n, std::unordered_map<ComputationNodeBasePtr, int>& parentCount)
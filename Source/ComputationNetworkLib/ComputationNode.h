@@ -22,6 +22,7 @@
 #include <algorithm>
 #include <assert.h>
 #include <atomic>
+#include <mutex>
 
 #define DEFAULT_HIDDEN_ACTIVATION 0.1
 
@@ -30,7 +31,11 @@
 // version number to control how to read and write
 #define CNTK_MODEL_VERSION_1 1
 #define CNTK_MODEL_VERSION_2 2
-#define CURRENT_CNTK_MODEL_VERSION CNTK_MODEL_VERSION_2
+#define CNTK_MODEL_VERSION_3 3 // parameter values stored as page-aligned contiguous tensors, see ComputationNode::SaveValue()
+#define CURRENT_CNTK_MODEL_VERSION CNTK_MODEL_VERSION_3
+
+// alignment of tensor payloads in model files, a multiple of the page size so that they can be memory-mapped
+#define CNTK_MODEL_TENSOR_ALIGNMENT 4096
 
 extern bool g_shareNodeValueMatrices;
 
@@ -51,6 +56,7 @@ enum CopyNodeFlags // flags to be passed to the CopyTo() function
     copyNodeChildren = 2,             // only copy over children links
     copyNodeAll = 3,                  // copy everything
     copyNodeChildrenCrossNetwork = 4, // allow a cross network child copy
+    copyNodeValueShared = 8,          // with copyNodeValue: share the value matrix instead of copying it (read-only parameters, see ComputationNetwork::CopyNetworkSharingParameters())
 };
 
 #pragma region base computation class
@@ -131,12 +137,30 @@ struct /*interface*/ IStatefulNode
 };
 typedef IStatefulNode::NodeStatePtr NodeStatePtr;
 
+// =======================================================================
+//  Interface for nodes that can use integer-quantized weights for inference (TimesNode, ConvolutionNode)
+//  See ComputationNetwork::QuantizeWeights().
+// =======================================================================
+
+struct /*interface*/ IQuantizableNode
+{
+    // quantized weights already created, by weights node and layout, so that nodes that share a parameter also share its quantized weights
+    // The values are QuantizedWeights<ElemType>.
+    typedef map<pair<shared_ptr<ComputationNodeBase>, wstring>, shared_ptr<void>> QuantizedWeightsCache;
+
+    // quantize the weights (Input(0)) to numBits (8 or 16); returns false if this node cannot use them (e.g. sparse or GPU operands)
+    // From then on, ForwardProp() uses the quantized weights, and no longer reads Input(0)'s value. Backprop is no longer possible.
+    virtual bool QuantizeWeights(size_t numBits, QuantizedWeightsCache& cache) = 0;
+    virtual size_t GetQuantizedWeightsSizeInBytes() const = 0; // 0 if not quantized
+};
+
 // =======================================================================
 // ComputationNetworkOwnedNodeState -- class to collect ComputationNode members that are really owned by ComputationNetwork
 // These members are only to be set, changed, and read by ComputationNetwork code.
 // =======================================================================
 
 class ComputationNetwork;
+class FusedElementwiseGroup;
 struct ComputationNetworkOwnedNodeState
 {
     friend class ComputationNetwork;
@@ -161,6 +185,9 @@ struct ComputationNetworkOwnedNodeState
     virtual void MarkValueSharable() { m_valueSharable = true; }
     bool isValueSharable() const { return m_valueSharable; }
 
+    // if not null, this node is computed together with others in one fused pass (see ComputationNetwork::FormFusedElementwiseGroups())
+    const std::shared_ptr<FusedElementwiseGroup>& GetFusedElementwiseGroup() const { return m_fusedElementwiseGroup; }
+
 protected:                // TODO: should be fully encapsulated here
 
     bool m_needsGradient; // true if this node or any children need a gradient to be computed (for own consumption or propagation to somewhere in the child tree)
@@ -168,6 +195,9 @@ protected:                // TODO: should be fully encapsulated here
     bool m_valueSharable; // a flag is needed for memory share.
                           // If it is false (e.g., learnableParameters/InputValue and those nodes are solely induced by learnableParameters),
                           // it will never be released to memory pool
+
+    std::shared_ptr<FusedElementwiseGroup> m_fusedElementwiseGroup;
+
 private:
 
     bool m_isPartOfLoop; // true if this loop is part of a recurrent loop
@@ -701,6 +731,15 @@ public:
     void SetOutputNeededDuringBackprop(bool f) { m_outputNeededDuringBackprop = f; }
     bool IsOutputNeededDuringBackprop() const { return !g_shareNodeValueMatrices || m_outputNeededDuringBackprop; }
 
+    // -----------------------------------------------------------------------
+    // elementwise fusion
+    // -----------------------------------------------------------------------
+
+    // Nodes whose ForwardProp() is a single elementwise op without broadcasting along the sample axes
+    // return that op here, so that ComputationNetwork::FormFusedElementwiseGroups() can fuse them.
+    // Their BackpropTo() must be the derivative that Matrix::FusedElementwiseBackward() implements for that op.
+    virtual bool GetFusableElementwiseOp(ElementWiseOperator& /*op*/) const { return false; }
+
     // -----------------------------------------------------------------------
     // helpers for network traversal
     // -----------------------------------------------------------------------
@@ -903,6 +942,13 @@ public:
         if (flags & CopyNodeFlags::copyNodeValue)
         {
             auto node = UpCast(nodeP);
+            if (flags & CopyNodeFlags::copyNodeValueShared) // both nodes use the same matrix; the copy has no gradient
+            {
+                node->m_value = m_value;
+                node->m_valueStorage = m_valueStorage;
+                node->m_gradient = nullptr;
+                return;
+            }
             *node->m_value = *m_value;
             if (m_gradient)
                 *node->m_gradient = *m_gradient;
@@ -916,7 +962,7 @@ public:
     {
         const std::wstring& name = (newName == L"") ? NodeName() : newName;
         ComputationNodeBasePtr node(NewThis(m_deviceId, name)); // NewThis() is a virtual function that creates a new node of the actual type of 'this'
-        node->CopyTo(shared_from_this(), newName, flags);       // note: shared_from_this() is the base class, but CopyTo() up-casts it as needed
+        CopyTo(node, name, flags);                              // note: CopyTo() up-casts the base-class pointer as needed
         return node;
     }
 
@@ -936,14 +982,86 @@ public:
         AttachInputs(configp, this->GetExpectedNumInputs()); \
     }
 
+    // helper to save m_value to a stream
+    // Dense values are written as a tensor section whose payload starts at a page boundary (CNTK_MODEL_VERSION_3):
+    //  BTensor <element size> <rows> <cols> <zero padding> <rows * cols elements> ETensor
+    // Anything else falls back to the generic matrix format.
+    void SaveValue(File& fstream) const
+    {
+        const auto& value = Value();
+        if (value.GetMatrixType() != DENSE)
+        {
+            fstream << value;
+            return;
+        }
+        fstream.PutMarker(fileMarkerBeginSection, L"BTensor");
+        fstream << sizeof(ElemType) << value.GetNumRows() << value.GetNumCols();
+        fstream.PadToAlignment(CNTK_MODEL_TENSOR_ALIGNMENT);
+        if (value.GetDeviceId() < 0)
+            fstream.WriteArray(value.BufferPointer(), value.GetNumElements());
+        else
+        {
+            unique_ptr<ElemType[]> copy(value.CopyToArray());
+            fstream.WriteArray(copy.get(), value.GetNumElements());
+        }
+        fstream.PutMarker(fileMarkerEndSection, L"ETensor");
+    }
+
     // helper to load m_value from a stream
     // This function updates the dimensions to a 2D matrix.
     // If a different tensor layout is associated with this, it must be implanted afterwards.
     // Nodes that call this never have an MB layout.
-    void LoadValue(File& fstream)
+    // If the file was opened with fileOptionsMemoryMapped and the node lives on the CPU, the value
+    // directly uses the mapped file as its storage (copy-on-write) instead of reading it.
+    void LoadValue(File& fstream, size_t modelVersion)
     {
         CreateMatrixIfNull(m_value);
-        fstream >> Value();
+        if (!Value().OwnBuffer()) // still using a previously mapped model file: let go of it
+        {
+            *m_value = Matrix<ElemType>(m_deviceId);
+            m_valueStorage.reset();
+        }
+        if (modelVersion < CNTK_MODEL_VERSION_3 || !fstream.TryGetMarker(fileMarkerBeginSection, L"BTensor"))
+            fstream >> Value();
+        else
+        {
+            size_t elementSize, numRows, numCols;
+            fstream >> elementSize >> numRows >> numCols;
+            if (elementSize != sizeof(ElemType))
+                RuntimeError("LoadValue: Node '%ls' was saved with elements of %d bytes, but %d are expected.", NodeName().c_str(), (int) elementSize, (int) sizeof(ElemType));
+            fstream.SkipToAlignment(CNTK_MODEL_TENSOR_ALIGNMENT);
+            size_t numElements = numRows * numCols;
+            const auto& mappedView = fstream.GetMappedView();
+            if (numElements == 0)
+                Value().Resize(numRows, numCols);
+            else if (mappedView)
+            {
+                uint64_t pos = fstream.GetPosition();
+                if (pos + numElements * sizeof(ElemType) > mappedView->Size())
+                    RuntimeError("LoadValue: Model file is truncated in the value of node '%ls'.", NodeName().c_str());
+                ElemType* data = (ElemType*) (mappedView->Data() + pos);
+                if (m_deviceId == CPUDEVICE)
+                {
+                    Value().SetValue(numRows, numCols, CPUDEVICE, data, matrixFlagDontOwnBuffer);
+                    m_valueStorage = mappedView;
+                }
+                else
+                    Value().SetValue(numRows, numCols, m_deviceId, data, matrixFlagNormal);
+                fstream.SetPosition(pos + numElements * sizeof(ElemType));
+            }
+            else if (m_deviceId == CPUDEVICE)
+            {
+                Value().Resize(numRows, numCols);
+                fstream.ReadArray(Value().BufferPointer(), numElements);
+            }
+            else
+            {
+                vector<ElemType> buffer(numElements);
+                fstream.ReadArray(buffer.data(), numElements);
+                Value().SetValue(numRows, numCols, m_deviceId, buffer.data(), matrixFlagNormal);
+            }
+            fstream.GetMarker(fileMarkerEndSection, L"ETensor");
+        }
         // above reads dimensions, so we must update our own dimensions
         SetDims(TensorShape(Value().GetNumRows(), Value().GetNumCols()), false);
     }
@@ -1425,9 +1543,10 @@ protected:
 
     void RequestMatrixFromPool(shared_ptr<Matrix<ElemType>>& matrixPtr, MatrixPool& matrixPool)
     {
+        // temps are typically shaped like our output, so our sample size is what the pool uses to pick a buffer of the right size class
         if (matrixPtr == nullptr)
         {
-            matrixPtr = matrixPool.Request<ElemType>(m_deviceId);
+            matrixPtr = matrixPool.Request<ElemType>(m_deviceId, GetSampleMatrixNumRows(), NodeName());
         }
     }
 
@@ -1527,6 +1646,8 @@ public:
     // When using the TensorView interface, one could instead just use a 1x1 matrix with a view that broadcasts its columns (stride 0).
     static const Matrix<ElemType>& ConstOnes(const size_t rows, const size_t cols, const DEVICEID_TYPE deviceId)
     {
+        static std::mutex constOnesMutex; // networks may be evaluated on several threads, see ComputationNetwork::CopyNetworkSharingParameters()
+        std::lock_guard<std::mutex> lock(constOnesMutex);
         if (s_constOnes.find(rows) == s_constOnes.end() ||
             s_constOnes[rows].find(cols) == s_constOnes[rows].end()) // not found
         {
@@ -1548,6 +1669,7 @@ public:
 protected:
 
     shared_ptr<Matrix<ElemType>> m_value, m_gradient;
+    shared_ptr<MappedFileView> m_valueStorage; // memory-mapped model file that m_value points into, see LoadValue()
 
     static std::map<size_t, std::map<size_t, Matrix<ElemType>*>> s_constOnes;
 };
@@ -1755,6 +1877,7 @@ protected:
     using Base::RequestMatricesBeforeForwardProp;                                                                                                        \
     using Base::RequestMatrixFromPool;                                                                                                                   \
     using Base::Save;                                                                                                                                    \
+    using Base::SaveValue;                                                                                                                               \
     using Base::SetDims1;                                                                                                                                \
     using Base::SetDims;                                                                                                                                 \
     using Base::SetInput;                                                                                                                                \
@@ -56,7 +56,7 @@ namespace Microsoft { namespace MSR { namespace CNTK {
 //     - for hidden layer: dimension of activation vector for each pixel
 //  - C' = output channels = dimension of activation vector for each pixel (also called N by NVidia, inconsistently)
 template <class ElemType>
-class ConvolutionNode : public ComputationNode<ElemType>, public NumInputs<2>
+class ConvolutionNode : public ComputationNode<ElemType>, public NumInputs<2>, public IQuantizableNode
 {
     typedef ComputationNode<ElemType> Base;
     UsingComputationNodeMembersBoilerplate;
@@ -145,11 +145,16 @@ public:
             node->m_imageLayoutKind = m_imageLayoutKind;
 
             *node->m_tempMatrix = *m_tempMatrix;
+
+            node->m_quantizedWeights = m_quantizedWeights; // read-only once created, hence shared
         }
     }
 
     void BackpropTo(const size_t inputIndex, const FrameRange& fr) override
     {
+        if (m_quantizedWeights)
+            LogicError("%ls %ls operation: Cannot backpropagate through quantized weights.", NodeName().c_str(), OperationName().c_str());
+
         auto sliceOutputGrad = GradientFor(fr);
         auto sliceInput1Value = Input(1)->ValueFor(fr);
 
@@ -179,7 +184,6 @@ public:
 
     void ForwardProp(const FrameRange& fr) override
     {
-        const Matrix<ElemType>& input0 = Input(0)->ValueAsMatrix();
         Matrix<ElemType> sliceInput1Value = Input(1)->ValueFor(fr);
         Matrix<ElemType> sliceOutputValue = ValueFor(fr);
 
@@ -188,6 +192,12 @@ public:
         m_inT->setN(batchSize);
         m_outT->setN(batchSize);
         assert(m_convEng != nullptr);
+        if (m_quantizedWeights)
+        {
+            m_convEng->ForwardQuantized(*m_inT, sliceInput1Value, *m_filterT, *m_quantizedWeights, *m_convDesc, *m_outT, sliceOutputValue, *m_tempMatrix);
+            return;
+        }
+        const Matrix<ElemType>& input0 = Input(0)->ValueAsMatrix();
 #if NANCHECK
         input0.HasNan("Convolution-input0");
         sliceInput1Value.HasNan("Convolution-input1");
@@ -291,6 +301,31 @@ public:
         m_maxTempMemSizeInSamples = maxTempMemSizeInSamples;
     }
 
+    ImageLayoutKind GetImageLayoutKind() const
+    {
+        return m_imageLayoutKind;
+    }
+
+    // requires the network to be validated, since the convolution engine is created by Validate()
+    bool /*IQuantizableNode::*/ QuantizeWeights(size_t numBits, QuantizedWeightsCache& cache) override
+    {
+        if (GetDeviceId() != CPUDEVICE || m_convEng == nullptr)
+            return false;
+        // the quantized filter is in the engine's layout, which depends on the filter geometry and the image layout
+        wstring layout = msra::strfun::wstrprintf(L"Convolution %dx%dx%d:%d %ls", (int) m_kernelWidth, (int) m_kernelHeight, (int) m_filterT->c(), (int) m_filterT->k(),
+                                                  m_imageLayoutKind == ImageLayoutKind::CHW ? L"CHW" : L"HWC");
+        auto& quantizedWeights = cache[make_pair(Input(0), layout)];
+        if (!quantizedWeights)
+            quantizedWeights = m_convEng->QuantizeFilter(*m_filterT, Input(0)->ValueAsMatrix(), numBits);
+        m_quantizedWeights = static_pointer_cast<QuantizedWeights<ElemType>>(quantizedWeights);
+        return true;
+    }
+
+    size_t /*IQuantizableNode::*/ GetQuantizedWeightsSizeInBytes() const override
+    {
+        return m_quantizedWeights ? m_quantizedWeights->GetSizeInBytes() : 0;
+    }
+
     // request matrices needed to do node function value evaluation
     void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
     {
@@ -325,6 +360,8 @@ private:
     std::unique_ptr<ConvolutionTensor4D> m_outT;
     std::unique_ptr<ConvolutionDescriptor> m_convDesc;
     std::unique_ptr<ConvolutionTensor4D> m_biasT;
+
+    shared_ptr<QuantizedWeights<ElemType>> m_quantizedWeights; // if set, ForwardProp() uses these instead of Input(0)
 };
 
 template class ConvolutionNode<float>;
@@ -40,13 +40,13 @@ class LearnableParameter : public ComputationNode<ElemType>, public NumInputs<0>
 
 public:
     LearnableParameter(DEVICEID_TYPE deviceId, const wstring& name)
-        : Base(deviceId, name)
+        : Base(deviceId, name), m_valueReleased(false)
     {
         m_parameterUpdateRequired = true;
         this->m_valueSharable = false;
     }
     LearnableParameter(DEVICEID_TYPE deviceId, const wstring& name, const TensorShape& shape)
-        : Base(deviceId, name)
+        : Base(deviceId, name), m_valueReleased(false)
     {
         m_parameterUpdateRequired = true;
         CreateMatrixIfNull(m_value);
@@ -90,11 +90,13 @@ public:
 
     virtual void Save(File& fstream) const override
     {
+        if (m_valueReleased)
+            LogicError("%ls %ls operation: Cannot save a parameter whose value has been released.", NodeName().c_str(), OperationName().c_str());
         Base::Save(fstream);
         fstream << m_parameterUpdateRequired;
         fstream << (size_t) 0 /*#rows in a legacy file format*/ << (size_t) 0 /*#cols in a legacy file format*/;
         m_sampleLayout.Save(fstream);
-        fstream << Value();
+        SaveValue(fstream);
     }
 
     virtual void Load(File& fstream, size_t modelVersion) override
@@ -114,7 +116,7 @@ public:
             if (cols > 1) // in some legacy format, last tensor dimension was split off as an explicit column dimension
                 sampleLayout.AppendInPlace(sampleLayout.GetRank(), cols);
         }
-        LoadValue(fstream);
+        LoadValue(fstream, modelVersion);
         SetDims(sampleLayout, false); // note: call this after LoadValue() since LoadValue() overwrites m_sampleLayout
         VerifyDataSize(Value());      // sanity check
     }
@@ -178,11 +180,36 @@ public:
         Value().SetValue(numRows, numCols, m_deviceId, array.data(), matrixFlagNormal);
     }
 
+    // free the value of a parameter that no node reads anymore, e.g. after ComputationNetwork::QuantizeWeights()
+    // The node keeps its dimensions, so the network still validates, but it can no longer be saved or trained.
+    void ReleaseValue()
+    {
+        Value() = Matrix<ElemType>(m_deviceId);
+        this->m_valueStorage.reset();
+        m_valueReleased = true;
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<LearnableParameter<ElemType>>(nodeP);
+            node->m_valueReleased = m_valueReleased;
+        }
+    }
+
     // computation functions don't do anything for parameter nodes
     virtual void UpdateFunctionMBSize() override
     {
     }
 
+    virtual void /*IComputationNode::*/ BeginForwardProp() override
+    {
+        if (!m_valueReleased) // (a released value no longer matches the dimensions)
+            Base::BeginForwardProp();
+    }
+
     virtual void /*ComputationNode::*/ BackpropTo(const size_t /*inputIndex*/, const FrameRange&) override
     {
     }
@@ -206,8 +233,11 @@ public:
         sprintf(str, "NeedGradient=%s", m_parameterUpdateRequired ? "true" : "false"); // TODO: update NDL to accept a better matching name as well
         fstream << string(str);
 
-        PrintNodeValuesToFile(printValues, fstream);
+        PrintNodeValuesToFile(printValues && !m_valueReleased, fstream);
     }
+
+private:
+    bool m_valueReleased; // see ReleaseValue()
 };
 
 // -----------------------------------------------------------------------
@@ -427,6 +457,10 @@ public:
             Matrix<ElemType> sliceInput1Value = Input(1)->MaskedValueFor(t);
             Matrix<ElemType> sliceOutputGrad = MaskedGradientFor(t);
 
+            // as in TimesNode: for sparse (one-hot) inputs, only the columns of the words in the minibatch get a gradient
+            if (sliceInput1Value.GetMatrixType() == SPARSE && Input(0)->Gradient().GetMatrixType() == DENSE && sliceOutputGrad.GetMatrixType() == DENSE)
+                Input(0)->Gradient().SwitchToMatrixType(SPARSE, MatrixFormat::matrixFormatSparseBlockCol, false);
+
             BackpropToLeft(sliceInput1Value, Input(0)->GradientAsMatrix(), sliceOutputGrad);
         }
         else if (inputIndex == 1) // right derivative (input)
@@ -505,6 +539,18 @@ public:
         SetDims(TensorShape(Input(0)->GetAsMatrixNumRows() * wordsInEachSample), true);
     }
 
+    virtual void AllocateGradientMatricesForInputs(MatrixPool& matrixPool) override
+    {
+        // as in TimesNode, a sparse input gets a sparse embedding gradient, which is not taken from the pool
+        if (Input(0)->NeedGradient() && Input(1)->Value().GetMatrixType() == SPARSE)
+        {
+            Input(0)->CreateGradientMatrixIfNull();
+            Input(0)->Gradient().SwitchToMatrixType(SPARSE, MatrixFormat::matrixFormatSparseBlockCol, false);
+        }
+
+        Base::AllocateGradientMatricesForInputs(matrixPool);
+    }
+
     bool UnitTest()
     {
         try
@@ -8,6 +8,7 @@
 #include "ComputationNode.h"
 #include "ConvolutionalNodes.h"
 #include "Matrix.h"
+#include "QuantizedGemm.h"
 #include "TensorView.h"
 
 #include <unordered_set>
@@ -66,6 +67,12 @@ public:
         auto input1 = Input(1)->ValueTensorFor(rank, fr.AllowBroadcast());
         result.AssignSumOf(input0, input1);
     }
+
+    virtual bool GetFusableElementwiseOp(ElementWiseOperator& op) const override
+    {
+        op = opSum;
+        return true;
+    }
 };
 
 template class PlusNode<float>;
@@ -114,6 +121,12 @@ public:
         auto input1 = Input(1)->ValueTensorFor(rank, fr.AllowBroadcast());
         result.AssignDifferenceOf(input0, input1);
     }
+
+    virtual bool GetFusableElementwiseOp(ElementWiseOperator& op) const override
+    {
+        op = opDifference;
+        return true;
+    }
 };
 
 template class MinusNode<float>;
@@ -182,7 +195,7 @@ template class NegateNode<double>;
 // -----------------------------------------------------------------------
 
 template <class ElemType, bool m_transpose>
-class TimesNodeBase : public ComputationNode<ElemType>, public NumInputs<2>
+class TimesNodeBase : public ComputationNode<ElemType>, public NumInputs<2>, public IQuantizableNode
 {
     typedef ComputationNode<ElemType> Base;
     UsingComputationNodeMembers;
@@ -195,6 +208,9 @@ public:
 
     virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
     {
+        if (m_quantizedWeights)
+            LogicError("%ls %ls operation: Cannot backpropagate through quantized weights.", NodeName().c_str(), OperationName().c_str());
+
         if (inputIndex == 0) // left derivative
         {
             // this potentially computes inner products over time, so we use the Masked- variants
@@ -236,6 +252,16 @@ public:
 #if DUMPOUTPUT
         Input(0)->ValueAsMatrix().Print("TimesNode - Input0");
 #endif
+        if (m_quantizedWeights)
+        {
+            if (sliceInput1Value.GetMatrixType() != DENSE || sliceInput1Value.GetDeviceId() != CPUDEVICE)
+                LogicError("%ls %ls operation: Quantized weights require a dense right operand on the CPU.", NodeName().c_str(), OperationName().c_str());
+            size_t K = m_quantizedWeights->GetNumInputs(), M = m_quantizedWeights->GetNumOutputs();
+            if (sliceInput1Value.GetNumRows() != K || sliceOutputValue.GetNumRows() != M)
+                LogicError("%ls %ls operation: Dimensions do not match the quantized weights.", NodeName().c_str(), OperationName().c_str());
+            m_quantizedWeights->Multiply(sliceInput1Value.BufferPointer(), 1, K, sliceInput1Value.GetNumCols(), sliceOutputValue.BufferPointer(), 1, M);
+            return;
+        }
         // BUGBUG: This uses correct Matrix dimensions when multiplying with a non-minibatch only by luck. To be fixed when we allow to apply TimesNode to a subset of tensor dimensions.
         sliceOutputValue.AssignProductOf(Input(0)->ValueAsMatrix(), m_transpose, sliceInput1Value, false);
 #if NANCHECK
@@ -300,6 +326,43 @@ public:
         // so that the default allocator will not allocate it again.
         Base::AllocateGradientMatricesForInputs(matrixPool);
     }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<TimesNodeBase<ElemType, m_transpose>>(nodeP);
+            node->m_quantizedWeights = m_quantizedWeights; // read-only once created, hence shared
+        }
+    }
+
+    virtual bool /*IQuantizableNode::*/ QuantizeWeights(size_t numBits, QuantizedWeightsCache& cache) override
+    {
+        const auto& weights = Input(0)->Value();
+        if (weights.GetDeviceId() != CPUDEVICE || weights.GetMatrixType() != DENSE || Input(1)->OperationName() == OperationNameOf(SparseInputValue))
+            return false;
+        bool transpose = m_transpose; // (assigning to a non-const variable avoids a compiler warning C4127: conditional expression is constant)
+        auto& quantizedWeights = cache[make_pair(Input(0), wstring(transpose ? L"TransposeTimes" : L"Times"))];
+        if (!quantizedWeights)
+        {
+            size_t rows = weights.GetNumRows(), cols = weights.GetNumCols();
+            if (!transpose) // output(m) = sum_k W(m, k) * input(k)
+                quantizedWeights = make_shared<QuantizedWeights<ElemType>>(weights.BufferPointer(), cols, rows, /*kStride=*/rows, /*mStride=*/1, numBits);
+            else            // output(m) = sum_k W(k, m) * input(k)
+                quantizedWeights = make_shared<QuantizedWeights<ElemType>>(weights.BufferPointer(), rows, cols, /*kStride=*/1, /*mStride=*/rows, numBits);
+        }
+        m_quantizedWeights = static_pointer_cast<QuantizedWeights<ElemType>>(quantizedWeights);
+        return true;
+    }
+
+    virtual size_t /*IQuantizableNode::*/ GetQuantizedWeightsSizeInBytes() const override
+    {
+        return m_quantizedWeights ? m_quantizedWeights->GetSizeInBytes() : 0;
+    }
+
+private:
+    shared_ptr<QuantizedWeights<ElemType>> m_quantizedWeights; // if set, ForwardProp() uses these instead of Input(0)
 };
 
 // -----------------------------------------------------------------------
@@ -405,6 +468,12 @@ public:
         auto input1 = Input(1)->ValueTensorFor(rank, fr.AllowBroadcast());
         result.AssignElementwiseProductOf(input0, input1);
     }
+
+    virtual bool GetFusableElementwiseOp(ElementWiseOperator& op) const override
+    {
+        op = opElementwiseProduct;
+        return true;
+    }
 };
 
 template class ElementTimesNode<float>;
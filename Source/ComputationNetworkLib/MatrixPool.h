@@ -8,8 +8,10 @@
 #include <string>
 #include <stdexcept>
 #include <vector>
+#include <map>
 #include <algorithm>
 #include <stdlib.h>
+#include <stdio.h>
 
 #include "Basics.h"
 #include "Matrix.h"
@@ -17,52 +19,250 @@
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
+// -----------------------------------------------------------------------
+// MatrixPool -- pool of matrices that can be shared across nodes
+//
+// ComputationNetwork::AllocateAllMatrices() simulates the forward/backward
+// execution order and calls Request() and Release() in that order. We treat this
+// like a linear-scan register allocator: each pooled matrix is a 'buffer' whose
+// live intervals are the [Request(), Release()) ranges of its sharers.
+//
+// Released buffers are bucketed by size class (log2 of the number of rows, which
+// is the per-sample size since all minibatch-sized matrices share the column
+// dimension). A request is served from the closest class that does not waste
+// memory: first an equal or slightly larger buffer, then the largest smaller one
+// (which will grow), then the smallest larger one, and only then a new buffer.
+// This keeps e.g. a small bias gradient from pinning a huge activation buffer
+// while a better fitting one is free, but never allocates while any buffer is free.
+//
+// The pool also keeps the allocation history so that PrintMemoryPlan() can report
+// which node got which buffer and the total size of the buffers, before any actual
+// memory has been allocated. The history is keyed by matrix object; each call to
+// AllocateAllMatrices() starts a new pass with StartAllocationPass(), which drops
+// the buffers whose matrices no longer exist (e.g. of deleted nodes), so that a
+// new matrix at the same address cannot pick up a stale record.
+// -----------------------------------------------------------------------
+
 class MatrixPool
 {
-    vector<shared_ptr<Matrix<float>>> m_releasedFloatMatrices;
-    vector<shared_ptr<Matrix<double>>> m_releasedDoubleMatrices;
+public:
+    // a request may reuse a released buffer that is at most this many size classes (factors of 2) larger
+    static const int maxSizeClassSlack = 2;
+
+private:
+    template <class ElemType>
+    using ReleasedMatrices = map<int, vector<shared_ptr<Matrix<ElemType>>>>; // [size class] -> released buffers
+
+    ReleasedMatrices<float> m_releasedFloatMatrices;
+    ReleasedMatrices<double> m_releasedDoubleMatrices;
 
     template <class ElemType>
-    vector<shared_ptr<Matrix<ElemType>>>& GetReleasedMatrices();
+    ReleasedMatrices<ElemType>& GetReleasedMatrices();
+
+    // one live interval of a buffer
+    struct Lease
+    {
+        wstring m_requester;
+        size_t m_numRows;      // rows requested by this sharer (0 = unknown)
+        size_t m_requestStep;  // step of Request()
+        size_t m_releaseStep;  // step of Release(), or SIZE_MAX if never released
+    };
+
+    // bookkeeping for one buffer handed out by the pool
+    struct Buffer
+    {
+        weak_ptr<void> m_matrix; // to tell whether the matrix still exists
+        size_t m_elemSize;       // sizeof(ElemType)
+        size_t m_numRows;        // largest number of rows requested by any sharer, i.e. what the buffer will grow to
+        vector<Lease> m_leases;
+    };
+
+    vector<Buffer> m_buffers;
+    map<const void*, size_t> m_bufferIndex; // [matrix object] -> index into m_buffers
+
+    size_t m_step;                 // simulation time, advanced by every Request() and Release()
+    size_t m_liveBytesPerSample;   // sum of requested sizes of all currently leased buffers
+    size_t m_peakLiveBytesPerSample;
+
+    static int SizeClass(size_t numRows)
+    {
+        int sizeClass = 0;
+        while (numRows > 0)
+        {
+            sizeClass++;
+            numRows >>= 1;
+        }
+        return sizeClass;
+    }
+
+    // pick a released buffer for a request of class 'sizeClass' (0 if the size is unknown); returns end() if none is released
+    template <class ElemType>
+    typename ReleasedMatrices<ElemType>::iterator FindBestFit(ReleasedMatrices<ElemType>& releasedMatrices, int sizeClass)
+    {
+        // equal or slightly larger: costs no additional memory
+        auto iter = releasedMatrices.lower_bound(sizeClass);
+        if (iter != releasedMatrices.end() && iter->first <= sizeClass + maxSizeClassSlack)
+            return iter;
+        // otherwise grow the largest smaller one, which costs less than a new buffer
+        if (iter != releasedMatrices.begin())
+            return std::prev(iter);
+        // otherwise the smallest larger one, which still costs no additional memory
+        return iter;
+    }
 
 public:
+    MatrixPool()
+        : m_step(0), m_liveBytesPerSample(0), m_peakLiveBytesPerSample(0)
+    {
+    }
+
     // release here means the matrix can be put back and shared by others
     template <class ElemType>
     void Release(shared_ptr<Matrix<ElemType>> freeMatrix)
     {
-        vector<shared_ptr<Matrix<ElemType>>>& releasedMatrices = GetReleasedMatrices<ElemType>();
+        ReleasedMatrices<ElemType>& releasedMatrices = GetReleasedMatrices<ElemType>();
         if (freeMatrix == nullptr || freeMatrix->GetMatrixType() == SPARSE)
             RuntimeError("MatrixPool::Release: freeMatrix should not be null or sparse.");
 #ifdef _DEBUG
-        for (int i = 0; i < releasedMatrices.size(); i++)
+        for (const auto& sizeClassIter : releasedMatrices)
         {
-            if (releasedMatrices[i] == freeMatrix)
-                RuntimeError("MatrixPool::Release: freeMatrix is already in the released pool.");
+            for (const auto& releasedMatrix : sizeClassIter.second)
+            {
+                if (releasedMatrix == freeMatrix)
+                    RuntimeError("MatrixPool::Release: freeMatrix is already in the released pool.");
+            }
         }
-
 #endif
-        releasedMatrices.push_back(freeMatrix);
+        // matrices not handed out by us (e.g. created by a node itself) start their own buffer record
+        auto indexIter = m_bufferIndex.find(freeMatrix.get());
+        if (indexIter == m_bufferIndex.end())
+        {
+            indexIter = m_bufferIndex.insert(make_pair(freeMatrix.get(), m_buffers.size())).first;
+            m_buffers.push_back(Buffer{freeMatrix, sizeof(ElemType), 0, {}});
+        }
+        Buffer& buffer = m_buffers[indexIter->second];
+        if (!buffer.m_leases.empty() && buffer.m_leases.back().m_releaseStep == SIZE_MAX)
+        {
+            buffer.m_leases.back().m_releaseStep = m_step;
+            m_liveBytesPerSample -= buffer.m_leases.back().m_numRows * buffer.m_elemSize;
+        }
+        m_step++;
+
+        releasedMatrices[SizeClass(buffer.m_numRows)].push_back(freeMatrix);
     }
 
+    // 'numRows' is the expected number of rows (per-sample size) of the requested matrix, or 0 if unknown
+    // 'requester' is only used for the memory-plan report
     template <class ElemType>
-    shared_ptr<Matrix<ElemType>> Request(DEVICEID_TYPE deviceId)
+    shared_ptr<Matrix<ElemType>> Request(DEVICEID_TYPE deviceId, size_t numRows = 0, const wstring& requester = wstring())
     {
-        vector<shared_ptr<Matrix<ElemType>>>& releasedMatrices = GetReleasedMatrices<ElemType>();
+        ReleasedMatrices<ElemType>& releasedMatrices = GetReleasedMatrices<ElemType>();
         shared_ptr<Matrix<ElemType>> matrixPtr;
-        if (releasedMatrices.empty())
+        auto sizeClassIter = FindBestFit<ElemType>(releasedMatrices, SizeClass(numRows));
+        if (sizeClassIter == releasedMatrices.end())
         {
             matrixPtr = make_shared<Matrix<ElemType>>(deviceId);
+            m_bufferIndex[matrixPtr.get()] = m_buffers.size();
+            m_buffers.push_back(Buffer{matrixPtr, sizeof(ElemType), 0, {}});
         }
         else
         {
-            matrixPtr = releasedMatrices.back();
-            releasedMatrices.pop_back();
+            matrixPtr = sizeClassIter->second.back();
+            sizeClassIter->second.pop_back();
+            if (sizeClassIter->second.empty())
+                releasedMatrices.erase(sizeClassIter);
         }
 
         if (!matrixPtr) // this can't really happen
             LogicError("MatrixPool::Request: failed to get a valid matrix.");
 
+        Buffer& buffer = m_buffers[m_bufferIndex[matrixPtr.get()]];
+        buffer.m_numRows = max(buffer.m_numRows, numRows);
+        buffer.m_leases.push_back(Lease{requester, numRows, m_step, SIZE_MAX});
+        m_step++;
+        m_liveBytesPerSample += numRows * sizeof(ElemType);
+        m_peakLiveBytesPerSample = max(m_peakLiveBytesPerSample, m_liveBytesPerSample);
+
         return matrixPtr;
     }
+
+    // start a new AllocateAllMatrices() pass: rebuild the index from the buffers whose matrices still exist
+    // The others belonged to nodes that have been deleted since; their records would only grow the history,
+    // and a new matrix allocated at the same address would otherwise be taken for one of them.
+    void StartAllocationPass()
+    {
+        vector<Buffer> buffers;
+        m_bufferIndex.clear();
+        for (auto& buffer : m_buffers)
+        {
+            auto matrix = buffer.m_matrix.lock();
+            if (!matrix)
+            {
+                if (!buffer.m_leases.empty() && buffer.m_leases.back().m_releaseStep == SIZE_MAX)
+                    m_liveBytesPerSample -= buffer.m_leases.back().m_numRows * buffer.m_elemSize;
+                continue;
+            }
+            m_bufferIndex[matrix.get()] = buffers.size();
+            buffers.push_back(move(buffer));
+        }
+        m_buffers = move(buffers);
+    }
+
+    // number of buffers handed out by the pool that still exist
+    size_t GetNumBuffers() const
+    {
+        return m_buffers.size();
+    }
+
+    // current simulation step; pass to PrintMemoryPlan() to only report requests made after this point
+    size_t GetCurrentStep() const
+    {
+        return m_step;
+    }
+
+    // for each buffer, the names of the nodes that requested it, in the order they got it
+    // Concurrent execution uses this to keep two sharers of a buffer from running at the same time.
+    vector<vector<wstring>> GetBufferSharers() const
+    {
+        vector<vector<wstring>> sharers(m_buffers.size());
+        for (size_t i = 0; i < m_buffers.size(); i++)
+        {
+            for (const auto& lease : m_buffers[i].m_leases)
+                sharers[i].push_back(lease.m_requester);
+        }
+        return sharers;
+    }
+
+    // print the memory usage, and with 'printLeases' the assignment of nodes to buffers
+    // Sizes are per sample (column); multiply by the minibatch size to get actual bytes.
+    void PrintMemoryPlan(FILE* f, size_t fromStep = 0, bool printLeases = true) const
+    {
+        size_t pooledBytesPerSample = 0;   // what the pool will actually allocate: each buffer grows to its largest sharer
+        size_t unsharedBytesPerSample = 0; // what it would take without sharing
+        size_t numLeases = 0;
+        if (printLeases)
+            fprintf(f, "\nMemory plan (sizes per sample):\n");
+        for (size_t i = 0; i < m_buffers.size(); i++)
+        {
+            const Buffer& buffer = m_buffers[i];
+            pooledBytesPerSample += buffer.m_numRows * buffer.m_elemSize;
+            for (const auto& lease : buffer.m_leases)
+            {
+                unsharedBytesPerSample += lease.m_numRows * buffer.m_elemSize;
+                numLeases++;
+                if (lease.m_requestStep < fromStep || !printLeases)
+                    continue;
+                fprintf(f, "\t%-40ls -> buffer %4d [%8d rows of %8d]  live [%d, ", lease.m_requester.empty() ? L"(anonymous)" : lease.m_requester.c_str(),
+                        (int) i, (int) lease.m_numRows, (int) buffer.m_numRows, (int) lease.m_requestStep);
+                if (lease.m_releaseStep == SIZE_MAX)
+                    fprintf(f, "end)\n");
+                else
+                    fprintf(f, "%d)\n", (int) lease.m_releaseStep);
+            }
+        }
+        fprintf(f, "Memory plan: %d requests share %d buffers of %.1f KB per sample in total (peak of the live requests %.1f KB, %.1f KB without sharing).\n",
+                (int) numLeases, (int) m_buffers.size(),
+                pooledBytesPerSample / 1024.0, m_peakLiveBytesPerSample / 1024.0, unsharedBytesPerSample / 1024.0);
+    }
 };
 } } }
@@ -0,0 +1,290 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#define _CRT_SECURE_NO_WARNINGS // "secure" CRT not available on all platforms  --add this at the top of all CPP files that give "function or variable may be unsafe" warnings
+
+#include "Basics.h"
+#include "NodeProfiler.h"
+#include "ComputationNetwork.h"
+#include "fileutil.h"
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+NodeProfiler::NodeProfiler(size_t numMBsToTrace)
+    : m_origin(Clock::now()), m_numMBsToTrace(numMBsToTrace), m_numMBsTraced(0)
+{
+}
+
+// -----------------------------------------------------------------------
+// cost estimates
+// -----------------------------------------------------------------------
+
+static size_t ElementSize(const ComputationNodeBasePtr& node)
+{
+    if (dynamic_pointer_cast<ComputationNode<float>>(node))
+        return sizeof(float);
+    else if (dynamic_pointer_cast<ComputationNode<double>>(node))
+        return sizeof(double);
+    else
+        return 0;
+}
+
+// number of elements of the node's value in the current minibatch
+static double NumElements(const ComputationNodeBasePtr& node)
+{
+    return (double) node->GetSampleMatrixNumRows() * node->GetSampleMatrixNumCols();
+}
+
+static double EstimateForwardFlops(const ComputationNodeBasePtr& node)
+{
+    double numElements = NumElements(node);
+    const wstring operationName = node->OperationName();
+    if ((operationName == L"Times" || operationName == L"TransposeTimes") && node->GetNumInputs() == 2)
+        return 2 * numElements * node->Input(1)->GetSampleMatrixNumRows(); // inner dimension = rows of the right operand
+    else if (operationName == L"Convolution" && node->GetNumInputs() == 2)
+    {
+        // kernel [outputChannels x (kernelWidth * kernelHeight * inputChannels)]
+        const auto& kernelLayout = node->Input(0)->GetSampleLayout();
+        return 2 * numElements * (kernelLayout.GetNumElements() / max((size_t) 1, kernelLayout[0]));
+    }
+    else
+        return numElements;
+}
+
+static double SumOfInputElements(const vector<ComputationNodeBasePtr>& inputs)
+{
+    double numElements = 0;
+    for (const auto& input : inputs)
+        numElements += NumElements(input);
+    return numElements;
+}
+
+/*static*/ void NodeProfiler::EstimateCost(const ComputationNodeBasePtr& node, bool isBackward, double& flops, double& bytes, double& memoryBytes)
+{
+    const auto& fusedGroup = node->GetFusedElementwiseGroup();
+    auto flowControlNode = dynamic_pointer_cast<FlowControlNode>(node);
+    if (fusedGroup || flowControlNode)
+    {
+        // a fused group or a recurrent loop: the operations of all members; the loop's members process one frame at a time, which adds up to the whole minibatch
+        const auto& members = fusedGroup ? fusedGroup->GetMembers() : flowControlNode->m_nestedNodes;
+        flops = 0;
+        bytes = 0;
+        memoryBytes = 0;
+        for (const auto& member : members)
+        {
+            double memberFlops = EstimateForwardFlops(member);
+            size_t elementSize = ElementSize(member);
+            flops += isBackward ? memberFlops * member->GetNumInputs() : memberFlops;
+            memoryBytes += elementSize * NumElements(member) * (member->NeedGradient() ? 2 : 1);
+            if (!fusedGroup) // a loop reads and writes all its members' values
+                bytes += elementSize * (isBackward ? NumElements(member) + 2 * SumOfInputElements(member->GetInputs()) : NumElements(member) + SumOfInputElements(member->GetInputs()));
+        }
+        if (fusedGroup) // a fused group only reads its external inputs and writes its root
+        {
+            size_t elementSize = ElementSize(node);
+            double numInputElements = SumOfInputElements(fusedGroup->GetInputs());
+            bytes = elementSize * (isBackward ? NumElements(node) + 2 * numInputElements : NumElements(node) + numInputElements);
+        }
+        return;
+    }
+
+    // a regular node: forward reads the inputs and writes the output; backprop reads the output gradient and the inputs, and updates the input gradients
+    size_t elementSize = ElementSize(node);
+    double forwardFlops = EstimateForwardFlops(node);
+    double numInputElements = SumOfInputElements(node->GetInputs());
+    flops = isBackward ? forwardFlops * node->GetNumInputs() : forwardFlops;
+    bytes = elementSize * (isBackward ? NumElements(node) + 2 * numInputElements : NumElements(node) + numInputElements);
+    memoryBytes = elementSize * NumElements(node) * (node->NeedGradient() ? 2 : 1);
+}
+
+// -----------------------------------------------------------------------
+// recording
+// -----------------------------------------------------------------------
+
+void NodeProfiler::Record(const ComputationNodeBasePtr& node, bool isBackward, Clock::time_point start)
+{
+    auto end = Clock::now();
+    double flops, bytes, memoryBytes;
+    EstimateCost(node, isBackward, flops, bytes, memoryBytes);
+
+    lock_guard<mutex> lock(m_mutex);
+
+    auto& statistics = m_statistics[node.get()];
+    if (statistics.m_nodeName.empty())
+    {
+        statistics.m_nodeName = node->NodeName();
+        statistics.m_operationName = node->GetFusedElementwiseGroup() ? L"FusedElementwise" : node->OperationName();
+    }
+    double seconds = chrono::duration<double>(end - start).count();
+    if (isBackward)
+    {
+        statistics.m_numBackwardCalls++;
+        statistics.m_backwardSeconds += seconds;
+    }
+    else
+    {
+        statistics.m_numForwardCalls++;
+        statistics.m_forwardSeconds += seconds;
+    }
+    statistics.m_flops += flops;
+    statistics.m_bytes += bytes;
+    statistics.m_memoryBytes = max(statistics.m_memoryBytes, memoryBytes);
+
+    if (m_numMBsTraced < m_numMBsToTrace)
+    {
+        auto nameIndex = m_traceNameIndices.find(node.get());
+        if (nameIndex == m_traceNameIndices.end())
+        {
+            nameIndex = m_traceNameIndices.insert(make_pair(node.get(), m_traceNames.size())).first;
+            m_traceNames.push_back(make_pair(statistics.m_nodeName, statistics.m_operationName));
+        }
+        auto threadIndex = m_threadIndices.insert(make_pair(this_thread::get_id(), (int) m_threadIndices.size())).first;
+
+        TraceEvent event;
+        event.m_nameIndex = nameIndex->second;
+        event.m_isBackward = isBackward;
+        event.m_startMicroseconds = chrono::duration<double, micro>(start - m_origin).count();
+        event.m_durationMicroseconds = chrono::duration<double, micro>(end - start).count();
+        event.m_threadIndex = threadIndex->second;
+        m_traceEvents.push_back(event);
+    }
+}
+
+void NodeProfiler::NextMinibatch()
+{
+    lock_guard<mutex> lock(m_mutex);
+    if (m_numMBsTraced < m_numMBsToTrace)
+        m_numMBsTraced++;
+}
+
+void NodeProfiler::ResetStatistics()
+{
+    lock_guard<mutex> lock(m_mutex);
+    m_statistics.clear();
+}
+
+map<wstring, NodeProfiler::NodeStatistics> NodeProfiler::GetStatistics() const
+{
+    lock_guard<mutex> lock(m_mutex);
+    map<wstring, NodeStatistics> statistics;
+    for (const auto& iter : m_statistics)
+        statistics[iter.second.m_nodeName] = iter.second;
+    return statistics;
+}
+
+// -----------------------------------------------------------------------
+// reporting
+// -----------------------------------------------------------------------
+
+void NodeProfiler::PrintSummary(FILE* f, const string& title, size_t maxNodes) const
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    vector<const NodeStatistics*> nodes;
+    map<wstring, NodeStatistics> operations; // [operation name] -> sum over all nodes of this type
+    double forwardSeconds = 0;
+    double backwardSeconds = 0;
+    for (const auto& iter : m_statistics)
+    {
+        const auto& node = iter.second;
+        nodes.push_back(&node);
+        forwardSeconds += node.m_forwardSeconds;
+        backwardSeconds += node.m_backwardSeconds;
+
+        auto& operation = operations[node.m_operationName];
+        operation.m_operationName = node.m_operationName;
+        operation.m_numForwardCalls += node.m_numForwardCalls;
+        operation.m_numBackwardCalls += node.m_numBackwardCalls;
+        operation.m_forwardSeconds += node.m_forwardSeconds;
+        operation.m_backwardSeconds += node.m_backwardSeconds;
+        operation.m_flops += node.m_flops;
+        operation.m_bytes += node.m_bytes;
+        operation.m_memoryBytes += node.m_memoryBytes;
+    }
+    double totalSeconds = forwardSeconds + backwardSeconds;
+    if (nodes.empty() || totalSeconds <= 0)
+        return;
+
+    auto byTotalTime = [](const NodeStatistics* a, const NodeStatistics* b)
+    {
+        return a->TotalSeconds() > b->TotalSeconds();
+    };
+    auto printRow = [&](const wstring& name, const NodeStatistics& s)
+    {
+        double seconds = s.TotalSeconds();
+        fprintf(f, "    %-40ls %-28ls %8d %10.2f %8d %10.2f %6.2f%% %9.3f %9.3f %9.2f\n",
+                name.c_str(), s.m_operationName.c_str(),
+                (int) s.m_numForwardCalls, s.m_forwardSeconds * 1e3, (int) s.m_numBackwardCalls, s.m_backwardSeconds * 1e3,
+                100.0 * seconds / totalSeconds,
+                seconds > 0 ? s.m_flops / seconds * 1e-9 : 0.0, seconds > 0 ? s.m_bytes / seconds * 1e-9 : 0.0,
+                s.m_memoryBytes / (1024.0 * 1024.0));
+    };
+    const char* header = "    %-40s %-28s %8s %10s %8s %10s %7s %9s %9s %9s\n";
+
+    fprintf(f, "\nNode profile %s: forward %.2f ms, backprop %.2f ms\n", title.c_str(), forwardSeconds * 1e3, backwardSeconds * 1e3);
+
+    sort(nodes.begin(), nodes.end(), byTotalTime);
+    fprintf(f, header, "Node", "Operation", "FwdCalls", "FwdMs", "BwdCalls", "BwdMs", "Time", "GFLOP/s", "GB/s", "MB");
+    for (size_t i = 0; i < nodes.size() && i < maxNodes; i++)
+        printRow(nodes[i]->m_nodeName, *nodes[i]);
+    if (nodes.size() > maxNodes)
+        fprintf(f, "    ... %d more nodes\n", (int) (nodes.size() - maxNodes));
+
+    vector<const NodeStatistics*> sortedOperations;
+    for (const auto& iter : operations)
+        sortedOperations.push_back(&iter.second);
+    sort(sortedOperations.begin(), sortedOperations.end(), byTotalTime);
+    fprintf(f, "  by operation:\n");
+    fprintf(f, header, "Operation", "", "FwdCalls", "FwdMs", "BwdCalls", "BwdMs", "Time", "GFLOP/s", "GB/s", "MB");
+    for (const auto* operation : sortedOperations)
+        printRow(operation->m_operationName, *operation);
+    fprintf(f, "\n");
+}
+
+// escape a string for use inside a JSON string literal
+static string JsonEscape(const wstring& s)
+{
+    string escaped;
+    for (char c : string(msra::strfun::utf8(s)))
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped.push_back('\\');
+            escaped.push_back(c);
+        }
+        else if ((unsigned char) c < 0x20)
+            escaped += msra::strfun::strprintf("\\u%04x", (int) c);
+        else
+            escaped.push_back(c);
+    }
+    return escaped;
+}
+
+void NodeProfiler::WriteTrace(const wstring& path) const
+{
+    lock_guard<mutex> lock(m_mutex);
+
+    FILE* f = fopenOrDie(path, L"w");
+    fprintfOrDie(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (size_t i = 0; i < m_traceEvents.size(); i++)
+    {
+        const auto& event = m_traceEvents[i];
+        const auto& names = m_traceNames[event.m_nameIndex];
+        fprintfOrDie(f, "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, \"pid\": 0, \"tid\": %d, \"args\": {\"operation\": \"%s\"}}%s\n",
+                     JsonEscape(names.first).c_str(), event.m_isBackward ? "backprop" : "forward",
+                     event.m_startMicroseconds, event.m_durationMicroseconds, event.m_threadIndex,
+                     JsonEscape(names.second).c_str(), i + 1 < m_traceEvents.size() ? "," : "");
+    }
+    fprintfOrDie(f, "]}\n");
+    fcloseOrDie(f);
+    fprintf(stderr, "NodeProfiler: %d trace events written to %ls\n", (int) m_traceEvents.size(), path.c_str());
+}
+
+} } }
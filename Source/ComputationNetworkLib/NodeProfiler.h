@@ -0,0 +1,117 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+
+#pragma once
+
+#include "ComputationNode.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <stdio.h>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// NodeProfiler -- per-node timing of forward and backward propagation
+//
+// Installed into a network with ComputationNetwork::SetNodeProfiler(). The traversal then
+// times every call of ForwardProp() and Backprop() of its top-level nodes and reports it here.
+// A recurrent loop is timed as a whole (as node Loop_xxx), and so is a fused elementwise group
+// (under the name of its root). For every node, the profiler keeps call counts and wall time,
+// and estimates the floating-point operations and bytes touched from the node dimensions:
+//  - Times, TransposeTimes, Convolution: 2 * output elements * inner dimension
+//  - anything else: one operation per output element
+//  - backprop: the forward estimate times the number of inputs
+// The estimates are meant for ranking nodes and comparing builds, not as exact counts.
+// Optionally, the calls of the first few minibatches are recorded as Chrome trace events
+// (chrome://tracing or about:tracing) to see the schedule, e.g. with parallelTraversalThreads.
+// Without a profiler installed, the traversal only pays for a null-pointer check per node.
+// -----------------------------------------------------------------------
+
+class NodeProfiler
+{
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // 'numMBsToTrace' is the number of minibatches for which trace events are recorded (0 for none)
+    NodeProfiler(size_t numMBsToTrace);
+
+    // called by the traversal after a node has been run; may be called concurrently
+    // For a fused elementwise group, 'node' is its root.
+    void RecordForwardProp(const ComputationNodeBasePtr& node, Clock::time_point start)
+    {
+        Record(node, false, start);
+    }
+    void RecordBackprop(const ComputationNodeBasePtr& node, Clock::time_point start)
+    {
+        Record(node, true, start);
+    }
+
+    // notifies transition to the next minibatch, for the trace window
+    void NextMinibatch();
+
+    // per-node statistics, e.g. reset at the start of every epoch
+    void ResetStatistics();
+    void PrintSummary(FILE* f, const std::string& title, size_t maxNodes = 30) const;
+
+    // writes the recorded trace events in Chrome trace-event JSON format
+    void WriteTrace(const std::wstring& path) const;
+
+    struct NodeStatistics
+    {
+        std::wstring m_nodeName;
+        std::wstring m_operationName;
+        size_t m_numForwardCalls;
+        size_t m_numBackwardCalls;
+        double m_forwardSeconds;
+        double m_backwardSeconds;
+        double m_flops;
+        double m_bytes;
+        double m_memoryBytes; // largest value + gradient footprint seen
+
+        NodeStatistics()
+            : m_numForwardCalls(0), m_numBackwardCalls(0), m_forwardSeconds(0), m_backwardSeconds(0), m_flops(0), m_bytes(0), m_memoryBytes(0)
+        {
+        }
+
+        double TotalSeconds() const
+        {
+            return m_forwardSeconds + m_backwardSeconds;
+        }
+    };
+
+    // a copy of the per-node statistics since the last ResetStatistics(), by node name
+    std::map<std::wstring, NodeStatistics> GetStatistics() const;
+
+private:
+    struct TraceEvent
+    {
+        size_t m_nameIndex; // index into m_traceNames
+        bool m_isBackward;
+        double m_startMicroseconds;
+        double m_durationMicroseconds;
+        int m_threadIndex;
+    };
+
+    void Record(const ComputationNodeBasePtr& node, bool isBackward, Clock::time_point start);
+
+    static void EstimateCost(const ComputationNodeBasePtr& node, bool isBackward, double& flops, double& bytes, double& memoryBytes);
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<const ComputationNodeBase*, NodeStatistics> m_statistics;
+    std::vector<TraceEvent> m_traceEvents;
+    std::vector<std::pair<std::wstring, std::wstring>> m_traceNames; // (node name, operation name), kept across ResetStatistics()
+    std::unordered_map<const ComputationNodeBase*, size_t> m_traceNameIndices;
+    std::map<std::thread::id, int> m_threadIndices;
+    Clock::time_point m_origin;
+    size_t m_numMBsToTrace;
+    size_t m_numMBsTraced;
+};
+
+} } }
@@ -76,6 +76,12 @@ public:
     {
         return !gradientFromOutput;
     }
+
+    virtual bool GetFusableElementwiseOp(ElementWiseOperator& op) const override
+    {
+        op = opForward;
+        return FusedElementwiseProgram::IsFusableUnaryOp(opForward);
+    }
 };
 
 #define UnaryElementWiseWithOpCodeNodeBaseMembers UsingComputationNodeMembersBoilerplate;
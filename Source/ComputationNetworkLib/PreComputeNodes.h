@@ -62,14 +62,14 @@ public:
     {
         Base::Save(fstream);
         fstream << m_hasComputed;
-        fstream << Value();
+        SaveValue(fstream);
     }
 
     virtual void Load(File& fstream, size_t modelVersion) override
     {
         Base::Load(fstream, modelVersion);
         fstream >> m_hasComputed;
-        LoadValue(fstream);
+        LoadValue(fstream, modelVersion);
         // Note: This loses the sample layout, but that is recovered by Validate().
     }
 
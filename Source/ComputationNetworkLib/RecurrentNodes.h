@@ -530,6 +530,693 @@ public:
 template class FutureValueNode<float>;
 template class FutureValueNode<double>;
 
+// -----------------------------------------------------------------------
+// RecurrentLayerNodeBase -- shared code of the fused recurrent layers LSTMNode and GRUNode
+//
+// Unlike a recurrence built from primitive nodes and PastValueNode, which the network evaluates
+// one time step at a time by calling every node of the loop, these nodes process the whole
+// minibatch in one call: the projection of the input is done for all frames in one large
+// matrix product, and then the time steps are iterated in a tight loop that only does the
+// recurrent product and one pass of the cell function (Matrix::LSTMCellForward() etc.).
+// Hence these nodes are not part of a loop themselves.
+//
+// Sequence boundaries and state carry-over across minibatches (truncated BPTT) behave like
+// for PastValueNode: at a sequence start, the previous output (and cell) is the initial
+// activation value; a sequence that continues from the previous minibatch continues from the
+// state of its last frame there; and the gradient is not propagated back into the previous
+// minibatch. The carried-over state can be exported/imported for sub-minibatching.
+//
+// This is currently implemented for the CPU only.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class RecurrentLayerNodeBase : public ComputationNode<ElemType>, public IStatefulNode
+{
+    typedef ComputationNode<ElemType> Base;
+    UsingComputationNodeMembers;
+
+protected:
+    RecurrentLayerNodeBase(DEVICEID_TYPE deviceId, const wstring& name, ElemType initialActivationValue)
+        : Base(deviceId, name),
+          m_initialActivationValue(initialActivationValue),
+          m_delayedValue(deviceId)
+    {
+    }
+
+public:
+    virtual void Save(File& fstream) const override
+    {
+        Base::Save(fstream);
+        fstream << m_initialActivationValue;
+    }
+
+    virtual void Load(File& fstream, size_t modelVersion) override
+    {
+        Base::Load(fstream, modelVersion);
+        fstream >> m_initialActivationValue;
+    }
+
+    virtual void CopyTo(ComputationNodeBasePtr nodeP, const std::wstring& newName, const CopyNodeFlags flags) const override
+    {
+        Base::CopyTo(nodeP, newName, flags);
+        if (flags & CopyNodeFlags::copyNodeValue)
+        {
+            auto node = dynamic_pointer_cast<RecurrentLayerNodeBase<ElemType>>(nodeP);
+            node->m_initialActivationValue = m_initialActivationValue;
+            node->m_delayedValue = m_delayedValue;
+            if (m_delayedActivationMBLayout)
+                (node->m_delayedActivationMBLayout = make_shared<MBLayout>())->CopyFrom(m_delayedActivationMBLayout);
+            else
+                node->m_delayedActivationMBLayout = nullptr;
+        }
+    }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+        InferMBLayoutFromInputsForStandardCase();
+        if (isFinalValidationPass)
+        {
+            if (!Input(0)->HasMBLayout())
+                InvalidArgument("%ls %ls operation requires its input to be minibatch data (must have an MBLayout).", NodeName().c_str(), OperationName().c_str());
+            if (m_deviceId != CPUDEVICE)
+                InvalidArgument("%ls %ls operation is currently only implemented for the CPU.", NodeName().c_str(), OperationName().c_str());
+        }
+    }
+
+    // the gradient is computed for all time steps at once, and then distributed to the inputs by BackpropTo()
+    virtual void /*ComputationNode::*/ Backprop(const FrameRange& fr, bool childrenInThisLoop, bool childrenInOuterLoop) override
+    {
+        if (!fr.IsAllFrames())
+            LogicError("%ls %ls operation iterates over time itself and cannot be part of a recurrent loop.", NodeName().c_str(), OperationName().c_str());
+        BackpropThroughTime(fr);
+        Base::Backprop(fr, childrenInThisLoop, childrenInOuterLoop);
+    }
+
+    virtual bool OutputUsedInComputingInputNodesGradients() const override
+    {
+        // all values needed for the gradient are kept in the node's own temp matrices
+        return false;
+    }
+
+    virtual NodeStatePtr /*IStatefulNode::*/ ExportState() override
+    {
+        auto pState = make_shared<DelayedValueNodeState<ElemType>>(m_deviceId);
+        pState->CacheDelayedMBLayout(m_delayedActivationMBLayout);
+        if (m_pMBLayout->HasSequenceBeyondEnd()) // only need to export state if anything crosses the MB boundary
+            pState->CacheState(m_delayedValue);
+        return pState;
+    }
+
+    virtual void /*IStatefulNode::*/ ImportState(const NodeStatePtr& pImportedState) override
+    {
+        auto pState = dynamic_pointer_cast<DelayedValueNodeState<ElemType>>(pImportedState);
+        if (!pState)
+            LogicError("Expecting DelayValueNodeState after downcasting");
+
+        if (!m_delayedActivationMBLayout)
+            m_delayedActivationMBLayout = make_shared<MBLayout>();
+        pState->ExportDelayedMBLayout(m_delayedActivationMBLayout);
+        if (!pState->IsEmpty())
+            m_delayedValue.SetValue(pState->ExportCachedActivity());
+    }
+
+protected:
+    virtual void BackpropThroughTime(const FrameRange& fr) = 0;
+
+    // true if frame t of parallel sequence s continues the sequence of frame t-1 (which may lie in the previous minibatch)
+    bool ContinuesSequence(size_t t, size_t s) const
+    {
+        FrameRange fr(m_pMBLayout, t);
+        return !m_pMBLayout->IsGap(fr.Sequence(s)) && !m_pMBLayout->IsBeyondStartOrEnd(fr.WithTimeOffset(-1).Sequence(s));
+    }
+    bool ContinuesAllSequences(size_t t) const
+    {
+        FrameRange fr(m_pMBLayout, t);
+        return !m_pMBLayout->IsGap(fr) && !m_pMBLayout->IsBeyondStartOrEnd(fr.WithTimeOffset(-1));
+    }
+
+    // prev(:, frame t) = what a PastValueNode would deliver at frame t for 'values', which is the state (e.g. the output)
+    // of the entire minibatch; stateRow is where this state is found in the carried-over state of the previous minibatch
+    void AssignPreviousFrame(Matrix<ElemType>& prev, const Matrix<ElemType>& values, size_t stateRow, size_t t)
+    {
+        const size_t numSeq = GetNumParallelSequences();
+        if (t > 0 && ContinuesAllSequences(t))
+        {
+            Matrix<ElemType> to = prev.ColumnSlice(t * numSeq, numSeq);
+            to.SetValue(values.ColumnSlice((t - 1) * numSeq, numSeq));
+            return;
+        }
+        for (size_t s = 0; s < numSeq; s++)
+        {
+            Matrix<ElemType> to = prev.ColumnSlice(t * numSeq + s, 1);
+            if (!ContinuesSequence(t, s)) // crossed a boundary, or a gap
+                to.SetValue(m_initialActivationValue);
+            else if (t > 0)
+                to.SetValue(values.ColumnSlice((t - 1) * numSeq + s, 1));
+            else // sequence continues from the previous minibatch
+            {
+                if (m_delayedValue.GetNumCols() != numSeq || m_delayedValue.GetNumRows() < stateRow + prev.GetNumRows())
+                    LogicError("%ls %ls operation: A sequence continues from the previous minibatch, but no state was carried over for it.", NodeName().c_str(), OperationName().c_str());
+                to.AssignRowSliceValuesOf(m_delayedValue.ColumnSlice(s, 1), stateRow, prev.GetNumRows());
+            }
+        }
+    }
+
+    // call f(firstColumn, numColumns) for the columns of frame t that continue a sequence of frame t-1 within this minibatch,
+    // i.e. those through which the gradient flows back into frame t-1
+    template <class F>
+    void ForEachContinuation(size_t t, const F& f) const
+    {
+        const size_t numSeq = GetNumParallelSequences();
+        if (t == 0) // truncated BPTT: we do not backpropagate into the previous minibatch
+            return;
+        if (ContinuesAllSequences(t))
+            f(t * numSeq, numSeq);
+        else
+        {
+            for (size_t s = 0; s < numSeq; s++)
+                if (ContinuesSequence(t, s))
+                    f(t * numSeq + s, 1);
+        }
+    }
+
+    // keep the last frame of the given state matrices (stacked) for the next minibatch
+    void SaveFinalState(const std::vector<const Matrix<ElemType>*>& states)
+    {
+        const size_t numSeq = GetNumParallelSequences();
+        const size_t lastColumn = (GetNumTimeSteps() - 1) * numSeq;
+        size_t numRows = 0;
+        for (const auto* state : states)
+            numRows += state->GetNumRows();
+        m_delayedValue.Resize(numRows, numSeq);
+        size_t row = 0;
+        for (const auto* state : states)
+        {
+            m_delayedValue.AssignToRowSliceValuesOf(state->ColumnSlice(lastColumn, numSeq), row, state->GetNumRows());
+            row += state->GetNumRows();
+        }
+        if (!m_delayedActivationMBLayout)
+            m_delayedActivationMBLayout = make_shared<MBLayout>();
+        m_delayedActivationMBLayout->CopyFrom(m_pMBLayout);
+    }
+
+protected:
+    ElemType m_initialActivationValue;       // output (and cell) value before the first frame of a sequence
+    Matrix<ElemType> m_delayedValue;         // state of the last frame of the previous minibatch, one column per parallel sequence
+    MBLayoutPtr m_delayedActivationMBLayout; // layout of the previous minibatch
+};
+
+#define UsingRecurrentLayerNodeMembers          \
+    UsingComputationNodeMembersBoilerplate;     \
+    using Base::m_initialActivationValue;       \
+    using Base::AssignPreviousFrame;            \
+    using Base::ContinuesAllSequences;          \
+    using Base::ContinuesSequence;              \
+    using Base::ForEachContinuation;            \
+    using Base::SaveFinalState;
+
+// -----------------------------------------------------------------------
+// LSTMNode (input, W, R, b, peepholes[, projection]) -- LSTM layer with peephole connections
+//
+// This computes the same as the LSTMPComponent macro in Examples/Speech/AN4/Config/lstmp-3layer-opt.ndl:
+//    [i ; g ; f ; o] = W input(t) + b + R h(t-1)
+//    i = Sigmoid(i + peepholes[:,0] .* c(t-1))
+//    g = Tanh(g)
+//    f = Sigmoid(f + peepholes[:,1] .* c(t-1))
+//    c(t) = f .* c(t-1) + i .* g
+//    o = Sigmoid(o + peepholes[:,2] .* c(t))
+//    h(t) = projection * (o .* Tanh(c(t)))    (or without 'projection *' if not given)
+// with dimensions
+//  - W: [4 cellDim x inputDim]
+//  - R: [4 cellDim x outputDim]
+//  - b: [4 cellDim x 1]
+//  - peepholes: [cellDim x 3]
+//  - projection: [outputDim x cellDim]; without projection, outputDim = cellDim
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class LSTMNode : public RecurrentLayerNodeBase<ElemType>
+{
+    typedef RecurrentLayerNodeBase<ElemType> Base;
+    UsingRecurrentLayerNodeMembers;
+    static const std::wstring TypeName()
+    {
+        return L"LSTM";
+    }
+
+public:
+    LSTMNode(DEVICEID_TYPE deviceId, const wstring& name)
+        : Base(deviceId, name, (ElemType) DEFAULT_HIDDEN_ACTIVATION)
+    {
+    }
+    LSTMNode(DEVICEID_TYPE deviceId, const wstring& name, ElemType initialActivationValue)
+        : Base(deviceId, name, initialActivationValue)
+    {
+    }
+    LSTMNode(const ScriptableObjects::IConfigRecordPtr configp)
+        : LSTMNode(configp->Get(L"deviceId"), L"<placeholder>", configp->Get(L"defaultHiddenActivation"))
+    {
+        AttachInputs(configp);
+    }
+
+    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    {
+        if (!fr.IsAllFrames())
+            LogicError("%ls %ls operation iterates over time itself and cannot be part of a recurrent loop.", NodeName().c_str(), OperationName().c_str());
+
+        const size_t numSeq = GetNumParallelSequences();
+        const size_t numTimeSteps = GetNumTimeSteps();
+        const size_t numCols = numSeq * numTimeSteps;
+        const size_t cellDim = GetCellDim();
+        const Matrix<ElemType>& W = Input(1)->ValueAsMatrix();
+        const Matrix<ElemType>& R = Input(2)->ValueAsMatrix();
+        const Matrix<ElemType>& peepholes = Input(4)->ValueAsMatrix();
+        Matrix<ElemType> output = ValueFor(fr);
+
+        m_gates->Resize(4 * cellDim, numCols);
+        m_prevOutput->Resize(GetSampleMatrixNumRows(), numCols);
+        m_prevCell->Resize(cellDim, numCols);
+        m_cell->Resize(cellDim, numCols);
+        if (HasProjection())
+            m_cellOutput->Resize(cellDim, numCols);
+
+        // input projection for all frames at once
+        m_gates->AssignProductOf(W, false, Input(0)->ValueFor(fr), false);
+        Matrix<ElemType>::ScaleAndAdd(1, Input(3)->ValueAsMatrix(), *m_gates);
+
+        for (size_t t = 0; t < numTimeSteps; t++)
+        {
+            AssignPreviousFrame(*m_prevOutput, output, 0, t);
+            AssignPreviousFrame(*m_prevCell, *m_cell, GetSampleMatrixNumRows(), t);
+            Matrix<ElemType> gates = m_gates->ColumnSlice(t * numSeq, numSeq);
+            Matrix<ElemType>::MultiplyAndAdd(R, false, m_prevOutput->ColumnSlice(t * numSeq, numSeq), false, gates);
+            Matrix<ElemType> cell = m_cell->ColumnSlice(t * numSeq, numSeq);
+            Matrix<ElemType> outputFrame = output.ColumnSlice(t * numSeq, numSeq);
+            if (HasProjection())
+            {
+                Matrix<ElemType> cellOutput = m_cellOutput->ColumnSlice(t * numSeq, numSeq);
+                Matrix<ElemType>::LSTMCellForward(gates, m_prevCell->ColumnSlice(t * numSeq, numSeq), peepholes, cell, cellOutput);
+                outputFrame.AssignProductOf(Input(5)->ValueAsMatrix(), false, cellOutput, false);
+            }
+            else
+                Matrix<ElemType>::LSTMCellForward(gates, m_prevCell->ColumnSlice(t * numSeq, numSeq), peepholes, cell, outputFrame);
+        }
+
+        SaveFinalState({&output, m_cell.get()});
+    }
+
+    virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
+    {
+        // the gradients of the gate pre-activations were computed by BackpropThroughTime()
+        const Matrix<ElemType>& gatesGradient = *m_gatesGradient;
+        switch (inputIndex)
+        {
+        case 0: // input
+        {
+            Matrix<ElemType> inputGradient = Input(0)->GradientFor(fr);
+            Matrix<ElemType>::MultiplyAndAdd(Input(1)->ValueAsMatrix(), true, gatesGradient, false, inputGradient);
+            break;
+        }
+        case 1: // W
+            Matrix<ElemType>::MultiplyAndAdd(gatesGradient, false, Input(0)->MaskedValueFor(fr), true, Input(1)->GradientAsMatrix());
+            break;
+        case 2: // R
+            Matrix<ElemType>::MultiplyAndAdd(gatesGradient, false, *m_prevOutput, true, Input(2)->GradientAsMatrix());
+            break;
+        case 3: // b
+        {
+            Matrix<ElemType> biasGradient(m_deviceId);
+            Matrix<ElemType>::VectorSum(gatesGradient, biasGradient, false);
+            Input(3)->GradientAsMatrix() += biasGradient;
+            break;
+        }
+        case 4: // peepholes
+            Input(4)->GradientAsMatrix() += *m_peepholesGradient;
+            break;
+        case 5: // projection
+            Matrix<ElemType>::MultiplyAndAdd(*m_outputGradient, false, *m_cellOutput, true, Input(5)->GradientAsMatrix());
+            break;
+        }
+    }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+        if (GetNumInputs() != 5 && GetNumInputs() != 6)
+            InvalidArgument("%ls %ls operation expects 5 or 6 inputs (input, W, R, b, peepholes[, projection]).", NodeName().c_str(), OperationName().c_str());
+
+        // infer parameter dimensions where possible
+        const size_t inputDim = Input(0)->GetSampleMatrixNumRows();
+        const size_t gatesDim = Input(1)->GetAsMatrixNumRows();
+        const size_t cellDim = gatesDim / 4;
+        Input(1)->ValidateInferInputDimsFrom(TensorShape(gatesDim, inputDim));
+        Input(3)->ValidateInferInputDimsFrom(TensorShape(gatesDim, 1));
+        Input(4)->ValidateInferInputDimsFrom(TensorShape(cellDim, 3));
+        size_t outputDim = cellDim;
+        if (HasProjection())
+        {
+            outputDim = Input(5)->GetAsMatrixNumRows();
+            Input(5)->ValidateInferInputDimsFrom(TensorShape(outputDim, cellDim));
+        }
+        Input(2)->ValidateInferInputDimsFrom(TensorShape(gatesDim, outputDim));
+        SetDims(TensorShape(outputDim), true);
+
+        if (isFinalValidationPass)
+        {
+            if (gatesDim == 0 || gatesDim % 4 != 0)
+                InvalidArgument("%ls %ls operation: The number of rows of W (%d) must be 4 times the cell dimension.", NodeName().c_str(), OperationName().c_str(), (int) gatesDim);
+            ValidateParameterDims(1, L"W", gatesDim, inputDim);
+            ValidateParameterDims(2, L"R", gatesDim, outputDim);
+            ValidateParameterDims(3, L"b", gatesDim, 1);
+            ValidateParameterDims(4, L"peepholes", cellDim, 3);
+            if (HasProjection())
+                ValidateParameterDims(5, L"projection", outputDim, cellDim);
+        }
+    }
+
+    virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeForwardProp(matrixPool);
+        RequestMatrixFromPool(m_gates, matrixPool);
+        RequestMatrixFromPool(m_prevOutput, matrixPool);
+        RequestMatrixFromPool(m_prevCell, matrixPool);
+        RequestMatrixFromPool(m_cell, matrixPool);
+        if (HasProjection())
+            RequestMatrixFromPool(m_cellOutput, matrixPool);
+    }
+
+    virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeBackprop(matrixPool);
+        RequestMatrixFromPool(m_gatesGradient, matrixPool);
+        RequestMatrixFromPool(m_outputGradient, matrixPool);
+        RequestMatrixFromPool(m_cellGradient, matrixPool);
+        RequestMatrixFromPool(m_peepholesGradient, matrixPool);
+        if (HasProjection())
+            RequestMatrixFromPool(m_cellOutputGradient, matrixPool);
+    }
+
+    virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool) override
+    {
+        Base::ReleaseMatricesAfterBackprop(matrixPool);
+        ReleaseMatrixToPool(m_gates, matrixPool);
+        ReleaseMatrixToPool(m_prevOutput, matrixPool);
+        ReleaseMatrixToPool(m_prevCell, matrixPool);
+        ReleaseMatrixToPool(m_cell, matrixPool);
+        ReleaseMatrixToPool(m_gatesGradient, matrixPool);
+        ReleaseMatrixToPool(m_outputGradient, matrixPool);
+        ReleaseMatrixToPool(m_cellGradient, matrixPool);
+        ReleaseMatrixToPool(m_peepholesGradient, matrixPool);
+        if (HasProjection())
+        {
+            ReleaseMatrixToPool(m_cellOutput, matrixPool);
+            ReleaseMatrixToPool(m_cellOutputGradient, matrixPool);
+        }
+    }
+
+protected:
+    virtual void BackpropThroughTime(const FrameRange& fr) override
+    {
+        const size_t numSeq = GetNumParallelSequences();
+        const size_t numTimeSteps = GetNumTimeSteps();
+        const size_t cellDim = GetCellDim();
+        const Matrix<ElemType>& R = Input(2)->ValueAsMatrix();
+        const Matrix<ElemType>& peepholes = Input(4)->ValueAsMatrix();
+
+        // m_outputGradient receives the recurrent gradient on top of our own, going backwards in time
+        m_outputGradient->SetValue(MaskedGradientFor(fr));
+        m_gatesGradient->Resize(4 * cellDim, numSeq * numTimeSteps);
+        m_cellGradient->Resize(cellDim, numSeq);
+        m_cellGradient->SetValue(0);
+        m_peepholesGradient->Resize(cellDim, 3);
+        m_peepholesGradient->SetValue(0);
+        if (HasProjection())
+            m_cellOutputGradient->Resize(cellDim, numSeq);
+
+        for (size_t t = numTimeSteps; t-- > 0;)
+        {
+            const size_t j = t * numSeq;
+            Matrix<ElemType> outputGradient = m_outputGradient->ColumnSlice(j, numSeq);
+            Matrix<ElemType> gatesGradient = m_gatesGradient->ColumnSlice(j, numSeq);
+            if (HasProjection())
+                m_cellOutputGradient->AssignProductOf(Input(5)->ValueAsMatrix(), true, outputGradient, false);
+            Matrix<ElemType>::LSTMCellBackward(m_gates->ColumnSlice(j, numSeq), m_prevCell->ColumnSlice(j, numSeq), m_cell->ColumnSlice(j, numSeq), peepholes,
+                                               HasProjection() ? *m_cellOutputGradient : outputGradient, *m_cellGradient, gatesGradient, *m_peepholesGradient);
+
+            // the cell gradient does not flow across sequence starts
+            if (!ContinuesAllSequences(t))
+            {
+                for (size_t s = 0; s < numSeq; s++)
+                    if (!ContinuesSequence(t, s))
+                        m_cellGradient->ColumnSlice(s, 1).SetValue(0);
+            }
+            // recurrent gradient into the output of the previous frame
+            ForEachContinuation(t, [&](size_t firstColumn, size_t numColumns)
+                                {
+                                    Matrix<ElemType> prevOutputGradient = m_outputGradient->ColumnSlice(firstColumn - numSeq, numColumns);
+                                    Matrix<ElemType>::MultiplyAndAdd(R, true, m_gatesGradient->ColumnSlice(firstColumn, numColumns), false, prevOutputGradient);
+                                });
+        }
+    }
+
+private:
+    bool HasProjection() const
+    {
+        return GetNumInputs() > 5;
+    }
+    size_t GetCellDim() const
+    {
+        return Input(4)->GetAsMatrixNumRows();
+    }
+    void ValidateParameterDims(size_t inputIndex, const wchar_t* what, size_t rows, size_t cols)
+    {
+        if (Input(inputIndex)->HasMBLayout() || Input(inputIndex)->GetAsMatrixNumRows() != rows || Input(inputIndex)->GetAsMatrixNumCols() != cols)
+            InvalidArgument("%ls %ls operation: %ls must be a [%d x %d] matrix, but is [%d x %d].", NodeName().c_str(), OperationName().c_str(), what,
+                            (int) rows, (int) cols, (int) Input(inputIndex)->GetAsMatrixNumRows(), (int) Input(inputIndex)->GetAsMatrixNumCols());
+    }
+
+    // kept from ForwardProp() for backprop
+    shared_ptr<Matrix<ElemType>> m_gates;      // [4 cellDim x T] gate activations
+    shared_ptr<Matrix<ElemType>> m_prevOutput; // [outputDim x T] h(t-1)
+    shared_ptr<Matrix<ElemType>> m_prevCell;   // [cellDim x T] c(t-1)
+    shared_ptr<Matrix<ElemType>> m_cell;       // [cellDim x T] c(t)
+    shared_ptr<Matrix<ElemType>> m_cellOutput; // [cellDim x T] o .* Tanh(c(t)), only with projection
+    // backprop temps
+    shared_ptr<Matrix<ElemType>> m_gatesGradient;      // [4 cellDim x T]
+    shared_ptr<Matrix<ElemType>> m_outputGradient;     // [outputDim x T]
+    shared_ptr<Matrix<ElemType>> m_cellGradient;       // [cellDim x numSeq], carried backwards in time
+    shared_ptr<Matrix<ElemType>> m_cellOutputGradient; // [cellDim x numSeq], only with projection
+    shared_ptr<Matrix<ElemType>> m_peepholesGradient;  // [cellDim x 3]
+};
+
+template class LSTMNode<float>;
+template class LSTMNode<double>;
+
+// -----------------------------------------------------------------------
+// GRUNode (input, W, R, b) -- GRU layer
+//
+//    [r ; z ; n] = W input(t) + b,  [hr ; hz ; hn] = R h(t-1)
+//    r = Sigmoid(r + hr)
+//    z = Sigmoid(z + hz)
+//    n = Tanh(n + r .* hn)
+//    h(t) = (1 - z) .* n + z .* h(t-1)
+// with dimensions
+//  - W: [3 outputDim x inputDim]
+//  - R: [3 outputDim x outputDim]
+//  - b: [3 outputDim x 1]
+// The reset gate is applied after the recurrent product, so that there is only one matrix product per time step.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class GRUNode : public RecurrentLayerNodeBase<ElemType>, public NumInputs<4>
+{
+    typedef RecurrentLayerNodeBase<ElemType> Base;
+    UsingRecurrentLayerNodeMembers;
+    static const std::wstring TypeName()
+    {
+        return L"GRU";
+    }
+
+public:
+    GRUNode(DEVICEID_TYPE deviceId, const wstring& name)
+        : Base(deviceId, name, (ElemType) DEFAULT_HIDDEN_ACTIVATION)
+    {
+    }
+    GRUNode(DEVICEID_TYPE deviceId, const wstring& name, ElemType initialActivationValue)
+        : Base(deviceId, name, initialActivationValue)
+    {
+    }
+    GRUNode(const ScriptableObjects::IConfigRecordPtr configp)
+        : GRUNode(configp->Get(L"deviceId"), L"<placeholder>", configp->Get(L"defaultHiddenActivation"))
+    {
+        AttachInputs(configp, this->GetExpectedNumInputs());
+    }
+
+    virtual void /*ComputationNode::*/ ForwardProp(const FrameRange& fr) override
+    {
+        if (!fr.IsAllFrames())
+            LogicError("%ls %ls operation iterates over time itself and cannot be part of a recurrent loop.", NodeName().c_str(), OperationName().c_str());
+
+        const size_t numSeq = GetNumParallelSequences();
+        const size_t numTimeSteps = GetNumTimeSteps();
+        const size_t numCols = numSeq * numTimeSteps;
+        const size_t outputDim = GetSampleMatrixNumRows();
+        const Matrix<ElemType>& R = Input(2)->ValueAsMatrix();
+        Matrix<ElemType> output = ValueFor(fr);
+
+        m_gates->Resize(3 * outputDim, numCols);
+        m_recurrent->Resize(3 * outputDim, numCols);
+        m_prevOutput->Resize(outputDim, numCols);
+
+        // input projection for all frames at once
+        m_gates->AssignProductOf(Input(1)->ValueAsMatrix(), false, Input(0)->ValueFor(fr), false);
+        Matrix<ElemType>::ScaleAndAdd(1, Input(3)->ValueAsMatrix(), *m_gates);
+
+        for (size_t t = 0; t < numTimeSteps; t++)
+        {
+            AssignPreviousFrame(*m_prevOutput, output, 0, t);
+            Matrix<ElemType> prevOutput = m_prevOutput->ColumnSlice(t * numSeq, numSeq);
+            Matrix<ElemType> recurrent = m_recurrent->ColumnSlice(t * numSeq, numSeq);
+            recurrent.AssignProductOf(R, false, prevOutput, false);
+            Matrix<ElemType> gates = m_gates->ColumnSlice(t * numSeq, numSeq);
+            Matrix<ElemType> outputFrame = output.ColumnSlice(t * numSeq, numSeq);
+            Matrix<ElemType>::GRUCellForward(gates, recurrent, prevOutput, outputFrame);
+        }
+
+        SaveFinalState({&output});
+    }
+
+    virtual void /*ComputationNode::*/ BackpropTo(const size_t inputIndex, const FrameRange& fr) override
+    {
+        // the gradients of the gate pre-activations were computed by BackpropThroughTime()
+        const Matrix<ElemType>& gatesGradient = *m_gatesGradient;
+        switch (inputIndex)
+        {
+        case 0: // input
+        {
+            Matrix<ElemType> inputGradient = Input(0)->GradientFor(fr);
+            Matrix<ElemType>::MultiplyAndAdd(Input(1)->ValueAsMatrix(), true, gatesGradient, false, inputGradient);
+            break;
+        }
+        case 1: // W
+            Matrix<ElemType>::MultiplyAndAdd(gatesGradient, false, Input(0)->MaskedValueFor(fr), true, Input(1)->GradientAsMatrix());
+            break;
+        case 2: // R
+            Matrix<ElemType>::MultiplyAndAdd(*m_recurrentGradient, false, *m_prevOutput, true, Input(2)->GradientAsMatrix());
+            break;
+        case 3: // b
+        {
+            Matrix<ElemType> biasGradient(m_deviceId);
+            Matrix<ElemType>::VectorSum(gatesGradient, biasGradient, false);
+            Input(3)->GradientAsMatrix() += biasGradient;
+            break;
+        }
+        }
+    }
+
+    virtual void /*ComputationNodeBase::*/ Validate(bool isFinalValidationPass) override
+    {
+        Base::Validate(isFinalValidationPass);
+
+        const size_t inputDim = Input(0)->GetSampleMatrixNumRows();
+        const size_t gatesDim = Input(1)->GetAsMatrixNumRows();
+        const size_t outputDim = gatesDim / 3;
+        Input(1)->ValidateInferInputDimsFrom(TensorShape(gatesDim, inputDim));
+        Input(2)->ValidateInferInputDimsFrom(TensorShape(gatesDim, outputDim));
+        Input(3)->ValidateInferInputDimsFrom(TensorShape(gatesDim, 1));
+        SetDims(TensorShape(outputDim), true);
+
+        if (isFinalValidationPass)
+        {
+            if (gatesDim == 0 || gatesDim % 3 != 0)
+                InvalidArgument("%ls %ls operation: The number of rows of W (%d) must be 3 times the output dimension.", NodeName().c_str(), OperationName().c_str(), (int) gatesDim);
+            for (size_t i = 1; i < 4; i++)
+            {
+                size_t cols = i == 1 ? inputDim : i == 2 ? outputDim : 1;
+                if (Input(i)->HasMBLayout() || Input(i)->GetAsMatrixNumRows() != gatesDim || Input(i)->GetAsMatrixNumCols() != cols)
+                    InvalidArgument("%ls %ls operation: Input %d must be a [%d x %d] matrix, but is [%d x %d].", NodeName().c_str(), OperationName().c_str(), (int) i,
+                                    (int) gatesDim, (int) cols, (int) Input(i)->GetAsMatrixNumRows(), (int) Input(i)->GetAsMatrixNumCols());
+            }
+        }
+    }
+
+    virtual void RequestMatricesBeforeForwardProp(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeForwardProp(matrixPool);
+        RequestMatrixFromPool(m_gates, matrixPool);
+        RequestMatrixFromPool(m_recurrent, matrixPool);
+        RequestMatrixFromPool(m_prevOutput, matrixPool);
+    }
+
+    virtual void RequestMatricesBeforeBackprop(MatrixPool& matrixPool) override
+    {
+        Base::RequestMatricesBeforeBackprop(matrixPool);
+        RequestMatrixFromPool(m_gatesGradient, matrixPool);
+        RequestMatrixFromPool(m_recurrentGradient, matrixPool);
+        RequestMatrixFromPool(m_outputGradient, matrixPool);
+        RequestMatrixFromPool(m_prevOutputGradient, matrixPool);
+    }
+
+    virtual void ReleaseMatricesAfterBackprop(MatrixPool& matrixPool) override
+    {
+        Base::ReleaseMatricesAfterBackprop(matrixPool);
+        ReleaseMatrixToPool(m_gates, matrixPool);
+        ReleaseMatrixToPool(m_recurrent, matrixPool);
+        ReleaseMatrixToPool(m_prevOutput, matrixPool);
+        ReleaseMatrixToPool(m_gatesGradient, matrixPool);
+        ReleaseMatrixToPool(m_recurrentGradient, matrixPool);
+        ReleaseMatrixToPool(m_outputGradient, matrixPool);
+        ReleaseMatrixToPool(m_prevOutputGradient, matrixPool);
+    }
+
+protected:
+    virtual void BackpropThroughTime(const FrameRange& fr) override
+    {
+        const size_t numSeq = GetNumParallelSequences();
+        const size_t numTimeSteps = GetNumTimeSteps();
+        const size_t outputDim = GetSampleMatrixNumRows();
+        const Matrix<ElemType>& R = Input(2)->ValueAsMatrix();
+
+        // m_outputGradient receives the recurrent gradient on top of our own, going backwards in time
+        m_outputGradient->SetValue(MaskedGradientFor(fr));
+        m_gatesGradient->Resize(3 * outputDim, numSeq * numTimeSteps);
+        m_recurrentGradient->Resize(3 * outputDim, numSeq * numTimeSteps);
+        m_prevOutputGradient->Resize(outputDim, numSeq);
+
+        for (size_t t = numTimeSteps; t-- > 0;)
+        {
+            const size_t j = t * numSeq;
+            Matrix<ElemType> gatesGradient = m_gatesGradient->ColumnSlice(j, numSeq);
+            Matrix<ElemType> recurrentGradient = m_recurrentGradient->ColumnSlice(j, numSeq);
+            Matrix<ElemType>::GRUCellBackward(m_gates->ColumnSlice(j, numSeq), m_recurrent->ColumnSlice(j, numSeq), m_prevOutput->ColumnSlice(j, numSeq),
+                                              m_outputGradient->ColumnSlice(j, numSeq), gatesGradient, recurrentGradient, *m_prevOutputGradient);
+
+            // gradient into the output of the previous frame, both directly and through R
+            ForEachContinuation(t, [&](size_t firstColumn, size_t numColumns)
+                                {
+                                    Matrix<ElemType> prevOutputGradient = m_outputGradient->ColumnSlice(firstColumn - numSeq, numColumns);
+                                    prevOutputGradient += m_prevOutputGradient->ColumnSlice(firstColumn - j, numColumns);
+                                    Matrix<ElemType>::MultiplyAndAdd(R, true, m_recurrentGradient->ColumnSlice(firstColumn, numColumns), false, prevOutputGradient);
+                                });
+        }
+    }
+
+private:
+    // kept from ForwardProp() for backprop
+    shared_ptr<Matrix<ElemType>> m_gates;      // [3 outputDim x T] gate activations
+    shared_ptr<Matrix<ElemType>> m_recurrent;  // [3 outputDim x T] R h(t-1)
+    shared_ptr<Matrix<ElemType>> m_prevOutput; // [outputDim x T] h(t-1)
+    // backprop temps
+    shared_ptr<Matrix<ElemType>> m_gatesGradient;      // [3 outputDim x T]
+    shared_ptr<Matrix<ElemType>> m_recurrentGradient;  // [3 outputDim x T]
+    shared_ptr<Matrix<ElemType>> m_outputGradient;     // [outputDim x T]
+    shared_ptr<Matrix<ElemType>> m_prevOutputGradient; // [outputDim x numSeq]
+};
+
+template class GRUNode<float>;
+template class GRUNode<double>;
+
 #ifdef COMING_SOON
 
 // -----------------------------------------------------------------------
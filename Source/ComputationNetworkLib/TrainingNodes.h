@@ -1841,6 +1841,14 @@ public:
     {
         m_eval = bnEvalMode;
     }
+    bool IsEvalMode() const
+    {
+        return m_eval;
+    }
+    bool IsSpatial() const
+    {
+        return m_spatial;
+    }
 
 private:
     struct VersionInfo
@@ -25,6 +25,12 @@ Microsoft::MSR::CNTK::MPIWrapper* g_mpi = nullptr;
 // sharing is ready to be enabled by default
 bool g_shareNodeValueMatrices = false;
 
+// number of threads for running independent nodes of a network concurrently (CPU only); 0 = one node at a time
+size_t g_parallelTraversalThreads = 0;
+
+// compute trees of elementwise nodes in a single pass (CPU only)
+bool g_fuseElementwiseNodes = false;
+
 namespace Microsoft { namespace MSR { namespace CNTK {
 
 template <class ElemType>
@@ -56,6 +62,8 @@ void CNTKEval<ElemType>::Init(const std::string& config)
     CPUMatrix<ElemType>::SetNumThreads(nThreads);
 
     g_shareNodeValueMatrices = m_config(L"shareNodeValueMatrices", false);
+    g_parallelTraversalThreads = m_config(L"parallelTraversalThreads", "0");
+    g_fuseElementwiseNodes = m_config(L"fuseElementwiseNodes", false);
 }
 
 // Destroy - cleanup and remove this class
@@ -77,7 +85,22 @@ void CNTKEval<ElemType>::LoadModel(const std::wstring& modelFileName)
 {
     DEVICEID_TYPE deviceId = DeviceFromConfig(m_config);
     fprintf(stderr, "DeviceID=%d\n", (int) deviceId);
-    m_net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelFileName);
+    // memoryMapModel: parameters of CPU models use the mapped model file as their storage instead of being read
+    bool memoryMapModel = m_config(L"memoryMapModel", false);
+    m_net = ComputationNetwork::CreateFromFile<ElemType>(deviceId, modelFileName, memoryMapModel ? (FileOptions)(fileOptionsBinary | fileOptionsMemoryMapped) : fileOptionsBinary);
+    // foldBatchNormalization: fold the BatchNormalization nodes into the weights of the Times or Convolution nodes they follow
+    if (m_config(L"foldBatchNormalization", false))
+    {
+        m_net->SetBatchNormlizationNodesBelowEvalMode(true);
+        size_t numFolded = m_net->FoldBatchNormalizationNodes<ElemType>();
+        fprintf(stderr, "Folded %d BatchNormalization nodes.\n", (int) numFolded);
+        if (numFolded > 0)
+            m_net->CompileNetwork();
+    }
+    // quantizeWeights: evaluate the Times and Convolution nodes with 8- or 16-bit integer weights (CPU only)
+    size_t quantizeWeights = m_config(L"quantizeWeights", (size_t) 0);
+    if (quantizeWeights != 0)
+        m_net->QuantizeWeights<ElemType>(quantizeWeights);
 }
 
 // GetNodeDimensions - Get the node dimensions of the specified nodes
@@ -182,6 +205,16 @@ void CNTKEval<ElemType>::ResetState()
     m_start = 1 - m_start;
 }
 
+// CreateContext - create a context for evaluating the model on one thread, sharing the parameters of m_net
+template <class ElemType>
+IEvaluateContext<ElemType>* CNTKEval<ElemType>::CreateContext(const std::vector<std::wstring>& inputNodeNames, const std::vector<std::wstring>& outputNodeNames)
+{
+    if (m_net == nullptr)
+        LogicError("CreateContext: No model loaded.");
+    std::lock_guard<std::mutex> lock(m_createContextMutex);
+    return new CNTKEvalContext<ElemType>(*m_net, inputNodeNames, outputNodeNames);
+}
+
 // instantiate all the combinations we expect to be used
 template class CNTKEval<double>;
 template class CNTKEval<float>;
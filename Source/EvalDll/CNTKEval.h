@@ -9,10 +9,12 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <mutex>
 
 #include "Eval.h"
 #include "EvalReader.h"
 #include "EvalWriter.h"
+#include "CNTKEvalContext.h"
 
 #include "ComputationNetwork.h"
 
@@ -28,6 +30,7 @@ class CNTKEval : public IEvaluateModel<ElemType>
     ComputationNetworkPtr m_net;
     std::map<std::wstring, size_t> m_dimensions;
     size_t m_start;
+    std::mutex m_createContextMutex; // contexts may be created from several threads
 
 public:
     // constructor
@@ -57,5 +60,8 @@ public:
     virtual void Init(const std::string& config);
     virtual void Destroy();
     virtual void ResetState();
+
+    // CreateContext - create a context for evaluating the model on one thread, sharing the parameters of m_net
+    virtual IEvaluateContext<ElemType>* CreateContext(const std::vector<std::wstring>& inputNodeNames, const std::vector<std::wstring>& outputNodeNames);
 };
 } } }
@@ -0,0 +1,168 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CNTKEvalContext.cpp : evaluation contexts that share the parameters of a loaded model
+//
+
+#include "stdafx.h"
+#include "CNTKEvalContext.h"
+#include "InputAndParamNodes.h"
+#include <functional>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+CNTKEvalContext<ElemType>::CNTKEvalContext(const ComputationNetwork& net, const std::vector<std::wstring>& inputNodeNames, const std::vector<std::wstring>& outputNodeNames)
+{
+    m_net = make_shared<ComputationNetwork>(net.GetDeviceId());
+    m_net->CopyNetworkSharingParameters(net);
+
+    for (const auto& name : outputNodeNames)
+    {
+        m_outputNodes.push_back(m_net->GetNodeFromName(name));
+        m_outputDims.push_back(m_outputNodes.back()->GetSampleMatrixNumRows());
+    }
+    for (const auto& name : inputNodeNames)
+    {
+        auto node = m_net->GetNodeFromName(name);
+        if (node->OperationName() != OperationNameOf(InputValue))
+            InvalidArgument("CreateContext: Node '%ls' is not a dense input but a %ls node.", name.c_str(), node->OperationName().c_str());
+        m_inputNodes.push_back(node);
+        m_inputDims.push_back(node->GetSampleMatrixNumRows());
+    }
+
+    // allocate the activation buffers once; they are reused for every call to Evaluate()
+    m_net->AllocateAllMatrices({}, m_outputNodes, nullptr);
+    m_net->StartEvaluateMinibatchLoop(m_outputNodes);
+}
+
+// Destroy - cleanup and remove this class
+// NOTE: this destroys the object, and it can't be used past this point
+template <class ElemType>
+void CNTKEvalContext<ElemType>::Destroy()
+{
+    delete this;
+}
+
+// Evaluate - evaluate the output nodes of this context for numSamples samples
+// inputs - [i] column-major data for input node [i]
+// outputs - [i] preallocated buffer for output node [i]
+template <class ElemType>
+void CNTKEvalContext<ElemType>::Evaluate(const ElemType* const inputs[], ElemType* const outputs[], size_t numSamples)
+{
+    // the samples form a single sequence, which makes each call independent of the previous one
+    auto pMBLayout = m_net->GetMBLayoutPtr();
+    pMBLayout->Init(1, numSamples);
+    pMBLayout->AddSequence(0, 0, 0, numSamples);
+    ForwardProp(inputs, outputs);
+}
+
+// EvaluateSequences - evaluate several independent sequences in one minibatch
+// Sequence [s] becomes parallel sequence s of the MBLayout, i.e. its frame t goes to column t * numSequences + s,
+// and shorter sequences are padded with gaps. Inputs and outputs are the concatenated sequences.
+template <class ElemType>
+void CNTKEvalContext<ElemType>::EvaluateSequences(const ElemType* const inputs[], ElemType* const outputs[], const std::vector<size_t>& sequenceLengths)
+{
+    const size_t numSequences = sequenceLengths.size();
+    size_t numTimeSteps = 0;
+    for (size_t length : sequenceLengths)
+    {
+        if (length == 0)
+            InvalidArgument("EvaluateSequences: Sequences must be at least one sample long.");
+        numTimeSteps = max(numTimeSteps, length);
+    }
+
+    // single samples or a single sequence: the concatenated data is in minibatch order already
+    auto pMBLayout = m_net->GetMBLayoutPtr();
+    if (numTimeSteps == 1)
+    {
+        pMBLayout->InitAsFrameMode(numSequences);
+        ForwardProp(inputs, outputs);
+        return;
+    }
+    if (numSequences == 1)
+    {
+        Evaluate(inputs, outputs, numTimeSteps);
+        return;
+    }
+
+    pMBLayout->Init(numSequences, numTimeSteps);
+    for (size_t s = 0; s < numSequences; s++)
+    {
+        pMBLayout->AddSequence(s, s, 0, sequenceLengths[s]);
+        pMBLayout->AddGap(s, sequenceLengths[s], numTimeSteps);
+    }
+
+    // copy column 'sample' of the concatenated sequences to or from its minibatch column
+    auto forEachSample = [&](size_t dim, const std::function<void(size_t sample, size_t col)>& copy)
+    {
+        size_t sample = 0;
+        for (size_t s = 0; s < numSequences; s++)
+            for (size_t t = 0; t < sequenceLengths[s]; t++, sample++)
+                copy(sample * dim, (t * numSequences + s) * dim);
+    };
+
+    const size_t numCols = numSequences * numTimeSteps;
+    m_packedInputs.resize(m_inputNodes.size());
+    m_packedInputPtrs.resize(m_inputNodes.size());
+    for (size_t i = 0; i < m_inputNodes.size(); i++)
+    {
+        const size_t dim = m_inputDims[i];
+        auto& packed = m_packedInputs[i];
+        packed.assign(dim * numCols, 0); // gaps are zero
+        forEachSample(dim, [&](size_t sample, size_t col)
+                      {
+                          memcpy(&packed[col], inputs[i] + sample, dim * sizeof(ElemType));
+                      });
+        m_packedInputPtrs[i] = packed.data();
+    }
+    m_packedOutputs.resize(m_outputNodes.size());
+    m_packedOutputPtrs.resize(m_outputNodes.size());
+    for (size_t i = 0; i < m_outputNodes.size(); i++)
+    {
+        m_packedOutputs[i].resize(m_outputDims[i] * numCols);
+        m_packedOutputPtrs[i] = m_packedOutputs[i].data();
+    }
+
+    ForwardProp(m_packedInputPtrs.data(), m_packedOutputPtrs.data());
+
+    for (size_t i = 0; i < m_outputNodes.size(); i++)
+    {
+        const size_t dim = m_outputDims[i];
+        const auto& packed = m_packedOutputs[i];
+        forEachSample(dim, [&](size_t sample, size_t col)
+                      {
+                          memcpy(outputs[i] + sample, &packed[col], dim * sizeof(ElemType));
+                      });
+    }
+}
+
+// copy the inputs into the input nodes, run the network for the MBLayout set up by the caller, and copy the outputs out
+template <class ElemType>
+void CNTKEvalContext<ElemType>::ForwardProp(const ElemType* const inputs[], ElemType* const outputs[])
+{
+    const size_t numCols = m_net->GetMBLayoutPtr()->GetNumCols();
+    for (size_t i = 0; i < m_inputNodes.size(); i++)
+    {
+        auto& value = dynamic_pointer_cast<ComputationNode<ElemType>>(m_inputNodes[i])->Value();
+        value.SetValue(m_inputDims[i], numCols, value.GetDeviceId(), const_cast<ElemType*>(inputs[i]), matrixFlagNormal);
+        m_inputNodes[i]->NotifyFunctionValuesMBSizeModified();
+    }
+    ComputationNetwork::BumpEvalTimeStamp(m_inputNodes);
+
+    for (size_t i = 0; i < m_outputNodes.size(); i++)
+    {
+        m_net->ForwardProp(m_outputNodes[i]);
+        const auto& value = dynamic_pointer_cast<ComputationNode<ElemType>>(m_outputNodes[i])->Value();
+        ElemType* output = outputs[i];
+        size_t outputSize = m_outputDims[i] * numCols;
+        if (value.GetNumElements() != outputSize)
+            LogicError("Evaluate: Output node '%ls' has %d elements instead of the expected %d.", m_outputNodes[i]->NodeName().c_str(), (int) value.GetNumElements(), (int) outputSize);
+        value.CopyToArray(output, outputSize);
+    }
+}
+
+template class CNTKEvalContext<double>;
+template class CNTKEvalContext<float>;
+} } }
@@ -0,0 +1,45 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CNTKEvalContext.h - evaluation context of the CNTK Evaluation DLL, see IEvaluateModel::CreateContext()
+//
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Eval.h"
+#include "ComputationNetwork.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// CNTKEvalContext - copy of a loaded network for evaluation on one thread
+// The copy shares the LearnableParameter values of the original network and allocates its own
+// activation buffers once (from its MatrixPool), so Evaluate() only copies data in and out and runs ForwardProp().
+template <class ElemType>
+class CNTKEvalContext : public IEvaluateContext<ElemType>
+{
+    typedef shared_ptr<ComputationNode<ElemType>> ComputationNodePtr;
+    ComputationNetworkPtr m_net;
+    std::vector<ComputationNodeBasePtr> m_inputNodes;
+    std::vector<ComputationNodeBasePtr> m_outputNodes;
+    std::vector<size_t> m_inputDims;
+    std::vector<size_t> m_outputDims;
+
+    // staging buffers of EvaluateSequences(), in minibatch column order
+    std::vector<std::vector<ElemType>> m_packedInputs;
+    std::vector<std::vector<ElemType>> m_packedOutputs;
+    std::vector<const ElemType*> m_packedInputPtrs;
+    std::vector<ElemType*> m_packedOutputPtrs;
+
+    void ForwardProp(const ElemType* const inputs[], ElemType* const outputs[]);
+
+public:
+    CNTKEvalContext(const ComputationNetwork& net, const std::vector<std::wstring>& inputNodeNames, const std::vector<std::wstring>& outputNodeNames);
+
+    virtual void Destroy();
+    virtual void Evaluate(const ElemType* const inputs[], ElemType* const outputs[], size_t numSamples);
+    virtual void EvaluateSequences(const ElemType* const inputs[], ElemType* const outputs[], const std::vector<size_t>& sequenceLengths);
+};
+} } }
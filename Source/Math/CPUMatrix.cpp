@@ -11,6 +11,8 @@
 
 #include "CPUMatrix.h"
 #include "TensorOps.h"
+#include "CPUVectorKernels.h"
+#include "CPUMemAllocator.h"
 #include <assert.h>
 #include <stdexcept>
 #include <omp.h>
@@ -151,6 +153,21 @@ static ElemType* NewArray(size_t n)
     return p;
 }
 
+// helpers to allocate and free the element buffer owned by a CPUMatrix
+// These go through the caching allocator, which also takes care of alignment and NUMA placement.
+// Buffers are zero-initialized (see BUGBUG at Resize()).
+template <class ElemType>
+static ElemType* NewBuffer(size_t n)
+{
+    return (ElemType*) CPUMemAllocator::Instance().MallocZeroed(n * sizeof(ElemType));
+}
+
+template <class ElemType>
+static void DeleteBuffer(ElemType* p)
+{
+    CPUMemAllocator::Instance().Free(p);
+}
+
 template <class ElemType>
 CPUMatrix<ElemType>::CPUMatrix(const size_t numRows, const size_t numCols)
 {
@@ -161,7 +178,7 @@ CPUMatrix<ElemType>::CPUMatrix(const size_t numRows, const size_t numCols)
     m_elemSizeAllocated = GetNumElements();
 
     if (m_elemSizeAllocated != 0)
-        m_pArray = NewArray<ElemType>(m_elemSizeAllocated);
+        m_pArray = NewBuffer<ElemType>(m_elemSizeAllocated);
 }
 
 template <class ElemType>
@@ -215,7 +232,7 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::operator=(CPUMatrix<ElemType>&& moveFr
     if (this != &moveFrom)
     {
         if (OwnBuffer() && m_pArray != nullptr)
-            delete[] m_pArray; // always delete the data pointer since we will use the pointer from moveFrom
+            DeleteBuffer(m_pArray); // always delete the data pointer since we will use the pointer from moveFrom
 
         m_computeDevice = moveFrom.m_computeDevice;
         m_numRows = moveFrom.m_numRows;
@@ -242,7 +259,7 @@ void CPUMatrix<ElemType>::Clear()
 {
     if (m_pArray != nullptr && OwnBuffer())
     {
-        delete[] m_pArray;
+        DeleteBuffer(m_pArray);
         m_pArray = nullptr;
         m_elemSizeAllocated = 0;
     }
@@ -847,8 +864,8 @@ void CPUMatrix<ElemType>::SetValue(const size_t numRows, const size_t numCols, E
     if (matrixFlags & matrixFlagDontOwnBuffer)
     {
         // free previous array allocation if any before overwriting
-        if (m_pArray != nullptr)
-            delete[] m_pArray;
+        if (m_pArray != nullptr && OwnBuffer())
+            DeleteBuffer(m_pArray);
 
         m_pArray = pArray;
         m_numRows = numRows;
@@ -1367,11 +1384,11 @@ void CPUMatrix<ElemType>::Resize(const size_t numRows, const size_t numCols, boo
         {
             if (!OwnBuffer())
                 LogicError("Resize: Resizing an matrix you don't own is not supported.");
-            pArray = NewArray<ElemType>(numElements);
+            pArray = NewBuffer<ElemType>(numElements);
         }
         // success: update the object
         if (OwnBuffer())
-            delete[] m_pArray;
+            DeleteBuffer(m_pArray);
         else
             assert(pArray == nullptr); // (if !OwnBuffer we can still resize to 0)
         m_pArray = pArray;
@@ -4188,6 +4205,36 @@ void CPUMatrix<ElemType>::AssignNCEUnnormalizedEval(const CPUMatrix<ElemType>& a
     c(0, 0) = -log_likelihood;
 }
 
+// NCE with one noise set shared by all columns (LMSequenceReader with noise_shared=true):
+// the noise word ids in rows 2, 4, ... are then the same in every column, and scoring the noise
+// words for the whole minibatch becomes a product with the gathered noise embeddings.
+template <class ElemType>
+static bool NCENoiseIsShared(const CPUMatrix<ElemType>& samples)
+{
+    size_t sample_size = samples.GetNumRows() / 2;
+    if (sample_size < 2 || samples.GetNumCols() < 2)
+        return false;
+    for (size_t instance_id = 1; instance_id < samples.GetNumCols(); instance_id++)
+        for (size_t sample_id = 1; sample_id < sample_size; sample_id++)
+            if (samples(2 * sample_id, instance_id) != samples(2 * sample_id, 0))
+                return false;
+    return true;
+}
+
+// noiseEmbeddings(:, k) = b(:, k-th noise word)
+template <class ElemType>
+static void NCEGatherNoiseEmbeddings(const CPUMatrix<ElemType>& samples, const CPUMatrix<ElemType>& b, CPUMatrix<ElemType>& noiseEmbeddings)
+{
+    long num_noise_samples = (long) (samples.GetNumRows() / 2 - 1);
+    noiseEmbeddings.Resize(b.GetNumRows(), num_noise_samples);
+#pragma omp parallel for
+    for (long k = 0; k < num_noise_samples; k++)
+    {
+        size_t sample = (size_t) samples(2 * (k + 1), 0);
+        memcpy(&noiseEmbeddings(0, k), &b(0, sample), sizeof(ElemType) * b.GetNumRows());
+    }
+}
+
 //samples+prob                         gradient           hidden               embedding          embedding/hidden
 //a.m_CPUMatrix->AssignNCEDerivative(*tmp.m_CPUMatrix, *a.m_CPUMatrix, *b.m_CPUMatrix, inputIndex, *c.m_CPUMatrix);
 template <class ElemType>
@@ -4195,7 +4242,47 @@ CPUMatrix<ElemType>& CPUMatrix<ElemType>::AssignNCEDerivative(const CPUMatrix<El
 {
     size_t sample_size = this->GetNumRows() / 2;
     size_t batch_size = this->GetNumCols();
-    if (inputIndex == 1)
+    if (inputIndex <= 2 && NCENoiseIsShared(*this))
+    {
+        // the target words as below, the shared noise words by products with tmp's noise rows
+        size_t num_noise_samples = sample_size - 1;
+        CPUMatrix<ElemType> noiseGradient(num_noise_samples, batch_size);
+        for (size_t instance_id = 0; instance_id < batch_size; instance_id++)
+            memcpy(&noiseGradient(0, instance_id), &tmp(1, instance_id), sizeof(ElemType) * num_noise_samples);
+
+        if (inputIndex == 1)
+        {
+            CPUMatrix<ElemType> noiseEmbeddings;
+            NCEGatherNoiseEmbeddings(*this, b, noiseEmbeddings);
+            MultiplyAndWeightedAdd(-1, noiseEmbeddings, false, noiseGradient, false, 1, c);
+#pragma omp parallel for
+            for (int instance_id = 0; instance_id < (int) batch_size; instance_id++)
+            {
+                int sample = (int) (*this)(0, instance_id);
+                for (size_t dim = 0; dim < b.GetNumRows(); dim++)
+                    c(dim, instance_id) -= b(dim, sample) * tmp(0, instance_id);
+            }
+        }
+        else
+        {
+            CPUMatrix<ElemType> noiseEmbeddingsGradient(a.GetNumRows(), num_noise_samples);
+            MultiplyAndWeightedAdd(1, a, false, noiseGradient, true, 0, noiseEmbeddingsGradient);
+            // (a word may occur repeatedly among the noise and target words, so columns are updated sequentially)
+            for (size_t k = 0; k < num_noise_samples; k++)
+            {
+                int sample = (int) (*this)(2 * (k + 1), 0);
+                for (size_t dim = 0; dim < a.GetNumRows(); dim++)
+                    c(dim, sample) -= noiseEmbeddingsGradient(dim, k);
+            }
+            for (size_t instance_id = 0; instance_id < batch_size; instance_id++)
+            {
+                int sample = (int) (*this)(0, instance_id);
+                for (size_t dim = 0; dim < a.GetNumRows(); dim++)
+                    c(dim, sample) -= a(dim, instance_id) * tmp(0, instance_id);
+            }
+        }
+    }
+    else if (inputIndex == 1)
     {
 #pragma omp parallel for
         for (int instance_id = 0; instance_id < batch_size; instance_id++)
@@ -4251,14 +4338,29 @@ void CPUMatrix<ElemType>::AssignNoiseContrastiveEstimation(const CPUMatrix<ElemT
     size_t batch_size = this->GetNumCols();
     size_t num_noise_samples = sample_size - 1;
     double log_num_noise_samples = std::log(num_noise_samples);
+
+    // with shared noise, the noise words are scored for the whole minibatch by one product
+    bool sharedNoise = NCENoiseIsShared(*this);
+    CPUMatrix<ElemType> noiseScores;
+    if (sharedNoise)
+    {
+        CPUMatrix<ElemType> noiseEmbeddings;
+        NCEGatherNoiseEmbeddings(*this, b, noiseEmbeddings);
+        noiseScores.Resize(num_noise_samples, batch_size);
+        MultiplyAndWeightedAdd(1, noiseEmbeddings, true, a, false, 0, noiseScores);
+    }
+
 #pragma omp parallel for reduction(+ : log_likelihood)
     for (int instance_id = 0; instance_id < batch_size; instance_id++)
         for (int sample_id = 0; sample_id < sample_size; sample_id++)
         {
             int sample = (int) (*this)(2 * sample_id, instance_id);
             double score = bias(0, sample);
-            for (int dim = 0; dim < b.GetNumRows(); dim++)
-                score += a(dim, instance_id) * b(dim, sample);
+            if (sharedNoise && sample_id > 0)
+                score += noiseScores(sample_id - 1, instance_id);
+            else
+                for (size_t dim = 0; dim < b.GetNumRows(); dim++)
+                    score += a(dim, instance_id) * b(dim, sample);
             double sample_prob = -(*this)(2 * sample_id + 1, instance_id);
             if (sample_id == 0)
                 sample_prob = -sample_prob;
@@ -5486,6 +5588,18 @@ int CPUMatrix<ElemType>::SetNumThreads(int numThreads)
     return numThreads;
 }
 
+template <class ElemType>
+CPUVectorISA CPUMatrix<ElemType>::SetVectorISA(CPUVectorISA isa)
+{
+    return CPUVectorKernels::SetISA(isa);
+}
+
+template <class ElemType>
+CPUVectorISA CPUMatrix<ElemType>::GetVectorISA()
+{
+    return CPUVectorKernels::GetISA();
+}
+
 // =======================================================================
 // TensorView support
 // =======================================================================
@@ -5700,6 +5814,84 @@ static void TensorOpWithFn(ElemType beta, array<ElemType*, N> pointers, ElemType
     }
 }
 
+// -----------------------------------------------------------------------
+// hand-vectorized kernels (CPUVectorKernels.h) for the most common cases
+// -----------------------------------------------------------------------
+
+// elements per OpenMP work item; smaller ops run on a single thread, as OMP has a considerable fixed cost
+static const size_t vectorizedChunkSize = 16384;
+
+// run the op through the vectorized kernels if the op and the shapes are covered, else return false
+// Covered are elementwise ops whose first dimension is contiguous in all operands (plus at most one more
+// dimension), and unary opCopy reductions, i.e. the sum over all elements of a vector or over the columns of a matrix.
+template <class ElemType, size_t N>
+static bool TensorOpVectorized(ElemType beta, array<ElemType*, N> pointers, ElemType alpha, ElementWiseOperator op,
+                               const array<size_t, N>& offsets,
+                               const SmallVector<size_t>& regularOpDims, const array<SmallVector<ptrdiff_t>, N>& regularStrides,
+                               const SmallVector<size_t>& reducingOpDims, const array<SmallVector<ptrdiff_t>, N>& reducingStrides)
+{
+    const CPUVectorKernelTable<ElemType>* kernels = CPUVectorKernels::GetKernels<ElemType>();
+    if (!kernels || !(N == 2 ? CPUVectorKernels::IsVectorizedUnaryOp(op) : CPUVectorKernels::IsVectorizedBinaryOp(op)))
+        return false;
+    for (size_t i = 0; i < N; i++)
+        pointers[i] += offsets[i];
+    const ElemType* pa = pointers[0];
+    const ElemType* pb = N == 3 ? pointers[1] : nullptr;
+    ElemType* pc = pointers[N - 1];
+    const size_t rank = regularOpDims.size();
+
+    if (reducingOpDims.empty())
+    {
+        if (rank == 0 || rank > 2)
+            return false;
+        for (size_t i = 0; i < N; i++)
+        {
+            if (regularStrides[i][0] != 1)
+                return false;
+        }
+        const size_t numRows = regularOpDims[0];
+        const size_t numCols = rank == 2 ? regularOpDims[1] : 1;
+        const size_t chunksPerCol = (numRows + vectorizedChunkSize - 1) / vectorizedChunkSize;
+        const size_t numChunks = chunksPerCol * numCols;
+#pragma omp parallel for if (numChunks > 1)
+        for (ptrdiff_t chunk = 0; chunk < (ptrdiff_t) numChunks; chunk++)
+        {
+            size_t j = chunk / chunksPerCol;
+            size_t begin = (chunk % chunksPerCol) * vectorizedChunkSize;
+            array<ptrdiff_t, N> index;
+            for (size_t i = 0; i < N; i++)
+                index[i] = begin + (rank == 2 ? j * regularStrides[i][1] : 0);
+            kernels->elementwiseOp(op, beta, pa + index[0], pb ? pb + index[1] : nullptr, pc + index[N - 1], min(vectorizedChunkSize, numRows - begin), alpha);
+        }
+        return true;
+    }
+
+    // reduction
+    if (N != 2 || op != opCopy || reducingOpDims.size() != 1)
+        return false;
+    const size_t numReduced = reducingOpDims[0];
+    const ptrdiff_t reducingStride = reducingStrides[0][0];
+    if (rank == 0 && reducingStride == 1) // sum over a vector
+    {
+        kernels->reduceSum(beta, pa, numReduced, pc, alpha);
+        return true;
+    }
+    else if (rank == 1 && regularStrides[0][0] == 1 && regularStrides[N - 1][0] == 1) // sum over columns
+    {
+        const size_t numRows = regularOpDims[0];
+        const size_t rowsPerChunk = max((size_t) 64, vectorizedChunkSize / max(numReduced, (size_t) 1)) & ~(size_t) 63; // (keep chunks on cache-line boundaries)
+        const size_t numChunks = (numRows + rowsPerChunk - 1) / rowsPerChunk;
+#pragma omp parallel for if (numChunks > 1)
+        for (ptrdiff_t chunk = 0; chunk < (ptrdiff_t) numChunks; chunk++)
+        {
+            size_t begin = chunk * rowsPerChunk;
+            kernels->reduceSumOverColumns(beta, pa + begin, reducingStride, numReduced, pc + begin, min(rowsPerChunk, numRows - begin), alpha);
+        }
+        return true;
+    }
+    return false;
+}
+
 // -----------------------------------------------------------------------
 // entry points from Matrix.cpp; also map op to a lambda
 // -----------------------------------------------------------------------
@@ -5722,6 +5914,8 @@ void CPUMatrix<ElemType>::TensorOp(ElemType beta, const CPUMatrix<ElemType>& a,
                               offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides)
 
     array<ElemType*, 2> pointers = {a.m_pArray, m_pArray};
+    if (TensorOpVectorized(beta, pointers, alpha, op, offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides))
+        return;
     switch (op)
     {
         ForAllUnaryOps(CaseUnaryTensorOp);
@@ -5747,6 +5941,8 @@ void CPUMatrix<ElemType>::TensorOp(ElemType beta, const CPUMatrix<ElemType>& a,
                               offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides)
 
     array<ElemType*, 3> pointers = {a.m_pArray, b.m_pArray, m_pArray};
+    if (TensorOpVectorized(beta, pointers, alpha, op, offsets, regularOpDims, regularStrides, reducingOpDims, reducingStrides))
+        return;
     switch (op)
     {
         ForAllBinaryOps(CaseBinaryTensorOp);
@@ -5780,6 +5976,476 @@ void CPUMatrix<ElemType>::TensorOp(ElemType beta, const CPUMatrix<ElemType>& a,
     }
 }
 
+// =======================================================================
+// fused elementwise evaluation (see FusedElementwiseProgram in CommonMatrix.h)
+// =======================================================================
+
+// The [rows x cols] region is processed in tiles of up to fusedBlockSize rows of one column.
+// Each step of the program is run over a whole tile, so that the switch over the op code stays
+// outside the innermost loop (which can then be vectorized), while all intermediate results
+// remain in the cache. This way each input is read once and the result is written once.
+static const size_t fusedBlockSize = 256;
+
+// run all steps of 'program' over one tile of 'n' elements; regs[r] points to the tile of register r
+template <class ElemType>
+static void FusedForwardTile(const FusedElementwiseProgram& program, ElemType* const* regs, size_t n)
+{
+#define CaseFusedUnaryOp(oper)         \
+    case op##oper:                     \
+        for (size_t i = 0; i < n; i++) \
+            c[i] = Op##oper(a[i]);     \
+        break;
+#define CaseFusedBinaryOp(oper)            \
+    case op##oper:                         \
+        for (size_t i = 0; i < n; i++)     \
+            c[i] = Op##oper(a[i], b[i]);   \
+        break;
+
+    for (size_t k = 0; k < program.m_steps.size(); k++)
+    {
+        const FusedElementwiseStep& step = program.m_steps[k];
+        const ElemType* a = regs[step.m_args[0]];
+        const ElemType* b = regs[step.m_args[1]];
+        ElemType* c = regs[program.m_numInputs + k];
+        switch (step.m_op)
+        {
+            ForAllFusableUnaryOps(CaseFusedUnaryOp);
+            ForAllFusableBinaryOps(CaseFusedBinaryOp);
+        default:
+            LogicError("FusedElementwiseForward: Op code %d cannot be fused.", (int) step.m_op);
+        }
+    }
+#undef CaseFusedUnaryOp
+#undef CaseFusedBinaryOp
+}
+
+// back-propagate the result gradient of one tile that was evaluated by FusedForwardTile() into its registers
+// Gradients are accumulated into grads[r], but only for registers with needsGradient[r] set.
+template <class ElemType>
+static void FusedBackwardTile(const FusedElementwiseProgram& program, ElemType* const* values, ElemType* const* grads, const vector<char>& needsGradient, size_t n)
+{
+    for (size_t k = program.m_steps.size(); k-- > 0;)
+    {
+        const size_t r = program.m_numInputs + k;
+        if (!needsGradient[r])
+            continue;
+        const FusedElementwiseStep& step = program.m_steps[k];
+        const ElemType* g = grads[r];
+        const ElemType* y = values[r];
+        const ElemType* a = values[step.m_args[0]];
+        const ElemType* b = values[step.m_args[1]];
+        ElemType* ga = needsGradient[step.m_args[0]] ? grads[step.m_args[0]] : nullptr;
+        ElemType* gb = needsGradient[step.m_args[1]] ? grads[step.m_args[1]] : nullptr;
+        // the derivatives are the same op codes the corresponding ComputationNodes use in BackpropTo()
+        switch (step.m_op)
+        {
+        case opSigmoid:
+            for (size_t i = 0; i < n; i++)
+                ga[i] += OpElementwiseProductWithSigmoidDerivativeFromOutput(g[i], y[i]);
+            break;
+        case opTanh:
+            for (size_t i = 0; i < n; i++)
+                ga[i] += OpElementwiseProductWithTanhDerivativeFromOutput(g[i], y[i]);
+            break;
+        case opExp:
+            for (size_t i = 0; i < n; i++)
+                ga[i] += OpElementwiseProduct(g[i], y[i]);
+            break;
+        case opLog:
+            for (size_t i = 0; i < n; i++)
+                ga[i] += OpElementwiseProductWithLogDerivativeFromOutput(g[i], y[i]);
+            break;
+        case opLinearRectifier:
+            for (size_t i = 0; i < n; i++)
+                ga[i] += OpElementwiseProductWithLinearRectifierDerivativeFromOutput(g[i], y[i]);
+            break;
+        case opCosine:
+            for (size_t i = 0; i < n; i++)
+                ga[i] += OpElementwiseProductWithCosDerivative(g[i], a[i]);
+            break;
+        case opSum:
+            if (ga)
+                for (size_t i = 0; i < n; i++)
+                    ga[i] += g[i];
+            if (gb)
+                for (size_t i = 0; i < n; i++)
+                    gb[i] += g[i];
+            break;
+        case opDifference:
+            if (ga)
+                for (size_t i = 0; i < n; i++)
+                    ga[i] += g[i];
+            if (gb)
+                for (size_t i = 0; i < n; i++)
+                    gb[i] -= g[i];
+            break;
+        case opElementwiseProduct:
+            if (ga)
+                for (size_t i = 0; i < n; i++)
+                    ga[i] += g[i] * b[i];
+            if (gb)
+                for (size_t i = 0; i < n; i++)
+                    gb[i] += g[i] * a[i];
+            break;
+        default:
+            LogicError("FusedElementwiseBackward: Op code %d cannot be fused.", (int) step.m_op);
+        }
+    }
+}
+
+// verify that 'inputs' can be combined into a [rows x cols] result; inputs with a single column are broadcast
+template <class ElemType>
+static void VerifyFusedOperands(const FusedElementwiseProgram& program, const vector<const CPUMatrix<ElemType>*>& inputs, size_t rows, size_t cols)
+{
+    if (program.m_steps.empty() || inputs.size() != program.m_numInputs)
+        InvalidArgument("FusedElementwise: Program expects %d inputs and at least one step, but got %d inputs and %d steps.",
+                        (int) program.m_numInputs, (int) inputs.size(), (int) program.m_steps.size());
+    for (size_t k = 0; k < program.m_steps.size(); k++)
+    {
+        const FusedElementwiseStep& step = program.m_steps[k];
+        if (step.m_args[0] >= program.m_numInputs + k || step.m_args[1] >= program.m_numInputs + k)
+            InvalidArgument("FusedElementwise: Step %d reads a register that has not been computed yet.", (int) k);
+    }
+    for (const auto* input : inputs)
+    {
+        if (input->GetNumRows() != rows || (input->GetNumCols() != cols && input->GetNumCols() != 1))
+            InvalidArgument("FusedElementwise: Input dimensions [%d x %d] are incompatible with the result dimensions [%d x %d].",
+                            (int) input->GetNumRows(), (int) input->GetNumCols(), (int) rows, (int) cols);
+    }
+}
+
+// result = program(inputs)
+// The result must already have its final dimensions.
+template <class ElemType>
+void CPUMatrix<ElemType>::FusedElementwiseForward(const FusedElementwiseProgram& program, const vector<const CPUMatrix<ElemType>*>& inputs, CPUMatrix<ElemType>& result)
+{
+    const size_t rows = result.GetNumRows();
+    const size_t cols = result.GetNumCols();
+    VerifyFusedOperands(program, inputs, rows, cols);
+
+    const size_t numInputs = program.m_numInputs;
+    const size_t numSteps = program.m_steps.size();
+    const size_t numRowBlocks = (rows + fusedBlockSize - 1) / fusedBlockSize;
+    const long long numTiles = (long long) (numRowBlocks * cols);
+
+#pragma omp parallel
+    {
+        vector<ElemType> scratch((numSteps - 1) * fusedBlockSize); // the last step writes directly into the result
+        vector<ElemType*> regs(numInputs + numSteps);
+        for (size_t k = 0; k + 1 < numSteps; k++)
+            regs[numInputs + k] = scratch.data() + k * fusedBlockSize;
+
+#pragma omp for
+        for (long long tile = 0; tile < numTiles; tile++)
+        {
+            const size_t i0 = (tile % numRowBlocks) * fusedBlockSize;
+            const size_t j = tile / numRowBlocks;
+            const size_t n = min(fusedBlockSize, rows - i0);
+            for (size_t r = 0; r < numInputs; r++)
+                regs[r] = inputs[r]->m_pArray + (inputs[r]->GetNumCols() == 1 ? 0 : j * rows) + i0;
+            regs[numInputs + numSteps - 1] = result.m_pArray + j * rows + i0;
+            FusedForwardTile(program, regs.data(), n);
+        }
+    }
+}
+
+// inputGradients[r] += d result / d inputs[r] * resultGradient, for all r where inputGradients[r] is not null
+// The inputs must be the ones the result was computed from; intermediate values are recomputed on the fly.
+// The gradient of a broadcast input is summed over all columns.
+template <class ElemType>
+void CPUMatrix<ElemType>::FusedElementwiseBackward(const FusedElementwiseProgram& program, const vector<const CPUMatrix<ElemType>*>& inputs,
+                                                   const CPUMatrix<ElemType>& resultGradient, const vector<CPUMatrix<ElemType>*>& inputGradients)
+{
+    const size_t rows = resultGradient.GetNumRows();
+    const size_t cols = resultGradient.GetNumCols();
+    VerifyFusedOperands(program, inputs, rows, cols);
+    if (inputGradients.size() != inputs.size())
+        InvalidArgument("FusedElementwiseBackward: Got %d input gradients for %d inputs.", (int) inputGradients.size(), (int) inputs.size());
+
+    const size_t numInputs = program.m_numInputs;
+    const size_t numSteps = program.m_steps.size();
+    const size_t numRegs = program.GetNumRegisters();
+
+    // determine which registers lie on a path to an input that needs a gradient
+    vector<char> needsGradient(numRegs, 0);
+    bool hasBroadcastGradient = false;
+    for (size_t r = 0; r < numInputs; r++)
+    {
+        if (!inputGradients[r])
+            continue;
+        if (inputGradients[r]->GetNumRows() != inputs[r]->GetNumRows() || inputGradients[r]->GetNumCols() != inputs[r]->GetNumCols())
+            InvalidArgument("FusedElementwiseBackward: Gradient dimensions of input %d do not match its value.", (int) r);
+        needsGradient[r] = 1;
+        hasBroadcastGradient |= (inputs[r]->GetNumCols() == 1 && cols != 1);
+    }
+    for (size_t k = 0; k < numSteps; k++)
+    {
+        const FusedElementwiseStep& step = program.m_steps[k];
+        needsGradient[numInputs + k] = needsGradient[step.m_args[0]] || (FusedElementwiseProgram::IsFusableBinaryOp(step.m_op) && needsGradient[step.m_args[1]]);
+    }
+    if (!needsGradient[numRegs - 1])
+        return;
+
+    // A broadcast gradient is a sum over columns. To not need atomics, we then let each thread own a
+    // range of rows and loop over all columns, instead of distributing individual tiles.
+    const size_t numRowBlocks = (rows + fusedBlockSize - 1) / fusedBlockSize;
+    const size_t numColGroups = hasBroadcastGradient ? 1 : cols;
+    const long long numWorkItems = (long long) (numRowBlocks * numColGroups);
+
+#pragma omp parallel
+    {
+        vector<ElemType> valueScratch(numSteps * fusedBlockSize);
+        vector<ElemType> gradScratch(numRegs * fusedBlockSize);
+        vector<ElemType*> values(numRegs);
+        vector<ElemType*> grads(numRegs);
+        for (size_t k = 0; k < numSteps; k++)
+            values[numInputs + k] = valueScratch.data() + k * fusedBlockSize;
+
+#pragma omp for
+        for (long long item = 0; item < numWorkItems; item++)
+        {
+            const size_t i0 = (item % numRowBlocks) * fusedBlockSize;
+            const size_t colBegin = hasBroadcastGradient ? 0 : item / numRowBlocks;
+            const size_t colEnd = hasBroadcastGradient ? cols : colBegin + 1;
+            const size_t n = min(fusedBlockSize, rows - i0);
+
+            // broadcast gradients are summed in the scratch area over all columns, and added in the end
+            for (size_t r = 0; r < numInputs; r++)
+            {
+                grads[r] = gradScratch.data() + r * fusedBlockSize;
+                if (needsGradient[r] && inputs[r]->GetNumCols() == 1 && cols != 1)
+                    memset(grads[r], 0, n * sizeof(ElemType));
+            }
+
+            for (size_t j = colBegin; j < colEnd; j++)
+            {
+                for (size_t r = 0; r < numInputs; r++)
+                {
+                    bool isBroadcast = inputs[r]->GetNumCols() == 1 && cols != 1;
+                    values[r] = inputs[r]->m_pArray + (isBroadcast ? 0 : j * rows) + i0;
+                    if (needsGradient[r] && !isBroadcast)
+                        grads[r] = inputGradients[r]->m_pArray + j * rows + i0; // accumulate in place
+                }
+                for (size_t k = 0; k + 1 < numSteps; k++)
+                {
+                    grads[numInputs + k] = gradScratch.data() + (numInputs + k) * fusedBlockSize;
+                    if (needsGradient[numInputs + k])
+                        memset(grads[numInputs + k], 0, n * sizeof(ElemType));
+                }
+                grads[numRegs - 1] = resultGradient.m_pArray + j * rows + i0; // only read
+
+                FusedForwardTile(program, values.data(), n);
+                FusedBackwardTile(program, values.data(), grads.data(), needsGradient, n);
+            }
+
+            for (size_t r = 0; r < numInputs; r++)
+            {
+                if (needsGradient[r] && inputs[r]->GetNumCols() == 1 && cols != 1)
+                {
+                    ElemType* inputGradient = inputGradients[r]->m_pArray + i0;
+                    for (size_t i = 0; i < n; i++)
+                        inputGradient[i] += grads[r][i];
+                }
+            }
+        }
+    }
+}
+
+// =======================================================================
+// recurrent cells (see LSTMNode and GRUNode in RecurrentNodes.h)
+// =======================================================================
+
+// These compute one time step of a recurrent layer for all parallel sequences (one column each),
+// after the matrix products with the weights have been done by the caller. Everything else the
+// cell does is done here in a single pass. The element-wise functions are the same as those of
+// the corresponding nodes (Sigmoid(), tanh_()), so that results match a network built from them.
+// Rows are distributed over threads, so that the peephole gradients need no atomics.
+
+static void VerifyRecurrentCellDims(const char* function, const char* what, size_t rows, size_t cols, size_t expectedRows, size_t expectedCols)
+{
+    if (rows != expectedRows || cols != expectedCols)
+        InvalidArgument("%s: %s has dimensions [%d x %d], expected [%d x %d].", function, what, (int) rows, (int) cols, (int) expectedRows, (int) expectedCols);
+}
+
+// LSTM cell with peephole connections, for cellDim = prevCell.GetNumRows()
+//  - gates: [4 cellDim x numSeq] in: pre-activations W x + b + R h(t-1), row blocks are [input gate; cell input; forget gate; output gate]
+//           out: the corresponding activations
+//  - peepholes: [cellDim x 3], the diagonal weights from the cell into the input, forget and output gates
+//  - cell = f .* prevCell + i .* g, cellOutput = o .* tanh(cell)
+template <class ElemType>
+void CPUMatrix<ElemType>::LSTMCellForward(CPUMatrix<ElemType>& gates, const CPUMatrix<ElemType>& prevCell, const CPUMatrix<ElemType>& peepholes,
+                                          CPUMatrix<ElemType>& cell, CPUMatrix<ElemType>& cellOutput)
+{
+    const size_t cellDim = prevCell.GetNumRows();
+    const size_t numSeq = prevCell.GetNumCols();
+    VerifyRecurrentCellDims("LSTMCellForward", "gates", gates.GetNumRows(), gates.GetNumCols(), 4 * cellDim, numSeq);
+    VerifyRecurrentCellDims("LSTMCellForward", "peepholes", peepholes.GetNumRows(), peepholes.GetNumCols(), cellDim, 3);
+    VerifyRecurrentCellDims("LSTMCellForward", "cell", cell.GetNumRows(), cell.GetNumCols(), cellDim, numSeq);
+    VerifyRecurrentCellDims("LSTMCellForward", "cellOutput", cellOutput.GetNumRows(), cellOutput.GetNumCols(), cellDim, numSeq);
+
+    const ElemType* pci = peepholes.m_pArray;
+    const ElemType* pcf = pci + cellDim;
+    const ElemType* pco = pcf + cellDim;
+#pragma omp parallel for
+    for (long k = 0; k < (long) cellDim; k++)
+    {
+        for (size_t j = 0; j < numSeq; j++)
+        {
+            ElemType* z = gates.m_pArray + j * 4 * cellDim + k;
+            const ElemType cp = prevCell.m_pArray[j * cellDim + k];
+            const ElemType i = Sigmoid(z[0] + pci[k] * cp);
+            const ElemType g = tanh_(z[cellDim]);
+            const ElemType f = Sigmoid(z[2 * cellDim] + pcf[k] * cp);
+            const ElemType c = f * cp + i * g;
+            const ElemType o = Sigmoid(z[3 * cellDim] + pco[k] * c);
+            z[0] = i;
+            z[cellDim] = g;
+            z[2 * cellDim] = f;
+            z[3 * cellDim] = o;
+            cell.m_pArray[j * cellDim + k] = c;
+            cellOutput.m_pArray[j * cellDim + k] = o * tanh_(c);
+        }
+    }
+}
+
+// backprop through LSTMCellForward()
+//  - gates, prevCell, cell: as computed by LSTMCellForward()
+//  - cellOutputGradient: gradient of cellOutput
+//  - cellGradient: in: gradient of cell coming from the next time step (0 if none); out: gradient of prevCell
+//  - gatesGradient: gradient of the gate pre-activations (assigned)
+//  - peepholesGradient: gradient of the peepholes (accumulated)
+template <class ElemType>
+void CPUMatrix<ElemType>::LSTMCellBackward(const CPUMatrix<ElemType>& gates, const CPUMatrix<ElemType>& prevCell, const CPUMatrix<ElemType>& cell, const CPUMatrix<ElemType>& peepholes,
+                                           const CPUMatrix<ElemType>& cellOutputGradient, CPUMatrix<ElemType>& cellGradient, CPUMatrix<ElemType>& gatesGradient, CPUMatrix<ElemType>& peepholesGradient)
+{
+    const size_t cellDim = prevCell.GetNumRows();
+    const size_t numSeq = prevCell.GetNumCols();
+    VerifyRecurrentCellDims("LSTMCellBackward", "gates", gates.GetNumRows(), gates.GetNumCols(), 4 * cellDim, numSeq);
+    VerifyRecurrentCellDims("LSTMCellBackward", "cell", cell.GetNumRows(), cell.GetNumCols(), cellDim, numSeq);
+    VerifyRecurrentCellDims("LSTMCellBackward", "peepholes", peepholes.GetNumRows(), peepholes.GetNumCols(), cellDim, 3);
+    VerifyRecurrentCellDims("LSTMCellBackward", "cellOutputGradient", cellOutputGradient.GetNumRows(), cellOutputGradient.GetNumCols(), cellDim, numSeq);
+    VerifyRecurrentCellDims("LSTMCellBackward", "cellGradient", cellGradient.GetNumRows(), cellGradient.GetNumCols(), cellDim, numSeq);
+    VerifyRecurrentCellDims("LSTMCellBackward", "gatesGradient", gatesGradient.GetNumRows(), gatesGradient.GetNumCols(), 4 * cellDim, numSeq);
+    VerifyRecurrentCellDims("LSTMCellBackward", "peepholesGradient", peepholesGradient.GetNumRows(), peepholesGradient.GetNumCols(), cellDim, 3);
+
+    const ElemType* pci = peepholes.m_pArray;
+    const ElemType* pcf = pci + cellDim;
+    const ElemType* pco = pcf + cellDim;
+    ElemType* dpci = peepholesGradient.m_pArray;
+    ElemType* dpcf = dpci + cellDim;
+    ElemType* dpco = dpcf + cellDim;
+#pragma omp parallel for
+    for (long k = 0; k < (long) cellDim; k++)
+    {
+        for (size_t j = 0; j < numSeq; j++)
+        {
+            const ElemType* a = gates.m_pArray + j * 4 * cellDim + k;
+            ElemType* dz = gatesGradient.m_pArray + j * 4 * cellDim + k;
+            const ElemType i = a[0];
+            const ElemType g = a[cellDim];
+            const ElemType f = a[2 * cellDim];
+            const ElemType o = a[3 * cellDim];
+            const ElemType cp = prevCell.m_pArray[j * cellDim + k];
+            const ElemType c = cell.m_pArray[j * cellDim + k];
+            const ElemType tc = tanh_(c);
+            const ElemType dm = cellOutputGradient.m_pArray[j * cellDim + k];
+            ElemType& dc = cellGradient.m_pArray[j * cellDim + k];
+
+            const ElemType dzo = dm * tc * o * (1 - o);
+            const ElemType dcTotal = dc + dm * o * (1 - tc * tc) + dzo * pco[k];
+            const ElemType dzi = dcTotal * g * i * (1 - i);
+            const ElemType dzg = dcTotal * i * (1 - g * g);
+            const ElemType dzf = dcTotal * cp * f * (1 - f);
+            dz[0] = dzi;
+            dz[cellDim] = dzg;
+            dz[2 * cellDim] = dzf;
+            dz[3 * cellDim] = dzo;
+            dc = dcTotal * f + dzi * pci[k] + dzf * pcf[k];
+            dpci[k] += dzi * cp;
+            dpcf[k] += dzf * cp;
+            dpco[k] += dzo * c;
+        }
+    }
+}
+
+// GRU cell, for outputDim = prevOutput.GetNumRows()
+//  - gates: [3 outputDim x numSeq] in: input pre-activations W x + b, row blocks are [reset gate; update gate; candidate]
+//           out: the corresponding activations r, z, n
+//  - recurrent: [3 outputDim x numSeq] R h(t-1), in the same row blocks
+//  - n = tanh(x_n + r .* recurrent_n), output = (1 - z) .* n + z .* prevOutput
+template <class ElemType>
+void CPUMatrix<ElemType>::GRUCellForward(CPUMatrix<ElemType>& gates, const CPUMatrix<ElemType>& recurrent, const CPUMatrix<ElemType>& prevOutput, CPUMatrix<ElemType>& output)
+{
+    const size_t outputDim = prevOutput.GetNumRows();
+    const size_t numSeq = prevOutput.GetNumCols();
+    VerifyRecurrentCellDims("GRUCellForward", "gates", gates.GetNumRows(), gates.GetNumCols(), 3 * outputDim, numSeq);
+    VerifyRecurrentCellDims("GRUCellForward", "recurrent", recurrent.GetNumRows(), recurrent.GetNumCols(), 3 * outputDim, numSeq);
+    VerifyRecurrentCellDims("GRUCellForward", "output", output.GetNumRows(), output.GetNumCols(), outputDim, numSeq);
+
+#pragma omp parallel for
+    for (long k = 0; k < (long) outputDim; k++)
+    {
+        for (size_t j = 0; j < numSeq; j++)
+        {
+            ElemType* x = gates.m_pArray + j * 3 * outputDim + k;
+            const ElemType* h = recurrent.m_pArray + j * 3 * outputDim + k;
+            const ElemType hp = prevOutput.m_pArray[j * outputDim + k];
+            const ElemType r = Sigmoid(x[0] + h[0]);
+            const ElemType z = Sigmoid(x[outputDim] + h[outputDim]);
+            const ElemType n = tanh_(x[2 * outputDim] + r * h[2 * outputDim]);
+            x[0] = r;
+            x[outputDim] = z;
+            x[2 * outputDim] = n;
+            output.m_pArray[j * outputDim + k] = (1 - z) * n + z * hp;
+        }
+    }
+}
+
+// backprop through GRUCellForward()
+//  - gates, recurrent, prevOutput: as used/computed by GRUCellForward()
+//  - gatesGradient: gradient of the input pre-activations (assigned)
+//  - recurrentGradient: gradient of recurrent (assigned)
+//  - prevOutputGradient: the part of the gradient of prevOutput that does not go through recurrent (assigned)
+template <class ElemType>
+void CPUMatrix<ElemType>::GRUCellBackward(const CPUMatrix<ElemType>& gates, const CPUMatrix<ElemType>& recurrent, const CPUMatrix<ElemType>& prevOutput, const CPUMatrix<ElemType>& outputGradient,
+                                          CPUMatrix<ElemType>& gatesGradient, CPUMatrix<ElemType>& recurrentGradient, CPUMatrix<ElemType>& prevOutputGradient)
+{
+    const size_t outputDim = prevOutput.GetNumRows();
+    const size_t numSeq = prevOutput.GetNumCols();
+    VerifyRecurrentCellDims("GRUCellBackward", "gates", gates.GetNumRows(), gates.GetNumCols(), 3 * outputDim, numSeq);
+    VerifyRecurrentCellDims("GRUCellBackward", "recurrent", recurrent.GetNumRows(), recurrent.GetNumCols(), 3 * outputDim, numSeq);
+    VerifyRecurrentCellDims("GRUCellBackward", "outputGradient", outputGradient.GetNumRows(), outputGradient.GetNumCols(), outputDim, numSeq);
+    VerifyRecurrentCellDims("GRUCellBackward", "gatesGradient", gatesGradient.GetNumRows(), gatesGradient.GetNumCols(), 3 * outputDim, numSeq);
+    VerifyRecurrentCellDims("GRUCellBackward", "recurrentGradient", recurrentGradient.GetNumRows(), recurrentGradient.GetNumCols(), 3 * outputDim, numSeq);
+    VerifyRecurrentCellDims("GRUCellBackward", "prevOutputGradient", prevOutputGradient.GetNumRows(), prevOutputGradient.GetNumCols(), outputDim, numSeq);
+
+#pragma omp parallel for
+    for (long k = 0; k < (long) outputDim; k++)
+    {
+        for (size_t j = 0; j < numSeq; j++)
+        {
+            const ElemType* a = gates.m_pArray + j * 3 * outputDim + k;
+            const ElemType* h = recurrent.m_pArray + j * 3 * outputDim + k;
+            ElemType* dx = gatesGradient.m_pArray + j * 3 * outputDim + k;
+            ElemType* dh = recurrentGradient.m_pArray + j * 3 * outputDim + k;
+            const ElemType r = a[0];
+            const ElemType z = a[outputDim];
+            const ElemType n = a[2 * outputDim];
+            const ElemType hp = prevOutput.m_pArray[j * outputDim + k];
+            const ElemType dout = outputGradient.m_pArray[j * outputDim + k];
+
+            const ElemType dzn = dout * (1 - z) * (1 - n * n);
+            const ElemType dzr = dzn * h[2 * outputDim] * r * (1 - r);
+            const ElemType dzz = dout * (hp - n) * z * (1 - z);
+            dx[0] = dh[0] = dzr;
+            dx[outputDim] = dh[outputDim] = dzz;
+            dx[2 * outputDim] = dzn;
+            dh[2 * outputDim] = dzn * r;
+            prevOutputGradient.m_pArray[j * outputDim + k] = dout * z;
+        }
+    }
+}
+
 // =======================================================================
 // explicit instantiations
 // =======================================================================
@@ -318,6 +318,8 @@ public:
 
 public:
     static int SetNumThreads(int numThreads); // note: this does not depend on <ElemType>, i.e. you can call it on any <ElemType>
+    static CPUVectorISA SetVectorISA(CPUVectorISA isa); // instruction set for TensorOp(), limited to what the CPU supports; returns the one in use. Does not depend on <ElemType> either.
+    static CPUVectorISA GetVectorISA();
 
     // static BLAS functions
     static void SVD(const CPUMatrix<ElemType>& A, CPUMatrix<ElemType>& SIGMA, CPUMatrix<ElemType>& U, CPUMatrix<ElemType>& VT, CPUMatrix<ElemType>& W);
@@ -364,6 +366,18 @@ public:
                   const SmallVector<size_t>& regularOpDims, const std::array<SmallVector<ptrdiff_t>, 4>& regularStrides,
                   const SmallVector<size_t>& reducingOpDims, const std::array<SmallVector<ptrdiff_t>, 4>& reducingStrides);
 
+    static void FusedElementwiseForward(const FusedElementwiseProgram& program, const std::vector<const CPUMatrix<ElemType>*>& inputs, CPUMatrix<ElemType>& result);
+    static void FusedElementwiseBackward(const FusedElementwiseProgram& program, const std::vector<const CPUMatrix<ElemType>*>& inputs,
+                                         const CPUMatrix<ElemType>& resultGradient, const std::vector<CPUMatrix<ElemType>*>& inputGradients);
+
+    static void LSTMCellForward(CPUMatrix<ElemType>& gates, const CPUMatrix<ElemType>& prevCell, const CPUMatrix<ElemType>& peepholes,
+                                CPUMatrix<ElemType>& cell, CPUMatrix<ElemType>& cellOutput);
+    static void LSTMCellBackward(const CPUMatrix<ElemType>& gates, const CPUMatrix<ElemType>& prevCell, const CPUMatrix<ElemType>& cell, const CPUMatrix<ElemType>& peepholes,
+                                 const CPUMatrix<ElemType>& cellOutputGradient, CPUMatrix<ElemType>& cellGradient, CPUMatrix<ElemType>& gatesGradient, CPUMatrix<ElemType>& peepholesGradient);
+    static void GRUCellForward(CPUMatrix<ElemType>& gates, const CPUMatrix<ElemType>& recurrent, const CPUMatrix<ElemType>& prevOutput, CPUMatrix<ElemType>& output);
+    static void GRUCellBackward(const CPUMatrix<ElemType>& gates, const CPUMatrix<ElemType>& recurrent, const CPUMatrix<ElemType>& prevOutput, const CPUMatrix<ElemType>& outputGradient,
+                                CPUMatrix<ElemType>& gatesGradient, CPUMatrix<ElemType>& recurrentGradient, CPUMatrix<ElemType>& prevOutputGradient);
+
     static CPUMatrix<ElemType> Ones(const size_t rows, const size_t cols);
     static CPUMatrix<ElemType> Zeros(const size_t rows, const size_t cols);
     static CPUMatrix<ElemType> Eye(const size_t rows);
@@ -393,17 +407,13 @@ public:
         size_t numRows, numCols;
         int format;
         stream >> matrixName >> format >> numRows >> numCols;
-        ElemType* d_array = new ElemType[numRows * numCols];
-        for (size_t i = 0; i < numRows * numCols; ++i)
-            stream >> d_array[i];
+        us.Resize(numRows, numCols);
+        stream.ReadArray(us.m_pArray, numRows * numCols); // read straight into the matrix
         stream.GetMarker(fileMarkerEndSection, std::wstring(L"EMAT"));
-        us.SetValue(numRows, numCols, d_array, matrixFlagNormal);
         if (us.m_matrixName)
             delete[] us.m_matrixName;
         us.m_matrixName = new wchar_t[matrixName.length() + 1];
         wmemcpy(us.m_matrixName, matrixName.c_str(), matrixName.length() + 1);
-
-        delete[] d_array;
         return stream;
     }
     friend File& operator<<(File& stream, const CPUMatrix<ElemType>& us)
@@ -416,8 +426,7 @@ public:
         stream << s << format;
 
         stream << us.m_numRows << us.m_numCols;
-        for (size_t i = 0; i < us.GetNumElements(); ++i)
-            stream << us.m_pArray[i];
+        stream.WriteArray(us.m_pArray, us.GetNumElements());
         stream.PutMarker(fileMarkerEndSection, std::wstring(L"EMAT"));
         return stream;
     }
@@ -0,0 +1,251 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUMemAllocator.cpp -- caching, aligned allocator for the element buffers of CPUMatrix
+//
+
+#include "stdafx.h"
+#include "Basics.h"
+#include "CPUMemAllocator.h"
+#include <omp.h>
+#include <string.h>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <stdlib.h>
+#include <sys/mman.h>
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+static const size_t minSizeClass = 64;
+static const size_t pageSize = 4096;
+static const size_t hugePageSize = 2 << 20;
+static const size_t minParallelZeroSize = 1 << 20; // below this, zeroing from multiple threads does not pay off
+
+CPUMemAllocator::CPUMemAllocator(const CPUMemAllocatorOptions& options)
+{
+    SetOptions(options);
+}
+
+CPUMemAllocator::~CPUMemAllocator()
+{
+    ReleaseCache(); // blocks still in use are owned by their matrices
+}
+
+// never destroyed, since static matrices may still free their buffers during exit
+/*static*/ CPUMemAllocator& CPUMemAllocator::Instance()
+{
+    static CPUMemAllocator* instance = new CPUMemAllocator();
+    return *instance;
+}
+
+void CPUMemAllocator::SetOptions(const CPUMemAllocatorOptions& options)
+{
+    if (options.alignment < sizeof(void*) || (options.alignment & (options.alignment - 1)) != 0)
+        InvalidArgument("CPUMemAllocator: Alignment must be a power of 2 and at least %d.", (int) sizeof(void*));
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ReleaseCacheLocked();
+    m_options = options;
+}
+
+CPUMemAllocatorOptions CPUMemAllocator::GetOptions() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_options;
+}
+
+// round up to one of 4 classes per power of 2: 2^k, 1.25 * 2^k, 1.5 * 2^k, 1.75 * 2^k
+size_t CPUMemAllocator::SizeClass(size_t size) const
+{
+    if (size <= minSizeClass)
+        return minSizeClass;
+    size_t pow2 = minSizeClass;
+    while (pow2 < size / 2)
+        pow2 *= 2;
+    size_t step = std::max(pow2 / 4, minSizeClass);
+    return (size + step - 1) / step * step;
+}
+
+size_t CPUMemAllocator::AlignmentFor(size_t capacity) const
+{
+    size_t alignment = m_options.alignment;
+    if (capacity >= pageSize)
+        alignment = std::max(alignment, pageSize);
+    if (m_options.hugePages && capacity >= hugePageSize)
+        alignment = std::max(alignment, hugePageSize);
+    return alignment;
+}
+
+// zero a block; in parallel using OpenMP's static partitioning, so that each page is first touched
+// by the thread that processes that part of the buffer in the (statically scheduled) matrix loops
+/*static*/ void CPUMemAllocator::Zero(void* p, size_t size, bool parallel)
+{
+    if (!parallel)
+    {
+        memset(p, 0, size);
+        return;
+    }
+#pragma omp parallel
+    {
+        size_t numThreads = omp_get_num_threads();
+        size_t thread = omp_get_thread_num();
+        size_t begin = size * thread / numThreads;
+        size_t end = size * (thread + 1) / numThreads;
+        memset((char*) p + begin, 0, end - begin);
+    }
+}
+
+void* CPUMemAllocator::AllocateFromSystem(size_t capacity, size_t alignment, bool& zeroed)
+{
+    void* p;
+#ifdef _WIN32
+    p = _aligned_malloc(capacity, alignment);
+#else
+    if (posix_memalign(&p, alignment, capacity) != 0)
+        p = nullptr;
+#endif
+    if (!p)
+        return nullptr;
+#if !defined(_WIN32) && defined(MADV_HUGEPAGE)
+    if (m_options.hugePages && capacity >= hugePageSize)
+        madvise(p, capacity / hugePageSize * hugePageSize, MADV_HUGEPAGE); // only a hint; failure is harmless
+#endif
+    zeroed = m_options.firstTouch && capacity >= minParallelZeroSize;
+    if (zeroed)
+        Zero(p, capacity, /*parallel=*/true);
+    return p;
+}
+
+/*static*/ void CPUMemAllocator::FreeToSystem(void* p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+void* CPUMemAllocator::Allocate(size_t size, bool zero)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    size_t capacity = SizeClass(size);
+    size_t alignment = AlignmentFor(capacity);
+    m_stats.numAllocations++;
+
+    void* p = nullptr;
+    bool zeroed = false;
+    auto freeList = m_freeLists.find(capacity);
+    if (freeList != m_freeLists.end() && !freeList->second.empty())
+    {
+        p = freeList->second.back();
+        freeList->second.pop_back();
+        m_stats.numCacheHits++;
+        m_stats.bytesCached -= capacity;
+    }
+    else
+    {
+        lock.unlock(); // (the system allocator is thread-safe, and first touch may take a while)
+        p = AllocateFromSystem(capacity, alignment, zeroed);
+        lock.lock();
+        if (!p) // out of memory: retry without the cache
+        {
+            ReleaseCacheLocked();
+            p = AllocateFromSystem(capacity, alignment, zeroed);
+            if (!p)
+                throw std::bad_alloc();
+        }
+        m_stats.bytesReserved += capacity;
+        m_stats.peakBytesReserved = std::max(m_stats.peakBytesReserved, m_stats.bytesReserved);
+    }
+    m_blocksInUse[p] = Block{capacity, alignment};
+    m_stats.bytesInUse += capacity;
+    m_stats.peakBytesInUse = std::max(m_stats.peakBytesInUse, m_stats.bytesInUse);
+    lock.unlock();
+
+    if (zero && !zeroed)
+        Zero(p, size, size >= minParallelZeroSize);
+    return p;
+}
+
+void* CPUMemAllocator::Malloc(size_t size)
+{
+    return Allocate(size, /*zero=*/false);
+}
+
+void* CPUMemAllocator::MallocZeroed(size_t size)
+{
+    return Allocate(size, /*zero=*/true);
+}
+
+void CPUMemAllocator::Free(void* p)
+{
+    if (!p)
+        return;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto iter = m_blocksInUse.find(p);
+    if (iter == m_blocksInUse.end())
+        LogicError("CPUMemAllocator: Attempted to free a block that was not allocated by this allocator.");
+    Block block = iter->second;
+    m_blocksInUse.erase(iter);
+    m_stats.bytesInUse -= block.capacity;
+
+    // keep the block unless options changed since it was allocated
+    if (m_options.cache && block.alignment >= AlignmentFor(block.capacity) &&
+        m_stats.bytesCached + block.capacity <= m_options.maxCachedBytes)
+    {
+        m_freeLists[block.capacity].push_back(p);
+        m_stats.bytesCached += block.capacity;
+    }
+    else
+    {
+        m_stats.bytesReserved -= block.capacity;
+        lock.unlock();
+        FreeToSystem(p);
+    }
+}
+
+void CPUMemAllocator::ReleaseCache()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ReleaseCacheLocked();
+}
+
+void CPUMemAllocator::ReleaseCacheLocked()
+{
+    for (auto& freeList : m_freeLists)
+        for (void* p : freeList.second)
+            FreeToSystem(p);
+    m_freeLists.clear();
+    m_stats.bytesReserved -= m_stats.bytesCached;
+    m_stats.bytesCached = 0;
+}
+
+CPUMemAllocatorStatistics CPUMemAllocator::GetStatistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void CPUMemAllocator::ResetStatistics()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.numAllocations = 0;
+    m_stats.numCacheHits = 0;
+    m_stats.peakBytesInUse = m_stats.bytesInUse;
+    m_stats.peakBytesReserved = m_stats.bytesReserved;
+}
+
+void CPUMemAllocator::PrintStatistics(FILE* f, const char* prefix) const
+{
+    CPUMemAllocatorStatistics stats = GetStatistics();
+    const double MB = 1024.0 * 1024.0;
+    fprintf(f, "%s: CPU memory: %.1f MB in use (peak %.1f MB), %.1f MB cached, %.1f MB reserved (peak %.1f MB); %llu allocations, %.1f%% served from cache\n",
+            prefix, stats.bytesInUse / MB, stats.peakBytesInUse / MB, stats.bytesCached / MB, stats.bytesReserved / MB, stats.peakBytesReserved / MB,
+            (unsigned long long) stats.numAllocations, 100 * stats.CacheHitRate());
+}
+} } }
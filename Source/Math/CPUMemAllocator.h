@@ -0,0 +1,101 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUMemAllocator.h -- caching, aligned allocator for the element buffers of CPUMatrix
+//
+
+#pragma once
+
+#include "MemAllocator.h"
+#include <stdio.h>
+#include <stddef.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+struct CPUMemAllocatorOptions
+{
+    bool cache = true;                  // keep freed blocks in per-size-class free lists for reuse
+    size_t maxCachedBytes = 4ull << 30; // freed blocks beyond this are returned to the system
+    size_t alignment = 64;              // minimum alignment of every block (a power of 2, at least a cache line)
+    bool hugePages = false;             // Linux: back blocks of 2 MB and more by transparent huge pages
+    bool firstTouch = true;             // zero fresh large blocks from all OpenMP threads, placing their pages on the NUMA node of the thread that will process them
+    bool traceStatistics = false;       // print the statistics at the end of each epoch
+};
+
+struct CPUMemAllocatorStatistics
+{
+    size_t numAllocations = 0; // calls to Malloc()
+    size_t numCacheHits = 0;   // ...of which were served from a free list
+    size_t bytesInUse = 0;     // capacity of the blocks currently handed out
+    size_t peakBytesInUse = 0;
+    size_t bytesCached = 0;    // capacity of the blocks held in the free lists
+    size_t bytesReserved = 0;  // bytesInUse + bytesCached, i.e. what we hold from the system
+    size_t peakBytesReserved = 0;
+
+    double CacheHitRate() const
+    {
+        return numAllocations > 0 ? (double) numCacheHits / numAllocations : 0;
+    }
+};
+
+// -----------------------------------------------------------------------
+// CPUMemAllocator -- allocator used by CPUMatrix for its element buffers.
+// Block sizes are rounded up to size classes (4 per power of 2, i.e. at most 25% waste),
+// and freed blocks are kept in a free list per class, since nodes create and resize temporary
+// matrices of the same few sizes in every minibatch.
+// All blocks are aligned to at least a cache line, blocks of a page or more to a page.
+// Thread-safe.
+// -----------------------------------------------------------------------
+
+class MATH_API CPUMemAllocator : public MemAllocator
+{
+public:
+    CPUMemAllocator(const CPUMemAllocatorOptions& options = CPUMemAllocatorOptions());
+    ~CPUMemAllocator();
+
+    void* Malloc(size_t size) override;
+    void Free(void* p) override;
+
+    // like Malloc() but zero-initialized; fresh large blocks are zeroed in parallel for first-touch placement
+    void* MallocZeroed(size_t size);
+
+    // changing the options releases the cache; blocks in use remain valid
+    void SetOptions(const CPUMemAllocatorOptions& options);
+    CPUMemAllocatorOptions GetOptions() const;
+
+    // return all cached blocks to the system
+    void ReleaseCache();
+
+    CPUMemAllocatorStatistics GetStatistics() const;
+    void ResetStatistics(); // resets counters and peaks, not the current sizes
+    void PrintStatistics(FILE* f, const char* prefix) const;
+
+    // the allocator instance used by CPUMatrix
+    static CPUMemAllocator& Instance();
+
+private:
+    struct Block
+    {
+        size_t capacity;
+        size_t alignment;
+    };
+
+    void* Allocate(size_t size, bool zero);
+    size_t SizeClass(size_t size) const;
+    size_t AlignmentFor(size_t capacity) const;
+    void* AllocateFromSystem(size_t capacity, size_t alignment, bool& zeroed);
+    static void FreeToSystem(void* p);
+    void ReleaseCacheLocked();
+    static void Zero(void* p, size_t size, bool parallel);
+
+    CPUMemAllocatorOptions m_options;
+    CPUMemAllocatorStatistics m_stats;
+    std::unordered_map<void*, Block> m_blocksInUse;
+    std::unordered_map<size_t, std::vector<void*>> m_freeLists; // [capacity] -> cached blocks
+    mutable std::mutex m_mutex;
+};
+} } }
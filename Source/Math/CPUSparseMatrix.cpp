@@ -482,6 +482,31 @@ CPUMatrix<ElemType> CPUSparseMatrix<ElemType>::CopyColumnSliceToDense(size_t sta
     return slice;
 }
 
+// set the stored elements of the columns whose mask is 0 to 'val'
+// The sparsity structure is kept, so this is exact for val == 0, which is what masking gaps in a minibatch uses.
+// Works on column slices, since m_compIndex always indexes m_pArray.
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::MaskColumnsValue(const CPUMatrix<char>& columnsMask, ElemType val)
+{
+    if (GetNumCols() != columnsMask.GetNumCols())
+        RuntimeError("Matrix and column mask must have equal number of columns");
+
+    if (m_format != MatrixFormat::matrixFormatSparseCSC)
+        NOT_IMPLEMENTED;
+
+#pragma omp parallel for
+    for (long j = 0; j < (long) m_numCols; j++)
+    {
+        if (columnsMask(0, j) == 1)
+            continue;
+
+        long start = (long) m_compIndex[j];
+        long end = (long) m_compIndex[j + 1];
+        for (long p = start; p < end; p++)
+            m_pArray[(size_t) p] = val;
+    }
+}
+
 template <class ElemType>
 CPUMatrix<ElemType> CPUSparseMatrix<ElemType>::DiagonalToDense() const
 {
@@ -612,6 +637,49 @@ void CPUSparseMatrix<ElemType>::Resize(const size_t numRows, const size_t numCol
     }
 }
 
+// reinterpret the elements in column-major order as a numRows x numCols matrix, like CPUMatrix::Reshape(); CSC only
+// Element (i, j) goes to linear index j * m_numRows + i, which increases in the CSC order, so the values stay where they are;
+// only the row indices and the column starts change.
+template <class ElemType>
+void CPUSparseMatrix<ElemType>::Reshape(const size_t numRows, const size_t numCols)
+{
+    if (!OwnBuffer())
+        LogicError("CPUSparseMatrix::Reshape: Cannot Reshape since the buffer is managed externally.");
+
+    if (m_numRows == numRows && m_numCols == numCols)
+        return;
+
+    if (m_format != MatrixFormat::matrixFormatSparseCSC)
+        NOT_IMPLEMENTED;
+
+    if (m_numRows * m_numCols != numRows * numCols)
+        LogicError("CPUSparseMatrix::Reshape: new matrix size does not match current size, can't be reshaped. Did you mean to resize?");
+
+    size_t newCompIndexSize = max(numRows, numCols) + 1;
+    CPUSPARSE_INDEX_TYPE* compIndex = new CPUSPARSE_INDEX_TYPE[newCompIndexSize];
+    compIndex[0] = m_compIndex[0];
+    size_t newCol = 0;
+    for (size_t j = 0; j < m_numCols; j++)
+    {
+        for (CPUSPARSE_INDEX_TYPE p = m_compIndex[j]; p < m_compIndex[j + 1]; p++)
+        {
+            size_t index = j * m_numRows + m_unCompIndex[p];
+            size_t col = index / numRows;
+            while (newCol < col) // columns (newCol, col] start here; all but the last are empty
+                compIndex[++newCol] = p;
+            m_unCompIndex[p] = (CPUSPARSE_INDEX_TYPE) (index % numRows);
+        }
+    }
+    while (newCol < numCols)
+        compIndex[++newCol] = m_compIndex[m_numCols];
+
+    delete[] m_compIndex;
+    m_compIndex = compIndex;
+    m_compIndexSize = newCompIndexSize;
+    m_numRows = numRows;
+    m_numCols = numCols;
+}
+
 //Reset matrix so it can be reused
 template <class ElemType>
 void CPUSparseMatrix<ElemType>::Reset()
@@ -665,7 +733,9 @@ void CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(ElemType alpha, const CPU
 
     if (!transposeA && !transposeB)
     {
-        for (size_t j = 0; j < rhs.GetNumCols(); j++)
+        // each output column only depends on its input column, e.g. one word per column for one-hot inputs
+#pragma omp parallel for
+        for (long j = 0; j < (long) rhs.GetNumCols(); j++)
         {
             size_t start = rhs.m_compIndex[j]; // ColLocation
             size_t end = rhs.m_compIndex[j + 1];
@@ -76,6 +76,7 @@ public:
 
     CPUSparseMatrix<ElemType> ColumnSlice(size_t startColumn, size_t numCols) const;
     CPUMatrix<ElemType> CopyColumnSliceToDense(size_t startColumn, size_t numCols) const;
+    void MaskColumnsValue(const CPUMatrix<char>& columnsMask, ElemType val);
 
     CPUMatrix<ElemType> DiagonalToDense() const;
 
@@ -120,6 +121,7 @@ public:
     }
 
     void Resize(const size_t numRows, const size_t numCols, size_t numNZElemToReserve = 10000, const bool growOnly = true, bool keepExistingValues = false);
+    void Reshape(const size_t numRows, const size_t numCols);
     void Reset();
 
     const ElemType operator()(const size_t row, const size_t col) const
@@ -0,0 +1,143 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUVectorKernels.cpp -- runtime selection of the vectorized TensorOp kernels
+//
+
+#include "stdafx.h"
+#include "CPUVectorKernels.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_VECTOR_KERNELS_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+#ifdef CPU_VECTOR_KERNELS_X86
+static void GetCPUID(unsigned int leaf, unsigned int subleaf, unsigned int regs[4] /*eax, ebx, ecx, edx*/)
+{
+#ifdef _MSC_VER
+    int r[4];
+    __cpuidex(r, (int) leaf, (int) subleaf);
+    for (size_t i = 0; i < 4; i++)
+        regs[i] = (unsigned int) r[i];
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// register state the OS saves on context switches (XCR0)
+static unsigned long long GetEnabledXSaveFeatures()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned int eax, edx;
+    __asm__ __volatile__("xgetbv"
+                         : "=a"(eax), "=d"(edx)
+                         : "c"(0));
+    return ((unsigned long long) edx << 32) | eax;
+#endif
+}
+#endif
+
+// what the CPU (and OS) can do, regardless of what was built
+static CPUVectorISA DetectCPUVectorISA()
+{
+#ifdef CPU_VECTOR_KERNELS_X86
+    unsigned int regs[4];
+    GetCPUID(0, 0, regs);
+    if (regs[0] < 7) // leaf 7 has the AVX2 and AVX-512 flags
+        return CPUVectorISA::None;
+    GetCPUID(1, 0, regs);
+    bool hasOSXSave = (regs[2] & (1u << 27)) != 0;
+    bool hasAVX = (regs[2] & (1u << 28)) != 0;
+    bool hasFMA = (regs[2] & (1u << 12)) != 0;
+    if (!hasOSXSave || !hasAVX || !hasFMA)
+        return CPUVectorISA::None;
+    unsigned long long xcr0 = GetEnabledXSaveFeatures();
+    if ((xcr0 & 0x06) != 0x06) // XMM and YMM state
+        return CPUVectorISA::None;
+    GetCPUID(7, 0, regs);
+    bool hasAVX2 = (regs[1] & (1u << 5)) != 0;
+    bool hasAVX512F = (regs[1] & (1u << 16)) != 0;
+    if (hasAVX2 && hasAVX512F && (xcr0 & 0xe0) == 0xe0) // opmask, upper ZMM0-15 and ZMM16-31 state
+        return CPUVectorISA::AVX512;
+    if (hasAVX2)
+        return CPUVectorISA::AVX2;
+#endif
+    return CPUVectorISA::None;
+}
+
+static bool IsISABuilt(CPUVectorISA isa)
+{
+    switch (isa)
+    {
+    case CPUVectorISA::AVX512:
+        return GetAVX512KernelTable<float>() != nullptr;
+    case CPUVectorISA::AVX2:
+        return GetAVX2KernelTable<float>() != nullptr;
+    default:
+        return true;
+    }
+}
+
+/*static*/ CPUVectorISA CPUVectorKernels::GetSupportedISA()
+{
+    static const CPUVectorISA supportedISA = []()
+    {
+        CPUVectorISA isa = DetectCPUVectorISA();
+        while (!IsISABuilt(isa))
+            isa = (CPUVectorISA)((int) isa - 1);
+        return isa;
+    }();
+    return supportedISA;
+}
+
+static CPUVectorISA& CurrentISA()
+{
+    static CPUVectorISA isa = CPUVectorKernels::GetSupportedISA();
+    return isa;
+}
+
+/*static*/ CPUVectorISA CPUVectorKernels::GetISA()
+{
+    return CurrentISA();
+}
+
+/*static*/ CPUVectorISA CPUVectorKernels::SetISA(CPUVectorISA isa)
+{
+    if ((int) isa > (int) GetSupportedISA())
+        isa = GetSupportedISA();
+    CurrentISA() = isa;
+    return isa;
+}
+
+template <class ElemType>
+/*static*/ const CPUVectorKernelTable<ElemType>* CPUVectorKernels::GetKernels()
+{
+    switch (CurrentISA())
+    {
+    case CPUVectorISA::AVX512:
+        return GetAVX512KernelTable<ElemType>();
+    case CPUVectorISA::AVX2:
+        return GetAVX2KernelTable<ElemType>();
+    default:
+        return nullptr;
+    }
+}
+
+/*static*/ const CPUQuantizedKernelTable* CPUVectorKernels::GetQuantizedKernels()
+{
+    return (int) CurrentISA() >= (int) CPUVectorISA::AVX2 ? GetAVX2QuantizedKernelTable() : nullptr;
+}
+
+template const CPUVectorKernelTable<float>* CPUVectorKernels::GetKernels<float>();
+template const CPUVectorKernelTable<double>* CPUVectorKernels::GetKernels<double>();
+} } }
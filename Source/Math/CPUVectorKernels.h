@@ -0,0 +1,112 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUVectorKernels.h -- hand-vectorized inner loops of CPU TensorOps (AVX2, AVX-512)
+//
+// CPUMatrix::TensorOp() hands contiguous runs of elements to these kernels if the op is
+// listed below and the CPU supports one of the instruction sets; otherwise it uses its
+// generic scalar loops. Each instruction set lives in its own .cpp file that is compiled
+// with the respective code-generation flags, so that the rest of the library keeps running
+// on any x64 CPU.
+//
+// Results match the scalar code bit-for-bit for the arithmetic ops and for the sum over
+// columns. Exp, Log, Tanh and Sigmoid use polynomial approximations that are within a few
+// ULPs of the C library functions, and ReduceSum() adds in a different order.
+//
+
+#pragma once
+
+#include "CommonMatrix.h"
+#include <stdint.h>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+#define ForAllVectorizedUnaryOps(Macro) \
+    Macro(Copy);                        \
+    Macro(Negate);                      \
+    Macro(Sigmoid);                     \
+    Macro(Tanh);                        \
+    Macro(Exp);                         \
+    Macro(Log);                         \
+    Macro(LinearRectifier);
+
+#define ForAllVectorizedBinaryOps(Macro) \
+    Macro(Sum);                          \
+    Macro(Difference);                   \
+    Macro(ElementwiseProduct);
+
+// the kernels of one instruction set
+// All of them compute c = beta * c + alpha * f(...) with the same order of operations as the scalar code.
+template <class ElemType>
+struct CPUVectorKernelTable
+{
+    // c[i] = beta * c[i] + alpha * op(a[i], b[i]) for i in [0, n); b is unused (may be nullptr) for unary ops
+    void (*elementwiseOp)(ElementWiseOperator op, ElemType beta, const ElemType* pa, const ElemType* pb, ElemType* pc, size_t n, ElemType alpha);
+    // *c = beta * *c + alpha * sum_i a[i]
+    void (*reduceSum)(ElemType beta, const ElemType* pa, size_t n, ElemType* pc, ElemType alpha);
+    // c[i] = beta * c[i] + alpha * sum_j a[i + j * colStride] for i in [0, numRows), e.g. the gradient of a bias
+    void (*reduceSumOverColumns)(ElemType beta, const ElemType* pa, ptrdiff_t colStride, size_t numCols, ElemType* pc, size_t numRows, ElemType alpha);
+};
+
+// implemented in CPUVectorKernelsAVX2.cpp and CPUVectorKernelsAVX512.cpp; nullptr if the compiler could not build them
+template <class ElemType>
+const CPUVectorKernelTable<ElemType>* GetAVX2KernelTable();
+template <class ElemType>
+const CPUVectorKernelTable<ElemType>* GetAVX512KernelTable();
+
+// the integer kernels of QuantizedWeights::Multiply()
+// acc[m + n * ldAcc] = sum_k w(k, m) * x[k + n * K] for m < M, n < N, with K even and M a multiple of 8.
+// The weights are packed in panels of 8 outputs that hold the pairs (k, k+1) of the 8 outputs one
+// after the other: w(k, m) = w[(m / 8) * 8 * K + (k / 2) * 16 + (m % 8) * 2 + k % 2].
+// The caller guarantees that the sums cannot overflow.
+struct CPUQuantizedKernelTable
+{
+    void (*dotProductsInt8)(const int8_t* w, const int16_t* x, size_t K, size_t M, size_t N, int32_t* acc, size_t ldAcc);
+    void (*dotProductsInt16)(const int16_t* w, const int16_t* x, size_t K, size_t M, size_t N, int32_t* acc, size_t ldAcc);
+};
+
+// implemented in CPUVectorKernelsAVX2.cpp (AVX-512 CPUs use it as well); nullptr if the compiler could not build it
+const CPUQuantizedKernelTable* GetAVX2QuantizedKernelTable();
+
+class CPUVectorKernels
+{
+public:
+    // the best instruction set that both the CPU and the build support
+    static CPUVectorISA GetSupportedISA();
+
+    // the instruction set in use; defaults to GetSupportedISA()
+    static CPUVectorISA GetISA();
+    // select the instruction set (e.g. None to compare against the scalar code); limited to GetSupportedISA(), returns the one in use
+    static CPUVectorISA SetISA(CPUVectorISA isa);
+
+    // kernels of the instruction set in use, or nullptr for the scalar code
+    template <class ElemType>
+    static const CPUVectorKernelTable<ElemType>* GetKernels();
+    // integer kernels of the instruction set in use, or nullptr for the scalar code
+    static const CPUQuantizedKernelTable* GetQuantizedKernels();
+
+    static bool IsVectorizedUnaryOp(ElementWiseOperator op)
+    {
+#define CaseVectorizedOp(oper) \
+    case op##oper:             \
+        return true;
+        switch (op)
+        {
+            ForAllVectorizedUnaryOps(CaseVectorizedOp);
+        default:
+            return false;
+        }
+    }
+    static bool IsVectorizedBinaryOp(ElementWiseOperator op)
+    {
+        switch (op)
+        {
+            ForAllVectorizedBinaryOps(CaseVectorizedOp);
+        default:
+            return false;
+        }
+#undef CaseVectorizedOp
+    }
+};
+} } }
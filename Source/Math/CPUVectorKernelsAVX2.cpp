@@ -0,0 +1,339 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUVectorKernelsAVX2.cpp -- AVX2 version of the vectorized TensorOp kernels
+//
+// This file must be compiled with AVX2 and FMA code generation enabled (-mavx2 -mfma, or /arch:AVX2),
+// and without floating-point contraction. Nothing in here may be called unless CPUID says the CPU has AVX2.
+//
+
+#include "stdafx.h"
+#include "CPUVectorKernels.h"
+
+#ifdef __AVX2__
+
+#include <immintrin.h>
+#include <string.h>
+#include "CPUVectorKernelsImpl.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+struct AVX2Double
+{
+    typedef double Elem;
+    typedef __m256d Reg;
+    typedef __m256d Mask;
+    typedef AVX2Double Wide;
+    static const size_t width = 4;
+    static const size_t numWide = 1;
+
+    static inline Reg Load(const Elem* p)
+    {
+        return _mm256_loadu_pd(p);
+    }
+    static inline void Store(Elem* p, Reg x)
+    {
+        _mm256_storeu_pd(p, x);
+    }
+    static inline Reg Set1(Elem v)
+    {
+        return _mm256_set1_pd(v);
+    }
+    static inline Reg Zero()
+    {
+        return _mm256_setzero_pd();
+    }
+    static inline Reg Add(Reg a, Reg b)
+    {
+        return _mm256_add_pd(a, b);
+    }
+    static inline Reg Sub(Reg a, Reg b)
+    {
+        return _mm256_sub_pd(a, b);
+    }
+    static inline Reg Mul(Reg a, Reg b)
+    {
+        return _mm256_mul_pd(a, b);
+    }
+    static inline Reg Div(Reg a, Reg b)
+    {
+        return _mm256_div_pd(a, b);
+    }
+    static inline Reg MulAdd(Reg a, Reg b, Reg c)
+    {
+        return _mm256_fmadd_pd(a, b, c);
+    }
+    static inline Reg Max(Reg a, Reg b)
+    {
+        return _mm256_max_pd(a, b);
+    }
+    static inline Reg Min(Reg a, Reg b)
+    {
+        return _mm256_min_pd(a, b);
+    }
+    static inline Reg Neg(Reg a)
+    {
+        return _mm256_xor_pd(a, _mm256_set1_pd(-0.0));
+    }
+    static inline Reg Abs(Reg a)
+    {
+        return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a);
+    }
+    static inline Reg Floor(Reg a)
+    {
+        return _mm256_floor_pd(a);
+    }
+    static inline Mask CmpLt(Reg a, Reg b)
+    {
+        return _mm256_cmp_pd(a, b, _CMP_LT_OQ);
+    }
+    static inline Mask CmpGt(Reg a, Reg b)
+    {
+        return _mm256_cmp_pd(a, b, _CMP_GT_OQ);
+    }
+    static inline Mask IsNaN(Reg a)
+    {
+        return _mm256_cmp_pd(a, a, _CMP_UNORD_Q);
+    }
+    static inline Reg Select(Mask m, Reg a, Reg b)
+    {
+        return _mm256_blendv_pd(b, a, m);
+    }
+
+    // 2^n for integral n in the range of normalized numbers
+    static inline Reg Pow2i(Reg n)
+    {
+        __m256i e = _mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(n));
+        return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_add_epi64(e, _mm256_set1_epi64x(1023)), 52));
+    }
+    // x = m * 2^e with m in [0.5, 1), for positive normalized x
+    static inline Reg Frexp(Reg x, Reg& e)
+    {
+        __m256i bits = _mm256_castpd_si256(x);
+        // convert the biased exponent to double by placing it in the mantissa of 2^52
+        __m256i biased = _mm256_srli_epi64(bits, 52);
+        const Reg twoTo52 = _mm256_set1_pd(4503599627370496.0);
+        e = _mm256_sub_pd(_mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(biased, _mm256_castpd_si256(twoTo52))), twoTo52), _mm256_set1_pd(1022.0));
+        bits = _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi64x(0x000FFFFFFFFFFFFFLL)), _mm256_set1_epi64x(0x3FE0000000000000LL));
+        return _mm256_castsi256_pd(bits);
+    }
+
+    static inline void Widen(Reg x, Wide::Reg* wide)
+    {
+        wide[0] = x;
+    }
+    static inline Reg Narrow(const Wide::Reg* wide)
+    {
+        return wide[0];
+    }
+};
+
+struct AVX2Float
+{
+    typedef float Elem;
+    typedef __m256 Reg;
+    typedef __m256 Mask;
+    typedef AVX2Double Wide;
+    static const size_t width = 8;
+    static const size_t numWide = 2;
+
+    static inline Reg Load(const Elem* p)
+    {
+        return _mm256_loadu_ps(p);
+    }
+    static inline void Store(Elem* p, Reg x)
+    {
+        _mm256_storeu_ps(p, x);
+    }
+    static inline Reg Set1(Elem v)
+    {
+        return _mm256_set1_ps(v);
+    }
+    static inline Reg Zero()
+    {
+        return _mm256_setzero_ps();
+    }
+    static inline Reg Add(Reg a, Reg b)
+    {
+        return _mm256_add_ps(a, b);
+    }
+    static inline Reg Sub(Reg a, Reg b)
+    {
+        return _mm256_sub_ps(a, b);
+    }
+    static inline Reg Mul(Reg a, Reg b)
+    {
+        return _mm256_mul_ps(a, b);
+    }
+    static inline Reg Div(Reg a, Reg b)
+    {
+        return _mm256_div_ps(a, b);
+    }
+    static inline Reg MulAdd(Reg a, Reg b, Reg c)
+    {
+        return _mm256_fmadd_ps(a, b, c);
+    }
+    static inline Reg Max(Reg a, Reg b)
+    {
+        return _mm256_max_ps(a, b);
+    }
+    static inline Reg Min(Reg a, Reg b)
+    {
+        return _mm256_min_ps(a, b);
+    }
+    static inline Reg Neg(Reg a)
+    {
+        return _mm256_xor_ps(a, _mm256_set1_ps(-0.0f));
+    }
+    static inline Reg Abs(Reg a)
+    {
+        return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a);
+    }
+    static inline Reg Floor(Reg a)
+    {
+        return _mm256_floor_ps(a);
+    }
+    static inline Mask CmpLt(Reg a, Reg b)
+    {
+        return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+    }
+    static inline Mask CmpGt(Reg a, Reg b)
+    {
+        return _mm256_cmp_ps(a, b, _CMP_GT_OQ);
+    }
+    static inline Mask IsNaN(Reg a)
+    {
+        return _mm256_cmp_ps(a, a, _CMP_UNORD_Q);
+    }
+    static inline Reg Select(Mask m, Reg a, Reg b)
+    {
+        return _mm256_blendv_ps(b, a, m);
+    }
+
+    static inline Reg Pow2i(Reg n)
+    {
+        __m256i e = _mm256_cvtps_epi32(n);
+        return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(e, _mm256_set1_epi32(127)), 23));
+    }
+    static inline Reg Frexp(Reg x, Reg& e)
+    {
+        __m256i bits = _mm256_castps_si256(x);
+        e = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(bits, 23)), _mm256_set1_ps(126.0f));
+        bits = _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007FFFFF)), _mm256_set1_epi32(0x3F000000));
+        return _mm256_castsi256_ps(bits);
+    }
+
+    static inline void Widen(Reg x, Wide::Reg* wide)
+    {
+        wide[0] = _mm256_cvtps_pd(_mm256_castps256_ps128(x));
+        wide[1] = _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1));
+    }
+    static inline Reg Narrow(const Wide::Reg* wide)
+    {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(wide[0])), _mm256_cvtpd_ps(wide[1]), 1);
+    }
+};
+
+template <>
+const CPUVectorKernelTable<float>* GetAVX2KernelTable<float>()
+{
+    return VectorKernels<AVX2Float>::GetTable();
+}
+template <>
+const CPUVectorKernelTable<double>* GetAVX2KernelTable<double>()
+{
+    return VectorKernels<AVX2Double>::GetTable();
+}
+
+// -----------------------------------------------------------------------
+// integer dot products of QuantizedWeights::Multiply()
+// A weight panel holds the (k, k+1) pairs of 8 outputs in one register (8-bit weights are
+// sign-extended), so that multiplying it with the broadcast (k, k+1) pair of a column and adding
+// adjacent products (vpmaddwd) yields the contributions to the 8 outputs. A block of R panels
+// and C columns is kept in R * C accumulators.
+// -----------------------------------------------------------------------
+
+static inline __m256i LoadWeights(const int8_t* p)
+{
+    return _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*) p));
+}
+static inline __m256i LoadWeights(const int16_t* p)
+{
+    return _mm256_loadu_si256((const __m256i*) p);
+}
+
+template <size_t R, size_t C, class WeightType>
+static inline void DotProductsBlock(const WeightType* w, const int16_t* x, size_t K, int32_t* acc, size_t ldAcc)
+{
+    __m256i sum[R][C];
+    for (size_t r = 0; r < R; r++)
+        for (size_t c = 0; c < C; c++)
+            sum[r][c] = _mm256_setzero_si256();
+    for (size_t k = 0; k < K; k += 2)
+    {
+        __m256i wv[R];
+        for (size_t r = 0; r < R; r++)
+            wv[r] = LoadWeights(w + r * 8 * K + k * 8);
+        for (size_t c = 0; c < C; c++)
+        {
+            int32_t pair;
+            memcpy(&pair, x + c * K + k, sizeof(pair));
+            __m256i xv = _mm256_set1_epi32(pair);
+            for (size_t r = 0; r < R; r++)
+                sum[r][c] = _mm256_add_epi32(sum[r][c], _mm256_madd_epi16(wv[r], xv));
+        }
+    }
+    for (size_t r = 0; r < R; r++)
+        for (size_t c = 0; c < C; c++)
+            _mm256_storeu_si256((__m256i*) (acc + r * 8 + c * ldAcc), sum[r][c]);
+}
+
+template <size_t R, class WeightType>
+static inline void DotProductsPanels(const WeightType* w, const int16_t* x, size_t K, size_t N, int32_t* acc, size_t ldAcc)
+{
+    size_t n = 0;
+    for (; n + 6 <= N; n += 6)
+        DotProductsBlock<R, 6>(w, x + n * K, K, acc + n * ldAcc, ldAcc);
+    for (; n < N; n++)
+        DotProductsBlock<R, 1>(w, x + n * K, K, acc + n * ldAcc, ldAcc);
+}
+
+template <class WeightType>
+static void DotProducts(const WeightType* w, const int16_t* x, size_t K, size_t M, size_t N, int32_t* acc, size_t ldAcc)
+{
+    size_t m = 0;
+    for (; m + 16 <= M; m += 16)
+        DotProductsPanels<2>(w + m * K, x, K, N, acc + m, ldAcc);
+    if (m < M)
+        DotProductsPanels<1>(w + m * K, x, K, N, acc + m, ldAcc);
+}
+
+const CPUQuantizedKernelTable* GetAVX2QuantizedKernelTable()
+{
+    static const CPUQuantizedKernelTable table = {&DotProducts<int8_t>, &DotProducts<int16_t>};
+    return &table;
+}
+} } }
+
+#else // compiler does not target AVX2: the scalar code will be used
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <>
+const CPUVectorKernelTable<float>* GetAVX2KernelTable<float>()
+{
+    return nullptr;
+}
+template <>
+const CPUVectorKernelTable<double>* GetAVX2KernelTable<double>()
+{
+    return nullptr;
+}
+const CPUQuantizedKernelTable* GetAVX2QuantizedKernelTable()
+{
+    return nullptr;
+}
+} } }
+
+#endif
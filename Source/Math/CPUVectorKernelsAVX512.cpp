@@ -0,0 +1,269 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUVectorKernelsAVX512.cpp -- AVX-512 version of the vectorized TensorOp kernels
+//
+// This file must be compiled with AVX-512F code generation enabled (-mavx512f), and without
+// floating-point contraction. Only AVX-512F instructions are used, so that it runs on all
+// AVX-512 CPUs. Nothing in here may be called unless CPUID says the CPU has AVX-512F.
+//
+
+#include "stdafx.h"
+#include "CPUVectorKernels.h"
+
+#ifdef __AVX512F__
+
+#include <immintrin.h>
+#include "CPUVectorKernelsImpl.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+struct AVX512Double
+{
+    typedef double Elem;
+    typedef __m512d Reg;
+    typedef __mmask8 Mask;
+    typedef AVX512Double Wide;
+    static const size_t width = 8;
+    static const size_t numWide = 1;
+
+    static inline Reg Load(const Elem* p)
+    {
+        return _mm512_loadu_pd(p);
+    }
+    static inline void Store(Elem* p, Reg x)
+    {
+        _mm512_storeu_pd(p, x);
+    }
+    static inline Reg Set1(Elem v)
+    {
+        return _mm512_set1_pd(v);
+    }
+    static inline Reg Zero()
+    {
+        return _mm512_setzero_pd();
+    }
+    static inline Reg Add(Reg a, Reg b)
+    {
+        return _mm512_add_pd(a, b);
+    }
+    static inline Reg Sub(Reg a, Reg b)
+    {
+        return _mm512_sub_pd(a, b);
+    }
+    static inline Reg Mul(Reg a, Reg b)
+    {
+        return _mm512_mul_pd(a, b);
+    }
+    static inline Reg Div(Reg a, Reg b)
+    {
+        return _mm512_div_pd(a, b);
+    }
+    static inline Reg MulAdd(Reg a, Reg b, Reg c)
+    {
+        return _mm512_fmadd_pd(a, b, c);
+    }
+    static inline Reg Max(Reg a, Reg b)
+    {
+        return _mm512_max_pd(a, b);
+    }
+    static inline Reg Min(Reg a, Reg b)
+    {
+        return _mm512_min_pd(a, b);
+    }
+    // (the floating-point logical instructions are AVX-512DQ, so use the integer ones)
+    static inline Reg Neg(Reg a)
+    {
+        return _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(a), _mm512_set1_epi64(0x8000000000000000LL)));
+    }
+    static inline Reg Abs(Reg a)
+    {
+        return _mm512_castsi512_pd(_mm512_and_si512(_mm512_castpd_si512(a), _mm512_set1_epi64(0x7FFFFFFFFFFFFFFFLL)));
+    }
+    static inline Reg Floor(Reg a)
+    {
+        return _mm512_roundscale_pd(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    }
+    static inline Mask CmpLt(Reg a, Reg b)
+    {
+        return _mm512_cmp_pd_mask(a, b, _CMP_LT_OQ);
+    }
+    static inline Mask CmpGt(Reg a, Reg b)
+    {
+        return _mm512_cmp_pd_mask(a, b, _CMP_GT_OQ);
+    }
+    static inline Mask IsNaN(Reg a)
+    {
+        return _mm512_cmp_pd_mask(a, a, _CMP_UNORD_Q);
+    }
+    static inline Reg Select(Mask m, Reg a, Reg b)
+    {
+        return _mm512_mask_blend_pd(m, b, a);
+    }
+
+    // 2^n for integral n in the range of normalized numbers
+    static inline Reg Pow2i(Reg n)
+    {
+        __m512i e = _mm512_cvtepi32_epi64(_mm512_cvtpd_epi32(n));
+        return _mm512_castsi512_pd(_mm512_slli_epi64(_mm512_add_epi64(e, _mm512_set1_epi64(1023)), 52));
+    }
+    // x = m * 2^e with m in [0.5, 1), for positive normalized x
+    static inline Reg Frexp(Reg x, Reg& e)
+    {
+        __m512i bits = _mm512_castpd_si512(x);
+        // convert the biased exponent to double by placing it in the mantissa of 2^52 (the direct conversion is AVX-512DQ)
+        __m512i biased = _mm512_srli_epi64(bits, 52);
+        const Reg twoTo52 = _mm512_set1_pd(4503599627370496.0);
+        e = _mm512_sub_pd(_mm512_sub_pd(_mm512_castsi512_pd(_mm512_or_si512(biased, _mm512_castpd_si512(twoTo52))), twoTo52), _mm512_set1_pd(1022.0));
+        bits = _mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi64(0x000FFFFFFFFFFFFFLL)), _mm512_set1_epi64(0x3FE0000000000000LL));
+        return _mm512_castsi512_pd(bits);
+    }
+
+    static inline void Widen(Reg x, Wide::Reg* wide)
+    {
+        wide[0] = x;
+    }
+    static inline Reg Narrow(const Wide::Reg* wide)
+    {
+        return wide[0];
+    }
+};
+
+struct AVX512Float
+{
+    typedef float Elem;
+    typedef __m512 Reg;
+    typedef __mmask16 Mask;
+    typedef AVX512Double Wide;
+    static const size_t width = 16;
+    static const size_t numWide = 2;
+
+    static inline Reg Load(const Elem* p)
+    {
+        return _mm512_loadu_ps(p);
+    }
+    static inline void Store(Elem* p, Reg x)
+    {
+        _mm512_storeu_ps(p, x);
+    }
+    static inline Reg Set1(Elem v)
+    {
+        return _mm512_set1_ps(v);
+    }
+    static inline Reg Zero()
+    {
+        return _mm512_setzero_ps();
+    }
+    static inline Reg Add(Reg a, Reg b)
+    {
+        return _mm512_add_ps(a, b);
+    }
+    static inline Reg Sub(Reg a, Reg b)
+    {
+        return _mm512_sub_ps(a, b);
+    }
+    static inline Reg Mul(Reg a, Reg b)
+    {
+        return _mm512_mul_ps(a, b);
+    }
+    static inline Reg Div(Reg a, Reg b)
+    {
+        return _mm512_div_ps(a, b);
+    }
+    static inline Reg MulAdd(Reg a, Reg b, Reg c)
+    {
+        return _mm512_fmadd_ps(a, b, c);
+    }
+    static inline Reg Max(Reg a, Reg b)
+    {
+        return _mm512_max_ps(a, b);
+    }
+    static inline Reg Min(Reg a, Reg b)
+    {
+        return _mm512_min_ps(a, b);
+    }
+    static inline Reg Neg(Reg a)
+    {
+        return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x80000000)));
+    }
+    static inline Reg Abs(Reg a)
+    {
+        return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x7FFFFFFF)));
+    }
+    static inline Reg Floor(Reg a)
+    {
+        return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    }
+    static inline Mask CmpLt(Reg a, Reg b)
+    {
+        return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ);
+    }
+    static inline Mask CmpGt(Reg a, Reg b)
+    {
+        return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ);
+    }
+    static inline Mask IsNaN(Reg a)
+    {
+        return _mm512_cmp_ps_mask(a, a, _CMP_UNORD_Q);
+    }
+    static inline Reg Select(Mask m, Reg a, Reg b)
+    {
+        return _mm512_mask_blend_ps(m, b, a);
+    }
+
+    static inline Reg Pow2i(Reg n)
+    {
+        __m512i e = _mm512_cvtps_epi32(n);
+        return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(e, _mm512_set1_epi32(127)), 23));
+    }
+    static inline Reg Frexp(Reg x, Reg& e)
+    {
+        __m512i bits = _mm512_castps_si512(x);
+        e = _mm512_sub_ps(_mm512_cvtepi32_ps(_mm512_srli_epi32(bits, 23)), _mm512_set1_ps(126.0f));
+        bits = _mm512_or_si512(_mm512_and_si512(bits, _mm512_set1_epi32(0x007FFFFF)), _mm512_set1_epi32(0x3F000000));
+        return _mm512_castsi512_ps(bits);
+    }
+
+    static inline void Widen(Reg x, Wide::Reg* wide)
+    {
+        wide[0] = _mm512_cvtps_pd(_mm512_castps512_ps256(x));
+        wide[1] = _mm512_cvtps_pd(_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(x), 1)));
+    }
+    static inline Reg Narrow(const Wide::Reg* wide)
+    {
+        __m256d lo = _mm256_castps_pd(_mm512_cvtpd_ps(wide[0]));
+        __m256d hi = _mm256_castps_pd(_mm512_cvtpd_ps(wide[1]));
+        return _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castpd256_pd512(lo), hi, 1));
+    }
+};
+
+template <>
+const CPUVectorKernelTable<float>* GetAVX512KernelTable<float>()
+{
+    return VectorKernels<AVX512Float>::GetTable();
+}
+template <>
+const CPUVectorKernelTable<double>* GetAVX512KernelTable<double>()
+{
+    return VectorKernels<AVX512Double>::GetTable();
+}
+} } }
+
+#else // compiler does not target AVX-512: the AVX2 or scalar code will be used
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <>
+const CPUVectorKernelTable<float>* GetAVX512KernelTable<float>()
+{
+    return nullptr;
+}
+template <>
+const CPUVectorKernelTable<double>* GetAVX512KernelTable<double>()
+{
+    return nullptr;
+}
+} } }
+
+#endif
@@ -0,0 +1,342 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// CPUVectorKernelsImpl.h -- the kernels of CPUVectorKernels.h, written against a small SIMD abstraction
+//
+// This is included by one .cpp file per instruction set, which defines the abstraction as a
+// 'vector traits' class V for each element type, with
+//  - types Elem, Reg (one register of Elem), Mask (result of a comparison), and Wide
+//    (the traits of the double vectors that hold a Reg converted to double, numWide of them);
+//  - loads/stores, arithmetic, comparison/Select(), and the exponent helpers Pow2i() and Frexp().
+// The .cpp files must be compiled without floating-point contraction (e.g. -ffp-contract=off), since
+// a fused multiply-add of the scalar code's 'alpha * val + beta * c' would not match it bit-for-bit.
+// Explicit MulAdd() is only used inside the approximations of the transcendental functions.
+//
+
+#pragma once
+
+#include "CPUVectorKernels.h"
+#include "TensorOps.h"
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// transcendental functions
+// These follow the Cephes library: range reduction by powers of 2, then a polynomial
+// or rational approximation. NaNs and infinities are passed through like the C library does.
+// -----------------------------------------------------------------------
+
+template <class V, class ElemType = typename V::Elem>
+struct VectorMath;
+
+template <class V>
+struct VectorMath<V, float>
+{
+    typedef typename V::Reg Reg;
+
+    static inline Reg Exp(Reg x0)
+    {
+        const Reg maxArg = V::Set1(88.7228391f);  // log(FLT_MAX)
+        const Reg minArg = V::Set1(-87.3365448f); // log(FLT_MIN); we flush the denormal range to 0
+        Reg x = V::Min(V::Max(x0, minArg), maxArg);
+        // exp(x) = 2^n * exp(r) with n = round(x / log(2)), |r| <= log(2)/2
+        Reg n = V::Floor(V::MulAdd(x, V::Set1(1.44269504088896341f), V::Set1(0.5f)));
+        x = V::MulAdd(n, V::Set1(-0.693359375f), x);
+        x = V::MulAdd(n, V::Set1(2.12194440e-4f), x);
+        Reg y = V::Set1(1.9875691500e-4f);
+        y = V::MulAdd(y, x, V::Set1(1.3981999507e-3f));
+        y = V::MulAdd(y, x, V::Set1(8.3334519073e-3f));
+        y = V::MulAdd(y, x, V::Set1(4.1665795894e-2f));
+        y = V::MulAdd(y, x, V::Set1(1.6666665459e-1f));
+        y = V::MulAdd(y, x, V::Set1(5.0000001201e-1f));
+        y = V::MulAdd(y, V::Mul(x, x), V::Add(x, V::Set1(1.0f)));
+        // 2^n may not be representable for n = 128, so apply it in two halves
+        Reg n1 = V::Floor(V::Mul(n, V::Set1(0.5f)));
+        y = V::Mul(V::Mul(y, V::Pow2i(n1)), V::Pow2i(V::Sub(n, n1)));
+        y = V::Select(V::CmpGt(x0, maxArg), V::Set1(std::numeric_limits<float>::infinity()), y);
+        y = V::Select(V::CmpLt(x0, minArg), V::Zero(), y);
+        return V::Select(V::IsNaN(x0), x0, y);
+    }
+
+    // natural log for x > 0
+    static inline Reg Log(Reg x0)
+    {
+        // x = m * 2^e with m in [sqrt(0.5), sqrt(2)), then log(x) = log(m) + e log(2)
+        Reg e;
+        Reg m = V::Frexp(x0, e); // m in [0.5, 1)
+        auto isSmall = V::CmpLt(m, V::Set1(0.707106781186547524f));
+        e = V::Sub(e, V::Select(isSmall, V::Set1(1.0f), V::Zero()));
+        Reg x = V::Add(V::Sub(m, V::Set1(1.0f)), V::Select(isSmall, m, V::Zero()));
+        Reg z = V::Mul(x, x);
+        Reg y = V::Set1(7.0376836292e-2f);
+        y = V::MulAdd(y, x, V::Set1(-1.1514610310e-1f));
+        y = V::MulAdd(y, x, V::Set1(1.1676998740e-1f));
+        y = V::MulAdd(y, x, V::Set1(-1.2420140846e-1f));
+        y = V::MulAdd(y, x, V::Set1(1.4249322787e-1f));
+        y = V::MulAdd(y, x, V::Set1(-1.6668057665e-1f));
+        y = V::MulAdd(y, x, V::Set1(2.0000714765e-1f));
+        y = V::MulAdd(y, x, V::Set1(-2.4999993993e-1f));
+        y = V::MulAdd(y, x, V::Set1(3.3333331174e-1f));
+        y = V::Mul(V::Mul(y, x), z);
+        y = V::MulAdd(e, V::Set1(-2.12194440e-4f), y);
+        y = V::MulAdd(z, V::Set1(-0.5f), y);
+        x = V::Add(x, y);
+        x = V::MulAdd(e, V::Set1(0.693359375f), x);
+        auto isSpecial = V::CmpGt(x0, V::Set1(std::numeric_limits<float>::max())); // +inf
+        return V::Select(isSpecial, x0, V::Select(V::IsNaN(x0), x0, x));
+    }
+
+    static inline Reg Tanh(Reg x0)
+    {
+        Reg ax = V::Abs(x0);
+        // small |x|: odd polynomial
+        Reg z = V::Mul(x0, x0);
+        Reg p = V::Set1(-5.70498872745e-3f);
+        p = V::MulAdd(p, z, V::Set1(2.06390887954e-2f));
+        p = V::MulAdd(p, z, V::Set1(-5.37397155531e-2f));
+        p = V::MulAdd(p, z, V::Set1(1.33314422036e-1f));
+        p = V::MulAdd(p, z, V::Set1(-3.33332819422e-1f));
+        Reg small = V::MulAdd(V::Mul(p, z), x0, x0);
+        // otherwise: 1 - 2 / (exp(2|x|) + 1), with the sign of x
+        Reg large = V::Sub(V::Set1(1.0f), V::Div(V::Set1(2.0f), V::Add(Exp(V::Add(ax, ax)), V::Set1(1.0f))));
+        large = V::Select(V::CmpLt(x0, V::Zero()), V::Neg(large), large);
+        return V::Select(V::CmpLt(ax, V::Set1(0.625f)), small, large);
+    }
+};
+
+template <class V>
+struct VectorMath<V, double>
+{
+    typedef typename V::Reg Reg;
+
+    static inline Reg Exp(Reg x0)
+    {
+        const Reg maxArg = V::Set1(7.09782712893383996843e2);  // log(DBL_MAX)
+        const Reg minArg = V::Set1(-7.08396418532264106224e2); // log(DBL_MIN); we flush the denormal range to 0
+        Reg x = V::Min(V::Max(x0, minArg), maxArg);
+        Reg n = V::Floor(V::MulAdd(x, V::Set1(1.4426950408889634073599), V::Set1(0.5)));
+        x = V::MulAdd(n, V::Set1(-6.93145751953125e-1), x);
+        x = V::MulAdd(n, V::Set1(-1.42860682030941723212e-6), x);
+        // exp(x) = 1 + 2 x P(x^2) / (Q(x^2) - x P(x^2))
+        Reg xx = V::Mul(x, x);
+        Reg p = V::Set1(1.26177193074810590878e-4);
+        p = V::MulAdd(p, xx, V::Set1(3.02994407707441961300e-2));
+        p = V::MulAdd(p, xx, V::Set1(9.99999999999999999910e-1));
+        p = V::Mul(p, x);
+        Reg q = V::Set1(3.00198505138664455042e-6);
+        q = V::MulAdd(q, xx, V::Set1(2.52448340349684104192e-3));
+        q = V::MulAdd(q, xx, V::Set1(2.27265548208155028766e-1));
+        q = V::MulAdd(q, xx, V::Set1(2.00000000000000000009e0));
+        Reg y = V::Div(p, V::Sub(q, p));
+        y = V::MulAdd(y, V::Set1(2.0), V::Set1(1.0));
+        Reg n1 = V::Floor(V::Mul(n, V::Set1(0.5)));
+        y = V::Mul(V::Mul(y, V::Pow2i(n1)), V::Pow2i(V::Sub(n, n1)));
+        y = V::Select(V::CmpGt(x0, maxArg), V::Set1(std::numeric_limits<double>::infinity()), y);
+        y = V::Select(V::CmpLt(x0, minArg), V::Zero(), y);
+        return V::Select(V::IsNaN(x0), x0, y);
+    }
+
+    static inline Reg Log(Reg x0)
+    {
+        Reg e;
+        Reg m = V::Frexp(x0, e);
+        auto isSmall = V::CmpLt(m, V::Set1(0.70710678118654752440));
+        e = V::Sub(e, V::Select(isSmall, V::Set1(1.0), V::Zero()));
+        Reg x = V::Add(V::Sub(m, V::Set1(1.0)), V::Select(isSmall, m, V::Zero()));
+        // log(1 + x) = x - x^2/2 + x^3 P(x) / Q(x)
+        Reg z = V::Mul(x, x);
+        Reg p = V::Set1(1.01875663804580931796e-4);
+        p = V::MulAdd(p, x, V::Set1(4.97494994976747001425e-1));
+        p = V::MulAdd(p, x, V::Set1(4.70579119878881725854e0));
+        p = V::MulAdd(p, x, V::Set1(1.44989225341610930846e1));
+        p = V::MulAdd(p, x, V::Set1(1.79368678507819816313e1));
+        p = V::MulAdd(p, x, V::Set1(7.70838733755885391666e0));
+        Reg q = V::Add(x, V::Set1(1.12873587189167450590e1));
+        q = V::MulAdd(q, x, V::Set1(4.52279145837532221105e1));
+        q = V::MulAdd(q, x, V::Set1(8.29875266912776603211e1));
+        q = V::MulAdd(q, x, V::Set1(7.11544750618563894466e1));
+        q = V::MulAdd(q, x, V::Set1(2.31251620126765340583e1));
+        Reg y = V::Mul(x, V::Div(V::Mul(z, p), q));
+        y = V::MulAdd(e, V::Set1(-2.121944400546905827679e-4), y);
+        y = V::MulAdd(z, V::Set1(-0.5), y);
+        x = V::Add(x, y);
+        x = V::MulAdd(e, V::Set1(0.693359375), x);
+        auto isSpecial = V::CmpGt(x0, V::Set1(std::numeric_limits<double>::max()));
+        return V::Select(isSpecial, x0, V::Select(V::IsNaN(x0), x0, x));
+    }
+
+    static inline Reg Tanh(Reg x0)
+    {
+        Reg ax = V::Abs(x0);
+        // small |x|: x + x^3 P(x^2) / Q(x^2)
+        Reg z = V::Mul(x0, x0);
+        Reg p = V::Set1(-9.64399179425052238628e-1);
+        p = V::MulAdd(p, z, V::Set1(-9.92877231001918586564e1));
+        p = V::MulAdd(p, z, V::Set1(-1.61468768441708447952e3));
+        Reg q = V::Add(z, V::Set1(1.12811678491632931402e2));
+        q = V::MulAdd(q, z, V::Set1(2.23548839060100448583e3));
+        q = V::MulAdd(q, z, V::Set1(4.84406305325125486048e3));
+        Reg small = V::MulAdd(V::Div(V::Mul(z, p), q), x0, x0);
+        Reg large = V::Sub(V::Set1(1.0), V::Div(V::Set1(2.0), V::Add(Exp(V::Add(ax, ax)), V::Set1(1.0))));
+        large = V::Select(V::CmpLt(x0, V::Zero()), V::Neg(large), large);
+        return V::Select(V::CmpLt(ax, V::Set1(0.625)), small, large);
+    }
+};
+
+// -----------------------------------------------------------------------
+// the kernels
+// -----------------------------------------------------------------------
+
+template <class V>
+struct VectorKernels
+{
+    typedef typename V::Elem ElemType;
+    typedef typename V::Reg Reg;
+    typedef typename V::Wide W;
+    typedef VectorMath<V> M;
+
+    // c = beta * c + alpha * f(a, b), where f is a vector function of one register of a and b each
+    // The remainder is run through the same vector code on a padded copy, so that the result of an
+    // element does not depend on whether it falls into the last partial vector.
+    template <class F>
+    static inline void Loop(ElemType beta, const ElemType* pa, const ElemType* pb, ElemType* pc, size_t n, ElemType alpha, const F& f)
+    {
+        const size_t nv = n - n % V::width;
+        const Reg valpha = V::Set1(alpha);
+        const Reg vbeta = V::Set1(beta);
+        // special-case beta and alpha to allow the compiler to short-circuit it, like the scalar code
+        if (beta != 0)
+            for (size_t i = 0; i < nv; i += V::width)
+                V::Store(pc + i, V::Add(V::Mul(f(V::Load(pa + i), pb ? V::Load(pb + i) : V::Zero()), valpha), V::Mul(vbeta, V::Load(pc + i))));
+        else if (alpha != 1)
+            for (size_t i = 0; i < nv; i += V::width)
+                V::Store(pc + i, V::Mul(f(V::Load(pa + i), pb ? V::Load(pb + i) : V::Zero()), valpha));
+        else
+            for (size_t i = 0; i < nv; i += V::width)
+                V::Store(pc + i, f(V::Load(pa + i), pb ? V::Load(pb + i) : V::Zero()));
+        if (nv == n)
+            return;
+        // padded with 1, which is in the domain of all ops
+        ElemType a[V::width], b[V::width], c[V::width];
+        for (size_t k = 0; k < V::width; k++)
+        {
+            a[k] = nv + k < n ? pa[nv + k] : 1;
+            b[k] = pb && nv + k < n ? pb[nv + k] : 1;
+            c[k] = beta != 0 && nv + k < n ? pc[nv + k] : 0;
+        }
+        Reg val = V::Mul(f(V::Load(a), V::Load(b)), valpha);
+        if (beta != 0)
+            val = V::Add(val, V::Mul(vbeta, V::Load(c)));
+        V::Store(c, val);
+        for (size_t i = nv; i < n; i++)
+            pc[i] = c[i - nv];
+    }
+
+    static void ElementwiseOp(ElementWiseOperator op, ElemType beta, const ElemType* pa, const ElemType* pb, ElemType* pc, size_t n, ElemType alpha)
+    {
+#define CaseVectorUnaryOp(oper, expr)                                  \
+    case op##oper:                                                     \
+        return Loop(beta, pa, nullptr, pc, n, alpha, [](Reg a, Reg)    \
+                    {                                                  \
+                        return expr;                                   \
+                    })
+#define CaseVectorBinaryOp(oper, expr)                                 \
+    case op##oper:                                                     \
+        return Loop(beta, pa, pb, pc, n, alpha, [](Reg a, Reg b)       \
+                    {                                                  \
+                        return expr;                                   \
+                    })
+
+        switch (op)
+        {
+            CaseVectorUnaryOp(Copy, a);
+            CaseVectorUnaryOp(Negate, V::Neg(a));
+            CaseVectorUnaryOp(Sigmoid, V::Div(V::Set1(1), V::Add(M::Exp(V::Neg(a)), V::Set1(1)))); // same formula as Sigmoid() in TensorOps.h
+            CaseVectorUnaryOp(Tanh, M::Tanh(a));
+            CaseVectorUnaryOp(Exp, M::Exp(a));
+            CaseVectorUnaryOp(Log, V::Select(V::CmpLt(a, V::Set1((ElemType) EPS_IN_LOG)), V::Set1((ElemType) LOG_OF_EPS_IN_LOG), M::Log(a))); // ClippedLog()
+            CaseVectorUnaryOp(LinearRectifier, V::Max(a, V::Zero())); // (max returns the second operand for NaN and for -0, like 'a > 0 ? a : 0')
+            CaseVectorBinaryOp(Sum, V::Add(a, b));
+            CaseVectorBinaryOp(Difference, V::Sub(a, b));
+            CaseVectorBinaryOp(ElementwiseProduct, V::Mul(a, b));
+        default:
+            LogicError("CPUVectorKernels: Op code %d is not vectorized.", (int) op);
+        }
+#undef CaseVectorUnaryOp
+#undef CaseVectorBinaryOp
+    }
+
+    static void ReduceSum(ElemType beta, const ElemType* pa, size_t n, ElemType* pc, ElemType alpha)
+    {
+        // accumulate in double like the scalar code, with independent partial sums per lane
+        typename W::Reg acc[V::numWide];
+        for (size_t k = 0; k < V::numWide; k++)
+            acc[k] = W::Zero();
+        const size_t nv = n - n % V::width;
+        for (size_t i = 0; i < nv; i += V::width)
+        {
+            typename W::Reg wide[V::numWide];
+            V::Widen(V::Load(pa + i), wide);
+            for (size_t k = 0; k < V::numWide; k++)
+                acc[k] = W::Add(acc[k], wide[k]);
+        }
+        double lanes[V::width];
+        for (size_t k = 0; k < V::numWide; k++)
+            W::Store(lanes + k * W::width, acc[k]);
+        double aggregate = 0;
+        for (size_t k = 0; k < V::width; k++)
+            aggregate += lanes[k];
+        for (size_t i = nv; i < n; i++)
+            aggregate += pa[i];
+        ElemType val = (ElemType) aggregate;
+        val *= alpha;
+        if (beta != 0)
+            val += beta * *pc;
+        *pc = val;
+    }
+
+    static void ReduceSumOverColumns(ElemType beta, const ElemType* pa, ptrdiff_t colStride, size_t numCols, ElemType* pc, size_t numRows, ElemType alpha)
+    {
+        // each output element is summed in double in column order, i.e. exactly like the scalar code
+        const size_t nv = numRows - numRows % V::width;
+        const Reg valpha = V::Set1(alpha);
+        const Reg vbeta = V::Set1(beta);
+        for (size_t i = 0; i < nv; i += V::width)
+        {
+            typename W::Reg acc[V::numWide];
+            for (size_t k = 0; k < V::numWide; k++)
+                acc[k] = W::Zero();
+            const ElemType* p = pa + i;
+            for (size_t j = 0; j < numCols; j++, p += colStride)
+            {
+                typename W::Reg wide[V::numWide];
+                V::Widen(V::Load(p), wide);
+                for (size_t k = 0; k < V::numWide; k++)
+                    acc[k] = W::Add(acc[k], wide[k]);
+            }
+            Reg val = V::Mul(V::Narrow(acc), valpha);
+            if (beta != 0)
+                val = V::Add(val, V::Mul(vbeta, V::Load(pc + i)));
+            V::Store(pc + i, val);
+        }
+        for (size_t i = nv; i < numRows; i++)
+        {
+            double aggregate = 0;
+            for (size_t j = 0; j < numCols; j++)
+                aggregate += pa[i + j * colStride];
+            ElemType val = (ElemType) aggregate;
+            val *= alpha;
+            if (beta != 0)
+                val += beta * pc[i];
+            pc[i] = val;
+        }
+    }
+
+    static const CPUVectorKernelTable<ElemType>* GetTable()
+    {
+        static const CPUVectorKernelTable<ElemType> table = {&ElementwiseOp, &ReduceSum, &ReduceSumOverColumns};
+        return &table;
+    }
+};
+} } }
@@ -16,6 +16,7 @@
 
 #include "Basics.h"
 #include <string>
+#include <vector>
 #include <stdint.h>
 
 #define DEVICEID_TYPE int
@@ -167,6 +168,84 @@ enum ElementWiseOperator
     Macro(Cond);                \
     Macro(Clip);
 
+// -----------------------------------------------------------------------
+// FusedElementwiseProgram -- an expression tree of elementwise ops that is
+// evaluated in a single pass over memory (Matrix::FusedElementwiseForward/Backward())
+//
+// Registers [0, m_numInputs) are the inputs. Step k writes register m_numInputs + k
+// and may only read registers below that. The last step's register is the result.
+// Only the ops listed in ForAllFusable{Unary,Binary}Ops() are supported, since the
+// backward pass needs to know their derivatives.
+// -----------------------------------------------------------------------
+
+#define ForAllFusableUnaryOps(Macro) \
+    Macro(Sigmoid);                  \
+    Macro(Tanh);                     \
+    Macro(Exp);                      \
+    Macro(Log);                      \
+    Macro(LinearRectifier);          \
+    Macro(Cosine);
+
+#define ForAllFusableBinaryOps(Macro) \
+    Macro(Sum);                       \
+    Macro(Difference);                \
+    Macro(ElementwiseProduct);
+
+struct FusedElementwiseStep
+{
+    ElementWiseOperator m_op;
+    size_t m_args[2]; // input registers; m_args[1] is unused for unary ops
+};
+
+struct FusedElementwiseProgram
+{
+    size_t m_numInputs;
+    std::vector<FusedElementwiseStep> m_steps;
+
+    FusedElementwiseProgram()
+        : m_numInputs(0)
+    {
+    }
+    size_t GetNumRegisters() const
+    {
+        return m_numInputs + m_steps.size();
+    }
+    static bool IsFusableUnaryOp(ElementWiseOperator op)
+    {
+#define CaseFusableOp(oper) \
+    case op##oper:          \
+        return true;
+        switch (op)
+        {
+            ForAllFusableUnaryOps(CaseFusableOp);
+        default:
+            return false;
+        }
+    }
+    static bool IsFusableBinaryOp(ElementWiseOperator op)
+    {
+        switch (op)
+        {
+            ForAllFusableBinaryOps(CaseFusableOp);
+        default:
+            return false;
+        }
+#undef CaseFusableOp
+    }
+};
+
+// -----------------------------------------------------------------------
+// CPUVectorISA -- instruction set used by the hand-vectorized CPU TensorOp
+// kernels (CPUVectorKernels.h); detected at runtime via CPUID
+// -----------------------------------------------------------------------
+
+enum class CPUVectorISA
+{
+    None,  // scalar code
+    AVX2,  // AVX2 and FMA
+    AVX512 // AVX-512F
+};
+
 // -----------------------------------------------------------------------
 // various enums to describe
 // -----------------------------------------------------------------------
@@ -6,6 +6,7 @@
 #include "stdafx.h"
 #include "ConvolutionEngine.h"
 #include "CuDnnConvolutionEngine.h"
+#include <limits>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -20,8 +21,8 @@ public:
     using typename Base::ConvDesc;
 
 public:
-    DefaultConvolutionEngine(DEVICEID_TYPE deviceId, size_t maxTempMemSizeInSamples)
-        : m_ones(deviceId), m_maxTempMemSizeInSamples(maxTempMemSizeInSamples)
+    DefaultConvolutionEngine(DEVICEID_TYPE deviceId, size_t maxTempMemSizeInSamples, ImageLayoutKind imageLayoutKind)
+        : m_ones(deviceId), m_maxTempMemSizeInSamples(maxTempMemSizeInSamples), m_imageLayoutKind(imageLayoutKind)
     {
     }
 
@@ -283,62 +284,240 @@ public:
         Mat::MultiplyAndAdd(sg.Reshaped(biasT.c(), ccol), false, m_ones, false, biasGrad);
     }
 
+    // Batch normalization on the CPU, with the same conventions as the cuDNN engine:
+    // statistics use the biased variance, InvStdDev = 1 / sqrt(variance + epsilon), and the running
+    // InvStdDev is an exponential average of the minibatch InvStdDev values, just like the running mean.
+    // Per-activation mode normalizes every row over the minibatch; spatial mode normalizes every feature map
+    // over the minibatch and all pixels, where the layout of a sample depends on the image layout (CHW or HWC).
+    // All passes go over the data column by column so that memory is accessed contiguously; statistics are
+    // accumulated per row (in parallel over blocks of rows) and then folded into the normalization channels.
     void NormalizeBatch(const Tensor4D& inT, const Mat& in, const Tensor4D& scaleBiasT, const Mat& scale, const Mat& bias,
                         bool spatial, double expAvgFactor, Mat& runMean, Mat& runInvStdDev, Mat& out, Mat& saveMean, Mat& saveInvStdDev) override
     {
-        UNUSED(inT);
-        UNUSED(in);
-        UNUSED(scaleBiasT);
-        UNUSED(scale);
-        UNUSED(bias);
-        UNUSED(out);
-        UNUSED(spatial);
-        UNUSED(expAvgFactor);
-        UNUSED(runMean);
-        UNUSED(runInvStdDev);
-        UNUSED(saveMean);
-        UNUSED(saveInvStdDev);
-        RuntimeError("Not yet implemented.");
+        size_t numChannels = InitBatchNormChannels(inT, scaleBiasT, in, spatial);
+        assert(scale.GetNumElements() == numChannels && bias.GetNumElements() == numChannels);
+        assert(runMean.GetNumElements() == numChannels && runInvStdDev.GetNumElements() == numChannels);
+        assert(saveMean.GetNumElements() >= numChannels && saveInvStdDev.GetNumElements() >= numChannels);
+        assert(out.GetNumRows() == in.GetNumRows() && out.GetNumCols() == in.GetNumCols());
+
+        size_t crow = in.GetNumRows();
+        size_t ccol = in.GetNumCols();
+        const ElemType* px = in.BufferPointer();
+        double count = (double) crow / numChannels * ccol; // number of values per channel
+
+        // mean
+        SumRows(crow, ccol, [px, crow](size_t r, size_t j) { return (double) px[j * crow + r]; });
+        FoldRowsIntoChannels(numChannels, m_mean);
+        for (size_t c = 0; c < numChannels; c++)
+            m_mean[c] /= count;
+
+        // InvStdDev, from the centered values for numerical stability
+        const size_t* rowChannel = m_rowChannel.data();
+        const double* mean = m_mean.data();
+        SumRows(crow, ccol, [px, crow, rowChannel, mean](size_t r, size_t j)
+                {
+                    double d = px[j * crow + r] - mean[rowChannel[r]];
+                    return d * d;
+                });
+        FoldRowsIntoChannels(numChannels, m_invStdDev);
+        for (size_t c = 0; c < numChannels; c++)
+            m_invStdDev[c] = 1 / sqrt(m_invStdDev[c] / count + BatchNormEpsilon());
+
+        // save the statistics for the backward pass, and update the running statistics
+        ElemType* pSaveMean = saveMean.BufferPointer();
+        ElemType* pSaveInvStdDev = saveInvStdDev.BufferPointer();
+        ElemType* pRunMean = runMean.BufferPointer();
+        ElemType* pRunInvStdDev = runInvStdDev.BufferPointer();
+        for (size_t c = 0; c < numChannels; c++)
+        {
+            pSaveMean[c] = (ElemType) m_mean[c];
+            pSaveInvStdDev[c] = (ElemType) m_invStdDev[c];
+            pRunMean[c] = (ElemType) ((1 - expAvgFactor) * pRunMean[c] + expAvgFactor * m_mean[c]);
+            pRunInvStdDev[c] = (ElemType) ((1 - expAvgFactor) * pRunInvStdDev[c] + expAvgFactor * m_invStdDev[c]);
+        }
+
+        ApplyBatchNorm(in, scale, bias, m_mean.data(), m_invStdDev.data(), out);
     }
 
     void NormalizeBatchInference(const Tensor4D& inT, const Mat& in, const Tensor4D& scaleBiasT, const Mat& scale, const Mat& bias,
                                  bool spatial, const Mat& runMean, const Mat& runInvStdDev, Mat& out) override
     {
-        UNUSED(inT);
-        UNUSED(in);
-        UNUSED(scaleBiasT);
-        UNUSED(scale);
-        UNUSED(bias);
-        UNUSED(out);
-        UNUSED(spatial);
-        UNUSED(runMean);
-        UNUSED(runInvStdDev);
-        RuntimeError("Not yet implemented.");
+        size_t numChannels = InitBatchNormChannels(inT, scaleBiasT, in, spatial);
+        assert(runMean.GetNumElements() == numChannels && runInvStdDev.GetNumElements() == numChannels);
+
+        const ElemType* pRunMean = runMean.BufferPointer();
+        const ElemType* pRunInvStdDev = runInvStdDev.BufferPointer();
+        m_mean.assign(pRunMean, pRunMean + numChannels);
+        m_invStdDev.assign(pRunInvStdDev, pRunInvStdDev + numChannels);
+        ApplyBatchNorm(in, scale, bias, m_mean.data(), m_invStdDev.data(), out);
     }
 
+    // Like the cuDNN engine, this adds to 'grad' and overwrites 'scaleGrad' and 'biasGrad'.
     void BackwardNormalizeBatch(const Tensor4D& inT, const Mat& in, const Mat& srcGrad, Mat& grad,
                                 const Tensor4D& scaleBiasT, const Mat& scale, bool spatial, const Mat& saveMean, const Mat& saveInvStdDev,
                                 Mat& scaleGrad, Mat& biasGrad) override
     {
-        UNUSED(inT);
-        UNUSED(in);
-        UNUSED(srcGrad);
-        UNUSED(grad);
-        UNUSED(scaleBiasT);
-        UNUSED(scale);
-        UNUSED(scaleGrad);
-        UNUSED(biasGrad);
-        UNUSED(spatial);
-        UNUSED(saveMean);
-        UNUSED(saveInvStdDev);
-        RuntimeError("Not yet implemented.");
+        size_t numChannels = InitBatchNormChannels(inT, scaleBiasT, in, spatial);
+        assert(scale.GetNumElements() == numChannels);
+        assert(scaleGrad.GetNumElements() == numChannels && biasGrad.GetNumElements() == numChannels);
+        assert(srcGrad.GetNumRows() == in.GetNumRows() && srcGrad.GetNumCols() == in.GetNumCols());
+        assert(grad.GetNumRows() == in.GetNumRows() && grad.GetNumCols() == in.GetNumCols());
+
+        size_t crow = in.GetNumRows();
+        size_t ccol = in.GetNumCols();
+        const ElemType* px = in.BufferPointer();
+        const ElemType* pdy = srcGrad.BufferPointer();
+        ElemType* pdx = grad.BufferPointer();
+        const ElemType* pSaveMean = saveMean.BufferPointer();
+        const ElemType* pSaveInvStdDev = saveInvStdDev.BufferPointer();
+        const ElemType* pScale = scale.BufferPointer();
+        double count = (double) crow / numChannels * ccol;
+
+        // bias gradient = sum of dy; scale gradient = sum of dy * xHat
+        SumRows(crow, ccol, [pdy, crow](size_t r, size_t j) { return (double) pdy[j * crow + r]; });
+        FoldRowsIntoChannels(numChannels, m_mean); // (reused as buffer for the bias gradient)
+        const size_t* rowChannel = m_rowChannel.data();
+        SumRows(crow, ccol, [px, pdy, crow, rowChannel, pSaveMean, pSaveInvStdDev](size_t r, size_t j)
+                {
+                    size_t c = rowChannel[r];
+                    return (double) pdy[j * crow + r] * (px[j * crow + r] - pSaveMean[c]) * pSaveInvStdDev[c];
+                });
+        FoldRowsIntoChannels(numChannels, m_invStdDev); // (reused as buffer for the scale gradient)
+        ElemType* pBiasGrad = biasGrad.BufferPointer();
+        ElemType* pScaleGrad = scaleGrad.BufferPointer();
+        for (size_t c = 0; c < numChannels; c++)
+        {
+            pBiasGrad[c] = (ElemType) m_mean[c];
+            pScaleGrad[c] = (ElemType) m_invStdDev[c];
+        }
+
+        // dx = scale * InvStdDev * (dy - (biasGrad + xHat * scaleGrad) / count), with per-row coefficients
+        m_rowCoefficients.resize(4 * crow);
+        ElemType* k = m_rowCoefficients.data();
+        ElemType* m = k + crow;
+        ElemType* db = m + crow;
+        ElemType* ds = db + crow;
+        for (size_t r = 0; r < crow; r++)
+        {
+            size_t c = rowChannel[r];
+            k[r] = (ElemType) (pScale[c] * pSaveInvStdDev[c]);
+            m[r] = pSaveMean[c];
+            db[r] = (ElemType) (m_mean[c] / count);
+            ds[r] = (ElemType) (m_invStdDev[c] / count * pSaveInvStdDev[c]);
+        }
+#pragma omp parallel for
+        for (long j = 0; j < (long) ccol; j++)
+        {
+            const ElemType* x = px + j * crow;
+            const ElemType* dy = pdy + j * crow;
+            ElemType* dx = pdx + j * crow;
+            for (size_t r = 0; r < crow; r++)
+                dx[r] += k[r] * (dy[r] - db[r] - (x[r] - m[r]) * ds[r]);
+        }
     }
 
 private:
+    static double BatchNormEpsilon()
+    {
+        return 1e-5; // = CUDNN_BN_MIN_EPSILON, which the cuDNN engine uses
+    }
+
+    // determine the normalization channel of each row of a sample (m_rowChannel), and return the number of channels
+    size_t InitBatchNormChannels(const Tensor4D& inT, const Tensor4D& scaleBiasT, const Mat& in, bool spatial)
+    {
+        if (in.GetCurrentMatrixLocation() == CurrentDataLocation::GPU || in.GetMatrixType() != MatrixType::DENSE)
+            RuntimeError("Batch normalization with the legacy engine is only implemented for dense matrices on the CPU, use the cuDNN engine on the GPU.");
+        size_t crow = inT.w() * inT.h() * inT.c();
+        assert(crow == in.GetNumRows());
+        assert(inT.n() == in.GetNumCols());
+        UNUSED(scaleBiasT);
+        if (spatial)
+            assert(scaleBiasT.c() == inT.c() && scaleBiasT.w() == 1 && scaleBiasT.h() == 1);
+        else
+            assert(scaleBiasT.w() * scaleBiasT.h() * scaleBiasT.c() == crow);
+        m_rowChannel.resize(crow);
+        size_t mapSize = inT.w() * inT.h();
+        for (size_t r = 0; r < crow; r++)
+        {
+            if (!spatial)
+                m_rowChannel[r] = r;
+            else if (m_imageLayoutKind == ImageLayoutKind::CHW)
+                m_rowChannel[r] = r / mapSize;
+            else
+                m_rowChannel[r] = r % inT.c();
+        }
+        return spatial ? inT.c() : crow;
+    }
+
+    // m_rowSums[r] = sum over all columns j of f(r, j)
+    // Parallel over blocks of rows; each block goes through all columns, so that the reads are contiguous.
+    template <class F>
+    void SumRows(size_t crow, size_t ccol, const F& f)
+    {
+        const size_t blockSize = 256;
+        m_rowSums.assign(crow, 0);
+        double* sums = m_rowSums.data();
+        long numBlocks = (long) ((crow + blockSize - 1) / blockSize);
+#pragma omp parallel for
+        for (long b = 0; b < numBlocks; b++)
+        {
+            size_t begin = b * blockSize;
+            size_t end = min(crow, begin + blockSize);
+            for (size_t j = 0; j < ccol; j++)
+                for (size_t r = begin; r < end; r++)
+                    sums[r] += f(r, j);
+        }
+    }
+
+    void FoldRowsIntoChannels(size_t numChannels, vector<double>& channelSums) const
+    {
+        channelSums.assign(numChannels, 0);
+        for (size_t r = 0; r < m_rowSums.size(); r++)
+            channelSums[m_rowChannel[r]] += m_rowSums[r];
+    }
+
+    // out = scale * (in - mean) * invStdDev + bias = a * in + b, with per-row coefficients a and b
+    void ApplyBatchNorm(const Mat& in, const Mat& scale, const Mat& bias, const double* mean, const double* invStdDev, Mat& out)
+    {
+        size_t crow = in.GetNumRows();
+        size_t ccol = in.GetNumCols();
+        const ElemType* pScale = scale.BufferPointer();
+        const ElemType* pBias = bias.BufferPointer();
+        m_rowCoefficients.resize(2 * crow);
+        ElemType* a = m_rowCoefficients.data();
+        ElemType* b = a + crow;
+        for (size_t r = 0; r < crow; r++)
+        {
+            size_t c = m_rowChannel[r];
+            a[r] = (ElemType) (pScale[c] * invStdDev[c]);
+            b[r] = (ElemType) (pBias[c] - mean[c] * pScale[c] * invStdDev[c]);
+        }
+        const ElemType* px = in.BufferPointer();
+        ElemType* py = out.BufferPointer();
+#pragma omp parallel for
+        for (long j = 0; j < (long) ccol; j++)
+        {
+            const ElemType* x = px + j * crow;
+            ElemType* y = py + j * crow;
+            for (size_t r = 0; r < crow; r++)
+                y[r] = a[r] * x[r] + b[r];
+        }
+    }
+
+protected:
     size_t m_maxTempMemSizeInSamples;
     Mat m_ones;
     bool m_gpuSparseOpt;
     bool m_gpuSparse1D;
+    ImageLayoutKind m_imageLayoutKind;
+
+private:
+    // batch normalization buffers
+    vector<size_t> m_rowChannel; // [row of a sample] -> normalization channel
+    vector<double> m_rowSums;
+    vector<double> m_mean;
+    vector<double> m_invStdDev;
+    vector<ElemType> m_rowCoefficients;
 };
 
 template class ConvolutionEngine<float>;
@@ -409,6 +588,877 @@ public:
 template class PoolingEngine<float>;
 template class PoolingEngine<double>;
 
+// -----------------------------------------------------------------------
+// CpuConvolutionEngine -- convolution and pooling on the CPU for both image layouts
+//
+// All kernels work on planar images: a sample is [C x H x W] (W fastest) and a filter is
+// [K x C x kH x kW], which is the cuDNN (CHW) layout, so CHW data is used in place. Legacy HWC data
+// (channel fastest, then row, then column) is converted to planar and back around the kernels,
+// which is cheap compared to the convolution itself.
+// Forward picks one of three algorithms based on the filter size and stride:
+//  - Winograd F(2x2, 3x3) for 3x3 filters with stride 1 and enough channels to amortize the transforms:
+//    2.25x fewer multiplications, done as 16 GEMMs over all tiles of a sub-batch
+//  - direct convolution for filters with few input values per output (e.g. the first layer of an RGB
+//    image), where GEMM would have a short inner dimension on an unrolled input kW * kH times the image;
+//    it accumulates output rows for a block of output channels at a time, so every input row is read once per block
+//  - unrolling (im2col) followed by GEMM otherwise; 1x1 filters with stride 1 skip the unrolling
+// Backprop uses unrolling and GEMM. The padding convention is the same as for the other engines
+// (kW / 2 and kH / 2 on both sides), and gradients are accumulated, like cuDNN does.
+// -----------------------------------------------------------------------
+
+// strides of a sample's pixels and channels in a given image layout
+struct ImageStrides
+{
+    size_t x, y, c; // column, row, channel
+
+    ImageStrides(const ConvolutionTensor4D& t, ImageLayoutKind imageLayoutKind)
+    {
+        if (imageLayoutKind == ImageLayoutKind::CHW)
+        {
+            x = 1;
+            y = t.w();
+            c = t.w() * t.h();
+        }
+        else // legacy HWC: channel, then row, then column
+        {
+            c = 1;
+            y = t.c();
+            x = t.c() * t.h();
+        }
+    }
+};
+
+template <class ElemType>
+class CpuConvolutionEngine : public DefaultConvolutionEngine<ElemType>
+{
+public:
+    using Base = DefaultConvolutionEngine<ElemType>;
+    using typename Base::Mat;
+    using typename Base::Tensor4D;
+    using typename Base::Filter;
+    using typename Base::ConvDesc;
+
+    enum class Algorithm
+    {
+        Gemm,
+        Direct,
+        Winograd
+    };
+
+public:
+    CpuConvolutionEngine(DEVICEID_TYPE deviceId, size_t maxTempMemSizeInSamples, ImageLayoutKind imageLayoutKind)
+        : Base(deviceId, maxTempMemSizeInSamples, imageLayoutKind), m_denseInput(CPUDEVICE)
+    {
+        if (deviceId != CPUDEVICE)
+            InvalidArgument("CpuConvolutionEngine: The CPU convolution engine cannot be used on device %d.", (int) deviceId);
+    }
+
+public:
+    void Forward(const Tensor4D& inT, const Mat& in, const Filter& filterT, const Mat& filter, const ConvDesc& convDesc,
+                 const Tensor4D& outT, Mat& out, Mat& workspace) override
+    {
+        assert(inT.w() * inT.h() * inT.c() == in.GetNumRows());
+        assert(inT.n() == in.GetNumCols());
+        assert(filterT.k() == filter.GetNumRows());
+        assert(filterT.w() * filterT.h() * filterT.c() == filter.GetNumCols());
+        assert(inT.c() == filterT.c());
+        assert(outT.c() == filterT.k());
+        assert(outT.w() * outT.h() * outT.c() == out.GetNumRows());
+        assert(outT.n() == out.GetNumCols());
+
+        Geometry g(inT, filterT, convDesc, outT);
+        const ElemType* x = DenseInput(in).BufferPointer();
+        const ElemType* w = PlanarFilter(filter, g);
+        out.SwitchToMatrixType(MatrixType::DENSE, MatrixFormat::matrixFormatDense, false);
+        ElemType* y = out.BufferPointer();
+
+        Algorithm algorithm = ChooseAlgorithm(g);
+        size_t batchSize = inT.n();
+        size_t subBatchSize = SubBatchSize(batchSize, algorithm == Algorithm::Winograd ? g.WinogradElementsPerSample() : 0);
+        for (size_t start = 0; start < batchSize; start += subBatchSize)
+        {
+            size_t numSamples = min(subBatchSize, batchSize - start);
+            const ElemType* xs = PlanarInput(x + start * g.InSize(), numSamples, inT);
+            ElemType* ys = IsPlanar() ? y + start * g.OutSize() : PlanarBuffer(m_planarOut, numSamples * g.OutSize());
+            if (algorithm == Algorithm::Winograd)
+                ForwardWinograd(g, xs, w, ys, numSamples);
+            else if (algorithm == Algorithm::Direct)
+                ForwardDirect(g, xs, w, ys, numSamples);
+            else
+                ForwardGemm(g, xs, w, ys, numSamples, workspace);
+            if (!IsPlanar())
+                FromPlanar(ys, y + start * g.OutSize(), numSamples, outT, false);
+        }
+    }
+
+    // the planar filter as [(C * kH * kW) x K], quantized per output channel
+    std::shared_ptr<QuantizedWeights<ElemType>> QuantizeFilter(const Filter& filterT, const Mat& filter, size_t numBits) override
+    {
+        assert(filterT.k() == filter.GetNumRows());
+        assert(filterT.w() * filterT.h() * filterT.c() == filter.GetNumCols());
+
+        if (filter.GetCurrentMatrixLocation() == CurrentDataLocation::GPU || filter.GetMatrixType() != MatrixType::DENSE)
+            RuntimeError("CpuConvolutionEngine: The filter must be a dense matrix on the CPU.");
+        Geometry g(filterT);
+        return std::make_shared<QuantizedWeights<ElemType>>(PlanarFilter(filter, g), g.PatchSize(), g.outC, /*kStride=*/1, /*mStride=*/g.PatchSize(), numBits);
+    }
+
+    // like ForwardGemm() with the quantized product; the patch of each output pixel is quantized with its own scale
+    void ForwardQuantized(const Tensor4D& inT, const Mat& in, const Filter& filterT, const QuantizedWeights<ElemType>& filter, const ConvDesc& convDesc,
+                          const Tensor4D& outT, Mat& out, Mat& workspace) override
+    {
+        assert(inT.w() * inT.h() * inT.c() == in.GetNumRows());
+        assert(inT.n() == in.GetNumCols());
+        assert(outT.w() * outT.h() * outT.c() == out.GetNumRows());
+        assert(outT.n() == out.GetNumCols());
+
+        Geometry g(inT, filterT, convDesc, outT);
+        if (filter.GetNumInputs() != g.PatchSize() || filter.GetNumOutputs() != g.outC)
+            LogicError("CpuConvolutionEngine: The quantized filter does not match the convolution.");
+        const ElemType* x = DenseInput(in).BufferPointer();
+        out.SwitchToMatrixType(MatrixType::DENSE, MatrixFormat::matrixFormatDense, false);
+        ElemType* y = out.BufferPointer();
+
+        size_t batchSize = inT.n();
+        size_t subBatchSize = SubBatchSize(batchSize, 0);
+        for (size_t start = 0; start < batchSize; start += subBatchSize)
+        {
+            size_t numSamples = min(subBatchSize, batchSize - start);
+            const ElemType* xs = PlanarInput(x + start * g.InSize(), numSamples, inT);
+            ElemType* ys = IsPlanar() ? y + start * g.OutSize() : PlanarBuffer(m_planarOut, numSamples * g.OutSize());
+            for (size_t s = 0; s < numSamples; s++)
+            {
+                const ElemType* cols = xs + s * g.InSize();
+                if (!g.IsPointwise())
+                {
+                    ElemType* unrolled = Workspace(workspace, g.OutPixels(), g.PatchSize());
+                    Im2Col(g, cols, unrolled);
+                    cols = unrolled;
+                }
+                // the unrolled input is [outPixels x (C * kH * kW)]: each pixel is a column of the product
+                filter.Multiply(cols, g.OutPixels(), 1, g.OutPixels(), ys + s * g.OutSize(), g.OutPixels(), 1);
+            }
+            if (!IsPlanar())
+                FromPlanar(ys, y + start * g.OutSize(), numSamples, outT, false);
+        }
+    }
+
+    void BackwardData(const Tensor4D& srcGradT, const Mat& srcGrad, const Filter& filterT, const Mat& filter, const ConvDesc& convDesc,
+                      const Tensor4D& gradT, Mat& grad, Mat& workspace) override
+    {
+        assert(srcGradT.w() * srcGradT.h() * srcGradT.c() == srcGrad.GetNumRows());
+        assert(srcGradT.n() == srcGrad.GetNumCols());
+        assert(filterT.k() == filter.GetNumRows());
+        assert(filterT.w() * filterT.h() * filterT.c() == filter.GetNumCols());
+        assert(srcGradT.c() == filterT.k());
+        assert(gradT.c() == filterT.c());
+        assert(gradT.w() * gradT.h() * gradT.c() == grad.GetNumRows());
+        assert(gradT.n() == grad.GetNumCols());
+
+        Geometry g(gradT, filterT, convDesc, srcGradT);
+        const ElemType* dy = DenseInput(srcGrad).BufferPointer();
+        const ElemType* w = PlanarFilter(filter, g);
+        ElemType* dx = grad.BufferPointer();
+
+        size_t batchSize = srcGradT.n();
+        size_t subBatchSize = SubBatchSize(batchSize, 0);
+        for (size_t start = 0; start < batchSize; start += subBatchSize)
+        {
+            size_t numSamples = min(subBatchSize, batchSize - start);
+            const ElemType* dys = IsPlanar() ? dy + start * g.OutSize() : ToPlanar(dy + start * g.OutSize(), numSamples, srcGradT, m_planarOut);
+            ElemType* dxs = dx + start * g.InSize();
+            if (!IsPlanar()) // gradients are accumulated into a zeroed planar buffer, then added to the HWC gradient
+            {
+                dxs = PlanarBuffer(m_planarIn, numSamples * g.InSize());
+                fill(dxs, dxs + numSamples * g.InSize(), (ElemType) 0);
+            }
+            for (size_t s = 0; s < numSamples; s++)
+            {
+                // dx += col2im(dy * W), with W as [(C * kH * kW) x K]
+                if (g.IsPointwise())
+                    Gemm(g.OutPixels(), g.inC, g.outC, dys + s * g.OutSize(), false, w, true, 1, dxs + s * g.InSize());
+                else
+                {
+                    ElemType* cols = Workspace(workspace, g.OutPixels(), g.PatchSize());
+                    Gemm(g.OutPixels(), g.PatchSize(), g.outC, dys + s * g.OutSize(), false, w, true, 0, cols);
+                    Col2Im(g, cols, dxs + s * g.InSize());
+                }
+            }
+            if (!IsPlanar())
+                FromPlanar(dxs, dx + start * g.InSize(), numSamples, gradT, true);
+        }
+    }
+
+    void BackwardFilter(const Tensor4D& srcGradT, const Mat& srcGrad, const Tensor4D& inT, const Mat& in, const ConvDesc& convDesc,
+                        const Filter& filterT, Mat& filter, bool /*allowReuse*/, Mat& workspace) override
+    {
+        assert(srcGradT.w() * srcGradT.h() * srcGradT.c() == srcGrad.GetNumRows());
+        assert(srcGradT.n() == srcGrad.GetNumCols());
+        assert(inT.w() * inT.h() * inT.c() == in.GetNumRows());
+        assert(inT.n() == in.GetNumCols());
+        assert(srcGradT.c() == filterT.k());
+        assert(inT.c() == filterT.c());
+        assert(filterT.k() == filter.GetNumRows());
+        assert(filterT.w() * filterT.h() * filterT.c() == filter.GetNumCols());
+
+        // Forward may not have unrolled the input, so the workspace is never reused.
+        Geometry g(inT, filterT, convDesc, srcGradT);
+        const ElemType* x = DenseInput(in).BufferPointer();
+        const ElemType* dy = DenseInput(srcGrad).BufferPointer();
+        ElemType* dw = filter.BufferPointer();
+        if (!IsPlanar()) // accumulate into a zeroed planar filter, then add it to the HWC filter gradient
+        {
+            dw = PlanarBuffer(m_planarFilter, g.FilterSize());
+            fill(dw, dw + g.FilterSize(), (ElemType) 0);
+        }
+
+        size_t batchSize = inT.n();
+        size_t subBatchSize = SubBatchSize(batchSize, 0);
+        for (size_t start = 0; start < batchSize; start += subBatchSize)
+        {
+            size_t numSamples = min(subBatchSize, batchSize - start);
+            const ElemType* xs = PlanarInput(x + start * g.InSize(), numSamples, inT);
+            const ElemType* dys = IsPlanar() ? dy + start * g.OutSize() : ToPlanar(dy + start * g.OutSize(), numSamples, srcGradT, m_planarOut);
+            for (size_t s = 0; s < numSamples; s++)
+            {
+                // dW += im2col(x)' * dy, with dW as [(C * kH * kW) x K]
+                const ElemType* cols = xs + s * g.InSize();
+                if (!g.IsPointwise())
+                {
+                    ElemType* unrolled = Workspace(workspace, g.OutPixels(), g.PatchSize());
+                    Im2Col(g, cols, unrolled);
+                    cols = unrolled;
+                }
+                Gemm(g.PatchSize(), g.outC, g.OutPixels(), cols, true, dys + s * g.OutSize(), false, 1, dw);
+            }
+        }
+        if (!IsPlanar())
+            AddPlanarFilter(dw, g, filter.BufferPointer());
+    }
+
+    void AddBias(const Tensor4D& outT, const Mat& out, const Tensor4D& biasT, const Mat& bias, Mat& dst) override
+    {
+        if (!IsPlanar())
+        {
+            Base::AddBias(outT, out, biasT, bias, dst);
+            return;
+        }
+
+        assert(biasT.c() == outT.c());
+        assert(bias.GetNumRows() == biasT.c());
+        assert(bias.GetNumCols() == 1);
+        assert(outT.w() * outT.h() * outT.c() == out.GetNumRows());
+        assert(outT.n() == out.GetNumCols());
+        UNUSED(biasT);
+
+        size_t mapSize = outT.w() * outT.h();
+        const ElemType* x = out.BufferPointer();
+        const ElemType* b = bias.BufferPointer();
+        ElemType* y = dst.BufferPointer();
+        long numMaps = (long) (outT.c() * outT.n());
+#pragma omp parallel for
+        for (long m = 0; m < numMaps; m++)
+        {
+            ElemType v = b[m % outT.c()];
+            for (size_t i = m * mapSize; i < (m + 1) * mapSize; i++)
+                y[i] = x[i] + v;
+        }
+    }
+
+    void BackwardBias(const Tensor4D& srcGradT, const Mat& srcGrad, const Tensor4D& biasT, Mat& biasGrad) override
+    {
+        if (!IsPlanar())
+        {
+            Base::BackwardBias(srcGradT, srcGrad, biasT, biasGrad);
+            return;
+        }
+
+        assert(biasT.c() == srcGradT.c());
+        assert(biasGrad.GetNumRows() == biasT.c());
+        assert(biasGrad.GetNumCols() == 1);
+        UNUSED(biasT);
+
+        size_t mapSize = srcGradT.w() * srcGradT.h();
+        size_t numChannels = srcGradT.c();
+        const ElemType* dy = srcGrad.BufferPointer();
+        ElemType* db = biasGrad.BufferPointer();
+#pragma omp parallel for
+        for (long c = 0; c < (long) numChannels; c++)
+        {
+            double sum = 0;
+            for (size_t s = 0; s < srcGradT.n(); s++)
+            {
+                const ElemType* map = dy + (s * numChannels + c) * mapSize;
+                for (size_t i = 0; i < mapSize; i++)
+                    sum += map[i];
+            }
+            db[c] += (ElemType) sum;
+        }
+    }
+
+private:
+    // sizes of a convolution, with the input, output, and filter in the planar layout
+    struct Geometry
+    {
+        size_t inW, inH, inC;
+        size_t outW, outH, outC;
+        size_t kW, kH;
+        size_t sW, sH;
+        size_t padW, padH;
+
+        Geometry(const Tensor4D& inT, const Filter& filterT, const ConvDesc& convDesc, const Tensor4D& outT)
+            : inW(inT.w()), inH(inT.h()), inC(inT.c()), outW(outT.w()), outH(outT.h()), outC(outT.c()), kW(filterT.w()), kH(filterT.h()), sW(convDesc.wStride()), sH(convDesc.hStride()), padW(convDesc.padding() ? filterT.w() / 2 : 0), padH(convDesc.padding() ? filterT.h() / 2 : 0)
+        {
+        }
+        // the sizes of the filter only, as needed by PlanarFilter()
+        explicit Geometry(const Filter& filterT)
+            : inW(0), inH(0), inC(filterT.c()), outW(0), outH(0), outC(filterT.k()), kW(filterT.w()), kH(filterT.h()), sW(1), sH(1), padW(0), padH(0)
+        {
+        }
+
+        size_t InSize() const
+        {
+            return inW * inH * inC;
+        }
+        size_t OutSize() const
+        {
+            return outW * outH * outC;
+        }
+        size_t OutPixels() const
+        {
+            return outW * outH;
+        }
+        size_t PatchSize() const
+        {
+            return inC * kH * kW;
+        }
+        size_t FilterSize() const
+        {
+            return PatchSize() * outC;
+        }
+        // 1x1 filter with stride 1: the input already is the unrolled input
+        bool IsPointwise() const
+        {
+            return kW == 1 && kH == 1 && sW == 1 && sH == 1;
+        }
+        size_t TilesW() const
+        {
+            return (outW + 1) / 2;
+        }
+        size_t TilesH() const
+        {
+            return (outH + 1) / 2;
+        }
+        size_t WinogradElementsPerSample() const
+        {
+            return 16 * TilesW() * TilesH() * (inC + outC);
+        }
+    };
+
+    Algorithm ChooseAlgorithm(const Geometry& g) const
+    {
+        if (g.kW == 3 && g.kH == 3 && g.sW == 1 && g.sH == 1 && g.inC >= 16 && g.outC >= 16)
+            return Algorithm::Winograd;
+        else if (g.PatchSize() <= 32 && !g.IsPointwise())
+            return Algorithm::Direct;
+        else
+            return Algorithm::Gemm;
+    }
+
+    bool IsPlanar() const
+    {
+        return m_imageLayoutKind == ImageLayoutKind::CHW;
+    }
+
+    // number of samples processed at once, bounded by maxTempMemSizeInSamples and by the size of the Winograd buffers
+    size_t SubBatchSize(size_t batchSize, size_t tempElementsPerSample) const
+    {
+        const size_t maxTempElements = 1 << 26;
+        size_t subBatchSize = m_maxTempMemSizeInSamples == 0 ? batchSize : min(batchSize, m_maxTempMemSizeInSamples);
+        if (tempElementsPerSample > 0)
+            subBatchSize = min(subBatchSize, max((size_t) 1, maxTempElements / tempElementsPerSample));
+        return max((size_t) 1, subBatchSize);
+    }
+
+    // sparse input (e.g. text) is converted to dense, like the legacy engine does
+    const Mat& DenseInput(const Mat& in)
+    {
+        if (in.GetCurrentMatrixLocation() == CurrentDataLocation::GPU)
+            RuntimeError("CpuConvolutionEngine: The input is on the GPU.");
+        if (in.GetMatrixType() == MatrixType::DENSE)
+            return in;
+        m_denseInput.SetValue(in);
+        m_denseInput.SwitchToMatrixType(MatrixType::DENSE, MatrixFormat::matrixFormatDense, true);
+        return m_denseInput;
+    }
+
+    static ElemType* PlanarBuffer(vector<ElemType>& buffer, size_t size)
+    {
+        if (buffer.size() < size)
+            buffer.resize(size);
+        return buffer.data();
+    }
+
+    static ElemType* Workspace(Mat& workspace, size_t rows, size_t cols)
+    {
+        workspace.SwitchToMatrixType(MatrixType::DENSE, MatrixFormat::matrixFormatDense, false);
+        workspace.Resize(rows, cols);
+        return workspace.BufferPointer();
+    }
+
+    // planar copy of HWC samples (or the samples themselves if they are CHW)
+    const ElemType* PlanarInput(const ElemType* x, size_t numSamples, const Tensor4D& t)
+    {
+        return IsPlanar() ? x : ToPlanar(x, numSamples, t, m_planarIn);
+    }
+
+    const ElemType* ToPlanar(const ElemType* x, size_t numSamples, const Tensor4D& t, vector<ElemType>& buffer) const
+    {
+        size_t sampleSize = t.w() * t.h() * t.c();
+        ElemType* planar = PlanarBuffer(buffer, numSamples * sampleSize);
+        ImageStrides strides(t, m_imageLayoutKind);
+        long numMaps = (long) (numSamples * t.c());
+#pragma omp parallel for
+        for (long m = 0; m < numMaps; m++)
+        {
+            const ElemType* src = x + (m / t.c()) * sampleSize + (m % t.c()) * strides.c;
+            ElemType* dst = planar + m * t.w() * t.h();
+            for (size_t iy = 0; iy < t.h(); iy++)
+                for (size_t ix = 0; ix < t.w(); ix++)
+                    dst[iy * t.w() + ix] = src[iy * strides.y + ix * strides.x];
+        }
+        return planar;
+    }
+
+    void FromPlanar(const ElemType* planar, ElemType* x, size_t numSamples, const Tensor4D& t, bool add) const
+    {
+        size_t sampleSize = t.w() * t.h() * t.c();
+        ImageStrides strides(t, m_imageLayoutKind);
+        long numMaps = (long) (numSamples * t.c());
+#pragma omp parallel for
+        for (long m = 0; m < numMaps; m++)
+        {
+            const ElemType* src = planar + m * t.w() * t.h();
+            ElemType* dst = x + (m / t.c()) * sampleSize + (m % t.c()) * strides.c;
+            for (size_t iy = 0; iy < t.h(); iy++)
+            {
+                for (size_t ix = 0; ix < t.w(); ix++)
+                {
+                    ElemType& v = dst[iy * strides.y + ix * strides.x];
+                    v = add ? v + src[iy * t.w() + ix] : src[iy * t.w() + ix];
+                }
+            }
+        }
+    }
+
+    // Filters are [K x (C * kH * kW)] matrices. In CHW their buffer is the planar filter [K x C x kH x kW]
+    // (like cuDNN expects it); in HWC the columns are ordered (c, column, row) as the legacy unrolling expects.
+    size_t LegacyFilterIndex(const Geometry& g, size_t k, size_t c, size_t ky, size_t kx) const
+    {
+        return k + g.outC * ((c * g.kW + kx) * g.kH + ky);
+    }
+
+    const ElemType* PlanarFilter(const Mat& filter, const Geometry& g)
+    {
+        if (IsPlanar())
+            return filter.BufferPointer();
+        const ElemType* src = filter.BufferPointer();
+        ElemType* dst = PlanarBuffer(m_planarFilter, g.FilterSize());
+        for (size_t k = 0; k < g.outC; k++)
+            for (size_t c = 0; c < g.inC; c++)
+                for (size_t ky = 0; ky < g.kH; ky++)
+                    for (size_t kx = 0; kx < g.kW; kx++)
+                        dst[((k * g.inC + c) * g.kH + ky) * g.kW + kx] = src[LegacyFilterIndex(g, k, c, ky, kx)];
+        return dst;
+    }
+
+    void AddPlanarFilter(const ElemType* planar, const Geometry& g, ElemType* filter) const
+    {
+        for (size_t k = 0; k < g.outC; k++)
+            for (size_t c = 0; c < g.inC; c++)
+                for (size_t ky = 0; ky < g.kH; ky++)
+                    for (size_t kx = 0; kx < g.kW; kx++)
+                        filter[LegacyFilterIndex(g, k, c, ky, kx)] += planar[((k * g.inC + c) * g.kH + ky) * g.kW + kx];
+    }
+
+    // c = op(a) * op(b) + beta * c, with column-major CPU buffers; c is [m x n]
+    static void Gemm(size_t m, size_t n, size_t k, const ElemType* a, bool transposeA, const ElemType* b, bool transposeB, ElemType beta, ElemType* c)
+    {
+        Mat matA(transposeA ? k : m, transposeA ? m : k, const_cast<ElemType*>(a), matrixFlagDontOwnBuffer, CPUDEVICE);
+        Mat matB(transposeB ? n : k, transposeB ? k : n, const_cast<ElemType*>(b), matrixFlagDontOwnBuffer, CPUDEVICE);
+        Mat matC(m, n, c, matrixFlagDontOwnBuffer, CPUDEVICE);
+        Mat::MultiplyAndWeightedAdd(1, matA, transposeA, matB, transposeB, beta, matC);
+    }
+
+    // range [begin, end) of output positions whose input position o * stride + k - pad lies within [0, size)
+    static void ValidOutputRange(size_t k, size_t pad, size_t stride, size_t size, size_t numOutputs, size_t& begin, size_t& end)
+    {
+        begin = k < pad ? (pad - k + stride - 1) / stride : 0;
+        end = size + pad > k ? min(numOutputs, (size + pad - k - 1) / stride + 1) : 0;
+        end = max(begin, end);
+    }
+
+    // unroll a planar sample into cols, an [outPixels x (C * kH * kW)] column-major matrix
+    static void Im2Col(const Geometry& g, const ElemType* x, ElemType* cols)
+    {
+        long patchSize = (long) g.PatchSize();
+#pragma omp parallel for
+        for (long r = 0; r < patchSize; r++)
+        {
+            size_t kx = r % g.kW;
+            size_t ky = (r / g.kW) % g.kH;
+            size_t c = r / (g.kW * g.kH);
+            const ElemType* plane = x + c * g.inH * g.inW;
+            ElemType* dst = cols + r * g.OutPixels();
+            size_t oxBegin, oxEnd;
+            ValidOutputRange(kx, g.padW, g.sW, g.inW, g.outW, oxBegin, oxEnd);
+            for (size_t oy = 0; oy < g.outH; oy++)
+            {
+                ElemType* row = dst + oy * g.outW;
+                long iy = (long) (oy * g.sH + ky) - (long) g.padH;
+                if (iy < 0 || iy >= (long) g.inH)
+                {
+                    fill(row, row + g.outW, (ElemType) 0);
+                    continue;
+                }
+                const ElemType* src = plane + iy * g.inW + ((ptrdiff_t) kx - (ptrdiff_t) g.padW); // only dereferenced for valid positions
+                fill(row, row + oxBegin, (ElemType) 0);
+                for (size_t ox = oxBegin; ox < oxEnd; ox++)
+                    row[ox] = src[ox * g.sW];
+                fill(row + oxEnd, row + g.outW, (ElemType) 0);
+            }
+        }
+    }
+
+    // inverse of Im2Col: add the unrolled values back to the planar sample
+    static void Col2Im(const Geometry& g, const ElemType* cols, ElemType* x)
+    {
+#pragma omp parallel for
+        for (long c = 0; c < (long) g.inC; c++) // each thread owns a channel
+        {
+            ElemType* plane = x + c * g.inH * g.inW;
+            for (size_t ky = 0; ky < g.kH; ky++)
+            {
+                for (size_t kx = 0; kx < g.kW; kx++)
+                {
+                    const ElemType* src = cols + ((c * g.kH + ky) * g.kW + kx) * g.OutPixels();
+                    size_t oxBegin, oxEnd;
+                    ValidOutputRange(kx, g.padW, g.sW, g.inW, g.outW, oxBegin, oxEnd);
+                    for (size_t oy = 0; oy < g.outH; oy++)
+                    {
+                        long iy = (long) (oy * g.sH + ky) - (long) g.padH;
+                        if (iy < 0 || iy >= (long) g.inH)
+                            continue;
+                        ElemType* dst = plane + iy * g.inW + ((ptrdiff_t) kx - (ptrdiff_t) g.padW);
+                        for (size_t ox = oxBegin; ox < oxEnd; ox++)
+                            dst[ox * g.sW] += src[oy * g.outW + ox];
+                    }
+                }
+            }
+        }
+    }
+
+    // y = im2col(x) * W, one sample at a time, with W as [(C * kH * kW) x K]; the result is the planar [K x outH x outW] output
+    void ForwardGemm(const Geometry& g, const ElemType* x, const ElemType* w, ElemType* y, size_t numSamples, Mat& workspace)
+    {
+        for (size_t s = 0; s < numSamples; s++)
+        {
+            const ElemType* cols = x + s * g.InSize();
+            if (!g.IsPointwise())
+            {
+                ElemType* unrolled = Workspace(workspace, g.OutPixels(), g.PatchSize());
+                Im2Col(g, cols, unrolled);
+                cols = unrolled;
+            }
+            Gemm(g.OutPixels(), g.outC, g.PatchSize(), cols, false, w, false, 0, y + s * g.OutSize());
+        }
+    }
+
+    // direct convolution; every task computes one output row of a block of output channels
+    static void ForwardDirect(const Geometry& g, const ElemType* x, const ElemType* w, ElemType* y, size_t numSamples)
+    {
+        const size_t channelBlock = 4;
+        size_t numChannelBlocks = (g.outC + channelBlock - 1) / channelBlock;
+        long numTasks = (long) (numSamples * numChannelBlocks * g.outH);
+#pragma omp parallel for
+        for (long t = 0; t < numTasks; t++)
+        {
+            size_t oy = t % g.outH;
+            size_t k0 = ((t / g.outH) % numChannelBlocks) * channelBlock;
+            size_t k1 = min(g.outC, k0 + channelBlock);
+            size_t s = t / (g.outH * numChannelBlocks);
+            const ElemType* xs = x + s * g.InSize();
+            ElemType* ys = y + s * g.OutSize() + oy * g.outW;
+            for (size_t k = k0; k < k1; k++)
+                fill(ys + k * g.OutPixels(), ys + k * g.OutPixels() + g.outW, (ElemType) 0);
+            for (size_t c = 0; c < g.inC; c++)
+            {
+                for (size_t ky = 0; ky < g.kH; ky++)
+                {
+                    long iy = (long) (oy * g.sH + ky) - (long) g.padH;
+                    if (iy < 0 || iy >= (long) g.inH)
+                        continue;
+                    const ElemType* row = xs + (c * g.inH + iy) * g.inW;
+                    for (size_t kx = 0; kx < g.kW; kx++)
+                    {
+                        size_t oxBegin, oxEnd;
+                        ValidOutputRange(kx, g.padW, g.sW, g.inW, g.outW, oxBegin, oxEnd);
+                        const ElemType* src = row + ((ptrdiff_t) kx - (ptrdiff_t) g.padW); // only dereferenced for valid positions
+                        for (size_t k = k0; k < k1; k++)
+                        {
+                            ElemType weight = w[((k * g.inC + c) * g.kH + ky) * g.kW + kx];
+                            ElemType* dst = ys + k * g.OutPixels();
+                            for (size_t ox = oxBegin; ox < oxEnd; ox++)
+                                dst[ox] += weight * src[ox * g.sW];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    // Winograd F(2x2, 3x3): Y = A' [(G g G') .* (B' d B)] A for every 4x4 input tile d (stride 2) and 3x3 filter g.
+    // The elementwise products summed over the input channels are 16 GEMMs [K x C] * [C x tiles].
+    void ForwardWinograd(const Geometry& g, const ElemType* x, const ElemType* w, ElemType* y, size_t numSamples)
+    {
+        size_t numTiles = g.TilesW() * g.TilesH() * numSamples;
+        size_t filterSize = g.outC * g.inC;
+        ElemType* u = PlanarBuffer(m_winogradFilter, 16 * filterSize);            // [16] x [K x C]
+        ElemType* v = PlanarBuffer(m_winogradInput, 16 * g.inC * numTiles);       // [16] x [C x tiles]
+        ElemType* m = PlanarBuffer(m_winogradOutput, 16 * g.outC * numTiles);     // [16] x [K x tiles]
+
+        // filter transform G g G'
+#pragma omp parallel for
+        for (long kc = 0; kc < (long) filterSize; kc++)
+        {
+            size_t k = kc / g.inC;
+            size_t c = kc % g.inC;
+            const ElemType* f = w + kc * 9;
+            ElemType t[4][3];
+            for (size_t j = 0; j < 3; j++)
+            {
+                t[0][j] = f[j];
+                t[1][j] = (f[j] + f[3 + j] + f[6 + j]) / 2;
+                t[2][j] = (f[j] - f[3 + j] + f[6 + j]) / 2;
+                t[3][j] = f[6 + j];
+            }
+            for (size_t i = 0; i < 4; i++)
+            {
+                ElemType r[4] = {t[i][0], (t[i][0] + t[i][1] + t[i][2]) / 2, (t[i][0] - t[i][1] + t[i][2]) / 2, t[i][2]};
+                for (size_t j = 0; j < 4; j++)
+                    u[(i * 4 + j) * filterSize + c * g.outC + k] = r[j];
+            }
+        }
+
+        // input transform B' d B
+        size_t tilesPerSample = g.TilesW() * g.TilesH();
+        long numInputTasks = (long) (numSamples * g.inC * g.TilesH());
+#pragma omp parallel for
+        for (long task = 0; task < numInputTasks; task++)
+        {
+            size_t ty = task % g.TilesH();
+            size_t c = (task / g.TilesH()) % g.inC;
+            size_t s = task / (g.TilesH() * g.inC);
+            const ElemType* plane = x + s * g.InSize() + c * g.inH * g.inW;
+            for (size_t tx = 0; tx < g.TilesW(); tx++)
+            {
+                ElemType d[4][4];
+                for (size_t i = 0; i < 4; i++)
+                {
+                    long iy = (long) (2 * ty + i) - (long) g.padH;
+                    for (size_t j = 0; j < 4; j++)
+                    {
+                        long ix = (long) (2 * tx + j) - (long) g.padW;
+                        d[i][j] = (iy >= 0 && iy < (long) g.inH && ix >= 0 && ix < (long) g.inW) ? plane[iy * g.inW + ix] : 0;
+                    }
+                }
+                ElemType t[4][4];
+                for (size_t j = 0; j < 4; j++)
+                {
+                    t[0][j] = d[0][j] - d[2][j];
+                    t[1][j] = d[1][j] + d[2][j];
+                    t[2][j] = d[2][j] - d[1][j];
+                    t[3][j] = d[1][j] - d[3][j];
+                }
+                size_t tile = s * tilesPerSample + ty * g.TilesW() + tx;
+                for (size_t i = 0; i < 4; i++)
+                {
+                    ElemType r[4] = {t[i][0] - t[i][2], t[i][1] + t[i][2], t[i][2] - t[i][1], t[i][1] - t[i][3]};
+                    for (size_t j = 0; j < 4; j++)
+                        v[((i * 4 + j) * numTiles + tile) * g.inC + c] = r[j];
+                }
+            }
+        }
+
+        for (size_t xi = 0; xi < 16; xi++)
+            Gemm(g.outC, numTiles, g.inC, u + xi * filterSize, false, v + xi * g.inC * numTiles, false, 0, m + xi * g.outC * numTiles);
+
+        // output transform A' m A
+        long numOutputTasks = (long) (numSamples * g.outC);
+#pragma omp parallel for
+        for (long task = 0; task < numOutputTasks; task++)
+        {
+            size_t k = task % g.outC;
+            size_t s = task / g.outC;
+            ElemType* map = y + s * g.OutSize() + k * g.OutPixels();
+            for (size_t tile = s * tilesPerSample; tile < (s + 1) * tilesPerSample; tile++)
+            {
+                ElemType p[4][4];
+                for (size_t xi = 0; xi < 16; xi++)
+                    p[xi / 4][xi % 4] = m[(xi * numTiles + tile) * g.outC + k];
+                ElemType t[2][4];
+                for (size_t j = 0; j < 4; j++)
+                {
+                    t[0][j] = p[0][j] + p[1][j] + p[2][j];
+                    t[1][j] = p[1][j] - p[2][j] - p[3][j];
+                }
+                size_t oy = 2 * ((tile - s * tilesPerSample) / g.TilesW());
+                size_t ox = 2 * ((tile - s * tilesPerSample) % g.TilesW());
+                for (size_t i = 0; i < 2 && oy + i < g.outH; i++)
+                {
+                    ElemType r[2] = {t[i][0] + t[i][1] + t[i][2], t[i][1] - t[i][2] - t[i][3]};
+                    for (size_t j = 0; j < 2 && ox + j < g.outW; j++)
+                        map[(oy + i) * g.outW + ox + j] = r[j];
+                }
+            }
+        }
+    }
+
+private:
+    using Base::m_maxTempMemSizeInSamples;
+    using Base::m_imageLayoutKind;
+
+    Mat m_denseInput;
+    vector<ElemType> m_planarIn;
+    vector<ElemType> m_planarOut;
+    vector<ElemType> m_planarFilter;
+    vector<ElemType> m_winogradFilter;
+    vector<ElemType> m_winogradInput;
+    vector<ElemType> m_winogradOutput;
+};
+
+template <class ElemType>
+class CpuPoolingEngine : public PoolingEngine<ElemType>
+{
+public:
+    using Base = PoolingEngine<ElemType>;
+    using typename Base::Tensor4D;
+    using typename Base::PoolDesc;
+    using typename Base::Mat;
+
+public:
+    CpuPoolingEngine(ImageLayoutKind imageLayoutKind)
+        : m_imageLayoutKind(imageLayoutKind)
+    {
+    }
+
+public:
+    // Like cuDNN, windows are clipped to the image, and average pooling averages over the values inside the image.
+    // A window that lies entirely in the padding yields 0, the value of the padding, for both kinds.
+    void Forward(const Tensor4D& inT, const Mat& in, const PoolDesc& poolDesc, const Tensor4D& outT, Mat& out) override
+    {
+        assert(inT.w() * inT.h() * inT.c() == in.GetNumRows());
+        assert(inT.n() == in.GetNumCols());
+        assert(outT.w() * outT.h() * outT.c() == out.GetNumRows());
+        assert(outT.n() == out.GetNumCols());
+
+        const ElemType* x = in.BufferPointer();
+        ElemType* y = out.BufferPointer();
+        ForEachWindow(inT, poolDesc, outT, [&](size_t inOffset, size_t outOffset, const vector<size_t>& window)
+        {
+            ElemType result;
+            if (poolDesc.kind() == PoolDesc::PoolKind::Max)
+            {
+                result = window.empty() ? 0 : -numeric_limits<ElemType>::max();
+                for (size_t i : window)
+                    result = max(result, x[inOffset + i]);
+            }
+            else
+            {
+                result = 0;
+                for (size_t i : window)
+                    result += x[inOffset + i];
+                result /= max((size_t) 1, window.size());
+            }
+            y[outOffset] = result;
+        });
+    }
+
+    // max pooling passes the gradient to every input equal to the maximum, like the legacy engine
+    void Backward(const Tensor4D& outT, const Mat& out, const Mat& srcGrad, const PoolDesc& poolDesc, const Tensor4D& inT, const Mat& in, Mat& grad) override
+    {
+        assert(outT.w() * outT.h() * outT.c() == out.GetNumRows());
+        assert(outT.n() == out.GetNumCols());
+        assert(out.GetNumRows() == srcGrad.GetNumRows());
+        assert(out.GetNumCols() == srcGrad.GetNumCols());
+        assert(inT.w() * inT.h() * inT.c() == in.GetNumRows());
+        assert(inT.n() == in.GetNumCols());
+        assert(in.GetNumRows() == grad.GetNumRows());
+        assert(in.GetNumCols() == grad.GetNumCols());
+
+        const ElemType* x = in.BufferPointer();
+        const ElemType* y = out.BufferPointer();
+        const ElemType* dy = srcGrad.BufferPointer();
+        ElemType* dx = grad.BufferPointer();
+        ForEachWindow(inT, poolDesc, outT, [&](size_t inOffset, size_t outOffset, const vector<size_t>& window)
+        {
+            if (poolDesc.kind() == PoolDesc::PoolKind::Max)
+            {
+                for (size_t i : window)
+                {
+                    if (x[inOffset + i] == y[outOffset])
+                        dx[inOffset + i] += dy[outOffset];
+                }
+            }
+            else
+            {
+                ElemType g = dy[outOffset] / max((size_t) 1, window.size());
+                for (size_t i : window)
+                    dx[inOffset + i] += g;
+            }
+        });
+    }
+
+private:
+    // calls f(inOffset, outOffset, window) for every output value, where inOffset + window[i] are the input values
+    // of its window; parallel over feature maps, so that f may update the input map of its output
+    template <class F>
+    void ForEachWindow(const Tensor4D& inT, const PoolDesc& poolDesc, const Tensor4D& outT, const F& f) const
+    {
+        ImageStrides inStrides(inT, m_imageLayoutKind);
+        ImageStrides outStrides(outT, m_imageLayoutKind);
+        size_t inSize = inT.w() * inT.h() * inT.c();
+        size_t outSize = outT.w() * outT.h() * outT.c();
+        long numMaps = (long) (inT.n() * inT.c());
+#pragma omp parallel for
+        for (long m = 0; m < numMaps; m++)
+        {
+            size_t s = m / inT.c();
+            size_t c = m % inT.c();
+            vector<size_t> window;
+            window.reserve(poolDesc.w() * poolDesc.h());
+            for (size_t oy = 0; oy < outT.h(); oy++)
+            {
+                long y0 = (long) (oy * poolDesc.hStride()) - (long) poolDesc.hPad();
+                long y1 = min(y0 + (long) poolDesc.h(), (long) inT.h());
+                for (size_t ox = 0; ox < outT.w(); ox++)
+                {
+                    long x0 = (long) (ox * poolDesc.wStride()) - (long) poolDesc.wPad();
+                    long x1 = min(x0 + (long) poolDesc.w(), (long) inT.w());
+                    window.clear();
+                    for (long iy = max(y0, 0L); iy < y1; iy++)
+                        for (long ix = max(x0, 0L); ix < x1; ix++)
+                            window.push_back(iy * inStrides.y + ix * inStrides.x);
+                    f(s * inSize + c * inStrides.c, s * outSize + c * outStrides.c + oy * outStrides.y + ox * outStrides.x, window);
+                }
+            }
+        }
+    }
+
+private:
+    ImageLayoutKind m_imageLayoutKind;
+};
+
 template <class ElemType>
 class DefaultConvolutionEngineFactory : public ConvolutionEngineFactory<ElemType>
 {
@@ -426,6 +1476,12 @@ public:
     using typename Base::ConvEnginePtr;
     using typename Base::PoolEnginePtr;
 
+public:
+    DefaultConvolutionEngineFactory(ImageLayoutKind imageLayoutKind)
+        : m_imageLayoutKind(imageLayoutKind)
+    {
+    }
+
 public:
     Tensor4DPtr CreateTensor(size_t w, size_t h, size_t c, size_t n) override
     {
@@ -450,13 +1506,45 @@ public:
 
     ConvEnginePtr CreateConvEngine(DEVICEID_TYPE deviceId, size_t maxTempMemSizeInSamples) override
     {
-        return std::make_unique<DefaultConvolutionEngine<ElemType>>(deviceId, maxTempMemSizeInSamples);
+        return std::make_unique<DefaultConvolutionEngine<ElemType>>(deviceId, maxTempMemSizeInSamples, m_imageLayoutKind);
     }
 
     PoolEnginePtr CreatePoolEngine(DEVICEID_TYPE /*deviceId*/) override
     {
         return std::make_unique<DefaultPoolingEngine<ElemType>>();
     }
+
+protected:
+    ImageLayoutKind m_imageLayoutKind;
+};
+
+template <class ElemType>
+class CpuConvolutionEngineFactory : public DefaultConvolutionEngineFactory<ElemType>
+{
+public:
+    using Base = DefaultConvolutionEngineFactory<ElemType>;
+    using typename Base::ConvEnginePtr;
+    using typename Base::PoolEnginePtr;
+
+public:
+    CpuConvolutionEngineFactory(ImageLayoutKind imageLayoutKind)
+        : Base(imageLayoutKind)
+    {
+    }
+
+public:
+    ConvEnginePtr CreateConvEngine(DEVICEID_TYPE deviceId, size_t maxTempMemSizeInSamples) override
+    {
+        return std::make_unique<CpuConvolutionEngine<ElemType>>(deviceId, maxTempMemSizeInSamples, m_imageLayoutKind);
+    }
+
+    PoolEnginePtr CreatePoolEngine(DEVICEID_TYPE /*deviceId*/) override
+    {
+        return std::make_unique<CpuPoolingEngine<ElemType>>(m_imageLayoutKind);
+    }
+
+private:
+    using Base::m_imageLayoutKind;
 };
 
 template <class ElemType>
@@ -467,6 +1555,9 @@ std::unique_ptr<ConvolutionEngineFactory<ElemType>> ConvolutionEngineFactory<Ele
         // REVIEW alexeyk: make cuDNN default when running on GPU and compiled with cuDNN, add config parameter to enable runtime switch between implementations.
         if (deviceId >= 0 && CuDnnConvolutionEngineFactory<ElemType>::IsSupported(deviceId) && imageLayoutKind == ImageLayoutKind::CHW)
             return Create(deviceId, EngineType::CuDnn, imageLayoutKind);
+        // the legacy engine stays the default for HWC on the CPU; it does not implement CHW (the cuDNN layout), which the CPU engine does
+        else if (deviceId < 0 && imageLayoutKind == ImageLayoutKind::CHW)
+            return Create(deviceId, EngineType::Cpu, imageLayoutKind);
         else
             return Create(deviceId, EngineType::Legacy, imageLayoutKind);
     }
@@ -484,7 +1575,13 @@ std::unique_ptr<ConvolutionEngineFactory<ElemType>> ConvolutionEngineFactory<Ele
         if (imageLayoutKind != ImageLayoutKind::HWC)
             fprintf(stderr, "WARNING: trying to use cuDNN on unsupported platform. It is safe to ignore the warning if it's produced during model editing command.\n");
         // InvalidArgument("ConvolutionEngineFactory: ImageLayout '%s' is not compatible with the legacy convolution engine.", ToString(imageLayoutKind).c_str());
-        return std::make_unique<DefaultConvolutionEngineFactory<ElemType>>();
+        return std::make_unique<DefaultConvolutionEngineFactory<ElemType>>(imageLayoutKind);
+    }
+    else if (engType == EngineType::Cpu)
+    {
+        if (deviceId >= 0)
+            InvalidArgument("ConvolutionEngineFactory: The CPU convolution engine cannot be used on device %d.", (int) deviceId);
+        return std::make_unique<CpuConvolutionEngineFactory<ElemType>>(imageLayoutKind);
     }
 
     RuntimeError("Not supported convolution engine type: %d.", (int)engType);
@@ -17,7 +17,9 @@
 #endif
 
 #include "Matrix.h"
+#include "QuantizedGemm.h"
 #include "TensorShape.h" // for ImageLayoutKind
+#include <memory>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -260,6 +262,18 @@ public:
                                         const Tensor4D& scaleBiasT, const Mat& scale, bool spatial, const Mat& saveMean, const Mat& saveInvStdDev,
                                         Mat& scaleGrad, Mat& biasGrad) = 0;
 
+    // inference with integer-quantized filters, see QuantizedGemm.h; only the CPU engine implements these
+    virtual std::shared_ptr<QuantizedWeights<ElemType>> QuantizeFilter(const Filter& /*filterT*/, const Mat& /*filter*/, size_t /*numBits*/)
+    {
+        RuntimeError("Quantized convolution is only supported by the CPU convolution engine.");
+    }
+
+    virtual void ForwardQuantized(const Tensor4D& /*inT*/, const Mat& /*in*/, const Filter& /*filterT*/, const QuantizedWeights<ElemType>& /*filter*/, const ConvDesc& /*convDesc*/,
+                                  const Tensor4D& /*outT*/, Mat& /*out*/, Mat& /*workspace*/)
+    {
+        RuntimeError("Quantized convolution is only supported by the CPU convolution engine.");
+    }
+
 public:
     ConvolutionEngine(const ConvolutionEngine&) = delete;
     ConvolutionEngine& operator=(const ConvolutionEngine&) = delete;
@@ -323,7 +337,8 @@ public:
     {
         Auto,
         CuDnn,
-        Legacy
+        Legacy,
+        Cpu // CPU only, both image layouts
     };
     static std::unique_ptr<ConvolutionEngineFactory<ElemType>> Create(DEVICEID_TYPE deviceId, EngineType engType, ImageLayoutKind imageLayoutKind);
 
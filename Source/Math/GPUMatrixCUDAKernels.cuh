@@ -2799,6 +2799,21 @@ __global__ void _isValid(
     }
 }
 
+template <class ElemType>
+__global__ void _maskColumnsValueSparseCSC(ElemType* a, const GPUSPARSE_INDEX_TYPE* colCSCIndex, const char* columnsMask, CUDA_LONG numCols, ElemType val)
+{
+    CUDA_LONG colIdx = blockIdx.x;
+    if (colIdx >= numCols)
+        return;
+
+    if (columnsMask[IDX2C(0, colIdx, 1)] == 1)
+        return;
+
+    CUDA_LONG end = colCSCIndex[colIdx + 1];
+    for (CUDA_LONG p = colCSCIndex[colIdx] + threadIdx.x; p < end; p += blockDim.x)
+        a[p] = val;
+}
+
 template <class ElemType>
 __global__ void _shiftColCSCIndexFromSliceViewToAbsolute(
     GPUSPARSE_INDEX_TYPE* colCSCIndex,
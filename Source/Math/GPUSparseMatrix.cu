@@ -2389,6 +2389,34 @@ GPUSparseMatrix<ElemType> GPUSparseMatrix<ElemType>::ColumnSlice(size_t startCol
     return slice;
 }
 
+// set the stored elements of the columns whose mask is 0 to 'val' (exact for val == 0; the sparsity structure is kept)
+template <class ElemType>
+void GPUSparseMatrix<ElemType>::MaskColumnsValue(const GPUMatrix<char>& columnsMask, ElemType val)
+{
+    if (GetNumCols() != columnsMask.GetNumCols())
+        RuntimeError("Matrix and column mask must have equal number of columns");
+
+    if (GetComputeDeviceId() != columnsMask.GetComputeDeviceId())
+        RuntimeError("Matrix and column mask must be on the same device");
+
+    if (m_format != MatrixFormat::matrixFormatSparseCSC)
+        NOT_IMPLEMENTED;
+
+    int blocksPerGrid = (int) GetNumCols();
+    PrepareDevice();
+    cudaEvent_t done = nullptr;
+    if (do_sync)
+        CUDA_CALL(cudaEventCreate(&done));
+    // (column starts are offsets into m_pArray, also for column slices)
+    _maskColumnsValueSparseCSC<ElemType><<<blocksPerGrid, GridDim::maxThreadsPerBlock, 0, t_stream>>>(m_pArray, SecondaryIndexLocation(), columnsMask.BufferPointer(), (CUDA_LONG) GetNumCols(), val);
+    if (do_sync)
+        CUDA_CALL(cudaEventRecord(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventSynchronize(done));
+    if (do_sync)
+        CUDA_CALL(cudaEventDestroy(done));
+}
+
 template <class ElemType>
 GPUMatrix<ElemType> GPUSparseMatrix<ElemType>::CopyColumnSliceToDense(size_t startColumn, size_t numCols) const
 {
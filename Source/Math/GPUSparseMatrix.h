@@ -233,6 +233,7 @@ public:
 
     GPUSparseMatrix<ElemType> ColumnSlice(size_t startColumn, size_t numCols) const;
     GPUMatrix<ElemType> CopyColumnSliceToDense(size_t startColumn, size_t numCols) const;
+    void MaskColumnsValue(const GPUMatrix<char>& columnsMask, ElemType val);
 
     GPUMatrix<ElemType> DiagonalToDense() const;
 
@@ -1153,8 +1153,8 @@ void Matrix<ElemType>::MaskColumnsValue(const Matrix<char>& columnsMask, ElemTyp
                             this,
                             m_CPUMatrix->MaskColumnsValue(*columnsMask.m_CPUMatrix, val),
                             m_GPUMatrix->MaskColumnsValue(*columnsMask.m_GPUMatrix, val),
-                            NOT_IMPLEMENTED,
-                            NOT_IMPLEMENTED);
+                            m_CPUSparseMatrix->MaskColumnsValue(*columnsMask.m_CPUMatrix, val),
+                            m_GPUSparseMatrix->MaskColumnsValue(*columnsMask.m_GPUMatrix, val));
 }
 
 template <class ElemType>
@@ -1503,7 +1503,7 @@ void Matrix<ElemType>::Reshape(const size_t numRows, const size_t numCols)
                                 this,
                                 m_CPUMatrix->Reshape(numRows, numCols),
                                 m_GPUMatrix->Reshape(numRows, numCols),
-                                NOT_IMPLEMENTED,
+                                m_CPUSparseMatrix->Reshape(numRows, numCols),
                                 m_GPUSparseMatrix->Reshape(numRows, numCols));
     }
 }
@@ -5081,6 +5081,96 @@ void Matrix<ElemType>::TensorOp(ElemType beta, const Matrix<ElemType>& a, const
                             NOT_IMPLEMENTED);
 }
 
+// evaluate a FusedElementwiseProgram in a single pass (see CommonMatrix.h)
+// This is currently only implemented for dense CPU matrices; use IsFusedElementwiseSupported() to check before calling.
+template <class ElemType>
+/*static*/ bool Matrix<ElemType>::IsFusedElementwiseSupported(const Matrix<ElemType>& m)
+{
+    return m.GetCurrentMatrixLocation() == CurrentDataLocation::CPU && m.GetMatrixType() == MatrixType::DENSE;
+}
+
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::FusedElementwiseForward(const FusedElementwiseProgram& program, const vector<const Matrix<ElemType>*>& inputs, Matrix<ElemType>& result)
+{
+    vector<const CPUMatrix<ElemType>*> cpuInputs;
+    for (const auto* input : inputs)
+    {
+        if (!IsFusedElementwiseSupported(*input))
+            NOT_IMPLEMENTED;
+        cpuInputs.push_back(input->m_CPUMatrix);
+    }
+    if (!IsFusedElementwiseSupported(result))
+        NOT_IMPLEMENTED;
+    CPUMatrix<ElemType>::FusedElementwiseForward(program, cpuInputs, *result.m_CPUMatrix);
+}
+
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::FusedElementwiseBackward(const FusedElementwiseProgram& program, const vector<const Matrix<ElemType>*>& inputs,
+                                                         const Matrix<ElemType>& resultGradient, const vector<Matrix<ElemType>*>& inputGradients)
+{
+    vector<const CPUMatrix<ElemType>*> cpuInputs;
+    for (const auto* input : inputs)
+    {
+        if (!IsFusedElementwiseSupported(*input))
+            NOT_IMPLEMENTED;
+        cpuInputs.push_back(input->m_CPUMatrix);
+    }
+    vector<CPUMatrix<ElemType>*> cpuInputGradients;
+    for (auto* inputGradient : inputGradients)
+    {
+        if (inputGradient && !IsFusedElementwiseSupported(*inputGradient))
+            NOT_IMPLEMENTED;
+        cpuInputGradients.push_back(inputGradient ? inputGradient->m_CPUMatrix : nullptr);
+    }
+    if (!IsFusedElementwiseSupported(resultGradient))
+        NOT_IMPLEMENTED;
+    CPUMatrix<ElemType>::FusedElementwiseBackward(program, cpuInputs, *resultGradient.m_CPUMatrix, cpuInputGradients);
+}
+
+// The recurrent cells are only implemented for dense CPU matrices.
+template <class ElemType>
+static void VerifyRecurrentCellOperands(std::initializer_list<const Matrix<ElemType>*> operands)
+{
+    for (const auto* m : operands)
+    {
+        if (m->GetCurrentMatrixLocation() != CurrentDataLocation::CPU || m->GetMatrixType() != MatrixType::DENSE)
+            NOT_IMPLEMENTED;
+    }
+}
+
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::LSTMCellForward(Matrix<ElemType>& gates, const Matrix<ElemType>& prevCell, const Matrix<ElemType>& peepholes,
+                                                Matrix<ElemType>& cell, Matrix<ElemType>& cellOutput)
+{
+    VerifyRecurrentCellOperands<ElemType>({&gates, &prevCell, &peepholes, &cell, &cellOutput});
+    CPUMatrix<ElemType>::LSTMCellForward(*gates.m_CPUMatrix, *prevCell.m_CPUMatrix, *peepholes.m_CPUMatrix, *cell.m_CPUMatrix, *cellOutput.m_CPUMatrix);
+}
+
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::LSTMCellBackward(const Matrix<ElemType>& gates, const Matrix<ElemType>& prevCell, const Matrix<ElemType>& cell, const Matrix<ElemType>& peepholes,
+                                                 const Matrix<ElemType>& cellOutputGradient, Matrix<ElemType>& cellGradient, Matrix<ElemType>& gatesGradient, Matrix<ElemType>& peepholesGradient)
+{
+    VerifyRecurrentCellOperands<ElemType>({&gates, &prevCell, &cell, &peepholes, &cellOutputGradient, &cellGradient, &gatesGradient, &peepholesGradient});
+    CPUMatrix<ElemType>::LSTMCellBackward(*gates.m_CPUMatrix, *prevCell.m_CPUMatrix, *cell.m_CPUMatrix, *peepholes.m_CPUMatrix,
+                                          *cellOutputGradient.m_CPUMatrix, *cellGradient.m_CPUMatrix, *gatesGradient.m_CPUMatrix, *peepholesGradient.m_CPUMatrix);
+}
+
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::GRUCellForward(Matrix<ElemType>& gates, const Matrix<ElemType>& recurrent, const Matrix<ElemType>& prevOutput, Matrix<ElemType>& output)
+{
+    VerifyRecurrentCellOperands<ElemType>({&gates, &recurrent, &prevOutput, &output});
+    CPUMatrix<ElemType>::GRUCellForward(*gates.m_CPUMatrix, *recurrent.m_CPUMatrix, *prevOutput.m_CPUMatrix, *output.m_CPUMatrix);
+}
+
+template <class ElemType>
+/*static*/ void Matrix<ElemType>::GRUCellBackward(const Matrix<ElemType>& gates, const Matrix<ElemType>& recurrent, const Matrix<ElemType>& prevOutput, const Matrix<ElemType>& outputGradient,
+                                                Matrix<ElemType>& gatesGradient, Matrix<ElemType>& recurrentGradient, Matrix<ElemType>& prevOutputGradient)
+{
+    VerifyRecurrentCellOperands<ElemType>({&gates, &recurrent, &prevOutput, &outputGradient, &gatesGradient, &recurrentGradient, &prevOutputGradient});
+    CPUMatrix<ElemType>::GRUCellBackward(*gates.m_CPUMatrix, *recurrent.m_CPUMatrix, *prevOutput.m_CPUMatrix, *outputGradient.m_CPUMatrix,
+                                         *gatesGradient.m_CPUMatrix, *recurrentGradient.m_CPUMatrix, *prevOutputGradient.m_CPUMatrix);
+}
+
 template class Matrix<float>;
 template class Matrix<double>;
 
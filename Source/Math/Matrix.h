@@ -525,6 +525,20 @@ public:
                   const SmallVector<size_t>& regularOpDims, const std::array<SmallVector<ptrdiff_t>, 4>& regularStrides,
                   const SmallVector<size_t>& reducingOpDims, const std::array<SmallVector<ptrdiff_t>, 4>& reducingStrides);
 
+    static bool IsFusedElementwiseSupported(const Matrix<ElemType>& m);
+    static void FusedElementwiseForward(const FusedElementwiseProgram& program, const std::vector<const Matrix<ElemType>*>& inputs, Matrix<ElemType>& result);
+    static void FusedElementwiseBackward(const FusedElementwiseProgram& program, const std::vector<const Matrix<ElemType>*>& inputs,
+                                         const Matrix<ElemType>& resultGradient, const std::vector<Matrix<ElemType>*>& inputGradients);
+
+    // one time step of the LSTM and GRU cells (RecurrentNodes.h); dense CPU matrices only
+    static void LSTMCellForward(Matrix<ElemType>& gates, const Matrix<ElemType>& prevCell, const Matrix<ElemType>& peepholes,
+                                Matrix<ElemType>& cell, Matrix<ElemType>& cellOutput);
+    static void LSTMCellBackward(const Matrix<ElemType>& gates, const Matrix<ElemType>& prevCell, const Matrix<ElemType>& cell, const Matrix<ElemType>& peepholes,
+                                 const Matrix<ElemType>& cellOutputGradient, Matrix<ElemType>& cellGradient, Matrix<ElemType>& gatesGradient, Matrix<ElemType>& peepholesGradient);
+    static void GRUCellForward(Matrix<ElemType>& gates, const Matrix<ElemType>& recurrent, const Matrix<ElemType>& prevOutput, Matrix<ElemType>& output);
+    static void GRUCellBackward(const Matrix<ElemType>& gates, const Matrix<ElemType>& recurrent, const Matrix<ElemType>& prevOutput, const Matrix<ElemType>& outputGradient,
+                                Matrix<ElemType>& gatesGradient, Matrix<ElemType>& recurrentGradient, Matrix<ElemType>& prevOutputGradient);
+
 public:
     void Read(File& stream);
     void Write(File& stream) const;
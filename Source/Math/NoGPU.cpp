@@ -440,6 +440,10 @@ GPUMatrix<ElemType> GPUSparseMatrix<ElemType>::CopyColumnSliceToDense(size_t sta
     return a;
 }
 template <class ElemType>
+void GPUSparseMatrix<ElemType>::MaskColumnsValue(const GPUMatrix<char>& columnsMask, ElemType val)
+{
+}
+template <class ElemType>
 GPUMatrix<ElemType> GPUSparseMatrix<ElemType>::DiagonalToDense() const
 {
     GPUMatrix<ElemType> a(0);
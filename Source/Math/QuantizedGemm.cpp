@@ -0,0 +1,191 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// QuantizedGemm.cpp -- matrix products with 8- or 16-bit integer weights for CPU inference
+//
+
+#include "stdafx.h"
+#include "Basics.h"
+#include "QuantizedGemm.h"
+#include "CPUVectorKernels.h"
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+static const size_t kAlignment = 2; // the kernels process pairs of inputs...
+static const size_t mAlignment = 8; // ...for panels of 8 outputs
+static const size_t mTile = 64;     // outputs and...
+static const size_t nTile = 24;     // ...columns per task (a multiple of the kernels' 6 columns)
+
+static size_t RoundUp(size_t n, size_t alignment)
+{
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+// index of w(k, m) in the panels of the kernels in CPUVectorKernels.h
+static size_t PanelIndex(size_t k, size_t m, size_t K)
+{
+    return (m / 8) * 8 * K + (k / 2) * 16 + (m % 8) * 2 + k % 2;
+}
+
+// the scalar version of the kernels
+template <class WeightType>
+static void DotProducts(const WeightType* w, const int16_t* x, size_t K, size_t M, size_t N, int32_t* acc, size_t ldAcc)
+{
+    for (size_t n = 0; n < N; n++)
+    {
+        for (size_t m = 0; m < M; m++)
+        {
+            const int16_t* xn = x + n * K;
+            int32_t sum = 0;
+            for (size_t k = 0; k < K; k++)
+                sum += (int32_t) w[PanelIndex(k, m, K)] * (int32_t) xn[k];
+            acc[m + n * ldAcc] = sum;
+        }
+    }
+}
+
+template <class ElemType>
+QuantizedWeights<ElemType>::QuantizedWeights(const ElemType* w, size_t K, size_t M, size_t kStride, size_t mStride, size_t numBits)
+    : m_K(K), m_M(M), m_Kp(RoundUp(max(K, (size_t) 1), kAlignment)), m_Mp(RoundUp(max(M, (size_t) 1), mAlignment)), m_numBits(numBits)
+{
+    if (numBits != 8 && numBits != 16)
+        InvalidArgument("QuantizedWeights: Only 8 and 16 bits are supported, not %d.", (int) numBits);
+
+    // largest ranges with K * wRange * xRange < 2^31
+    const double maxProduct = (double) std::numeric_limits<int32_t>::max() / m_Kp;
+    if (numBits == 8)
+    {
+        m_wRange = 127;
+        m_xRange = (int) min(32767.0, floor(maxProduct / m_wRange));
+    }
+    else
+        m_wRange = m_xRange = (int) min(32767.0, floor(sqrt(maxProduct)));
+    if (m_xRange < 127)
+        InvalidArgument("QuantizedWeights: Inner dimension %d is too large for exact 32-bit accumulation.", (int) K);
+
+    if (numBits == 8)
+        Quantize(w, kStride, mStride, m_w8);
+    else
+        Quantize(w, kStride, mStride, m_w16);
+}
+
+template <class ElemType>
+template <class WeightType>
+void QuantizedWeights<ElemType>::Quantize(const ElemType* w, size_t kStride, size_t mStride, std::vector<WeightType>& wq)
+{
+    wq.assign(m_Kp * m_Mp, 0); // padding is 0
+    m_scales.assign(m_Mp, 0);
+#pragma omp parallel for
+    for (long m = 0; m < (long) m_M; m++)
+    {
+        const ElemType* wm = w + m * mStride;
+        ElemType maxAbs = 0;
+        for (size_t k = 0; k < m_K; k++)
+            maxAbs = max(maxAbs, (ElemType) fabs(wm[k * kStride]));
+        if (maxAbs == 0)
+            continue; // all 0, and so is the scale
+        m_scales[m] = maxAbs / m_wRange;
+        double invScale = m_wRange / (double) maxAbs;
+        for (size_t k = 0; k < m_K; k++)
+            wq[PanelIndex(k, m, m_Kp)] = (WeightType) lrint(wm[k * kStride] * invScale);
+    }
+}
+
+template <class ElemType>
+size_t QuantizedWeights<ElemType>::GetSizeInBytes() const
+{
+    return m_w8.size() * sizeof(int8_t) + m_w16.size() * sizeof(int16_t) + m_scales.size() * sizeof(ElemType);
+}
+
+template <class ElemType>
+ElemType QuantizedWeights<ElemType>::GetDequantizedWeight(size_t k, size_t m) const
+{
+    if (k >= m_K || m >= m_M)
+        InvalidArgument("GetDequantizedWeight: Index out of range.");
+    size_t i = PanelIndex(k, m, m_Kp);
+    return m_scales[m] * (m_numBits == 8 ? m_w8[i] : m_w16[i]);
+}
+
+// quantize each column of x with its own scale into the columns of xq, [m_Kp x N]
+template <class ElemType>
+void QuantizedWeights<ElemType>::QuantizeActivations(const ElemType* x, size_t xRowStride, size_t xColStride, size_t N, int16_t* xq, ElemType* xScales) const
+{
+#pragma omp parallel for
+    for (long n = 0; n < (long) N; n++)
+    {
+        const ElemType* xn = x + n * xColStride;
+        int16_t* xqn = xq + n * m_Kp;
+        ElemType maxAbs = 0;
+        for (size_t k = 0; k < m_K; k++)
+            maxAbs = max(maxAbs, (ElemType) fabs(xn[k * xRowStride]));
+        xScales[n] = maxAbs / m_xRange;
+        double invScale = maxAbs > 0 ? m_xRange / (double) maxAbs : 0;
+        for (size_t k = 0; k < m_K; k++)
+            xqn[k] = (int16_t) lrint(xn[k * xRowStride] * invScale);
+        std::fill(xqn + m_K, xqn + m_Kp, (int16_t) 0);
+    }
+}
+
+template <class ElemType>
+void QuantizedWeights<ElemType>::Multiply(const ElemType* x, size_t xRowStride, size_t xColStride, size_t N, ElemType* c, size_t cRowStride, size_t cColStride) const
+{
+    if (N == 0 || m_M == 0)
+        return;
+
+    std::vector<int16_t> xq(m_Kp * N);
+    std::vector<ElemType> xScales(N);
+    QuantizeActivations(x, xRowStride, xColStride, N, xq.data(), xScales.data());
+
+    const CPUQuantizedKernelTable* kernels = CPUVectorKernels::GetQuantizedKernels();
+    size_t numMTiles = (m_Mp + mTile - 1) / mTile;
+    size_t numNTiles = (N + nTile - 1) / nTile;
+    long numTiles = (long) (numMTiles * numNTiles);
+#pragma omp parallel for schedule(dynamic)
+    for (long t = 0; t < numTiles; t++)
+    {
+        size_t m0 = (t % numMTiles) * mTile;
+        size_t n0 = (t / numMTiles) * nTile;
+        size_t mCount = min(mTile, m_Mp - m0);
+        size_t nCount = min(nTile, N - n0);
+        int32_t acc[mTile * nTile];
+        const int16_t* xqTile = xq.data() + n0 * m_Kp;
+        if (m_numBits == 8)
+            (kernels ? kernels->dotProductsInt8 : &DotProducts<int8_t>)(m_w8.data() + m0 * m_Kp, xqTile, m_Kp, mCount, nCount, acc, mCount);
+        else
+            (kernels ? kernels->dotProductsInt16 : &DotProducts<int16_t>)(m_w16.data() + m0 * m_Kp, xqTile, m_Kp, mCount, nCount, acc, mCount);
+
+        // dequantize; the inner loops run over the output's contiguous dimension so that they vectorize
+        size_t mEnd = min(m0 + mCount, m_M);
+        if (cRowStride == 1)
+        {
+            for (size_t n = n0; n < n0 + nCount; n++)
+            {
+                const int32_t* accn = acc + (n - n0) * mCount;
+                const ElemType* scales = m_scales.data() + m0;
+                ElemType xScale = xScales[n];
+                ElemType* cn = c + m0 + n * cColStride;
+                for (size_t i = 0; i < mEnd - m0; i++)
+                    cn[i] = (ElemType) accn[i] * (scales[i] * xScale);
+            }
+        }
+        else
+        {
+            for (size_t m = m0; m < mEnd; m++)
+            {
+                const int32_t* accm = acc + (m - m0);
+                ElemType wScale = m_scales[m];
+                ElemType* cm = c + m * cRowStride;
+                for (size_t n = n0; n < n0 + nCount; n++)
+                    cm[n * cColStride] = (ElemType) accm[(n - n0) * mCount] * (wScale * xScales[n]);
+            }
+        }
+    }
+}
+
+template class QuantizedWeights<float>;
+template class QuantizedWeights<double>;
+} } }
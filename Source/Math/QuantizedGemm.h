@@ -0,0 +1,72 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// QuantizedGemm.h -- matrix products with 8- or 16-bit integer weights for CPU inference
+//
+// The weights of each output (a row of a Times node's weight matrix, a filter of a convolution)
+// are quantized once, symmetrically with one scale per output; i.e. the transposed weight matrix
+// is stored column by column with a scale per column, like QuantizedColumn does it for gradients.
+// The activations are quantized on the fly, with one scale per column (sample or pixel).
+// Products are accumulated exactly in 32-bit integers and then dequantized:
+//   c(m, n) = wScale[m] * xScale[n] * sum_k wq(k, m) * xq(k, n)
+// To rule out overflow, the quantization ranges are chosen such that K * max|wq| * max|xq| < 2^31:
+//  - 8 bits: weights in [-127, 127], activations with as many of their 16 bits as this allows
+//    (e.g. [-16513, 16513] for K = 1024)
+//  - 16 bits: weights and activations share the range, e.g. [-1448, 1448] for K = 1024
+//
+
+#pragma once
+
+#include "CommonMatrix.h"
+#include <stdint.h>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+template <class ElemType>
+class MATH_API QuantizedWeights
+{
+public:
+    // quantize the weights w(k, m) = w[k * kStride + m * mStride] of the M outputs, with K inputs each
+    // numBits - 8 or 16
+    QuantizedWeights(const ElemType* w, size_t K, size_t M, size_t kStride, size_t mStride, size_t numBits);
+
+    // c(m, n) = sum_k w(k, m) * x(k, n) for n < N
+    // x(k, n) = x[k * xRowStride + n * xColStride], c(m, n) = c[m * cRowStride + n * cColStride]
+    // Thread-safe; parallelized with OpenMP.
+    void Multiply(const ElemType* x, size_t xRowStride, size_t xColStride, size_t N, ElemType* c, size_t cRowStride, size_t cColStride) const;
+
+    size_t GetNumBits() const
+    {
+        return m_numBits;
+    }
+    size_t GetNumInputs() const
+    {
+        return m_K;
+    }
+    size_t GetNumOutputs() const
+    {
+        return m_M;
+    }
+    // memory held by the quantized weights and their scales
+    size_t GetSizeInBytes() const;
+
+    // the weight w(k, m) as represented after quantization
+    ElemType GetDequantizedWeight(size_t k, size_t m) const;
+
+private:
+    template <class WeightType>
+    void Quantize(const ElemType* w, size_t kStride, size_t mStride, std::vector<WeightType>& wq);
+    void QuantizeActivations(const ElemType* x, size_t xRowStride, size_t xColStride, size_t N, int16_t* xq, ElemType* xScales) const;
+
+    size_t m_K, m_M;   // inputs, outputs
+    size_t m_Kp, m_Mp; // K padded to a multiple of 2, M to a multiple of 8, for the kernels
+    size_t m_numBits;
+    int m_wRange;      // quantized values are in [-m_wRange, m_wRange]...
+    int m_xRange;      // ...and [-m_xRange, m_xRange]
+    std::vector<int8_t> m_w8;   // [m_Kp x m_Mp] in the panel layout of CPUQuantizedKernelTable, if m_numBits == 8
+    std::vector<int16_t> m_w16; // ...if m_numBits == 16
+    std::vector<ElemType> m_scales; // [m]
+};
+} } }
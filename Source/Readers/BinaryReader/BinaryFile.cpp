@@ -9,7 +9,15 @@
 #include "DataReader.h"
 #include "BinaryReader.h"
 #include <limits.h>
+#include <float.h>
 #include <stdint.h>
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -29,22 +37,21 @@ DWORD LODWORD(size_t size)
 // size - size of the file to map, will expand/contract existing files to given size. zero means keep current size
 BinaryFile::BinaryFile(std::wstring fileName, FileOptions options, size_t size)
 {
+    m_writeFile = options == fileOptionsReadWrite;
+    m_name = fileName;
+    m_maxViewSize = 0x10000000; // 256MB initial max size
 
+#ifdef _WIN32
     SYSTEM_INFO sysInfo;
     GetSystemInfo(&sysInfo);
     m_viewAlignment = sysInfo.dwAllocationGranularity;
     /* If file created, continue to map file. */
 
-    m_writeFile = options == fileOptionsReadWrite;
-    m_name = fileName;
-    m_maxViewSize = 0x10000000; // 256MB initial max size
     m_hndFile = CreateFile(fileName.c_str(), m_writeFile ? (GENERIC_WRITE | GENERIC_READ) : GENERIC_READ,
                            FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
     if (m_hndFile == INVALID_HANDLE_VALUE)
     {
-        char message[256];
-        sprintf_s(message, "Unable to Open/Create file %ls, error %x", fileName.c_str(), GetLastError());
-        RuntimeError(message);
+        RuntimeError("Unable to Open/Create file %ls, error %x", fileName.c_str(), GetLastError());
     }
 
     // code to detect type of file (network/local)
@@ -70,10 +77,44 @@ BinaryFile::BinaryFile(std::wstring fileName, FileOptions options, size_t size)
                           NULL);
     if (m_hndMapped == NULL)
     {
-        char message[256];
-        sprintf_s(message, "Unable to map file %ls, error 0x%x", fileName.c_str(), GetLastError());
-        RuntimeError(message);
+        RuntimeError("Unable to map file %ls, error 0x%x", fileName.c_str(), GetLastError());
+    }
+#else
+    // mmap() only needs views to start at a page boundary, but sections are placed at multiples of the view alignment
+    // when the file is written, so we keep the Windows allocation granularity (64K), and files can be shared between platforms
+    m_viewAlignment = max((size_t) 0x10000, (size_t) sysconf(_SC_PAGESIZE));
+
+    m_fd = open(wtocharpath(fileName).c_str(), m_writeFile ? (O_RDWR | O_CREAT) : O_RDONLY, 0666);
+    if (m_fd < 0)
+    {
+        RuntimeError("Unable to Open/Create file %ls, error %d", fileName.c_str(), errno);
     }
+
+    // get the actual size of the file
+    struct stat fileStat;
+    if (fstat(m_fd, &fileStat) != 0)
+    {
+        RuntimeError("Unable to get the size of file %ls, error %d", fileName.c_str(), errno);
+    }
+    if (size == 0)
+    {
+        size = fileStat.st_size;
+    }
+    m_filePositionMax = size;
+
+    // unlike CreateFileMapping(), mmap() does not grow the file, and touching a mapped page beyond its end is a SIGBUS
+    if (m_writeFile)
+    {
+        if (ftruncate(m_fd, size) != 0)
+        {
+            RuntimeError("Unable to set the size of file %ls to %lld, error %d", fileName.c_str(), (long long) size, errno);
+        }
+    }
+    else if (size > (size_t) fileStat.st_size)
+    {
+        RuntimeError("Unable to map file %ls, %lld bytes requested, but the file has only %lld", fileName.c_str(), (long long) size, (long long) fileStat.st_size);
+    }
+#endif
     m_mappedSize = size;
 
     // if writing the file, the inital size of the file is zero
@@ -91,6 +132,7 @@ BinaryFile::~BinaryFile()
         // the view
         iter = ReleaseView(iter, true);
     }
+#ifdef _WIN32
     CloseHandle(m_hndMapped);
 
     // if we are writing the file, truncate to actual size
@@ -100,6 +142,14 @@ BinaryFile::~BinaryFile()
         SetEndOfFile(m_hndFile);
     }
     CloseHandle(m_hndFile);
+#else
+    // if we are writing the file, truncate to actual size
+    if (m_writeFile && ftruncate(m_fd, m_filePositionMax) != 0)
+    {
+        fprintf(stderr, "~BinaryFile: Unable to truncate file %ls, error %d\n", m_name.c_str(), errno);
+    }
+    close(m_fd);
+#endif
 }
 
 void BinaryFile::SetFilePositionMax(size_t filePositionMax)
@@ -107,9 +157,7 @@ void BinaryFile::SetFilePositionMax(size_t filePositionMax)
     m_filePositionMax = filePositionMax;
     if (m_filePositionMax > m_mappedSize)
     {
-        char message[128];
-        sprintf_s(message, "Setting max position larger than mapped file size: %ld > %ld", m_filePositionMax, m_mappedSize);
-        RuntimeError(message);
+        RuntimeError("Setting max position larger than mapped file size: %lld > %lld", (long long) m_filePositionMax, (long long) m_mappedSize);
     }
 }
 
@@ -144,7 +192,7 @@ vector<ViewPosition>::iterator BinaryFile::FindDataView(void* data)
     auto iter = m_views.begin();
     for (; iter != m_views.end(); ++iter)
     {
-        byte* viewBegin = (byte*) iter->view;
+        char* viewBegin = (char*) iter->view;
         if (viewBegin <= data && viewBegin + iter->size > data)
             break;
     }
@@ -191,10 +239,16 @@ vector<ViewPosition>::iterator BinaryFile::ReleaseView(vector<ViewPosition>::ite
     }
     else
     {
+#ifdef _WIN32
         if (m_writeFile)
             FlushViewOfFile(iter->view, iter->size);
         bool ret = UnmapViewOfFile(iter->view) != FALSE;
         ret;
+#else
+        if (m_writeFile)
+            msync(iter->view, iter->size, MS_ASYNC);
+        munmap(iter->view, iter->size);
+#endif
         iter = m_views.erase(iter);
     }
     return iter;
@@ -206,6 +260,7 @@ vector<ViewPosition>::iterator BinaryFile::ReleaseView(vector<ViewPosition>::ite
 // returns - pointer to the view
 void* BinaryFile::GetView(size_t filePosition, size_t size)
 {
+#ifdef _WIN32
     void* pBuf = MapViewOfFile(m_hndMapped,                                  // handle to map object
                                m_writeFile ? FILE_MAP_WRITE : FILE_MAP_READ, // get correct permissions
                                HIDWORD(filePosition),
@@ -213,10 +268,22 @@ void* BinaryFile::GetView(size_t filePosition, size_t size)
                                size);
     if (pBuf == NULL)
     {
-        char message[128];
-        sprintf_s(message, "Unable to map file %ls @ %lld, error %x", m_name.c_str(), filePosition, GetLastError());
-        RuntimeError(message);
+        RuntimeError("Unable to map file %ls @ %lld, error %x", m_name.c_str(), (long long) filePosition, GetLastError());
+    }
+#else
+    // same rules as MapViewOfFile(): size zero maps to the end of the file, and a view may not extend beyond it
+    if (size == 0 && filePosition < m_mappedSize)
+        size = m_mappedSize - filePosition;
+    if (filePosition + size > m_mappedSize)
+    {
+        RuntimeError("Unable to map file %ls @ %lld, view of %lld bytes extends beyond the mapped size %lld", m_name.c_str(), (long long) filePosition, (long long) size, (long long) m_mappedSize);
+    }
+    void* pBuf = mmap(NULL, size, m_writeFile ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, m_fd, filePosition);
+    if (pBuf == MAP_FAILED)
+    {
+        RuntimeError("Unable to map file %ls @ %lld, error %d", m_name.c_str(), (long long) filePosition, errno);
     }
+#endif
     m_views.push_back(ViewPosition(pBuf, filePosition, size));
 
     // update file position max if neccesary
@@ -303,7 +370,7 @@ void* BinaryFile::EnsureMapped(void* data, size_t size)
     auto viewPos = FindDataView(data);
     if (viewPos != m_views.end())
     {
-        int64_t offset = (byte*) data - (byte*) viewPos->view;
+        int64_t offset = (char*) data - (char*) viewPos->view;
         int64_t dataEnd = offset + size;
 
         // if our end of data is beyond the size of the view, need to reallocate
@@ -312,7 +379,7 @@ void* BinaryFile::EnsureMapped(void* data, size_t size)
             // TODO: this view change only accomidates this request
             size_t filePosition = viewPos->filePosition;
             ReleaseView(viewPos);
-            byte* view = (byte*) GetView(filePosition, dataEnd);
+            char* view = (char*) GetView(filePosition, dataEnd);
             data = view + offset;
         }
     }
@@ -325,6 +392,23 @@ void* BinaryFile::EnsureMapped(void* data, size_t size)
     return data;
 }
 
+// Prefetch - hint that a mapped range will be accessed soon, so that it is read in the background
+// data - pointer into a view
+// size - size of the range in bytes
+void BinaryFile::Prefetch(void* data, size_t size)
+{
+#ifdef _WIN32
+    // PrefetchVirtualMemory() requires Windows 8, so leave it to the read-ahead of the system
+    data;
+    size;
+#else
+    // madvise() wants a page aligned start; views are page aligned, so this does not leave the view
+    size_t pageSize = (size_t) sysconf(_SC_PAGESIZE);
+    char* begin = (char*) ((uintptr_t) data / pageSize * pageSize);
+    madvise(begin, (char*) data + size - begin, MADV_WILLNEED); // only a hint; failure is harmless
+#endif
+}
+
 // RoundUp - round the file position to the next mappable location if we intend on mapping the location separately
 // filePosition - position in the file we want to round up
 size_t BinaryFile::RoundUp(size_t filePosition)
@@ -340,7 +424,7 @@ size_t BinaryFile::RoundUp(size_t filePosition)
 SectionFile::SectionFile(std::wstring fileName, FileOptions options, size_t size)
     : BinaryFile(fileName, options, size)
 {
-    m_fileSection = new Section(this, 0, NULL, mappingFile, sectionHeaderMin);
+    m_fileSection = new Section(this, NULL, 0, mappingFile, sectionHeaderMin);
     if (m_writeFile)
     {
         m_fileSection->InitHeader(sectionTypeFile, string("Binary Data File"), sectionDataNone, 0);
@@ -349,9 +433,7 @@ SectionFile::SectionFile(std::wstring fileName, FileOptions options, size_t size
     // check for a file header
     if (!m_fileSection->ValidateHeader(m_writeFile))
     {
-        char message[128];
-        sprintf_s(message, "Invalid File format for binary file %ls", fileName.c_str());
-        RuntimeError(message);
+        RuntimeError("Invalid File format for binary file %ls", fileName.c_str());
     }
 }
 
@@ -389,7 +471,7 @@ void Section::InitHeader(SectionType type, std::string description, SectionData
     m_sectionHeader->flags = flagNone;                                                  // bit flags, dependent on sectionType
     m_sectionHeader->elementsCount = 0;                                                 // number of total elements stored
     memset(m_sectionHeader->nameDescription, 0, descriptionSize);                       // clear out the string buffer to all zeros first
-    strcpy_s(m_sectionHeader->nameDescription, description.c_str());                    // name and description of section contents in this format (name: description) (string, with extra bytes zeroed out, at least one null terminator required)
+    strcpy_s(m_sectionHeader->nameDescription, descriptionSize, description.c_str());   // name and description of section contents in this format (name: description) (string, with extra bytes zeroed out, at least one null terminator required)
     m_sectionHeader->size = sectionHeaderMin;                                           // size of this section (including header)
     m_sectionHeader->sizeAll = sectionHeaderMin;                                        // size of this section (including header and all sub-sections)
     m_sectionHeader->sectionFilePosition[0] = 0;                                        // sub-section file offsets (if needed), assumed to be in File Position order
@@ -497,9 +579,7 @@ Section* Section::ReadSection(size_t index, MappingType mapping, size_t sizeElem
     // make sure the header is valid
     if (!section->ValidateHeader())
     {
-        char message[256];
-        sprintf_s(message, "Invalid header in file %ls, in header %s\n", m_file->GetName(), section->GetName());
-        RuntimeError(message);
+        RuntimeError("Invalid header in file %ls, in header %ls\n", m_file->GetName().c_str(), section->GetName().c_str());
     }
 
     // setup the element mapping and pointers as needed
@@ -536,9 +616,7 @@ char* Section::EnsureElements(size_t element, size_t bytesRequested)
     size_t elementsRequested = bytesRequested / GetElementSize();
     if (element + elementsRequested > GetElementCount())
     {
-        char message[256];
-        sprintf_s(message, "Element out of range, error accesing element %lld, size=%lld\n", element, bytesRequested);
-        RuntimeError(message);
+        RuntimeError("Element out of range, error accesing element %lld, size=%lld\n", (long long) element, (long long) bytesRequested);
     }
 
     // make sure we have the buffer in the range to handle the request
@@ -550,6 +628,17 @@ char* Section::EnsureElements(size_t element, size_t bytesRequested)
     return (char*) m_elementBuffer + (element - m_elemMin) * GetElementSize();
 }
 
+// Prefetch - hint that an element range will be accessed soon, only the part that is currently mapped is read ahead
+// element - beginning element
+// bytesRequested - bytes that will be accessed
+void Section::Prefetch(size_t element, size_t bytesRequested)
+{
+    if (m_elementBuffer == NULL || GetElementSize() == 0 || element < m_elemMin || element >= m_elemMax)
+        return;
+    size_t elementsRequested = min(bytesRequested / GetElementSize(), m_elemMax - element);
+    m_file->Prefetch((char*) m_elementBuffer + (element - m_elemMin) * GetElementSize(), elementsRequested * GetElementSize());
+}
+
 // GetElementBuffer - get the element buffer for the passed element and size
 // element - element we want the elementBuffer to start from
 // windowSize - minimum size of the window in bytes for Element Window (will not resize smaller)
@@ -559,9 +648,7 @@ char* Section::GetElementBuffer(size_t element, size_t windowSize)
     // check element range
     if (!m_file->Writing() && element >= GetElementCount())
     {
-        char message[256];
-        sprintf_s(message, "Element out of range, error accesing element %lld, max element=%lld\n", element, GetElementCount());
-        RuntimeError(message);
+        RuntimeError("Element out of range, error accesing element %lld, max element=%lld\n", (long long) element, (long long) GetElementCount());
     }
 
     // section is mapped as a whole, so no separate mapping for element buffer
@@ -700,7 +787,7 @@ void* Section::EnsureMapped(void* dataStart, size_t size)
         // Element Window is mapped separately so won't no need to remap
         if (m_mappingType != mappingElementWindow)
         {
-            int64_t offset = (byte*) view - (byte*) dataStart;
+            int64_t offset = (char*) view - (char*) dataStart;
             m_sectionHeader = (SectionHeader*) ((char*) m_sectionHeader + offset);
             m_elementBuffer = (char*) m_sectionHeader + m_sectionHeader->sizeHeader;
             RemapHeader(m_sectionHeader, m_filePosition);
@@ -1069,22 +1156,18 @@ void SectionString::SetLabelMapping(const std::map<SectionString::LabelIdType, S
         auto iter = labelMapping.find(i);
         if (iter == labelMapping.end())
         {
-            char message[256];
-            sprintf_s(message, "Mapping table doesn't contain an entry for label Id#%d\n", i);
-            RuntimeError(message);
+            RuntimeError("Mapping table doesn't contain an entry for label Id#%d\n", i);
         }
 
         // add to reverse mapping table
         m_mapLabelToId[iter->second] = i;
 
         const string& str = iter->second;
-        errno_t err = strcpy_s(curStr, size, str.c_str());
-        if (err)
+        if (str.length() + 1 > size)
         {
-            char message[256];
-            sprintf_s(message, "Not enough room in mapping buffer, %lld bytes insufficient for string %d - %s\n", originalSize, i, str.c_str());
-            RuntimeError(message);
+            RuntimeError("Not enough room in mapping buffer, %lld bytes insufficient for string %d - %s\n", (long long) originalSize, (int) i, str.c_str());
         }
+        strcpy(curStr, str.c_str());
         size_t len = str.length() + 1; // don't forget the null
         size -= len;
         curStr += len;
@@ -1103,9 +1186,7 @@ void* SectionString::GetElement(size_t index) const
     char* str = (char*) m_elementBuffer;
     if (index >= GetElementCount())
     {
-        char message[256];
-        sprintf_s(message, "GetElement: invalid index, %lld requested when there are only %lld elements\n", index, GetElementCount());
-        RuntimeError(message);
+        RuntimeError("GetElement: invalid index, %lld requested when there are only %lld elements\n", (long long) index, (long long) GetElementCount());
     }
 
     // now skip all the strings before the one that we want
@@ -1129,9 +1210,7 @@ char* SectionString::EnsureElements(size_t element, size_t bytesRequested)
     assert(GetMappingType() != mappingElementWindow); // not supported for string tables currently
     if (element >= GetElementCount())
     {
-        char message[256];
-        sprintf_s(message, "Element out of range, error accesing element %lld, size=%lld\n", element, bytesRequested);
-        RuntimeError(message);
+        RuntimeError("Element out of range, error accesing element %lld, size=%lld\n", (long long) element, (long long) bytesRequested);
     }
 
     // make sure we have the buffer in the range to handle the request
@@ -1220,7 +1299,7 @@ void SectionStats::InitCompute(const ConfigArray& compute)
     {
         std::string name = compute[i];
         auto stat = GetElement<NumericStatistics>(i);
-        strcpy_s(stat->statistic, name.c_str());
+        strcpy_s(stat->statistic, _countof(stat->statistic), name.c_str());
         stat->value = 0.0;
     }
 
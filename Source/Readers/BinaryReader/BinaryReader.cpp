@@ -208,10 +208,10 @@ void BinaryReader<ElemType>::StartMinibatchLoop(size_t mbSize, size_t epoch, siz
 }
 
 // CheckEndDataset - Check to see if we have arrived at the end of the dataset
-// actualmbsize - [in] the actual size of the dataset we are requesting,
+// actualmbsize - [in] the actual size of the dataset we are requesting, [out] reduced to what is left at the end of the epoch or dataset
 // returns - true if there we hit dataset end, false otherwise
 template <class ElemType>
-bool BinaryReader<ElemType>::CheckEndDataset(size_t actualmbsize)
+bool BinaryReader<ElemType>::CheckEndDataset(size_t& actualmbsize)
 {
     size_t epochEnd = m_epochSize;
     size_t epochSample = m_mbStartSample % m_epochSize;
@@ -324,6 +324,9 @@ bool BinaryReader<ElemType>::GetMinibatch(std::map<std::wstring, Matrix<ElemType
         {
             RuntimeError("GetMinibatch: Section %ls Auxilary section specified, and/or element size %lld mismatch", section->GetName().c_str(), section->GetElementSize());
         }
+
+        // the matrix is filled straight from the mapped pages; meanwhile have the next minibatch read ahead
+        section->Prefetch(index + rows * actualmbsize, size);
         gpuData->SetValue(rows, actualmbsize, gpuData->GetDeviceId(), data);
     }
 
@@ -125,13 +125,17 @@ struct ViewPosition
 };
 
 // BinaryFile - class that will read/write a Binary file to a local or network path
-// for local paths, the disk file will be memory mapped for best performance
+// for local paths, the disk file will be memory mapped for best performance (MapViewOfFile() on Windows, mmap() elsewhere)
 // if a network path is used, it still works fine, but consistency between processes is not guaranteed
 class BinaryFile
 {
 protected:
-    HANDLE m_hndFile;         // handle to the file
-    HANDLE m_hndMapped;       // handle to the mapped file object
+#ifdef _WIN32
+    HANDLE m_hndFile;   // handle to the file
+    HANDLE m_hndMapped; // handle to the mapped file object
+#else
+    int m_fd; // the file, views are mapped from it directly
+#endif
     size_t m_mappedSize;      // size of mapped file (zero for size of file being read)
     size_t m_maxViewSize;     // maximum size we want a single view to contain
     size_t m_viewAlignment;   // address alignment required by views
@@ -156,6 +160,7 @@ public:
     void* EnsureViewSize(void* view, size_t size);
     void* EnsureMapped(void* data, size_t size);
     vector<ViewPosition>::iterator Mapped(size_t filePosition, size_t& size);
+    void Prefetch(void* data, size_t size);
     size_t RoundUp(size_t filePosition);
     size_t GetViewAlignment()
     {
@@ -246,6 +251,7 @@ public:
         return (char*) m_elementBuffer + index * GetElementSize();
     }
     virtual char* EnsureElements(size_t element, size_t bytesRequested = 0);
+    void Prefetch(size_t element, size_t bytesRequested);
 
     SectionHeader* GetSectionHeader(size_t filePosition, MappingType& mappingType, size_t& size);
 
@@ -570,7 +576,7 @@ private:
     void SetupEpoch();
     void LoadSections(Section* parentSection, MappingType mapping, size_t windowSize);
     void DisplayProperties();
-    bool CheckEndDataset(size_t actualmbsize);
+    bool CheckEndDataset(size_t& actualmbsize);
 
 public:
     template <class ConfigRecordType>
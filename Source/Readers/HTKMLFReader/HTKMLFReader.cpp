@@ -75,6 +75,8 @@ void HTKMLFReader<ElemType>::InitFromConfig(const ConfigRecordType& readerConfig
     m_pMBLayout->Init(m_numSeqsPerMB, 0); // (SGD will ask before entering actual reading --TODO: This is hacky.)
 
     m_noData = false;
+    m_numUttBuffers = m_numSeqsPerMB;
+    m_packingWindow = 0;
 
     wstring command(readerConfig(L"action", L"")); // look up in the config for the master command to determine whether we're writing output (inputs only) or training/evaluating (inputs and outputs)
 
@@ -304,12 +306,20 @@ void HTKMLFReader<ElemType>::PrepareForTrainingOrTesting(const ConfigRecordType&
     wstring minibatchMode(readerConfig(L"minibatchMode", L"partial"));
     m_partialMinibatch = !_wcsicmp(minibatchMode.c_str(), L"partial");
 
+    // when reading whole utterances, pack the utterances of this many minibatches at a time by length, to minimize the gaps
+    m_packingWindow = readerConfig(L"packingWindow", (size_t) 0);
+    if (m_packingWindow > 0 && (m_frameMode || m_truncated))
+        InvalidArgument("'packingWindow' requires reading whole utterances ('frameMode' and 'truncated' false).");
+
     // get the read method, defaults to "blockRandomize" other option is "rollingWindow"
     wstring readMethod(readerConfig(L"readMethod", L"blockRandomize"));
 
     if (readMethod == L"blockRandomize" && randomize == randomizeNone)
         InvalidArgument("'randomize' cannot be 'none' when 'readMethod' is 'blockRandomize'.");
 
+    // with blockRandomize, read chunks ahead in a background thread, up to this much memory (0 = read chunks when they are needed)
+    size_t readAheadMemoryMB = readerConfig(L"readAheadMemoryMB", (size_t) 0);
+
     // read all input files (from multiple inputs)
     // TO DO: check for consistency (same number of files in each script file)
     numFiles = 0;
@@ -455,7 +465,7 @@ void HTKMLFReader<ElemType>::PrepareForTrainingOrTesting(const ConfigRecordType&
         m_lattices->setverbosity(m_verbosity);
 
         // now get the frame source. This has better randomization and doesn't create temp files
-        m_frameSource.reset(new msra::dbn::minibatchutterancesourcemulti(infilesmulti, labelsmulti, m_featDims, m_labelDims, numContextLeft, numContextRight, randomize, *m_lattices, m_latticeMap, m_frameMode));
+        m_frameSource.reset(new msra::dbn::minibatchutterancesourcemulti(infilesmulti, labelsmulti, m_featDims, m_labelDims, numContextLeft, numContextRight, randomize, *m_lattices, m_latticeMap, m_frameMode, readAheadMemoryMB * 1024 * 1024));
         m_frameSource->setverbosity(m_verbosity);
     }
     else if (!_wcsicmp(readMethod.c_str(), L"rollingWindow"))
@@ -662,24 +672,29 @@ void HTKMLFReader<ElemType>::StartDistributedMinibatchLoop(size_t requestedMBSiz
     // resize the arrays
     // These are sized to the requested number. If not all can be filled, it will still return this many, just with gaps.
     // In frame mode, m_numSeqsPerMB must be 1. However, the returned layout has one 1-frame sequence per frame.
+    // The utterance buffers hold the utterances that the next minibatches are filled from; when packing, that is a whole window.
+    m_numUttBuffers = m_numSeqsPerMB * std::max(m_packingWindow, (size_t) 1);
     m_sentenceEnd.assign(m_numSeqsPerMB, true);
-    m_processedFrame.assign(m_numSeqsPerMB, 0);
-    m_numFramesToProcess.assign(m_numSeqsPerMB, 0);
+    m_processedFrame.assign(m_numUttBuffers, 0);
+    m_numFramesToProcess.assign(m_numUttBuffers, 0);
     m_switchFrame.assign(m_numSeqsPerMB, 0);
     m_numValidFrames.assign(m_numSeqsPerMB, 0);
 
+    m_sequencePacker.Reset(m_numSeqsPerMB);
+    m_packingSeed = (epoch * numSubsets + subsetNum) << 32;
+
     if (m_trainOrTest)
     {
         // for the multi-utterance process
-        m_featuresBufferMultiUtt.assign(m_numSeqsPerMB, nullptr);
-        m_featuresBufferAllocatedMultiUtt.assign(m_numSeqsPerMB, 0);
-        m_labelsBufferMultiUtt.assign(m_numSeqsPerMB, nullptr);
-        m_labelsBufferAllocatedMultiUtt.assign(m_numSeqsPerMB, 0);
+        m_featuresBufferMultiUtt.assign(m_numUttBuffers, nullptr);
+        m_featuresBufferAllocatedMultiUtt.assign(m_numUttBuffers, 0);
+        m_labelsBufferMultiUtt.assign(m_numUttBuffers, nullptr);
+        m_labelsBufferAllocatedMultiUtt.assign(m_numUttBuffers, 0);
 
         // for the multi-utterance process for lattice and phone boundary
-        m_latticeBufferMultiUtt.assign(m_numSeqsPerMB, nullptr);
-        m_labelsIDBufferMultiUtt.resize(m_numSeqsPerMB);
-        m_phoneboundaryIDBufferMultiUtt.resize(m_numSeqsPerMB);
+        m_latticeBufferMultiUtt.assign(m_numUttBuffers, nullptr);
+        m_labelsIDBufferMultiUtt.resize(m_numUttBuffers);
+        m_phoneboundaryIDBufferMultiUtt.resize(m_numUttBuffers);
 
         if (m_frameMode && (m_numSeqsPerMB > 1))
         {
@@ -757,7 +772,7 @@ void HTKMLFReader<ElemType>::StartMinibatchLoopToTrainOrTest(size_t mbSize, size
             }
         }
 
-        m_featuresStartIndexMultiUtt.assign(m_featuresBufferMultiIO.size() * m_numSeqsPerMB, 0);
+        m_featuresStartIndexMultiUtt.assign(m_featuresBufferMultiIO.size() * m_numUttBuffers, 0);
     }
 
     if (!m_labelsBufferMultiIO.empty())
@@ -771,10 +786,10 @@ void HTKMLFReader<ElemType>::StartMinibatchLoopToTrainOrTest(size_t mbSize, size
             }
         }
 
-        m_labelsStartIndexMultiUtt.assign(m_labelsBufferMultiIO.size() * m_numSeqsPerMB, 0);
+        m_labelsStartIndexMultiUtt.assign(m_labelsBufferMultiIO.size() * m_numUttBuffers, 0);
     }
 
-    for (size_t u = 0; u < m_numSeqsPerMB; u++)
+    for (size_t u = 0; u < m_numUttBuffers; u++)
     {
         if (m_featuresBufferMultiUtt[u] != NULL)
         {
@@ -889,6 +904,9 @@ bool HTKMLFReader<ElemType>::GetMinibatchToTrainOrTest(std::map<std::wstring, Ma
         m_checkDictionaryKeys = false;
     }
 
+    if (m_packingWindow > 0)
+        return GetPackedMinibatchToTrainOrTest(matrices);
+
     Timer aggregateTimer;
     if (m_verbosity > 2)
         aggregateTimer.Start();
@@ -907,6 +925,7 @@ bool HTKMLFReader<ElemType>::GetMinibatchToTrainOrTest(std::map<std::wstring, Ma
             m_extraSeqsPerMB.clear();
             if (m_noData && m_numFramesToProcess[0] == 0) // no data left for the first channel of this minibatch,
             {
+                ReportPaddingEfficiency();
                 return false;
             }
 
@@ -1042,6 +1061,11 @@ bool HTKMLFReader<ElemType>::GetMinibatchToTrainOrTest(std::map<std::wstring, Ma
                     // and declare the remaining gaps as such
                     for (size_t i = 0; i < m_numSeqsPerMB; i++)
                         m_pMBLayout->AddGap(i, m_numValidFrames[i], m_mbNumTimeSteps);
+
+                    size_t numValidFrames = 0;
+                    for (size_t i = 0; i < m_numSeqsPerMB; i++)
+                        numValidFrames += m_numValidFrames[i];
+                    m_sequencePacker.CountMinibatch(m_extraSeqsPerMB.size(), numValidFrames, m_mbNumTimeSteps);
                 } // if (!frameMode)
 
                 for (auto iter = matrices.begin(); iter != matrices.end(); iter++)
@@ -1351,6 +1375,101 @@ bool HTKMLFReader<ElemType>::GetMinibatchToTrainOrTest(std::map<std::wstring, Ma
     return true;
 }
 
+// GetMinibatchToTrainOrTest() for whole utterances with 'packingWindow': the utterances of m_packingWindow minibatches
+// are buffered, packed by length (SequencePacker), and the resulting minibatches are returned in random order.
+template <class ElemType>
+bool HTKMLFReader<ElemType>::GetPackedMinibatchToTrainOrTest(std::map<std::wstring, Matrix<ElemType>*>& matrices)
+{
+    m_extraLatticeBufferMultiUtt.clear();
+    m_extraLabelsIDBufferMultiUtt.clear();
+    m_extraPhoneboundaryIDBufferMultiUtt.clear();
+    m_extraSeqsPerMB.clear();
+
+    if (!m_sequencePacker.HasMinibatches())
+    {
+        // the previous window has been returned completely; read the next one into the utterance buffers that it used up
+        vector<size_t> lengths(m_numUttBuffers, 0);
+        for (size_t src = 0; src < m_numUttBuffers; src++)
+        {
+            if (m_numFramesToProcess[src] == 0)
+                ReNewBufferForMultiIO(src);
+            size_t framenum = m_numFramesToProcess[src];
+            if (framenum > 0 && m_latticeBufferMultiUtt[src] != nullptr && m_latticeBufferMultiUtt[src]->getnumframes() != framenum)
+            {
+                // BUGBUG: see GetMinibatchToTrainOrTest()
+                fprintf(stderr, "WARNING: mismatched number of frames filled in the reader: %d in data vs %d in lattices. Ignoring this utterance %ls\n",
+                        (int) framenum, (int) m_latticeBufferMultiUtt[src]->getnumframes(), m_latticeBufferMultiUtt[src]->getkey().c_str());
+                m_numFramesToProcess[src] = 0;
+                continue;
+            }
+            lengths[src] = framenum;
+        }
+        m_sequencePacker.Pack(lengths, m_packingSeed++);
+        if (!m_sequencePacker.HasMinibatches()) // no data left
+        {
+            ReportPaddingEfficiency();
+            return false;
+        }
+    }
+
+    SequencePacker::Minibatch mb = m_sequencePacker.NextMinibatch();
+    m_mbNumTimeSteps = mb.numTimeSteps;
+    m_sequencePacker.GetLayout(mb, *m_pMBLayout);
+    m_numValidFrames = mb.numValidFrames;
+
+    for (const auto& placement : mb.sequences)
+    {
+        size_t src = placement.sequence;
+        fillOneUttDataforParallelmode(matrices, placement.tBegin, placement.tEnd - placement.tBegin, placement.s, src);
+        m_extraSeqsPerMB.push_back(placement.s);
+        if (m_latticeBufferMultiUtt[src] != nullptr)
+        {
+            m_extraLatticeBufferMultiUtt.push_back(m_latticeBufferMultiUtt[src]);
+            m_extraLabelsIDBufferMultiUtt.push_back(m_labelsIDBufferMultiUtt[src]);
+            m_extraPhoneboundaryIDBufferMultiUtt.push_back(m_phoneboundaryIDBufferMultiUtt[src]);
+        }
+        m_numFramesToProcess[src] = 0; // used up; refilled with the next window
+    }
+
+    // the utterances beyond the first one in each parallel sequence
+    m_extraNumSeqs = mb.sequences.size();
+    for (size_t i = 0; i < m_numSeqsPerMB; i++)
+        if (m_numValidFrames[i] > 0)
+            m_extraNumSeqs--;
+
+    for (auto iter = matrices.begin(); iter != matrices.end(); iter++)
+    {
+        // dereference matrix that corresponds to key (input/output name) and
+        // populate based on whether its a feature or a label
+        Matrix<ElemType>& data = *matrices[iter->first]; // can be features or labels
+        if (m_nameToTypeMap[iter->first] == InputOutputTypes::real)
+        {
+            size_t id = m_featureNameToIdMap[iter->first];
+            size_t dim = m_featureNameToDimMap[iter->first];
+            data.SetValue(dim, m_mbNumTimeSteps * m_numSeqsPerMB, data.GetDeviceId(), m_featuresBufferMultiIO[id].get(), matrixFlagNormal);
+        }
+        else if (m_nameToTypeMap[iter->first] == InputOutputTypes::category)
+        {
+            size_t id = m_labelNameToIdMap[iter->first];
+            size_t dim = m_labelNameToDimMap[iter->first];
+            data.SetValue(dim, m_mbNumTimeSteps * m_numSeqsPerMB, data.GetDeviceId(), m_labelsBufferMultiIO[id].get(), matrixFlagNormal);
+        }
+    }
+    return true;
+}
+
+// at the end of an epoch of whole utterances, report which fraction of the minibatches was valid frames rather than gaps
+template <class ElemType>
+void HTKMLFReader<ElemType>::ReportPaddingEfficiency()
+{
+    if (m_sequencePacker.GetNumMinibatches() == 0 || m_verbosity == 0)
+        return;
+    fprintf(stderr, "HTKMLFReader: %d utterances in %d minibatches (%s), %d of %d frames valid: padding efficiency %.2f%%\n",
+            (int) m_sequencePacker.GetNumSequences(), (int) m_sequencePacker.GetNumMinibatches(), m_packingWindow > 0 ? "packed by length" : "in arrival order",
+            (int) m_sequencePacker.GetNumValidFrames(), (int) m_sequencePacker.GetNumFrames(), 100.0 * m_sequencePacker.GetPaddingEfficiency());
+    m_sequencePacker.ResetStatistics();
+}
+
 // copy an utterance into the minibatch given a location (parallel-sequence index, start frame)
 // TODO: This should use DataFor(). But for that, DataFor() will have to move out from ComputationNode. Ah, it has!
 template <class ElemType>
@@ -8,6 +8,7 @@
 #include "DataReader.h"
 #include "Config.h" // for intargvector
 #include "CUDAPageLockedMemAllocator.h"
+#include "SequencePacker.h"
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -39,6 +40,10 @@ private:
     vector<size_t> m_numValidFrames;     // [seq index] valid #frames in each parallel sequence. Frames (s, t) with t >= m_numValidFrames[s] are NoInput.
     vector<size_t> m_extraSeqsPerMB;
     size_t m_extraNumSeqs;
+    size_t m_numUttBuffers;  // number of utterances buffered (m_featuresBufferMultiUtt etc.): m_numSeqsPerMB, or m_packingWindow times that
+    size_t m_packingWindow;  // (whole utterances) pack the utterances of this many minibatches at a time by length; 0 = fill the parallel sequences in arrival order
+    size_t m_packingSeed;    // random seed of the next packed window
+    SequencePacker m_sequencePacker; // packs the windows, and counts the padding in either case
     bool m_noData;
     bool m_trainOrTest; // if false, in file writing mode
     using LabelType = typename IDataReader<ElemType>::LabelType;
@@ -98,6 +103,8 @@ private:
     void PrepareForWriting(const ConfigRecordType& config);
 
     bool GetMinibatchToTrainOrTest(std::map<std::wstring, Matrix<ElemType>*>& matrices);
+    bool GetPackedMinibatchToTrainOrTest(std::map<std::wstring, Matrix<ElemType>*>& matrices);
+    void ReportPaddingEfficiency();
     bool GetMinibatch4SEToTrainOrTest(std::vector<shared_ptr<const msra::dbn::latticepair>>& latticeinput, vector<size_t>& uids, vector<size_t>& boundaries, std::vector<size_t>& extrauttmap);
     void fillOneUttDataforParallelmode(std::map<std::wstring, Matrix<ElemType>*>& matrices, size_t startFr, size_t framenum, size_t channelIndex, size_t sourceChannelIndex);
     bool GetMinibatchToWrite(std::map<std::wstring, Matrix<ElemType>*>& matrices);
@@ -13,6 +13,12 @@
 #include "minibatchsourcehelpers.h"
 #include "minibatchiterator.h"
 #include "unordered_set"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <chrono>
 
 namespace msra { namespace dbn {
 
@@ -142,37 +148,52 @@ class minibatchutterancesourcemulti : public minibatchsource
                 LogicError("requiredata: called when data is already in memory");
             try // this function supports retrying since we read from the unrealible network, i.e. do not return in a broken state
             {
-                msra::asr::htkfeatreader reader; // feature reader (we reinstantiate it for each block, i.e. we reopen the file actually)
                 // if this is the first feature read ever, we explicitly open the first file to get the information such as feature dimension
                 if (featdim == 0)
                 {
+                    msra::asr::htkfeatreader reader;
                     reader.getinfo(utteranceset[0].parsedpath, featkind, featdim, sampperiod);
                     fprintf(stderr, "requiredata: determined feature kind as %d-dimensional '%s' with frame shift %.1f ms\n", (int) featdim, featkind.c_str(), sampperiod / 1e4);
                 }
-                // read all utterances; if they are in the same archive, htkfeatreader will be efficient in not closing the file
-                frames.resize(featdim, totalframes);
-                if (!latticesource.empty())
-                    lattices.resize(utteranceset.size());
-                foreach_index (i, utteranceset)
-                {
-                    // fprintf (stderr, ".");
-                    // read features for this file
-                    auto uttframes = getutteranceframes(i);                                                    // matrix stripe for this utterance (currently unfilled)
-                    reader.read(utteranceset[i].parsedpath, (const string &) featkind, sampperiod, uttframes); // note: file info here used for checkuing only
-                    // page in lattice data
-                    if (!latticesource.empty())
-                        latticesource.getlattices(utteranceset[i].key(), lattices[i], uttframes.cols());
-                }
-                // fprintf (stderr, "\n");
-                if (verbosity)
-                    fprintf(stderr, "requiredata: %d utterances read\n", (int) utteranceset.size());
+                readdata(featkind, featdim, sampperiod, latticesource, frames, lattices, verbosity);
             }
             catch (...)
             {
-                releasedata();
+                if (isinram())
+                    releasedata();
                 throw;
             }
         }
+        // read the data of this chunk into 'frames' and 'lattices', without touching this object's cache
+        // This is what requiredata() does, and what the read-ahead thread does concurrently to the main thread.
+        void readdata(const string &featkind, size_t featdim, unsigned int sampperiod, const latticesource &latticesource,
+                      msra::dbn::matrix &frames, std::vector<shared_ptr<const latticesource::latticepair>> &lattices, int verbosity) const
+        {
+            msra::asr::htkfeatreader reader; // feature reader (we reinstantiate it for each block, i.e. we reopen the file actually)
+            // read all utterances; if they are in the same archive, htkfeatreader will be efficient in not closing the file
+            frames.resize(featdim, totalframes);
+            if (!latticesource.empty())
+                lattices.resize(utteranceset.size());
+            foreach_index (i, utteranceset)
+            {
+                // read features for this file
+                msra::dbn::matrixstripe uttframes(frames, firstframes[i], numframes(i));                   // matrix stripe for this utterance (currently unfilled)
+                reader.read(utteranceset[i].parsedpath, (const string &) featkind, sampperiod, uttframes); // note: file info here used for checkuing only
+                // page in lattice data
+                if (!latticesource.empty())
+                    latticesource.getlattices(utteranceset[i].key(), lattices[i], uttframes.cols());
+            }
+            if (verbosity)
+                fprintf(stderr, "requiredata: %d utterances read\n", (int) utteranceset.size());
+        }
+        // page in data that was read by readdata() (the arguments are emptied)
+        void adoptdata(msra::dbn::matrix &frames, std::vector<shared_ptr<const latticesource::latticepair>> &lattices) const
+        {
+            if (isinram())
+                LogicError("adoptdata: called when data is already in memory");
+            this->frames.swap(frames);
+            this->lattices.swap(lattices);
+        }
         // page out data for this chunk
         void releasedata() const
         {
@@ -285,6 +306,34 @@ class minibatchutterancesourcemulti : public minibatchsource
     };
     std::vector<positionchunkwindow> positionchunkwindows; // [utterance position] -> [windowbegin, windowend) for controlling paging
 
+    // background read-ahead of chunks
+    // If a memory budget is given, a paging thread loads the chunks that the next getbatch() calls will page in,
+    // in the order they will be needed, for as many chunks as fit into the budget. The loaded data is handed over
+    // to the chunks in requirerandomizedchunk() on the main thread, so that the chunk data structures are only
+    // ever touched by the main thread. Once the thread runs, all reads go through it, since the lattice archives
+    // are not thread-safe.
+    struct readaheadchunk // a chunk that is queued, being read, or read by the read-ahead thread
+    {
+        std::vector<msra::dbn::matrix> frames;                                            // [feature stream] read data
+        std::vector<std::vector<shared_ptr<const latticesource::latticepair>>> lattices; // [feature stream] (may be empty if none)
+        bool isread;
+        std::exception_ptr error; // reading failed; rethrown on the main thread
+        readaheadchunk()
+            : isread(false)
+        {
+        }
+    };
+    size_t readaheadmemorybudget;                      // in bytes; 0 means no read-ahead
+    std::thread readaheadthread;                       // started by the first getbatch() after the feature kinds are known
+    std::mutex readaheadmutex;                         // guards everything below
+    std::condition_variable readaheadsignal;           // a chunk was queued or read, or termination was requested
+    std::deque<size_t> readaheadqueue;                 // [original chunk index] to be read, in order of need
+    std::map<size_t, readaheadchunk> readaheadchunks;  // [original chunk index] -> queued, being read, or read
+    bool readaheadterminate;                           // tells the thread to exit
+    size_t readaheadnumready;                          // statistics: chunks that were read ahead in time
+    size_t readaheadnumwaited;                         // statistics: chunks the main thread had to wait for
+    double readaheadwaitseconds;                       // statistics: total time the main thread waited
+
     // frame-level randomization layered on top of utterance chunking (randomized, where randomization is cached)
     struct frameref
     {
@@ -388,8 +437,10 @@ public:
     // This mode requires utterances with time stamps.
     minibatchutterancesourcemulti(const std::vector<std::vector<wstring>> &infiles, const std::vector<map<wstring, std::vector<msra::asr::htkmlfentry>>> &labels,
                                   std::vector<size_t> vdim, std::vector<size_t> udim, std::vector<size_t> leftcontext, std::vector<size_t> rightcontext, size_t randomizationrange,
-                                  const latticesource &lattices, const map<wstring, msra::lattices::lattice::htkmlfwordsequence> &allwordtranscripts, const bool framemode)
-        : vdim(vdim), leftcontext(leftcontext), rightcontext(rightcontext), sampperiod(0), featdim(0), randomizationrange(randomizationrange), currentsweep(SIZE_MAX), lattices(lattices), allwordtranscripts(allwordtranscripts), framemode(framemode), chunksinram(0), timegetbatch(0), verbosity(2)
+                                  const latticesource &lattices, const map<wstring, msra::lattices::lattice::htkmlfwordsequence> &allwordtranscripts, const bool framemode,
+                                  size_t readaheadmemorybudget = 0 /*bytes of chunk data to read ahead in the background; 0 = off*/)
+        : vdim(vdim), leftcontext(leftcontext), rightcontext(rightcontext), sampperiod(0), featdim(0), randomizationrange(randomizationrange), currentsweep(SIZE_MAX), lattices(lattices), allwordtranscripts(allwordtranscripts), framemode(framemode), chunksinram(0), timegetbatch(0), verbosity(2),
+          readaheadmemorybudget(readaheadmemorybudget), readaheadterminate(false), readaheadnumready(0), readaheadnumwaited(0), readaheadwaitseconds(0)
     // [v-hansu] change framemode (lattices.empty()) into framemode (false) to run utterance mode without lattice
     // you also need to change another line, search : [v-hansu] comment out to run utterance mode without lattice
     {
@@ -753,6 +804,9 @@ private:
         currentsweep = sweep;
         if (verbosity > 0)
             fprintf(stderr, "lazyrandomization: re-randomizing for sweep %d in %s mode\n", (int) currentsweep, framemode ? "frame" : "utterance");
+        printreadaheadstatistics(); // (of the previous sweep)
+        readaheadnumready = readaheadnumwaited = 0;
+        readaheadwaitseconds = 0;
 
         const size_t sweepts = sweep * _totalframes; // first global frame index for this sweep
 
@@ -1103,6 +1157,12 @@ private:
         }
         if (numinram == randomizedchunks.size())
             return false;
+        else if (numinram == 0 && readaheadthread.joinable())
+        {
+            requirereadaheadchunk(chunkindex);
+            chunksinram++;
+            return true;
+        }
         else if (numinram == 0)
         {
             foreach_index (m, randomizedchunks)
@@ -1125,6 +1185,178 @@ private:
         }
     }
 
+    // original (non-randomized) index of a randomized chunk, which is the same for all feature streams; used as the key for read-ahead
+    size_t originalchunkindex(size_t k) const
+    {
+        return randomizedchunks[0][k].uttchunkdata - allchunks[0].begin();
+    }
+
+    // the read-ahead thread: reads queued chunks one by one
+    // The feature kinds are passed in since the main thread determines them lazily.
+    void readaheadthreadproc(const std::vector<string> featkind, const std::vector<size_t> featdim, const std::vector<unsigned int> sampperiod)
+    {
+        std::unique_lock<std::mutex> lock(readaheadmutex);
+        for (;;)
+        {
+            readaheadsignal.wait(lock, [&]()
+                                 {
+                                     return readaheadterminate || !readaheadqueue.empty();
+                                 });
+            if (readaheadterminate)
+                return;
+            const size_t k = readaheadqueue.front();
+            readaheadqueue.pop_front();
+            lock.unlock();
+
+            readaheadchunk chunk; // read into a local, since the main thread may drop the request meanwhile
+            try
+            {
+                chunk.frames.resize(allchunks.size());
+                chunk.lattices.resize(allchunks.size());
+                foreach_index (m, allchunks)
+                {
+                    msra::util::attempt(5, [&]() // (reading from network)
+                                        {
+                                            allchunks[m][k].readdata(featkind[m], featdim[m], sampperiod[m], this->lattices, chunk.frames[m], chunk.lattices[m], verbosity);
+                                        });
+                }
+            }
+            catch (...)
+            {
+                chunk.error = std::current_exception();
+            }
+
+            lock.lock();
+            auto iter = readaheadchunks.find(k);
+            if (iter != readaheadchunks.end()) // (else the request was dropped while reading)
+            {
+                iter->second = std::move(chunk);
+                iter->second.isread = true;
+            }
+            readaheadsignal.notify_all();
+        }
+    }
+
+    // page in a randomized chunk from the read-ahead thread, waiting for it if it has not been read yet
+    void requirereadaheadchunk(const size_t chunkindex)
+    {
+        const size_t k = originalchunkindex(chunkindex);
+        readaheadchunk chunk;
+        {
+            std::unique_lock<std::mutex> lock(readaheadmutex);
+            auto iter = readaheadchunks.find(k);
+            if (iter == readaheadchunks.end()) // not requested in time (e.g. at the start of a sweep): read it next
+            {
+                iter = readaheadchunks.insert(std::make_pair(k, readaheadchunk())).first;
+                readaheadqueue.push_front(k);
+                readaheadsignal.notify_all();
+            }
+            else if (!iter->second.isread) // queued or being read: move it to the head of the queue if not yet started
+            {
+                auto queueiter = std::find(readaheadqueue.begin(), readaheadqueue.end(), k);
+                if (queueiter != readaheadqueue.end())
+                {
+                    readaheadqueue.erase(queueiter);
+                    readaheadqueue.push_front(k);
+                }
+            }
+
+            if (iter->second.isread)
+                readaheadnumready++;
+            else
+            {
+                auto waitstart = std::chrono::steady_clock::now();
+                readaheadsignal.wait(lock, [&]()
+                                     {
+                                         return readaheadchunks[k].isread;
+                                     });
+                readaheadnumwaited++;
+                readaheadwaitseconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - waitstart).count();
+                iter = readaheadchunks.find(k);
+            }
+            chunk = std::move(iter->second);
+            readaheadchunks.erase(iter);
+        }
+        if (chunk.error)
+            std::rethrow_exception(chunk.error);
+
+        foreach_index (m, randomizedchunks)
+        {
+            const auto &randomizedchunk = randomizedchunks[m][chunkindex];
+            if (verbosity)
+                fprintf(stderr, "feature set %d: requirerandomizedchunk: paging in randomized chunk %d (frame range [%d..%d]) from read-ahead, %d resident in RAM\n", m, (int) chunkindex, (int) randomizedchunk.globalts, (int) (randomizedchunk.globalte() - 1), (int) (chunksinram + 1));
+            randomizedchunk.getchunkdata().adoptdata(chunk.frames[m], chunk.lattices[m]);
+        }
+    }
+
+    // queue the chunks that will be paged in next for the read-ahead thread
+    // The chunk window slides to the right along the randomized chunks (cf. positionchunkwindows), so the chunks
+    // are needed roughly in order, starting with those of the current window that are not in RAM yet ('firstchunk'
+    // is the current window's begin). Requests that are beyond the memory budget, or no longer needed, are dropped.
+    void updatereadahead(const size_t firstchunk, const size_t subsetnum, const size_t numsubsets)
+    {
+        // start the thread once all feature kinds are known
+        if (!readaheadthread.joinable())
+        {
+            foreach_index (m, featdim)
+                if (featdim[m] == 0)
+                    return;
+            readaheadthread = std::thread(&minibatchutterancesourcemulti::readaheadthreadproc, this, featkind, featdim, sampperiod);
+        }
+
+        // determine the chunks to read ahead: the next ones not yet in RAM, as far as they fit into the budget
+        std::vector<size_t> wanted; // [original chunk index]
+        std::unordered_set<size_t> wantedset;
+        size_t bytes = 0;
+        for (size_t chunkindex = firstchunk; chunkindex < randomizedchunks[0].size(); chunkindex++)
+        {
+            if ((chunkindex % numsubsets) != subsetnum || randomizedchunks[0][chunkindex].getchunkdata().isinram())
+                continue;
+            const size_t k = originalchunkindex(chunkindex);
+            size_t chunkbytes = 0;
+            foreach_index (m, featdim)
+                chunkbytes += featdim[m] * allchunks[m][k].totalframes * sizeof(float);
+            if (bytes + chunkbytes > readaheadmemorybudget && !wanted.empty())
+                break;
+            bytes += chunkbytes;
+            wanted.push_back(k);
+            wantedset.insert(k);
+        }
+
+        std::lock_guard<std::mutex> lock(readaheadmutex);
+        const std::unordered_set<size_t> queued(readaheadqueue.begin(), readaheadqueue.end());
+        // drop what is no longer wanted, except the chunk being read (it gets dropped once read)
+        for (auto iter = readaheadchunks.begin(); iter != readaheadchunks.end();)
+        {
+            if (wantedset.find(iter->first) == wantedset.end() && (iter->second.isread || queued.find(iter->first) != queued.end()))
+                iter = readaheadchunks.erase(iter);
+            else
+                iter++;
+        }
+        // (re-)queue the wanted chunks in order of need
+        readaheadqueue.clear();
+        for (auto k : wanted)
+        {
+            auto iter = readaheadchunks.find(k);
+            if (iter == readaheadchunks.end())
+            {
+                readaheadchunks.insert(std::make_pair(k, readaheadchunk()));
+                readaheadqueue.push_back(k);
+            }
+            else if (queued.find(k) != queued.end())
+                readaheadqueue.push_back(k);
+            // else already read, or being read
+        }
+        readaheadsignal.notify_all();
+    }
+
+    void printreadaheadstatistics() const
+    {
+        if (readaheadthread.joinable() && readaheadnumready + readaheadnumwaited > 0)
+            fprintf(stderr, "minibatchutterancesourcemulti: read-ahead had %d of %d chunks ready in time; waited %.2f seconds for the other %d\n",
+                    (int) readaheadnumready, (int) (readaheadnumready + readaheadnumwaited), readaheadwaitseconds, (int) readaheadnumwaited);
+    }
+
     class matrixasvectorofvectors // wrapper around a matrix that views it as a vector of column vectors
     {
         void operator=(const matrixasvectorofvectors &); // non-assignable
@@ -1159,6 +1391,20 @@ private:
     }
 
 public:
+    ~minibatchutterancesourcemulti()
+    {
+        if (readaheadthread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(readaheadmutex);
+                readaheadterminate = true;
+            }
+            readaheadsignal.notify_all();
+            readaheadthread.join();
+            printreadaheadstatistics();
+        }
+    }
+
     void setverbosity(int newverbosity)
     {
         verbosity = newverbosity;
@@ -1221,6 +1467,8 @@ public:
             for (size_t pos = spos; pos < epos; pos++)
                 if ((randomizedutterancerefs[pos].chunkindex % numsubsets) == subsetnum)
                     readfromdisk |= requirerandomizedchunk(randomizedutterancerefs[pos].chunkindex, windowbegin, windowend); // (window range passed in for checking only)
+            if (readaheadmemorybudget > 0)
+                updatereadahead(windowbegin, subsetnum, numsubsets);
 
             // Note that the above loop loops over all chunks incl. those that we already should have.
             // This has an effect, e.g., if 'numsubsets' has changed (we will fill gaps).
@@ -1373,6 +1621,8 @@ public:
                     readfromdisk |= requirerandomizedchunk(k, windowbegin, windowend); // (window range passed in for checking only, redundant here)
             for (size_t k = windowend; k < randomizedchunks[0].size(); k++)
                 releaserandomizedchunk(k);
+            if (readaheadmemorybudget > 0)
+                updatereadahead(windowend, subsetnum, numsubsets);
 
             // determine the true #frames we return--it is less than mbframes in the case of MPI/data-parallel sub-set mode
             // First determine it for all nodes, then pick the min over all nodes, as to give all the same #frames for better load balancing.
@@ -0,0 +1,146 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// NoiseSampler.h -- unigram noise sampler for NCE training with the LMSequenceReader
+//
+#pragma once
+
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+
+// noiseSampler -- draws noise words for NCE from the unigram distribution
+// Uses an alias table (Vose's method), so a draw costs one random number and two table lookups
+// regardless of the vocabulary size.
+template <typename Count>
+class noiseSampler
+{
+    std::vector<double> m_prob, m_log_prob;
+    std::vector<double> m_aliasProb; // [i] probability of keeping bucket i rather than taking its alias
+    std::vector<Count> m_alias;      // [i] the word that fills the rest of bucket i
+    std::uniform_int_distribution<Count> unif_int;
+    std::uniform_real_distribution<double> unif_real;
+    bool uniform_sampling;
+    double uniform_prob;
+    double uniform_log_prob;
+    std::mt19937 rng;
+    std::vector<double> m_uniforms; // buffer for batched draws
+
+    void BuildAliasTable()
+    {
+        size_t k = m_prob.size();
+        m_aliasProb.assign(k, 1.0);
+        m_alias.resize(k);
+        std::vector<double> scaled(k);
+        std::vector<Count> small, large;
+        for (size_t i = 0; i < k; i++)
+        {
+            m_alias[i] = (Count) i;
+            scaled[i] = m_prob[i] * k;
+            (scaled[i] < 1.0 ? small : large).push_back((Count) i);
+        }
+        while (!small.empty() && !large.empty())
+        {
+            Count s = small.back();
+            small.pop_back();
+            Count l = large.back();
+            large.pop_back();
+            m_aliasProb[s] = scaled[s];
+            m_alias[s] = l;
+            scaled[l] -= 1.0 - scaled[s];
+            (scaled[l] < 1.0 ? small : large).push_back(l);
+        }
+        // what remains is 1 up to rounding errors; those buckets keep m_aliasProb = 1
+    }
+
+public:
+    noiseSampler()
+    {
+    }
+    noiseSampler(const std::vector<double>& counts, bool xuniform_sampling = false)
+        : uniform_sampling(xuniform_sampling), rng(1234)
+    {
+        size_t k = counts.size();
+        uniform_prob = 1.0 / k;
+        uniform_log_prob = std::log(uniform_prob);
+        double total = 0;
+        for (double count : counts)
+            total += count;
+        m_prob.resize(k);
+        m_log_prob.resize(k);
+        for (size_t i = 0; i < k; i++)
+        {
+            m_prob[i] = counts[i] / total;
+            m_log_prob[i] = std::log(m_prob[i]);
+        }
+        BuildAliasTable();
+        unif_int = std::uniform_int_distribution<Count>(0, (Count) k - 1);
+        unif_real = std::uniform_real_distribution<double>(0.0, (double) k);
+    }
+    int size() const
+    {
+        return m_prob.size();
+    }
+    double prob(int i) const
+    {
+        if (uniform_sampling)
+            return uniform_prob;
+        else
+            return m_prob[i];
+    }
+    double logprob(int i) const
+    {
+        if (uniform_sampling)
+            return uniform_log_prob;
+        else
+            return m_log_prob[i];
+    }
+
+    template <typename Engine>
+    int sample(Engine& eng)
+    {
+        if (uniform_sampling)
+            return (int) unif_int(eng);
+        // the integer part of u selects the bucket, the fractional part decides between the bucket and its alias
+        double u = unif_real(eng);
+        size_t i = std::min((size_t) u, m_alias.size() - 1);
+        return (int) ((u - i) < m_aliasProb[i] ? (Count) i : m_alias[i]);
+    }
+
+    int sample()
+    {
+        return sample(this->rng);
+    }
+
+    // draw n samples at once; the random numbers are drawn first, so that the table lookups form a loop of their own
+    template <typename Engine>
+    void sample(Engine& eng, int* samples, size_t n)
+    {
+        if (uniform_sampling)
+        {
+            for (size_t j = 0; j < n; j++)
+                samples[j] = (int) unif_int(eng);
+            return;
+        }
+        m_uniforms.resize(n);
+        for (size_t j = 0; j < n; j++)
+            m_uniforms[j] = unif_real(eng);
+        const size_t last = m_alias.size() - 1;
+        for (size_t j = 0; j < n; j++)
+        {
+            size_t i = std::min((size_t) m_uniforms[j], last);
+            samples[j] = (int) ((m_uniforms[j] - i) < m_aliasProb[i] ? (Count) i : m_alias[i]);
+        }
+    }
+
+    void sample(int* samples, size_t n)
+    {
+        sample(this->rng, samples, n);
+    }
+};
+} } }
@@ -544,6 +544,7 @@ void SequenceReader<ElemType>::InitFromConfig(const ConfigRecordType& readerConf
     m_readNextSample = 0;
     m_traceLevel = readerConfig(L"traceLevel", 0);
     m_parser.SetTraceLevel(m_traceLevel);
+    m_sparseInput = readerConfig(L"sparseInput", false);
 
     // The input data is a combination of the label Data and extra feature dims together
     //    m_featureCount = m_featureDim + m_labelInfo[labelInfoIn].dim;
@@ -995,6 +996,40 @@ bool SequenceReader<ElemType>::SentenceEnd()
 /// the second row is the class id of this word
 /// the third row is begining index of the class for this word
 /// the fourth row is the ending index + 1 of the class for this word
+// fill the one-hot word input; column j has a 1 in row wordIds[j]
+// With sparse input, the CSC arrays are built directly, which avoids zeroing a dim x numCols dense matrix
+// and lets the product in the following TimesNode or LookupTableNode run sparse.
+template <class ElemType>
+void SequenceReader<ElemType>::SetOneHotFeatures(Matrix<ElemType>& features, size_t dim, const ElemType* wordIds, size_t numCols)
+{
+    if (m_sparseInput && features.GetMatrixType() == MatrixType::DENSE)
+        features.SwitchToMatrixType(MatrixType::SPARSE, matrixFormatSparseCSC, false);
+
+    if (features.GetMatrixType() == MatrixType::SPARSE)
+    {
+        m_oneHotColStarts.resize(numCols + 1);
+        m_oneHotRows.resize(numCols);
+        m_oneHotValues.assign(numCols, (ElemType) 1);
+        for (size_t j = 0; j < numCols; j++)
+        {
+            m_oneHotColStarts[j] = (CPUSPARSE_INDEX_TYPE) j;
+            m_oneHotRows[j] = (CPUSPARSE_INDEX_TYPE) wordIds[j];
+        }
+        m_oneHotColStarts[numCols] = (CPUSPARSE_INDEX_TYPE) numCols;
+        features.SetMatrixFromCSCFormat(m_oneHotColStarts.data(), m_oneHotRows.data(), m_oneHotValues.data(), numCols, dim, numCols);
+        return;
+    }
+
+    // dense: we always fill it on the cpu and then convert to gpu if gpu is desired
+    DEVICEID_TYPE featureDeviceId = features.GetDeviceId();
+    features.TransferFromDeviceToDevice(featureDeviceId, CPUDEVICE, false, true, false);
+    features.Resize(dim, numCols);
+    features.SetValue(0);
+    for (size_t j = 0; j < numCols; j++)
+        features.SetValue((size_t) wordIds[j], j, (ElemType) 1);
+    features.TransferFromDeviceToDevice(CPUDEVICE, featureDeviceId, false, false, false);
+}
+
 template <class ElemType>
 void SequenceReader<ElemType>::GetLabelOutput(std::map<std::wstring, Matrix<ElemType>*>& matrices,
                                               size_t m_mbStartSample, size_t actualmbsize)
@@ -1011,6 +1046,9 @@ void SequenceReader<ElemType>::GetLabelOutput(std::map<std::wstring, Matrix<Elem
     else if (readerMode == ReaderMode::Softmax)
         labels->Resize(1, actualmbsize);
 
+    if (readerMode == ReaderMode::NCE)
+        SampleNoise(actualmbsize);
+
     for (size_t jSample = m_mbStartSample; j < actualmbsize; ++j, ++jSample)
     {
         // pick the right sample with randomization if desired
@@ -1023,7 +1061,7 @@ void SequenceReader<ElemType>::GetLabelOutput(std::map<std::wstring, Matrix<Elem
             labels->SetValue(1, j, (ElemType) m_noiseSampler.logprob(wrd));
             for (size_t noiseid = 0; noiseid < this->noise_sample_size; noiseid++)
             {
-                int wid = m_noiseSampler.sample();
+                int wid = NoiseSample(j, noiseid);
                 labels->SetValue(2 * (noiseid + 1), j, (ElemType) wid);
                 labels->SetValue(2 * (noiseid + 1) + 1, j, -(ElemType) m_noiseSampler.logprob(wid));
             }
@@ -1207,21 +1245,6 @@ bool SequenceReader<ElemType>::GetMinibatch(std::map<std::wstring, Matrix<ElemTy
 
         // loop through all the samples
         int j = 0;
-        Matrix<ElemType>& features = *matrices[m_featuresName];
-        if (matrices.find(m_featuresName) != matrices.end())
-        {
-            if (features.GetMatrixType() == MatrixType::DENSE)
-            {
-                features.Resize(labelInfo.dim, actualmbsize, false);
-                features.SetValue(0);
-            }
-            else
-            {
-                features.Resize(labelInfo.dim, actualmbsize);
-                features.Reset();
-            }
-        }
-
         for (size_t jSample = m_mbStartSample; j < actualmbsize; ++j, ++jSample)
         {
             // pick the right sample with randomization if desired
@@ -1230,11 +1253,11 @@ bool SequenceReader<ElemType>::GetMinibatch(std::map<std::wstring, Matrix<ElemTy
             // vector of feature data goes into matrix column
             size_t idx = (size_t) m_featureData[jRand];
             m_featuresBuffer[j * labelInfo.dim + idx] = (ElemType) 1;
-
-            if (matrices.find(m_featuresName) != matrices.end())
-                features.SetValue(idx, j, (ElemType) 1);
         }
 
+        if (matrices.find(m_featuresName) != matrices.end())
+            SetOneHotFeatures(*matrices[m_featuresName], labelInfo.dim, &m_featureData[m_mbStartSample], actualmbsize);
+
         GetLabelOutput(matrices, m_mbStartSample, actualmbsize);
         GetInputToClass(matrices);
         GetClassInfo();
@@ -1406,6 +1429,7 @@ void BatchSequenceReader<ElemType>::InitFromConfig(const ConfigRecordType& reade
         readerMode = ReaderMode::NCE;
 
         this->noise_sample_size = featureConfig(L"noise_number", 0);
+        noise_shared = featureConfig(L"noise_shared", false);
     }
     else if (mode == L"softmax")
         readerMode = ReaderMode::Softmax;
@@ -1525,6 +1549,7 @@ void BatchSequenceReader<ElemType>::InitFromConfig(const ConfigRecordType& reade
     m_readNextSample = 0;
     m_traceLevel = readerConfig(L"traceLevel", 0);
     m_parser.SetTraceLevel(m_traceLevel);
+    m_sparseInput = readerConfig(L"sparseInput", false);
 
     if (readerConfig.Exists(L"randomize"))
     {
@@ -1893,35 +1918,8 @@ bool BatchSequenceReader<ElemType>::GetMinibatch(std::map<std::wstring, Matrix<E
         }
 
         // copy m_featureData to matrix
-        // m_featureData is a sparse, already with interleaved parallel sequences. We copy it into a dense matrix.
-        // we always copy it to cpu first and then convert to gpu if gpu is desired.
-        DEVICEID_TYPE featureDeviceId = features.GetDeviceId();
-        features.TransferFromDeviceToDevice(featureDeviceId, CPUDEVICE, false, true, false);
-
-        if (features.GetMatrixType() == MatrixType::DENSE)
-        {
-            features.Resize(labelInfo.dim, actualmbsize);
-            features.SetValue(0);
-        }
-        else
-        {
-            features.Resize(labelInfo.dim, actualmbsize, actualmbsize);
-            features.Reset();
-        }
-
-        for (size_t j = 0; j < actualmbsize; ++j) // note: this is a loop over matrix columns, not time steps or parallel sequences
-        {
-            // vector of feature data goes into matrix column
-            size_t idx = (size_t) m_featureData[j]; // one-hot index of the word, indexed by column (i.e. already interleaved)
-
-            features.SetValue(idx, j, (ElemType) 1);
-
-            // actual time position
-            // size_t timeIdx = (size_t)j / mToProcess.size();
-            // size_t uttIdx = (size_t)fmod(j, mToProcess.size()); // parallel-sequence index
-        }
-
-        features.TransferFromDeviceToDevice(CPUDEVICE, featureDeviceId, false, false, false);
+        // m_featureData is a sparse, already with interleaved parallel sequences, i.e. the one-hot index of the word for each matrix column.
+        SetOneHotFeatures(features, labelInfo.dim, m_featureData.data(), actualmbsize);
 
         // TODO: move these two methods to startMiniBatchLoop()
         if (readerMode == ReaderMode::Class)
@@ -2073,6 +2071,9 @@ void BatchSequenceReader<ElemType>::GetLabelOutput(std::map<std::wstring,
     else
         labels->Resize(1, actualmbsize, false);
 
+    if (readerMode == ReaderMode::NCE)
+        this->SampleNoise(actualmbsize);
+
     // move to CPU since element-wise operation is expensive and can go wrong in GPU
     int curDevId = labels->GetDeviceId();
     labels->TransferFromDeviceToDevice(curDevId, CPUDEVICE, true, false, false);
@@ -2092,7 +2093,7 @@ void BatchSequenceReader<ElemType>::GetLabelOutput(std::map<std::wstring,
                 labels->SetValue(1, j, (ElemType) m_noiseSampler.logprob(wrd));
                 for (size_t noiseid = 0; noiseid < this->noise_sample_size; noiseid++)
                 {
-                    int wid = m_noiseSampler.sample();
+                    int wid = this->NoiseSample(j, noiseid);
                     labels->SetValue(2 * (noiseid + 1), j, (ElemType) wid);
                     labels->SetValue(2 * (noiseid + 1) + 1, j, -(ElemType) m_noiseSampler.logprob(wid));
                 }
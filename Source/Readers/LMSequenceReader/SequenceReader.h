@@ -12,10 +12,12 @@
 #include "Config.h"
 #include "SequenceParser.h"
 #include "RandomOrdering.h"
+#include "NoiseSampler.h"
 #include <string>
 #include <map>
 #include <vector>
 #include <random>
+#include <algorithm>
 
 namespace Microsoft { namespace MSR { namespace CNTK {
 
@@ -44,71 +46,6 @@ enum ReaderMode
     None = 4, // some other type of label
 };
 
-template <typename Count>
-class noiseSampler
-{
-    std::vector<double> m_prob, m_log_prob;
-    std::uniform_int_distribution<Count> unif_int;
-    bool uniform_sampling;
-    double uniform_prob;
-    double uniform_log_prob;
-    std::piecewise_constant_distribution<double> d;
-    std::mt19937 rng;
-
-public:
-    noiseSampler()
-    {
-    }
-    noiseSampler(const std::vector<double>& counts, bool xuniform_sampling = false)
-        : uniform_sampling(xuniform_sampling), rng(1234)
-    {
-        size_t k = counts.size();
-        uniform_prob = 1.0 / k;
-        uniform_log_prob = std::log(uniform_prob);
-        std::vector<double> vn(counts.size() + 1);
-        for (int i = 0; i < vn.size(); i++)
-            vn[i] = i;
-        d = std::piecewise_constant_distribution<double>(vn.begin(), vn.end(), counts.begin());
-        unif_int = std::uniform_int_distribution<Count>(0, (long) counts.size() - 1);
-        m_prob = d.densities();
-        m_log_prob.resize(m_prob.size());
-        for (int i = 0; i < k; i++)
-            m_log_prob[i] = std::log(m_prob[i]);
-    }
-    int size() const
-    {
-        return m_prob.size();
-    }
-    double prob(int i) const
-    {
-        if (uniform_sampling)
-            return uniform_prob;
-        else
-            return m_prob[i];
-    }
-    double logprob(int i) const
-    {
-        if (uniform_sampling)
-            return uniform_log_prob;
-        else
-            return m_log_prob[i];
-    }
-
-    template <typename Engine>
-    int sample(Engine& eng)
-    {
-        int m = unif_int(eng);
-        if (uniform_sampling)
-            return m;
-        return (int) d(eng);
-    }
-
-    int sample()
-    {
-        return sample(this->rng);
-    }
-};
-
 template <class ElemType>
 class SequenceReader : public IDataReader<ElemType>
 {
@@ -136,7 +73,9 @@ public:
     map<int, vector<int>> class_words;
 
     int noise_sample_size;
+    bool noise_shared;               // draw one set of noise words per minibatch instead of one per word
     noiseSampler<long> m_noiseSampler;
+    std::vector<int> m_noiseSamples; // noise words of the current minibatch
 
     ReaderMode readerMode;
     int eos_idx, unk_idx;
@@ -192,6 +131,24 @@ protected:
 
     bool m_endReached;
     int m_traceLevel;
+    bool m_sparseInput; // emit the one-hot word input as a sparse CSC matrix
+
+    // CSC arrays of the one-hot word input, reused across minibatches
+    std::vector<CPUSPARSE_INDEX_TYPE> m_oneHotColStarts;
+    std::vector<CPUSPARSE_INDEX_TYPE> m_oneHotRows;
+    std::vector<ElemType> m_oneHotValues;
+    void SetOneHotFeatures(Matrix<ElemType>& features, size_t dim, const ElemType* wordIds, size_t numCols);
+
+    // draw the NCE noise words of a minibatch at once; NoiseSample(j, k) is the k-th noise word of column j
+    void SampleNoise(size_t numCols)
+    {
+        m_noiseSamples.resize(noise_shared ? noise_sample_size : noise_sample_size * numCols);
+        m_noiseSampler.sample(m_noiseSamples.data(), m_noiseSamples.size());
+    }
+    int NoiseSample(size_t j, size_t k) const
+    {
+        return m_noiseSamples[noise_shared ? k : j * noise_sample_size + k];
+    }
 
     // feature and label data are parallel arrays
     std::vector<ElemType> m_featureData;
@@ -274,6 +231,9 @@ public:
         m_cachingReader = NULL;
         m_cachingWriter = NULL;
         m_labelsIdBuffer = NULL;
+        m_sparseInput = false;
+        noise_sample_size = 0;
+        noise_shared = false;
         readerMode = ReaderMode::Class;
         /*
         delete m_featuresBufferRow;
@@ -334,6 +294,8 @@ public:
     using SequenceReader<ElemType>::m_readNextSampleLine;
     using SequenceReader<ElemType>::m_readNextSample;
     using SequenceReader<ElemType>::m_traceLevel;
+    using SequenceReader<ElemType>::m_sparseInput;
+    using SequenceReader<ElemType>::SetOneHotFeatures;
     using SequenceReader<ElemType>::m_featureCount;
     using SequenceReader<ElemType>::m_endReached;
     //  using IDataReader<ElemType>::labelIn;
@@ -366,6 +328,8 @@ public:
     using SequenceReader<ElemType>::idx4class;
     using SequenceReader<ElemType>::m_indexer;
     using SequenceReader<ElemType>::m_noiseSampler;
+    using SequenceReader<ElemType>::m_noiseSamples;
+    using SequenceReader<ElemType>::noise_shared;
     using SequenceReader<ElemType>::readerMode;
     using SequenceReader<ElemType>::GetIdFromLabel;
     using SequenceReader<ElemType>::GetInputToClass;
@@ -409,6 +409,7 @@ void BatchLUSequenceReader<ElemType>::InitFromConfig(const ConfigRecordType& rea
     m_readNextSample = 0;
 
     m_wordContext = readerConfig(L"wordContext", ConfigRecordType::Array(intargvector(vector<int>{0})));
+    m_sparseInput = readerConfig(L"sparseInput", false);
 
     // The input data is a combination of the label Data and extra feature dims together
     //    m_featureCount = m_featureDim + m_labelInfo[labelInfoIn].dim;
@@ -844,14 +845,23 @@ bool BatchLUSequenceReader<ElemType>::GetMinibatch(std::map<std::wstring, Matrix
         Matrix<ElemType>& features = *matrices[m_featuresName];
 
         // loop through all the samples and create a one-hot representation, or multi-hot in some conditions (TODO: which condition)
+        // With sparse input, the CSC arrays are built directly instead of filling a dense matrix of zeros.
+        if (m_sparseInput && features.GetMatrixType() == DENSE)
+            features.SwitchToMatrixType(SPARSE, matrixFormatSparseCSC, false);
+        bool sparse = features.GetMatrixType() == SPARSE;
+
         Matrix<ElemType> locObs(CPUDEVICE);
-        if (features.GetMatrixType() == DENSE)
+        if (!sparse)
+        {
             locObs.SwitchToMatrixType(DENSE, features.GetFormat(), false);
+            locObs.Resize(featInfo.dim * m_wordContext.size(), actualmbsize);
+            locObs.SetValue(0);
+        }
         else
-            locObs.SwitchToMatrixType(SPARSE, matrixFormatSparseCSC, false);
-
-        locObs.Resize(featInfo.dim * m_wordContext.size(), actualmbsize);
-        locObs.SetValue(0);
+        {
+            m_oneHotColStarts.assign(1, 0);
+            m_oneHotRows.clear();
+        }
 
         assert(m_featureWordContext.size() == actualmbsize);
         for (size_t j = 0; j < actualmbsize; ++j) // loop over matrix columns
@@ -862,6 +872,7 @@ bool BatchLUSequenceReader<ElemType>::GetMinibatch(std::map<std::wstring, Matrix
             // vector of feature data goes into matrix column
             // Each column is a (featInfo.dim x m_wordContext.size()) tensor, i.e. one sub-column per word in the context.
             assert(m_wordContext.size() == m_featureWordContext[j].size());
+            size_t firstNz = m_oneHotRows.size();
             for (size_t jj = 0; jj < m_featureWordContext[j].size(); jj++) // number of n-tuples (samples) to return
             {
                 // this support context dependent inputs since words or vector of words are placed in different slots
@@ -883,14 +894,32 @@ bool BatchLUSequenceReader<ElemType>::GetMinibatch(std::map<std::wstring, Matrix
                     // if (m_pMBLayout->IsGap(s, t))    // verify that these are marked as NoInput
                     //    LogicError("BatchLUSequenceReader::GetMinibatch: Inconsistent NoInput flag");
 
-                    locObs.SetValue(idx + jj * featInfo.dim, j, (ElemType) 1);
+                    if (sparse)
+                        m_oneHotRows.push_back((CPUSPARSE_INDEX_TYPE)(idx + jj * featInfo.dim));
+                    else
+                        locObs.SetValue(idx + jj * featInfo.dim, j, (ElemType) 1);
                 }
             }
+            if (sparse) // CSC wants the rows of a column sorted; a word repeated within a slot is still a 1
+            {
+                sort(m_oneHotRows.begin() + firstNz, m_oneHotRows.end());
+                m_oneHotRows.erase(unique(m_oneHotRows.begin() + firstNz, m_oneHotRows.end()), m_oneHotRows.end());
+                m_oneHotColStarts.push_back((CPUSPARSE_INDEX_TYPE) m_oneHotRows.size());
+            }
         }
 
-        locObs.SetPreferredDeviceId(features.GetDeviceId()); // needed, otherwise SetValue() below will inherit CPUDEVICE a as target
-        // Note: This is not efficient, as it first moves locObs to GPU, and then copies it. What is the correct way of doing this?
-        features.SetValue(locObs);
+        if (sparse)
+        {
+            m_oneHotValues.assign(m_oneHotRows.size(), (ElemType) 1);
+            features.SetMatrixFromCSCFormat(m_oneHotColStarts.data(), m_oneHotRows.data(), m_oneHotValues.data(), m_oneHotRows.size(),
+                                            featInfo.dim * m_wordContext.size(), actualmbsize);
+        }
+        else
+        {
+            locObs.SetPreferredDeviceId(features.GetDeviceId()); // needed, otherwise SetValue() below will inherit CPUDEVICE a as target
+            // Note: This is not efficient, as it first moves locObs to GPU, and then copies it. What is the correct way of doing this?
+            features.SetValue(locObs);
+        }
 
         // fill in the label matrix
         GetLabelOutput(matrices, m_labelInfo[labelInfoOut], actualmbsize);
@@ -269,6 +269,12 @@ private:
     bool mSentenceEnd;
     bool mSentenceBegin;
 
+    bool m_sparseInput; // emit the (multi-)hot word input as a sparse CSC matrix
+    // CSC arrays of the word input, reused across minibatches
+    std::vector<CPUSPARSE_INDEX_TYPE> m_oneHotColStarts;
+    std::vector<CPUSPARSE_INDEX_TYPE> m_oneHotRows;
+    std::vector<ElemType> m_oneHotValues;
+
 public:
     vector<bool> mProcessed;
     BatchLUSequenceParser<ElemType, LabelType> m_parser;
@@ -282,6 +288,7 @@ public:
         mSentenceEnd = false;
         mSentenceBegin = true;
         mIgnoreSentenceBeginTag = false;
+        m_sparseInput = false;
     }
 
     ~BatchLUSequenceReader();
@@ -277,6 +277,9 @@ void UCIFastReader<ElemType>::InitFromConfig(const ConfigRecordType& readerConfi
     // See if the user wants caching
     m_cachingReader = NULL;
     m_cachingWriter = NULL;
+    // defaults that are also used when reading from the cache
+    m_prefetchEnabled = false;
+    mOneLinePerFile = false;
 
     // initialize the cache
     InitCache(readerConfig);
@@ -319,6 +322,8 @@ void UCIFastReader<ElemType>::InitFromConfig(const ConfigRecordType& readerConfi
     m_readNextSample = 0;
     m_traceLevel = readerConfig(L"traceLevel", 0);
     m_parser.SetTraceLevel(m_traceLevel);
+    // threads that parse chunks of the file concurrently (1: parse serially, 0: one per core)
+    m_parser.SetParseThreads(readerConfig(L"parseThreads", (size_t) 1));
 
     m_prefetchEnabled = readerConfig(L"prefetch", false);
     // set the feature count to at least one (we better have one feature...)
@@ -10,6 +10,7 @@
 #include "UCIParser.h"
 #include <stdexcept>
 #include <stdint.h>
+#include <thread>
 
 #if WIN32
 #define ftell64 _ftelli64
@@ -17,6 +18,40 @@
 #define ftell64 ftell
 #endif
 
+// LeadingDigits - scan eight characters (read as a little endian word) for a run of decimal digits
+// chars - the characters, the first one in the lowest byte
+// value - returns the value of the leading digits
+// returns - number of leading digits (0..8)
+static inline size_t LeadingDigits(uint64_t chars, uint64_t &value)
+{
+    // digits become bytes 0..9; the high bit of (byte + 0x76) or of the byte itself is then set for all other characters
+    // (a carry out of a byte only happens for a non-digit, so the first non-digit is always found correctly)
+    uint64_t digits = chars ^ 0x3030303030303030ull;
+    uint64_t nonDigits = ((digits + 0x7676767676767676ull) | digits) & 0x8080808080808080ull;
+    size_t numDigits = 8;
+    if (nonDigits != 0)
+    {
+#ifdef _WIN32
+        unsigned long bit;
+        _BitScanForward64(&bit, nonDigits);
+#else
+        unsigned long bit = __builtin_ctzll(nonDigits);
+#endif
+        numDigits = bit / 8;
+        if (numDigits == 0)
+            return 0;
+        digits <<= 64 - 8 * numDigits; // drop the rest, shifting in leading zeros
+    }
+
+    // combine pairs of digits, then pairs of pairs, then the two halves
+    digits = (digits * 10 + (digits >> 8)) & 0x00FF00FF00FF00FFull;
+    digits = (digits * 100 + (digits >> 16)) & 0x0000FFFF0000FFFFull;
+    value = (digits * 10000 + (digits >> 32)) & 0xFFFFFFFFull;
+    return numDigits;
+}
+
+static const double s_powersOfTen[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8};
+
 // SetState for a particular value
 template <typename NumType, typename LabelType>
 void UCIParser<NumType, LabelType>::SetState(int value, ParseState m_current_state, ParseState next_state)
@@ -158,7 +193,8 @@ void UCIParser<NumType, LabelType>::SetupStateTables()
     // whitespace
     SetState(' ', EndOfLine, Whitespace);
     SetState('\t', EndOfLine, Whitespace);
-    SetState('\r', EndOfLine, Whitespace);
+    // a carriage return right after the end of a line is part of an empty line, which is skipped
+    SetState('\r', EndOfLine, EndOfLine);
 
     // =========================
     // STATE = LABEL
@@ -175,6 +211,7 @@ void UCIParser<NumType, LabelType>::SetupStateTables()
     // =========================
     SetStateRange(0, 255, LineCountEOL, LineCountOther);
     SetState('\n', LineCountEOL, LineCountEOL);
+    SetState('\r', LineCountEOL, LineCountEOL);
 
     // =========================
     // STATE = LINE_COUNT_OTHER
@@ -235,6 +272,8 @@ void UCIParser<NumType, LabelType>::Init()
     PrepareStartPosition(0);
     m_fileBuffer = NULL;
     m_pFile = NULL;
+    m_parseMode = ParseNormal;
+    m_traceLevel = 0;
     m_stateTable = new DWORD[AllStateMax * 256];
     SetupStateTables();
 }
@@ -243,8 +282,8 @@ void UCIParser<NumType, LabelType>::Init()
 template <typename NumType, typename LabelType>
 UCIParser<NumType, LabelType>::~UCIParser()
 {
-    delete m_stateTable;
-    delete m_fileBuffer;
+    delete[] m_stateTable;
+    delete[] m_fileBuffer;
     if (m_pFile)
         fclose(m_pFile);
 }
@@ -361,7 +400,12 @@ void UCIParser<NumType, LabelType>::ParseInit(LPCWSTR fileName, size_t startFeat
 
     // if we have a file already open, cleanup
     if (m_pFile != NULL)
-        UCIParser<NumType, LabelType>::~UCIParser();
+    {
+        fclose(m_pFile);
+        m_pFile = NULL;
+    }
+    delete[] m_fileBuffer;
+    m_fileBuffer = NULL;
 
     errno_t err = _wfopen_s(&m_pFile, fileName, L"rb");
     if (err)
@@ -479,6 +523,208 @@ void UCIParser<NumType, LabelType>::SetTraceLevel(int traceLevel)
     m_traceLevel = traceLevel;
 }
 
+// SetParseThreads - Set the number of threads that parse chunks of the file concurrently
+// numThreads - 1 parses serially, 0 uses one thread per core
+template <typename NumType, typename LabelType>
+void UCIParser<NumType, LabelType>::SetParseThreads(size_t numThreads)
+{
+    if (numThreads == 0)
+        numThreads = std::thread::hardware_concurrency();
+
+    m_threadPool.reset();
+    m_parseChunks.clear();
+    if (numThreads <= 1)
+        return;
+
+    // one chunk per thread
+    m_parseChunks.resize(numThreads);
+    for (auto &chunk : m_parseChunks)
+        chunk.parser.reset(new UCIParser<NumType, LabelType>());
+    m_threadPool.reset(new Microsoft::MSR::CNTK::ThreadPool(numThreads));
+}
+
+// AtStartOfNumber - true if no number is being accumulated
+// (a malformed number at the end of a line, e.g. "1." or "-", leaves state behind that carries over into the next line)
+template <typename NumType, typename LabelType>
+bool UCIParser<NumType, LabelType>::AtStartOfNumber() const
+{
+    return m_partialResult == 0 && m_builtUpNumber == 0 && m_divider == 0 && m_wholeNumberMultiplier == 1 && m_exponentMultiplier == 1;
+}
+
+// CopyStateFrom - continue parsing in the state machine state of another parser
+template <typename NumType, typename LabelType>
+void UCIParser<NumType, LabelType>::CopyStateFrom(const UCIParser<NumType, LabelType> &other)
+{
+    m_current_state = other.m_current_state;
+    m_byteCounter = other.m_byteCounter;
+
+    m_partialResult = other.m_partialResult;
+    m_builtUpNumber = other.m_builtUpNumber;
+    m_divider = other.m_divider;
+    m_wholeNumberMultiplier = other.m_wholeNumberMultiplier;
+    m_exponentMultiplier = other.m_exponentMultiplier;
+
+    m_spaceDelimitedStart = other.m_spaceDelimitedStart;
+    m_spaceDelimitedMax = other.m_spaceDelimitedMax;
+    m_numbersConvertedThisLine = other.m_numbersConvertedThisLine;
+    m_labelsConvertedThisLine = other.m_labelsConvertedThisLine;
+    m_elementsConvertedThisLine = other.m_elementsConvertedThisLine;
+    m_lastLabelIsString = other.m_lastLabelIsString;
+}
+
+// StartChunk - prepare a chunk parser to parse [start, end) of a window buffer
+// parent - the parser whose chunk this is
+// state - parser whose state to continue from, NULL to start at a record boundary
+// window - buffer holding the window, owned by the parent
+// windowStart - file position of the window
+template <typename NumType, typename LabelType>
+void UCIParser<NumType, LabelType>::StartChunk(const UCIParser<NumType, LabelType> &parent, const UCIParser<NumType, LabelType> *state, BYTE *window, int64_t windowStart, int64_t start, int64_t end)
+{
+    m_startLabels = parent.m_startLabels;
+    m_dimLabels = parent.m_dimLabels;
+    m_startFeatures = parent.m_startFeatures;
+    m_dimFeatures = parent.m_dimFeatures;
+    m_parseMode = ParseNormal;
+
+    // the chunk is the end of the "file", so Parse() never needs to update the buffer
+    m_fileBuffer = window;
+    m_bufferStart = windowStart;
+    m_bufferSize = end - windowStart;
+    m_fileSize = end;
+
+    if (state != NULL)
+    {
+        CopyStateFrom(*state);
+        assert(m_byteCounter == start);
+    }
+    else
+    {
+        // a record boundary is right after a newline
+        m_current_state = EndOfLine;
+        m_byteCounter = start;
+        PrepareStartNumber();
+        PrepareStartLine();
+    }
+    m_totalNumbersConverted = 0;
+    m_totalLabelsConverted = 0;
+}
+
+// ParseChunks - parse whole records in parallel, starting at the current position (which must be at a record boundary)
+// recordsRequested - number of records requested
+// numbers - pointer to vector to return the numbers
+// labels - pointer to vector to return the labels
+// returns - number of records read, stops early at the end of the file or at a line that does not fit into a window
+template <typename NumType, typename LabelType>
+long UCIParser<NumType, LabelType>::ParseChunks(size_t recordsRequested, std::vector<NumType> *numbers, std::vector<LabelType> *labels)
+{
+    assert(m_parseMode == ParseNormal && (m_current_state == Whitespace || m_current_state == EndOfLine));
+
+    // chunks are at least a buffer in size, and a window is a few buffers per chunk
+    const size_t minChunkSize = m_bufferSize;
+    const size_t windowSize = m_parseChunks.size() * 4 * m_bufferSize;
+    if (m_windowBuffer.size() < windowSize)
+        m_windowBuffer.resize(windowSize);
+    BYTE *windowBuffer = m_windowBuffer.data();
+    const char *window = (const char *) windowBuffer;
+
+    long recordCount = 0;
+    while (m_byteCounter < m_fileSize && (size_t) recordCount < recordsRequested)
+    {
+        // read the next window
+        int64_t windowStart = m_byteCounter;
+        size_t bytesRead = (size_t) min((int64_t) windowSize, m_fileSize - windowStart);
+        if (_fseeki64(m_pFile, windowStart, SEEK_SET))
+            RuntimeError("UCIParser::ParseChunks - error seeking in file");
+        if (fread(windowBuffer, 1, bytesRead, m_pFile) != bytesRead)
+            RuntimeError("UCIParser::ParseChunks - error reading file");
+
+        // find the end of the records to parse: a record ends at a newline that does not follow a newline
+        // (the state machine only counts a record when it enters EndOfLine, empty lines, incl. CR LF ones, are skipped)
+        size_t windowEnd = 0; // one past the last newline
+        size_t windowRecords = 0;
+        for (const char *p = window; (size_t) recordCount + windowRecords < recordsRequested; p++)
+        {
+            p = (const char *) memchr(p, '\n', bytesRead - (p - window));
+            if (p == NULL)
+                break;
+            const char *lineEnd = p;
+            while (lineEnd > window && lineEnd[-1] == '\r')
+                lineEnd--;
+            if (lineEnd > window ? lineEnd[-1] != '\n' : m_current_state != EndOfLine)
+                windowRecords++;
+            windowEnd = p + 1 - window;
+        }
+
+        // a line that does not fit into the window is left to the serial parser
+        if (windowEnd == 0)
+            break;
+
+        // split the window at record boundaries into chunks of about equal size
+        size_t numChunks = min(m_parseChunks.size(), std::max(windowEnd / minChunkSize, (size_t) 1));
+        std::vector<size_t> chunkStart(1, 0);
+        for (size_t k = 1; k < numChunks; k++)
+        {
+            size_t target = std::max(windowEnd * k / numChunks, chunkStart.back());
+            size_t boundary = (const char *) memchr(window + target, '\n', windowEnd - target) + 1 - window;
+            if (boundary < windowEnd)
+                chunkStart.push_back(boundary);
+        }
+        numChunks = chunkStart.size();
+        chunkStart.push_back(windowEnd);
+
+        // parse the chunks concurrently, the first one continues from our state, the others start at a record boundary
+        m_threadPool->ParallelFor(0, numChunks, [&](size_t k)
+                                  {
+                                      ParseChunk &chunk = m_parseChunks[k];
+                                      chunk.numbers.clear();
+                                      chunk.labels.clear();
+                                      chunk.parser->StartChunk(*this, k == 0 ? this : NULL, windowBuffer, windowStart, windowStart + chunkStart[k], windowStart + chunkStart[k + 1]);
+                                      chunk.records = chunk.parser->Parse(size_t(-1), numbers ? &chunk.numbers : NULL, labels ? &chunk.labels : NULL);
+                                  });
+
+        // append the results in order
+        long windowStartRecord = recordCount;
+        for (size_t k = 0; k < numChunks; k++)
+        {
+            ParseChunk &chunk = m_parseChunks[k];
+
+            // the serial parser would have started this chunk with the number state the previous one ended with, parse it again from there
+            if (k > 0 && !m_parseChunks[k - 1].parser->AtStartOfNumber())
+            {
+                chunk.numbers.clear();
+                chunk.labels.clear();
+                chunk.parser->StartChunk(*this, m_parseChunks[k - 1].parser.get(), windowBuffer, windowStart, windowStart + chunkStart[k], windowStart + chunkStart[k + 1]);
+                chunk.records = chunk.parser->Parse(size_t(-1), numbers ? &chunk.numbers : NULL, labels ? &chunk.labels : NULL);
+            }
+
+            if (numbers != NULL)
+                numbers->insert(numbers->end(), chunk.numbers.begin(), chunk.numbers.end());
+            if (labels != NULL)
+                labels->insert(labels->end(), std::make_move_iterator(chunk.labels.begin()), std::make_move_iterator(chunk.labels.end()));
+            recordCount += chunk.records;
+            m_totalNumbersConverted += chunk.parser->m_totalNumbersConverted;
+        }
+        assert((size_t)(recordCount - windowStartRecord) == windowRecords);
+        UNUSED(windowStartRecord);
+
+        // continue from where the last chunk ended
+        CopyStateFrom(*m_parseChunks[numChunks - 1].parser);
+        for (size_t k = 0; k < numChunks; k++)
+            m_parseChunks[k].parser->m_fileBuffer = NULL; // owned by the window buffer
+    }
+
+    // the serial parser continues from here, with a fresh buffer
+    if (recordCount > 0)
+    {
+        if (_fseeki64(m_pFile, m_byteCounter, SEEK_SET))
+            RuntimeError("UCIParser::ParseChunks - error seeking in file");
+        m_bufferStart = m_byteCounter;
+        m_spaceDelimitedStart = m_spaceDelimitedMax = m_byteCounter; // nothing to keep from the last buffer
+        UpdateBuffer();
+    }
+    return recordCount;
+}
+
 // Parse - Parse the data
 // recordsRequested - number of records requested
 // numbers - pointer to vector to return the numbers (must be allocated)
@@ -496,6 +742,11 @@ long UCIParser<NumType, LabelType>::Parse(size_t recordsRequested, std::vector<N
 
     long TickStart = GetTickCount();
     long recordCount = 0;
+
+    // parse whole records in parallel, if we are at a record boundary
+    if (!m_parseChunks.empty() && m_parseMode == ParseNormal && (m_current_state == Whitespace || m_current_state == EndOfLine))
+        recordCount = ParseChunks(recordsRequested, numbers, labels);
+
     size_t bufferIndex = m_byteCounter - m_bufferStart;
     while (m_byteCounter < m_fileSize && recordCount < recordsRequested)
     {
@@ -506,6 +757,26 @@ long UCIParser<NumType, LabelType>::Parse(size_t recordsRequested, std::vector<N
             bufferIndex = m_byteCounter - m_bufferStart;
         }
 
+        // within a number, take the rest of a run of digits in one step, as long as the number stays exactly representable
+        // (all intermediate values are integers below 2^53, so the result is the same as digit by digit)
+        if (m_current_state <= Exponent && bufferIndex + 8 <= m_bufferSize && m_byteCounter + 8 <= m_fileSize &&
+            m_builtUpNumber < 1e7 && m_divider <= 1e14)
+        {
+            uint64_t chars, value;
+            memcpy(&chars, &m_fileBuffer[bufferIndex], sizeof(chars));
+            size_t numDigits = LeadingDigits(chars, value);
+            if (numDigits > 0)
+            {
+                m_builtUpNumber = m_builtUpNumber * s_powersOfTen[numDigits] + value;
+                if (m_current_state == Remainder)
+                    m_divider *= s_powersOfTen[numDigits];
+                m_byteCounter += numDigits;
+                bufferIndex += numDigits;
+                if (bufferIndex >= m_bufferSize || m_byteCounter >= m_fileSize)
+                    continue;
+            }
+        }
+
         char ch = m_fileBuffer[bufferIndex];
 
         ParseState nextState = (ParseState) m_stateTable[(m_current_state << 8) + ch];
@@ -530,6 +801,11 @@ long UCIParser<NumType, LabelType>::Parse(size_t recordsRequested, std::vector<N
                 switch (m_current_state)
                 {
                 case TheLetterE:
+                    if (nextState == Whitespace || nextState == EndOfLine)
+                    {
+                        PrepareStartNumber();
+                        break;
+                    }
                     if (m_divider != 0) // decimal number
                         m_partialResult += m_builtUpNumber / m_divider;
                     else // integer
@@ -556,6 +832,17 @@ long UCIParser<NumType, LabelType>::Parse(size_t recordsRequested, std::vector<N
                 case Exponent:
                     DoneWithValue();
                     break;
+                case Period:
+                    // a number with a trailing period, e.g. "5."
+                    if (nextState == Whitespace || nextState == EndOfLine)
+                        DoneWithValue();
+                    break;
+                case Sign:
+                case ExponentSign:
+                    // a sign or an exponent without digits is skipped, it must not carry over into the next number
+                    if (nextState == Whitespace || nextState == EndOfLine)
+                        PrepareStartNumber();
+                    break;
                 }
             }
 
@@ -6,8 +6,10 @@
 //
 
 #include "stdafx.h"
+#include "ThreadPool.h"
 #include <string>
 #include <vector>
+#include <memory>
 #include <assert.h>
 #include <stdint.h>
 #include <algorithm>
@@ -109,6 +111,19 @@ private:
     std::vector<LabelType> *m_labels; // pointer to vector to append with labels (may be numeric)
     // FUTURE: do we want a vector to collect string labels in the non string label case? (signifies an error)
 
+    // parallel parsing: the file is read in windows of whole records, which are split at record boundaries
+    // into chunks that are parsed concurrently, each by its own chunk parser into its own vectors
+    struct ParseChunk
+    {
+        std::unique_ptr<UCIParser> parser;
+        std::vector<NumType> numbers;
+        std::vector<LabelType> labels;
+        long records;
+    };
+    std::vector<ParseChunk> m_parseChunks;                          // [chunk], empty if parsing serially
+    std::unique_ptr<Microsoft::MSR::CNTK::ThreadPool> m_threadPool; // parses the chunks
+    std::vector<BYTE> m_windowBuffer;                               // the window being parsed
+
     // SetState for a particular value
     void SetState(int value, ParseState m_current_state, ParseState next_state);
 
@@ -132,6 +147,21 @@ private:
     // returns - number of records read
     size_t UpdateBuffer();
 
+    // true if no number is being accumulated, i.e. the state of the number accumulation variables does not depend on the input so far
+    bool AtStartOfNumber() const;
+
+    // CopyStateFrom - continue parsing in the state machine state of another parser
+    void CopyStateFrom(const UCIParser &other);
+
+    // StartChunk - prepare a chunk parser to parse [start, end) of a window buffer
+    // parent - the parser whose chunk this is
+    // state - parser whose state to continue from, NULL to start at a record boundary
+    void StartChunk(const UCIParser &parent, const UCIParser *state, BYTE *window, int64_t windowStart, int64_t start, int64_t end);
+
+    // ParseChunks - parse whole records in parallel, starting at the current position (which must be at a record boundary)
+    // returns - number of records read, stops early at a line that does not fit into a window
+    long ParseChunks(size_t recordsRequested, std::vector<NumType> *numbers, std::vector<LabelType> *labels);
+
 public:
     // UCIParser constructor
     UCIParser();
@@ -164,6 +194,11 @@ public:
     // traceLevel - traceLevel, zero means no output, 1 epoch related output, > 1 all output
     void SetTraceLevel(int traceLevel);
 
+    // SetParseThreads - Set the number of threads that parse chunks of the file concurrently
+    // numThreads - 1 parses serially, 0 uses one thread per core
+    // the results are identical to a serial parse
+    void SetParseThreads(size_t numThreads);
+
     // ParseInit - Initialize a parse of a file
     // fileName - path to the file to open
     // startFeatures - column (zero based) where features start
@@ -21,6 +21,36 @@ public:
     // Returns a boolean indicating if any samples were processed
     virtual bool AggregateGradients(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, int epochNumber) = 0;
 
+    // Layer-wise aggregation, overlapped with backprop: BeginLayerwiseAggregation() is called before backprop,
+    // GradientReady(i) once backprop has completed gradients[i], and EndLayerwiseAggregation() in place of AggregateGradients().
+    // 'gradients' must be in the order in which backprop completes them, since the gradients are reduced in that order on all nodes.
+    virtual bool SupportsLayerwiseAggregation() const
+    {
+        return false;
+    }
+
+    virtual void BeginLayerwiseAggregation(const std::vector<Matrix<ElemType>*>& /*gradients*/, int /*numEvalNode*/, int /*epochNumber*/)
+    {
+        LogicError("BeginLayerwiseAggregation: Layer-wise gradient aggregation is not supported by this aggregator.");
+    }
+
+    // may be called from any thread
+    virtual void GradientReady(size_t /*i*/)
+    {
+        LogicError("GradientReady: Layer-wise gradient aggregation is not supported by this aggregator.");
+    }
+
+    // Returns a boolean indicating if any samples were processed
+    virtual bool EndLayerwiseAggregation(DistGradHeader* /*headerCPU*/)
+    {
+        LogicError("EndLayerwiseAggregation: Layer-wise gradient aggregation is not supported by this aggregator.");
+    }
+
+    // ends a layer-wise aggregation without completing it, e.g. when backprop has thrown; the gradients are undefined afterwards
+    virtual void AbortLayerwiseAggregation()
+    {
+    }
+
     size_t NumProc()
     {
         return m_mpi->NumNodesInUse();
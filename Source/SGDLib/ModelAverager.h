@@ -0,0 +1,290 @@
+#pragma once
+
+#include "ComputationNode.h"
+#include "MPIWrapper.h"
+#include "TimerUtility.h"
+#include <climits>
+#include <list>
+#include <vector>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// ModelAverager -- model averaging with blockwise model-update filtering
+//
+// Each node trains its local model for a block of samples; then the local models are averaged,
+// weighted by the number of samples each node has processed in the block. The difference between
+// the average and the model that the block started from is the block's update G, which is filtered
+// with block momentum (BMUF, K. Chen and Q. Huo, ICASSP 2016):
+//   delta = blockMomentum * delta + blockLearningRate * G
+//   global model += delta
+// and the nodes continue from the global model (plus blockMomentum * delta with Nesterov momentum).
+// blockMomentum = 0 and blockLearningRate = 1 is plain model averaging; with N nodes,
+// blockMomentum = 1 - 1/N is a good choice, and keeps large sync periods converging.
+//
+// The parameters are packed into one buffer on the host, which is summed up in chunks with non-blocking
+// allreduces. With 'pipelined', Sync() only starts this, and the nodes continue training their local
+// models while the allreduce is in flight; the result is applied at the next Sync(), by moving the local
+// model by the difference between the new global model and the local model at the time the allreduce
+// was started. This delays the model averaging by one block, but hides the communication.
+//
+// Besides the global model, the averager keeps only the host copies that its configuration needs: the block
+// momentum with blockMomentum > 0, the Nesterov look-ahead model with useNesterovMomentum, and the snapshot
+// of the local model with 'pipelined'.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class ModelAverager
+{
+public:
+    ModelAverager(MPIWrapper* mpi, double blockMomentum, double blockLearningRate, bool useNesterovMomentum, bool pipelined, size_t chunkSizeInBytes)
+        : m_mpi(mpi), m_blockMomentum(blockMomentum), m_blockLearningRate(blockLearningRate), m_useNesterovMomentum(useNesterovMomentum), m_pipelined(pipelined),
+          m_chunkSize(chunkSizeInBytes / sizeof(ElemType)), m_numParameters(0), m_syncPending(false), m_allReduceInFlight(false)
+    {
+        if (m_chunkSize == 0 || m_chunkSize > INT_MAX) // (MPI counts are ints)
+            m_chunkSize = INT_MAX;
+        ResetStatistics();
+    }
+
+    // Start of an epoch: make all nodes start from the model of the main node, and reset the block momentum.
+    void Reset(const std::list<ComputationNodeBasePtr>& learnableNodes)
+    {
+        if (m_syncPending)
+            LogicError("ModelAverager: Reset() called while a model averaging is in flight.");
+
+        m_parameters.clear();
+        m_numParameters = 0;
+        for (auto& node : learnableNodes)
+        {
+            if (!node->IsParameterUpdateRequired())
+                continue;
+            Matrix<ElemType>& mat = dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value();
+            m_parameters.push_back(&mat);
+            m_numParameters += mat.GetNumElements();
+        }
+
+        m_globalModel.resize(m_numParameters);
+        m_delta.assign(m_blockMomentum != 0 ? m_numParameters : 0, 0);
+        m_reductionBuffer.resize(m_numParameters + 1); // the parameters weighted by the number of samples, and the number of samples
+
+        Pack(m_globalModel);
+        m_mpi->Bcast(m_globalModel.data(), m_numParameters, m_mpi->MainNodeRank());
+        Unpack(m_globalModel);
+        if (HasLookAhead())
+            m_startModel = m_globalModel;
+        else
+            m_startModel.clear();
+    }
+
+    // End of a block: average the local models of the nodes, which have processed numLocalSamples since the last Sync().
+    // Returns the number of samples (summed over all nodes) whose averaging has been completed by this call:
+    // those of this block, or with 'pipelined', those of the previous one.
+    size_t Sync(size_t numLocalSamples)
+    {
+        Timer timer;
+        timer.Start();
+
+        size_t numSamplesSynced = 0;
+        Pack(m_localModel);
+        if (m_syncPending)
+        {
+            numSamplesSynced += FinishSync();
+            const std::vector<ElemType>& startModel = StartModel();
+            for (size_t i = 0; i < m_numParameters; i++)
+                m_localModel[i] += startModel[i] - m_snapshot[i];
+        }
+        StartSync(numLocalSamples);
+        if (!m_pipelined)
+        {
+            numSamplesSynced += FinishSync();
+            m_localModel = StartModel();
+        }
+        Unpack(m_localModel);
+
+        timer.Stop();
+        m_numSyncs++;
+        m_blockedSeconds += timer.ElapsedSeconds();
+        return numSamplesSynced;
+    }
+
+    // End of the epoch: complete the averaging in flight, if any, and average the samples processed since then.
+    // All nodes end up with the same (global) model. Returns the number of samples averaged.
+    size_t Finish(size_t numLocalSamples)
+    {
+        bool pipelined = m_pipelined;
+        m_pipelined = false;
+        size_t numSamplesSynced = Sync(numLocalSamples);
+        m_pipelined = pipelined;
+
+        // the saved model must not contain the Nesterov look-ahead
+        Unpack(m_globalModel);
+        return numSamplesSynced;
+    }
+
+    // Called after each minibatch, so that MPI makes progress with the allreduces in flight.
+    void Progress()
+    {
+        if (!m_allReduceInFlight)
+            return;
+        int done = 0;
+        MPI_Testall((int) m_requests.size(), m_requests.data(), &done, MPI_STATUSES_IGNORE) || MpiFail("MPI_Testall");
+        if (done)
+            StopCommunicationTimer();
+    }
+
+    // bytes that each node contributes to an allreduce
+    size_t GetSyncSizeInBytes() const
+    {
+        return m_reductionBuffer.size() * sizeof(ElemType);
+    }
+
+    // communication statistics since the last call of ResetStatistics()
+    size_t GetNumSyncs() const
+    {
+        return m_numSyncs;
+    }
+    double GetBlockedSeconds() const // time spent in Sync(), incl. packing and unpacking
+    {
+        return m_blockedSeconds;
+    }
+    double GetOverlappedFraction() const // fraction of the allreduce time that overlapped with training
+    {
+        return m_communicationSeconds > 0 ? 1 - m_waitSeconds / m_communicationSeconds : 0;
+    }
+    void ResetStatistics()
+    {
+        m_numSyncs = 0;
+        m_blockedSeconds = 0;
+        m_communicationSeconds = 0;
+        m_waitSeconds = 0;
+    }
+
+private:
+    // with Nesterov block momentum, the nodes continue from the global model plus the look-ahead
+    bool HasLookAhead() const
+    {
+        return m_blockMomentum != 0 && m_useNesterovMomentum;
+    }
+
+    // the model that the nodes continue from after an averaging
+    std::vector<ElemType>& StartModel()
+    {
+        return HasLookAhead() ? m_startModel : m_globalModel;
+    }
+
+    void Pack(std::vector<ElemType>& buffer) const
+    {
+        buffer.resize(m_numParameters);
+        ElemType* p = buffer.data();
+        for (auto mat : m_parameters)
+        {
+            size_t size = mat->GetNumElements();
+            mat->CopyToArray(p, size);
+            p += size;
+        }
+    }
+
+    void Unpack(std::vector<ElemType>& buffer) const
+    {
+        ElemType* p = buffer.data();
+        for (auto mat : m_parameters)
+        {
+            mat->SetValue(mat->GetNumRows(), mat->GetNumCols(), mat->GetDeviceId(), p);
+            p += mat->GetNumElements();
+        }
+    }
+
+    // start summing up m_localModel, weighted by the number of samples
+    void StartSync(size_t numLocalSamples)
+    {
+        if (m_pipelined) // (the local model moves on while the allreduce is in flight)
+            m_snapshot = m_localModel;
+        ElemType weight = (ElemType) numLocalSamples;
+        for (size_t i = 0; i < m_numParameters; i++)
+            m_reductionBuffer[i] = m_localModel[i] * weight;
+        m_reductionBuffer[m_numParameters] = weight;
+
+        m_requests.clear();
+        for (size_t begin = 0; begin < m_reductionBuffer.size(); begin += m_chunkSize)
+        {
+            size_t size = min(m_chunkSize, m_reductionBuffer.size() - begin);
+            MPI_Request request;
+            MPI_Iallreduce(MPI_IN_PLACE, m_reductionBuffer.data() + begin, (int) size, MPIWrapper::GetDataType(m_reductionBuffer.data()), MPI_SUM, m_mpi->Communicator(), &request) || MpiFail("MPI_Iallreduce");
+            m_requests.push_back(request);
+        }
+        m_syncPending = true;
+        m_allReduceInFlight = true;
+        m_communicationTimer.Start();
+    }
+
+    // wait for the sums, update the global model, and compute the model the nodes start the next block from (StartModel())
+    size_t FinishSync()
+    {
+        if (m_allReduceInFlight)
+        {
+            Timer waitTimer;
+            waitTimer.Start();
+            MPI_Waitall((int) m_requests.size(), m_requests.data(), MPI_STATUSES_IGNORE) || MpiFail("MPI_Waitall");
+            waitTimer.Stop();
+            m_waitSeconds += waitTimer.ElapsedSeconds();
+            StopCommunicationTimer();
+        }
+        m_syncPending = false;
+
+        // without samples, the block's update is 0
+        ElemType numSamples = m_reductionBuffer[m_numParameters];
+        std::vector<ElemType>& startModel = StartModel(); // (m_globalModel itself without look-ahead)
+        bool hasLookAhead = HasLookAhead();
+        for (size_t i = 0; i < m_numParameters; i++)
+        {
+            ElemType update = numSamples > 0 ? m_reductionBuffer[i] / numSamples - startModel[i] : 0;
+            if (m_blockMomentum != 0)
+            {
+                m_delta[i] = (ElemType) m_blockMomentum * m_delta[i] + (ElemType) m_blockLearningRate * update;
+                m_globalModel[i] += m_delta[i];
+                if (hasLookAhead)
+                    m_startModel[i] = m_globalModel[i] + (ElemType) m_blockMomentum * m_delta[i];
+            }
+            else
+                m_globalModel[i] += (ElemType) m_blockLearningRate * update;
+        }
+        return (size_t) (numSamples + 0.5);
+    }
+
+    void StopCommunicationTimer()
+    {
+        m_communicationTimer.Stop();
+        m_allReduceInFlight = false;
+        m_communicationSeconds += m_communicationTimer.ElapsedSeconds();
+    }
+
+private:
+    MPIWrapper* m_mpi;
+    double m_blockMomentum;
+    double m_blockLearningRate;
+    bool m_useNesterovMomentum;
+    bool m_pipelined;
+    size_t m_chunkSize; // elements per allreduce
+
+    std::vector<Matrix<ElemType>*> m_parameters; // in the order in which they are packed
+    size_t m_numParameters;                      // elements of all parameters
+
+    // packed parameters, on the host
+    std::vector<ElemType> m_globalModel;     // same on all nodes
+    std::vector<ElemType> m_delta;           // block momentum; same on all nodes; only with blockMomentum > 0
+    std::vector<ElemType> m_localModel;      // scratch
+    std::vector<ElemType> m_snapshot;        // the local model when the allreduce in flight was started; only if pipelined
+    std::vector<ElemType> m_startModel;      // the global model plus the look-ahead; same on all nodes; only if HasLookAhead()
+    std::vector<ElemType> m_reductionBuffer; // [m_numParameters + 1], see StartSync()
+
+    bool m_syncPending;                  // an averaging has been started, and not applied yet
+    bool m_allReduceInFlight;            // ...and its allreduce has not been seen completing yet
+    std::vector<MPI_Request> m_requests; // [chunk]
+    Timer m_communicationTimer;          // runs from the start of the allreduce until its completion is detected
+
+    size_t m_numSyncs;
+    double m_blockedSeconds;
+    double m_communicationSeconds;
+    double m_waitSeconds;
+};
+} } }
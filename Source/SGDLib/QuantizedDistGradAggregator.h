@@ -0,0 +1,223 @@
+#pragma once
+
+#include "IDistGradAggregator.h"
+#include "MatrixQuantizerImpl.h"
+#include "TimerUtility.h"
+#include <memory>
+#include <climits>
+
+namespace Microsoft { namespace MSR { namespace CNTK {
+
+// -----------------------------------------------------------------------
+// QuantizedDistGradAggregator -- data-parallel gradient aggregation with gradients quantized to 1..16 bits
+//
+// Each gradient matrix is split column-wise into one stripe per node. Every node
+//  - quantizes its whole gradient, adding the quantization error of the previous minibatch (the residual)
+//    and keeping the new error for the next one, so that no gradient information is lost over time,
+//  - sends stripe j to node j, which unquantizes and sums the stripes it receives from all nodes (reduce-scatter),
+//  - quantizes its summed stripe (again with a residual of its own), and sends it to all nodes (allgather),
+//  - and unquantizes the gathered stripes into the gradient.
+// All nodes thus end up with identical gradients, while only nbits per value (plus a range per column) are sent.
+// The quantization is done on the device of the gradients; the quantized data is exchanged from CPU memory.
+// -----------------------------------------------------------------------
+
+template <class ElemType>
+class QuantizedDistGradAggregator : public IDistGradAggregator<ElemType>
+{
+    UsingIDistGradAggregatorMembers;
+
+public:
+    QuantizedDistGradAggregator(MPIWrapper* mpi, int numBits, bool zeroThresholdFor1Bit, int traceLevel, int syncStatsTrace)
+        : IDistGradAggregator<ElemType>(mpi), m_numBits(numBits), m_zeroThresholdFor1Bit(zeroThresholdFor1Bit), m_traceLevel(traceLevel), m_syncStatsTrace(syncStatsTrace), m_iterationCount(0), m_initialized(false)
+    {
+        // the quantized values are packed into 64-bit words
+        if ((numBits < 1) || (numBits >= (int) (8 * sizeof(ElemType))) || ((64 / numBits) * numBits != 64))
+            InvalidArgument("QuantizedDistGradAggregator: gradientBits must be 1, 2, 4, 8 or 16 (or 32 with precision=double), not %d.", numBits);
+    }
+
+    // Aggregate the gradient matrices across all nodes
+    bool AggregateGradients(const std::vector<Matrix<ElemType>*>& gradients, DistGradHeader* headerCPU, int /*epochNumber*/) override
+    {
+        if (!m_initialized)
+            Initialize(gradients, headerCPU->numEvalNode);
+
+        bool showSyncPerfStats = (m_syncStatsTrace > 0) && ((m_iterationCount % m_syncStatsTrace) == 0);
+        m_iterationCount++;
+
+        int deviceId = gradients[0]->GetDeviceId();
+        Timer aggregationTimer;
+        if (showSyncPerfStats)
+        {
+            std::unique_ptr<MatrixComputeStreamEvent> mainStreamSyncEvent(MatrixComputeStreamEvent::Create(deviceId));
+            mainStreamSyncEvent->SynchronizeEvent();
+            aggregationTimer.Start();
+        }
+
+        // If the current node did not process any samples, the gradients should be zero'd.
+        // The residuals are still sent along, so that they are not held back any longer.
+        if (headerCPU->numSamples == 0)
+        {
+            for (size_t i = 0; i < gradients.size(); ++i)
+                gradients[i]->SetValue(0);
+        }
+
+        // The header is summed up as doubles, concurrently with the gradients
+        m_headerBuffer[0] = (double) headerCPU->numSamples;
+        m_headerBuffer[1] = (double) headerCPU->numSamplesWithLabel;
+        m_headerBuffer[2] = headerCPU->criterion;
+        for (int i = 0; i < headerCPU->numEvalNode; ++i)
+            m_headerBuffer[3 + i] = headerCPU->evalErrors[i];
+        MPI_Request headerAllReduceRequest;
+        MPI_Iallreduce(MPI_IN_PLACE, m_headerBuffer.data(), (int) m_headerBuffer.size(), MPIWrapper::GetDataType(m_headerBuffer.data()), MPI_SUM, m_mpi->Communicator(), &headerAllReduceRequest) || MpiFail("MPI_Iallreduce");
+
+        // Quantize all gradients and start sending their stripes, so that the exchange of one overlaps with the quantization of the next
+        size_t numGradMatrices = gradients.size();
+        std::vector<MPI_Request> requests(numGradMatrices, MPI_REQUEST_NULL);
+        for (size_t i = 0; i < numGradMatrices; ++i)
+        {
+            GradientState& state = *m_states[i];
+            m_quantizer->QuantizeAsync(*gradients[i], *state.residual, *state.quantizedGradient, *state.residual, m_zeroThresholdFor1Bit);
+            m_quantizer->WaitQuantizeAsyncDone();
+            MPI_Ialltoallv(state.quantizedGradient->GetArray(), state.stripeSizes.data(), state.stripeOffsets.data(), MPI_CHAR,
+                           state.receivedStripes->GetArray(), state.receivedSizes.data(), state.receivedOffsets.data(), MPI_CHAR,
+                           m_mpi->Communicator(), &requests[i]) || MpiFail("MPI_Ialltoallv");
+        }
+
+        // Sum up our stripe of each gradient, quantize the sum, and start distributing it
+        for (size_t i = 0; i < numGradMatrices; ++i)
+        {
+            GradientState& state = *m_states[i];
+            MPI_Wait(&requests[i], MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
+            if (state.stripeNumCols != 0)
+            {
+                // the sum goes into our stripe of the gradient, which is not needed anymore
+                Matrix<ElemType> stripe = gradients[i]->ColumnSlice(state.stripeFirstCol, state.stripeNumCols);
+                for (size_t node = 0; node < NumProc(); ++node)
+                {
+                    QuantizedMatrix<ElemType> receivedStripe = state.receivedStripes->ColumnSlice(node * state.stripeNumCols, state.stripeNumCols);
+                    m_quantizer->UnquantizeAsync(receivedStripe, stripe, /*add=*/node != 0);
+                }
+
+                QuantizedMatrix<ElemType> quantizedSum = state.quantizedGradient->ColumnSlice(state.stripeFirstCol, state.stripeNumCols);
+                m_quantizer->QuantizeAsync(stripe, *state.stripeResidual, quantizedSum, *state.stripeResidual, m_zeroThresholdFor1Bit);
+                m_quantizer->WaitQuantizeAsyncDone();
+            }
+
+            MPI_Iallgatherv(MPI_IN_PLACE, 0, MPI_CHAR,
+                            state.quantizedGradient->GetArray(), state.stripeSizes.data(), state.stripeOffsets.data(), MPI_CHAR,
+                            m_mpi->Communicator(), &requests[i]) || MpiFail("MPI_Iallgatherv");
+        }
+
+        // Unquantize the aggregated gradients
+        for (size_t i = 0; i < numGradMatrices; ++i)
+        {
+            MPI_Wait(&requests[i], MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
+            m_quantizer->UnquantizeAsync(*m_states[i]->quantizedGradient, *gradients[i], /*add=*/false);
+        }
+        m_quantizer->WaitUnquantizeAsyncDone();
+
+        MPI_Wait(&headerAllReduceRequest, MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
+        headerCPU->numSamples = (size_t) m_headerBuffer[0];
+        headerCPU->numSamplesWithLabel = (size_t) m_headerBuffer[1];
+        headerCPU->criterion = m_headerBuffer[2];
+        for (int i = 0; i < headerCPU->numEvalNode; ++i)
+            headerCPU->evalErrors[i] = m_headerBuffer[3 + i];
+
+        if (showSyncPerfStats)
+        {
+            aggregationTimer.Stop();
+            fprintf(stderr, "Actual gradient aggregation time: %.6g (%d-bit quantized, %.2f MB)\n",
+                    aggregationTimer.ElapsedSeconds(), m_numBits, m_numQuantizedBytes / (1024.0 * 1024.0));
+        }
+
+        return (headerCPU->numSamples != 0);
+    }
+
+private:
+    // the quantized gradient, its stripes, and the residuals of one gradient matrix
+    struct GradientState
+    {
+        std::unique_ptr<Matrix<ElemType>> residual;                 // of the quantization of the whole gradient
+        std::unique_ptr<Matrix<ElemType>> stripeResidual;           // of the quantization of our summed stripe
+        std::unique_ptr<QuantizedMatrix<ElemType>> quantizedGradient; // our quantized gradient, and after the allgather the quantized sums
+        std::unique_ptr<QuantizedMatrix<ElemType>> receivedStripes;   // our stripe, as quantized by each node
+        size_t stripeFirstCol;
+        size_t stripeNumCols;
+        std::vector<int> stripeSizes, stripeOffsets;     // [node] bytes of the node's stripe in quantizedGradient
+        std::vector<int> receivedSizes, receivedOffsets; // [node] bytes of our stripe from the node in receivedStripes
+    };
+
+    void Initialize(const std::vector<Matrix<ElemType>*>& gradients, int numEvalNode)
+    {
+        int deviceId = gradients[0]->GetDeviceId();
+        m_quantizer.reset(MatrixQuantizerImpl<ElemType>::Create(deviceId, /*useAsync=*/false));
+
+        const size_t numNodes = NumProc();
+        const size_t rank = MyRank();
+        m_numQuantizedBytes = 0;
+        for (size_t i = 0; i < gradients.size(); i++)
+        {
+            // Make sure none of the gradient matrixes are sparse - we currently do not support aggregation of sparse gradient matrices
+            if (gradients[i]->GetMatrixType() != DENSE)
+                RuntimeError("Gradient aggregation for sparse gradient matrices is currently unsupported!");
+
+            // The stripes are column ranges of near-equal size; with fewer columns than nodes, some nodes get empty stripes
+            size_t numRows = gradients[i]->GetNumRows();
+            size_t numCols = gradients[i]->GetNumCols();
+            auto stripeBegin = [&](size_t node)
+            {
+                return numCols * node / numNodes;
+            };
+            std::unique_ptr<GradientState> state(new GradientState());
+            state->residual.reset(new Matrix<ElemType>(numRows, numCols, deviceId));
+            state->residual->SetValue(0);
+            state->stripeFirstCol = stripeBegin(rank);
+            state->stripeNumCols = stripeBegin(rank + 1) - stripeBegin(rank);
+            state->stripeResidual.reset(new Matrix<ElemType>(numRows, state->stripeNumCols, deviceId));
+            state->stripeResidual->SetValue(0);
+            state->quantizedGradient.reset(new QuantizedMatrix<ElemType>(numRows, numCols, m_numBits, CPUDEVICE));
+            state->receivedStripes.reset(new QuantizedMatrix<ElemType>(numRows, state->stripeNumCols * numNodes, m_numBits, CPUDEVICE));
+
+            size_t columnSize = QuantizedColumn<ElemType>::QuantizedColumnSize(m_numBits, numRows);
+            if (columnSize * numCols > (size_t) INT_MAX || columnSize * state->stripeNumCols * numNodes > (size_t) INT_MAX)
+                RuntimeError("QuantizedDistGradAggregator: Gradient matrix of %d x %d is too large.", (int) numRows, (int) numCols);
+            for (size_t node = 0; node < numNodes; node++)
+            {
+                state->stripeSizes.push_back((int) (columnSize * (stripeBegin(node + 1) - stripeBegin(node))));
+                state->stripeOffsets.push_back((int) (columnSize * stripeBegin(node)));
+                state->receivedSizes.push_back((int) (columnSize * state->stripeNumCols));
+                state->receivedOffsets.push_back((int) (columnSize * state->stripeNumCols * node));
+            }
+
+            m_numQuantizedBytes += columnSize * numCols;
+            m_states.push_back(std::move(state));
+        }
+
+        m_headerBuffer.resize(3 + numEvalNode); // numSamples, numSamplesWithLabel, criterion, evalErrors[]
+        m_initialized = true;
+
+        if (m_traceLevel > 0)
+            fprintf(stderr, "QuantizedDistGradAggregator: %d gradient matrices, %d-bit quantized to %.2f MB.\n",
+                    (int) gradients.size(), m_numBits, m_numQuantizedBytes / (1024.0 * 1024.0));
+    }
+
+private:
+    std::unique_ptr<MatrixQuantizerImpl<ElemType>> m_quantizer;
+    std::vector<std::unique_ptr<GradientState>> m_states; // [i] for gradients[i]
+    size_t m_numQuantizedBytes;                           // of all quantized gradients
+
+    int m_numBits;
+    bool m_zeroThresholdFor1Bit;
+
+    // header fields, summed with one allreduce
+    std::vector<double> m_headerBuffer;
+
+    int m_traceLevel;
+    int m_syncStatsTrace;
+
+    // Only used for controlling frequency of measuring/showing gradient aggregation perf stats
+    size_t m_iterationCount;
+
+    bool m_initialized;
+};
+} } }
@@ -13,7 +13,9 @@
 #include "AllReduceDistGradAggregator.h"
 #endif
 #include "SimpleDistGradAggregator.h"
+#include "QuantizedDistGradAggregator.h"
 #include "ProgressTracing.h"
+#include "CPUMemAllocator.h"             // for the per-epoch memory statistics
 
 #include <map>
 #include <set>
@@ -171,6 +173,7 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
     additionalNodesToEvaluate.insert(additionalNodesToEvaluate.end(), preComputeNodesList.cbegin(), preComputeNodesList.cend());
 
     // allocate memory for forward and backward computation
+    net->SetTraceLevel(m_traceLevel);
     net->AllocateAllMatrices(evaluationNodes, additionalNodesToEvaluate, criterionNodes[0]);
 
     // get feature and label nodes into an array of matrices that will be passed to GetMinibatch()
@@ -315,6 +318,13 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
                                                   m_seqGammarCalcAMF, m_seqGammarCalcLMF, m_seqGammarCalcWP, m_seqGammarCalcbMMIFactor, m_seqGammarCalcUsesMBR);
     }
 
+    // per-node timing of forward and backprop, see NodeProfiler
+    if (m_nodeProfiling)
+    {
+        m_nodeProfiler = make_shared<NodeProfiler>(m_nodeProfilingTraceFile.empty() ? 0 : m_numMBsToTraceNodes);
+        net->SetNodeProfiler(m_nodeProfiler);
+    }
+
     // --- MAIN EPOCH LOOP
     for (int i = startEpoch; i < (int) m_maxEpochs; i++) // TODO: why is this an int, and not a size_t?
     {
@@ -413,6 +423,9 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
         fprintf(stderr, "Starting Epoch %d: learning rate per sample = %f  effective momentum = %f  momentum as time constant = %.1f samples\n",
                 i + 1, learnRatePerSample, MomentumPerMB(momentumPerSample, actualMinibatchSize), momentumAsTimeConstant);
 
+        if (m_nodeProfiler)
+            m_nodeProfiler->ResetStatistics(); // (also drops the minibatch-size search above)
+
         TrainOneEpoch(net,
                       refNet,
                       refNode,
@@ -479,6 +492,16 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
             }
         }
 
+        if (m_nodeProfiler)
+            m_nodeProfiler->PrintSummary(stderr, msra::strfun::strprintf("Epoch[%2d of %d]", i + 1, (int) m_maxEpochs));
+
+        // per-epoch CPU memory statistics; the peaks are reset so that each epoch reports its own
+        if (CPUMemAllocator::Instance().GetOptions().traceStatistics)
+        {
+            CPUMemAllocator::Instance().PrintStatistics(stderr, msra::strfun::strprintf("Epoch[%2d of %d]", i + 1, (int) m_maxEpochs).c_str());
+            CPUMemAllocator::Instance().ResetStatistics();
+        }
+
         if ((g_mpi == nullptr) || g_mpi->IsMainNode())
         {
             if (validationSetDataReader != trainSetDataReader && validationSetDataReader != nullptr)
@@ -655,6 +678,20 @@ void SGD<ElemType>::TrainOrAdaptModel(int startEpoch, ComputationNetworkPtr net,
     }
     // --- END OF MAIN EPOCH LOOP
 
+    if (m_nodeProfiler)
+    {
+        if (!m_nodeProfilingTraceFile.empty())
+        {
+            // one file per worker
+            wstring traceFile = m_nodeProfilingTraceFile;
+            if (g_mpi != nullptr && g_mpi->NumNodesInUse() > 1)
+                traceFile += msra::strfun::wstrprintf(L".rank%d", (int) g_mpi->CurrentNodeRank());
+            m_nodeProfiler->WriteTrace(traceFile);
+        }
+        net->SetNodeProfiler(nullptr);
+        m_nodeProfiler.reset();
+    }
+
     // Synchronize all ranks before proceeding to ensure that
     // rank 0 has finished writing the model file
     if (g_mpi != nullptr)
@@ -739,6 +776,8 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
     float nSecondsSinceLastMAPerfReport = 0;
 
     std::vector<Matrix<ElemType>*> learnParamsGradients;
+    std::map<ComputationNodeBase*, size_t> learnParamsGradientIndex; // [node] -> index into learnParamsGradients
+    bool useLayerwiseGradientAggregation = useGradientAggregation && m_layerwiseGradientAggregation && m_distGradAgg->SupportsLayerwiseAggregation();
     if (useGradientAggregation)
     {
         epochCriterion = double(0.0);
@@ -793,6 +832,14 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
     if (numSubminibatchesNeeded > 1)
         smbDispatcher.Init(net, learnableNodes, criterionNodes, evaluationNodes);
 
+    // With sub-minibatches, a gradient is only complete once the dispatcher has summed up the shares of all
+    // sub-minibatches and written them back, after the last backprop. So it cannot be sent while backprop runs.
+    if (useLayerwiseGradientAggregation && numSubminibatchesNeeded > 1)
+    {
+        fprintf(stderr, "WARNING: useLayerwiseGradientAggregation is ignored with sub-minibatches (%d per minibatch) in this epoch.\n", (int) numSubminibatchesNeeded);
+        useLayerwiseGradientAggregation = false;
+    }
+
     // The following is a special feature only supported by the Kaldi2Reader for more efficient sequence training.
     // This attemps to compute the error signal for the whole utterance, which will
     // be fed to the neural network as features. Currently it is a workaround
@@ -810,6 +857,24 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         {
             fprintf(stderr, ", BufferedAsyncGradientAggregation is ENABLED");
         }
+        if (useLayerwiseGradientAggregation)
+        {
+            fprintf(stderr, ", LayerwiseGradientAggregation is ENABLED");
+        }
+    }
+    if (useModelAveraging && (g_mpi->NumNodesInUse() > 1))
+    {
+        if (!m_modelAverager)
+            m_modelAverager = make_shared<ModelAverager<ElemType>>(g_mpi, m_blockMomentum, m_blockLearningRate, m_useNesterovBlockMomentum, m_pipelinedModelAveraging, m_modelAveragingChunkSizeInBytes);
+        m_modelAverager->Reset(learnableNodes);
+        m_modelAverager->ResetStatistics();
+
+        fprintf(stderr, ", ModelAveragingSGD training (MyRank = %d, NumNodes = %d, BlockMomentum = %.6g, %.2f MB per sync)",
+                (int) g_mpi->CurrentNodeRank(), (int) g_mpi->NumNodesInUse(), m_blockMomentum, m_modelAverager->GetSyncSizeInBytes() / (1024.0 * 1024.0));
+        if (m_pipelinedModelAveraging)
+        {
+            fprintf(stderr, ", PipelinedModelAveraging is ENABLED");
+        }
     }
     if (useDistributedMBReading)
     {
@@ -829,6 +894,25 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
 
     // --- MAIN MINIBATCH LOOP
 
+    // If forward or backprop throws during layer-wise aggregation, the communication thread must be stopped,
+    // or destroying its future would block forever; and the gradient-ready callback refers to locals of this function.
+    struct LayerwiseAggregationGuard
+    {
+        ComputationNetworkPtr m_net;
+        IDistGradAggregator<ElemType>* m_aggregator; // set while an aggregation is in progress
+        LayerwiseAggregationGuard(const ComputationNetworkPtr& net)
+            : m_net(net), m_aggregator(nullptr)
+        {
+        }
+        ~LayerwiseAggregationGuard()
+        {
+            if (!m_aggregator)
+                return;
+            m_net->SetGradientReadyCallback(nullptr);
+            m_aggregator->AbortLayerwiseAggregation();
+        }
+    } layerwiseAggregationGuard(net);
+
     bool noMoreSamplesToProcess = false;
     for (;;)
     {
@@ -856,6 +940,15 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         ComputationNetwork::BumpEvalTimeStamp(featureNodes);
         ComputationNetwork::BumpEvalTimeStamp(labelNodes);
 
+        // with layer-wise aggregation, the gradients are reduced on a communication thread while backprop continues
+        if (useLayerwiseGradientAggregation)
+        {
+            if (learnParamsGradients.size() == 0)
+                CollectLearnableParameterGradients(net, criterionNodes[0], learnableNodes, useLayerwiseGradientAggregation, learnParamsGradients, learnParamsGradientIndex);
+            m_distGradAgg->BeginLayerwiseAggregation(learnParamsGradients, (int) evaluationNodes.size(), epochNumber);
+            layerwiseAggregationGuard.m_aggregator = m_distGradAgg;
+        }
+
         if (actualMBSize > 0)
         {
             assert(wasDataRead);
@@ -912,7 +1005,19 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
                 // ===========================================================
 
                 if (learnRatePerSample > 0.01 * m_minLearnRate) // only compute gradient when learning rate is large enough
+                {
+                    if (useLayerwiseGradientAggregation)
+                    {
+                        net->SetGradientReadyCallback([&](const ComputationNodeBasePtr& node)
+                                                      {
+                                                          auto iter = learnParamsGradientIndex.find(node.get());
+                                                          if (iter != learnParamsGradientIndex.end())
+                                                              m_distGradAgg->GradientReady(iter->second);
+                                                      });
+                    }
                     net->Backprop(criterionNodes[0]);
+                    net->SetGradientReadyCallback(nullptr);
+                }
 
                 // house-keeping for sub-minibatching
                 if (actualNumSubminibatches > 1)
@@ -949,27 +1054,7 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         {
             // distributed gradient aggregation
             if (learnParamsGradients.size() == 0)
-            {
-                learnParamsGradients.reserve(learnableNodes.size());
-                for (auto nodeIter = learnableNodes.begin(); nodeIter != learnableNodes.end(); nodeIter++)
-                {
-                    ComputationNodePtr node = dynamic_pointer_cast<ComputationNode<ElemType>>(*nodeIter);
-                    if (node->IsParameterUpdateRequired())
-                    {
-                        Matrix<ElemType>* currParamsGradient = &(node->Gradient());
-
-                        // Sometimes, in parallel training, the current node may not get any samples to process
-                        // In this case, the gradient matrix may not have been sized yet. If so, lets size it.
-                        if (currParamsGradient->GetNumCols() == 0)
-                        {
-                            Matrix<ElemType>* currParamsValues = &(node->Value());
-                            currParamsGradient->Resize(currParamsValues->GetNumRows(), currParamsValues->GetNumCols());
-                        }
-
-                        learnParamsGradients.push_back(currParamsGradient);
-                    }
-                }
-            }
+                CollectLearnableParameterGradients(net, criterionNodes[0], learnableNodes, useLayerwiseGradientAggregation, learnParamsGradients, learnParamsGradientIndex);
 
             // prepare the header
             m_gradHeader->numEvalNode = evaluationNodes.size();
@@ -979,7 +1064,9 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
             for (size_t i = 0; i < evaluationNodes.size(); i++)
                 m_gradHeader->evalErrors[i] = actualMBSize > 0 ? evaluationNodes[i]->Get00Element() : 0.0;
 
-            bool samplesProcessed = m_distGradAgg->AggregateGradients(learnParamsGradients, m_gradHeader, epochNumber);
+            bool samplesProcessed = useLayerwiseGradientAggregation ? m_distGradAgg->EndLayerwiseAggregation(m_gradHeader)
+                                                                    : m_distGradAgg->AggregateGradients(learnParamsGradients, m_gradHeader, epochNumber);
+            layerwiseAggregationGuard.m_aggregator = nullptr;
             noMoreSamplesToProcess = !samplesProcessed;
 
             aggregateNumSamples = m_gradHeader->numSamples;
@@ -1034,7 +1121,7 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
                 size_t processedSamples = 0;
                 float secondsSinceLastSyncFinished = 0;
                 float secondsSpentOnSync = 0;
-                if (ModelAveragingProcessing(nSamplesSinceLastModelSync, learnableNodes, processedSamples,
+                if (ModelAveragingProcessing(nSamplesSinceLastModelSync, processedSamples,
                                              secondsSinceLastSyncFinished, secondsSpentOnSync))
                 {
                     // if a sync happens, do some extra work
@@ -1048,10 +1135,12 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
                     {
                         if (nSynced % m_syncStatsTrace == 0)
                         {
-                            fprintf(stderr, "\t\t-----(model averaging stats) %d-th sync, %8.2f seconds since last report, %5.2f seconds on communication\n",
-                                    (int) nSynced, nSecondsSinceLastMAPerfReport, nSecondsOnMASync);
+                            fprintf(stderr, "\t\t-----(model averaging stats) %d-th sync, %8.2f seconds since last report, %5.2f seconds on communication (%.2f MB per sync, %.0f%% of the allreduce overlapped with training)\n",
+                                    (int) nSynced, nSecondsSinceLastMAPerfReport, nSecondsOnMASync,
+                                    m_modelAverager->GetSyncSizeInBytes() / (1024.0 * 1024.0), 100 * m_modelAverager->GetOverlappedFraction());
                             nSecondsOnMASync = 0;
                             nSecondsSinceLastMAPerfReport = 0;
+                            m_modelAverager->ResetStatistics();
                         }
                     }
                 }
@@ -1171,18 +1260,18 @@ size_t SGD<ElemType>::TrainOneEpoch(ComputationNetworkPtr net,
         AttemptUtteranceDerivativeFeatures(net, trainSetDataReader, featureNodes, inputMatrices);
 
         profiler.NextSample();
+        if (m_nodeProfiler)
+            m_nodeProfiler->NextMinibatch();
     }
 
     // --- END MAIN MINIBATCH LOOP
 
     if (useModelAveraging && (g_mpi->NumNodesInUse() > 1))
     {
-        // may not be synced after epoch finished, so do the sync here
-        int residualSampels = (int) nSamplesSinceLastModelSync;
-        g_mpi->AllReduce(&residualSampels, 1);
-        totalSamplesSeen += residualSampels;
-        totalEpochSamples += residualSampels;
-        ModelAveragingSync(nSamplesSinceLastModelSync, learnableNodes);
+        // may not be synced after epoch finished, so do the sync here (which also completes the one in flight, if pipelined)
+        size_t residualSamples = m_modelAverager->Finish(nSamplesSinceLastModelSync);
+        totalSamplesSeen += residualSamples;
+        totalEpochSamples += residualSamples;
         nSynced++;
         nSamplesSinceLastModelSync = 0;
     }
@@ -1826,6 +1915,49 @@ int SGD<ElemType>::SGDTrace(FILE* __restrict __stream, const char* __restrict __
     return result;
 }
 
+// collect the gradients of the learnable parameters that are updated, for aggregation across nodes
+// For layer-wise aggregation, they are ordered as backprop completes them (reverse evaluation order), rather than by node name.
+template <class ElemType>
+void SGD<ElemType>::CollectLearnableParameterGradients(const ComputationNetworkPtr& net, const ComputationNodeBasePtr& criterionNode,
+                                                       const std::list<ComputationNodeBasePtr>& learnableNodes, bool inBackpropOrder,
+                                                       std::vector<Matrix<ElemType>*>& learnParamsGradients,
+                                                       std::map<ComputationNodeBase*, size_t>& learnParamsGradientIndex)
+{
+    std::vector<ComputationNodeBasePtr> nodes(learnableNodes.begin(), learnableNodes.end());
+    if (inBackpropOrder)
+    {
+        std::map<ComputationNodeBase*, size_t> evalIndex;
+        size_t index = 0;
+        for (const auto& node : net->GetEvalOrder(criterionNode))
+            evalIndex[node.get()] = index++;
+        std::stable_sort(nodes.begin(), nodes.end(), [&](const ComputationNodeBasePtr& a, const ComputationNodeBasePtr& b)
+                         {
+                             return evalIndex[a.get()] > evalIndex[b.get()];
+                         });
+    }
+
+    learnParamsGradients.reserve(nodes.size());
+    for (const auto& nodeBase : nodes)
+    {
+        ComputationNodePtr node = dynamic_pointer_cast<ComputationNode<ElemType>>(nodeBase);
+        if (node->IsParameterUpdateRequired())
+        {
+            Matrix<ElemType>* currParamsGradient = &(node->Gradient());
+
+            // Sometimes, in parallel training, the current node may not get any samples to process
+            // In this case, the gradient matrix may not have been sized yet. If so, lets size it.
+            if (currParamsGradient->GetNumCols() == 0)
+            {
+                Matrix<ElemType>* currParamsValues = &(node->Value());
+                currParamsGradient->Resize(currParamsValues->GetNumRows(), currParamsValues->GetNumCols());
+            }
+
+            learnParamsGradientIndex[node.get()] = learnParamsGradients.size();
+            learnParamsGradients.push_back(currParamsGradient);
+        }
+    }
+}
+
 template <class ElemType>
 void SGD<ElemType>::InitDistGradAgg(int numEvalNodes, int traceLevel)
 {
@@ -1838,10 +1970,15 @@ void SGD<ElemType>::InitDistGradAgg(int numEvalNodes, int traceLevel)
 #else
             if (m_numGradientBits != (8 * sizeof(ElemType)))
             {
-                RuntimeError("Gradient quantization is unsupported in CNTK binaries built without quantized gradient aggregation support!");
-            }
+                if (m_bufferedAsyncGradientAggregation)
+                    InvalidArgument("useBufferedAsyncGradientAggregation is unsupported with gradientBits < %d in CNTK binaries built without 1-bit SGD.", (int) (8 * sizeof(ElemType)));
 
-            m_distGradAgg = new SimpleDistGradAggregator<ElemType>(g_mpi, m_bufferedAsyncGradientAggregation, m_syncStatsTrace);
+                m_distGradAgg = new QuantizedDistGradAggregator<ElemType>(g_mpi, m_numGradientBits, m_zeroThresholdFor1Bit, traceLevel, m_syncStatsTrace);
+            }
+            else
+            {
+                m_distGradAgg = new SimpleDistGradAggregator<ElemType>(g_mpi, m_bufferedAsyncGradientAggregation, m_syncStatsTrace, m_allReduceAlgorithm, m_gradientBucketSizeInBytes);
+            }
 #endif // !QUANTIZED_GRADIENT_AGGREGATION
         }
 
@@ -1853,7 +1990,7 @@ void SGD<ElemType>::InitDistGradAgg(int numEvalNodes, int traceLevel)
 }
 
 template <class ElemType>
-bool SGD<ElemType>::ModelAveragingProcessing(size_t nSamplesSinceLastSync, const std::list<ComputationNodeBasePtr>& learnableNodes, size_t& nProcessedFrames,
+bool SGD<ElemType>::ModelAveragingProcessing(size_t nSamplesSinceLastSync, size_t& nProcessedFrames,
                                              float& SecondsSinceLastSyncFinished, float& SecondsSpentOnSync)
 {
     // ////////////////////////////////////////////////////////////////////////
@@ -1871,6 +2008,9 @@ bool SGD<ElemType>::ModelAveragingProcessing(size_t nSamplesSinceLastSync, const
         first = false;
     }
 
+    // let MPI progress with a pipelined sync that is in flight
+    m_modelAverager->Progress();
+
     char bNeedToSync = (char) 0; // use char for bool
     if (g_mpi->IsMainNode() && nSamplesSinceLastSync >= m_nFramesBetweenMASync)
     {
@@ -1884,7 +2024,7 @@ bool SGD<ElemType>::ModelAveragingProcessing(size_t nSamplesSinceLastSync, const
         double elapsedsec = MAtimer.ElapsedSeconds();
         SecondsSinceLastSyncFinished = first ? 0 : (float) elapsedsec;
         MAtimer.Start();
-        nProcessedFrames = ModelAveragingSync((int) nSamplesSinceLastSync, learnableNodes);
+        nProcessedFrames = m_modelAverager->Sync(nSamplesSinceLastSync);
         MAtimer.Stop();
         SecondsSpentOnSync = (float) MAtimer.ElapsedSeconds();
 
@@ -1898,63 +2038,6 @@ bool SGD<ElemType>::ModelAveragingProcessing(size_t nSamplesSinceLastSync, const
     return true;
 }
 
-template <class ElemType>
-size_t SGD<ElemType>::ModelAveragingSync(int nSamplesSinceLastSync, const std::list<ComputationNodeBasePtr>& learnableNodes)
-{
-    if (g_mpi->NumNodesInUse() <= 1)
-    {
-        return nSamplesSinceLastSync;
-    }
-
-    // ========================================
-    // Sec. 1 calculate factor
-    // ========================================
-    float factor = 0;
-    int nTotalSamples = nSamplesSinceLastSync;
-    g_mpi->AllReduce(&nTotalSamples, 1);
-    if (nTotalSamples <= 0)
-    {
-        // prepare for overflow
-        factor = 1.0f / g_mpi->NumNodesInUse();
-    }
-    else
-    {
-        factor = (nSamplesSinceLastSync + 0.0f) / nTotalSamples;
-    }
-
-    // ========================================
-    // Sec. 2 sync models based on factor
-    // Note: this is suboptimal at the moment:
-    //       we do the averaging for each node in a sequence manner, i.e.,
-    //          (node1) GPU->CPU->MPI_AllReduce -> (node2)GPU->CPU->MPI_AllReduce
-    //       we can improve it by using a pipeline
-    //          (node1) GPU ->  CPU  ->  MPI_AllReduce
-    //          (node2)         GPU  ->  CPU            -> MPI_AllReduce
-    //          (node3)                  GPU            -> CPU              -> MPI_AllReduce
-    // ========================================
-    for (auto iter = learnableNodes.begin(); iter != learnableNodes.end(); iter++)
-    {
-        ComputationNodeBasePtr pNode = *iter;
-        if (!pNode->IsParameterUpdateRequired())
-            continue;
-
-        Matrix<ElemType>& mat = dynamic_pointer_cast<ComputationNode<ElemType>>(pNode)->Value();
-        // 1. normalize the weight matrix
-        Matrix<ElemType>::Scale(factor, mat);
-        // 2. send weight matrix over MPI nodes;
-        ElemType* px = mat.CopyToArray();
-        size_t nx = mat.GetNumElements();
-
-        // 3. inplace sum
-        g_mpi->AllReduce(px, nx);
-        mat.SetValue(mat.GetNumRows(), mat.GetNumCols(), mat.GetDeviceId(), px);
-        // 4. clean up
-        delete[] px;
-    }
-
-    return nTotalSamples;
-}
-
 // public:
 // UpdateWeightsS - static version of UpdateWeights()
 // not static since it wants to access protected methods on the SGD object
@@ -2385,6 +2468,18 @@ static ParallelizationMethod ParseParallelizationMethod(const wstring& s)
         InvalidArgument("ParseParallelizationMethod: Invalid Parallelization Method. Valid values are (none | dataParallelSGD | modelAveragingSGD)");
 }
 
+static AllReduceAlgorithm ParseAllReduceAlgorithm(const wstring& s)
+{
+    if (!_wcsicmp(s.c_str(), L"") || !_wcsicmp(s.c_str(), L"mpi"))
+        return AllReduceAlgorithm::MPI;
+    else if (!_wcsicmp(s.c_str(), L"ring"))
+        return AllReduceAlgorithm::Ring;
+    else if (!_wcsicmp(s.c_str(), L"recursiveHalving"))
+        return AllReduceAlgorithm::RecursiveHalving;
+    else
+        InvalidArgument("ParseAllReduceAlgorithm: Invalid allreduce algorithm. Valid values are (mpi | ring | recursiveHalving)");
+}
+
 static LearningRateSearchAlgorithm ParseLearningRateSearchType(const wstring& s)
 {
     // TODO: why allow so many variants?
@@ -2468,6 +2563,9 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     m_traceLevel = configSGD(L"traceLevel", (int) 0);
     m_numMBsToShowResult = configSGD(L"numMBsToShowResult", (size_t) 10);
     m_numMBsToCUDAProfile = configSGD(L"numMBsToCUDAProfile", (size_t) 0);
+    m_nodeProfiling = configSGD(L"nodeProfiling", false);
+    m_nodeProfilingTraceFile = (wstring) configSGD(L"nodeProfilingTraceFile", L"");
+    m_numMBsToTraceNodes = configSGD(L"numMBsToTraceNodes", (size_t) 10);
 
     m_gradientClippingWithTruncation = configSGD(L"gradientClippingWithTruncation", true);
     m_clippingThresholdPerSample = configSGD(L"clippingThresholdPerSample", numeric_limits<double>::infinity());
@@ -2624,9 +2722,17 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
     m_numGradientBits = 32;
     m_zeroThresholdFor1Bit = true;
     m_bufferedAsyncGradientAggregation = false;
+    m_layerwiseGradientAggregation = false;
+    m_allReduceAlgorithm = AllReduceAlgorithm::MPI;
+    m_gradientBucketSizeInBytes = 0;
     m_enableDistributedMBReading = false;
     m_parallelizationStartEpochNum = 0;
     m_nFramesBetweenMASync = 40000; // default 40k frames
+    m_blockMomentum = 0;
+    m_blockLearningRate = 1;
+    m_useNesterovBlockMomentum = true;
+    m_pipelinedModelAveraging = false;
+    m_modelAveragingChunkSizeInBytes = 4096 * 1024;
 
     if ((g_mpi != nullptr) && configSGD.Exists(L"ParallelTrain"))
     {
@@ -2643,6 +2749,11 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
             m_numGradientBits = configDataParallelSGD(L"gradientBits", defaultGradientBits);
             m_zeroThresholdFor1Bit = configDataParallelSGD(L"useZeroThresholdFor1BitQuantization", true);
             m_bufferedAsyncGradientAggregation = configDataParallelSGD(L"useBufferedAsyncGradientAggregation", false);
+            m_layerwiseGradientAggregation = configDataParallelSGD(L"useLayerwiseGradientAggregation", false);
+            if (m_layerwiseGradientAggregation && m_bufferedAsyncGradientAggregation)
+                InvalidArgument("useLayerwiseGradientAggregation and useBufferedAsyncGradientAggregation cannot be combined.");
+            m_allReduceAlgorithm = ParseAllReduceAlgorithm(configDataParallelSGD(L"allReduceAlgorithm", L"mpi"));
+            m_gradientBucketSizeInBytes = configDataParallelSGD(L"gradientBucketSizeInKB", (size_t) 0) * 1024;
             if ((m_numGradientBits < 1) || (m_numGradientBits > (8 * sizeofElemType)))
             {
                 InvalidArgument("gradientBits must be in the range [1, 32] when using precision=float and in range [1, 64] when using precision=double!");
@@ -2653,6 +2764,13 @@ SGDParams::SGDParams(const ConfigRecordType& configSGD, size_t sizeofElemType)
         {
             const ConfigRecordType& configMASGD(configParallelTrain(L"ModelAveragingSGD", ConfigRecordType::Record()));
             m_nFramesBetweenMASync = configMASGD(L"syncFrequencyInFrames", (size_t) 40000);
+            m_blockMomentum = configMASGD(L"blockMomentum", 0.0);
+            m_blockLearningRate = configMASGD(L"blockLearningRate", 1.0);
+            m_useNesterovBlockMomentum = configMASGD(L"useNesterovBlockMomentum", true);
+            m_pipelinedModelAveraging = configMASGD(L"usePipelinedModelAveraging", false);
+            m_modelAveragingChunkSizeInBytes = configMASGD(L"syncChunkSizeInKB", (size_t) 4096) * 1024;
+            if (m_blockMomentum < 0 || m_blockMomentum >= 1)
+                InvalidArgument("blockMomentum must be in the range [0, 1).");
         }
     }
 }
@@ -17,6 +17,7 @@
 #include <chrono>
 #include <random>
 #include "Profiler.h"
+#include "ModelAverager.h"
 
 using namespace std; // ugh! TODO: get rid of this from .h files!!!
 
@@ -212,6 +213,10 @@ protected:
     int m_numMBsToShowResult;
     int m_numMBsToCUDAProfile;
 
+    bool m_nodeProfiling;                     // time forward and backprop of every node and print a summary after each epoch
+    std::wstring m_nodeProfilingTraceFile;    // if given, also write Chrome trace events of the first minibatches to this file
+    size_t m_numMBsToTraceNodes;
+
     bool m_doGradientCheck;
     double m_gradientCheckSigDigit;
 
@@ -233,10 +238,18 @@ protected:
     // Data parallel SGD training parameters
     int m_numGradientBits;
     bool m_bufferedAsyncGradientAggregation;
+    bool m_layerwiseGradientAggregation; // aggregate each gradient as soon as backprop has completed it
     bool m_zeroThresholdFor1Bit;
+    AllReduceAlgorithm m_allReduceAlgorithm; // for SimpleDistGradAggregator
+    size_t m_gradientBucketSizeInBytes;      // gradients are packed into buckets of up to this size for aggregation (0: one per matrix)
 
     // Parallel training related with MA
     size_t m_nFramesBetweenMASync;
+    double m_blockMomentum;                    // block momentum per sync (0: plain model averaging)
+    double m_blockLearningRate;
+    bool m_useNesterovBlockMomentum;
+    bool m_pipelinedModelAveraging;            // overlap each sync with the next block of training
+    size_t m_modelAveragingChunkSizeInBytes;   // the model is summed up in chunks of this size
 
     bool m_needAveMultiplier;
     double m_L2RegWeight;
@@ -423,13 +436,16 @@ protected:
                          /*out*/ size_t& totalSamplesSeen,
                          std::string prefixMsg = "");
 
+    void CollectLearnableParameterGradients(const ComputationNetworkPtr& net, const ComputationNodeBasePtr& criterionNode,
+                                            const std::list<ComputationNodeBasePtr>& learnableNodes, bool inBackpropOrder,
+                                            std::vector<Matrix<ElemType>*>& learnParamsGradients,
+                                            std::map<ComputationNodeBase*, size_t>& learnParamsGradientIndex);
+
     void InitDistGradAgg(int numEvalNodes, int traceLevel);
 
-    bool ModelAveragingProcessing(size_t nSamplesSinceLastSync, const std::list<ComputationNodeBasePtr>& learnableNodes, size_t& nProcessedFrames,
+    bool ModelAveragingProcessing(size_t nSamplesSinceLastSync, size_t& nProcessedFrames,
                                   float& SecondsSinceLastSyncFinished, float& SecondsSpentOnSync);
 
-    size_t ModelAveragingSync(int nSamplesSinceLastSync, const std::list<ComputationNodeBasePtr>& learnableNodes);
-
 public:
     // UpdateWeightsS - static version of UpdateWeights()
     static void UpdateWeightsS(const SGD* sgd, Matrix<ElemType>& functionValues,
@@ -506,6 +522,10 @@ protected:
     IDistGradAggregator<ElemType>* m_distGradAgg;
     struct DistGradHeader* m_gradHeader;
 
+    shared_ptr<ModelAverager<ElemType>> m_modelAverager; // created when model averaging starts
+
+    shared_ptr<NodeProfiler> m_nodeProfiler; // installed into the network during TrainModel() if m_nodeProfiling
+
 private:
     int SGDTrace(FILE* __restrict __stream, const char* __restrict __format, ...);
 };
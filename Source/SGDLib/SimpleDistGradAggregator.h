@@ -3,6 +3,8 @@
 #include "IDistGradAggregator.h"
 #include "CUDAPageLockedMemAllocator.h"
 #include <future>
+#include <mutex>
+#include <condition_variable>
 #include "GPUDataTransferer.h"
 #include "TimerUtility.h"
 
@@ -14,18 +16,14 @@ class SimpleDistGradAggregator : public IDistGradAggregator<ElemType>
     UsingIDistGradAggregatorMembers;
 
 public:
-    SimpleDistGradAggregator(MPIWrapper* mpi, bool useAsyncAggregation, int syncStatsTrace)
-        : IDistGradAggregator<ElemType>(mpi), m_useAsyncAggregation(useAsyncAggregation), m_currentEpochNumber(-1), m_bufferedGradHeader(nullptr), m_syncStatsTrace(syncStatsTrace), m_iterationCount(0)
+    SimpleDistGradAggregator(MPIWrapper* mpi, bool useAsyncAggregation, int syncStatsTrace, AllReduceAlgorithm allReduceAlgorithm = AllReduceAlgorithm::MPI, size_t bucketSizeInBytes = 0)
+        : IDistGradAggregator<ElemType>(mpi), m_numGradientElements(0), m_bucketSizeInBytes(bucketSizeInBytes), m_allReduceAlgorithm(allReduceAlgorithm), m_layerwiseAborted(false), m_showLayerwiseSyncPerfStats(false), m_layerwiseCommunicationTime(0),
+          m_useAsyncAggregation(useAsyncAggregation), m_bufferedGradHeader(nullptr), m_syncStatsTrace(syncStatsTrace), m_iterationCount(0), m_currentEpochNumber(-1)
     {
     }
 
     ~SimpleDistGradAggregator()
     {
-        for (size_t i = 0; i < m_recvHeaders.size(); ++i)
-        {
-            DistGradHeader::Destroy(m_recvHeaders[i]);
-        }
-
         if (m_bufferedGradHeader != nullptr)
         {
             DistGradHeader::Destroy(m_bufferedGradHeader);
@@ -121,7 +119,169 @@ public:
         }
     }
 
+    // The buffered async mode already overlaps with the next minibatch, and is not combined with layer-wise aggregation
+    bool SupportsLayerwiseAggregation() const override
+    {
+        return !m_useAsyncAggregation;
+    }
+
+    // Start the communication thread, which reduces the buckets in order, each as soon as all its gradients are ready
+    void BeginLayerwiseAggregation(const std::vector<Matrix<ElemType>*>& gradients, int numEvalNode, int epochNumber) override
+    {
+        if (m_pendingAsyncAggregation.valid())
+            LogicError("BeginLayerwiseAggregation: Previous layer-wise gradient aggregation has not been ended.");
+
+        ResetCurrentEpoch(gradients, numEvalNode, epochNumber);
+        m_showLayerwiseSyncPerfStats = (m_syncStatsTrace > 0) && ((m_iterationCount % m_syncStatsTrace) == 0);
+        m_iterationCount++;
+
+        m_layerwiseGradients = gradients;
+        m_gradientReady.assign(gradients.size(), false);
+        m_gradientReadyEvents.resize(gradients.size());
+        m_layerwiseAborted = false;
+        m_layerwiseCommunicationTime = 0;
+
+        int deviceId = gradients[0]->GetDeviceId();
+        m_pendingAsyncAggregation = std::async(std::launch::async, [this, deviceId]
+                                               {
+                                                   // We are starting on a new thread. Make sure the new thread is
+                                                   // setup to use the right device
+                                                   Matrix<ElemType>::SetDevice(deviceId);
+                                                   ReduceBucketsWhenReady();
+                                               });
+    }
+
+    void GradientReady(size_t i) override
+    {
+        // on the GPU, the transfer of the gradient must wait for the backprop kernels that have been launched so far
+        int deviceId = m_layerwiseGradients[i]->GetDeviceId();
+        std::unique_ptr<MatrixComputeStreamEvent> readyEvent;
+        if (deviceId >= 0)
+            readyEvent.reset(MatrixComputeStreamEvent::Create(deviceId));
+
+        std::lock_guard<std::mutex> lock(m_gradientReadyMutex);
+        if (m_gradientReady[i])
+            return;
+        m_gradientReadyEvents[i] = std::move(readyEvent);
+        m_gradientReady[i] = true;
+        m_gradientReadyCondition.notify_all();
+    }
+
+    bool EndLayerwiseAggregation(DistGradHeader* headerCPU) override
+    {
+        Timer waitTimer;
+        if (m_showLayerwiseSyncPerfStats)
+            waitTimer.Start();
+
+        // If the current node did not process any samples, the gradients should be zero'd.
+        // No gradient has been reported ready in this case, so the communication thread has not touched them yet.
+        if (headerCPU->numSamples == 0)
+        {
+            for (size_t i = 0; i < m_layerwiseGradients.size(); ++i)
+            {
+                m_layerwiseGradients[i]->SetValue(0);
+            }
+        }
+
+        // gradients that backprop did not reach (e.g. when it was skipped) are reduced as they are
+        for (size_t i = 0; i < m_layerwiseGradients.size(); ++i)
+        {
+            GradientReady(i);
+        }
+
+        m_pendingAsyncAggregation.get();
+
+        // The header is reduced only now, since MPI collectives must not be issued concurrently from two threads
+        PackHeader(headerCPU);
+        MPI_Request headerAllReduceRequest;
+        MPI_Iallreduce(MPI_IN_PLACE, m_headerBuffer.data(), (int) m_headerBuffer.size(), MPIWrapper::GetDataType(m_headerBuffer.data()), MPI_SUM, m_mpi->Communicator(), &headerAllReduceRequest) || MpiFail("MPI_Iallreduce");
+        MPI_Wait(&headerAllReduceRequest, MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
+        UnpackHeader(headerCPU);
+
+        if (m_showLayerwiseSyncPerfStats)
+        {
+            waitTimer.Stop();
+            fprintf(stderr, "Layer-wise gradient aggregation time: %.6g, of which not overlapped with backprop: %.6g (%d buckets, %.2f MB, %s allreduce)\n",
+                    m_layerwiseCommunicationTime, waitTimer.ElapsedSeconds(), (int) m_buckets.size(), m_numGradientElements * sizeof(ElemType) / (1024.0 * 1024.0), AllReduceAlgorithmName());
+        }
+
+        return (headerCPU->numSamples != 0);
+    }
+
+    // stop the communication thread after the bucket it is reducing (an MPI collective cannot be cancelled), and wait for it
+    void AbortLayerwiseAggregation() override
+    {
+        if (!m_pendingAsyncAggregation.valid())
+            return;
+        {
+            std::lock_guard<std::mutex> lock(m_gradientReadyMutex);
+            m_layerwiseAborted = true;
+        }
+        m_gradientReadyCondition.notify_all();
+        try
+        {
+            m_pendingAsyncAggregation.get();
+        }
+        catch (...) // (we are already handling another error, which is the one to report)
+        {
+        }
+    }
+
 private:
+    // runs on the communication thread during layer-wise aggregation
+    void ReduceBucketsWhenReady()
+    {
+        const std::vector<Matrix<ElemType>*>& gradients = m_layerwiseGradients;
+        int deviceId = gradients[0]->GetDeviceId();
+        Timer communicationTimer;
+        for (size_t b = 0; b < m_buckets.size(); ++b)
+        {
+            const GradientBucket& bucket = m_buckets[b];
+            for (size_t i = bucket.firstGradient; i < bucket.endGradient; ++i)
+            {
+                std::unique_ptr<MatrixComputeStreamEvent> readyEvent;
+                {
+                    std::unique_lock<std::mutex> lock(m_gradientReadyMutex);
+                    m_gradientReadyCondition.wait(lock, [this, i]
+                                                  {
+                                                      return m_gradientReady[i] || m_layerwiseAborted;
+                                                  });
+                    if (m_layerwiseAborted)
+                        return;
+                    readyEvent = std::move(m_gradientReadyEvents[i]);
+                }
+
+                if (deviceId >= 0)
+                {
+                    readyEvent->SynchronizeDataTransferFetchStreamWithEvent<ElemType>();
+                    m_gpuDataTransferers[i]->CopyGPUToCPUAsync(gradients[i]->BufferPointer(), gradients[i]->GetNumElements(), GradientReductionBuffer(gradients, i));
+                }
+            }
+
+            if (m_showLayerwiseSyncPerfStats)
+                communicationTimer.Start();
+
+            MPI_Request request;
+            StartBucketReduction(gradients, b, &request);
+            FinishBucketReduction(gradients, b, &request);
+
+            if (m_showLayerwiseSyncPerfStats)
+            {
+                communicationTimer.Stop();
+                m_layerwiseCommunicationTime += communicationTimer.ElapsedSeconds();
+            }
+        }
+
+        // Wait for all the transfers to finish
+        if (deviceId >= 0)
+        {
+            for (size_t i = 0; i < gradients.size(); ++i)
+            {
+                m_gpuDataTransferers[i]->WaitForCopyCPUToGPUAsync();
+            }
+        }
+    }
+
     std::shared_ptr<ElemType> AllocateIntermediateBuffer(int deviceID, size_t numElements)
     {
         assert(deviceID >= 0);
@@ -156,7 +316,6 @@ private:
                 if (deviceId != CPUDEVICE)
                 {
                     m_gpuDataTransferers.push_back(std::unique_ptr<GPUDataTransferer<ElemType>>(new GPUDataTransferer<ElemType>(deviceId, m_useAsyncAggregation)));
-                    m_intermediateCPUBuffers.push_back(AllocateIntermediateBuffer(deviceId, gradients[i]->GetNumElements()));
                 }
 
                 if (m_useAsyncAggregation)
@@ -171,13 +330,8 @@ private:
                 m_bufferedGradHeader->Clear();
             }
 
-            if (m_mpi->IsMainNode())
-            {
-                for (size_t i = 0; i < NumProc() - 1; ++i)
-                {
-                    m_recvHeaders.push_back(DistGradHeader::Create(numEvalNode));
-                }
-            }
+            CreateGradientBuckets(gradients);
+            m_headerBuffer.resize(3 + numEvalNode); // numSamples, numSamplesWithLabel, criterion, evalErrors[]
         }
         else
         {
@@ -239,139 +393,219 @@ private:
             }
         }
 
-        // Initiate transfer of the gradient matrices to the CPU if needed
+        // Initiate transfer of the gradient matrices to the CPU if needed. On the GPU, each gradient goes
+        // straight into its slice of the bucket buffer.
         if (deviceId >= 0)
         {
             for (size_t i = 0; i < numGradMatrices; ++i)
             {
-                m_gpuDataTransferers[i]->CopyGPUToCPUAsync(gradients[i]->BufferPointer(), gradients[i]->GetNumElements(), m_intermediateCPUBuffers[i].get());
+                m_gpuDataTransferers[i]->CopyGPUToCPUAsync(gradients[i]->BufferPointer(), gradients[i]->GetNumElements(), GradientReductionBuffer(gradients, i));
             }
         }
 
-        // Initiate receive of the header on the main node
-        std::vector<MPI_Request> recvHeaderRequests(NumProc() - 1);
-        if (m_mpi->IsMainNode())
+        // The header is summed up with the same collective on all nodes (instead of being gathered on the main node and sent back).
+        // It is reduced as doubles, so that the sample counts and criterion sums keep full precision also with float gradients.
+        // That is why it is a collective of its own rather than a few extra elements of the last gradient bucket; it is
+        // started first, so its latency overlaps with the gradient reduction.
+        PackHeader(headerCPU);
+        MPI_Request headerAllReduceRequest;
+        MPI_Iallreduce(MPI_IN_PLACE, m_headerBuffer.data(), (int) m_headerBuffer.size(), MPIWrapper::GetDataType(m_headerBuffer.data()), MPI_SUM, m_mpi->Communicator(), &headerAllReduceRequest) || MpiFail("MPI_Iallreduce");
+
+        // Reduce the gradients one bucket at a time
+        size_t numBuckets = m_buckets.size();
+        std::vector<MPI_Request> allReduceRequests(numBuckets, MPI_REQUEST_NULL);
+        for (size_t b = 0; b < numBuckets; ++b)
         {
-            for (size_t j = 0; j < NumProc() - 1; ++j)
-            {
-                int source = (j >= MyRank()) ? (j + 1) : j;
-                // We use a tag of 'numGradMatrices' for the pre-aggregation header
-                MPI_Irecv(m_recvHeaders[j], m_recvHeaders[j]->Size(), MPI_CHAR, source, numGradMatrices, m_mpi->Communicator(), &(recvHeaderRequests[j])) || MpiFail("MPI_Irecv");
-            }
+            StartBucketReduction(gradients, b, &allReduceRequests[b]);
         }
 
-        // Send the headers from all nodes but the main node
-        MPI_Request sendHeaderRequest;
-        if (!m_mpi->IsMainNode())
+        // Wait for the allreduce operations to finish and copy the results back into the gradients
+        for (size_t b = 0; b < numBuckets; ++b)
         {
-            MPI_Isend(headerCPU, headerCPU->Size(), MPI_CHAR, m_mpi->MainNodeRank(), numGradMatrices, m_mpi->Communicator(), &sendHeaderRequest) || MpiFail("MPI_Isend");
+            FinishBucketReduction(gradients, b, &allReduceRequests[b]);
         }
 
-        // Perform MPI async allreduce on the gradient data
-        std::vector<MPI_Request> allReduceRequests(numGradMatrices);
-        for (size_t i = 0; i < numGradMatrices; ++i)
+        // Wait for the aggregate header
+        MPI_Wait(&headerAllReduceRequest, MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
+        UnpackHeader(headerCPU);
+
+        // Wait for all the transfers to finish
+        if (deviceId >= 0)
         {
-            ElemType* reductionBuffer = gradients[i]->BufferPointer();
-            if (deviceId >= 0)
+            for (size_t i = 0; i < numGradMatrices; ++i)
             {
-                m_gpuDataTransferers[i]->WaitForCopyGPUToCPUAsync();
-                reductionBuffer = m_intermediateCPUBuffers[i].get();
+                m_gpuDataTransferers[i]->WaitForCopyCPUToGPUAsync();
             }
-
-            // On Windows this async MPI_Iallreduce call requires MS MPI v7 or higher to be installed
-            MPI_Iallreduce(MPI_IN_PLACE, reductionBuffer, gradients[i]->GetNumElements(), MPIWrapper::GetDataType(reductionBuffer), MPI_SUM, m_mpi->Communicator(), &allReduceRequests[i]) || MpiFail("MPI_Iallreduce");
         }
 
-        // On the main node wait for the headers to arrive and aggregate
-        if (m_mpi->IsMainNode())
+        if (showSyncPerfStats)
         {
-            size_t numNodesHeadersReceivedFrom = 0;
-            while (numNodesHeadersReceivedFrom < (NumProc() - 1))
-            {
-                int idx = MPI_UNDEFINED;
-                MPI_Waitany(recvHeaderRequests.size(), recvHeaderRequests.data(), &idx, MPI_STATUS_IGNORE) || MpiFail("MPI_Waitany");
-                if (idx == MPI_UNDEFINED)
-                {
-                    break;
-                }
-
-                numNodesHeadersReceivedFrom++;
-
-                headerCPU->Aggregate(m_recvHeaders[idx], true);
-            }
-
-            assert(numNodesHeadersReceivedFrom == (NumProc() - 1));
+            aggregationTimer.Stop();
+            double epochTime = aggregationTimer.ElapsedSeconds();
+            fprintf(stderr, "Actual gradient aggregation time: %.6g (%d buckets, %.2f MB, %s allreduce)\n",
+                    epochTime, (int) numBuckets, m_numGradientElements * sizeof(ElemType) / (1024.0 * 1024.0), AllReduceAlgorithmName());
         }
+    }
 
-        MPI_Request recvAggHeaderRequest;
-        // Initiate receive of the aggregate header
-        if (!m_mpi->IsMainNode())
+    void PackHeader(const DistGradHeader* headerCPU)
+    {
+        m_headerBuffer[0] = (double) headerCPU->numSamples;
+        m_headerBuffer[1] = (double) headerCPU->numSamplesWithLabel;
+        m_headerBuffer[2] = headerCPU->criterion;
+        for (int i = 0; i < headerCPU->numEvalNode; ++i)
         {
-            MPI_Irecv(headerCPU, headerCPU->Size(), MPI_CHAR, m_mpi->MainNodeRank(), numGradMatrices + 1 + numGradMatrices, m_mpi->Communicator(), &recvAggHeaderRequest) || MpiFail("MPI_Irecv");
+            m_headerBuffer[3 + i] = headerCPU->evalErrors[i];
         }
+    }
 
-        // Intiate send of the aggregate header from main node
-        std::vector<MPI_Request> sendAggHeaderRequests(NumProc() - 1);
-        if (m_mpi->IsMainNode())
+    void UnpackHeader(DistGradHeader* headerCPU) const
+    {
+        headerCPU->numSamples = (size_t) m_headerBuffer[0];
+        headerCPU->numSamplesWithLabel = (size_t) m_headerBuffer[1];
+        headerCPU->criterion = m_headerBuffer[2];
+        for (int i = 0; i < headerCPU->numEvalNode; ++i)
         {
-            for (size_t j = 0; j < NumProc() - 1; ++j)
-            {
-                int dest = (j >= MyRank()) ? (j + 1) : j;
-                // TODO: Should we use MPI_Bcast instead for better performance
-                MPI_Isend(headerCPU, headerCPU->Size(), MPI_CHAR, dest, numGradMatrices + 1 + numGradMatrices, m_mpi->Communicator(), &(sendAggHeaderRequests[j])) || MpiFail("MPI_Isend");
-            }
+            headerCPU->evalErrors[i] = m_headerBuffer[3 + i];
         }
+    }
 
-        // Wait for the allreduce operations to finish and initiate transfer back to the GPU if needed
-        for (size_t i = 0; i < numGradMatrices; ++i)
+    // Gather the gradients of bucket b into its buffer (on the GPU, the transfers must have been initiated) and start reducing it.
+    // The built-in algorithms are blocking, and leave 'request' at MPI_REQUEST_NULL.
+    void StartBucketReduction(const std::vector<Matrix<ElemType>*>& gradients, size_t b, MPI_Request* request)
+    {
+        const GradientBucket& bucket = m_buckets[b];
+        int deviceId = gradients[0]->GetDeviceId();
+        for (size_t i = bucket.firstGradient; i < bucket.endGradient; ++i)
         {
-            MPI_Wait(&allReduceRequests[i], MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
             if (deviceId >= 0)
-            {
-                m_gpuDataTransferers[i]->CopyCPUToGPUAsync(m_intermediateCPUBuffers[i].get(), gradients[i]->GetNumElements(), gradients[i]->BufferPointer());
-            }
+                m_gpuDataTransferers[i]->WaitForCopyGPUToCPUAsync();
+            else if (bucket.buffer)
+                memcpy(GradientReductionBuffer(gradients, i), gradients[i]->BufferPointer(), sizeof(ElemType) * gradients[i]->GetNumElements());
         }
 
-        // Wait to receive aggregate header
-        if (!m_mpi->IsMainNode())
+        *request = MPI_REQUEST_NULL;
+        ElemType* reductionBuffer = BucketReductionBuffer(gradients, b);
+        if (m_allReduceAlgorithm == AllReduceAlgorithm::MPI)
         {
-            MPI_Wait(&recvAggHeaderRequest, MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
+            // On Windows this async MPI_Iallreduce call requires MS MPI v7 or higher to be installed
+            MPI_Iallreduce(MPI_IN_PLACE, reductionBuffer, (int) bucket.numElements, MPIWrapper::GetDataType(reductionBuffer), MPI_SUM, m_mpi->Communicator(), request) || MpiFail("MPI_Iallreduce");
         }
-
-        // Wait for all the transfers to finish
-        if (deviceId >= 0)
+        else
         {
-            for (size_t i = 0; i < numGradMatrices; ++i)
-            {
-                m_gpuDataTransferers[i]->WaitForCopyCPUToGPUAsync();
-            }
+            m_mpi->AllReduce(reductionBuffer, bucket.numElements, m_allReduceAlgorithm, m_allReduceScratch);
         }
+    }
 
-        // Wait for completion of the async send requests
-        if (!m_mpi->IsMainNode())
+    // Wait for the reduction of bucket b and initiate copying the results back into the gradients
+    void FinishBucketReduction(const std::vector<Matrix<ElemType>*>& gradients, size_t b, MPI_Request* request)
+    {
+        const GradientBucket& bucket = m_buckets[b];
+        int deviceId = gradients[0]->GetDeviceId();
+        MPI_Wait(request, MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
+        for (size_t i = bucket.firstGradient; i < bucket.endGradient; ++i)
         {
-            MPI_Wait(&sendHeaderRequest, MPI_STATUSES_IGNORE) || MpiFail("MPI_Wait");
+            if (deviceId >= 0)
+                m_gpuDataTransferers[i]->CopyCPUToGPUAsync(GradientReductionBuffer(gradients, i), gradients[i]->GetNumElements(), gradients[i]->BufferPointer());
+            else if (bucket.buffer)
+                memcpy(gradients[i]->BufferPointer(), GradientReductionBuffer(gradients, i), sizeof(ElemType) * gradients[i]->GetNumElements());
         }
-        else
+    }
+
+    // The gradients are packed into buckets of consecutive matrices of at most m_bucketSizeInBytes (a larger matrix gets a bucket of its own),
+    // which are reduced with one collective each. A bucket of a single CPU matrix is reduced in place.
+    void CreateGradientBuckets(const std::vector<Matrix<ElemType>*>& gradients)
+    {
+        int deviceId = gradients[0]->GetDeviceId();
+        size_t maxBucketElements = m_bucketSizeInBytes / sizeof(ElemType);
+
+        m_gradientBucket.resize(gradients.size());
+        m_gradientOffsets.resize(gradients.size());
+        m_numGradientElements = 0;
+        size_t i = 0;
+        while (i < gradients.size())
         {
-            MPI_Waitall(sendAggHeaderRequests.size(), sendAggHeaderRequests.data(), MPI_STATUSES_IGNORE) || MpiFail("MPI_Waitall");
+            GradientBucket bucket;
+            bucket.firstGradient = i;
+            bucket.numElements = 0;
+            do
+            {
+                m_gradientBucket[i] = m_buckets.size();
+                m_gradientOffsets[i] = bucket.numElements;
+                bucket.numElements += gradients[i]->GetNumElements();
+                i++;
+            } while ((i < gradients.size()) && (bucket.numElements + gradients[i]->GetNumElements() <= maxBucketElements));
+            bucket.endGradient = i;
+
+            if (deviceId != CPUDEVICE)
+                bucket.buffer = AllocateIntermediateBuffer(deviceId, bucket.numElements);
+            else if (bucket.endGradient - bucket.firstGradient > 1)
+                bucket.buffer = std::shared_ptr<ElemType>(new ElemType[bucket.numElements], [](ElemType* p)
+                                                          {
+                                                              delete[] p;
+                                                          });
+
+            m_numGradientElements += bucket.numElements;
+            m_buckets.push_back(bucket);
         }
+    }
 
-        if (showSyncPerfStats)
+    // the buffer that the bucket is reduced in: the bucket buffer, or the gradient itself for a CPU bucket of one matrix
+    ElemType* BucketReductionBuffer(const std::vector<Matrix<ElemType>*>& gradients, size_t b) const
+    {
+        const GradientBucket& bucket = m_buckets[b];
+        return bucket.buffer ? bucket.buffer.get() : gradients[bucket.firstGradient]->BufferPointer();
+    }
+
+    // the slice of the bucket buffer that holds gradient i
+    ElemType* GradientReductionBuffer(const std::vector<Matrix<ElemType>*>& gradients, size_t i) const
+    {
+        return BucketReductionBuffer(gradients, m_gradientBucket[i]) + m_gradientOffsets[i];
+    }
+
+    const char* AllReduceAlgorithmName() const
+    {
+        switch (m_allReduceAlgorithm)
         {
-            aggregationTimer.Stop();
-            double epochTime = aggregationTimer.ElapsedSeconds();
-            fprintf(stderr, "Actual gradient aggregation time: %.6g\n", epochTime);
+        case AllReduceAlgorithm::Ring:             return "ring";
+        case AllReduceAlgorithm::RecursiveHalving: return "recursive-halving";
+        default:                                   return "MPI";
         }
     }
 
 private:
     std::unique_ptr<CUDAPageLockedMemAllocator> m_allocator;
-    std::vector<std::shared_ptr<ElemType>> m_intermediateCPUBuffers;
 
     std::vector<std::unique_ptr<GPUDataTransferer<ElemType>>> m_gpuDataTransferers;
 
-    std::vector<DistGradHeader*> m_recvHeaders;
+    // gradients [firstGradient, endGradient) that are reduced together in 'buffer' (pinned for GPU gradients; null for a CPU bucket of one matrix)
+    struct GradientBucket
+    {
+        size_t firstGradient;
+        size_t endGradient;
+        size_t numElements;
+        std::shared_ptr<ElemType> buffer;
+    };
+    std::vector<GradientBucket> m_buckets;
+    std::vector<size_t> m_gradientBucket;  // [i] bucket that gradient i is in
+    std::vector<size_t> m_gradientOffsets; // [i] offset of gradient i in its bucket
+    size_t m_numGradientElements;
+    size_t m_bucketSizeInBytes;            // 0: one bucket per gradient matrix
+
+    AllReduceAlgorithm m_allReduceAlgorithm;
+    std::vector<ElemType> m_allReduceScratch; // receive buffer of the built-in allreduce algorithms
+
+    // header fields, summed with one allreduce
+    std::vector<double> m_headerBuffer;
+
+    // layer-wise aggregation: the gradients of the current iteration, and which of them backprop has completed
+    std::vector<Matrix<ElemType>*> m_layerwiseGradients;
+    std::vector<bool> m_gradientReady;
+    std::vector<std::unique_ptr<MatrixComputeStreamEvent>> m_gradientReadyEvents;
+    std::mutex m_gradientReadyMutex;
+    std::condition_variable m_gradientReadyCondition;
+    bool m_layerwiseAborted; // set by AbortLayerwiseAggregation() to stop the communication thread
+    bool m_showLayerwiseSyncPerfStats;
+    double m_layerwiseCommunicationTime; // time the communication thread spent in allreduce (as opposed to waiting for backprop)
 
     // Perform aysnchronous gradient aggregation using double buffering of the gradient matrices
     bool m_useAsyncAggregation;
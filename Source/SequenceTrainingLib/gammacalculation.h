@@ -1,6 +1,8 @@
 #pragma once
 
 #include <unordered_map>
+#include <exception>
+#include <omp.h>
 #include "simplesenonehmm.h"
 #include "latticearchive.h"
 #include "latticesource.h"
@@ -97,7 +99,6 @@ public:
     {
         // check total frame number to be added ?
         // int deviceid = loglikelihood.GetDeviceId();
-        size_t boundaryframenum;
         std::vector<size_t> validframes; // [s] cursor pointing to next utterance begin within a single parallel sequence [s]
         validframes.assign(samplesInRecurrentStep, 0);
         ElemType objectValue = 0.0;
@@ -123,15 +124,29 @@ public:
             assert(T == pMBLayout->GetNumTimeSteps());
         }
 
-        size_t mapi = 0; // parallel-sequence index for utterance [i]
-        // cal gamma for each utterance
+        // per-utterance bookkeeping, so that the three steps below can be run in separate passes
+        struct utterance
+        {
+            size_t ts;          // first column of utterance in pred and dengammas
+            size_t numframes;
+            size_t mapi;        // parallel-sequence index for utterance [i]
+            size_t tbegin;      // first time step of utterance within its parallel sequence
+            double denavlogp;
+        };
+        std::vector<utterance> utterances(lattices.size());
+
+        // step 1: get the log-likelihoods of utterance [i] into its stripe of pred (and onto the GPU if used)
         size_t ts = 0;
-        for (size_t i = 0; i < lattices.size(); i++)
+        auto getloglls = [&](size_t i)
         {
+            utterance& utt = utterances[i];
             const size_t numframes = lattices[i]->getnumframes();
+            utt.ts = ts;
+            utt.numframes = numframes;
+            utt.mapi = 0;
+            utt.tbegin = 0;
 
-            msra::dbn::matrixstripe predstripe(pred, ts, numframes);           // logLLs for this utterance
-            msra::dbn::matrixstripe dengammasstripe(dengammas, ts, numframes); // denominator gammas
+            msra::dbn::matrixstripe predstripe(pred, ts, numframes); // logLLs for this utterance
 
             if (samplesInRecurrentStep == 1) // no sequence parallelism
             {
@@ -147,7 +162,9 @@ public:
             else // multiple parallel sequences
             {
                 // get number of frames for the utterance
-                mapi = extrauttmap[i]; // parallel-sequence index; in case of >1 utterance within this parallel sequence, this is in order of concatenation
+                const size_t mapi = extrauttmap[i]; // parallel-sequence index; in case of >1 utterance within this parallel sequence, this is in order of concatenation
+                utt.mapi = mapi;
+                utt.tbegin = validframes[mapi];
 
                 // scan MBLayout for end of utterance
                 size_t mapframenum = SIZE_MAX; // duration of utterance [i] as determined from MBLayout
@@ -181,17 +198,40 @@ public:
                 {
                     parallellattice.setloglls(tempmatrix);
                 }
+                validframes[mapi] += numframes; // advance the cursor within the parallel sequence
             }
+            ts += numframes;
+        };
 
-            array_ref<size_t> uidsstripe(&uids[ts], numframes);
+        // step 2: lattice forward-backward of utterance [i]; only touches the stripes of utterance [i]
+        auto computegammas = [&](size_t i)
+        {
+            utterance& utt = utterances[i];
+            const size_t numframes = utt.numframes;
 
-            if (doreferencealign)
-            {
-                boundaryframenum = numframes;
-            }
-            else
-                boundaryframenum = 0;
-            array_ref<size_t> boundariesstripe(&boundaries[ts], boundaryframenum);
+            msra::dbn::matrixstripe predstripe(pred, utt.ts, numframes);           // logLLs for this utterance
+            msra::dbn::matrixstripe dengammasstripe(dengammas, utt.ts, numframes); // denominator gammas
+
+            array_ref<size_t> uidsstripe(&uids[utt.ts], numframes);
+            array_ref<size_t> boundariesstripe(&boundaries[utt.ts], doreferencealign ? numframes : 0);
+
+            // auto_timer dengammatimer;
+            utt.denavlogp = lattices[i]->second.forwardbackward(parallellattice,
+                                                                (const msra::math::ssematrixbase&) predstripe, (const msra::asr::simplesenonehmm&) m_hset,
+                                                                (msra::math::ssematrixbase&) dengammasstripe, (msra::math::ssematrixbase&) gammasbuffer /*empty, not used*/,
+                                                                lmf, wp, amf, boostmmifactor, seqsMBRmode, uidsstripe, boundariesstripe);
+        };
+
+        // step 3: accumulate the objective and copy the gammas of utterance [i] into gammafromlattice
+        auto setgammas = [&](size_t i)
+        {
+            const utterance& utt = utterances[i];
+            const size_t numframes = utt.numframes;
+            const size_t mapi = utt.mapi;
+
+            msra::dbn::matrixstripe predstripe(pred, utt.ts, numframes);           // logLLs for this utterance
+            msra::dbn::matrixstripe dengammasstripe(dengammas, utt.ts, numframes); // denominator gammas
+            array_ref<size_t> uidsstripe(&uids[utt.ts], numframes);
 
             double numavlogp = 0;
             foreach_column (t, dengammasstripe) // we do not allocate memory for numgamma now, should be the same as numgammasstripe
@@ -201,22 +241,17 @@ public:
             }
             numavlogp /= numframes;
 
-            // auto_timer dengammatimer;
-            double denavlogp = lattices[i]->second.forwardbackward(parallellattice,
-                                                                   (const msra::math::ssematrixbase&) predstripe, (const msra::asr::simplesenonehmm&) m_hset,
-                                                                   (msra::math::ssematrixbase&) dengammasstripe, (msra::math::ssematrixbase&) gammasbuffer /*empty, not used*/,
-                                                                   lmf, wp, amf, boostmmifactor, seqsMBRmode, uidsstripe, boundariesstripe);
-            objectValue += (ElemType)((numavlogp - denavlogp) * numframes);
+            objectValue += (ElemType)((numavlogp - utt.denavlogp) * numframes);
 
             if (samplesInRecurrentStep == 1)
             {
-                tempmatrix = gammafromlattice.ColumnSlice(ts, numframes);
+                tempmatrix = gammafromlattice.ColumnSlice(utt.ts, numframes);
             }
 
             // copy gamma to tempmatrix
             if (m_deviceid == CPUDEVICE)
             {
-                CopyFromSSEMatrixToCNTKMatrix(dengammas, numrows, numframes, tempmatrix, gammafromlattice.GetDeviceId());
+                CopyFromSSEMatrixToCNTKMatrix(dengammasstripe, numrows, numframes, tempmatrix, gammafromlattice.GetDeviceId());
             }
             else
                 parallellattice.getgamma(tempmatrix);
@@ -224,7 +259,7 @@ public:
             // set gamma for multi channel
             if (samplesInRecurrentStep > 1)
             {
-                Microsoft::MSR::CNTK::Matrix<ElemType> gammaFromLatticeForCurrentParallelUtterance = gammafromlattice.ColumnSlice(mapi + (validframes[mapi] * samplesInRecurrentStep), ((numframes - 1) * samplesInRecurrentStep) + 1);
+                Microsoft::MSR::CNTK::Matrix<ElemType> gammaFromLatticeForCurrentParallelUtterance = gammafromlattice.ColumnSlice(mapi + (utt.tbegin * samplesInRecurrentStep), ((numframes - 1) * samplesInRecurrentStep) + 1);
                 gammaFromLatticeForCurrentParallelUtterance.CopyColumnsStrided(tempmatrix, numframes, 1, samplesInRecurrentStep);
             }
 
@@ -234,15 +269,51 @@ public:
                 {
                     size_t uid = uidsstripe[nframe];
                     if (samplesInRecurrentStep > 1)
-                        labels(uid, (nframe + validframes[mapi]) * samplesInRecurrentStep + mapi) = 1.0;
+                        labels(uid, (nframe + utt.tbegin) * samplesInRecurrentStep + mapi) = 1.0;
                     else
-                        labels(uid, ts + nframe) = 1.0;
+                        labels(uid, utt.ts + nframe) = 1.0;
                 }
             }
-            if (samplesInRecurrentStep > 1)
-                validframes[mapi] += numframes; // advance the cursor within the parallel sequence
-            fprintf(stderr, "dengamma value %f\n", denavlogp);
-            ts += numframes;
+            fprintf(stderr, "dengamma value %f\n", utt.denavlogp);
+        };
+
+        // cal gamma for each utterance
+        // On the CPU, with enough utterances to keep all threads busy, the lattices are processed in parallel
+        // (each on a single thread, since nested parallel regions are serialized); otherwise one at a time,
+        // parallelizing over the edges within each lattice.
+        // Utterances write to disjoint stripes, and the objective is summed in order, so results do not depend on this choice.
+        if (m_deviceid == CPUDEVICE && lattices.size() > 1 && lattices.size() >= (size_t) omp_get_max_threads())
+        {
+            for (size_t i = 0; i < lattices.size(); i++)
+                getloglls(i);
+            std::exception_ptr firsterror; // exceptions must not leave the parallel region
+#pragma omp parallel for schedule(dynamic)
+            for (int i = 0; i < (int) lattices.size(); i++)
+            {
+                try
+                {
+                    computegammas(i);
+                }
+                catch (...)
+                {
+#pragma omp critical
+                    if (!firsterror)
+                        firsterror = std::current_exception();
+                }
+            }
+            if (firsterror)
+                std::rethrow_exception(firsterror);
+            for (size_t i = 0; i < lattices.size(); i++)
+                setgammas(i);
+        }
+        else // one at a time; this is also required on the GPU, where the device holds the state of one lattice at a time
+        {
+            for (size_t i = 0; i < lattices.size(); i++)
+            {
+                getloglls(i);
+                computegammas(i);
+                setgammas(i);
+            }
         }
         functionValues.SetValue(objectValue);
     }
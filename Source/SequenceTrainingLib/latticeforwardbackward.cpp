@@ -15,6 +15,8 @@
 #include <unordered_map>
 #include <list>
 #include <stdexcept>
+#include <exception>
+#include <omp.h>
 
 using namespace std;
 
@@ -135,6 +137,43 @@ static bool islogzero(FLOAT v)
 // other helpers go here
 // ---------------------------------------------------------------------------
 
+// run body(i) for i = 0..n-1 on the OpenMP threads
+// Exceptions must not leave a parallel region, so the first one is rethrown after the loop.
+template <typename BODY>
+static void parallelforeach(size_t n, const BODY &body)
+{
+    std::exception_ptr firsterror;
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < (int) n; i++)
+    {
+        try
+        {
+            body((size_t) i);
+        }
+        catch (...)
+        {
+#pragma omp critical
+            if (!firsterror)
+                firsterror = std::current_exception();
+        }
+    }
+    if (firsterror)
+        std::rethrow_exception(firsterror);
+}
+
+// run body(ts, te) for disjoint frame ranges [ts, te) covering [0, numframes) on the OpenMP threads
+// Used to accumulate per-frame statistics over all edges: each range visits the edges in the same order as
+// a serial loop would, so every matrix entry sees the same sequence of additions and results are bit-identical.
+template <typename BODY>
+static void parallelforframeranges(size_t numframes, const BODY &body)
+{
+    const size_t numranges = min(numframes, 4 * (size_t) omp_get_max_threads()); // some slack for load balancing
+    parallelforeach(numranges, [&](size_t k)
+                    {
+                        body(numframes * k / numranges, numframes * (k + 1) / numranges);
+                    });
+}
+
 // helper to reconstruct the phonetic transcript
 /*static*/ std::string lattice::gettranscript(const_array_ref<aligninfo> units, const msra::asr::simplesenonehmm &hset)
 {
@@ -958,26 +997,34 @@ void lattice::forwardbackwardalign(parallelstate &parallelstate,
             parallelstate.getedgeacscores(edgeacscoresgpu);
             parallelstate.copyalignments(thisedgealignmentsgpu);
         }
-        foreach_index (j, edges)
+        // edges are independent: each one has its own abcs[j] and its own range in thisedgealignments
+        thisedgealignments.allocate();
+        parallelforeach(edges.size(), [&](size_t j)
+                        {
+                            const edgeinfowithscores &e = edges[j];
+                            const size_t ts = nodes[e.S].t;
+                            const size_t te = nodes[e.E].t;
+                            if (ts == te) // dummy !NULL edge at end
+                                edgeacscores[j] = 0.0f;
+                            else
+                            {
+                                const auto &aligntokens = getaligninfo(j); // get alignment tokens
+                                const auto edgeLLs = msra::math::ssematrixstriperef<msra::math::ssematrixbase>(const_cast<msra::math::ssematrixbase &>(logLLs), ts, te - ts);
+                                if (minlogpp > LOGZERO && origlogpps[j] < minlogpp)
+                                    edgeacscores[j] = LOGZERO; // will kill word level forwardbackward hypothesis
+                                else if (softalignstates)
+                                    edgeacscores[j] = forwardbackwardedge(aligntokens, hset, edgeLLs, *abcs[j], j);
+                                else
+                                    edgeacscores[j] = alignedge(aligntokens, hset, edgeLLs, *abcs[j], j, returnsenoneids, thisedgealignments[j]);
+                            }
+                        });
+        if (cpuverification)
         {
-            const edgeinfowithscores &e = edges[j];
-            const size_t ts = nodes[e.S].t;
-            const size_t te = nodes[e.E].t;
-            if (ts == te) // dummy !NULL edge at end
-                edgeacscores[j] = 0.0f;
-            else
-            {
-                const auto &aligntokens = getaligninfo(j); // get alignment tokens
-                const auto edgeLLs = msra::math::ssematrixstriperef<msra::math::ssematrixbase>(const_cast<msra::math::ssematrixbase &>(logLLs), ts, te - ts);
-                if (minlogpp > LOGZERO && origlogpps[j] < minlogpp)
-                    edgeacscores[j] = LOGZERO; // will kill word level forwardbackward hypothesis
-                else if (softalignstates)
-                    edgeacscores[j] = forwardbackwardedge(aligntokens, hset, edgeLLs, *abcs[j], j);
-                else
-                    edgeacscores[j] = alignedge(aligntokens, hset, edgeLLs, *abcs[j], j, returnsenoneids, thisedgealignments[j]);
-            }
-            if (cpuverification)
+            foreach_index (j, edges)
             {
+                const edgeinfowithscores &e = edges[j];
+                const size_t ts = nodes[e.S].t;
+                const size_t te = nodes[e.E].t;
                 const auto &aligntokens = getaligninfo(j); // get alignment tokens
                 bool edgehassil = false;
                 foreach_index (i, aligntokens)
@@ -1023,30 +1070,37 @@ void lattice::sMBRerrorsignal(parallelstate &parallelstate,
     }
 
     //  linear mode
-    foreach_coord (i, j, errorsignal)
-        errorsignal(i, j) = 0.0f; // Note: we don't actually put anything into the numgammas
-    foreach_index (j, edges)
-    {
-        const auto &e = edges[j];
-        if (nodes[e.S].t == nodes[e.E].t) // this happens for dummy !NULL edge at end of file
-            continue;
-        if (minlogpp > LOGZERO && origlogpps[j] < minlogpp) // this is pruned
-            continue;
-
-        size_t ts = nodes[e.S].t;
-        size_t te = nodes[e.E].t;
-
-        const double diff = logEframescorrect[j] - logEframescorrecttotal;
-        // Note: the contribution of the states of an edge to their senones is the same for all states
-        // so we compute it once and add it to all; this will not be the case without hard alignments.
-        const double pp = exp(logpps[j]); // edge posterior
-        const float edgecorrect = (float) (pp * diff) / amf;
-        for (size_t t = ts; t < te; t++)
-        {
-            const size_t s = thisedgealignments[j][t - ts];
-            errorsignal(s, t) += edgecorrect;
-        }
-    }
+    // Each thread owns a range of frames [tbegin, tend) and clips all edges to it.
+    parallelforframeranges(errorsignal.cols(), [&](size_t tbegin, size_t tend)
+                           {
+                               for (size_t t = tbegin; t < tend; t++)
+                                   foreach_row (i, errorsignal)
+                                       errorsignal(i, t) = 0.0f; // Note: we don't actually put anything into the numgammas
+                               foreach_index (j, edges)
+                               {
+                                   const auto &e = edges[j];
+                                   if (nodes[e.S].t == nodes[e.E].t) // this happens for dummy !NULL edge at end of file
+                                       continue;
+                                   if (minlogpp > LOGZERO && origlogpps[j] < minlogpp) // this is pruned
+                                       continue;
+
+                                   size_t ts = nodes[e.S].t;
+                                   size_t te = nodes[e.E].t;
+                                   if (te <= tbegin || ts >= tend) // not in our range
+                                       continue;
+
+                                   const double diff = logEframescorrect[j] - logEframescorrecttotal;
+                                   // Note: the contribution of the states of an edge to their senones is the same for all states
+                                   // so we compute it once and add it to all; this will not be the case without hard alignments.
+                                   const double pp = exp(logpps[j]); // edge posterior
+                                   const float edgecorrect = (float) (pp * diff) / amf;
+                                   for (size_t t = max(ts, tbegin); t < min(te, tend); t++)
+                                   {
+                                       const size_t s = thisedgealignments[j][t - ts];
+                                       errorsignal(s, t) += edgecorrect;
+                                   }
+                               }
+                           });
 }
 
 // compute the error signal for MMI mode
@@ -1065,79 +1119,104 @@ void lattice::mmierrorsignal(parallelstate &parallelstate, double minlogpp, cons
         return;
     }
 
-    for (size_t j = 0; j < (errorsignal).cols(); j++)
-        for (size_t i = 0; i < (errorsignal).rows(); i++)
-            errorsignal(i, j) = VIRGINLOGZERO; // set to zero  --note: may be in-place with logLLs, which now get overwritten
-
-    // size_t warnings = 0;   // [v-hansu] check code for mmi; search this comment to see all related codes
-    foreach_index (j, edges)
-    {
-        const auto &e = edges[j];
-        if (nodes[e.S].t == nodes[e.E].t) // this happens for dummy !NULL edge at end of file
-            continue;
-        if (minlogpp > LOGZERO && origlogpps[j] < minlogpp) // this is pruned
-            continue;
-
-        const auto &aligntokens = getaligninfo(j); // get alignment tokens
-        auto &loggammas = *abcs[j];
-
-        const float edgelogP = (float) logpps[j];
-        // if (islogzero (edgelogP))               // we had a 0 prob
-        //    continue;
-
-        // accumulate this edge's gamma matrix into target posteriors
-        const size_t tedge = nodes[e.S].t;
-        size_t ts = 0;                 // time index into gamma matrix
-        size_t js = 0;                 // state index into gamma matrix
-        foreach_index (k, aligntokens) // we exploit that units have fixed boundaries
-        {
-            const auto &unit = aligntokens[k];
-            const size_t te = ts + unit.frames;
-            const auto &hmm = hset.gethmm(unit.unit); // TODO: inline these expressions
-            const size_t n = hmm.getnumstates();
-            const size_t je = js + n;
-            // P(s) = P(s|e) * P(e)
-            for (size_t t = ts; t < te; t++)
-            {
-                const size_t tutt = t + tedge; // time index w.r.t. utterance
-                // double logsum = LOGZERO;         // [v-hansu] check code for mmi; search this comment to see all related codes
-                for (size_t i = 0; i < n; i++)
-                {
-                    const size_t j = js + i;             // state index for this unit in matrix
-                    const size_t s = hmm.getsenoneid(i); // state class index
-                    const float gammajt = loggammas(j, t);
-                    const float statelogP = edgelogP + gammajt;
-                    logadd(errorsignal(s, tutt), statelogP);
-                }
-            }
-            ts = te;
-            js = je;
-        }
-        assert(ts + 2 == loggammas.cols() && js == loggammas.rows());
-    }
+    // Each thread owns a range of frames [tbegin, tend) and clips all edges to it.
+    parallelforframeranges(errorsignal.cols(), [&](size_t tbegin, size_t tend)
+                           {
+                               for (size_t t = tbegin; t < tend; t++)
+                                   for (size_t i = 0; i < (errorsignal).rows(); i++)
+                                       errorsignal(i, t) = VIRGINLOGZERO; // set to zero  --note: may be in-place with logLLs, which now get overwritten
+
+                               // size_t warnings = 0;   // [v-hansu] check code for mmi; search this comment to see all related codes
+                               foreach_index (j, edges)
+                               {
+                                   const auto &e = edges[j];
+                                   if (nodes[e.S].t == nodes[e.E].t) // this happens for dummy !NULL edge at end of file
+                                       continue;
+                                   if (minlogpp > LOGZERO && origlogpps[j] < minlogpp) // this is pruned
+                                       continue;
+
+                                   // accumulate this edge's gamma matrix into target posteriors
+                                   const size_t tedge = nodes[e.S].t;
+                                   if (nodes[e.E].t <= tbegin || tedge >= tend) // not in our range
+                                       continue;
+
+                                   const auto &aligntokens = getaligninfo(j); // get alignment tokens
+                                   auto &loggammas = *abcs[j];
+
+                                   const float edgelogP = (float) logpps[j];
+                                   // if (islogzero (edgelogP))               // we had a 0 prob
+                                   //    continue;
+
+                                   size_t ts = 0;                 // time index into gamma matrix
+                                   size_t js = 0;                 // state index into gamma matrix
+                                   foreach_index (k, aligntokens) // we exploit that units have fixed boundaries
+                                   {
+                                       const auto &unit = aligntokens[k];
+                                       const size_t te = ts + unit.frames;
+                                       const auto &hmm = hset.gethmm(unit.unit); // TODO: inline these expressions
+                                       const size_t n = hmm.getnumstates();
+                                       const size_t je = js + n;
+                                       // P(s) = P(s|e) * P(e)
+                                       for (size_t t = ts; t < te; t++)
+                                       {
+                                           const size_t tutt = t + tedge; // time index w.r.t. utterance
+                                           if (tutt < tbegin || tutt >= tend)
+                                               continue;
+                                           // double logsum = LOGZERO;         // [v-hansu] check code for mmi; search this comment to see all related codes
+                                           for (size_t i = 0; i < n; i++)
+                                           {
+                                               const size_t j = js + i;             // state index for this unit in matrix
+                                               const size_t s = hmm.getsenoneid(i); // state class index
+                                               const float gammajt = loggammas(j, t);
+                                               const float statelogP = edgelogP + gammajt;
+                                               logadd(errorsignal(s, tutt), statelogP);
+                                           }
+                                       }
+                                       ts = te;
+                                       js = je;
+                                   }
+                                   assert(ts + 2 == loggammas.cols() && js == loggammas.rows());
+                               }
+                           });
 
     // check normalizedness (is that an actual English word?)
     // also count non-zero probs
+    std::vector<double> logsums(errorsignal.cols());
+    std::vector<size_t> nonzerostatesperframe(errorsignal.cols());
+    parallelforframeranges(errorsignal.cols(), [&](size_t tbegin, size_t tend)
+                           {
+                               for (size_t t = tbegin; t < tend; t++)
+                               {
+                                   double logsum = LOGZERO;
+                                   size_t nonzerostates = 0;
+                                   foreach_row (s, errorsignal)
+                                   {
+                                       if (islogzero(errorsignal(s, t)))
+                                           nonzerostates++;
+                                       else
+                                           logadd(logsum, (double) errorsignal(s, t));
+                                       // TODO: count VIRGINLOGZERO, print per frame
+                                   }
+                                   logsums[t] = logsum;
+                                   nonzerostatesperframe[t] = nonzerostates;
+                               }
+                           });
     size_t nonzerostates = 0;
     foreach_column (t, errorsignal)
     {
-        double logsum = LOGZERO;
-        foreach_row (s, errorsignal)
-        {
-            if (islogzero(errorsignal(s, t)))
-                nonzerostates++;
-            else
-                logadd(logsum, (double) errorsignal(s, t));
-            // TODO: count VIRGINLOGZERO, print per frame
-        }
-        if (fabs(logsum) / errorsignal.rows() > 1e-6)
-            fprintf(stderr, "forwardbackward: WARNING: overall posterior column(%d) sum = exp (%.10f) != 1\n", (int) t, logsum);
+        if (fabs(logsums[t]) / errorsignal.rows() > 1e-6)
+            fprintf(stderr, "forwardbackward: WARNING: overall posterior column(%d) sum = exp (%.10f) != 1\n", (int) t, logsums[t]);
+        nonzerostates += nonzerostatesperframe[t];
     }
     fprintf(stderr, "forwardbackward: %.3f%% non-zero state posteriors\n", 100.0f - nonzerostates * 100.0f / errorsignal.rows() / errorsignal.cols());
 
     // convert to non-log posterior  --that's what we return
-    foreach_coord (i, j, errorsignal)
-        errorsignal(i, j) = expf(errorsignal(i, j));
+    parallelforframeranges(errorsignal.cols(), [&](size_t tbegin, size_t tend)
+                           {
+                               for (size_t t = tbegin; t < tend; t++)
+                                   foreach_row (i, errorsignal)
+                                       errorsignal(i, t) = expf(errorsignal(i, t));
+                           });
 }
 
 // compute ground truth's score
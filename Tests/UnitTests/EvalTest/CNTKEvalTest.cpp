@@ -3,6 +3,7 @@
 
 #include "stdafx.h"
 #include "Eval.h"
+#include "EvalBatcher.h"
 #include "DataReader.h"
 #include "Config.h"
 using namespace Microsoft::MSR::CNTK;
@@ -61,6 +62,201 @@ void DoCommand(const ConfigParameters& configRoot)
     }
 }
 
+// run numRequests evaluations of numSamples random samples on each of numThreads threads, each with its own
+// IEvaluateContext of the same model, and print latency and throughput
+// With numThreads=0, the single-instance Evaluate() path is measured instead.
+template <typename ElemType>
+void RunEvalBenchmark(Eval<ElemType>& eval, const std::wstring& inputName, size_t inputDim, const std::wstring& outputName, size_t outputDim,
+                      size_t numThreads, size_t numRequests, size_t numSamples)
+{
+    typedef std::chrono::steady_clock Clock;
+    std::vector<std::vector<double>> latencies(std::max(numThreads, (size_t) 1));
+
+    auto runRequests = [&](size_t thread, std::function<void(const std::vector<ElemType>&, std::vector<ElemType>&)> evaluate)
+    {
+        std::vector<ElemType> input(inputDim * numSamples);
+        std::vector<ElemType> output(outputDim * numSamples);
+        for (size_t i = 0; i < input.size(); i++)
+            input[i] = (ElemType)((i * 7919 + thread * 104729) % 1000) / 1000;
+        evaluate(input, output); // warm up, e.g. first-time allocations
+        for (size_t r = 0; r < numRequests; r++)
+        {
+            auto start = Clock::now();
+            evaluate(input, output);
+            latencies[thread].push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        }
+    };
+
+    auto start = Clock::now();
+    if (numThreads == 0)
+    {
+        eval.StartEvaluateMinibatchLoop(outputName);
+        runRequests(0, [&](const std::vector<ElemType>& input, std::vector<ElemType>& output)
+                    {
+                        std::map<std::wstring, std::vector<ElemType>*> inputs{{inputName, const_cast<std::vector<ElemType>*>(&input)}};
+                        std::map<std::wstring, std::vector<ElemType>*> outputs{{outputName, &output}};
+                        eval.Evaluate(inputs, outputs);
+                    });
+    }
+    else
+    {
+        std::vector<IEvaluateContext<ElemType>*> contexts;
+        for (size_t t = 0; t < numThreads; t++)
+            contexts.push_back(eval.CreateContext({inputName}, {outputName}));
+        start = Clock::now();
+        std::vector<std::thread> threads;
+        for (size_t t = 0; t < numThreads; t++)
+        {
+            threads.push_back(std::thread([&, t]()
+                                          {
+                                              runRequests(t, [&](const std::vector<ElemType>& input, std::vector<ElemType>& output)
+                                                          {
+                                                              const ElemType* inputs[] = {input.data()};
+                                                              ElemType* outputs[] = {output.data()};
+                                                              contexts[t]->Evaluate(inputs, outputs, numSamples);
+                                                          });
+                                          }));
+        }
+        for (auto& thread : threads)
+            thread.join();
+        for (auto context : contexts)
+            context->Destroy();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<double> all;
+    for (const auto& l : latencies)
+        all.insert(all.end(), l.begin(), l.end());
+    std::sort(all.begin(), all.end());
+    fprintf(stderr, "%-22s threads = %2d, samples/request = %4d: latency p50 = %8.3f ms, p99 = %8.3f ms; throughput = %10.1f requests/s\n",
+            numThreads == 0 ? "Evaluate():" : "IEvaluateContext:", (int) numThreads, (int) numSamples,
+            all[all.size() / 2], all[std::min(all.size() - 1, all.size() * 99 / 100)], all.size() / seconds);
+}
+
+// run numRequests evaluations of numSamples random samples on each of numClients threads through one EvalBatcher,
+// and print throughput and the batcher's latency and batch size statistics
+template <typename ElemType>
+void RunBatcherBenchmark(Eval<ElemType>& eval, const std::wstring& inputName, size_t inputDim, const std::wstring& outputName, size_t outputDim,
+                         size_t numClients, size_t numRequests, size_t numSamples, const EvalBatcherOptions& options)
+{
+    typedef std::chrono::steady_clock Clock;
+    EvalBatcher<ElemType> batcher(eval, {inputName}, {outputName}, options);
+
+    auto start = Clock::now();
+    std::vector<std::thread> threads;
+    for (size_t c = 0; c < numClients; c++)
+    {
+        threads.push_back(std::thread([&, c]()
+                                      {
+                                          std::vector<ElemType> input(inputDim * numSamples);
+                                          std::vector<ElemType> output(outputDim * numSamples);
+                                          for (size_t i = 0; i < input.size(); i++)
+                                              input[i] = (ElemType)((i * 7919 + c * 104729) % 1000) / 1000;
+                                          const ElemType* inputs[] = {input.data()};
+                                          ElemType* outputs[] = {output.data()};
+                                          for (size_t r = 0; r < numRequests; r++)
+                                              batcher.Evaluate(inputs, outputs, numSamples);
+                                      }));
+    }
+    for (auto& thread : threads)
+        thread.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    fprintf(stderr, "%-22s clients = %2d, samples/request = %4d: throughput = %10.1f requests/s\n",
+            "EvalBatcher:", (int) numClients, (int) numSamples, numClients * numRequests / seconds);
+    batcher.PrintStatistics(stderr);
+}
+
+// benchmark the evaluation paths of a model
+// Also checks that a context produces the same outputs as Evaluate(), and that packing sequences of
+// different lengths into one minibatch does not change their outputs.
+template <typename ElemType>
+void DoEvalBenchmark(const ConfigParameters& configRoot)
+{
+    ConfigArray command = configRoot("command", "train");
+    ConfigParameters config = configRoot(command[0]);
+    std::wstring modelPath = config("modelPath");
+    std::wstring inputName = config("inputNodeName", L"features");
+    std::wstring outputName = config("outputNodeName");
+    size_t numRequests = config("numRequests", "1000");
+    intargvector numThreadsArr = ConfigArray(config("numThreads", "1:2:4:8"));
+    intargvector numSamplesArr = ConfigArray(config("samplesPerRequest", "1:16"));
+    intargvector numClientsArr = ConfigArray(config("numClients", "1:8:32"));
+    EvalBatcherOptions batcherOptions;
+    batcherOptions.maxBatchSamples = config("maxBatchSamples", "64");
+    batcherOptions.maxWaitMilliseconds = config("maxWaitMilliseconds", "2");
+    batcherOptions.numWorkers = config("batcherWorkers", "1");
+
+    Eval<ElemType> eval(config);
+    eval.LoadModel(modelPath);
+    std::map<std::wstring, size_t> dims{{inputName, 0}, {outputName, 0}};
+    eval.GetNodeDimensions(dims, nodeSpecified);
+
+    // check against the single-instance path
+    {
+        size_t numSamples = numSamplesArr[numSamplesArr.size() - 1];
+        std::vector<ElemType> input(dims[inputName] * numSamples);
+        for (size_t i = 0; i < input.size(); i++)
+            input[i] = (ElemType)(i % 101) / 101;
+        std::vector<ElemType> output(dims[outputName] * numSamples);
+        std::vector<ElemType> contextOutput(output.size());
+        std::map<std::wstring, std::vector<ElemType>*> inputs{{inputName, &input}};
+        std::map<std::wstring, std::vector<ElemType>*> outputs{{outputName, &output}};
+        eval.StartEvaluateMinibatchLoop(outputName);
+        eval.Evaluate(inputs, outputs);
+        IEvaluateContext<ElemType>* context = eval.CreateContext({inputName}, {outputName});
+        const ElemType* contextInputs[] = {input.data()};
+        ElemType* contextOutputs[] = {contextOutput.data()};
+        context->Evaluate(contextInputs, contextOutputs, numSamples);
+        context->Destroy();
+        double maxDiff = 0;
+        for (size_t i = 0; i < output.size(); i++)
+            maxDiff = std::max(maxDiff, (double) fabs(output[i] - contextOutput[i]));
+        fprintf(stderr, "max. difference between Evaluate() and IEvaluateContext outputs: %g\n", maxDiff);
+        if (maxDiff > 1e-5)
+            RuntimeError("IEvaluateContext output does not match Evaluate().");
+    }
+    {
+        std::vector<size_t> sequenceLengths{3, 1, 5, 2};
+        size_t numSamples = 0;
+        for (size_t length : sequenceLengths)
+            numSamples += length;
+        std::vector<ElemType> input(dims[inputName] * numSamples);
+        for (size_t i = 0; i < input.size(); i++)
+            input[i] = (ElemType)(i % 103) / 103;
+        std::vector<ElemType> output(dims[outputName] * numSamples);
+        std::vector<ElemType> packedOutput(output.size());
+        IEvaluateContext<ElemType>* context = eval.CreateContext({inputName}, {outputName});
+        size_t firstSample = 0;
+        for (size_t length : sequenceLengths)
+        {
+            const ElemType* inputs[] = {input.data() + dims[inputName] * firstSample};
+            ElemType* outputs[] = {output.data() + dims[outputName] * firstSample};
+            context->Evaluate(inputs, outputs, length);
+            firstSample += length;
+        }
+        const ElemType* packedInputs[] = {input.data()};
+        ElemType* packedOutputs[] = {packedOutput.data()};
+        context->EvaluateSequences(packedInputs, packedOutputs, sequenceLengths);
+        context->Destroy();
+        double maxDiff = 0;
+        for (size_t i = 0; i < output.size(); i++)
+            maxDiff = std::max(maxDiff, (double) fabs(output[i] - packedOutput[i]));
+        fprintf(stderr, "max. difference between separate and packed sequence outputs: %g\n", maxDiff);
+        if (maxDiff > 1e-5)
+            RuntimeError("IEvaluateContext::EvaluateSequences() output does not match Evaluate().");
+    }
+
+    for (size_t numSamples : numSamplesArr)
+    {
+        RunEvalBenchmark(eval, inputName, dims[inputName], outputName, dims[outputName], 0, numRequests, numSamples);
+        for (size_t numThreads : numThreadsArr)
+            RunEvalBenchmark(eval, inputName, dims[inputName], outputName, dims[outputName], numThreads, numRequests, numSamples);
+        for (size_t numClients : numClientsArr)
+            RunBatcherBenchmark(eval, inputName, dims[inputName], outputName, dims[outputName], numClients, numRequests, numSamples, batcherOptions);
+    }
+}
+
 int wmain(int argc, wchar_t* argv[])
 {
     try
@@ -85,7 +281,19 @@ int wmain(int argc, wchar_t* argv[])
         if (config.Exists("type"))
             type = config("type", "float");
         fprintf(stderr, "\nprecision = %s\n", type.c_str());
-        if (type == "float")
+        // action=benchmark in the command section: measure the evaluation paths of the model instead
+        ConfigParameters commandConfig = config(command[0]);
+        std::string action = commandConfig("action", "eval");
+        if (action == "benchmark")
+        {
+            if (type == "float")
+                DoEvalBenchmark<float>(config);
+            else if (type == "double")
+                DoEvalBenchmark<double>(config);
+            else
+                RuntimeError("invalid precision specified: %s", type.c_str());
+        }
+        else if (type == "float")
             DoCommand<float>(config);
         else if (type == "double")
             DoCommand<double>(config);
@@ -24,5 +24,7 @@
 #include <queue>
 #include <memory>
 #include <chrono>
+#include <thread>
+#include <functional>
 #include <algorithm>
 #include <iostream>
@@ -2,463 +2,686 @@
 // Copyright (c) Microsoft. All rights reserved.
 // Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
 //
-// MathPerformanceTests.cpp : Defines the entry point for the console application.
+// MathPerformanceTests.cpp : CPU micro-benchmarks of the math library and of small networks.
 //
+// Usage: mathperformancetests [-format csv|json] [-jsonFile <path>] [-filter <substring>] [-minTime <seconds>] [-precision float|double|both]
+//
+// Every benchmark is run once to warm up, and then repeatedly for at least minTime seconds.
+// It reports the time per iteration, and GFLOP/s and GB/s computed from the nominal number of
+// floating-point operations and the number of bytes that must at least be read and written.
+// The results go to stdout (progress messages to stderr), so that they can be compared across builds.
+// With -jsonFile, they are also written as JSON to that file, so that one run gives both formats.
+//
+
 #include "stdafx.h"
-#define NOMINMAX
-#include "Windows.h"
 #include <chrono>
-#include <iostream>
+#include <functional>
+#include <string>
 #include <vector>
+#include <cmath>
+#include "Basics.h"
 #include "Matrix.h"
 #include "CPUMatrix.h"
-#include "Sequences.h"
-using namespace Microsoft::MSR::CNTK;
+#include "CPUSparseMatrix.h"
+#include "TensorView.h"
+#include "ConvolutionEngine.h"
+#include "ComputationNetwork.h"
+#include "ComputationNetworkBuilder.h"
+#include "MPIWrapper.h"
+
+// globals that the network library expects the executable to define (cf. CNTK.cpp)
+Microsoft::MSR::CNTK::MPIWrapper* g_mpi = nullptr;
+bool g_shareNodeValueMatrices = false;
+size_t g_parallelTraversalThreads = 0;
+bool g_fuseElementwiseNodes = false;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
 using namespace std;
 
-template <class ElemType>
-void SetToInitStateValueForResetSeg(const Matrix<ElemType>& sentenceBegin,
-                                    size_t nStream, ElemType initStateValue, Matrix<ElemType>& newprevstate)
-{
-    Matrix<ElemType> colSeg(sentenceBegin.GetDeviceId());
-    colSeg.Resize(nStream, nStream);
-    size_t nStateRow = newprevstate.GetNumRows();
-
-    assert(nStream == sentenceBegin.GetNumRows());
-
-    // only set state to init state value for segmentation = 0, and -1
-    // e.g., -1 0 1 -> 0 0 1 -> 0 0 -1 -> 1 1 0
-
-    Matrix<ElemType> colPos(sentenceBegin.GetDeviceId());
-    colPos.SetValue(sentenceBegin);                                                     // -1 0 1
-    colPos.InplaceTruncateBottom(1 << 0 /*(int)MinibatchPackingFlags::SequenceStart*/); // TODO: these flags no longer exist, this test probably no longer applies
-    Matrix<ElemType>::Scale((ElemType) -1.0, colPos);
-    colPos += 0; // (int)MinibatchPackingFlags::None; // TODO: these flags no longer exist, this test probably no longer applies
-    colSeg.SetDiagonalValue(colPos);
-    Matrix<ElemType> ones(sentenceBegin.GetDeviceId());
-    ones.Resize(nStateRow, nStream);
-    ones.SetValue((ElemType) 1);
-    // add default state value if it is for reset
-    Matrix<ElemType>::MultiplyAndWeightedAdd(initStateValue, ones, false, colSeg, false, 1.0, newprevstate); // += [0 initStateValue 0 ]
-}
+// -----------------------------------------------------------------------
+// BenchmarkRunner -- times benchmarks and collects their results
+// -----------------------------------------------------------------------
 
-template <class ElemType>
-void rnnForwardPropSRP(Matrix<ElemType>& functionValues, size_t mNbr, Matrix<ElemType>& pastActivity, Matrix<ElemType>& inputFunctionValues, Matrix<ElemType>& colBegin, const Matrix<ElemType>& needToCompute)
+class BenchmarkRunner
 {
-    size_t ncol = functionValues.GetNumCols();
-    size_t ntime = ncol / mNbr;
-    Matrix<ElemType> out = functionValues.ColumnSlice(0, mNbr);
-    Matrix<ElemType> inp((DEVICEID_TYPE) functionValues.GetDeviceId());
+public:
+    BenchmarkRunner(const string& filter, double minTime)
+        : m_filter(filter), m_minTime(minTime)
+    {
+    }
 
-    for (size_t d = 0; d < ntime; d++)
+    // time 'run', which performs 'flops' floating-point operations and moves at least 'bytes' bytes per call
+    void Run(const string& category, const string& name, const string& precision, const string& shape, double flops, double bytes, const function<void()>& run)
     {
-        if (d == 0)
-            inp = pastActivity.ColumnSlice(d, mNbr);
-        else
-            inp = inputFunctionValues.ColumnSlice(d, mNbr);
+        string fullName = category + "/" + name + "/" + precision + "/" + shape;
+        if (!m_filter.empty() && fullName.find(m_filter) == string::npos)
+            return;
+
+        fprintf(stderr, "running %s\n", fullName.c_str());
+        run(); // warm-up
+
+        typedef chrono::steady_clock Clock;
+        size_t iterations = 0;
+        auto start = Clock::now();
+        double elapsed = 0;
+        do
+        {
+            run();
+            iterations++;
+            elapsed = chrono::duration<double>(Clock::now() - start).count();
+        } while (elapsed < m_minTime || iterations < 3);
 
-        if (needToCompute.ColumnSlice(d, 1).Get00Element() == 1)
+        Result result = {category, name, precision, shape, iterations, elapsed / iterations, flops, bytes};
+        m_results.push_back(result);
+    }
+
+    void PrintCSV(FILE* f) const
+    {
+        fprintf(f, "category,name,precision,shape,iterations,msPerIteration,GFLOPs,GBs\n");
+        for (const auto& r : m_results)
+            fprintf(f, "%s,%s,%s,%s,%d,%.6f,%.3f,%.3f\n", r.category.c_str(), r.name.c_str(), r.precision.c_str(), r.shape.c_str(),
+                    (int) r.iterations, r.seconds * 1e3, r.GFlopsPerSecond(), r.GBytesPerSecond());
+    }
+
+    void PrintJSON(FILE* f) const
+    {
+        fprintf(f, "[\n");
+        for (size_t i = 0; i < m_results.size(); i++)
         {
-            Matrix<ElemType> colSegPastActivity((DEVICEID_TYPE) functionValues.GetDeviceId());
-            Matrix<ElemType> colSeg((DEVICEID_TYPE) functionValues.GetDeviceId());
-            colSeg.Resize(mNbr, mNbr);
-            colSeg.SetValue(0);
-            colSegPastActivity.SetValue(colBegin);
-            colSegPastActivity.InplaceTruncateBottom(1 << 0 /*(int)MinibatchPackingFlags::SequenceStart*/); // TODO: these flags no longer exist, this test probably no longer applies
-            colSeg.SetDiagonalValue(colSegPastActivity);
-            Matrix<ElemType>::Multiply(inp, false, colSeg, false, out);
-            ElemType initStateValue = (ElemType) 0.1;
-            SetToInitStateValueForResetSeg<ElemType>(colBegin, mNbr, initStateValue, out);
+            const auto& r = m_results[i];
+            fprintf(f, "  {\"category\": \"%s\", \"name\": \"%s\", \"precision\": \"%s\", \"shape\": \"%s\", \"iterations\": %d, \"msPerIteration\": %.6f, \"GFLOPs\": %.3f, \"GBs\": %.3f}%s\n",
+                    r.category.c_str(), r.name.c_str(), r.precision.c_str(), r.shape.c_str(),
+                    (int) r.iterations, r.seconds * 1e3, r.GFlopsPerSecond(), r.GBytesPerSecond(), i + 1 < m_results.size() ? "," : "");
         }
+        fprintf(f, "]\n");
     }
-}
 
-template <class ElemType>
-void oldRnnForwardPropSRP(Matrix<ElemType>& functionValues, size_t mNbr, Matrix<ElemType>& pastActivity, Matrix<ElemType>& inputFunctionValues)
-{
-    size_t ncol = functionValues.GetNumCols();
-    size_t ntime = ncol / mNbr;
-    for (size_t timeIdxInSeq = 0; timeIdxInSeq < ntime; timeIdxInSeq++)
+private:
+    struct Result
     {
-        for (size_t i = 0; i < mNbr; i++)
+        string category;
+        string name;
+        string precision;
+        string shape;
+        size_t iterations;
+        double seconds; // per iteration
+        double flops;   // per iteration
+        double bytes;   // per iteration
+
+        double GFlopsPerSecond() const
         {
-            bool reset = false;
-
-            if (timeIdxInSeq == 0)
-            {
-                reset = true;
-            }
-            oldRNNForwardPropSRP<ElemType>(timeIdxInSeq, 1, reset, (ElemType) 0.1, functionValues, pastActivity, inputFunctionValues, i, mNbr);
+            return flops / seconds * 1e-9;
         }
-    }
-}
+        double GBytesPerSecond() const
+        {
+            return bytes / seconds * 1e-9;
+        }
+    };
+
+    string m_filter;
+    double m_minTime;
+    vector<Result> m_results;
+};
 
 template <class ElemType>
-void oldRNNForwardPropSRP(const size_t timeIdxInSeq, const int delay, const bool reset, const ElemType default_activity, Matrix<ElemType>& functionValues, const Matrix<ElemType>& pastActivity, const Matrix<ElemType>& inputFunctionValues, const size_t indexInBatch, const size_t mNbr)
+static const char* PrecisionName()
 {
-    assert(delay > 0);
-
-    if (functionValues.GetNumRows() != inputFunctionValues.GetNumRows() ||
-        functionValues.GetNumCols() != inputFunctionValues.GetNumCols())
-        functionValues.Resize(inputFunctionValues.GetNumRows(),
-                              inputFunctionValues.GetNumCols());
-
-    int iPastIndex = (int) ((int) timeIdxInSeq - (int) delay) * (int) mNbr;
-    int d = iPastIndex;
-    if (d < 0)
-        d = (int) functionValues.Mod((float) iPastIndex, (float) pastActivity.GetNumCols());
-    // this can point to the past activity of the previous mninibatch
+    return sizeof(ElemType) == sizeof(float) ? "float" : "double";
+}
 
-    Matrix<ElemType> out = functionValues.ColumnSlice(timeIdxInSeq * mNbr + indexInBatch, 1);
-    Matrix<ElemType> inp((DEVICEID_TYPE) functionValues.GetDeviceId());
+// -----------------------------------------------------------------------
+// dense GEMM, in shapes of the forward and backward passes of typical layers
+// -----------------------------------------------------------------------
 
-    if (reset)
-        out.SetValue(default_activity);
-    else
+template <class ElemType>
+void BenchmarkGEMM(BenchmarkRunner& runner)
+{
+    struct Shape
     {
-        if (iPastIndex < 0)
-            inp = pastActivity.ColumnSlice(d + indexInBatch, 1);
-        else
-            inp = inputFunctionValues.ColumnSlice(d + indexInBatch, 1);
-        out.SetValue(inp);
+        const char* layer;
+        size_t m, n, k;
+        bool transposeA, transposeB;
+    };
+    const Shape shapes[] =
+    {
+        // W * X, W' * dY, dY * X' of a 784-512 layer at minibatch 256
+        {"dnn-784x512-forward", 512, 256, 784, false, false},
+        {"dnn-784x512-backwardData", 784, 256, 512, true, false},
+        {"dnn-784x512-backwardWeight", 512, 784, 256, false, true},
+        // 2048-2048 hidden layer at minibatch 256
+        {"dnn-2048x2048-forward", 2048, 256, 2048, false, false},
+        {"dnn-2048x2048-backwardWeight", 2048, 2048, 256, false, true},
+        // LSTM with 1024 cells: all four gates of 80 parallel sequences at once
+        {"lstm-1024-gates", 4096, 80, 1024, false, false},
+        // 10000-class output layer at minibatch 128
+        {"output-512x10000-forward", 10000, 128, 512, false, false},
+        // matrix-vector product
+        {"gemv-4096x4096", 4096, 1, 4096, false, false},
+    };
+
+    for (const auto& s : shapes)
+    {
+        CPUMatrix<ElemType> a(s.transposeA ? s.k : s.m, s.transposeA ? s.m : s.k);
+        CPUMatrix<ElemType> b(s.transposeB ? s.n : s.k, s.transposeB ? s.k : s.n);
+        CPUMatrix<ElemType> c(s.m, s.n);
+        a.SetUniformRandomValue(-1, 1, 1);
+        b.SetUniformRandomValue(-1, 1, 2);
+
+        string shape = msra::strfun::strprintf("%dx%dx%d%s%s", (int) s.m, (int) s.n, (int) s.k, s.transposeA ? "-TA" : "", s.transposeB ? "-TB" : "");
+        double flops = 2.0 * s.m * s.n * s.k;
+        double bytes = (double) sizeof(ElemType) * (s.m * s.k + s.k * s.n + s.m * s.n);
+        runner.Run("CPUMatrix", string("GEMM-") + s.layer, PrecisionName<ElemType>(), shape, flops, bytes, [&]
+                   {
+                       CPUMatrix<ElemType>::MultiplyAndWeightedAdd(1, a, s.transposeA, b, s.transposeB, 0, c);
+                   });
     }
 }
 
-/**
-The new way of resetting RNN state. 
-*/
-template <class ElemType>
-void TestRnnForwardPropSRP(size_t nRow = 100, size_t nCol = 1000, size_t mNbr = 10, DEVICEID_TYPE deviceID = 0)
-{
-    Matrix<ElemType> functionValues(deviceID);
-    Matrix<ElemType> colBegin(deviceID);
-    Matrix<ElemType> pastActivity(deviceID);
-    Matrix<ElemType> inputFunctionValues(deviceID);
-    Matrix<ElemType> needToCompute(deviceID);
-
-    functionValues.Resize(nRow, nCol);
-    colBegin.Resize(mNbr, 1);
-    pastActivity.Resize(nRow, nCol);
-    inputFunctionValues.Resize(nRow, nCol);
-    needToCompute.Resize(1, nCol / mNbr);
-    needToCompute.SetValue(0);
-    needToCompute.ColumnSlice(0, 1).SetValue(1);
-    auto t_start = clock();
-    rnnForwardPropSRP<ElemType>(functionValues, mNbr, pastActivity, inputFunctionValues, colBegin, needToCompute);
-    auto t_end = clock();
-    std::cout << "testRnnForwardPropSRP: " << 1.0 * (t_end - t_start) / CLOCKS_PER_SEC << " seconds" << endl;
-}
+// -----------------------------------------------------------------------
+// TensorOp: elementwise unary and binary ops, broadcasting, and reductions
+// -----------------------------------------------------------------------
 
-/**
-The old way of resetting RNN state, which used if statement. Also only supports up to two sentences within a minibatch
-*/
 template <class ElemType>
-void TestOldRnnForwardPropSRP(size_t nRow = 100, size_t nCol = 1000, size_t mNbr = 10, DEVICEID_TYPE deviceID = 0)
+void BenchmarkTensorOps(BenchmarkRunner& runner)
 {
-    Matrix<ElemType> functionValues(deviceID);
-    Matrix<ElemType> colBegin(deviceID);
-    Matrix<ElemType> pastActivity(deviceID);
-    Matrix<ElemType> inputFunctionValues(deviceID);
-
-    functionValues.Resize(nRow, nCol);
-    colBegin.Resize(mNbr, 1);
-    pastActivity.Resize(nRow, nCol);
-    inputFunctionValues.Resize(nRow, nCol);
-    auto t_start = clock();
-    oldRnnForwardPropSRP<ElemType>(functionValues, mNbr, pastActivity, inputFunctionValues);
-    auto t_end = clock();
-    std::cout << "TestOldRnnForwardPropSRP: " << 1.0 * (t_end - t_start) / CLOCKS_PER_SEC << " seconds" << endl;
+    const size_t rows = 1024;
+    const size_t cols = 1024;
+    const double n = (double) rows * cols;
+    const string shape = msra::strfun::strprintf("%dx%d", (int) rows, (int) cols);
+
+    Matrix<ElemType> aMatrix(rows, cols, CPUDEVICE);
+    Matrix<ElemType> bMatrix(rows, cols, CPUDEVICE);
+    Matrix<ElemType> cMatrix(rows, cols, CPUDEVICE);
+    Matrix<ElemType> biasMatrix(rows, 1, CPUDEVICE);
+    Matrix<ElemType> scalarMatrix(1, 1, CPUDEVICE);
+    aMatrix.SetUniformRandomValue((ElemType) 0.1, 1, 1); // (positive for Log and Sqrt)
+    bMatrix.SetUniformRandomValue((ElemType) 0.1, 1, 2);
+    biasMatrix.SetUniformRandomValue(-1, 1, 3);
+
+    TensorView<ElemType> a(aMatrix), b(bMatrix), c(cMatrix), bias(biasMatrix), scalar(scalarMatrix);
+
+    const size_t elemSize = sizeof(ElemType);
+    auto runUnary = [&](const char* name, ElementWiseOperator op)
+    {
+        runner.Run("TensorOp", string("unary-") + name, PrecisionName<ElemType>(), shape, n, 2 * n * elemSize, [&]
+                   {
+                       c.DoUnaryOpOf(0, a, 1, op);
+                   });
+    };
+    runUnary("Copy", ElementWiseOperator::opCopy);
+    runUnary("Negate", ElementWiseOperator::opNegate);
+    runUnary("Sigmoid", ElementWiseOperator::opSigmoid);
+    runUnary("Tanh", ElementWiseOperator::opTanh);
+    runUnary("Exp", ElementWiseOperator::opExp);
+    runUnary("Log", ElementWiseOperator::opLog);
+    runUnary("LinearRectifier", ElementWiseOperator::opLinearRectifier);
+
+    auto runBinary = [&](const char* name, ElementWiseOperator op)
+    {
+        runner.Run("TensorOp", string("binary-") + name, PrecisionName<ElemType>(), shape, n, 3 * n * elemSize, [&]
+                   {
+                       c.DoBinaryOpOf(0, a, b, 1, op);
+                   });
+    };
+    runBinary("Sum", ElementWiseOperator::opSum);
+    runBinary("Difference", ElementWiseOperator::opDifference);
+    runBinary("ElementwiseProduct", ElementWiseOperator::opElementwiseProduct);
+    runBinary("Max", ElementWiseOperator::opMax);
+    runBinary("ElementwiseProductWithSigmoidDerivativeFromOutput", ElementWiseOperator::opElementwiseProductWithSigmoidDerivativeFromOutput);
+
+    // bias add: [rows x cols] + [rows x 1]
+    runner.Run("TensorOp", "broadcast-SumBias", PrecisionName<ElemType>(), shape, n, 2 * n * elemSize, [&]
+               {
+                   c.DoBinaryOpOf(0, a, bias, 1, ElementWiseOperator::opSum);
+               });
+
+    // reductions: over the columns (bias gradient), and over all elements
+    runner.Run("TensorOp", "reduce-SumColumns", PrecisionName<ElemType>(), shape, n, n * elemSize, [&]
+               {
+                   bias.DoUnaryOpOf(0, a, 1, ElementWiseOperator::opCopy);
+               });
+    runner.Run("TensorOp", "reduce-SumAll", PrecisionName<ElemType>(), shape, n, n * elemSize, [&]
+               {
+                   scalar.DoUnaryOpOf(0, a, 1, ElementWiseOperator::opCopy);
+               });
 }
 
+// -----------------------------------------------------------------------
+// dense x sparse products, as for one-hot or bag-of-words inputs
+// -----------------------------------------------------------------------
+
 template <class ElemType>
-void randomInitializeCPUMatrix(CPUMatrix<ElemType>& M, float min = -10, float max = 10)
+void BenchmarkSparse(BenchmarkRunner& runner)
 {
-    foreach_coord (i, j, M)
+    const size_t hidden = 512;
+    const size_t vocab = 50000;
+    const size_t mbSize = 256;
+
+    for (size_t nzPerColumn : {1, 20})
     {
-        M(i, j) = (1.0 * rand() / RAND_MAX) * max + min;
+        // random CSC matrix [vocab x mbSize]
+        vector<CPUSPARSE_INDEX_TYPE> colStart(mbSize + 1);
+        vector<CPUSPARSE_INDEX_TYPE> rowIndex(mbSize * nzPerColumn);
+        vector<ElemType> values(mbSize * nzPerColumn, 1);
+        for (size_t j = 0; j < mbSize; j++)
+        {
+            colStart[j] = (CPUSPARSE_INDEX_TYPE)(j * nzPerColumn);
+            for (size_t i = 0; i < nzPerColumn; i++)
+                rowIndex[j * nzPerColumn + i] = (CPUSPARSE_INDEX_TYPE)(((j * 7919 + i * 104729) % (vocab / nzPerColumn)) + i * (vocab / nzPerColumn)); // ascending within the column
+        }
+        colStart[mbSize] = (CPUSPARSE_INDEX_TYPE)(mbSize * nzPerColumn);
+
+        CPUSparseMatrix<ElemType> sparse(MatrixFormat::matrixFormatSparseCSC);
+        sparse.SetMatrixFromCSCFormat(colStart.data(), rowIndex.data(), values.data(), values.size(), vocab, mbSize);
+
+        CPUMatrix<ElemType> weights(hidden, vocab);
+        weights.SetUniformRandomValue(-1, 1, 1);
+        CPUMatrix<ElemType> out(hidden, mbSize);
+        CPUMatrix<ElemType> outGradient(hidden, mbSize);
+        outGradient.SetUniformRandomValue(-1, 1, 2);
+        CPUMatrix<ElemType> weightsGradient(hidden, vocab);
+        weightsGradient.SetValue(0);
+
+        const double nz = (double) values.size();
+        const string shape = msra::strfun::strprintf("%dx%dx%d-nz%d", (int) hidden, (int) mbSize, (int) vocab, (int) nzPerColumn);
+        runner.Run("CPUSparseMatrix", "MultiplyAndWeightedAdd-forward", PrecisionName<ElemType>(), shape,
+                   2 * hidden * nz, sizeof(ElemType) * (hidden * nz + hidden * mbSize) + (sizeof(ElemType) + sizeof(CPUSPARSE_INDEX_TYPE)) * nz, [&]
+                   {
+                       CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(1, weights, false, sparse, false, 0, out);
+                   });
+        runner.Run("CPUSparseMatrix", "MultiplyAndWeightedAdd-backwardWeight", PrecisionName<ElemType>(), shape,
+                   2 * hidden * nz, sizeof(ElemType) * (2 * hidden * nz + hidden * mbSize) + (sizeof(ElemType) + sizeof(CPUSPARSE_INDEX_TYPE)) * nz, [&]
+                   {
+                       CPUSparseMatrix<ElemType>::MultiplyAndWeightedAdd(1, outGradient, false, sparse, true, 1, weightsGradient);
+                   });
     }
 }
 
+// -----------------------------------------------------------------------
+// one-hot word input of a language model, as delivered by LMSequenceReader
+// with and without sparseInput: filling the input, W * X, and the gradient dY * X'
+// -----------------------------------------------------------------------
+
 template <class ElemType>
-void randomInitializeMatrix(Matrix<ElemType>& M, float min = -10, float max = 10)
+void BenchmarkOneHotInput(BenchmarkRunner& runner)
 {
-    foreach_coord (i, j, M)
+    struct Shape
+    {
+        const char* setup;
+        size_t vocab, hidden, mbSize;
+    };
+    const Shape shapes[] =
+    {
+        {"rnnlm", 10000, 200, 10},                // Tests/EndToEndTests/LM/RNNLM: layerSizes 10000:200:10000, minibatchSize 10
+        {"lm-100k-128streams", 100000, 200, 128}, // large vocabulary, 128 parallel sequences
+    };
+
+    for (const auto& s : shapes)
     {
-        M(i, j) = (1.0 * rand() / RAND_MAX) * max + min;
+        vector<size_t> words(s.mbSize);
+        for (size_t j = 0; j < s.mbSize; j++)
+            words[j] = (j * 7919) % s.vocab;
+
+        Matrix<ElemType> weights(s.hidden, s.vocab, CPUDEVICE);
+        weights.SetUniformRandomValue(-1, 1, 1);
+        Matrix<ElemType> out(s.hidden, s.mbSize, CPUDEVICE);
+        Matrix<ElemType> outGradient(s.hidden, s.mbSize, CPUDEVICE);
+        outGradient.SetUniformRandomValue(-1, 1, 2);
+
+        const string shape = msra::strfun::strprintf("%s-%dx%dx%d", s.setup, (int) s.hidden, (int) s.mbSize, (int) s.vocab);
+        const double elemSize = sizeof(ElemType);
+
+        // dense: what the readers did so far
+        Matrix<ElemType> denseInput(CPUDEVICE);
+        Matrix<ElemType> denseGradient(s.hidden, s.vocab, CPUDEVICE);
+        denseGradient.SetValue(0);
+        runner.Run("OneHotInput", "dense", PrecisionName<ElemType>(), shape,
+                   4.0 * s.hidden * s.vocab * s.mbSize, elemSize * (s.vocab * s.mbSize + 3 * s.hidden * s.vocab), [&]
+                   {
+                       denseInput.Resize(s.vocab, s.mbSize);
+                       denseInput.SetValue(0);
+                       for (size_t j = 0; j < s.mbSize; j++)
+                           denseInput.SetValue(words[j], j, 1);
+                       Matrix<ElemType>::Multiply(weights, false, denseInput, false, out);
+                       Matrix<ElemType>::MultiplyAndAdd(outGradient, false, denseInput, true, denseGradient);
+                   });
+
+        // sparse: CSC input, and a block-column gradient that holds only the columns of the words seen
+        vector<CPUSPARSE_INDEX_TYPE> colStarts(s.mbSize + 1);
+        vector<CPUSPARSE_INDEX_TYPE> rows(s.mbSize);
+        vector<ElemType> values(s.mbSize, 1);
+        Matrix<ElemType> sparseInput(CPUDEVICE);
+        sparseInput.SwitchToMatrixType(MatrixType::SPARSE, matrixFormatSparseCSC, false);
+        Matrix<ElemType> sparseGradient(CPUDEVICE);
+        sparseGradient.SwitchToMatrixType(MatrixType::SPARSE, matrixFormatSparseBlockCol, false);
+        runner.Run("OneHotInput", "sparse", PrecisionName<ElemType>(), shape,
+                   4.0 * s.hidden * s.mbSize, elemSize * (3 * s.hidden * s.mbSize) + (elemSize + 2 * sizeof(CPUSPARSE_INDEX_TYPE)) * s.mbSize, [&]
+                   {
+                       for (size_t j = 0; j < s.mbSize; j++)
+                       {
+                           colStarts[j] = (CPUSPARSE_INDEX_TYPE) j;
+                           rows[j] = (CPUSPARSE_INDEX_TYPE) words[j];
+                       }
+                       colStarts[s.mbSize] = (CPUSPARSE_INDEX_TYPE) s.mbSize;
+                       sparseInput.SetMatrixFromCSCFormat(colStarts.data(), rows.data(), values.data(), s.mbSize, s.vocab, s.mbSize);
+                       Matrix<ElemType>::Multiply(weights, false, sparseInput, false, out);
+                       Matrix<ElemType>::MultiplyAndAdd(outGradient, false, sparseInput, true, sparseGradient);
+                   });
     }
 }
 
-template <class ElemType>
-void MultiplyAndWeightedAddTest(int n, int k, int m)
-{
-    cout << "Testing CPUMatrix" << endl;
-    cout << "A(" << n << "x" << k << ") and B(" << k << "," << m << ")" << endl;
-    CPUMatrix<ElemType> A(n, k);
-    randomInitializeCPUMatrix<ElemType>(A);
-    CPUMatrix<ElemType> B(k, m);
-    randomInitializeCPUMatrix<ElemType>(B);
-    CPUMatrix<ElemType> C(n, m);
-    auto t_start = clock();
-    CPUMatrix<ElemType>::MultiplyAndWeightedAdd(0.324, A, false, B, false, 0.632, C);
-    auto t_end = clock();
-    std::cout << "CPU Matrix in: " << 1.0 * (t_end - t_start) / CLOCKS_PER_SEC << " seconds" << endl;
-    std::cout << n << " " << k << " " << m << endl;
-
-    cout << "Testing Matrix" << endl;
-    Matrix<ElemType> AG((size_t) n, (size_t) k);
-    randomInitializeMatrix<ElemType>(AG);
-    Matrix<ElemType> BG((size_t) k, (size_t) m);
-    randomInitializeMatrix<ElemType>(BG);
-    Matrix<ElemType> CG((size_t) n, (size_t) m);
-    auto t_startG = clock();
-    Matrix<ElemType>::MultiplyAndWeightedAdd(0.324, AG, false, BG, false, 0.632, CG);
-    auto t_endG = clock();
-    std::cout << "Matrix in: " << 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC << " seconds" << endl;
-}
+// -----------------------------------------------------------------------
+// convolution and pooling engines (legacy CPU engine, HWC layout)
+// -----------------------------------------------------------------------
 
 template <class ElemType>
-void AddMultiplyAndInplaceSigmoidTest(int n, int k, int m)
+void BenchmarkConvolution(BenchmarkRunner& runner)
 {
-    cout << "Testing CPUMatrix" << endl;
-    cout << "A(" << n << "x" << k << ") and B(" << k << "," << m << ")" << endl;
-    CPUMatrix<ElemType> A(n, k);
-    randomInitializeCPUMatrix<ElemType>(A);
-    CPUMatrix<ElemType> B(k, m);
-    randomInitializeCPUMatrix<ElemType>(B);
-    CPUMatrix<ElemType> D(n, m);
-    randomInitializeCPUMatrix<ElemType>(D);
-    CPUMatrix<ElemType> C(n, m);
-    auto t_start = clock();
-    C = A * B + D;
-    // C.InplaceSigmoid();
-    auto t_end = clock();
-    std::cout << "CPU Matrix in: " << 1.0 * (t_end - t_start) / CLOCKS_PER_SEC << " seconds" << endl;
-    std::cout << n << " " << k << " " << m << endl;
-
-    cout << "Testing Matrix" << endl;
-    Matrix<ElemType> AG((size_t) n, (size_t) k);
-    randomInitializeMatrix<ElemType>(AG);
-    Matrix<ElemType> BG((size_t) k, (size_t) m);
-    randomInitializeMatrix<ElemType>(BG);
-    Matrix<ElemType> DG((size_t) n, (size_t) m);
-    randomInitializeMatrix<ElemType>(DG);
-    Matrix<ElemType> CG((size_t) n, (size_t) m);
-    auto t_startG = clock();
-    CG = AG * BG + DG;
-    // CG.InplaceSigmoid();
-    auto t_endG = clock();
-    std::cout << "Matrix in: " << 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC << " seconds" << endl;
-}
+    using ConvFact = ConvolutionEngineFactory<ElemType>;
+    auto fact = ConvFact::Create(CPUDEVICE, ConvFact::EngineType::Legacy, ImageLayoutKind::HWC);
+    auto convEngine = fact->CreateConvEngine(CPUDEVICE, 0);
+    auto poolEngine = fact->CreatePoolEngine(CPUDEVICE);
 
-template <class ElemType>
-void ColumnSliceMultAndAddTest(int n, int k, int m, DEVICEID_TYPE deviceID)
-{
-    cout << "Testing Matrix" << endl;
-
-    Matrix<ElemType> AG((size_t) n, (size_t) k, deviceID);
-    AG.SetUniformRandomValue(-1, 1);
+    struct Shape
+    {
+        const char* layer;
+        size_t w, h, c, k, kW, kH, stride, n;
+    };
+    const Shape shapes[] =
+    {
+        {"lenet-conv1", 28, 28, 1, 32, 5, 5, 1, 64},
+        {"cifar-conv", 32, 32, 64, 64, 3, 3, 1, 32},
+        {"resnet-conv-stride2", 56, 56, 64, 128, 3, 3, 2, 16},
+    };
 
-    Matrix<ElemType> BG((size_t) k, (size_t) m, deviceID);
-    BG.SetUniformRandomValue(-1, 1);
+    for (const auto& s : shapes)
+    {
+        size_t outW = (s.w - s.kW) / s.stride + 1;
+        size_t outH = (s.h - s.kH) / s.stride + 1;
+        auto inT = fact->CreateTensor(s.w, s.h, s.c, s.n);
+        auto filterT = fact->CreateFilter(s.kW, s.kH, s.c, s.k);
+        auto outT = fact->CreateTensor(outW, outH, s.k, s.n);
+        auto convT = fact->CreateConvDescriptor(*inT, *filterT, s.stride, s.stride, false);
+
+        Matrix<ElemType> in(s.w * s.h * s.c, s.n, CPUDEVICE);
+        Matrix<ElemType> filter(s.k, s.kW * s.kH * s.c, CPUDEVICE);
+        Matrix<ElemType> out(outW * outH * s.k, s.n, CPUDEVICE);
+        Matrix<ElemType> outGradient(outW * outH * s.k, s.n, CPUDEVICE);
+        Matrix<ElemType> inGradient(s.w * s.h * s.c, s.n, CPUDEVICE);
+        Matrix<ElemType> filterGradient(s.k, s.kW * s.kH * s.c, CPUDEVICE);
+        Matrix<ElemType> workspace(CPUDEVICE);
+        in.SetUniformRandomValue(-1, 1, 1);
+        filter.SetUniformRandomValue(-1, 1, 2);
+        outGradient.SetUniformRandomValue(-1, 1, 3);
+        inGradient.SetValue(0);
+        filterGradient.SetValue(0);
+
+        const string shape = msra::strfun::strprintf("%dx%dx%d-k%d-%dx%d-s%d-n%d", (int) s.w, (int) s.h, (int) s.c, (int) s.k, (int) s.kW, (int) s.kH, (int) s.stride, (int) s.n);
+        const double flops = 2.0 * outW * outH * s.k * s.kW * s.kH * s.c * s.n;
+        const double bytes = (double) sizeof(ElemType) * (in.GetNumElements() + filter.GetNumElements() + out.GetNumElements());
+        runner.Run("ConvolutionEngine", string(s.layer) + "-Forward", PrecisionName<ElemType>(), shape, flops, bytes, [&]
+                   {
+                       convEngine->Forward(*inT, in, *filterT, filter, *convT, *outT, out, workspace);
+                   });
+        runner.Run("ConvolutionEngine", string(s.layer) + "-BackwardData", PrecisionName<ElemType>(), shape, flops, bytes, [&]
+                   {
+                       convEngine->BackwardData(*outT, outGradient, *filterT, filter, *convT, *inT, inGradient, workspace);
+                   });
+        runner.Run("ConvolutionEngine", string(s.layer) + "-BackwardFilter", PrecisionName<ElemType>(), shape, flops, bytes, [&]
+                   {
+                       convEngine->BackwardFilter(*outT, outGradient, *inT, in, *convT, *filterT, filterGradient, false, workspace);
+                   });
+
+        // 2x2 max pooling with stride 2 of the convolution output
+        size_t poolW = outW / 2;
+        size_t poolH = outH / 2;
+        auto poolT = fact->CreatePoolDescriptor(PoolingDescriptor::PoolKind::Max, 2, 2, 2, 2, 0, 0);
+        auto pooledT = fact->CreateTensor(poolW, poolH, s.k, s.n);
+        Matrix<ElemType> pooled(poolW * poolH * s.k, s.n, CPUDEVICE);
+        Matrix<ElemType> pooledGradient(poolW * poolH * s.k, s.n, CPUDEVICE);
+        pooledGradient.SetUniformRandomValue(-1, 1, 4);
+        convEngine->Forward(*inT, in, *filterT, filter, *convT, *outT, out, workspace);
+
+        const string poolShape = msra::strfun::strprintf("%dx%dx%d-2x2-s2-n%d", (int) outW, (int) outH, (int) s.k, (int) s.n);
+        const double poolBytes = (double) sizeof(ElemType) * (out.GetNumElements() + pooled.GetNumElements());
+        runner.Run("PoolingEngine", string(s.layer) + "-MaxPool-Forward", PrecisionName<ElemType>(), poolShape, (double) out.GetNumElements(), poolBytes, [&]
+                   {
+                       poolEngine->Forward(*outT, out, *poolT, *pooledT, pooled);
+                   });
+        runner.Run("PoolingEngine", string(s.layer) + "-MaxPool-Backward", PrecisionName<ElemType>(), poolShape, (double) out.GetNumElements(), 2 * poolBytes, [&]
+                   {
+                       poolEngine->Backward(*pooledT, pooled, pooledGradient, *poolT, *outT, out, outGradient);
+                   });
+    }
+}
 
-    Matrix<ElemType> CG((size_t) n, (size_t) m, deviceID);
-    Matrix<ElemType> DG((size_t) n, (size_t) m, deviceID);
+// -----------------------------------------------------------------------
+// node-level and network-level benchmarks: forward and backward of small networks built in code
+// -----------------------------------------------------------------------
 
-    auto t_startG = clock();
-    Matrix<ElemType>::MultiplyAndAdd(AG, false, BG, false, CG);
-    auto t_endG = clock();
-    std::cout << "MultiplyAndAdd Directly: " << 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC << " seconds" << endl;
+template <class ElemType>
+class NetworkBenchmark
+{
+    typedef shared_ptr<ComputationNode<ElemType>> ComputationNodePtr;
 
-    t_startG = clock();
-    for (int i = 0; i < m; i++)
+public:
+    NetworkBenchmark()
+        : m_net(make_shared<ComputationNetwork>(CPUDEVICE)), m_builder(*m_net), m_randomSeed(1), m_flops(0)
     {
-        Matrix<ElemType> col_BG = BG.ColumnSlice(i, 1);
-        Matrix<ElemType> col_CG = CG.ColumnSlice(i, 1);
-        Matrix<ElemType>::MultiplyAndAdd(AG, false, col_BG, false, col_CG);
     }
-    t_endG = clock();
-    std::cout << "MultiplyAndAdd With ColumnSlice: " << 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC << " seconds" << endl;
 
-    t_startG = clock();
-    for (int i = 0; i < m; i++)
+    ComputationNetworkBuilder<ElemType>& Builder()
     {
-        Matrix<ElemType> col_BG = BG.ColumnSlice(i, 1);
-        Matrix<ElemType> col_CG = CG.ColumnSlice(i, 1);
-        Matrix<ElemType>::MultiplyAndAdd(AG, false, col_BG, false, col_CG);
+        return m_builder;
     }
-    t_endG = clock();
-    std::cout << "MultiplyAndAdd With ColumnSlice&: " << 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC << " seconds" << endl;
 
-    Matrix<ElemType> col_BG1, col_CG1;
-    t_startG = clock();
-    for (int i = 0; i < m; i++)
+    ComputationNodePtr Features(const TensorShape& sampleLayout)
     {
-        col_BG1.AssignColumnSlice(BG, i, 1);
-        col_CG1.AssignColumnSlice(CG, i, 1);
-        Matrix<ElemType>::MultiplyAndAdd(AG, false, col_BG1, false, col_CG1);
+        auto node = m_builder.CreateInputNode(L"features", sampleLayout);
+        m_net->FeatureNodes().push_back(node);
+        return node;
     }
-    t_endG = clock();
-    std::cout << "MultiplyAndAdd With AssignColumnSlice: " << 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC << " seconds" << endl;
 
-    t_startG = clock();
-    for (int i = 0; i < m; i++)
+    ComputationNodePtr Parameter(size_t rows, size_t cols)
     {
-        Matrix<ElemType> col_CG = CG.ColumnSlice(i, 1);
-        Matrix<ElemType> col_DG = DG.ColumnSlice(i, 1);
-        col_DG.AssignSigmoidOf(col_CG);
+        auto node = m_builder.CreateLearnableParameter(msra::strfun::wstrprintf(L"P%d", (int) m_randomSeed), rows, cols);
+        m_net->InitLearnableParameters(node, true, m_randomSeed++, (ElemType) 1);
+        return node;
     }
-    t_endG = clock();
-    std::cout << "AssignSigmoidOf With ColumnSlice: " << 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC << " seconds" << endl;
 
-    t_startG = clock();
-    for (int i = 0; i < m; i++)
+    // dense layer; counts the GEMM flops of forward and backward
+    ComputationNodePtr Dense(const ComputationNodePtr& input, size_t inDim, size_t outDim, size_t mbSize)
     {
-        col_BG1.AssignColumnSlice(BG, i, 1);
-        col_CG1.AssignColumnSlice(CG, i, 1);
-        col_BG1.AssignSigmoidOf(col_CG1);
+        m_flops += 3 * 2.0 * inDim * outDim * mbSize;
+        return m_builder.Plus(m_builder.Times(Parameter(outDim, inDim), input), Parameter(outDim, 1));
     }
-    t_endG = clock();
-    std::cout << "AssignSigmoidOf With AssignColumnSlice: " << 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC << " seconds" << endl;
-}
 
-template <class ElemType>
-void SquareMultiplyAndAdd10TimesAvgTest(int n, int count)
-{
-    cout << "Testing CPUMatrix" << endl;
-    cout << "A(" << n << "x" << n << ") and B(" << n << "," << n << ")" << endl;
-
-    double cpu_avg = 0;
-    for (int i = 0; i < count; ++i)
-    {
-        CPUMatrix<ElemType> A(n, n);
-        randomInitializeCPUMatrix<ElemType>(A);
-        CPUMatrix<ElemType> B(n, n);
-        randomInitializeCPUMatrix<ElemType>(B);
-        CPUMatrix<ElemType> C(n, n);
-        auto t_start = clock();
-        CPUMatrix<ElemType>::MultiplyAndWeightedAdd(0.324, A, false, B, false, 0.632, C);
-        auto t_end = clock();
-        double val = 1.0 * (t_end - t_start) / CLOCKS_PER_SEC;
-        if (i == 0)
-        {
-            cpu_avg = val;
-        }
-        else
-        {
-            cpu_avg = cpu_avg * (i - 1) / i + val / i;
-        }
+    void AddFlops(double flops)
+    {
+        m_flops += flops;
     }
 
-    cout << "Testing Matrix" << endl;
-    double m_avg = 0;
-    for (int i = 0; i < count; ++i)
-    {
-        Matrix<ElemType> AG((size_t) n, (size_t) n);
-        randomInitializeMatrix<ElemType>(AG);
-        Matrix<ElemType> BG((size_t) n, (size_t) n);
-        randomInitializeMatrix<ElemType>(BG);
-        Matrix<ElemType> CG((size_t) n, (size_t) n);
-        auto t_startG = clock();
-        Matrix<ElemType>::MultiplyAndWeightedAdd(0.324, AG, false, BG, false, 0.632, CG);
-        auto t_endG = clock();
-        double val = 1.0 * (t_endG - t_startG) / CLOCKS_PER_SEC;
-        if (i == 0)
-        {
-            m_avg = val;
-        }
-        else
-        {
-            m_avg = m_avg * (i - 1) / i + val / i;
-        }
+    // Finish with a cross-entropy criterion over 'numClasses', and time forward and backward with random inputs and labels
+    void Run(BenchmarkRunner& runner, const string& name, const string& shape, const ComputationNodePtr& output, size_t numClasses, size_t mbSize)
+    {
+        auto labels = m_builder.CreateInputNode(L"labels", numClasses);
+        m_net->LabelNodes().push_back(labels);
+        ComputationNodeBasePtr criterion = m_builder.CrossEntropyWithSoftmax(labels, output, L"criterion");
+        m_net->FinalCriterionNodes().push_back(criterion);
+        m_net->CompileNetwork();
+        m_net->AllocateAllMatrices({}, {}, criterion);
+
+        auto& features = dynamic_pointer_cast<ComputationNode<ElemType>>(m_net->FeatureNodes()[0])->Value();
+        features.Resize(m_net->FeatureNodes()[0]->GetSampleLayout().GetNumElements(), mbSize);
+        features.SetUniformRandomValue(-1, 1, 1);
+        auto& labelValues = labels->Value();
+        labelValues.Resize(numClasses, mbSize);
+        labelValues.SetValue(0);
+        for (size_t j = 0; j < mbSize; j++)
+            labelValues.SetValue((j * 7919) % numClasses, j, 1);
+        m_net->GetMBLayoutPtr()->InitAsFrameMode(mbSize);
+        m_net->NotifyInputNodesFunctionValuesMBSizeModified();
+        m_net->StartEvaluateMinibatchLoop(criterion);
+
+        // softmax and cross entropy, forward and backward
+        m_flops += 8.0 * numClasses * mbSize;
+
+        double bytes = 0;
+        for (const auto& node : m_net->LearnableParameterNodes(criterion))
+            bytes += 2.0 * sizeof(ElemType) * dynamic_pointer_cast<ComputationNode<ElemType>>(node)->Value().GetNumElements(); // parameters read, gradients written
+
+        runner.Run("Network", name, PrecisionName<ElemType>(), shape, m_flops, bytes, [&]
+                   {
+                       ComputationNetwork::BumpEvalTimeStamp(m_net->FeatureNodes());
+                       ComputationNetwork::BumpEvalTimeStamp(m_net->LabelNodes());
+                       m_net->ForwardProp(criterion);
+                       m_net->Backprop(criterion);
+                   });
     }
 
-    cout << "Based on " << count << " runs:" << endl;
-    cout << "Average time for CPUMatrix is: " << cpu_avg << " seconds" << endl;
-    cout << "Average time for Matrix is: " << m_avg << " seconds" << endl;
-    cout << "CPUMatrix/Matrix ratio is: " << cpu_avg / m_avg << " seconds" << endl;
-}
+private:
+    ComputationNetworkPtr m_net;
+    ComputationNetworkBuilder<ElemType> m_builder;
+    unsigned long m_randomSeed;
+    double m_flops;
+};
 
 template <class ElemType>
-void MandSTest(int count, int devId)
+void BenchmarkNetworks(BenchmarkRunner& runner)
 {
-    ElemType* arr = new ElemType[count];
-    for (int i = 0; i < count; ++i)
-        arr[i] = (1.0 * rand()) / RAND_MAX + 1;
-
-    ElemType* data1 = new ElemType[1024 * 4096];
-    for (int i = 0; i < 1024 * 4096; ++i)
-        data1[i] = (1.0 * rand()) / RAND_MAX + 1;
-
-    ElemType* data2 = new ElemType[1024 * 4096];
-    for (int i = 0; i < 1024 * 4096; ++i)
-        data2[i] = (1.0 * rand()) / RAND_MAX + 1;
-
-    ElemType* data3 = new ElemType[1024];
-    for (int i = 0; i < 1024; ++i)
-        data3[i] = (1.0 * rand()) / RAND_MAX + 1;
-
-    cout << "Testing Matrix" << endl;
-    Matrix<ElemType> A(1024, 4096, data1, true, devId);
-    Matrix<ElemType> B(4096, 1024, data2, true, devId);
-    Matrix<ElemType> V(1024, 1, data3, true, devId);
-    Matrix<ElemType> C(1024, 1024, devId);
+    // softmax/cross-entropy nodes over a 10000-word vocabulary (with a bias so that there is something to backprop into)
+    {
+        const size_t numClasses = 10000, mbSize = 128;
+        NetworkBenchmark<ElemType> bench;
+        auto z = bench.Builder().Plus(bench.Features(TensorShape(numClasses)), bench.Parameter(numClasses, 1));
+        bench.Run(runner, "CrossEntropyWithSoftmax", msra::strfun::strprintf("%dx%d", (int) numClasses, (int) mbSize), z, numClasses, mbSize);
+    }
 
-    auto t_startG = clock();
-    for (int i = 0; i < count; ++i)
+    // MLP 784-512-512-10 with sigmoid hidden layers
     {
-        // Matrix<ElemType>::MultiplyAndWeightedAdd(arr[i],A,false,B,false,3.2*arr[i],C);
-        C += (A * arr[i]) * (B * (arr[i] * 2.3));
+        const size_t mbSize = 256;
+        NetworkBenchmark<ElemType> bench;
+        auto h = bench.Builder().Sigmoid(bench.Dense(bench.Features(TensorShape(784)), 784, 512, mbSize));
+        h = bench.Builder().Sigmoid(bench.Dense(h, 512, 512, mbSize));
+        auto z = bench.Dense(h, 512, 10, mbSize);
+        bench.Run(runner, "MLP-784-512-512-10", msra::strfun::strprintf("mb%d", (int) mbSize), z, 10, mbSize);
     }
-    auto t_endG = clock();
-    double valM = 1.0 * (t_endG - t_startG) / (CLOCKS_PER_SEC * count);
-    cout << "Matrix C+=alpha*A*beta*B in: " << valM << " seconds" << endl;
 
-    cout << "Testing CPUMatrix" << endl;
-    CPUMatrix<ElemType> AC(1024, 4096, data1, true);
-    CPUMatrix<ElemType> BC(4096, 1024, data2, true);
-    CPUMatrix<ElemType> VC(1024, 1, data3, true);
-    CPUMatrix<ElemType> CC(1024, 1024);
+    // elementwise nodes after a dense layer, like the gates of a recurrent layer, computed node by node and fused
+    // (fuseElementwiseNodes); the groups are formed by AllocateAllMatrices(), so the flag must be set while Run() allocates
+    for (bool fuse : {false, true})
+    {
+        const size_t mbSize = 256;
+        g_fuseElementwiseNodes = fuse;
+        NetworkBenchmark<ElemType> bench;
+        auto& builder = bench.Builder();
+        auto x = bench.Dense(bench.Features(TensorShape(64)), 64, 2048, mbSize);
+        auto h = builder.RectifiedLinear(builder.ElementTimes(builder.Sigmoid(x), builder.Tanh(builder.Minus(x, bench.Parameter(2048, 1)))));
+        auto z = bench.Dense(h, 2048, 10, mbSize);
+        bench.Run(runner, "Elementwise-gates", msra::strfun::strprintf("2048-mb%d-%s", (int) mbSize, fuse ? "fused" : "unfused"), z, 10, mbSize);
+        g_fuseElementwiseNodes = false;
+    }
 
-    auto t_startC = clock();
-    for (int i = 0; i < count; ++i)
+    // LeNet-style convnet on 28x28x1: conv 5x5x16, relu, max pool 2x2, conv 5x5x32, relu, max pool 2x2, dense 10
     {
-        CPUMatrix<ElemType>::MultiplyAndWeightedAdd(arr[i], AC, false, BC, false, 3.2 * arr[i], CC);
-        // CC+=(arr[i]*AC)*((arr[i]*2.3)*BC);
+        const size_t mbSize = 64;
+        NetworkBenchmark<ElemType> bench;
+        auto& builder = bench.Builder();
+        auto input = bench.Features(ImageDimensions::AsTensorShape(28, 28, 1, ImageLayoutKind::HWC));
+        bench.AddFlops(3 * 2.0 * 24 * 24 * 16 * 5 * 5 * 1 * mbSize);
+        auto h = builder.RectifiedLinear(builder.Convolution(bench.Parameter(16, 5 * 5 * 1), input, 5, 5, 16, 1, 1, ImageLayoutKind::HWC));
+        h = builder.MaxPooling(h, 2, 2, 2, 2, ImageLayoutKind::HWC); // 12x12x16
+        bench.AddFlops(3 * 2.0 * 8 * 8 * 32 * 5 * 5 * 16 * mbSize);
+        h = builder.RectifiedLinear(builder.Convolution(bench.Parameter(32, 5 * 5 * 16), h, 5, 5, 32, 1, 1, ImageLayoutKind::HWC));
+        h = builder.MaxPooling(h, 2, 2, 2, 2, ImageLayoutKind::HWC); // 4x4x32
+        auto z = bench.Dense(h, 4 * 4 * 32, 10, mbSize);
+        bench.Run(runner, "ConvNet-LeNet", msra::strfun::strprintf("28x28x1-mb%d", (int) mbSize), z, 10, mbSize);
     }
-    auto t_endC = clock();
-    double valMC = 1.0 * (t_endC - t_startC) / (CLOCKS_PER_SEC * count);
-    cout << "CPUMatrix C+=alpha*A*beta*B in: " << valMC << " seconds" << endl;
-
-    delete[] arr;
-    delete[] data1;
-    delete[] data2;
-    delete[] data3;
 }
 
-int wmain()
+template <class ElemType>
+void RunAllBenchmarks(BenchmarkRunner& runner)
 {
-    ColumnSliceMultAndAddTest<float>(2048, 2048, 256, 0);
-
-    TestRnnForwardPropSRP<float>();
-
-    TestOldRnnForwardPropSRP<float>();
+    BenchmarkGEMM<ElemType>(runner);
+    BenchmarkTensorOps<ElemType>(runner);
+    BenchmarkSparse<ElemType>(runner);
+    BenchmarkOneHotInput<ElemType>(runner);
+    BenchmarkConvolution<ElemType>(runner);
+    BenchmarkNetworks<ElemType>(runner);
+}
 
-    // MandSTest<float>(100, 2);
+} } } }
 
-    /*cout<<endl<<"********************Matrix SquareMultiplyAndWeightedAdd10TimesAvg TEST********************"<<endl;
-    SquareMultiplyAndAdd10TimesAvgTest<float>(4096,10);
+using namespace Microsoft::MSR::CNTK::Test;
 
-    cout<<endl<<"********************Matrix AddMultiplyAndInplaceSigmoid TEST********************"<<endl;    
-    AddMultiplyAndInplaceSigmoidTest<float>(11,10,12);    
-    AddMultiplyAndInplaceSigmoidTest<float>(110,100,120);    
-    AddMultiplyAndInplaceSigmoidTest<float>(1100,1000,1200);    
-    AddMultiplyAndInplaceSigmoidTest<float>(11000,10000,1200);
+int main(int argc, char* argv[])
+{
+    std::string format = "csv";
+    std::string jsonFile;
+    std::string filter;
+    std::string precision = "float";
+    double minTime = 0.5;
+    for (int i = 1; i < argc; i += 2)
+    {
+        std::string option = argv[i];
+        if (i + 1 == argc) // option without a value
+            option.clear();
+        if (option == "-format")
+            format = argv[i + 1];
+        else if (option == "-jsonFile")
+            jsonFile = argv[i + 1];
+        else if (option == "-filter")
+            filter = argv[i + 1];
+        else if (option == "-minTime")
+            minTime = atof(argv[i + 1]);
+        else if (option == "-precision")
+            precision = argv[i + 1];
+        else
+        {
+            fprintf(stderr, "usage: %s [-format csv|json] [-jsonFile <path>] [-filter <substring>] [-minTime <seconds>] [-precision float|double|both]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if ((format != "csv" && format != "json") || (precision != "float" && precision != "double" && precision != "both"))
+    {
+        fprintf(stderr, "invalid -format or -precision\n");
+        return EXIT_FAILURE;
+    }
 
-    cout<<endl<<"********************Matrix MultiplyAndWeightedAdd TEST********************"<<endl;    
-    MultiplyAndWeightedAddTest<float>(11,10,12);    
-    MultiplyAndWeightedAddTest<float>(110,100,120);    
-    MultiplyAndWeightedAddTest<float>(1100,1000,1200);    
-    MultiplyAndWeightedAddTest<float>(11000,10000,12000);*/
+    FILE* jsonOutput = nullptr; // opened before the benchmarks run, so that a bad path fails right away
+    if (!jsonFile.empty())
+    {
+        jsonOutput = fopen(jsonFile.c_str(), "w");
+        if (!jsonOutput)
+        {
+            fprintf(stderr, "cannot open '%s' for writing\n", jsonFile.c_str());
+            return EXIT_FAILURE;
+        }
+    }
 
-    return 0;
+    try
+    {
+        BenchmarkRunner runner(filter, minTime);
+        if (precision != "double")
+            RunAllBenchmarks<float>(runner);
+        if (precision != "float")
+            RunAllBenchmarks<double>(runner);
+
+        if (format == "json")
+            runner.PrintJSON(stdout);
+        else
+            runner.PrintCSV(stdout);
+        if (jsonOutput)
+        {
+            runner.PrintJSON(jsonOutput);
+            fclose(jsonOutput);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        fprintf(stderr, "EXCEPTION occurred: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
 }
@@ -4,6 +4,8 @@
 //
 #include "stdafx.h"
 #include "../../../Source/Math/CPUMatrix.h"
+#include "../../../Source/Math/CPUMemAllocator.h"
+#include "../../../Source/Math/QuantizedGemm.h"
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -898,6 +900,506 @@ BOOST_FIXTURE_TEST_CASE(CPUMatrixSeedingDouble, RandomSeedFixture)
     BOOST_CHECK(m1.IsEqualTo(m2));
 }
 
+BOOST_FIXTURE_TEST_CASE(CPUMatrixFusedElementwise, RandomSeedFixture)
+{
+    // y = Sigmoid(a + bias) .* Tanh(b), where 'bias' is a column vector that is broadcast
+    // 300 rows to cover more than one tile
+    const size_t rows = 300;
+    const size_t cols = 3;
+    FusedElementwiseProgram program;
+    program.m_numInputs = 3; // registers 0..2 = a, bias, b
+    program.m_steps.push_back(FusedElementwiseStep{opSum, {0, 1}});                // 3
+    program.m_steps.push_back(FusedElementwiseStep{opSigmoid, {3, 3}});            // 4
+    program.m_steps.push_back(FusedElementwiseStep{opTanh, {2, 2}});               // 5
+    program.m_steps.push_back(FusedElementwiseStep{opElementwiseProduct, {4, 5}}); // 6
+
+    auto a = DMatrix::RandomUniform(rows, cols, -3, 3, 1);
+    auto bias = DMatrix::RandomUniform(rows, 1, -1, 1, 2);
+    auto b = DMatrix::RandomUniform(rows, cols, -3, 3, 3);
+    auto resultGradient = DMatrix::RandomUniform(rows, cols, -1, 1, 4);
+
+    DMatrix result(rows, cols);
+    DMatrix::FusedElementwiseForward(program, {&a, &bias, &b}, result);
+
+    DMatrix aGradient = DMatrix::Zeros(rows, cols);
+    DMatrix biasGradient = DMatrix::Zeros(rows, 1);
+    DMatrix bGradient = DMatrix::Zeros(rows, cols);
+    DMatrix::FusedElementwiseBackward(program, {&a, &bias, &b}, resultGradient, {&aGradient, &biasGradient, &bGradient});
+
+    DMatrix biasGradientExpected = DMatrix::Zeros(rows, 1);
+    for (size_t j = 0; j < cols; j++)
+    {
+        for (size_t i = 0; i < rows; i++)
+        {
+            double s = 1 / (1 + exp(-(a(i, j) + bias(i, 0))));
+            double t = tanh(b(i, j));
+            BOOST_CHECK_CLOSE(result(i, j), s * t, c_epsilonFloatE4);
+
+            double aGradientExpected = resultGradient(i, j) * t * s * (1 - s);
+            BOOST_CHECK_CLOSE(aGradient(i, j), aGradientExpected, c_epsilonFloatE4);
+            BOOST_CHECK_CLOSE(bGradient(i, j), resultGradient(i, j) * s * (1 - t * t), c_epsilonFloatE4);
+            biasGradientExpected(i, 0) += aGradientExpected;
+        }
+    }
+    BOOST_CHECK(biasGradient.IsEqualTo(biasGradientExpected, c_epsilonFloatE4));
+
+    // gradients accumulate, and inputs without gradient are skipped
+    DMatrix::FusedElementwiseBackward(program, {&a, &bias, &b}, resultGradient, {&aGradient, nullptr, nullptr});
+    for (size_t i = 0; i < rows; i++)
+    {
+        double s = 1 / (1 + exp(-(a(i, 0) + bias(i, 0))));
+        double t = tanh(b(i, 0));
+        BOOST_CHECK_CLOSE(aGradient(i, 0), 2 * resultGradient(i, 0) * t * s * (1 - s), c_epsilonFloatE4);
+    }
+}
+
+// run 'op' through TensorOp() with the vectorized kernels and with the scalar code, and compare
+// 'maxUlps' is the allowed difference in units of the last place (0 = bit-for-bit).
+template <class ElemType>
+static void TestTensorOpVectorized(ElementWiseOperator op, const CPUMatrix<ElemType>& a, const CPUMatrix<ElemType>* b, ElemType beta, ElemType alpha, double maxUlps,
+                                   const SmallVector<size_t>& regularOpDims, const vector<SmallVector<ptrdiff_t>>& regularStrides,
+                                   const SmallVector<size_t>& reducingOpDims = SmallVector<size_t>(), const vector<SmallVector<ptrdiff_t>>& reducingStrides = vector<SmallVector<ptrdiff_t>>(3))
+{
+    const size_t resultRows = regularOpDims.size() > 0 ? regularOpDims[0] : 1;
+    const size_t resultCols = regularOpDims.size() > 1 ? regularOpDims[1] : 1;
+    auto initialResult = CPUMatrix<ElemType>::RandomUniform(resultRows, resultCols, -1, 1, 7);
+    CPUMatrix<ElemType> results[2] = {initialResult, initialResult};
+    const CPUVectorISA isa = CPUMatrix<ElemType>::GetVectorISA();
+    for (size_t k = 0; k < 2; k++)
+    {
+        CPUMatrix<ElemType>::SetVectorISA(k == 0 ? isa : CPUVectorISA::None);
+        if (b)
+            results[k].TensorOp(beta, a, *b, alpha, op, array<size_t, 3>{0, 0, 0},
+                                regularOpDims, array<SmallVector<ptrdiff_t>, 3>{regularStrides[0], regularStrides[1], regularStrides[2]},
+                                reducingOpDims, array<SmallVector<ptrdiff_t>, 3>{reducingStrides[0], reducingStrides[1], reducingStrides[2]});
+        else
+            results[k].TensorOp(beta, a, alpha, op, array<size_t, 2>{0, 0},
+                                regularOpDims, array<SmallVector<ptrdiff_t>, 2>{regularStrides[0], regularStrides[1]},
+                                reducingOpDims, array<SmallVector<ptrdiff_t>, 2>{reducingStrides[0], reducingStrides[1]});
+    }
+    CPUMatrix<ElemType>::SetVectorISA(isa);
+
+    for (size_t j = 0; j < resultCols; j++)
+    {
+        for (size_t i = 0; i < resultRows; i++)
+        {
+            double vectorized = results[0](i, j);
+            double scalar = results[1](i, j);
+            double ulp = std::numeric_limits<ElemType>::epsilon() * std::max(fabs(scalar), (double) std::numeric_limits<ElemType>::min());
+            BOOST_CHECK_MESSAGE(fabs(vectorized - scalar) <= maxUlps * ulp, "op " << (int) op << " at (" << i << "," << j << "): " << vectorized << " vs. " << scalar);
+        }
+    }
+}
+
+template <class ElemType>
+static void TestTensorOpVectorized()
+{
+    // an odd number of rows, so that all kernels also run their scalar remainder loops
+    const size_t rows = 1001;
+    const size_t cols = 3;
+    auto a = CPUMatrix<ElemType>::RandomUniform(rows, cols, -5, 5, 1);
+    auto positive = CPUMatrix<ElemType>::RandomUniform(rows, cols, (ElemType) 1e-3, 5, 2);
+    auto b = CPUMatrix<ElemType>::RandomUniform(rows, cols, -5, 5, 3);
+    auto bias = CPUMatrix<ElemType>::RandomUniform(rows, 1, -5, 5, 4);
+
+    const SmallVector<size_t> flatDims{rows * cols};
+    const vector<SmallVector<ptrdiff_t>> flatStrides(3, SmallVector<ptrdiff_t>{1});
+    for (auto alpha : {(ElemType) 1, (ElemType) 0.5})
+    {
+        for (auto beta : {(ElemType) 0, (ElemType) 1})
+        {
+            // arithmetic: bit-for-bit
+            TestTensorOpVectorized<ElemType>(opCopy, a, nullptr, beta, alpha, 0, flatDims, flatStrides);
+            TestTensorOpVectorized<ElemType>(opNegate, a, nullptr, beta, alpha, 0, flatDims, flatStrides);
+            TestTensorOpVectorized<ElemType>(opLinearRectifier, a, nullptr, beta, alpha, 0, flatDims, flatStrides);
+            TestTensorOpVectorized<ElemType>(opSum, a, &b, beta, alpha, 0, flatDims, flatStrides);
+            TestTensorOpVectorized<ElemType>(opDifference, a, &b, beta, alpha, 0, flatDims, flatStrides);
+            TestTensorOpVectorized<ElemType>(opElementwiseProduct, a, &b, beta, alpha, 0, flatDims, flatStrides);
+            // approximated functions: a few ULPs (before adding beta * c, which may cancel digits)
+            if (beta == 0)
+            {
+                TestTensorOpVectorized<ElemType>(opSigmoid, a, nullptr, beta, alpha, 4, flatDims, flatStrides);
+                TestTensorOpVectorized<ElemType>(opTanh, a, nullptr, beta, alpha, 4, flatDims, flatStrides);
+                TestTensorOpVectorized<ElemType>(opExp, a, nullptr, beta, alpha, 4, flatDims, flatStrides);
+                TestTensorOpVectorized<ElemType>(opLog, positive, nullptr, beta, alpha, 4, flatDims, flatStrides);
+            }
+        }
+    }
+
+    // the remainder that does not fill a whole vector goes through the same approximations:
+    // shortening the op by 4 elements moves the last elements from a full vector into the remainder
+    for (auto op : {opSigmoid, opTanh, opExp, opLog})
+    {
+        CPUMatrix<ElemType> results[2];
+        for (size_t k = 0; k < 2; k++)
+        {
+            const size_t n = rows * cols - 4 * k;
+            results[k].Resize(n, 1);
+            results[k].TensorOp(0, positive, 1, op, array<size_t, 2>{0, 0}, SmallVector<size_t>{n}, array<SmallVector<ptrdiff_t>, 2>{flatStrides[0], flatStrides[0]},
+                                SmallVector<size_t>(), array<SmallVector<ptrdiff_t>, 2>());
+        }
+        for (size_t i = 0; i < results[1].GetNumRows(); i++)
+            BOOST_CHECK_MESSAGE(results[0](i, 0) == results[1](i, 0), "op " << (int) op << " at " << i << ": " << results[0](i, 0) << " vs. " << results[1](i, 0));
+    }
+
+    // broadcasting a column vector
+    TestTensorOpVectorized<ElemType>(opSum, a, &bias, 0, 1, 0, SmallVector<size_t>{rows, cols},
+                                     {SmallVector<ptrdiff_t>{1, (ptrdiff_t) rows}, SmallVector<ptrdiff_t>{1, 0}, SmallVector<ptrdiff_t>{1, (ptrdiff_t) rows}});
+
+    // sum over columns (e.g. a bias gradient): bit-for-bit
+    TestTensorOpVectorized<ElemType>(opCopy, a, nullptr, 1, 1, 0, SmallVector<size_t>{rows}, flatStrides,
+                                     SmallVector<size_t>{cols}, {SmallVector<ptrdiff_t>{(ptrdiff_t) rows}, SmallVector<ptrdiff_t>{0}, SmallVector<ptrdiff_t>{0}});
+    // sum over all elements: summed in a different order
+    TestTensorOpVectorized<ElemType>(opCopy, positive, nullptr, 0, 1, 16, SmallVector<size_t>(), vector<SmallVector<ptrdiff_t>>(3),
+                                     SmallVector<size_t>{rows * cols}, {SmallVector<ptrdiff_t>{1}, SmallVector<ptrdiff_t>{0}, SmallVector<ptrdiff_t>{0}});
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixTensorOpVectorized, RandomSeedFixture)
+{
+    if (SMatrix::GetVectorISA() == CPUVectorISA::None)
+    {
+        BOOST_TEST_MESSAGE("CPUMatrixTensorOpVectorized: CPU does not support AVX2, skipping.");
+        return;
+    }
+    TestTensorOpVectorized<float>();
+    TestTensorOpVectorized<double>();
+
+    // the instruction set can be lowered, but not raised beyond what the CPU supports
+    const CPUVectorISA isa = SMatrix::GetVectorISA();
+    BOOST_CHECK(SMatrix::SetVectorISA(CPUVectorISA::None) == CPUVectorISA::None);
+    BOOST_CHECK(SMatrix::SetVectorISA(CPUVectorISA::AVX512) == isa);
+}
+
+// loss used to check the gradients of the recurrent cells: sum of the outputs weighted with random numbers
+static double WeightedSum(const DMatrix& a, const DMatrix& weights)
+{
+    double sum = 0;
+    for (size_t j = 0; j < a.GetNumCols(); j++)
+        for (size_t i = 0; i < a.GetNumRows(); i++)
+            sum += a(i, j) * weights(i, j);
+    return sum;
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixLSTMCell, RandomSeedFixture)
+{
+    const size_t cellDim = 5;
+    const size_t numSeq = 3;
+    const auto z = DMatrix::RandomUniform(4 * cellDim, numSeq, -2, 2, 1); // pre-activations
+    auto prevCell = DMatrix::RandomUniform(cellDim, numSeq, -1, 1, 2);
+    auto peepholes = DMatrix::RandomUniform(cellDim, 3, -1, 1, 3);
+    const auto cellOutputWeights = DMatrix::RandomUniform(cellDim, numSeq, -1, 1, 4);
+    const auto cellWeights = DMatrix::RandomUniform(cellDim, numSeq, -1, 1, 5);
+
+    // loss = cellOutputWeights .* cellOutput + cellWeights .* cell, the latter standing in for the next time step
+    auto forward = [&](DMatrix& gates, DMatrix& cell, DMatrix& cellOutput)
+    {
+        cell.Resize(cellDim, numSeq);
+        cellOutput.Resize(cellDim, numSeq);
+        DMatrix::LSTMCellForward(gates, prevCell, peepholes, cell, cellOutput);
+        return WeightedSum(cellOutput, cellOutputWeights) + WeightedSum(cell, cellWeights);
+    };
+    DMatrix gates(z), cell, cellOutput;
+    forward(gates, cell, cellOutput);
+
+    // compare with the formula of the LSTMPComponent macro
+    for (size_t j = 0; j < numSeq; j++)
+    {
+        for (size_t k = 0; k < cellDim; k++)
+        {
+            double cp = prevCell(k, j);
+            double i = 1 / (1 + exp(-(z(k, j) + peepholes(k, 0) * cp)));
+            double g = tanh(z(cellDim + k, j));
+            double f = 1 / (1 + exp(-(z(2 * cellDim + k, j) + peepholes(k, 1) * cp)));
+            double c = f * cp + i * g;
+            double o = 1 / (1 + exp(-(z(3 * cellDim + k, j) + peepholes(k, 2) * c)));
+            BOOST_CHECK_CLOSE(cell(k, j), c, c_epsilonFloatE4);
+            BOOST_CHECK_CLOSE(cellOutput(k, j), o * tanh(c), c_epsilonFloatE4);
+            BOOST_CHECK_CLOSE(gates(3 * cellDim + k, j), o, c_epsilonFloatE4);
+        }
+    }
+
+    DMatrix cellGradient(cellWeights);
+    DMatrix gatesGradient(4 * cellDim, numSeq);
+    DMatrix peepholesGradient = DMatrix::Zeros(cellDim, 3);
+    DMatrix::LSTMCellBackward(gates, prevCell, cell, peepholes, cellOutputWeights, cellGradient, gatesGradient, peepholesGradient);
+
+    // compare with finite differences
+    const double delta = 1e-6;
+    DMatrix c, m;
+    auto loss = [&]()
+    {
+        DMatrix zz(z);
+        return forward(zz, c, m);
+    };
+    for (size_t j = 0; j < numSeq; j++)
+    {
+        for (size_t r = 0; r < 4 * cellDim; r++)
+        {
+            DMatrix zp(z), zm(z);
+            zp(r, j) += delta;
+            zm(r, j) -= delta;
+            double expected = (forward(zp, c, m) - forward(zm, c, m)) / (2 * delta);
+            BOOST_CHECK_SMALL(gatesGradient(r, j) - expected, 1e-6);
+        }
+        for (size_t k = 0; k < cellDim; k++)
+        {
+            const double cp = prevCell(k, j);
+            prevCell(k, j) = cp + delta;
+            double lossPlus = loss();
+            prevCell(k, j) = cp - delta;
+            double lossMinus = loss();
+            prevCell(k, j) = cp;
+            BOOST_CHECK_SMALL(cellGradient(k, j) - (lossPlus - lossMinus) / (2 * delta), 1e-6);
+        }
+    }
+    for (size_t n = 0; n < 3; n++)
+    {
+        for (size_t k = 0; k < cellDim; k++)
+        {
+            const double p = peepholes(k, n);
+            peepholes(k, n) = p + delta;
+            double lossPlus = loss();
+            peepholes(k, n) = p - delta;
+            double lossMinus = loss();
+            peepholes(k, n) = p;
+            BOOST_CHECK_SMALL(peepholesGradient(k, n) - (lossPlus - lossMinus) / (2 * delta), 1e-6);
+        }
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixGRUCell, RandomSeedFixture)
+{
+    const size_t outputDim = 5;
+    const size_t numSeq = 3;
+    const auto x = DMatrix::RandomUniform(3 * outputDim, numSeq, -2, 2, 1);
+    auto recurrent = DMatrix::RandomUniform(3 * outputDim, numSeq, -2, 2, 2);
+    auto prevOutput = DMatrix::RandomUniform(outputDim, numSeq, -1, 1, 3);
+    const auto outputWeights = DMatrix::RandomUniform(outputDim, numSeq, -1, 1, 4);
+
+    auto forward = [&](DMatrix& gates, DMatrix& output)
+    {
+        output.Resize(outputDim, numSeq);
+        DMatrix::GRUCellForward(gates, recurrent, prevOutput, output);
+        return WeightedSum(output, outputWeights);
+    };
+    DMatrix gates(x), output;
+    forward(gates, output);
+
+    for (size_t j = 0; j < numSeq; j++)
+    {
+        for (size_t k = 0; k < outputDim; k++)
+        {
+            double r = 1 / (1 + exp(-(x(k, j) + recurrent(k, j))));
+            double z = 1 / (1 + exp(-(x(outputDim + k, j) + recurrent(outputDim + k, j))));
+            double n = tanh(x(2 * outputDim + k, j) + r * recurrent(2 * outputDim + k, j));
+            BOOST_CHECK_CLOSE(output(k, j), (1 - z) * n + z * prevOutput(k, j), c_epsilonFloatE4);
+        }
+    }
+
+    DMatrix gatesGradient(3 * outputDim, numSeq);
+    DMatrix recurrentGradient(3 * outputDim, numSeq);
+    DMatrix prevOutputGradient(outputDim, numSeq);
+    DMatrix::GRUCellBackward(gates, recurrent, prevOutput, outputWeights, gatesGradient, recurrentGradient, prevOutputGradient);
+
+    const double delta = 1e-6;
+    DMatrix h;
+    auto loss = [&]()
+    {
+        DMatrix xx(x);
+        return forward(xx, h);
+    };
+    for (size_t j = 0; j < numSeq; j++)
+    {
+        for (size_t r = 0; r < 3 * outputDim; r++)
+        {
+            DMatrix xp(x), xm(x);
+            xp(r, j) += delta;
+            xm(r, j) -= delta;
+            BOOST_CHECK_SMALL(gatesGradient(r, j) - (forward(xp, h) - forward(xm, h)) / (2 * delta), 1e-6);
+
+            const double v = recurrent(r, j);
+            recurrent(r, j) = v + delta;
+            double lossPlus = loss();
+            recurrent(r, j) = v - delta;
+            double lossMinus = loss();
+            recurrent(r, j) = v;
+            BOOST_CHECK_SMALL(recurrentGradient(r, j) - (lossPlus - lossMinus) / (2 * delta), 1e-6);
+        }
+        for (size_t k = 0; k < outputDim; k++)
+        {
+            const double v = prevOutput(k, j);
+            prevOutput(k, j) = v + delta;
+            double lossPlus = loss();
+            prevOutput(k, j) = v - delta;
+            double lossMinus = loss();
+            prevOutput(k, j) = v;
+            BOOST_CHECK_SMALL(prevOutputGradient(k, j) - (lossPlus - lossMinus) / (2 * delta), 1e-6);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CPUMemAllocatorReuse)
+{
+    CPUMemAllocator allocator;
+
+    char* p = (char*) allocator.MallocZeroed(1000);
+    BOOST_CHECK_EQUAL((size_t) p % 64, 0);
+    memset(p, 1, 1000);
+    allocator.Free(p);
+
+    // same size class: the block comes from the cache and is zeroed again
+    char* q = (char*) allocator.MallocZeroed(990);
+    BOOST_CHECK(q == p);
+    BOOST_CHECK(std::all_of(q, q + 990, [](char c) { return c == 0; }));
+
+    void* big = allocator.Malloc(3 << 20);
+    BOOST_CHECK_EQUAL((size_t) big % 4096, 0);
+
+    CPUMemAllocatorStatistics stats = allocator.GetStatistics();
+    BOOST_CHECK_EQUAL(stats.numAllocations, 3);
+    BOOST_CHECK_EQUAL(stats.numCacheHits, 1);
+    BOOST_CHECK_EQUAL(stats.bytesCached, 0);
+    BOOST_CHECK_GE(stats.bytesInUse, 990 + (3 << 20));
+    BOOST_CHECK_EQUAL(stats.bytesReserved, stats.bytesInUse);
+
+    allocator.Free(q);
+    allocator.Free(big);
+    stats = allocator.GetStatistics();
+    BOOST_CHECK_EQUAL(stats.bytesInUse, 0);
+    BOOST_CHECK_EQUAL(stats.bytesCached, stats.peakBytesInUse);
+
+    allocator.ReleaseCache();
+    BOOST_CHECK_EQUAL(allocator.GetStatistics().bytesReserved, 0);
+
+    // without caching, freed blocks go straight back to the system
+    CPUMemAllocatorOptions options;
+    options.cache = false;
+    options.alignment = 256;
+    allocator.SetOptions(options);
+    p = (char*) allocator.Malloc(100);
+    BOOST_CHECK_EQUAL((size_t) p % 256, 0);
+    allocator.Free(p);
+    BOOST_CHECK_EQUAL(allocator.GetStatistics().bytesReserved, 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixBufferReuse, RandomSeedFixture)
+{
+    SMatrix m(17, 33);
+    BOOST_CHECK_EQUAL((size_t) m.BufferPointer() % 64, 0);
+    m.SetValue(3);
+    m.Resize(0, 0, false);
+
+    // matrices rely on zero-initialized buffers, also when the buffer is reused
+    SMatrix m1(17, 33);
+    BOOST_CHECK(m1.IsEqualTo(SMatrix::Zeros(17, 33)));
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixNCESharedNoise, RandomSeedFixture)
+{
+    // NCE with one noise set shared by all columns must agree with scoring each column on its own
+    const size_t dim = 8, vocab = 50, numCols = 6, numNoise = 5;
+    const int noise[numNoise] = {3, 17, 3, 40, 9};
+    DMatrix hidden(dim, numCols), embedding(dim, vocab), bias(1, vocab);
+    hidden.SetUniformRandomValue(-1, 1, IncrementCounter());
+    embedding.SetUniformRandomValue(-1, 1, IncrementCounter());
+    bias.SetUniformRandomValue(-1, 1, IncrementCounter());
+
+    DMatrix samples(2 * (numNoise + 1), numCols);
+    for (size_t j = 0; j < numCols; j++)
+    {
+        samples(0, j) = (double) ((j * 7) % vocab);
+        samples(1, j) = -2.0 - 0.1 * j;
+        for (size_t k = 0; k < numNoise; k++)
+        {
+            samples(2 * (k + 1), j) = noise[k];
+            samples(2 * (k + 1) + 1, j) = 1.5 + 0.2 * k;
+        }
+    }
+
+    DMatrix tmp(numNoise + 1, numCols), criterion(1, 1);
+    samples.AssignNoiseContrastiveEstimation(hidden, embedding, bias, tmp, criterion);
+    DMatrix hiddenGradient(dim, numCols), embeddingGradient(dim, vocab);
+    hiddenGradient.SetValue(0);
+    embeddingGradient.SetValue(0);
+    samples.AssignNCEDerivative(tmp, hidden, embedding, 1, hiddenGradient);
+    samples.AssignNCEDerivative(tmp, hidden, embedding, 2, embeddingGradient);
+
+    double expectedCriterion = 0;
+    DMatrix expectedEmbeddingGradient(dim, vocab);
+    expectedEmbeddingGradient.SetValue(0);
+    for (size_t j = 0; j < numCols; j++)
+    {
+        DMatrix samples1 = samples.ColumnSlice(j, 1), hidden1 = hidden.ColumnSlice(j, 1);
+        DMatrix tmp1(numNoise + 1, 1), criterion1(1, 1), hiddenGradient1(dim, 1);
+        samples1.AssignNoiseContrastiveEstimation(hidden1, embedding, bias, tmp1, criterion1);
+        expectedCriterion += criterion1(0, 0);
+        BOOST_CHECK(tmp1.IsEqualTo(tmp.ColumnSlice(j, 1), c_epsilonFloatE4));
+
+        hiddenGradient1.SetValue(0);
+        samples1.AssignNCEDerivative(tmp1, hidden1, embedding, 1, hiddenGradient1);
+        BOOST_CHECK(hiddenGradient1.IsEqualTo(hiddenGradient.ColumnSlice(j, 1), c_epsilonFloatE4));
+        samples1.AssignNCEDerivative(tmp1, hidden1, embedding, 2, expectedEmbeddingGradient);
+    }
+    BOOST_CHECK_CLOSE(criterion(0, 0), expectedCriterion, 1e-6);
+    BOOST_CHECK(embeddingGradient.IsEqualTo(expectedEmbeddingGradient, c_epsilonFloatE4));
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUMatrixQuantizedProduct, RandomSeedFixture)
+{
+    const size_t M = 37, K = 100, N = 13;
+    SMatrix w = SMatrix::RandomUniform(M, K, -1, 1, IncrementCounter());
+    SMatrix x = SMatrix::RandomUniform(K, N, -2, 2, IncrementCounter());
+    SMatrix expected(M, N);
+    SMatrix::MultiplyAndWeightedAdd(1, w, false, x, false, 0, expected);
+
+    for (size_t numBits : {8, 16})
+    {
+        // the weights of output m are row m of w
+        QuantizedWeights<float> qw(w.BufferPointer(), K, M, /*kStride=*/M, /*mStride=*/1, numBits);
+        BOOST_CHECK_EQUAL(qw.GetNumInputs(), K);
+        BOOST_CHECK_EQUAL(qw.GetNumOutputs(), M);
+        BOOST_CHECK_LT(qw.GetSizeInBytes(), M * K * sizeof(float) * numBits / 16);
+
+        SMatrix c(M, N);
+        qw.Multiply(x.BufferPointer(), 1, K, N, c.BufferPointer(), 1, M);
+
+        // the products are exact, so the error is bounded by the quantization error of the factors
+        double wRange = numBits == 8 ? 127 : floor(sqrt(2147483647.0 / K));
+        double xRange = numBits == 8 ? floor(2147483647.0 / K / 127) : wRange;
+        for (size_t n = 0; n < N; n++)
+        {
+            double xMax = 0;
+            for (size_t k = 0; k < K; k++)
+                xMax = max(xMax, (double) fabs(x(k, n)));
+            for (size_t m = 0; m < M; m++)
+            {
+                double wMax = 0;
+                for (size_t k = 0; k < K; k++)
+                    wMax = max(wMax, (double) fabs(w(m, k)));
+                double dw = wMax / wRange / 2, dx = xMax / xRange / 2;
+                double bound = 1e-5 * fabs(expected(m, n));
+                for (size_t k = 0; k < K; k++)
+                {
+                    bound += dw * fabs(x(k, n)) + dx * fabs(w(m, k)) + dw * dx;
+                    BOOST_CHECK_LE(fabs(qw.GetDequantizedWeight(k, m) - w(m, k)), dw * (1 + 1e-5));
+                }
+                BOOST_CHECK_LE(fabs(c(m, n) - expected(m, n)), bound);
+            }
+        }
+
+        // transposed output (as used for convolutions), and the scalar code give the same values
+        SMatrix cT(N, M);
+        qw.Multiply(x.BufferPointer(), 1, K, N, cT.BufferPointer(), N, 1);
+        BOOST_CHECK(cT.IsEqualTo(c.Transpose(), 0));
+        const CPUVectorISA isa = SMatrix::GetVectorISA();
+        SMatrix::SetVectorISA(CPUVectorISA::None);
+        SMatrix cScalar(M, N);
+        qw.Multiply(x.BufferPointer(), 1, K, N, cScalar.BufferPointer(), 1, M);
+        SMatrix::SetVectorISA(isa);
+        BOOST_CHECK(cScalar.IsEqualTo(c, 0));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
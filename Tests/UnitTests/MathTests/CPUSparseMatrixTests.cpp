@@ -59,6 +59,71 @@ BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixCopyColumnSliceToDense, RandomSeedFixture
     BOOST_CHECK(dm1.IsEqualTo(dm2, c_epsilonFloatE4));
 }
 
+BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixMaskColumnsValue, RandomSeedFixture)
+{
+    const size_t m = 100;
+    const size_t n = 50;
+    DenseMatrix dm0(m, n);
+    SparseMatrix sm0(MatrixFormat::matrixFormatSparseCSC, m, n, 0);
+
+    dm0.SetUniformRandomValue(-1, 1, IncrementCounter());
+
+    foreach_coord (row, col, dm0)
+    {
+        sm0.SetValue(row, col, dm0(row, col));
+    }
+
+    CPUMatrix<char> mask(1, n);
+    for (size_t j = 0; j < n; j++)
+        mask(0, j) = (j % 3 == 0) ? 0 : 1;
+
+    dm0.MaskColumnsValue(mask, 0);
+    sm0.MaskColumnsValue(mask, 0);
+    DenseMatrix dm1 = sm0.CopyColumnSliceToDense(0, n);
+
+    BOOST_CHECK(dm0.IsEqualTo(dm1, c_epsilonFloatE4));
+}
+
+BOOST_FIXTURE_TEST_CASE(CPUSparseMatrixReshape, RandomSeedFixture)
+{
+    const size_t m = 12;
+    const size_t n = 11;
+    DenseMatrix dm0(m, n);
+    dm0.SetUniformRandomValue(-1, 1, IncrementCounter());
+
+    // a few elements per column, and some empty columns (but not the last one, which SetValue() cannot leave empty)
+    foreach_coord (row, col, dm0)
+    {
+        if ((row * 7 + col * 3) % 5 != 0 || col % 4 == 1)
+            dm0(row, col) = 0;
+    }
+
+    const size_t shapes[][2] = {{33, 4}, {6, 22}, {4, 33}, {132, 1}, {1, 132}};
+    for (const auto& shape : shapes)
+    {
+        SparseMatrix sm0(MatrixFormat::matrixFormatSparseCSC, m, n, 0);
+        foreach_coord (row, col, dm0)
+        {
+            if (dm0(row, col) != 0)
+                sm0.SetValue(row, col, dm0(row, col));
+        }
+
+        DenseMatrix dm1 = dm0;
+        dm1.Reshape(shape[0], shape[1]);
+        sm0.Reshape(shape[0], shape[1]);
+
+        BOOST_CHECK_EQUAL(sm0.GetNumRows(), shape[0]);
+        BOOST_CHECK_EQUAL(sm0.GetNumCols(), shape[1]);
+        DenseMatrix dm2 = sm0.CopyColumnSliceToDense(0, shape[1]);
+        BOOST_CHECK(dm1.IsEqualTo(dm2, c_epsilonFloatE4));
+
+        // and back
+        sm0.Reshape(m, n);
+        DenseMatrix dm3 = sm0.CopyColumnSliceToDense(0, n);
+        BOOST_CHECK(dm0.IsEqualTo(dm3, c_epsilonFloatE4));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
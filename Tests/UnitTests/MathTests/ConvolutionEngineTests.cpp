@@ -5,6 +5,7 @@
 #include "stdafx.h"
 #include <algorithm>
 #include <array>
+#include <random>
 #include "../../../Source/Math/Matrix.h"
 #include "../../../Source/Math/CPUMatrix.h"
 #include "../../../Source/Math/GPUMatrix.h"
@@ -535,6 +536,509 @@ BOOST_AUTO_TEST_CASE(AvgPoolBackward)
     }
 }
 
+// Straightforward batch normalization of 'in' (crow x n, column per sample) for checking the engines.
+// 'channelOfRow' maps the rows of a sample to the normalization channels.
+struct BatchNormReference
+{
+    vector<double> mean, invStdDev, out, dx, dScale, dBias;
+
+    BatchNormReference(const vec& in, const vec& dy, const vec& scale, const vec& bias, size_t crow, size_t n, const vector<size_t>& channelOfRow, size_t numChannels)
+        : mean(numChannels, 0), invStdDev(numChannels, 0), out(in.size()), dx(in.size()), dScale(numChannels, 0), dBias(numChannels, 0)
+    {
+        const double eps = 1e-5;
+        double count = (double) crow / numChannels * n;
+        for (size_t j = 0; j < n; j++)
+            for (size_t r = 0; r < crow; r++)
+                mean[channelOfRow[r]] += in[j * crow + r] / count;
+        for (size_t j = 0; j < n; j++)
+            for (size_t r = 0; r < crow; r++)
+                invStdDev[channelOfRow[r]] += pow(in[j * crow + r] - mean[channelOfRow[r]], 2) / count;
+        for (size_t c = 0; c < numChannels; c++)
+            invStdDev[c] = 1 / sqrt(invStdDev[c] + eps);
+        for (size_t j = 0; j < n; j++)
+        {
+            for (size_t r = 0; r < crow; r++)
+            {
+                size_t c = channelOfRow[r];
+                double xHat = (in[j * crow + r] - mean[c]) * invStdDev[c];
+                out[j * crow + r] = scale[c] * xHat + bias[c];
+                dBias[c] += dy[j * crow + r];
+                dScale[c] += dy[j * crow + r] * xHat;
+            }
+        }
+        for (size_t j = 0; j < n; j++)
+        {
+            for (size_t r = 0; r < crow; r++)
+            {
+                size_t c = channelOfRow[r];
+                double xHat = (in[j * crow + r] - mean[c]) * invStdDev[c];
+                dx[j * crow + r] = scale[c] * invStdDev[c] * (dy[j * crow + r] - (dBias[c] + xHat * dScale[c]) / count);
+            }
+        }
+    }
+};
+
+static bool AreClose(const SingleMatrix& m, const vector<double>& expected, size_t count, double tolerance = 1e-4)
+{
+    unique_ptr<float[]> values(m.CopyToArray());
+    for (size_t i = 0; i < count; i++)
+    {
+        if (fabs(values[i] - expected[i]) > tolerance * max(1.0, fabs(expected[i])))
+            return false;
+    }
+    return true;
+}
+
+static void TestBatchNormalizationOnCpu(bool spatial, ImageLayoutKind imageLayoutKind)
+{
+    size_t n = 7;
+    size_t cmap = 3;
+    size_t inW = 5;
+    size_t inH = 4;
+    size_t crow = inW * inH * cmap;
+    size_t numChannels = spatial ? cmap : crow;
+    int deviceId = -1;
+
+    auto fact = ConvFact::Create(deviceId, ConvFact::EngineType::Legacy, imageLayoutKind);
+    auto eng = fact->CreateConvEngine(deviceId, 0);
+    auto inT = spatial ? fact->CreateTensor(inW, inH, cmap, n) : fact->CreateTensor(crow, 1, 1, n);
+    auto scaleBiasT = spatial ? fact->CreateTensor(1, 1, cmap, 1) : fact->CreateTensor(crow, 1, 1, 1);
+
+    vector<size_t> channelOfRow(crow);
+    for (size_t r = 0; r < crow; r++)
+        channelOfRow[r] = !spatial ? r : imageLayoutKind == ImageLayoutKind::CHW ? r / (inW * inH) : r % cmap;
+
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-2, 3);
+    auto random = [&](size_t size)
+    {
+        vec v(size);
+        std::generate(v.begin(), v.end(), [&] { return dist(rng); });
+        return v;
+    };
+    vec inBuf = random(crow * n);
+    vec dyBuf = random(crow * n);
+    vec scaleBuf = random(numChannels);
+    vec biasBuf = random(numChannels);
+    BatchNormReference ref(inBuf, dyBuf, scaleBuf, biasBuf, crow, n, channelOfRow, numChannels);
+
+    SingleMatrix in(crow, n, inBuf.data(), matrixFlagNormal, deviceId);
+    SingleMatrix scale(numChannels, 1, scaleBuf.data(), matrixFlagNormal, deviceId);
+    SingleMatrix bias(numChannels, 1, biasBuf.data(), matrixFlagNormal, deviceId);
+    SingleMatrix runMean(numChannels, 1, deviceId);
+    SingleMatrix runInvStdDev(numChannels, 1, deviceId);
+    runMean.SetValue(1);
+    runInvStdDev.SetValue(1);
+    SingleMatrix saveMean(numChannels, 1, deviceId);
+    SingleMatrix saveInvStdDev(numChannels, 1, deviceId);
+    SingleMatrix out(crow, n, deviceId);
+
+    double expAvgFactor = 0.25;
+    eng->NormalizeBatch(*inT, in, *scaleBiasT, scale, bias, spatial, expAvgFactor, runMean, runInvStdDev, out, saveMean, saveInvStdDev);
+    BOOST_CHECK(AreClose(out, ref.out, crow * n));
+    BOOST_CHECK(AreClose(saveMean, ref.mean, numChannels));
+    BOOST_CHECK(AreClose(saveInvStdDev, ref.invStdDev, numChannels));
+    vector<double> expRunMean(numChannels), expRunInvStdDev(numChannels);
+    for (size_t c = 0; c < numChannels; c++)
+    {
+        expRunMean[c] = (1 - expAvgFactor) + expAvgFactor * ref.mean[c];
+        expRunInvStdDev[c] = (1 - expAvgFactor) + expAvgFactor * ref.invStdDev[c];
+    }
+    BOOST_CHECK(AreClose(runMean, expRunMean, numChannels));
+    BOOST_CHECK(AreClose(runInvStdDev, expRunInvStdDev, numChannels));
+
+    // inference with the minibatch statistics must give the same result as training
+    SingleMatrix outInference(crow, n, deviceId);
+    eng->NormalizeBatchInference(*inT, in, *scaleBiasT, scale, bias, spatial, saveMean, saveInvStdDev, outInference);
+    BOOST_CHECK(AreClose(outInference, ref.out, crow * n));
+
+    // backward adds to the input gradient
+    SingleMatrix dy(crow, n, dyBuf.data(), matrixFlagNormal, deviceId);
+    SingleMatrix dx(crow, n, deviceId);
+    dx.SetValue(1);
+    SingleMatrix dScale(numChannels, 1, deviceId);
+    SingleMatrix dBias(numChannels, 1, deviceId);
+    eng->BackwardNormalizeBatch(*inT, in, dy, dx, *scaleBiasT, scale, spatial, saveMean, saveInvStdDev, dScale, dBias);
+    for (auto& v : ref.dx)
+        v += 1;
+    BOOST_CHECK(AreClose(dx, ref.dx, crow * n));
+    BOOST_CHECK(AreClose(dScale, ref.dScale, numChannels));
+    BOOST_CHECK(AreClose(dBias, ref.dBias, numChannels));
+}
+
+BOOST_AUTO_TEST_CASE(BatchNormalizationCpuPerActivation)
+{
+    TestBatchNormalizationOnCpu(false, ImageLayoutKind::CHW);
+}
+
+BOOST_AUTO_TEST_CASE(BatchNormalizationCpuSpatial)
+{
+    TestBatchNormalizationOnCpu(true, ImageLayoutKind::CHW);
+    TestBatchNormalizationOnCpu(true, ImageLayoutKind::HWC);
+}
+
+// the CPU engine must match the cuDNN engine, including the running statistics
+BOOST_AUTO_TEST_CASE(BatchNormalizationCpuMatchesCuDnn)
+{
+    if (!IsCuDnnSupported())
+        return;
+
+    size_t n = 16;
+    size_t cmap = 4;
+    size_t inW = 6;
+    size_t inH = 6;
+    size_t crow = inW * inH * cmap;
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> dist(-1, 1);
+    auto random = [&](size_t size)
+    {
+        vec v(size);
+        std::generate(v.begin(), v.end(), [&] { return dist(rng); });
+        return v;
+    };
+
+    for (bool spatial : {false, true})
+    {
+        size_t numChannels = spatial ? cmap : crow;
+        vec inBuf = random(crow * n);
+        vec dyBuf = random(crow * n);
+        vec scaleBuf = random(numChannels);
+        vec biasBuf = random(numChannels);
+
+        vector<unique_ptr<SingleMatrix>> results[2];
+        for (int deviceId : {-1, 0})
+        {
+            auto fact = ConvFact::Create(deviceId, deviceId < 0 ? ConvFact::EngineType::Legacy : ConvFact::EngineType::CuDnn, ImageLayoutKind::CHW);
+            auto eng = fact->CreateConvEngine(deviceId, 0);
+            auto inT = spatial ? fact->CreateTensor(inW, inH, cmap, n) : fact->CreateTensor(crow, 1, 1, n);
+            auto scaleBiasT = spatial ? fact->CreateTensor(1, 1, cmap, 1) : fact->CreateTensor(crow, 1, 1, 1);
+
+            SingleMatrix in(crow, n, inBuf.data(), matrixFlagNormal, deviceId);
+            SingleMatrix scale(numChannels, 1, scaleBuf.data(), matrixFlagNormal, deviceId);
+            SingleMatrix bias(numChannels, 1, biasBuf.data(), matrixFlagNormal, deviceId);
+            auto runMean = make_unique<SingleMatrix>(numChannels, 1, deviceId);
+            auto runInvStdDev = make_unique<SingleMatrix>(numChannels, 1, deviceId);
+            runMean->SetValue(0);
+            runInvStdDev->SetValue(0);
+            SingleMatrix saveMean(numChannels, 1, deviceId);
+            SingleMatrix saveInvStdDev(numChannels, 1, deviceId);
+            auto out = make_unique<SingleMatrix>(crow, n, deviceId);
+            eng->NormalizeBatch(*inT, in, *scaleBiasT, scale, bias, spatial, 0.5, *runMean, *runInvStdDev, *out, saveMean, saveInvStdDev);
+
+            SingleMatrix dy(crow, n, dyBuf.data(), matrixFlagNormal, deviceId);
+            auto dx = make_unique<SingleMatrix>(crow, n, deviceId);
+            dx->SetValue(0);
+            auto dScale = make_unique<SingleMatrix>(numChannels, 1, deviceId);
+            auto dBias = make_unique<SingleMatrix>(numChannels, 1, deviceId);
+            eng->BackwardNormalizeBatch(*inT, in, dy, *dx, *scaleBiasT, scale, spatial, saveMean, saveInvStdDev, *dScale, *dBias);
+
+            auto& result = results[deviceId < 0 ? 0 : 1];
+            result.push_back(move(out));
+            result.push_back(move(runMean));
+            result.push_back(move(runInvStdDev));
+            result.push_back(move(dx));
+            result.push_back(move(dScale));
+            result.push_back(move(dBias));
+        }
+        for (size_t i = 0; i < results[0].size(); i++)
+        {
+            results[1][i]->TransferToDeviceIfNotThere(-1);
+            BOOST_CHECK(results[0][i]->IsEqualTo(*results[1][i], 1e-3f));
+        }
+    }
+}
+
+// offsets of an image element (channel c, row y, column x) and of a filter weight in a given layout
+struct ImageLayoutIndex
+{
+    size_t w, h, c;
+    bool chw;
+
+    size_t operator()(size_t ic, size_t y, size_t x) const
+    {
+        return chw ? (ic * h + y) * w + x : ic + c * (y + h * x);
+    }
+};
+
+static size_t FilterIndex(bool chw, size_t k, size_t c, size_t y, size_t x, size_t cmapIn, size_t cmapOut, size_t kW, size_t kH)
+{
+    return chw ? ((k * cmapIn + c) * kH + y) * kW + x : k + cmapOut * ((c * kW + x) * kH + y);
+}
+
+// compares forward and backprop of the CPU convolution engine with a naive double-precision convolution
+static void TestConvolutionOnCpu(int inW, int inH, int cmapIn, int cmapOut, int kW, int kH, int sW, int sH, bool pad, ImageLayoutKind imageLayoutKind, size_t maxTempMemSizeInSamples = 0)
+{
+    int n = 3;
+    int outW = GetNumOut(inW, kW, sW, pad);
+    int outH = GetNumOut(inH, kH, sH, pad);
+    int padW = pad ? kW / 2 : 0;
+    int padH = pad ? kH / 2 : 0;
+    bool chw = imageLayoutKind == ImageLayoutKind::CHW;
+    int deviceId = -1;
+
+    auto fact = ConvFact::Create(deviceId, ConvFact::EngineType::Cpu, imageLayoutKind);
+    auto eng = fact->CreateConvEngine(deviceId, maxTempMemSizeInSamples);
+    auto inT = fact->CreateTensor(inW, inH, cmapIn, n);
+    auto filtT = fact->CreateFilter(kW, kH, cmapIn, cmapOut);
+    auto outT = fact->CreateTensor(outW, outH, cmapOut, n);
+    auto convT = fact->CreateConvDescriptor(*inT, *filtT, sW, sH, pad);
+
+    size_t inSize = inW * inH * cmapIn;
+    size_t outSize = outW * outH * cmapOut;
+    size_t filtSize = kW * kH * cmapIn * cmapOut;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-1, 1);
+    auto random = [&](size_t size)
+    {
+        vec v(size);
+        std::generate(v.begin(), v.end(), [&] { return dist(rng); });
+        return v;
+    };
+    vec inBuf = random(inSize * n);
+    vec filtBuf = random(filtSize);
+    vec dyBuf = random(outSize * n);
+
+    vector<double> expOut(outSize * n, 0);
+    vector<double> expDx(inSize * n, 1); // gradients are accumulated into 1
+    vector<double> expDw(filtSize, 1);
+    ImageLayoutIndex inIndex = {(size_t) inW, (size_t) inH, (size_t) cmapIn, chw};
+    ImageLayoutIndex outIndex = {(size_t) outW, (size_t) outH, (size_t) cmapOut, chw};
+    for (int s = 0; s < n; s++)
+        for (int k = 0; k < cmapOut; k++)
+            for (int oy = 0; oy < outH; oy++)
+                for (int ox = 0; ox < outW; ox++)
+                    for (int c = 0; c < cmapIn; c++)
+                        for (int ky = 0; ky < kH; ky++)
+                            for (int kx = 0; kx < kW; kx++)
+                            {
+                                int iy = oy * sH + ky - padH;
+                                int ix = ox * sW + kx - padW;
+                                if (iy < 0 || iy >= inH || ix < 0 || ix >= inW)
+                                    continue;
+                                size_t i = s * inSize + inIndex(c, iy, ix);
+                                size_t o = s * outSize + outIndex(k, oy, ox);
+                                size_t f = FilterIndex(chw, k, c, ky, kx, cmapIn, cmapOut, kW, kH);
+                                expOut[o] += (double) filtBuf[f] * inBuf[i];
+                                expDx[i] += (double) filtBuf[f] * dyBuf[o];
+                                expDw[f] += (double) inBuf[i] * dyBuf[o];
+                            }
+
+    SingleMatrix in(inSize, n, inBuf.data(), matrixFlagNormal, deviceId);
+    SingleMatrix filt(cmapOut, kW * kH * cmapIn, filtBuf.data(), matrixFlagNormal, deviceId);
+    SingleMatrix out(outSize, n, deviceId);
+    SingleMatrix temp(deviceId);
+    eng->Forward(*inT, in, *filtT, filt, *convT, *outT, out, temp);
+    BOOST_CHECK(AreClose(out, expOut, outSize * n));
+
+    // 8-bit weights: every product is off by at most half a quantization step of the weight (|x| <= 1) plus one of the input (|w| <= 1)
+    auto quantizedFilt = eng->QuantizeFilter(*filtT, filt, 8);
+    SingleMatrix quantizedOut(outSize, n, deviceId);
+    eng->ForwardQuantized(*inT, in, *filtT, *quantizedFilt, *convT, *outT, quantizedOut, temp);
+    BOOST_CHECK(AreClose(quantizedOut, expOut, outSize * n, kW * kH * cmapIn * 0.5 * (1.0 / 127 + 1.0 / 8192)));
+
+    SingleMatrix dy(outSize, n, dyBuf.data(), matrixFlagNormal, deviceId);
+    SingleMatrix dx(inSize, n, deviceId);
+    dx.SetValue(1);
+    eng->BackwardData(*outT, dy, *filtT, filt, *convT, *inT, dx, temp);
+    BOOST_CHECK(AreClose(dx, expDx, inSize * n));
+
+    SingleMatrix dw(cmapOut, kW * kH * cmapIn, deviceId);
+    dw.SetValue(1);
+    eng->BackwardFilter(*outT, dy, *inT, in, *convT, *filtT, dw, false, temp);
+    BOOST_CHECK(AreClose(dw, expDw, filtSize));
+}
+
+static void TestConvolutionOnCpu(ImageLayoutKind imageLayoutKind)
+{
+    for (bool pad : {false, true})
+    {
+        TestConvolutionOnCpu(9, 7, 16, 17, 3, 3, 1, 1, pad, imageLayoutKind);    // Winograd
+        TestConvolutionOnCpu(8, 8, 16, 16, 3, 3, 1, 1, pad, imageLayoutKind, 2); // Winograd in sub-batches
+        TestConvolutionOnCpu(11, 9, 3, 5, 3, 3, 2, 2, pad, imageLayoutKind);     // direct, strided
+        TestConvolutionOnCpu(10, 6, 2, 6, 4, 2, 1, 1, pad, imageLayoutKind);     // direct, even filter size
+        TestConvolutionOnCpu(9, 9, 8, 7, 5, 5, 2, 1, pad, imageLayoutKind);      // unrolling and GEMM
+        TestConvolutionOnCpu(6, 5, 40, 9, 1, 1, 1, 1, pad, imageLayoutKind, 2);  // 1x1 filter, no unrolling
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ConvolutionCpuChw)
+{
+    TestConvolutionOnCpu(ImageLayoutKind::CHW);
+}
+
+BOOST_AUTO_TEST_CASE(ConvolutionCpuHwc)
+{
+    TestConvolutionOnCpu(ImageLayoutKind::HWC);
+}
+
+// same data as ConvolutionForward, which checks the cuDNN engine
+BOOST_AUTO_TEST_CASE(ConvolutionForwardCpuChw)
+{
+    int n = 2;
+    int cmapIn = 3;
+    int inW = 5;
+    int inH = 5;
+    int kW = 3;
+    int kH = 3;
+    int cmapOut = 2;
+    int outW = GetNumOut(inW, kW, 2, false);
+    int outH = GetNumOut(inH, kH, 2, false);
+    int deviceId = -1;
+
+    auto fact = ConvFact::Create(deviceId, ConvFact::EngineType::Cpu, ImageLayoutKind::CHW);
+    auto eng = fact->CreateConvEngine(deviceId, 0);
+    auto inT = fact->CreateTensor(inW, inH, cmapIn, n);
+    auto filtT = fact->CreateFilter(kW, kH, cmapIn, cmapOut);
+    auto outT = fact->CreateTensor(outW, outH, cmapOut, n);
+    auto convT = fact->CreateConvDescriptor(*inT, *filtT, 2, 2, false);
+
+    vec buf(inW * inH * cmapIn * n);
+    int seed = 0;
+    std::generate(buf.begin(), buf.end(), [=, &seed] { return seed++ % (inW * inH * cmapIn); });
+    SingleMatrix in(inW * inH * cmapIn, n, buf.data(), matrixFlagNormal, deviceId);
+    seed = 0;
+    buf.resize(kW * kH * cmapIn * cmapOut);
+    std::generate(buf.begin(), buf.end(), [=, &seed] { return seed++ % (kW * kH * cmapIn); });
+    SingleMatrix filt(cmapOut, kW * kH * cmapIn, buf.data(), matrixFlagNormal, deviceId);
+    SingleMatrix out(outW * outH * cmapOut, n, deviceId);
+    SingleMatrix temp(deviceId);
+
+    eng->Forward(*inT, in, *filtT, filt, *convT, *outT, out, temp);
+
+    std::array<float, 4 * 2 * 2> expBuf = {
+        15219.0f, 15921.0f, 18729.0f, 19431.0f,
+        15219.0f, 15921.0f, 18729.0f, 19431.0f,
+        15219.0f, 15921.0f, 18729.0f, 19431.0f,
+        15219.0f, 15921.0f, 18729.0f, 19431.0f};
+    SingleMatrix exp(outW * outH * cmapOut, n, expBuf.data(), matrixFlagNormal, deviceId);
+    BOOST_CHECK_MESSAGE(out.IsEqualTo(exp), "Unexpected convolution output.");
+
+    float b[] = {1.0f, 2.0f};
+    auto biasT = fact->CreateTensor(1, 1, cmapOut, 1);
+    SingleMatrix bias(cmapOut, 1, b, matrixFlagNormal, deviceId);
+    SingleMatrix plusB(outW * outH * cmapOut, n, deviceId);
+    eng->AddBias(*outT, out, *biasT, bias, plusB);
+    seed = 0;
+    std::transform(expBuf.begin(), expBuf.end(), expBuf.begin(), [=, &seed, &b](const float& a)
+                   {
+                       return a + b[(seed++ % (outW * outH * cmapOut)) / (outW * outH)];
+                   });
+    SingleMatrix expPlusB(outW * outH * cmapOut, n, expBuf.data(), matrixFlagNormal, deviceId);
+    BOOST_CHECK_MESSAGE(plusB.IsEqualTo(expPlusB), "Unexpected (convolution + bias) output.");
+}
+
+// pooling of the CPU engine in both layouts, including padding, against a naive implementation
+BOOST_AUTO_TEST_CASE(PoolingCpu)
+{
+    int n = 2;
+    int cmap = 3;
+    int inW = 7;
+    int inH = 6;
+    int wW = 3;
+    int wH = 2;
+    int sW = 2;
+    int sH = 2;
+    int deviceId = -1;
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-1, 1);
+
+    for (auto imageLayoutKind : {ImageLayoutKind::CHW, ImageLayoutKind::HWC})
+    {
+        for (auto kind : {PoolingDescriptor::PoolKind::Max, PoolingDescriptor::PoolKind::Average})
+        {
+            for (int pad : {0, 1})
+            {
+                int outW = (inW + 2 * pad - wW) / sW + 1;
+                int outH = (inH + 2 * pad - wH) / sH + 1;
+                size_t inSize = inW * inH * cmap;
+                size_t outSize = outW * outH * cmap;
+                bool chw = imageLayoutKind == ImageLayoutKind::CHW;
+                ImageLayoutIndex inIndex = {(size_t) inW, (size_t) inH, (size_t) cmap, chw};
+                ImageLayoutIndex outIndex = {(size_t) outW, (size_t) outH, (size_t) cmap, chw};
+
+                vec inBuf(inSize * n);
+                vec dyBuf(outSize * n);
+                std::generate(inBuf.begin(), inBuf.end(), [&] { return dist(rng); });
+                std::generate(dyBuf.begin(), dyBuf.end(), [&] { return dist(rng); });
+                vector<double> expOut(outSize * n);
+                vector<double> expDx(inSize * n, 0);
+                for (int s = 0; s < n; s++)
+                    for (int c = 0; c < cmap; c++)
+                        for (int oy = 0; oy < outH; oy++)
+                            for (int ox = 0; ox < outW; ox++)
+                            {
+                                vector<size_t> window;
+                                for (int y = max(0, oy * sH - pad); y < min(inH, oy * sH - pad + wH); y++)
+                                    for (int x = max(0, ox * sW - pad); x < min(inW, ox * sW - pad + wW); x++)
+                                        window.push_back(s * inSize + inIndex(c, y, x));
+                                size_t o = s * outSize + outIndex(c, oy, ox);
+                                if (kind == PoolingDescriptor::PoolKind::Max)
+                                {
+                                    size_t argMax = *std::max_element(window.begin(), window.end(), [&](size_t a, size_t b) { return inBuf[a] < inBuf[b]; });
+                                    expOut[o] = inBuf[argMax];
+                                    expDx[argMax] += dyBuf[o];
+                                }
+                                else
+                                {
+                                    expOut[o] = 0;
+                                    for (size_t i : window)
+                                        expOut[o] += inBuf[i] / window.size();
+                                    for (size_t i : window)
+                                        expDx[i] += dyBuf[o] / window.size();
+                                }
+                            }
+
+                auto fact = ConvFact::Create(deviceId, ConvFact::EngineType::Cpu, imageLayoutKind);
+                auto eng = fact->CreatePoolEngine(deviceId);
+                auto inT = fact->CreateTensor(inW, inH, cmap, n);
+                auto outT = fact->CreateTensor(outW, outH, cmap, n);
+                auto poolT = fact->CreatePoolDescriptor(kind, wW, wH, sW, sH, pad, pad);
+
+                SingleMatrix in(inSize, n, inBuf.data(), matrixFlagNormal, deviceId);
+                SingleMatrix out(outSize, n, deviceId);
+                eng->Forward(*inT, in, *poolT, *outT, out);
+                BOOST_CHECK(AreClose(out, expOut, outSize * n));
+
+                SingleMatrix dy(outSize, n, dyBuf.data(), matrixFlagNormal, deviceId);
+                SingleMatrix dx(inSize, n, deviceId);
+                dx.SetValue(0);
+                eng->Backward(*outT, out, dy, *poolT, *inT, in, dx);
+                BOOST_CHECK(AreClose(dx, expDx, inSize * n));
+            }
+        }
+    }
+}
+
+// max pooling of the CPU engine over windows that lie entirely in the padding yields the padding value 0,
+// and such windows pass no gradient back
+BOOST_AUTO_TEST_CASE(MaxPoolCpuFullyPaddedWindow)
+{
+    int deviceId = -1;
+    for (auto imageLayoutKind : {ImageLayoutKind::CHW, ImageLayoutKind::HWC})
+    {
+        // a 1x1 image, 2x2 windows with stride 2 and padding 2: only the last of the 2x2 outputs covers the pixel
+        auto fact = ConvFact::Create(deviceId, ConvFact::EngineType::Cpu, imageLayoutKind);
+        auto eng = fact->CreatePoolEngine(deviceId);
+        auto inT = fact->CreateTensor(1, 1, 1, 1);
+        auto outT = fact->CreateTensor(2, 2, 1, 1);
+        auto poolT = fact->CreatePoolDescriptor(PoolingDescriptor::PoolKind::Max, 2, 2, 2, 2, 2, 2);
+
+        float inBuf[] = {-5};
+        SingleMatrix in(1, 1, inBuf, matrixFlagNormal, deviceId);
+        SingleMatrix out(4, 1, deviceId);
+        eng->Forward(*inT, in, *poolT, *outT, out);
+        BOOST_CHECK(AreClose(out, {0, 0, 0, -5}, 4));
+
+        float dyBuf[] = {1, 2, 3, 4};
+        SingleMatrix dy(4, 1, dyBuf, matrixFlagNormal, deviceId);
+        SingleMatrix dx(1, 1, deviceId);
+        dx.SetValue(0);
+        eng->Backward(*outT, out, dy, *poolT, *inT, in, dx);
+        BOOST_CHECK(AreClose(dx, {4}, 1));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
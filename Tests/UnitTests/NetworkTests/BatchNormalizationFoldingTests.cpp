@@ -0,0 +1,146 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// BatchNormalizationFoldingTests.cpp -- the output of a network before and after FoldBatchNormalizationNodes()
+//
+#include "stdafx.h"
+#include "TrainingNodes.h"
+#include "ConvolutionalNodes.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+static const size_t numSamples = 5;
+static const size_t inputDim = 6;   // dense layer
+static const size_t outputDim = 4;
+static const size_t imageWidth = 5; // convolution layer
+static const size_t imageHeight = 4;
+static const size_t inputChannels = 2;
+static const size_t outputChannels = 3;
+static const size_t kernelSize = 3;
+
+// one dense or convolution layer, optionally with a bias, followed by a BatchNormalization node in inference mode and a Tanh
+class BatchNormalizationTestNetwork
+{
+    typedef shared_ptr<ComputationNode<double>> ComputationNodePtr;
+
+public:
+    BatchNormalizationTestNetwork(bool convolution, ImageLayoutKind imageLayoutKind, bool withBias)
+        : m_net(make_shared<ComputationNetwork>(CPUDEVICE))
+    {
+        ComputationNetworkBuilder<double> builder(*m_net);
+        ComputationNodePtr linear;
+        size_t numChannels;
+        if (convolution)
+        {
+            numChannels = outputChannels;
+            m_features = builder.CreateInputNode(L"features", ImageDimensions::AsTensorShape(imageWidth, imageHeight, inputChannels, imageLayoutKind));
+            auto W = Parameter(builder, L"W", TensorShape(outputChannels, kernelSize * kernelSize * inputChannels), 1);
+            linear = builder.Convolution(W, m_features, kernelSize, kernelSize, outputChannels, 1, 1, imageLayoutKind, /*zeroPadding=*/true);
+        }
+        else
+        {
+            numChannels = outputDim;
+            m_features = builder.CreateInputNode(L"features", inputDim);
+            auto W = Parameter(builder, L"W", TensorShape(outputDim, inputDim), 1);
+            linear = builder.Times(W, m_features);
+        }
+        m_net->FeatureNodes().push_back(m_features);
+        if (withBias)
+        {
+            auto biasShape = convolution ? ImageDimensions::AsTensorShape(1, 1, numChannels, imageLayoutKind) : TensorShape(numChannels);
+            linear = builder.Plus(linear, Parameter(builder, L"b", biasShape, 2));
+        }
+        auto scale = Parameter(builder, L"scale", TensorShape(numChannels, 1), 3);
+        auto bias = Parameter(builder, L"bias", TensorShape(numChannels, 1), 4);
+        auto runMean = Parameter(builder, L"runMean", TensorShape(numChannels, 1), 5);
+        auto runInvStdDev = Parameter(builder, L"runInvStdDev", TensorShape(numChannels, 1), 6);
+        runInvStdDev->Value().InplaceAbs();
+        runInvStdDev->Value() += 0.5;
+        auto bn = builder.BatchNormalization(linear, scale, bias, runMean, runInvStdDev, /*eval=*/true, /*spatial=*/convolution, 1, imageLayoutKind, L"bn");
+        m_output = builder.Tanh(bn, L"output");
+        m_net->OutputNodes().push_back(m_output);
+        m_net->CompileNetwork();
+    }
+
+    size_t Fold()
+    {
+        size_t numFolded = m_net->FoldBatchNormalizationNodes<double>();
+        if (numFolded > 0)
+            m_net->CompileNetwork();
+        return numFolded;
+    }
+
+    bool HasNode(const wstring& name) const
+    {
+        return m_net->NodeNameExists(name);
+    }
+
+    Matrix<double> Evaluate()
+    {
+        ComputationNodeBasePtr output = m_output; // (not the overloads for node lists)
+        m_net->AllocateAllMatrices({output}, {}, nullptr);
+        m_net->StartEvaluateMinibatchLoop(output);
+        auto pMBLayout = m_net->GetMBLayoutPtr();
+        pMBLayout->InitAsFrameMode(numSamples);
+        m_features->Value().SetValue(Matrix<double>::RandomUniform(m_features->GetSampleLayout().GetNumElements(), numSamples, -1, 1, 10, CPUDEVICE));
+        m_net->NotifyInputNodesFunctionValuesMBSizeModified();
+        ComputationNetwork::BumpEvalTimeStamp(m_net->FeatureNodes());
+        m_net->ForwardProp(output);
+        return Matrix<double>(m_output->Value(), CPUDEVICE);
+    }
+
+private:
+    ComputationNodePtr Parameter(ComputationNetworkBuilder<double>& builder, const wstring& name, const TensorShape& shape, unsigned long randomSeed)
+    {
+        auto node = builder.CreateLearnableParameter(name, shape);
+        node->Value().SetValue(Matrix<double>::RandomUniform(node->Value().GetNumRows(), node->Value().GetNumCols(), -0.5, 0.5, randomSeed, CPUDEVICE));
+        return node;
+    }
+
+    ComputationNetworkPtr m_net;
+    ComputationNodePtr m_features, m_output;
+};
+
+static void TestFolding(bool convolution, ImageLayoutKind imageLayoutKind, bool withBias)
+{
+    BatchNormalizationTestNetwork reference(convolution, imageLayoutKind, withBias);
+    BatchNormalizationTestNetwork folded(convolution, imageLayoutKind, withBias);
+    BOOST_REQUIRE_EQUAL(folded.Fold(), 1);
+    // with a bias, the BN node is removed; otherwise it only adds the folded bias
+    BOOST_CHECK_EQUAL(folded.HasNode(L"bn"), !withBias);
+
+    Matrix<double> expected = reference.Evaluate();
+    Matrix<double> actual = folded.Evaluate();
+    BOOST_REQUIRE_EQUAL(actual.GetNumRows(), expected.GetNumRows());
+    BOOST_REQUIRE_EQUAL(actual.GetNumCols(), expected.GetNumCols());
+    for (size_t j = 0; j < expected.GetNumCols(); j++)
+        for (size_t i = 0; i < expected.GetNumRows(); i++)
+            BOOST_CHECK_MESSAGE(fabs(actual(i, j) - expected(i, j)) <= 1e-10,
+                                "output (" << i << "," << j << "): " << actual(i, j) << " vs. " << expected(i, j));
+}
+
+BOOST_AUTO_TEST_SUITE(BatchNormalizationFoldingSuite)
+
+BOOST_AUTO_TEST_CASE(FoldBatchNormalizationDense)
+{
+    TestFolding(false, ImageLayoutKind::CHW, true);
+    TestFolding(false, ImageLayoutKind::CHW, false);
+}
+
+BOOST_AUTO_TEST_CASE(FoldBatchNormalizationConvolutionChw)
+{
+    TestFolding(true, ImageLayoutKind::CHW, true);
+    TestFolding(true, ImageLayoutKind::CHW, false);
+}
+
+BOOST_AUTO_TEST_CASE(FoldBatchNormalizationConvolutionHwc)
+{
+    TestFolding(true, ImageLayoutKind::HWC, true);
+    TestFolding(true, ImageLayoutKind::HWC, false);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
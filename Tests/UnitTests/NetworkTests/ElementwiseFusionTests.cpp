@@ -0,0 +1,155 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// ElementwiseFusionTests.cpp -- compare a network whose elementwise nodes are fused (g_fuseElementwiseNodes) against the same network unfused
+//
+#include "stdafx.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+static const size_t inputDim = 6;
+static const size_t hiddenDim = 5;
+static const size_t outputDim = 4;
+static const size_t numSamples = 7;
+
+// sets g_fuseElementwiseNodes for the lifetime of the object
+class FuseElementwiseNodes
+{
+public:
+    FuseElementwiseNodes(bool fuse)
+        : m_savedFuse(g_fuseElementwiseNodes)
+    {
+        g_fuseElementwiseNodes = fuse;
+    }
+    ~FuseElementwiseNodes()
+    {
+        g_fuseElementwiseNodes = m_savedFuse;
+    }
+
+private:
+    bool m_savedFuse;
+};
+
+// h = ReLU(Sigmoid(W1 * features + b1) .* Tanh(W2 * features - b2)), output = Sigmoid(Log(Exp(V * h) + c)),
+// with the criterion |output - targets|^2 / 2
+// This has one group of six elementwise nodes up to h, and one of four up to the output,
+// whose root must keep its value; the biases are read as broadcast operands.
+class FusionTestNetwork
+{
+    typedef shared_ptr<ComputationNode<double>> ComputationNodePtr;
+
+public:
+    FusionTestNetwork(bool fuse)
+        : m_net(make_shared<ComputationNetwork>(CPUDEVICE))
+    {
+        ComputationNetworkBuilder<double> builder(*m_net);
+        m_features = builder.CreateInputNode(L"features", inputDim);
+        m_targets = builder.CreateInputNode(L"targets", outputDim);
+        m_net->FeatureNodes().push_back(m_features);
+        m_net->FeatureNodes().push_back(m_targets);
+        auto W1 = Parameter(builder, L"W1", hiddenDim, inputDim, 1);
+        auto W2 = Parameter(builder, L"W2", hiddenDim, inputDim, 2);
+        auto b1 = Parameter(builder, L"b1", hiddenDim, 1, 3);
+        auto b2 = Parameter(builder, L"b2", hiddenDim, 1, 4);
+        auto V = Parameter(builder, L"V", outputDim, hiddenDim, 5);
+        auto c = Parameter(builder, L"c", outputDim, 1, 6);
+        c->Value().SetValue(Matrix<double>::RandomUniform(outputDim, 1, 0.5, 1.5, 6, CPUDEVICE)); // (positive, for the Log)
+        auto gate = builder.Sigmoid(builder.Plus(builder.Times(W1, m_features), b1));
+        auto h = builder.RectifiedLinear(builder.ElementTimes(gate, builder.Tanh(builder.Minus(builder.Times(W2, m_features), b2))), L"h");
+        m_output = builder.Sigmoid(builder.Log(builder.Plus(builder.Exp(builder.Times(V, h)), c)), L"output");
+        m_criterion = builder.SquareError(m_targets, m_output, L"criterion");
+        m_net->FinalCriterionNodes().push_back(m_criterion);
+        m_net->OutputNodes().push_back(m_output);
+        m_net->OutputNodes().push_back(h); // (so that it gets an evaluation order of its own)
+
+        FuseElementwiseNodes fusion(fuse);
+        m_net->CompileNetwork();
+        m_net->AllocateAllMatrices({}, {m_output, h}, m_criterion); // (h keeps its value, to be compared)
+        m_net->StartEvaluateMinibatchLoop(m_criterion);
+    }
+
+    void RunMinibatch(unsigned long randomSeed)
+    {
+        m_net->GetMBLayoutPtr()->InitAsFrameMode(numSamples);
+        m_features->Value().SetValue(Matrix<double>::RandomUniform(inputDim, numSamples, -1, 1, randomSeed, CPUDEVICE));
+        m_targets->Value().SetValue(Matrix<double>::RandomUniform(outputDim, numSamples, 0, 1, randomSeed + 1, CPUDEVICE));
+        m_net->NotifyInputNodesFunctionValuesMBSizeModified();
+        ComputationNetwork::BumpEvalTimeStamp(m_net->FeatureNodes());
+        m_net->ForwardProp(m_criterion);
+        m_net->Backprop(m_criterion);
+    }
+
+    // the fused group that computes the given node, or null
+    shared_ptr<FusedElementwiseGroup> GetFusedGroup(const wstring& name) const
+    {
+        return m_net->GetNodeFromName(name)->GetFusedElementwiseGroup();
+    }
+
+    Matrix<double> GetValue(const wstring& name) const
+    {
+        return Matrix<double>(dynamic_pointer_cast<ComputationNode<double>>(m_net->GetNodeFromName(name))->Value(), CPUDEVICE);
+    }
+
+    Matrix<double> GetGradient(const wstring& name) const
+    {
+        return Matrix<double>(dynamic_pointer_cast<ComputationNode<double>>(m_net->GetNodeFromName(name))->Gradient(), CPUDEVICE);
+    }
+
+private:
+    ComputationNodePtr Parameter(ComputationNetworkBuilder<double>& builder, const wstring& name, size_t rows, size_t cols, unsigned long randomSeed)
+    {
+        auto node = builder.CreateLearnableParameter(name, rows, cols);
+        node->Value().SetValue(Matrix<double>::RandomUniform(rows, cols, -0.5, 0.5, randomSeed, CPUDEVICE));
+        return node;
+    }
+
+    ComputationNetworkPtr m_net;
+    ComputationNodePtr m_features, m_targets, m_output;
+    ComputationNodeBasePtr m_criterion;
+};
+
+// the fused kernels evaluate the same expressions in the same order per element, up to rounding of the derivatives
+static void CheckEqual(const Matrix<double>& fused, const Matrix<double>& unfused, const string& what)
+{
+    BOOST_REQUIRE_EQUAL(fused.GetNumRows(), unfused.GetNumRows());
+    BOOST_REQUIRE_EQUAL(fused.GetNumCols(), unfused.GetNumCols());
+    for (size_t j = 0; j < unfused.GetNumCols(); j++)
+        for (size_t i = 0; i < unfused.GetNumRows(); i++)
+            BOOST_CHECK_MESSAGE(fabs(fused(i, j) - unfused(i, j)) <= 1e-10 * (1 + fabs(unfused(i, j))),
+                                what << " (" << i << "," << j << "): " << fused(i, j) << " vs. " << unfused(i, j));
+}
+
+BOOST_AUTO_TEST_SUITE(ElementwiseFusionSuite)
+
+BOOST_AUTO_TEST_CASE(FusedElementwiseNodesMatchUnfused)
+{
+    FusionTestNetwork fused(true);
+    FusionTestNetwork unfused(false);
+
+    auto hiddenGroup = fused.GetFusedGroup(L"h");
+    auto outputGroup = fused.GetFusedGroup(L"output");
+    BOOST_REQUIRE(hiddenGroup && outputGroup);
+    BOOST_CHECK_EQUAL(hiddenGroup->GetMembers().size(), (size_t) 6);
+    BOOST_CHECK_EQUAL(outputGroup->GetMembers().size(), (size_t) 4);
+    BOOST_CHECK(!unfused.GetFusedGroup(L"h") && !unfused.GetFusedGroup(L"output"));
+
+    for (unsigned long minibatch = 0; minibatch < 3; minibatch++)
+    {
+        fused.RunMinibatch(100 + 2 * minibatch);
+        unfused.RunMinibatch(100 + 2 * minibatch);
+        BOOST_CHECK(hiddenGroup->LastForwardWasFused() && outputGroup->LastForwardWasFused());
+
+        string what = "minibatch " + to_string(minibatch);
+        CheckEqual(fused.GetValue(L"h"), unfused.GetValue(L"h"), what + ": h");
+        CheckEqual(fused.GetValue(L"output"), unfused.GetValue(L"output"), what + ": output");
+        CheckEqual(fused.GetValue(L"criterion"), unfused.GetValue(L"criterion"), what + ": criterion");
+        for (const auto& name : {L"W1", L"W2", L"b1", L"b2", L"V", L"c"})
+            CheckEqual(fused.GetGradient(name), unfused.GetGradient(name), what + ": gradient of " + msra::strfun::utf8(name));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
@@ -0,0 +1,205 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// EvalBatcherTests.cpp -- EvalBatcher against a stub model, so that no network is needed
+//
+#include "stdafx.h"
+#include "EvalBatcher.h"
+#include <atomic>
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+static const size_t inputDim = 2;
+
+// A stub context whose output for a sample is the sum of its two inputs, plus 1000 times the position
+// of the sample in its sequence, so that packing sequences wrongly changes the result.
+// A negative input makes the evaluation fail, like a bad model would.
+class StubContext : public IEvaluateContext<float>
+{
+public:
+    StubContext(std::atomic<size_t>& numEvaluations)
+        : m_numEvaluations(numEvaluations)
+    {
+    }
+
+    virtual void Destroy() override
+    {
+        delete this;
+    }
+
+    virtual void Evaluate(const float* const inputs[], float* const outputs[], size_t numSamples) override
+    {
+        EvaluateSequences(inputs, outputs, std::vector<size_t>(1, numSamples));
+    }
+
+    virtual void EvaluateSequences(const float* const inputs[], float* const outputs[], const std::vector<size_t>& sequenceLengths) override
+    {
+        m_numEvaluations++;
+        size_t j = 0;
+        for (auto length : sequenceLengths)
+        {
+            for (size_t t = 0; t < length; t++, j++)
+            {
+                if (inputs[0][inputDim * j] < 0 || inputs[0][inputDim * j + 1] < 0)
+                    throw std::runtime_error("StubContext: negative input"); // (not RuntimeError(), which prints a call stack)
+                outputs[0][j] = inputs[0][inputDim * j] + inputs[0][inputDim * j + 1] + 1000 * t;
+            }
+        }
+    }
+
+private:
+    std::atomic<size_t>& m_numEvaluations;
+};
+
+class StubModel : public IEvaluateModel<float>
+{
+public:
+    virtual void Init(const std::string&) override
+    {
+    }
+    virtual void Destroy() override
+    {
+    }
+    virtual void LoadModel(const std::wstring&) override
+    {
+    }
+    virtual void GetNodeDimensions(std::map<std::wstring, size_t>& dimensions, NodeGroup) override
+    {
+        dimensions[L"features"] = inputDim;
+        dimensions[L"output"] = 1;
+    }
+    virtual void StartEvaluateMinibatchLoop(const std::wstring&) override
+    {
+    }
+    virtual void Evaluate(std::map<std::wstring, std::vector<float>*>&, std::map<std::wstring, std::vector<float>*>&) override
+    {
+        LogicError("StubModel: use a context");
+    }
+    virtual void ResetState() override
+    {
+    }
+    virtual IEvaluateContext<float>* CreateContext(const std::vector<std::wstring>&, const std::vector<std::wstring>&) override
+    {
+        return new StubContext(m_numEvaluations);
+    }
+
+    std::atomic<size_t> m_numEvaluations{0};
+};
+
+// one client: evaluates sequences of length 1 to 3 and checks the results; 'failEvery' > 0 makes every failEvery-th request fail
+static void RunClient(EvalBatcher<float>& batcher, size_t client, size_t numRequests, size_t failEvery, size_t& numFailed)
+{
+    numFailed = 0;
+    for (size_t r = 0; r < numRequests; r++)
+    {
+        size_t numSamples = 1 + (client + r) % 3;
+        bool fail = failEvery > 0 && r % failEvery == failEvery - 1;
+        std::vector<float> input(inputDim * numSamples), output(numSamples, -1);
+        for (size_t j = 0; j < input.size(); j++)
+            input[j] = (float) (client * 10 + j);
+        if (fail)
+            input.back() = -1;
+        const float* inputs[] = {input.data()};
+        float* outputs[] = {output.data()};
+        try
+        {
+            batcher.Evaluate(inputs, outputs, numSamples);
+            BOOST_CHECK(!fail);
+            for (size_t t = 0; t < numSamples; t++)
+                BOOST_CHECK_EQUAL(output[t], input[inputDim * t] + input[inputDim * t + 1] + 1000 * t);
+        }
+        catch (const std::exception&)
+        {
+            numFailed++;
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(EvalBatcherSuite)
+
+BOOST_AUTO_TEST_CASE(EvalBatcherConcurrentClients)
+{
+    StubModel model;
+    EvalBatcherOptions options;
+    options.maxBatchSamples = 16;
+    options.maxWaitMilliseconds = 5;
+    options.numWorkers = 2;
+    const size_t numClients = 8, numRequests = 200;
+    {
+        EvalBatcher<float> batcher(model, {L"features"}, {L"output"}, options);
+        std::vector<std::thread> clients;
+        std::vector<size_t> numFailed(numClients);
+        for (size_t c = 0; c < numClients; c++)
+            clients.push_back(std::thread([&, c]()
+                                          {
+                                              RunClient(batcher, c, numRequests, 0, numFailed[c]);
+                                          }));
+        for (auto& client : clients)
+            client.join();
+        for (auto n : numFailed)
+            BOOST_CHECK_EQUAL(n, 0);
+        batcher.PrintStatistics(stderr);
+    }
+    // concurrent requests must have been batched
+    BOOST_CHECK_LT(model.m_numEvaluations.load(), numClients * numRequests);
+}
+
+BOOST_AUTO_TEST_CASE(EvalBatcherFailingRequests)
+{
+    StubModel model;
+    EvalBatcherOptions options;
+    options.maxBatchSamples = 16;
+    options.maxWaitMilliseconds = 5;
+    const size_t numClients = 4, numRequests = 100, failEvery = 10;
+    EvalBatcher<float> batcher(model, {L"features"}, {L"output"}, options);
+    std::vector<std::thread> clients;
+    std::vector<size_t> numFailed(numClients);
+    for (size_t c = 0; c < numClients; c++)
+        clients.push_back(std::thread([&, c]()
+                                      {
+                                          RunClient(batcher, c, numRequests, failEvery, numFailed[c]);
+                                      }));
+    for (auto& client : clients)
+        client.join();
+    // every failing request gets the error, and requests batched with it may fail too, but all complete
+    for (auto n : numFailed)
+        BOOST_CHECK_GE(n, numRequests / failEvery);
+
+    // the batcher still works after the errors
+    size_t numFailedAfterwards;
+    RunClient(batcher, 0, 10, 0, numFailedAfterwards);
+    BOOST_CHECK_EQUAL(numFailedAfterwards, 0);
+}
+
+BOOST_AUTO_TEST_CASE(EvalBatcherStatistics)
+{
+    StubModel model;
+    EvalBatcher<float> batcher(model, {L"features"}, {L"output"});
+    size_t numFailed;
+    RunClient(batcher, 0, 1000, 0, numFailed);
+    BOOST_CHECK_EQUAL(numFailed, 0);
+
+    FILE* f = tmpfile();
+    BOOST_REQUIRE(f != nullptr);
+    batcher.PrintStatistics(f);
+    rewind(f);
+    char line[1000];
+    BOOST_REQUIRE(fgets(line, sizeof(line), f) != nullptr);
+    BOOST_CHECK(strstr(line, "1000 requests in 1000 batches") != nullptr);
+    fclose(f);
+
+    batcher.ResetStatistics();
+    f = tmpfile();
+    BOOST_REQUIRE(f != nullptr);
+    batcher.PrintStatistics(f);
+    rewind(f);
+    BOOST_REQUIRE(fgets(line, sizeof(line), f) != nullptr);
+    BOOST_CHECK(strstr(line, "No requests") != nullptr);
+    fclose(f);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
@@ -0,0 +1,193 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// EvalContextTests.cpp -- evaluation contexts (CNTKEvalContext) used concurrently against evaluating the model itself
+//
+#include "stdafx.h"
+#include "../../../Source/EvalDll/CNTKEvalContext.h"
+#include <random>
+#include <thread>
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+static const size_t inputDim = 6;
+static const size_t hiddenDim = 5;
+static const size_t outputDim = 4;
+static const size_t numRequests = 16;
+static const size_t maxRequestLength = 9;
+static const size_t numContexts = 4;
+
+// h = Tanh(W * features + R * PastValue(h) + b), output = Sigmoid(V * h + c)
+// The recurrence makes the result depend on where each request's sequence starts.
+static ComputationNetworkPtr CreateNetwork()
+{
+    auto net = make_shared<ComputationNetwork>(CPUDEVICE);
+    ComputationNetworkBuilder<double> builder(*net);
+    auto features = builder.CreateInputNode(L"features", inputDim);
+    net->FeatureNodes().push_back(features);
+    auto parameter = [&](const wstring& name, size_t rows, size_t cols, unsigned long randomSeed)
+    {
+        auto node = builder.CreateLearnableParameter(name, rows, cols);
+        node->Value().SetValue(Matrix<double>::RandomUniform(rows, cols, -0.5, 0.5, randomSeed, CPUDEVICE));
+        return node;
+    };
+    auto prevH = builder.PastValue(nullptr, 0.1f, hiddenDim, 1);
+    auto h = builder.Tanh(builder.Plus(builder.Plus(builder.Times(parameter(L"W", hiddenDim, inputDim, 1), features),
+                                                    builder.Times(parameter(L"R", hiddenDim, hiddenDim, 2), prevH)),
+                                       parameter(L"b", hiddenDim, 1, 3)),
+                          L"h");
+    prevH->AttachInputs(h);
+    auto output = builder.Sigmoid(builder.Plus(builder.Times(parameter(L"V", outputDim, hiddenDim, 4), h), parameter(L"c", outputDim, 1, 5)), L"output");
+    net->OutputNodes().push_back(output);
+    net->OutputNodes().push_back(h); // (so that it gets an evaluation order of its own)
+    net->CompileNetwork();
+    return net;
+}
+
+struct Request
+{
+    size_t numSamples;
+    vector<double> features;
+};
+
+static vector<Request> CreateRequests()
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> length(1, maxRequestLength);
+    std::uniform_real_distribution<double> value(-1, 1);
+    vector<Request> requests(numRequests);
+    for (auto& request : requests)
+    {
+        request.numSamples = length(rng);
+        request.features.resize(inputDim * request.numSamples);
+        for (auto& x : request.features)
+            x = value(rng);
+    }
+    return requests;
+}
+
+// the outputs 'output' and 'h' of a request, concatenated
+typedef vector<double> Result;
+
+// evaluate each request as one sequence directly on the model's network
+static vector<Result> EvaluateOnNetwork(ComputationNetwork& net, const vector<Request>& requests)
+{
+    auto features = dynamic_pointer_cast<ComputationNode<double>>(net.GetNodeFromName(L"features"));
+    vector<ComputationNodeBasePtr> outputNodes = {net.GetNodeFromName(L"output"), net.GetNodeFromName(L"h")};
+    net.AllocateAllMatrices({}, outputNodes, nullptr);
+    net.StartEvaluateMinibatchLoop(outputNodes);
+
+    vector<Result> results;
+    for (const auto& request : requests)
+    {
+        auto pMBLayout = net.GetMBLayoutPtr();
+        pMBLayout->Init(1, request.numSamples);
+        pMBLayout->AddSequence(0, 0, 0, request.numSamples);
+        features->Value().SetValue(inputDim, request.numSamples, CPUDEVICE, const_cast<double*>(request.features.data()), matrixFlagNormal);
+        net.NotifyInputNodesFunctionValuesMBSizeModified();
+        ComputationNetwork::BumpEvalTimeStamp(net.FeatureNodes());
+        Result result;
+        for (const auto& node : outputNodes)
+        {
+            net.ForwardProp(node);
+            const auto& value = dynamic_pointer_cast<ComputationNode<double>>(node)->Value();
+            size_t offset = result.size();
+            size_t size = value.GetNumElements();
+            result.resize(offset + size);
+            double* data = &result[offset];
+            value.CopyToArray(data, size);
+        }
+        results.push_back(result);
+    }
+    return results;
+}
+
+// evaluate the requests in the given order with a context; results are in request order
+static vector<Result> EvaluateOnContext(IEvaluateContext<double>& context, const vector<Request>& requests, size_t firstRequest)
+{
+    vector<Result> results(requests.size());
+    for (size_t k = 0; k < requests.size(); k++)
+    {
+        size_t r = (firstRequest + k) % requests.size();
+        const auto& request = requests[r];
+        auto& result = results[r];
+        result.resize((outputDim + hiddenDim) * request.numSamples);
+        const double* inputs[] = {request.features.data()};
+        double* outputs[] = {result.data(), result.data() + outputDim * request.numSamples};
+        context.Evaluate(inputs, outputs, request.numSamples);
+    }
+    return results;
+}
+
+// the contexts run the same nodes on the same shared parameters, so the results are the same up to rounding
+static void CheckEqual(const vector<Result>& actual, const vector<Result>& expected, const string& what)
+{
+    BOOST_REQUIRE_EQUAL(actual.size(), expected.size());
+    for (size_t r = 0; r < expected.size(); r++)
+    {
+        BOOST_REQUIRE_EQUAL(actual[r].size(), expected[r].size());
+        for (size_t i = 0; i < expected[r].size(); i++)
+            BOOST_CHECK_MESSAGE(fabs(actual[r][i] - expected[r][i]) <= 1e-12 * (1 + fabs(expected[r][i])),
+                                what << ", request " << r << " [" << i << "]: " << actual[r][i] << " vs. " << expected[r][i]);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(EvalContextSuite)
+
+BOOST_AUTO_TEST_CASE(ConcurrentContextsMatchSingleContext)
+{
+    auto requests = CreateRequests();
+    auto net = CreateNetwork();
+    auto expected = EvaluateOnNetwork(*net, requests);
+
+    // one context, alone
+    {
+        CNTKEvalContext<double> context(*net, {L"features"}, {L"output", L"h"});
+        CheckEqual(EvaluateOnContext(context, requests, 0), expected, "single context");
+    }
+
+    // several contexts on their own threads, each starting at a different request, several times over
+    vector<unique_ptr<CNTKEvalContext<double>>> contexts;
+    for (size_t k = 0; k < numContexts; k++)
+        contexts.emplace_back(new CNTKEvalContext<double>(*net, {L"features"}, {L"output", L"h"}));
+    for (size_t pass = 0; pass < 3; pass++)
+    {
+        vector<vector<Result>> results(numContexts);
+        vector<string> errors(numContexts); // (Boost.Test assertions must not be used from other threads)
+        vector<std::thread> threads;
+        for (size_t k = 0; k < numContexts; k++)
+        {
+            threads.emplace_back([&, k]()
+                                 {
+                                     try
+                                     {
+                                         results[k] = EvaluateOnContext(*contexts[k], requests, k * numRequests / numContexts);
+                                     }
+                                     catch (const std::exception& e)
+                                     {
+                                         errors[k] = e.what();
+                                     }
+                                 });
+        }
+        for (auto& thread : threads)
+            thread.join();
+        for (size_t k = 0; k < numContexts; k++)
+        {
+            string what = "pass " + to_string(pass) + ", context " + to_string(k);
+            BOOST_REQUIRE_MESSAGE(errors[k].empty(), what << ": " << errors[k]);
+            CheckEqual(results[k], expected, what);
+        }
+    }
+
+    // the contexts share the parameters instead of copying them
+    auto W = dynamic_pointer_cast<ComputationNode<double>>(net->GetNodeFromName(L"W"));
+    W->Value().SetValue(0);
+    auto changed = EvaluateOnNetwork(*net, requests);
+    CheckEqual(EvaluateOnContext(*contexts[0], requests, 0), changed, "after changing W");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
@@ -0,0 +1,324 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// LSTMNodeTests.cpp -- compare the fused LSTMNode and GRUNode against the same layers built from primitive nodes
+//
+#include "stdafx.h"
+#include "RecurrentNodes.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+static const size_t inputDim = 5;
+static const size_t cellDim = 4;
+static const size_t numParallelSequences = 3;
+static const size_t numTimeSteps = 5;
+static const double initialActivation = 0.1;
+
+// one recurrent layer with the criterion |h - targets|^2 / 2, either as a fused node or built from primitive nodes
+// Both get the same parameter values, so that their outputs and gradients can be compared.
+class RecurrentLayerTestNetwork
+{
+protected:
+    typedef shared_ptr<ComputationNode<double>> ComputationNodePtr;
+
+    RecurrentLayerTestNetwork(bool fused, size_t outputDim)
+        : m_net(make_shared<ComputationNetwork>(CPUDEVICE)), m_fused(fused), m_outputDim(outputDim)
+    {
+        ComputationNetworkBuilder<double> builder(*m_net);
+        m_features = builder.CreateInputNode(L"features", inputDim);
+        m_targets = builder.CreateInputNode(L"targets", outputDim);
+        m_net->FeatureNodes().push_back(m_features);
+        m_net->FeatureNodes().push_back(m_targets);
+    }
+
+    // add the criterion of m_output and prepare the network for training
+    void Compile()
+    {
+        ComputationNetworkBuilder<double> builder(*m_net);
+        m_criterion = builder.SquareError(m_targets, m_output, L"criterion");
+        m_net->FinalCriterionNodes().push_back(m_criterion);
+        m_net->OutputNodes().push_back(m_output);
+
+        m_net->CompileNetwork();
+        m_net->AllocateAllMatrices({}, {m_output}, m_criterion);
+        m_net->StartEvaluateMinibatchLoop(m_criterion);
+    }
+
+public:
+    virtual ~RecurrentLayerTestNetwork()
+    {
+    }
+
+    // forward and backward for one minibatch; the features and targets are a function of the minibatch and frame only
+    void RunMinibatch(const function<void(MBLayout&)>& initLayout, unsigned long randomSeed)
+    {
+        auto pMBLayout = m_net->GetMBLayoutPtr();
+        initLayout(*pMBLayout);
+        const size_t numCols = pMBLayout->GetNumCols();
+        m_features->Value().SetValue(Matrix<double>::RandomUniform(inputDim, numCols, -1, 1, randomSeed, CPUDEVICE));
+        m_targets->Value().SetValue(Matrix<double>::RandomUniform(m_outputDim, numCols, -1, 1, randomSeed + 1, CPUDEVICE));
+        m_net->NotifyInputNodesFunctionValuesMBSizeModified();
+        ComputationNetwork::BumpEvalTimeStamp(m_net->FeatureNodes());
+        m_net->ForwardProp(m_criterion);
+        m_net->Backprop(m_criterion);
+    }
+
+    map<wstring, NodeStatePtr> ExportState()
+    {
+        map<wstring, NodeStatePtr> states;
+        for (const auto& node : m_net->GetEvalOrder(m_criterion))
+        {
+            auto statefulNode = dynamic_pointer_cast<IStatefulNode>(node);
+            if (statefulNode)
+                states[node->NodeName()] = statefulNode->ExportState();
+        }
+        return states;
+    }
+
+    void ImportState(const map<wstring, NodeStatePtr>& states)
+    {
+        for (const auto& state : states)
+            dynamic_pointer_cast<IStatefulNode>(m_net->GetNodeFromName(state.first))->ImportState(state.second);
+    }
+
+    // the output of the layer, with the gaps set to 0
+    Matrix<double> GetOutput() const
+    {
+        Matrix<double> output(m_output->Value(), CPUDEVICE);
+        ComputationNode<double>::MaskMissingColumnsToZero(output, m_net->GetMBLayoutPtr(), FrameRange(m_net->GetMBLayoutPtr()));
+        return output;
+    }
+
+    double GetCriterion() const
+    {
+        return m_criterion->Get00Element();
+    }
+
+    // the names of the parameters whose gradients are compared
+    virtual vector<wstring> GetParameterNames() const = 0;
+
+    virtual Matrix<double> GetGradient(const wstring& name) const
+    {
+        return Matrix<double>(dynamic_pointer_cast<ComputationNode<double>>(m_net->GetNodeFromName(name))->Gradient(), CPUDEVICE);
+    }
+
+protected:
+    ComputationNodePtr Parameter(ComputationNetworkBuilder<double>& builder, const wstring& name, size_t rows, size_t cols, unsigned long randomSeed)
+    {
+        auto node = builder.CreateLearnableParameter(name, rows, cols);
+        node->Value().SetValue(Matrix<double>::RandomUniform(rows, cols, -0.5, 0.5, randomSeed, CPUDEVICE));
+        return node;
+    }
+
+    ComputationNetworkPtr m_net;
+    bool m_fused;
+    size_t m_outputDim;
+    ComputationNodePtr m_features, m_targets, m_output;
+    ComputationNodeBasePtr m_criterion;
+};
+
+// an LSTMNode, or the LSTMPComponent macro
+class LSTMTestNetwork : public RecurrentLayerTestNetwork
+{
+public:
+    LSTMTestNetwork(bool fused, size_t outputDim)
+        : RecurrentLayerTestNetwork(fused, outputDim)
+    {
+        ComputationNetworkBuilder<double> builder(*m_net);
+        auto W = Parameter(builder, L"W", 4 * cellDim, inputDim, 1);
+        auto R = Parameter(builder, L"R", 4 * cellDim, outputDim, 2);
+        auto b = Parameter(builder, L"b", 4 * cellDim, 1, 3);
+        auto peepholes = Matrix<double>::RandomUniform(cellDim, 3, -0.5, 0.5, 4, CPUDEVICE);
+        auto projection = HasProjection() ? Parameter(builder, L"projection", outputDim, cellDim, 5) : nullptr;
+
+        if (fused)
+        {
+            m_peepholes[0] = Parameter(builder, L"peepholes", cellDim, 3, 0);
+            m_peepholes[0]->Value().SetValue(peepholes);
+            m_output = builder.LSTM(m_features, W, R, b, m_peepholes[0], projection, (float) initialActivation, L"output");
+        }
+        else
+        {
+            // this is LSTMPComponent of Examples/Speech/AN4/Config/lstmp-3layer-opt.ndl, with the peepholes as three vectors
+            for (size_t k = 0; k < 3; k++)
+            {
+                m_peepholes[k] = Parameter(builder, msra::strfun::wstrprintf(L"peepholes%d", (int) k), cellDim, 1, 0);
+                m_peepholes[k]->Value().SetValue(peepholes.ColumnSlice(k, 1));
+            }
+            auto prevOutput = builder.PastValue(nullptr, (float) initialActivation, outputDim, 1);
+            auto prevCell = builder.PastValue(nullptr, (float) initialActivation, cellDim, 1);
+            auto gates = builder.Plus(builder.Plus(builder.Times(W, m_features), b), builder.Times(R, prevOutput));
+            auto i = builder.Sigmoid(builder.Plus(builder.RowSlice(gates, 0, cellDim), builder.ElementTimes(m_peepholes[0], prevCell)));
+            auto g = builder.Tanh(builder.RowSlice(gates, cellDim, cellDim));
+            auto f = builder.Sigmoid(builder.Plus(builder.RowSlice(gates, 2 * cellDim, cellDim), builder.ElementTimes(m_peepholes[1], prevCell)));
+            auto cell = builder.Plus(builder.ElementTimes(f, prevCell), builder.ElementTimes(i, g));
+            auto o = builder.Sigmoid(builder.Plus(builder.RowSlice(gates, 3 * cellDim, cellDim), builder.ElementTimes(m_peepholes[2], cell)));
+            auto cellOutput = builder.ElementTimes(o, builder.Tanh(cell));
+            m_output = HasProjection() ? builder.Times(projection, cellOutput, L"output") : cellOutput;
+            prevOutput->AttachInputs(m_output);
+            prevCell->AttachInputs(cell);
+        }
+        Compile();
+    }
+
+    bool HasProjection() const
+    {
+        return m_outputDim != cellDim;
+    }
+
+    vector<wstring> GetParameterNames() const override
+    {
+        vector<wstring> parameters = {L"W", L"R", L"b", L"peepholes"};
+        if (HasProjection())
+            parameters.push_back(L"projection");
+        return parameters;
+    }
+
+    // for the peepholes, the three vectors are stacked into the columns of one matrix
+    Matrix<double> GetGradient(const wstring& name) const override
+    {
+        if (name != L"peepholes" || m_fused)
+            return RecurrentLayerTestNetwork::GetGradient(name);
+        Matrix<double> gradient(cellDim, 3, CPUDEVICE);
+        for (size_t k = 0; k < 3; k++)
+            gradient.SetColumnSlice(m_peepholes[k]->Gradient(), k, 1);
+        return gradient;
+    }
+
+private:
+    ComputationNodePtr m_peepholes[3]; // the fused node has all three in m_peepholes[0]
+};
+
+// a GRUNode, or the same GRU from primitive nodes
+class GRUTestNetwork : public RecurrentLayerTestNetwork
+{
+public:
+    GRUTestNetwork(bool fused, size_t outputDim)
+        : RecurrentLayerTestNetwork(fused, outputDim)
+    {
+        ComputationNetworkBuilder<double> builder(*m_net);
+        auto W = Parameter(builder, L"W", 3 * outputDim, inputDim, 1);
+        auto R = Parameter(builder, L"R", 3 * outputDim, outputDim, 2);
+        auto b = Parameter(builder, L"b", 3 * outputDim, 1, 3);
+
+        if (fused)
+            m_output = builder.GRU(m_features, W, R, b, (float) initialActivation, L"output");
+        else
+        {
+            // the reset gate is applied to the recurrent product, as in GRUNode
+            auto prevOutput = builder.PastValue(nullptr, (float) initialActivation, outputDim, 1);
+            auto gates = builder.Plus(builder.Times(W, m_features), b);
+            auto recurrent = builder.Times(R, prevOutput);
+            auto r = builder.Sigmoid(builder.Plus(builder.RowSlice(gates, 0, outputDim), builder.RowSlice(recurrent, 0, outputDim)));
+            auto z = builder.Sigmoid(builder.Plus(builder.RowSlice(gates, outputDim, outputDim), builder.RowSlice(recurrent, outputDim, outputDim)));
+            auto n = builder.Tanh(builder.Plus(builder.RowSlice(gates, 2 * outputDim, outputDim), builder.ElementTimes(r, builder.RowSlice(recurrent, 2 * outputDim, outputDim))));
+            // (1 - z) .* n + z .* h(t-1)
+            m_output = builder.Plus(n, builder.ElementTimes(z, builder.Minus(prevOutput, n)), L"output");
+            prevOutput->AttachInputs(m_output);
+        }
+        Compile();
+    }
+
+    vector<wstring> GetParameterNames() const override
+    {
+        return {L"W", L"R", L"b"};
+    }
+};
+
+static void CheckEqual(const Matrix<double>& fused, const Matrix<double>& primitive, const string& what)
+{
+    BOOST_REQUIRE_EQUAL(fused.GetNumRows(), primitive.GetNumRows());
+    BOOST_REQUIRE_EQUAL(fused.GetNumCols(), primitive.GetNumCols());
+    for (size_t j = 0; j < fused.GetNumCols(); j++)
+        for (size_t i = 0; i < fused.GetNumRows(); i++)
+            BOOST_CHECK_MESSAGE(fabs(fused(i, j) - primitive(i, j)) <= 1e-10 * (1 + fabs(primitive(i, j))),
+                                what << " (" << i << "," << j << "): " << fused(i, j) << " vs. " << primitive(i, j));
+}
+
+static void CheckEqual(RecurrentLayerTestNetwork& fused, RecurrentLayerTestNetwork& primitive, const string& what)
+{
+    BOOST_CHECK_CLOSE(fused.GetCriterion(), primitive.GetCriterion(), 1e-8);
+    CheckEqual(fused.GetOutput(), primitive.GetOutput(), what + ": output");
+    for (const auto& name : fused.GetParameterNames())
+        CheckEqual(fused.GetGradient(name), primitive.GetGradient(name), what + ": gradient of " + msra::strfun::utf8(name));
+}
+
+// Two minibatches of 3 parallel sequences with sequences that start and end within the minibatch,
+// sequences that continue into the next minibatch (so the state is carried over and the gradient
+// is truncated there), and a gap at the end of a parallel sequence.
+static void InitFirstMinibatch(MBLayout& layout)
+{
+    layout.Init(numParallelSequences, numTimeSteps);
+    layout.AddSequence(NEW_SEQUENCE_ID, 0, 0, numTimeSteps + 1); // continues into the second minibatch
+    layout.AddSequence(NEW_SEQUENCE_ID, 1, 0, 3);
+    layout.AddGap(1, 3, numTimeSteps);
+    layout.AddSequence(NEW_SEQUENCE_ID, 2, 0, 2);
+    layout.AddSequence(NEW_SEQUENCE_ID, 2, 2, numTimeSteps + 3); // continues into the second minibatch
+}
+
+static void InitSecondMinibatch(MBLayout& layout)
+{
+    layout.Init(numParallelSequences, numTimeSteps);
+    layout.AddSequence(NEW_SEQUENCE_ID, 0, -(ptrdiff_t) numTimeSteps, 1);
+    layout.AddSequence(NEW_SEQUENCE_ID, 0, 1, numTimeSteps);
+    layout.AddSequence(NEW_SEQUENCE_ID, 1, 0, numTimeSteps);
+    layout.AddSequence(NEW_SEQUENCE_ID, 2, -3, 3);
+    layout.AddGap(2, 3, numTimeSteps);
+}
+
+static void TestAgainstPrimitives(RecurrentLayerTestNetwork& fused, RecurrentLayerTestNetwork& primitive)
+{
+    fused.RunMinibatch(InitFirstMinibatch, 10);
+    primitive.RunMinibatch(InitFirstMinibatch, 10);
+    CheckEqual(fused, primitive, "first minibatch");
+
+    // the state carried over into the second minibatch, as sub-minibatching exports and re-imports it
+    auto fusedState = fused.ExportState();
+    auto primitiveState = primitive.ExportState();
+    BOOST_REQUIRE(!fusedState.empty());
+
+    fused.RunMinibatch(InitSecondMinibatch, 20);
+    primitive.RunMinibatch(InitSecondMinibatch, 20);
+    CheckEqual(fused, primitive, "second minibatch");
+    auto fusedOutput = fused.GetOutput();
+
+    // running the second minibatch again from the imported state gives the same result
+    fused.ImportState(fusedState);
+    primitive.ImportState(primitiveState);
+    fused.RunMinibatch(InitSecondMinibatch, 20);
+    primitive.RunMinibatch(InitSecondMinibatch, 20);
+    CheckEqual(fused, primitive, "second minibatch after ImportState");
+    CheckEqual(fused.GetOutput(), fusedOutput, "second minibatch repeated");
+}
+
+static void TestLSTMNodeAgainstPrimitives(size_t outputDim)
+{
+    LSTMTestNetwork fused(true, outputDim);
+    LSTMTestNetwork primitive(false, outputDim);
+    TestAgainstPrimitives(fused, primitive);
+}
+
+BOOST_AUTO_TEST_SUITE(LSTMNodeSuite)
+
+BOOST_AUTO_TEST_CASE(LSTMNodeMatchesPrimitives)
+{
+    TestLSTMNodeAgainstPrimitives(cellDim);
+}
+
+BOOST_AUTO_TEST_CASE(LSTMNodeWithProjectionMatchesPrimitives)
+{
+    TestLSTMNodeAgainstPrimitives(3);
+}
+
+BOOST_AUTO_TEST_CASE(GRUNodeMatchesPrimitives)
+{
+    GRUTestNetwork fused(true, cellDim);
+    GRUTestNetwork primitive(false, cellDim);
+    TestAgainstPrimitives(fused, primitive);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
@@ -0,0 +1,197 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// LatticeForwardBackwardTests.cpp -- the CPU lattice forward-backward of sequence training gives the same results on 1 and N threads
+//
+#include "stdafx.h"
+#include "simplesenonehmm.h"
+#include "latticearchive.h"
+#include "ssematrix.h"
+#include <omp.h>
+#include <random>
+
+using namespace msra::lattices;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+static const size_t numUnits = 4;     // sil, a, b, c; 3 states each
+static const size_t framesPerNode = 6; // nodes are at t = 0, 6, 12, ...
+static const size_t numNodes = 9;
+static const size_t numFrames = (numNodes - 1) * framesPerNode;
+static const float lmf = 7.0f;
+static const float wp = 0.0f;
+static const float amf = 7.0f;
+
+// the header of a V1 lattice file, as lattice::fread() expects it
+struct LatticeHeaderV1
+{
+    size_t numnodes : 32;
+    size_t numedges : 32;
+    float lmf;
+    float wp;
+    double frameduration;
+    size_t numframes : 32;
+    size_t impliedspunitid : 31;
+    size_t hasacscores : 1;
+};
+
+// left-to-right HMMs with 3 states and their own senones
+static void InitHmms(msra::asr::simplesenonehmm& hset)
+{
+    static const char* names[numUnits] = {"sil", "a", "b", "c"};
+    hset.transPs.resize(1);
+    auto& transP = hset.transPs[0];
+    transP.resize(3);
+    for (int from = -1; from < 3; from++)
+        for (size_t to = 0; to <= 3; to++)
+            transP(from, to) = from == -1 ? (to == 0 ? 0.0f : -1e30f) : (to == (size_t) from || to == (size_t) from + 1 ? logf(0.5f) : -1e30f);
+    hset.hmms.resize(numUnits);
+    for (size_t i = 0; i < numUnits; i++)
+    {
+        auto& hmm = hset.hmms[i];
+        hmm.name = names[i];
+        hmm.transP = &transP;
+        hmm.transPindex = 0;
+        hmm.numstates = 3;
+        for (size_t s = 0; s < 3; s++)
+            hmm.senoneids[s] = (unsigned short) (3 * i + s);
+        hset.symmap[names[i]] = i;
+    }
+}
+
+// A lattice with nodes every 6 frames, and between them three words of one node (6 frames) and two words of two nodes
+// (12 frames), with alignments of up to three units. The edges are sorted by end node, then start node, as the code expects.
+static void InitLattice(lattice& lat)
+{
+    std::vector<nodeinfo> nodes;
+    for (size_t i = 0; i < numNodes; i++)
+        nodes.push_back(nodeinfo(i * framesPerNode));
+    std::vector<edgeinfowithscores> edges;
+    std::vector<aligninfo> align;
+    auto addEdge = [&](size_t S, size_t E, float l, const std::vector<std::pair<size_t, size_t>>& units)
+    {
+        edges.push_back(edgeinfowithscores(S, E, 0, l, align.size()));
+        for (const auto& unit : units)
+            align.push_back(aligninfo(unit.first, unit.second));
+    };
+    for (size_t E = 1; E < numNodes; E++)
+    {
+        if (E >= 2)
+        {
+            addEdge(E - 2, E, -2.0f, {{1, 4}, {0, 4}, {2, 4}});
+            addEdge(E - 2, E, -2.5f, {{3, 12}});
+        }
+        addEdge(E - 1, E, -1.0f, {{1, 3}, {2, 3}});
+        addEdge(E - 1, E, -1.5f, {{2, 6}});
+        addEdge(E - 1, E, -0.5f, {{0, 6}});
+    }
+
+    LatticeHeaderV1 header;
+    header.numnodes = nodes.size();
+    header.numedges = edges.size();
+    header.lmf = lmf;
+    header.wp = wp;
+    header.frameduration = 0.01;
+    header.numframes = numFrames;
+    header.impliedspunitid = INT_MAX;
+    header.hasacscores = 0;
+
+    FILE* f = tmpfile();
+    BOOST_REQUIRE(f != nullptr);
+    fputTag(f, "LAT ");
+    fputint(f, 1);
+    fwriteOrDie(&header, sizeof(header), 1, f);
+    fputTag(f, "NODE");
+    fputint(f, (int) nodes.size());
+    fwriteOrDie(nodes, f);
+    fputTag(f, "EDGE");
+    fputint(f, (int) edges.size());
+    fwriteOrDie(edges, f);
+    fputTag(f, "ALIG");
+    fputint(f, (int) align.size());
+    fwriteOrDie(align, f);
+    fputTag(f, "END ");
+    rewind(f);
+    std::vector<size_t> idmap;
+    for (size_t i = 0; i < numUnits; i++)
+        idmap.push_back(i);
+    lat.fread(f, idmap, SIZE_MAX);
+    fclose(f);
+    lat.setverbosity(0);
+}
+
+// the forward-backward of the lattice on 'numThreads' OpenMP threads; returns the average log posterior
+// (MMI) or frame accuracy (sMBR), and the denominator gammas or the error signal in 'result'
+static double ForwardBackward(const lattice& lat, const msra::asr::simplesenonehmm& hset, const msra::dbn::matrix& logLLs,
+                              bool sMBRmode, std::vector<size_t>& uids, int numThreads, msra::dbn::matrix& result)
+{
+    int maxThreads = omp_get_max_threads();
+    omp_set_num_threads(numThreads);
+    lattice::parallelstate parallelstate; // (no GPU, so the CPU code runs)
+    result.resize(logLLs.rows(), logLLs.cols());
+    result.setzero();
+    msra::dbn::matrix errorsignalbuf;
+    double result0 = lat.forwardbackward(parallelstate, logLLs, hset, result, errorsignalbuf, lmf, wp, amf, 0.0f, sMBRmode,
+                                         array_ref<size_t>(uids.data(), uids.size()));
+    omp_set_num_threads(maxThreads);
+    return result0;
+}
+
+static void TestForwardBackwardOnThreads(bool sMBRmode)
+{
+    msra::asr::simplesenonehmm hset;
+    InitHmms(hset);
+    lattice lat;
+    InitLattice(lat);
+    BOOST_REQUIRE_EQUAL(lat.getnumframes(), numFrames);
+
+    msra::dbn::matrix logLLs(3 * numUnits, numFrames);
+    std::mt19937 rng(0);
+    std::uniform_real_distribution<float> dist(-5, 0);
+    foreach_coord (i, t, logLLs)
+        logLLs(i, t) = dist(rng);
+    // the reference: the word "b" of 6 frames throughout, its states 2 frames each
+    std::vector<size_t> uids(numFrames);
+    for (size_t t = 0; t < numFrames; t++)
+        uids[t] = hset.gethmm(2).getsenoneid((t % framesPerNode) / 2);
+
+    msra::dbn::matrix serialResult, parallelResult;
+    double serial = ForwardBackward(lat, hset, logLLs, sMBRmode, uids, 1, serialResult);
+    BOOST_REQUIRE_GT(serial, -1e10); // (LOGZERO if no path was found)
+    if (!sMBRmode) // the denominator gammas of a frame sum up to 1
+    {
+        for (size_t t = 0; t < numFrames; t++)
+        {
+            double sum = 0;
+            for (size_t i = 0; i < serialResult.rows(); i++)
+                sum += serialResult(i, t);
+            BOOST_CHECK_CLOSE(sum, 1.0, 1e-3);
+        }
+    }
+
+    for (int numThreads : {2, 3, 8})
+    {
+        double parallel = ForwardBackward(lat, hset, logLLs, sMBRmode, uids, numThreads, parallelResult);
+        BOOST_CHECK_EQUAL(parallel, serial);
+        size_t numDifferent = 0;
+        foreach_coord (i, t, serialResult)
+            numDifferent += parallelResult(i, t) != serialResult(i, t);
+        BOOST_CHECK_MESSAGE(numDifferent == 0, numDifferent << " values differ between 1 and " << numThreads << " threads");
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(LatticeForwardBackwardSuite)
+
+BOOST_AUTO_TEST_CASE(LatticeForwardBackwardMMIThreads)
+{
+    TestForwardBackwardOnThreads(false);
+}
+
+BOOST_AUTO_TEST_CASE(LatticeForwardBackwardSMBRThreads)
+{
+    TestForwardBackwardOnThreads(true);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
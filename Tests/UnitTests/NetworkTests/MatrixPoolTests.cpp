@@ -0,0 +1,108 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// MatrixPoolTests.cpp -- allocating the matrices of a network in several passes, and again after deleting nodes
+//
+#include "stdafx.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+static const size_t inputDim = 6;
+static const size_t hiddenDim = 5;
+static const size_t outputDim = 4;
+static const size_t numSamples = 3;
+
+// h = Sigmoid(W1 * features), out1 = W2 * h + b, out2 = Tanh(W3 * h)
+static ComputationNetworkPtr CreateNetwork()
+{
+    auto net = make_shared<ComputationNetwork>(CPUDEVICE);
+    ComputationNetworkBuilder<double> builder(*net);
+    auto features = builder.CreateInputNode(L"features", inputDim);
+    net->FeatureNodes().push_back(features);
+    auto parameter = [&](const wstring& name, size_t rows, size_t cols, unsigned long randomSeed)
+    {
+        auto node = builder.CreateLearnableParameter(name, rows, cols);
+        node->Value().SetValue(Matrix<double>::RandomUniform(rows, cols, -1, 1, randomSeed, CPUDEVICE));
+        return node;
+    };
+    auto h = builder.Sigmoid(builder.Times(parameter(L"W1", hiddenDim, inputDim, 1), features), L"h");
+    auto out1 = builder.Plus(builder.Times(parameter(L"W2", outputDim, hiddenDim, 2), h, L"W2h"), parameter(L"b", outputDim, 1, 3), L"out1");
+    auto out2 = builder.Tanh(builder.Times(parameter(L"W3", outputDim, hiddenDim, 4), h, L"W3h"), L"out2");
+    net->OutputNodes().push_back(out1);
+    net->OutputNodes().push_back(out2);
+    net->CompileNetwork();
+    return net;
+}
+
+static Matrix<double> Evaluate(ComputationNetwork& net, const wstring& outputName)
+{
+    ComputationNodeBasePtr output = net.GetNodeFromName(outputName);
+    net.StartEvaluateMinibatchLoop(output);
+    net.GetMBLayoutPtr()->InitAsFrameMode(numSamples);
+    auto features = dynamic_pointer_cast<ComputationNode<double>>(net.GetNodeFromName(L"features"));
+    features->Value().SetValue(Matrix<double>::RandomUniform(inputDim, numSamples, -1, 1, 10, CPUDEVICE));
+    net.NotifyInputNodesFunctionValuesMBSizeModified();
+    ComputationNetwork::BumpEvalTimeStamp(net.FeatureNodes());
+    net.ForwardProp(output);
+    return Matrix<double>(dynamic_pointer_cast<ComputationNode<double>>(output)->Value(), CPUDEVICE);
+}
+
+static void CheckEqual(const Matrix<double>& actual, const Matrix<double>& expected)
+{
+    BOOST_REQUIRE_EQUAL(actual.GetNumRows(), expected.GetNumRows());
+    BOOST_REQUIRE_EQUAL(actual.GetNumCols(), expected.GetNumCols());
+    for (size_t j = 0; j < expected.GetNumCols(); j++)
+        for (size_t i = 0; i < expected.GetNumRows(); i++)
+            BOOST_CHECK_EQUAL(actual(i, j), expected(i, j));
+}
+
+BOOST_AUTO_TEST_SUITE(MatrixPoolSuite)
+
+// the second pass adds only the buffers of its own nodes, and both outputs are computed as with one pass
+BOOST_AUTO_TEST_CASE(MatrixPoolAllocateTwice)
+{
+    auto reference = CreateNetwork();
+    reference->AllocateAllMatrices({reference->GetNodeFromName(L"out1"), reference->GetNodeFromName(L"out2")}, {}, nullptr);
+
+    auto net = CreateNetwork();
+    net->AllocateAllMatrices({net->GetNodeFromName(L"out1")}, {}, nullptr);
+    size_t numBuffers = net->GetMatrixPool().GetNumBuffers();
+    net->AllocateAllMatrices({net->GetNodeFromName(L"out2")}, {}, nullptr);
+    BOOST_CHECK_GT(net->GetMatrixPool().GetNumBuffers(), numBuffers);
+    BOOST_CHECK_LE(net->GetMatrixPool().GetNumBuffers(), numBuffers + 2); // (at most one each for W3h and out2)
+
+    // allocating what is already allocated adds nothing
+    numBuffers = net->GetMatrixPool().GetNumBuffers();
+    net->AllocateAllMatrices({net->GetNodeFromName(L"out2")}, {}, nullptr);
+    BOOST_CHECK_EQUAL(net->GetMatrixPool().GetNumBuffers(), numBuffers);
+
+    CheckEqual(Evaluate(*net, L"out1"), Evaluate(*reference, L"out1"));
+    CheckEqual(Evaluate(*net, L"out2"), Evaluate(*reference, L"out2"));
+}
+
+// the buffers of deleted nodes are dropped by the next pass
+BOOST_AUTO_TEST_CASE(MatrixPoolForgetsDeletedNodes)
+{
+    auto reference = CreateNetwork();
+    reference->AllocateAllMatrices({reference->GetNodeFromName(L"out1")}, {}, nullptr);
+
+    auto net = CreateNetwork();
+    net->AllocateAllMatrices({net->GetNodeFromName(L"out1"), net->GetNodeFromName(L"out2")}, {}, nullptr);
+    size_t numBuffers = net->GetMatrixPool().GetNumBuffers();
+    net->DeleteNode(L"out2");
+    net->DeleteNode(L"W3h");
+    net->DeleteNode(L"W3");
+    net->CompileNetwork();
+    net->AllocateAllMatrices({net->GetNodeFromName(L"out1")}, {}, nullptr);
+    BOOST_CHECK_LT(net->GetMatrixPool().GetNumBuffers(), numBuffers);
+    for (const auto& sharers : net->GetMatrixPool().GetBufferSharers())
+        BOOST_CHECK(std::find(sharers.begin(), sharers.end(), L"out2") == sharers.end());
+
+    CheckEqual(Evaluate(*net, L"out1"), Evaluate(*reference, L"out1"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
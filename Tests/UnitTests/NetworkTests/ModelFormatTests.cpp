@@ -0,0 +1,192 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// ModelFormatTests.cpp -- saving a network and loading it back, with bulk reads and memory-mapped, and from a version 2 model
+//
+#include "stdafx.h"
+#include "InputAndParamNodes.h"
+#include "PreComputeNodes.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+static const size_t inputDim = 6;
+static const size_t outputDim = 4;
+static const wstring modelPath = L"ModelFormatTests.dnn";
+static const wstring legacyModelPath = L"ModelFormatTests.v2.dnn";
+
+// W * (features - mean) + b, where mean is a precomputed node
+static ComputationNetworkPtr CreateNetwork()
+{
+    auto net = make_shared<ComputationNetwork>(CPUDEVICE);
+    ComputationNetworkBuilder<double> builder(*net);
+    auto features = builder.CreateInputNode(L"features", inputDim);
+    net->FeatureNodes().push_back(features);
+    auto W = builder.CreateLearnableParameter(L"W", outputDim, inputDim);
+    W->Value().SetValue(Matrix<double>::RandomUniform(outputDim, inputDim, -1, 1, 1, CPUDEVICE));
+    auto b = builder.CreateLearnableParameter(L"b", TensorShape(outputDim));
+    b->Value().SetValue(Matrix<double>::RandomUniform(outputDim, 1, -1, 1, 2, CPUDEVICE));
+    auto mean = builder.Mean(features, L"mean");
+    auto output = builder.Plus(builder.Times(W, builder.Minus(features, mean)), b, L"output");
+    net->OutputNodes().push_back(output);
+    net->CompileNetwork();
+    dynamic_pointer_cast<PreComputedNodeBase<double>>(mean)->SideLoadFromMatrix(Matrix<double>::RandomUniform(inputDim, 1, -1, 1, 3, CPUDEVICE));
+    return net;
+}
+
+// the nodes whose values are stored in the model
+static vector<shared_ptr<ComputationNode<double>>> GetStoredNodes(const ComputationNetwork& net)
+{
+    vector<shared_ptr<ComputationNode<double>>> nodes;
+    for (const auto& node : net.GetAllNodes())
+    {
+        if (dynamic_pointer_cast<LearnableParameter<double>>(node) || dynamic_pointer_cast<PreComputedNodeBase<double>>(node))
+            nodes.push_back(dynamic_pointer_cast<ComputationNode<double>>(node));
+    }
+    return nodes;
+}
+
+// save 'net' in the format of CNTK_MODEL_VERSION_2, where values are stored as generic matrices
+// This is ComputationNetwork::SaveToFileImpl() as it was before CNTK_MODEL_VERSION_3, for a network without pair nodes.
+static void SaveVersion2(const ComputationNetwork& net, const wstring& fileName)
+{
+    File fstream(fileName, FileOptions::fileOptionsBinary | FileOptions::fileOptionsWrite);
+    fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BCN");
+    fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BVersion");
+    fstream << (size_t) CNTK_MODEL_VERSION_2;
+    fstream.PutMarker(FileMarker::fileMarkerEndSection, L"EVersion");
+
+    auto nodes = net.GetAllNodes();
+    fstream << nodes.size();
+    fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BNodeList");
+    for (const auto& node : nodes)
+    {
+        auto preComputed = dynamic_pointer_cast<PreComputedNodeBase<double>>(node);
+        if (dynamic_pointer_cast<LearnableParameter<double>>(node))
+        {
+            fstream << node->OperationName() << node->NodeName();
+            fstream << node->IsParameterUpdateRequired() << (size_t) 0 << (size_t) 0;
+            node->GetSampleLayout().Save(fstream);
+            fstream << dynamic_pointer_cast<ComputationNode<double>>(node)->Value();
+        }
+        else if (preComputed)
+        {
+            fstream << node->OperationName() << node->NodeName();
+            fstream << preComputed->HasComputed();
+            fstream << dynamic_pointer_cast<ComputationNode<double>>(node)->Value();
+        }
+        else
+            node->Save(fstream);
+    }
+    fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ENodeList");
+
+    fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BRelation");
+    for (const auto& node : nodes)
+    {
+        fstream << node->NodeName() << node->GetNumInputs();
+        for (size_t i = 0; i < node->GetNumInputs(); i++)
+            fstream << node->Input(i)->NodeName();
+    }
+    fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ERelation");
+
+    auto saveRootNodes = [&](const wchar_t* begin, const wchar_t* end, const vector<ComputationNodeBasePtr>& rootNodes)
+    {
+        fstream.PutMarker(FileMarker::fileMarkerBeginSection, begin);
+        fstream << rootNodes.size();
+        for (const auto& node : rootNodes)
+            fstream << node->NodeName();
+        fstream.PutMarker(FileMarker::fileMarkerEndSection, end);
+    };
+    auto& mutableNet = const_cast<ComputationNetwork&>(net); // (the accessors are not const)
+    fstream.PutMarker(FileMarker::fileMarkerBeginSection, L"BRootNodes");
+    saveRootNodes(L"BFeatureNodes", L"EFeatureNodes", mutableNet.FeatureNodes());
+    saveRootNodes(L"BLabelNodes", L"ELabelNodes", mutableNet.LabelNodes());
+    saveRootNodes(L"BCriterionNodes", L"ECriterionNodes", mutableNet.FinalCriterionNodes());
+    saveRootNodes(L"BEvalNodes", L"EEvalNodes", mutableNet.EvaluationNodes());
+    saveRootNodes(L"BOutputNodes", L"EOutputNodes", mutableNet.OutputNodes());
+    fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ERootNodes");
+    fstream.PutMarker(FileMarker::fileMarkerEndSection, L"ECN");
+    fstream.Flush();
+}
+
+static ComputationNetworkPtr LoadNetwork(const wstring& fileName, bool memoryMapped)
+{
+    auto net = make_shared<ComputationNetwork>(CPUDEVICE);
+    int fileOptions = FileOptions::fileOptionsBinary | (memoryMapped ? FileOptions::fileOptionsMemoryMapped : 0);
+    net->Load<double>(fileName, (FileOptions) fileOptions);
+    return net;
+}
+
+// the loaded network has the same nodes, and the stored values are bit-identical
+static void CheckSameNetwork(const ComputationNetwork& loaded, const ComputationNetwork& original)
+{
+    BOOST_REQUIRE_EQUAL(loaded.GetAllNodes().size(), original.GetAllNodes().size());
+    auto originalNodes = GetStoredNodes(original);
+    BOOST_REQUIRE_EQUAL(GetStoredNodes(loaded).size(), originalNodes.size());
+    for (const auto& originalNode : originalNodes)
+    {
+        const wstring& name = originalNode->NodeName();
+        BOOST_REQUIRE(loaded.NodeNameExists(name));
+        auto node = dynamic_pointer_cast<ComputationNode<double>>(loaded.GetNodeFromName(name));
+        BOOST_CHECK(node->OperationName() == originalNode->OperationName());
+        if (dynamic_pointer_cast<LearnableParameter<double>>(node)) // (precomputed nodes load their values as matrices, see PreComputedNodeBase::Load())
+            BOOST_CHECK(node->GetSampleLayout() == originalNode->GetSampleLayout());
+        const auto& value = node->Value();
+        const auto& originalValue = originalNode->Value();
+        BOOST_REQUIRE_EQUAL(value.GetNumRows(), originalValue.GetNumRows());
+        BOOST_REQUIRE_EQUAL(value.GetNumCols(), originalValue.GetNumCols());
+        BOOST_CHECK_MESSAGE(memcmp(value.BufferPointer(), originalValue.BufferPointer(), value.GetNumElements() * sizeof(double)) == 0,
+                            "the value of " << msra::strfun::utf8(name) << " differs");
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(ModelFormatSuite)
+
+BOOST_AUTO_TEST_CASE(ModelFormatRoundTrip)
+{
+    auto original = CreateNetwork();
+    original->Save(modelPath);
+
+    auto loaded = LoadNetwork(modelPath, false);
+    CheckSameNetwork(*loaded, *original);
+    for (const auto& node : GetStoredNodes(*loaded))
+        BOOST_CHECK(node->Value().OwnBuffer());
+
+    // memory-mapped: the values point into the page-aligned tensors of the file
+    auto mapped = LoadNetwork(modelPath, true);
+    CheckSameNetwork(*mapped, *original);
+    for (const auto& node : GetStoredNodes(*mapped))
+    {
+        BOOST_CHECK(!node->Value().OwnBuffer());
+        BOOST_CHECK_EQUAL((size_t) node->Value().BufferPointer() % CNTK_MODEL_TENSOR_ALIGNMENT, 0);
+    }
+
+    // writing to a mapped value does not change the file
+    auto W = dynamic_pointer_cast<ComputationNode<double>>(mapped->GetNodeFromName(L"W"));
+    W->Value().SetValue(0);
+    mapped = nullptr;
+    CheckSameNetwork(*LoadNetwork(modelPath, true), *original);
+
+    unlinkOrDie(modelPath);
+}
+
+BOOST_AUTO_TEST_CASE(ModelFormatConvertVersion2)
+{
+    auto original = CreateNetwork();
+    SaveVersion2(*original, legacyModelPath);
+    auto legacy = LoadNetwork(legacyModelPath, false);
+    CheckSameNetwork(*legacy, *original);
+
+    // what the convertModel action does: load the old model and save it in the current format
+    legacy->Save(modelPath);
+    CheckSameNetwork(*LoadNetwork(modelPath, false), *original);
+    CheckSameNetwork(*LoadNetwork(modelPath, true), *original);
+
+    unlinkOrDie(legacyModelPath);
+    unlinkOrDie(modelPath);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
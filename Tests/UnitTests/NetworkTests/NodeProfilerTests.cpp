@@ -0,0 +1,112 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// NodeProfilerTests.cpp -- the per-node statistics of NodeProfiler cover every node of the traversal
+//
+#include "stdafx.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+static const size_t inputDim = 6;
+static const size_t hiddenDim = 5;
+static const size_t outputDim = 4;
+static const size_t numSamples = 7;
+static const size_t numMinibatches = 3;
+
+// h = Tanh(W * features + R * PastValue(h) + b) and g = Sigmoid(U * features), with the criterion |V * (h .* g) - targets|^2 / 2
+// This has a recurrent loop, which is timed as a whole, and a branch beside it for the concurrent traversal.
+static ComputationNetworkPtr CreateNetwork(size_t numThreads)
+{
+    auto net = make_shared<ComputationNetwork>(CPUDEVICE);
+    ComputationNetworkBuilder<double> builder(*net);
+    auto features = builder.CreateInputNode(L"features", inputDim);
+    auto targets = builder.CreateInputNode(L"targets", outputDim);
+    net->FeatureNodes().push_back(features);
+    net->FeatureNodes().push_back(targets);
+    auto parameter = [&](const wstring& name, size_t rows, size_t cols, unsigned long randomSeed)
+    {
+        auto node = builder.CreateLearnableParameter(name, rows, cols);
+        node->Value().SetValue(Matrix<double>::RandomUniform(rows, cols, -0.5, 0.5, randomSeed, CPUDEVICE));
+        return node;
+    };
+    auto prevH = builder.PastValue(nullptr, 0.1f, hiddenDim, 1);
+    auto h = builder.Tanh(builder.Plus(builder.Plus(builder.Times(parameter(L"W", hiddenDim, inputDim, 1), features),
+                                                    builder.Times(parameter(L"R", hiddenDim, hiddenDim, 2), prevH)),
+                                       parameter(L"b", hiddenDim, 1, 3)));
+    prevH->AttachInputs(h);
+    auto g = builder.Sigmoid(builder.Times(parameter(L"U", hiddenDim, inputDim, 4), features));
+    auto output = builder.Times(parameter(L"V", outputDim, hiddenDim, 5), builder.ElementTimes(h, g), L"output");
+    auto criterion = builder.SquareError(targets, output, L"criterion");
+    net->FinalCriterionNodes().push_back(criterion);
+    net->OutputNodes().push_back(output);
+
+    size_t savedNumThreads = g_parallelTraversalThreads;
+    g_parallelTraversalThreads = numThreads;
+    net->CompileNetwork();
+    net->AllocateAllMatrices({}, {output}, criterion);
+    g_parallelTraversalThreads = savedNumThreads;
+    return net;
+}
+
+static void RunMinibatches(ComputationNetwork& net, size_t numThreads)
+{
+    ComputationNodeBasePtr criterion = net.GetNodeFromName(L"criterion");
+    net.StartEvaluateMinibatchLoop(criterion);
+    size_t savedNumThreads = g_parallelTraversalThreads;
+    g_parallelTraversalThreads = numThreads;
+    for (unsigned long minibatch = 0; minibatch < numMinibatches; minibatch++)
+    {
+        auto pMBLayout = net.GetMBLayoutPtr();
+        pMBLayout->Init(1, numSamples);
+        pMBLayout->AddSequence(0, 0, 0, numSamples);
+        auto features = dynamic_pointer_cast<ComputationNode<double>>(net.GetNodeFromName(L"features"));
+        auto targets = dynamic_pointer_cast<ComputationNode<double>>(net.GetNodeFromName(L"targets"));
+        features->Value().SetValue(Matrix<double>::RandomUniform(inputDim, numSamples, -1, 1, 100 + 2 * minibatch, CPUDEVICE));
+        targets->Value().SetValue(Matrix<double>::RandomUniform(outputDim, numSamples, 0, 1, 101 + 2 * minibatch, CPUDEVICE));
+        net.NotifyInputNodesFunctionValuesMBSizeModified();
+        ComputationNetwork::BumpEvalTimeStamp(net.FeatureNodes());
+        net.ForwardProp(criterion);
+        net.Backprop(criterion);
+    }
+    g_parallelTraversalThreads = savedNumThreads;
+}
+
+BOOST_AUTO_TEST_SUITE(NodeProfilerSuite)
+
+// Every node of the top-level (PAR) traversal is reported, the loop under its own name, with one call per minibatch.
+// Leaves have nothing to compute forward; backprop visits all nodes.
+BOOST_AUTO_TEST_CASE(NodeProfilerReportsEveryNode)
+{
+    for (size_t numThreads : {(size_t) 0, (size_t) 2})
+    {
+        auto net = CreateNetwork(numThreads);
+        auto profiler = make_shared<NodeProfiler>(0);
+        net->SetNodeProfiler(profiler);
+        RunMinibatches(*net, numThreads);
+        net->SetNodeProfiler(nullptr);
+
+        auto statistics = profiler->GetStatistics();
+        auto parNodes = dynamic_pointer_cast<FlowControlNode>(net->GetNestedNetwork(net->GetNodeFromName(L"criterion")))->m_nestedNodes;
+        size_t numLoops = 0;
+        for (const auto& node : parNodes)
+        {
+            string what = "numThreads " + to_string(numThreads) + ", " + msra::strfun::utf8(node->NodeName());
+            numLoops += dynamic_pointer_cast<FlowControlNode>(node) != nullptr;
+            auto iter = statistics.find(node->NodeName());
+            BOOST_REQUIRE_MESSAGE(iter != statistics.end(), what << " is not reported");
+            const auto& s = iter->second;
+            BOOST_CHECK_MESSAGE(s.m_numForwardCalls == (node->IsLeaf() ? 0 : numMinibatches), what << ": " << s.m_numForwardCalls << " forward calls");
+            BOOST_CHECK_MESSAGE(s.m_numBackwardCalls == numMinibatches, what << ": " << s.m_numBackwardCalls << " backward calls");
+            BOOST_CHECK_MESSAGE(s.m_forwardSeconds >= 0 && s.m_backwardSeconds >= 0, what << ": " << s.m_forwardSeconds << " s forward, " << s.m_backwardSeconds << " s backward");
+            BOOST_CHECK_MESSAGE(s.m_flops >= 0 && s.m_bytes >= 0 && s.m_memoryBytes >= 0, what << ": negative cost estimate");
+        }
+        BOOST_CHECK_EQUAL(numLoops, (size_t) 1);
+        BOOST_CHECK_EQUAL(statistics.size(), parNodes.size()); // (nothing else, e.g. the members of the loop)
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
@@ -0,0 +1,152 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// ParallelTraversalTests.cpp -- compare the concurrent traversal of PARTraversalFlowControlNode against the serial one
+//
+#include "stdafx.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+static const size_t inputDim = 6;
+static const size_t hiddenDim = 5;
+static const size_t outputDim = 4;
+static const size_t numTowers = 4;
+static const size_t numSamples = 7;
+
+// sets g_parallelTraversalThreads for the lifetime of the object
+class ParallelTraversalThreads
+{
+public:
+    ParallelTraversalThreads(size_t numThreads)
+        : m_savedNumThreads(g_parallelTraversalThreads)
+    {
+        g_parallelTraversalThreads = numThreads;
+    }
+    ~ParallelTraversalThreads()
+    {
+        g_parallelTraversalThreads = m_savedNumThreads;
+    }
+
+private:
+    size_t m_savedNumThreads;
+};
+
+// independent towers Tanh(W1_k * features + b) whose outputs W2_k * h_k are summed, with the criterion |sum - targets|^2 / 2
+// The bias is shared, so that the towers back-propagate into the same gradient.
+// The execution graphs are built by AllocateAllMatrices() only with g_parallelTraversalThreads > 0.
+class TowerTestNetwork
+{
+    typedef shared_ptr<ComputationNode<double>> ComputationNodePtr;
+
+public:
+    TowerTestNetwork(size_t numThreads)
+        : m_net(make_shared<ComputationNetwork>(CPUDEVICE)), m_numThreads(numThreads)
+    {
+        ComputationNetworkBuilder<double> builder(*m_net);
+        m_features = builder.CreateInputNode(L"features", inputDim);
+        m_targets = builder.CreateInputNode(L"targets", outputDim);
+        m_net->FeatureNodes().push_back(m_features);
+        m_net->FeatureNodes().push_back(m_targets);
+        auto b = Parameter(builder, L"b", hiddenDim, 1, 1);
+        ComputationNodePtr sum;
+        for (size_t k = 0; k < numTowers; k++)
+        {
+            auto W1 = Parameter(builder, msra::strfun::wstrprintf(L"W1_%d", (int) k), hiddenDim, inputDim, 10 + k);
+            auto W2 = Parameter(builder, msra::strfun::wstrprintf(L"W2_%d", (int) k), outputDim, hiddenDim, 20 + k);
+            auto tower = builder.Times(W2, builder.Tanh(builder.Plus(builder.Times(W1, m_features), b)));
+            sum = sum ? builder.Plus(sum, tower) : tower;
+        }
+        m_output = builder.Sigmoid(sum, L"output");
+        m_criterion = builder.SquareError(m_targets, m_output, L"criterion");
+        m_net->FinalCriterionNodes().push_back(m_criterion);
+        m_net->OutputNodes().push_back(m_output);
+
+        ParallelTraversalThreads threads(m_numThreads);
+        m_net->CompileNetwork();
+        m_net->AllocateAllMatrices({}, {m_output}, m_criterion);
+        m_net->StartEvaluateMinibatchLoop(m_criterion);
+    }
+
+    void RunMinibatch(unsigned long randomSeed)
+    {
+        ParallelTraversalThreads threads(m_numThreads);
+        m_net->GetMBLayoutPtr()->InitAsFrameMode(numSamples);
+        m_features->Value().SetValue(Matrix<double>::RandomUniform(inputDim, numSamples, -1, 1, randomSeed, CPUDEVICE));
+        m_targets->Value().SetValue(Matrix<double>::RandomUniform(outputDim, numSamples, 0, 1, randomSeed + 1, CPUDEVICE));
+        m_net->NotifyInputNodesFunctionValuesMBSizeModified();
+        ComputationNetwork::BumpEvalTimeStamp(m_net->FeatureNodes());
+        m_net->ForwardProp(m_criterion);
+        m_net->Backprop(m_criterion);
+    }
+
+    Matrix<double> GetValue(const wstring& name) const
+    {
+        return Matrix<double>(dynamic_pointer_cast<ComputationNode<double>>(m_net->GetNodeFromName(name))->Value(), CPUDEVICE);
+    }
+
+    Matrix<double> GetGradient(const wstring& name) const
+    {
+        return Matrix<double>(dynamic_pointer_cast<ComputationNode<double>>(m_net->GetNodeFromName(name))->Gradient(), CPUDEVICE);
+    }
+
+    vector<wstring> GetParameterNames() const
+    {
+        vector<wstring> names;
+        for (const auto& node : m_net->LearnableParameterNodes(m_criterion))
+            names.push_back(node->NodeName());
+        return names;
+    }
+
+private:
+    ComputationNodePtr Parameter(ComputationNetworkBuilder<double>& builder, const wstring& name, size_t rows, size_t cols, unsigned long randomSeed)
+    {
+        auto node = builder.CreateLearnableParameter(name, rows, cols);
+        node->Value().SetValue(Matrix<double>::RandomUniform(rows, cols, -0.5, 0.5, randomSeed, CPUDEVICE));
+        return node;
+    }
+
+    ComputationNetworkPtr m_net;
+    size_t m_numThreads;
+    ComputationNodePtr m_features, m_targets, m_output;
+    ComputationNodeBasePtr m_criterion;
+};
+
+// the concurrent schedule only reorders independent nodes, so the results are the same up to rounding
+static void CheckEqual(const Matrix<double>& parallel, const Matrix<double>& serial, const string& what)
+{
+    BOOST_REQUIRE_EQUAL(parallel.GetNumRows(), serial.GetNumRows());
+    BOOST_REQUIRE_EQUAL(parallel.GetNumCols(), serial.GetNumCols());
+    for (size_t j = 0; j < serial.GetNumCols(); j++)
+        for (size_t i = 0; i < serial.GetNumRows(); i++)
+            BOOST_CHECK_MESSAGE(fabs(parallel(i, j) - serial(i, j)) <= 1e-12 * (1 + fabs(serial(i, j))),
+                                what << " (" << i << "," << j << "): " << parallel(i, j) << " vs. " << serial(i, j));
+}
+
+BOOST_AUTO_TEST_SUITE(ParallelTraversalSuite)
+
+BOOST_AUTO_TEST_CASE(ParallelTraversalMatchesSerial)
+{
+    TowerTestNetwork serial(0);
+    TowerTestNetwork parallel(numTowers);
+
+    auto parameterNames = serial.GetParameterNames();
+    BOOST_REQUIRE_EQUAL(parameterNames.size(), 2 * numTowers + 1);
+
+    // several minibatches, so that different interleavings of the towers get a chance to occur
+    for (unsigned long minibatch = 0; minibatch < 10; minibatch++)
+    {
+        serial.RunMinibatch(100 + 2 * minibatch);
+        parallel.RunMinibatch(100 + 2 * minibatch);
+        string what = "minibatch " + to_string(minibatch);
+        CheckEqual(parallel.GetValue(L"output"), serial.GetValue(L"output"), what + ": output");
+        CheckEqual(parallel.GetValue(L"criterion"), serial.GetValue(L"criterion"), what + ": criterion");
+        for (const auto& name : parameterNames)
+            CheckEqual(parallel.GetGradient(name), serial.GetGradient(name), what + ": gradient of " + msra::strfun::utf8(name));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
@@ -0,0 +1,142 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// SequencePackerTests.cpp -- the placement, layouts, and order of the minibatches of SequencePacker
+//
+#include "stdafx.h"
+#include "SequencePacker.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+static const size_t numParallelSequences = 4;
+
+// a window of sequence lengths like utterances, with a few long outliers and some empty sequences
+static std::vector<size_t> TestLengths()
+{
+    std::mt19937_64 rng(1);
+    std::vector<size_t> lengths;
+    for (size_t i = 0; i < 200; i++)
+        lengths.push_back(i % 37 == 0 ? 0 : i % 23 == 0 ? 300 + rng() % 200 : 10 + rng() % 100);
+    return lengths;
+}
+
+static std::vector<SequencePacker::Minibatch> PackAll(const std::vector<size_t>& lengths, size_t randomSeed)
+{
+    SequencePacker packer(numParallelSequences);
+    packer.Pack(lengths, randomSeed);
+    std::vector<SequencePacker::Minibatch> minibatches;
+    while (packer.HasMinibatches())
+        minibatches.push_back(packer.NextMinibatch());
+    return minibatches;
+}
+
+BOOST_AUTO_TEST_SUITE(SequencePackerSuite)
+
+BOOST_AUTO_TEST_CASE(SequencePackerPlacesEverySequenceOnce)
+{
+    std::vector<size_t> lengths = TestLengths();
+    std::vector<size_t> numPlaced(lengths.size(), 0);
+    for (const auto& mb : PackAll(lengths, 5))
+    {
+        BOOST_REQUIRE_EQUAL(mb.numValidFrames.size(), numParallelSequences);
+        std::vector<std::vector<bool>> used(numParallelSequences, std::vector<bool>(mb.numTimeSteps, false));
+        for (const auto& placement : mb.sequences)
+        {
+            BOOST_REQUIRE_LT(placement.sequence, lengths.size());
+            BOOST_REQUIRE_LT(placement.s, numParallelSequences);
+            BOOST_CHECK_EQUAL(placement.tEnd - placement.tBegin, lengths[placement.sequence]);
+            BOOST_REQUIRE_LE(placement.tEnd, mb.numTimeSteps);
+            BOOST_CHECK_LE(placement.tEnd, mb.numValidFrames[placement.s]);
+            for (size_t t = placement.tBegin; t < placement.tEnd; t++)
+            {
+                BOOST_CHECK_MESSAGE(!used[placement.s][t], "sequences overlap at stream " << placement.s << ", time step " << t);
+                used[placement.s][t] = true;
+            }
+            numPlaced[placement.sequence]++;
+        }
+        // the streams are filled without holes up to numValidFrames
+        for (size_t s = 0; s < numParallelSequences; s++)
+            for (size_t t = 0; t < mb.numTimeSteps; t++)
+                BOOST_CHECK_EQUAL(used[s][t], t < mb.numValidFrames[s]);
+    }
+    // every sequence exactly once, except the empty ones, which are dropped
+    for (size_t i = 0; i < lengths.size(); i++)
+        BOOST_CHECK_EQUAL(numPlaced[i], lengths[i] > 0 ? 1 : 0);
+}
+
+BOOST_AUTO_TEST_CASE(SequencePackerLayoutGaps)
+{
+    SequencePacker packer(numParallelSequences);
+    packer.Pack(TestLengths(), 5);
+    size_t numGaps = 0;
+    while (packer.HasMinibatches())
+    {
+        SequencePacker::Minibatch mb = packer.NextMinibatch();
+        MBLayout layout;
+        packer.GetLayout(mb, layout);
+        BOOST_CHECK_EQUAL(layout.GetNumParallelSequences(), numParallelSequences);
+        BOOST_CHECK_EQUAL(layout.GetNumTimeSteps(), mb.numTimeSteps);
+
+        // one gap from numValidFrames[s] to the end of each stream that is not full, and the sequences otherwise
+        std::vector<size_t> gapBegin(numParallelSequences, mb.numTimeSteps);
+        size_t numSequences = 0;
+        for (const auto& seq : layout.GetAllSequences())
+        {
+            if (seq.seqId == GAP_SEQUENCE_ID)
+            {
+                BOOST_CHECK_EQUAL(gapBegin[seq.s], mb.numTimeSteps); // (at most one per stream)
+                BOOST_CHECK_EQUAL(seq.tEnd, mb.numTimeSteps);
+                gapBegin[seq.s] = seq.tBegin;
+                numGaps++;
+            }
+            else
+                numSequences++;
+        }
+        BOOST_CHECK_EQUAL(numSequences, mb.sequences.size());
+        for (size_t s = 0; s < numParallelSequences; s++)
+            BOOST_CHECK_EQUAL(gapBegin[s], mb.numValidFrames[s]);
+    }
+    BOOST_CHECK_GT(numGaps, 0); // (the test lengths do not pack perfectly)
+
+    // the statistics count the frames of the layouts
+    BOOST_CHECK_LT(packer.GetNumValidFrames(), packer.GetNumFrames());
+    BOOST_CHECK_CLOSE(packer.GetPaddingEfficiency(), (double) packer.GetNumValidFrames() / packer.GetNumFrames(), 1e-10);
+}
+
+BOOST_AUTO_TEST_CASE(SequencePackerShuffleIsDeterministic)
+{
+    std::vector<size_t> lengths = TestLengths();
+    auto order = [](const std::vector<SequencePacker::Minibatch>& minibatches)
+    {
+        std::vector<size_t> firstSequences;
+        for (const auto& mb : minibatches)
+            firstSequences.push_back(mb.sequences.front().sequence);
+        return firstSequences;
+    };
+    auto first = order(PackAll(lengths, 5));
+    BOOST_CHECK(order(PackAll(lengths, 5)) == first);
+
+    // another seed hands out the same minibatches in another order
+    auto other = order(PackAll(lengths, 6));
+    BOOST_CHECK(other != first);
+    std::sort(first.begin(), first.end());
+    std::sort(other.begin(), other.end());
+    BOOST_CHECK(other == first);
+}
+
+BOOST_AUTO_TEST_CASE(SequencePackerDropsEmptySequences)
+{
+    BOOST_CHECK(PackAll(std::vector<size_t>(5, 0), 1).empty());
+
+    auto minibatches = PackAll({0, 3, 0}, 1);
+    BOOST_REQUIRE_EQUAL(minibatches.size(), 1);
+    BOOST_REQUIRE_EQUAL(minibatches[0].sequences.size(), 1);
+    BOOST_CHECK_EQUAL(minibatches[0].sequences[0].sequence, 1);
+    BOOST_CHECK_EQUAL(minibatches[0].numTimeSteps, 3);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
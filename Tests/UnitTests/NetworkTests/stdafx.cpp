@@ -0,0 +1,16 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+// stdafx.cpp : source file that includes just the standard includes
+//
+#define BOOST_TEST_MODULE NetworkTests
+#include "stdafx.h"
+
+#include "MPIWrapper.h"
+
+// globals that the network library expects the executable to define (cf. CNTK.cpp)
+Microsoft::MSR::CNTK::MPIWrapper* g_mpi = nullptr;
+bool g_shareNodeValueMatrices = false;
+size_t g_parallelTraversalThreads = 0;
+bool g_fuseElementwiseNodes = false;
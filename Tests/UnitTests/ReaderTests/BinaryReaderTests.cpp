@@ -0,0 +1,75 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "TimerUtility.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+struct BinaryReaderFixture : ReaderFixture
+{
+    BinaryReaderFixture()
+        : ReaderFixture("/Data")
+    {
+    }
+
+    // reads the whole data set in the given config section, and reports the time it took
+    double TimeReaderTest(const string& testSectionName, const string& outputFileName)
+    {
+        Timer timer;
+        timer.Start();
+        HelperRunReaderTest<float>(
+            testDataPath() + "/Config/BinaryReaderSimpleDataLoop_Config.txt",
+            testDataPath() + "/Control/BinaryReaderSimpleDataLoop_Control.txt",
+            testDataPath() + "/Control/" + outputFileName,
+            testSectionName,
+            "reader",
+            1000,
+            250,
+            1,
+            1,
+            1,
+            0,
+            1);
+        timer.Stop();
+        return timer.ElapsedSeconds();
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(ReaderTestSuite, BinaryReaderFixture)
+
+// The first pass of the UCIFastReader parses the text file and writes the binary cache,
+// later ones (and the BinaryReader itself) read the same minibatches from the memory mapped cache.
+BOOST_AUTO_TEST_CASE(BinaryReaderUCIFastReaderCacheDataLoop)
+{
+    const string cacheFileName = "BinaryReaderSimpleDataLoop_Cache.bin";
+    boost::filesystem::remove(cacheFileName);
+
+    double textSeconds = TimeReaderTest("Simple_Test", "BinaryReaderSimpleDataLoop_Text_Output.txt");
+    BOOST_REQUIRE(boost::filesystem::exists(cacheFileName));
+    BOOST_CHECK(boost::filesystem::file_size(cacheFileName) > 0);
+
+    double cacheSeconds = TimeReaderTest("Simple_Test", "BinaryReaderSimpleDataLoop_Cache_Output.txt");
+    double binarySeconds = TimeReaderTest("Binary_Test", "BinaryReaderSimpleDataLoop_Binary_Output.txt");
+
+    fprintf(stderr, "Reading the data set: UCIFastReader %.4f s (parsing text and writing the cache), UCIFastReader %.4f s (from the cache), BinaryReader %.4f s\n",
+            textSeconds, cacheSeconds, binarySeconds);
+};
+
+// A window smaller than a minibatch, and not a divisor of it, makes minibatches span several views of the cache.
+BOOST_AUTO_TEST_CASE(BinaryReaderSmallWindowDataLoop)
+{
+    const string cacheFileName = "BinaryReaderSimpleDataLoop_Cache.bin";
+    if (!boost::filesystem::exists(cacheFileName))
+        TimeReaderTest("Simple_Test", "BinaryReaderSimpleDataLoop_Text_Output.txt");
+
+    double binarySeconds = TimeReaderTest("Binary_SmallWindow_Test", "BinaryReaderSimpleDataLoop_SmallWindow_Output.txt");
+    fprintf(stderr, "Reading the data set: BinaryReader with a 64-record window %.4f s\n", binarySeconds);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}
+} } }
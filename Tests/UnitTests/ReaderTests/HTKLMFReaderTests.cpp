@@ -388,6 +388,24 @@ BOOST_AUTO_TEST_CASE(HTKMLFReaderSimpleDataLoop22)
         1);
 };
 
+// HTKMLFReaderSimpleDataLoop1 with background chunk read-ahead, which must not change the minibatches
+BOOST_AUTO_TEST_CASE(HTKMLFReaderSimpleDataLoop23)
+{
+    HelperRunReaderTest<float>(
+        testDataPath() + "/Config/HTKMLFReaderSimpleDataLoop23_Config.txt",
+        testDataPath() + "/Control/HTKMLFReaderSimpleDataLoop1_5_11_Control.txt",
+        testDataPath() + "/Control/HTKMLFReaderSimpleDataLoop23_Output.txt",
+        "Simple_Test",
+        "reader",
+        500,
+        250,
+        2,
+        1,
+        1,
+        0,
+        1);
+};
+
 BOOST_AUTO_TEST_SUITE_END()
 }
 } } }
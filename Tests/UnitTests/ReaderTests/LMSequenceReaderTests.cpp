@@ -0,0 +1,100 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+struct LMSequenceReaderFixture : ReaderFixture
+{
+    LMSequenceReaderFixture()
+        : ReaderFixture("/Data")
+    {
+    }
+
+    // a reader with CPU matrices for its input words and next words
+    struct TestReader
+    {
+        TestReader(const ConfigParameters& readerConfig)
+            : m_dataReader(readerConfig), m_features(CPUDEVICE), m_labels(CPUDEVICE)
+        {
+            m_matrices[L"features"] = &m_features;
+            m_matrices[L"labels"] = &m_labels;
+        }
+
+        DataReader<float> m_dataReader;
+        Matrix<float> m_features, m_labels;
+        std::map<std::wstring, Matrix<float>*> m_matrices;
+    };
+
+    ConfigParameters LoadConfig()
+    {
+        string configFileName = testDataPath() + "/Config/LMSequenceReaderSparseInput_Config.txt";
+        std::wstring configFileCommand(L"configFile=" + std::wstring(configFileName.begin(), configFileName.end()));
+        wchar_t* arg[2]{L"CNTK", &configFileCommand[0]};
+        ConfigParameters config;
+        const std::string rawConfigString = ConfigParameters::ParseCommandLine(2, arg, config);
+        config.ResolveVariables(rawConfigString);
+        return config;
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(ReaderTestSuite, LMSequenceReaderFixture)
+
+// With sparseInput, the reader builds the CSC arrays of the one-hot input words itself.
+// The minibatches must hold the same words as the dense one-hot matrices of the same data.
+BOOST_AUTO_TEST_CASE(LMSequenceReaderSparseInput)
+{
+    const size_t mbSize = 4, vocabSize = 10;
+    const ConfigParameters config = LoadConfig();
+    const ConfigParameters denseConfig = config("Dense_Test");
+    const ConfigParameters sparseConfig = config("Sparse_Test");
+    TestReader dense(denseConfig("reader"));
+    TestReader sparse(sparseConfig("reader"));
+    dense.m_dataReader.StartMinibatchLoop(mbSize, 0, requestDataSize);
+    sparse.m_dataReader.StartMinibatchLoop(mbSize, 0, requestDataSize);
+
+    size_t numMinibatches = 0, numWords = 0;
+    for (;;)
+    {
+        // (the reader shuffles the sentences with rand() when it parses the file)
+        srand(1);
+        bool denseMore = dense.m_dataReader.GetMinibatch(dense.m_matrices);
+        srand(1);
+        bool sparseMore = sparse.m_dataReader.GetMinibatch(sparse.m_matrices);
+        BOOST_REQUIRE_EQUAL(sparseMore, denseMore);
+        if (!denseMore)
+            break;
+        numMinibatches++;
+
+        BOOST_REQUIRE_EQUAL(dense.m_features.GetMatrixType(), DENSE);
+        BOOST_REQUIRE_EQUAL(sparse.m_features.GetMatrixType(), SPARSE);
+        BOOST_REQUIRE_EQUAL(sparse.m_features.GetFormat(), matrixFormatSparseCSC);
+        BOOST_REQUIRE_EQUAL(sparse.m_features.GetNumRows(), vocabSize);
+        BOOST_REQUIRE_EQUAL(sparse.m_features.GetNumCols(), dense.m_features.GetNumCols());
+        BOOST_CHECK(sparse.m_labels.IsEqualTo(dense.m_labels)); // (the same sentences in the same order)
+
+        // one 1 per column
+        const size_t numCols = sparse.m_features.GetNumCols();
+        BOOST_CHECK_EQUAL(sparse.m_features.NzCount(), numCols);
+        Matrix<float> sparseAsDense(sparse.m_features, CPUDEVICE);
+        sparseAsDense.SwitchToMatrixType(DENSE, matrixFormatDense, true);
+        BOOST_CHECK(sparseAsDense.IsEqualTo(dense.m_features));
+        for (size_t j = 0; j < numCols; j++)
+        {
+            float sum = 0;
+            for (size_t i = 0; i < vocabSize; i++)
+                sum += sparseAsDense(i, j);
+            BOOST_CHECK_EQUAL(sum, 1);
+        }
+        numWords += numCols;
+    }
+    BOOST_CHECK_GT(numMinibatches, 1);
+    BOOST_CHECK_GT(numWords, 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+} } } }
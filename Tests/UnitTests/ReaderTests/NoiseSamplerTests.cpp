@@ -0,0 +1,95 @@
+//
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
+//
+#include "stdafx.h"
+#include "../../../Source/Readers/LMSequenceReader/NoiseSampler.h"
+
+using namespace Microsoft::MSR::CNTK;
+
+namespace Microsoft { namespace MSR { namespace CNTK { namespace Test {
+
+// Pearson's chi-square statistic of observed counts against the expected probabilities
+static double ChiSquare(const std::vector<size_t>& observed, const noiseSampler<long>& sampler, size_t numSamples)
+{
+    double chiSquare = 0;
+    for (size_t i = 0; i < observed.size(); i++)
+    {
+        double expected = sampler.prob((int) i) * numSamples;
+        if (expected == 0)
+        {
+            BOOST_CHECK_EQUAL(observed[i], 0);
+            continue;
+        }
+        chiSquare += (observed[i] - expected) * (observed[i] - expected) / expected;
+    }
+    return chiSquare;
+}
+
+// unigram counts with a long tail, a dominant word, and a word that never occurs
+static std::vector<double> TestCounts()
+{
+    std::vector<double> counts;
+    for (size_t i = 0; i < 20; i++)
+        counts.push_back(1.0 + i * i);
+    counts.push_back(2000);
+    counts.push_back(0);
+    return counts;
+}
+
+// 0.999 quantile of the chi-square distribution with 20 degrees of freedom (21 words with non-zero counts);
+// the sampler's random generator is seeded with a constant, so the test is deterministic
+static const double chiSquareCriticalValue = 45.31;
+static const size_t numSamples = 200000;
+
+BOOST_AUTO_TEST_SUITE(NoiseSamplerSuite)
+
+BOOST_AUTO_TEST_CASE(NoiseSamplerMatchesUnigram)
+{
+    std::vector<double> counts = TestCounts();
+    noiseSampler<long> sampler(counts);
+
+    std::vector<size_t> observed(counts.size(), 0);
+    for (size_t j = 0; j < numSamples; j++)
+    {
+        int sample = sampler.sample();
+        BOOST_REQUIRE(sample >= 0 && sample < (int) counts.size());
+        observed[sample]++;
+    }
+    BOOST_CHECK_LT(ChiSquare(observed, sampler, numSamples), chiSquareCriticalValue);
+}
+
+BOOST_AUTO_TEST_CASE(NoiseSamplerBatchedMatchesUnigram)
+{
+    std::vector<double> counts = TestCounts();
+    noiseSampler<long> sampler(counts);
+
+    std::vector<size_t> observed(counts.size(), 0);
+    std::vector<int> samples(1000);
+    for (size_t j = 0; j < numSamples; j += samples.size())
+    {
+        sampler.sample(samples.data(), samples.size());
+        for (int sample : samples)
+        {
+            BOOST_REQUIRE(sample >= 0 && sample < (int) counts.size());
+            observed[sample]++;
+        }
+    }
+    BOOST_CHECK_LT(ChiSquare(observed, sampler, numSamples), chiSquareCriticalValue);
+}
+
+BOOST_AUTO_TEST_CASE(NoiseSamplerUniform)
+{
+    std::vector<double> counts = TestCounts();
+    noiseSampler<long> sampler(counts, /*uniform_sampling=*/true);
+
+    std::vector<size_t> observed(counts.size(), 0);
+    for (size_t j = 0; j < numSamples; j++)
+        observed[sampler.sample()]++;
+    // 21 degrees of freedom here, since the word without counts is drawn as well
+    BOOST_CHECK_LT(ChiSquare(observed, sampler, numSamples), 46.80);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+}
+} } }
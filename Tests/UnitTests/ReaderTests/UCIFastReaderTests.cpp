@@ -3,6 +3,7 @@
 // Licensed under the MIT license. See LICENSE.md file in the project root for full license information.
 //
 #include "stdafx.h"
+#include "../../../Source/Readers/UCIFastReader/UCIParser.h"
 
 using namespace Microsoft::MSR::CNTK;
 
@@ -33,8 +34,121 @@ BOOST_AUTO_TEST_CASE(UCIFastReaderSimpleDataLoop)
         1,
         0,
         1);
+}
 
-    BOOST_AUTO_TEST_SUITE_END()
+BOOST_AUTO_TEST_CASE(UCIFastReaderSimpleDataLoopParseThreads1)
+{
+    HelperRunReaderTest<float>(
+        testDataPath() + "/Config/UCIFastReaderSimpleDataLoop_Config.txt",
+        testDataPath() + "/Control/UCIFastReaderSimpleDataLoop_Control.txt",
+        testDataPath() + "/Control/UCIFastReaderSimpleDataLoopParseThreads1_Output.txt",
+        "Simple_Test_ParseThreads1",
+        "reader",
+        500,
+        250,
+        2,
+        1,
+        1,
+        0,
+        1);
 }
+
+BOOST_AUTO_TEST_CASE(UCIFastReaderSimpleDataLoopParseThreads4)
+{
+    HelperRunReaderTest<float>(
+        testDataPath() + "/Config/UCIFastReaderSimpleDataLoop_Config.txt",
+        testDataPath() + "/Control/UCIFastReaderSimpleDataLoop_Control.txt",
+        testDataPath() + "/Control/UCIFastReaderSimpleDataLoopParseThreads4_Output.txt",
+        "Simple_Test_ParseThreads4",
+        "reader",
+        500,
+        250,
+        2,
+        1,
+        1,
+        0,
+        1);
+}
+
+BOOST_AUTO_TEST_CASE(UCIFastReaderMalformedParseThreads1)
+{
+    HelperRunReaderTest<float>(
+        testDataPath() + "/Config/UCIFastReaderMalformed_Config.txt",
+        testDataPath() + "/Control/UCIFastReaderMalformed_Control.txt",
+        testDataPath() + "/Control/UCIFastReaderMalformedParseThreads1_Output.txt",
+        "Malformed_Test_ParseThreads1",
+        "reader",
+        300,
+        100,
+        1,
+        1,
+        1,
+        0,
+        1);
+}
+
+BOOST_AUTO_TEST_CASE(UCIFastReaderMalformedParseThreads4)
+{
+    HelperRunReaderTest<float>(
+        testDataPath() + "/Config/UCIFastReaderMalformed_Config.txt",
+        testDataPath() + "/Control/UCIFastReaderMalformed_Control.txt",
+        testDataPath() + "/Control/UCIFastReaderMalformedParseThreads4_Output.txt",
+        "Malformed_Test_ParseThreads4",
+        "reader",
+        300,
+        100,
+        1,
+        1,
+        1,
+        0,
+        1);
+}
+
+// The reader's buffer is larger than the test files, so the reader tests above parse each file as one chunk.
+// Parse the malformed file directly with small buffers, which splits it into many chunks and puts chunk and
+// buffer boundaries into the middle of numbers, CR LF pairs and empty lines.
+BOOST_AUTO_TEST_CASE(UCIParserMalformedChunks)
+{
+    const std::wstring fileName = L"UCIFastReaderMalformed_Train.txt";
+
+    UCIParser<float, std::string> serialParser;
+    serialParser.ParseInit(fileName.c_str(), 0, 2, 2, 1);
+    std::vector<float> expectedNumbers;
+    std::vector<std::string> expectedLabels;
+    BOOST_CHECK_EQUAL(serialParser.Parse(size_t(-1), &expectedNumbers, &expectedLabels), 300);
+    BOOST_REQUIRE_EQUAL(expectedNumbers.size(), 600);
+    BOOST_REQUIRE_EQUAL(expectedLabels.size(), 300);
+
+    // long numbers and exponents, which take the 8-digits-at-a-time path of the parser
+    BOOST_CHECK_CLOSE(expectedNumbers[0], -0.352334f, 1e-4);
+    BOOST_CHECK_CLOSE(expectedNumbers[2], -0.855127426664914f, 1e-4);
+    BOOST_CHECK_CLOSE(expectedNumbers[4], 94750323160.0f, 1e-4);
+    BOOST_CHECK_CLOSE(expectedNumbers[10], 0.261252e-3f, 1e-4);
+    BOOST_CHECK_CLOSE(expectedNumbers[11], 0.165993809E+2f, 1e-4);
+    BOOST_CHECK_CLOSE(expectedNumbers[16], 12345678.87654321f, 1e-4);
+    BOOST_CHECK_EQUAL(expectedLabels[0], "0");
+    BOOST_CHECK_EQUAL(expectedLabels[1], "1");
+
+    serialParser.SetFilePosition(0);
+    serialParser.SetParseMode(ParseLineCount);
+    BOOST_CHECK_EQUAL(serialParser.Parse(size_t(-1), NULL, NULL), 300);
+
+    for (size_t bufferSize : {64, 97, 256 * 1024})
+    {
+        for (size_t numThreads : {1, 3, 4})
+        {
+            UCIParser<float, std::string> parser;
+            parser.SetParseThreads(numThreads);
+            parser.ParseInit(fileName.c_str(), 0, 2, 2, 1, bufferSize);
+            std::vector<float> numbers;
+            std::vector<std::string> labels;
+            BOOST_CHECK_EQUAL(parser.Parse(size_t(-1), &numbers, &labels), 300);
+            BOOST_CHECK_EQUAL_COLLECTIONS(numbers.begin(), numbers.end(), expectedNumbers.begin(), expectedNumbers.end());
+            BOOST_CHECK_EQUAL_COLLECTIONS(labels.begin(), labels.end(), expectedLabels.begin(), expectedLabels.end());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
 }
 } } }